@@ -0,0 +1,98 @@
+/*
+ * Copyright (c) 2018 Confetti Interactive Inc.
+ * 
+ * This file is part of The-Forge
+ * (see https://github.com/ConfettiFX/The-Forge).
+ * 
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ * 
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+*/
+
+#pragma once
+
+#include <stdint.h>
+
+#if defined(_WIN32)
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN 1
+#endif
+#include <windows.h>
+#include <intrin.h>
+#endif
+
+/************************************************************************/
+// Minimal atomics layer used by the lock-free parts of the OS layer.
+// Read-modify-write operations are sequentially consistent on every
+// platform, loads and stores state the ordering they require.
+/************************************************************************/
+typedef volatile uint32_t  tfrg_atomic32_t;
+typedef volatile uint64_t  tfrg_atomic64_t;
+typedef volatile uintptr_t tfrg_atomicptr_t;
+
+#if defined(_WIN32)
+
+#define tfrg_memorybarrier_full() MemoryBarrier()
+
+static inline uint32_t tfrg_atomic32_load_relaxed(const tfrg_atomic32_t* pVar) { return *pVar; }
+static inline uint32_t tfrg_atomic32_load_acquire(const tfrg_atomic32_t* pVar) { uint32_t value = *pVar; _ReadWriteBarrier(); return value; }
+static inline void tfrg_atomic32_store_relaxed(tfrg_atomic32_t* pVar, uint32_t value) { *pVar = value; }
+static inline void tfrg_atomic32_store_release(tfrg_atomic32_t* pVar, uint32_t value) { _ReadWriteBarrier(); *pVar = value; }
+// Returns the value before the addition
+static inline uint32_t tfrg_atomic32_add(tfrg_atomic32_t* pVar, int32_t value) { return (uint32_t)InterlockedExchangeAdd((volatile LONG*)pVar, (LONG)value); }
+// Returns the value before the exchange, the exchange happened if it equals cmp
+static inline uint32_t tfrg_atomic32_cas(tfrg_atomic32_t* pVar, uint32_t cmp, uint32_t value) { return (uint32_t)InterlockedCompareExchange((volatile LONG*)pVar, (LONG)value, (LONG)cmp); }
+
+static inline uint64_t tfrg_atomic64_load_relaxed(const tfrg_atomic64_t* pVar) { return *pVar; }
+static inline uint64_t tfrg_atomic64_load_acquire(const tfrg_atomic64_t* pVar) { uint64_t value = *pVar; _ReadWriteBarrier(); return value; }
+static inline void tfrg_atomic64_store_relaxed(tfrg_atomic64_t* pVar, uint64_t value) { *pVar = value; }
+static inline void tfrg_atomic64_store_release(tfrg_atomic64_t* pVar, uint64_t value) { _ReadWriteBarrier(); *pVar = value; }
+static inline uint64_t tfrg_atomic64_add(tfrg_atomic64_t* pVar, int64_t value) { return (uint64_t)InterlockedExchangeAdd64((volatile LONG64*)pVar, (LONG64)value); }
+static inline uint64_t tfrg_atomic64_cas(tfrg_atomic64_t* pVar, uint64_t cmp, uint64_t value) { return (uint64_t)InterlockedCompareExchange64((volatile LONG64*)pVar, (LONG64)value, (LONG64)cmp); }
+
+static inline uintptr_t tfrg_atomicptr_load_relaxed(const tfrg_atomicptr_t* pVar) { return *pVar; }
+static inline uintptr_t tfrg_atomicptr_load_acquire(const tfrg_atomicptr_t* pVar) { uintptr_t value = *pVar; _ReadWriteBarrier(); return value; }
+static inline void tfrg_atomicptr_store_relaxed(tfrg_atomicptr_t* pVar, uintptr_t value) { *pVar = value; }
+static inline void tfrg_atomicptr_store_release(tfrg_atomicptr_t* pVar, uintptr_t value) { _ReadWriteBarrier(); *pVar = value; }
+static inline uintptr_t tfrg_atomicptr_cas(tfrg_atomicptr_t* pVar, uintptr_t cmp, uintptr_t value) { return (uintptr_t)InterlockedCompareExchangePointer((volatile PVOID*)pVar, (PVOID)value, (PVOID)cmp); }
+
+#else
+
+#define tfrg_memorybarrier_full() __atomic_thread_fence(__ATOMIC_SEQ_CST)
+
+static inline uint32_t tfrg_atomic32_load_relaxed(const tfrg_atomic32_t* pVar) { return __atomic_load_n(pVar, __ATOMIC_RELAXED); }
+static inline uint32_t tfrg_atomic32_load_acquire(const tfrg_atomic32_t* pVar) { return __atomic_load_n(pVar, __ATOMIC_ACQUIRE); }
+static inline void tfrg_atomic32_store_relaxed(tfrg_atomic32_t* pVar, uint32_t value) { __atomic_store_n(pVar, value, __ATOMIC_RELAXED); }
+static inline void tfrg_atomic32_store_release(tfrg_atomic32_t* pVar, uint32_t value) { __atomic_store_n(pVar, value, __ATOMIC_RELEASE); }
+// Returns the value before the addition
+static inline uint32_t tfrg_atomic32_add(tfrg_atomic32_t* pVar, int32_t value) { return __atomic_fetch_add(pVar, (uint32_t)value, __ATOMIC_SEQ_CST); }
+// Returns the value before the exchange, the exchange happened if it equals cmp
+static inline uint32_t tfrg_atomic32_cas(tfrg_atomic32_t* pVar, uint32_t cmp, uint32_t value) { __atomic_compare_exchange_n(pVar, &cmp, value, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST); return cmp; }
+
+static inline uint64_t tfrg_atomic64_load_relaxed(const tfrg_atomic64_t* pVar) { return __atomic_load_n(pVar, __ATOMIC_RELAXED); }
+static inline uint64_t tfrg_atomic64_load_acquire(const tfrg_atomic64_t* pVar) { return __atomic_load_n(pVar, __ATOMIC_ACQUIRE); }
+static inline void tfrg_atomic64_store_relaxed(tfrg_atomic64_t* pVar, uint64_t value) { __atomic_store_n(pVar, value, __ATOMIC_RELAXED); }
+static inline void tfrg_atomic64_store_release(tfrg_atomic64_t* pVar, uint64_t value) { __atomic_store_n(pVar, value, __ATOMIC_RELEASE); }
+static inline uint64_t tfrg_atomic64_add(tfrg_atomic64_t* pVar, int64_t value) { return __atomic_fetch_add(pVar, (uint64_t)value, __ATOMIC_SEQ_CST); }
+static inline uint64_t tfrg_atomic64_cas(tfrg_atomic64_t* pVar, uint64_t cmp, uint64_t value) { __atomic_compare_exchange_n(pVar, &cmp, value, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST); return cmp; }
+
+static inline uintptr_t tfrg_atomicptr_load_relaxed(const tfrg_atomicptr_t* pVar) { return __atomic_load_n(pVar, __ATOMIC_RELAXED); }
+static inline uintptr_t tfrg_atomicptr_load_acquire(const tfrg_atomicptr_t* pVar) { return __atomic_load_n(pVar, __ATOMIC_ACQUIRE); }
+static inline void tfrg_atomicptr_store_relaxed(tfrg_atomicptr_t* pVar, uintptr_t value) { __atomic_store_n(pVar, value, __ATOMIC_RELAXED); }
+static inline void tfrg_atomicptr_store_release(tfrg_atomicptr_t* pVar, uintptr_t value) { __atomic_store_n(pVar, value, __ATOMIC_RELEASE); }
+static inline uintptr_t tfrg_atomicptr_cas(tfrg_atomicptr_t* pVar, uintptr_t cmp, uintptr_t value) { __atomic_compare_exchange_n(pVar, &cmp, value, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST); return cmp; }
+
+#endif
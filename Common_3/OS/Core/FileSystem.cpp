@@ -25,13 +25,18 @@
 #include "../Interfaces/IFileSystem.h"
 #include "../Math/FloatUtil.h"
 #include "../Interfaces/ILogManager.h"
+#include "../Interfaces/IThread.h"
+#include "../../ThirdParty/OpenSource/TinySTL/flat_hash_map.h"
 #include "../Interfaces/IMemoryManager.h"
 
+#include <ctype.h>
+
 #ifdef __APPLE__
 #include <unistd.h>
 #include <limits.h>  // for UINT_MAX
 #include <sys/stat.h>  // for mkdir
 #include <sys/errno.h> // for errno
+#include <sys/wait.h>  // for waitpid
 #endif
 #ifdef _WIN32
 #include  <io.h>
@@ -205,25 +210,44 @@ String Deserializer::ReadFileID()
 String Deserializer::ReadLine()
 {
 	String ret;
+	char buffer[256];
 
+	// Reads a block at a time and moves back to the start of the next line once the line break was found
 	while (!IsEof())
 	{
-		char c = ReadByte();
-		if (c == 10)
+		unsigned start = mPosition;
+		unsigned count = Read(buffer, min((unsigned)sizeof(buffer), mSize - mPosition));
+		if (!count)
 			break;
-		if (c == 13)
+
+		// memchr is vectorized by the C runtime
+		const char* pLineFeed = (const char*)memchr(buffer, 10, count);
+		const char* pReturn = (const char*)memchr(buffer, 13, pLineFeed ? (unsigned)(pLineFeed - buffer) : count);
+		const char* pBreak = pReturn ? pReturn : pLineFeed;
+		if (!pBreak)
+		{
+			ret.append(buffer, buffer + count);
+			continue;
+		}
+
+		ret.append(buffer, pBreak);
+		unsigned next = start + (unsigned)(pBreak - buffer) + 1;
+		// Skip the 10 of a 13 10 line break too
+		if (pBreak == pReturn && next < mSize)
 		{
-			// Peek next char to see if it's 10, and skip it too
-			if (!IsEof())
+			if (next < start + count)
 			{
-				char next = ReadByte();
-				if (next != 10)
-					Seek(mPosition - 1);
+				if (buffer[next - start] == 10)
+					++next;
+			}
+			else if (ReadByte() == 10)
+			{
+				++next;
 			}
-			break;
 		}
 
-		ret.push_back(c);
+		Seek(next);
+		break;
 	}
 
 	return ret;
@@ -367,7 +391,7 @@ File::File() :
 {
 }
 
-bool File::Open(const String& _fileName, FileMode mode, FSRoot root)
+bool File::Open(StringView _fileName, FileMode mode, FSRoot root)
 {
 	String fileName = FileSystem::FixPath(_fileName, root);
 
@@ -387,7 +411,7 @@ bool File::Open(const String& _fileName, FileMode mode, FSRoot root)
 		return false;
 	}
 
-	mFileName = fileName;
+	mFileName.swap(fileName);
 	mMode = mode;
 	mPosition = 0;
 	mOffset = 0;
@@ -398,7 +422,7 @@ bool File::Open(const String& _fileName, FileMode mode, FSRoot root)
 	size_t size = FileSystem::GetFileSize(pHandle);
 	if (size > UINT_MAX)
 	{
-		LOGERRORF("Could not open file %s which is larger than 4GB", fileName.c_str());
+		LOGERRORF("Could not open file %s which is larger than 4GB", mFileName.c_str());
 		Close();
 		mSize = 0;
 		return false;
@@ -569,6 +593,48 @@ String File::ReadText()
 	return text;
 }
 
+MappedFile::MappedFile() :
+	pData(NULL),
+	mSize(0),
+	pMapHandle(NULL)
+{
+}
+
+MappedFile::~MappedFile()
+{
+	Close();
+}
+
+bool MappedFile::Open(StringView _fileName, FSRoot root)
+{
+	String fileName = FileSystem::FixPath(_fileName, root);
+
+	Close();
+
+	pData = _mapFile(fileName.c_str(), &mSize, &pMapHandle);
+	if (!pData)
+	{
+		LOGERRORF("Could not map file %s", fileName.c_str());
+		mSize = 0;
+		pMapHandle = NULL;
+		return false;
+	}
+
+	mFileName.swap(fileName);
+	return true;
+}
+
+void MappedFile::Close()
+{
+	if (pData)
+	{
+		_unmapFile(pData, mSize, pMapHandle);
+		pData = NULL;
+		mSize = 0;
+		pMapHandle = NULL;
+	}
+}
+
 MemoryBuffer::MemoryBuffer(const void* data, unsigned size) :
 	Deserializer(size),
 	pBuffer((unsigned char*)data),
@@ -688,7 +754,7 @@ unsigned FileSystem::GetFileSize(FileHandle handle)
 	return (unsigned)length;
 }
     
-bool FileSystem::FileExists(const String& _fileName, FSRoot _root)
+bool FileSystem::FileExists(StringView _fileName, FSRoot _root)
 {
 	String fileName = FileSystem::FixPath(_fileName, _root);
 #ifdef _DURANGO
@@ -698,161 +764,170 @@ bool FileSystem::FileExists(const String& _fileName, FSRoot _root)
 #endif
 }
 
-// TODO: FIX THIS FUNCTION
-String FileSystem::FixPath(const String& pszFileName, FSRoot root)
+String FileSystem::FixPath(StringView fileName, FSRoot root)
 {
 	if (root == FSR_Absolute)
-		return pszFileName;
+		return String(fileName);
 
 	ASSERT(root < FSR_Count);
-	String res;
-	if (pszFileName[1U] != ':' && pszFileName[0U] != '/') //Quick hack to ignore root changes when a absolute path is given in windows or GNU
-	{
-		// was the path modified? if so use that, otherwise use static array
-		if (mModifiedRootPaths[root].size() != 0)
-			res = mModifiedRootPaths[root] + pszFileName;
-		else
-			res = String(pszRoots[root]) + pszFileName;
-	}
-	else
+	//Quick hack to ignore root changes when a absolute path is given in windows or GNU
+	if ((fileName.size() > 1 && fileName[1] == ':') || (fileName.size() > 0 && fileName[0] == '/'))
+		return String(fileName);
+
+	// was the path modified? if so use that, otherwise use static array
+	const String& modifiedRoot = mModifiedRootPaths[root];
+	StringView rootPath = modifiedRoot.size() != 0 ? StringView(modifiedRoot.c_str(), modifiedRoot.size()) : StringView(pszRoots[root]);
+	return rootPath + fileName;
+}
+
+// Finds the position of the last path separator and of the extension dot, npos if there is none
+static void FindPathParts(StringView fullPath, unsigned* pPathPos, unsigned* pExtPos)
+{
+	unsigned pathPos = StringView::npos;
+	unsigned extPos = StringView::npos;
+	for (unsigned i = (unsigned)fullPath.size(); i-- > 0;)
 	{
-		res = pszFileName;
-	}
-	/*
-	ASSERT( root < FSR_Count );
-	// absolute or already relative to absolute paths we can assume are already fixed,
-	// of course deteminting whats absolute is platform specific
-	// so this will likely require work for some platforms
-	const String filename(pszFileName);
-	// on all but unix filesystem : generally mean volume relative so absolute
-	if( filename.find( ":" ) ){
-	return filename;
-	}
-	// if it has relative movement, if must know where it belongs.
-	if( filename.find( ".." ) ) {
-	return filename;
+		const char c = fullPath[i];
+		if (c == '/' || c == '\\')
+		{
+			pathPos = i;
+			break;
+		}
+		if (c == '.' && extPos == StringView::npos)
+			extPos = i;
 	}
-	// TODO unix root, google Filesytem has a good open source implementation
-	// that should work on most platforms.
-
-	String res = String (rootPaths[root] ) + filename;
+	*pPathPos = pathPos;
+	*pExtPos = extPos;
+}
 
-	#ifdef	SN_TARGET_PS3
-	res.replace("\\","/");
-	//	Igor: this can be handled differently: just replace the last 3 chars.
-	if (root==FSR_Textures)
-	res.replace(".dds",".gtf");
-	#endif
-	*/
-	return res;
+static void LowercaseExtension(String& extension)
+{
+	for (char* c = extension.begin(); c != extension.end(); ++c)
+		*c = (char)tolower(*c);
 }
 
-void FileSystem::SplitPath(const String& fullPath, String* pathName, String* fileName, String* extension, bool lowercaseExtension)
+static StringView TrimmedPath(StringView pathName)
 {
-	String fullPathCopy = GetInternalPath(fullPath);
+	const char* first = pathName.begin();
+	const char* last = pathName.end();
+	while (first != last && (*first == ' ' || *first == '\t'))
+		++first;
+	while (last != first && (last[-1] == ' ' || last[-1] == '\t'))
+		--last;
+	return StringView(first, (size_t)(last - first));
+}
 
-	unsigned extPos = fullPathCopy.find_last('.');
-	unsigned pathPos = fullPathCopy.find_last('/');
+void FileSystem::SplitPath(StringView fullPath, String* pathName, String* fileName, String* extension, bool lowercaseExtension)
+{
+	unsigned pathPos, extPos;
+	FindPathParts(fullPath, &pathPos, &extPos);
 
-	if (extPos != String::npos && (pathPos == String::npos || extPos > pathPos))
-	{
-		*extension = fullPathCopy.substring(extPos);
-		if (lowercaseExtension)
-			*extension = extension->to_lower();
-		fullPathCopy = fullPathCopy.substring(0, extPos);
-	}
-	else
-		extension->resize(0);
+	const unsigned fileStart = pathPos != StringView::npos ? pathPos + 1 : 0;
+	const unsigned fileEnd = extPos != StringView::npos ? extPos : (unsigned)fullPath.size();
 
-	pathPos = fullPathCopy.find_last('/');
-	if (pathPos != String::npos)
-	{
-		*fileName = fullPathCopy.substring(pathPos + 1);
-		*pathName = fullPathCopy.substring(0, pathPos + 1);
-	}
-	else
-	{
-		*fileName = fullPathCopy;
-		pathName->resize(0);
-	}
+	*extension = extPos != StringView::npos ? String(fullPath.substring(extPos)) : String();
+	if (lowercaseExtension)
+		LowercaseExtension(*extension);
+	*fileName = String(fullPath.substring(fileStart, fileEnd - fileStart));
+	*pathName = GetInternalPath(fullPath.substring(0, fileStart));
 }
 
-String FileSystem::GetPath(const String& fullPath)
+String FileSystem::GetPath(StringView fullPath)
 {
-	String path, file, extension;
-	SplitPath(fullPath, &path, &file, &extension);
-	return path;
+	unsigned pathPos, extPos;
+	FindPathParts(fullPath, &pathPos, &extPos);
+	if (pathPos == StringView::npos)
+		return String();
+	return GetInternalPath(fullPath.substring(0, pathPos + 1));
 }
 
-String FileSystem::GetFileName(const String& fullPath)
+String FileSystem::GetFileName(StringView fullPath)
 {
-	String path, file, extension;
-	SplitPath(fullPath, &path, &file, &extension);
-	return file;
+	unsigned pathPos, extPos;
+	FindPathParts(fullPath, &pathPos, &extPos);
+	const unsigned fileStart = pathPos != StringView::npos ? pathPos + 1 : 0;
+	const unsigned fileEnd = extPos != StringView::npos ? extPos : (unsigned)fullPath.size();
+	return String(fullPath.substring(fileStart, fileEnd - fileStart));
 }
 
-String FileSystem::GetExtension(const String& fullPath, bool lowercaseExtension)
+String FileSystem::GetExtension(StringView fullPath, bool lowercaseExtension)
 {
-	String path, file, extension;
-	SplitPath(fullPath, &path, &file, &extension, lowercaseExtension);
+	unsigned pathPos, extPos;
+	FindPathParts(fullPath, &pathPos, &extPos);
+	if (extPos == StringView::npos)
+		return String();
+	String extension(fullPath.substring(extPos));
+	if (lowercaseExtension)
+		LowercaseExtension(extension);
 	return extension;
 }
 
-String FileSystem::GetFileNameAndExtension(const String& fileName, bool lowercaseExtension)
+String FileSystem::GetFileNameAndExtension(StringView fullPath, bool lowercaseExtension)
 {
-	String path, file, extension;
-	SplitPath(fileName, &path, &file, &extension, lowercaseExtension);
-	return file + extension;
+	unsigned pathPos, extPos;
+	FindPathParts(fullPath, &pathPos, &extPos);
+	const unsigned fileStart = pathPos != StringView::npos ? pathPos + 1 : 0;
+	String ret(fullPath.substring(fileStart));
+	if (lowercaseExtension && extPos != StringView::npos)
+	{
+		for (char* c = ret.begin() + (extPos - fileStart); c != ret.end(); ++c)
+			*c = (char)tolower(*c);
+	}
+	return ret;
 }
 
-String FileSystem::ReplaceExtension(const String& fullPath, const String& newExtension)
+String FileSystem::ReplaceExtension(StringView fullPath, StringView newExtension)
 {
-	String path, file, extension;
-	SplitPath(fullPath, &path, &file, &extension);
-	return path + file + newExtension;
+	unsigned pathPos, extPos;
+	FindPathParts(fullPath, &pathPos, &extPos);
+	String ret = GetInternalPath(fullPath.substring(0, extPos != StringView::npos ? extPos : (unsigned)fullPath.size()));
+	ret += newExtension;
+	return ret;
 }
 
-String FileSystem::AddTrailingSlash(const String& pathName)
+String FileSystem::AddTrailingSlash(StringView pathName)
 {
-	String ret = pathName.trimmed();
+	StringView trimmed = TrimmedPath(pathName);
+	String ret;
+	ret.reserve(trimmed.size() + 1);
+	ret += trimmed;
 	ret.replace('\\', '/');
 	if (ret.size() != 0 && ret.at((uint32_t)ret.size() - 1) != '/')
 		ret.push_back('/');
 	return ret;
 }
 
-String FileSystem::RemoveTrailingSlash(const String& pathName)
+String FileSystem::RemoveTrailingSlash(StringView pathName)
 {
-	String ret = pathName.trimmed();
-	ret.replace('\\', '/');
-	if (ret.size() != 0 && ret.at((uint32_t)ret.size() - 1) == '/')
-		ret.resize((uint32_t)ret.size() - 1);
-	return ret;
+	StringView trimmed = TrimmedPath(pathName);
+	if (trimmed.size() != 0 && (trimmed[trimmed.size() - 1] == '/' || trimmed[trimmed.size() - 1] == '\\'))
+		trimmed = trimmed.substring(0, (unsigned)trimmed.size() - 1);
+	return GetInternalPath(trimmed);
 }
 
-String FileSystem::GetParentPath(const String& path)
+String FileSystem::GetParentPath(StringView path)
 {
 	unsigned pos = RemoveTrailingSlash(path).find_last('/');
 	if (pos != String::npos)
-		return path.substring(0, pos + 1);
+		return String(path.substring(0, pos + 1));
 	else
 		return String();
 }
 
-String FileSystem::GetInternalPath(const String& pathName)
+String FileSystem::GetInternalPath(StringView pathName)
 {
-	String ret = pathName;
+	String ret(pathName);
 	ret.replace('\\', '/');
 	return ret;
 }
 
-String FileSystem::GetNativePath(const String& pathName)
+String FileSystem::GetNativePath(StringView pathName)
 {
+	String ret(pathName);
 #ifdef _WIN32
-	return pathName.replaced('/', '\\');
-#else
-	return pathName;
+	ret.replace('/', '\\');
 #endif
+	return ret;
 }
 
 bool FileSystem::DirExists(const String& pathName)
@@ -964,23 +1039,29 @@ int FileSystem::SystemRun(const String& fileName, const tinystl::vector<String>&
 
 	return exitCode;
 #else
+	// The arguments are prepared before forking, the child of a multithreaded process may not allocate
+	tinystl::vector<const char*> argPtrs;
+	argPtrs.push_back(fixedFileName.c_str());
+	for (unsigned i = 0; i < (unsigned)arguments.size(); ++i)
+		argPtrs.push_back(arguments[i].c_str());
+	argPtrs.push_back(NULL);
+
 	pid_t pid = fork();
 	if (!pid)
 	{
-		tinystl::vector<const char*> argPtrs;
-		argPtrs.push_back(fixedFileName.c_str());
-		for (unsigned i = 0; i < (unsigned)arguments.size(); ++i)
-			argPtrs.push_back(arguments[i].c_str());
-		argPtrs.push_back(NULL);
-
 		execvp(argPtrs[0], (char**)&argPtrs[0]);
-		return -1; // Return -1 if we could not spawn the process
+		_exit(-1); // Exit with -1 if we could not spawn the process
 	}
 	else if (pid > 0)
 	{
-		int exitCode = EINTR;
-        while(exitCode == EINTR) wait(&exitCode);
-		return exitCode;
+		// Only wait for this child, other threads may run processes at the same time
+		int status = 0;
+		while (waitpid(pid, &status, 0) == -1)
+		{
+			if (errno != EINTR)
+				return -1;
+		}
+		return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
 	}
 	else
 		return -1;
@@ -995,3 +1076,108 @@ bool FileSystem::Delete(const String& fileName)
 	return remove(GetNativePath(fileName).c_str()) == 0;
 #endif
 }
+
+/************************************************************************/
+// Name table implementation
+/************************************************************************/
+// Interned names are packed into blocks which are only released by exitNameTable,
+// so the pointers handed out stay valid for the lifetime of the app
+struct NameBlock
+{
+	NameBlock*	pNext;
+	size_t		mUsed;
+	size_t		mSize;
+};
+
+// Names whose ids collide are chained behind the first one, the characters follow the entry
+struct InternedName
+{
+	InternedName*	pNext;
+	size_t			mLength;
+
+	const char* GetName() const { return (const char*)(this + 1); }
+};
+
+static const size_t NAME_BLOCK_SIZE = 16 * 1024;
+
+static Mutex gNameTableMutex;
+static tinystl::flat_hash_map<NameId, InternedName*> gNameTable;
+static NameBlock* pNameBlocks = NULL;
+
+static InternedName* AllocateName(StringView name)
+{
+	// Entries stay pointer aligned
+	const size_t size = (sizeof(InternedName) + name.size() + 1 + sizeof(void*) - 1) & ~(sizeof(void*) - 1);
+	if (!pNameBlocks || pNameBlocks->mUsed + size > pNameBlocks->mSize)
+	{
+		size_t blockSize = size > NAME_BLOCK_SIZE ? size : NAME_BLOCK_SIZE;
+		NameBlock* pBlock = (NameBlock*)conf_malloc(sizeof(NameBlock) + blockSize);
+		pBlock->pNext = pNameBlocks;
+		pBlock->mUsed = 0;
+		pBlock->mSize = blockSize;
+		pNameBlocks = pBlock;
+	}
+
+	InternedName* pEntry = (InternedName*)((char*)(pNameBlocks + 1) + pNameBlocks->mUsed);
+	pNameBlocks->mUsed += size;
+	pEntry->pNext = NULL;
+	pEntry->mLength = name.size();
+	char* pName = (char*)(pEntry + 1);
+	memcpy(pName, name.data(), name.size());
+	pName[name.size()] = '\0';
+	return pEntry;
+}
+
+NameId internName(StringView name, const char** ppName)
+{
+	const NameId id = getNameId(name);
+	InternedName* pCollision = NULL;
+	const char* pName = NULL;
+	{
+		MutexLock lock(gNameTableMutex);
+		InternedName*& pFirst = gNameTable[id];
+		InternedName** ppLink = &pFirst;
+		for (; *ppLink; ppLink = &(*ppLink)->pNext)
+		{
+			if ((*ppLink)->mLength == name.size() && memcmp((*ppLink)->GetName(), name.data(), name.size()) == 0)
+			{
+				pName = (*ppLink)->GetName();
+				break;
+			}
+		}
+
+		if (!pName)
+		{
+			pCollision = pFirst;
+			*ppLink = AllocateName(name);
+			pName = (*ppLink)->GetName();
+		}
+	}
+
+	// Both names keep their own copy, but the id no longer identifies either of them
+	if (pCollision)
+		LOGWARNINGF("Name %s has the same id as %s", pName, pCollision->GetName());
+
+	if (ppName)
+		*ppName = pName;
+	return id;
+}
+
+const char* getInternedName(NameId id)
+{
+	MutexLock lock(gNameTableMutex);
+	tinystl::flat_hash_map<NameId, InternedName*>::iterator it = gNameTable.find(id);
+	return it != gNameTable.end() ? it->second->GetName() : NULL;
+}
+
+void exitNameTable()
+{
+	MutexLock lock(gNameTableMutex);
+	while (pNameBlocks)
+	{
+		NameBlock* pNext = pNameBlocks->pNext;
+		conf_free(pNameBlocks);
+		pNameBlocks = pNext;
+	}
+	tinystl::flat_hash_map<NameId, InternedName*>().swap(gNameTable);
+}
@@ -23,6 +23,7 @@
 */
 
 #include <algorithm>
+#include <string.h>
 
 #include "../Interfaces/IThread.h"
 #include "../Interfaces/ILogManager.h"
@@ -39,11 +40,11 @@ MutexLock::~MutexLock()
 	mMutex.Release();
 }
 
-Thread::Thread(ThreadPool* pThreadSystem)
+Thread::Thread(JobFunction pFunc, void* pData)
 {
 	pItem = (WorkItem*)conf_calloc(1, sizeof(WorkItem));
-	pItem->pData = pThreadSystem;
-	pItem->pFunc = ThreadPool::ProcessItems;
+	pItem->pData = pData;
+	pItem->pFunc = pFunc;
 	pItem->mCompleted = false;
 
 	pHandle = _createThread(pItem);
@@ -57,79 +58,270 @@ Thread::~Thread()
 		conf_free(pItem);
 	}
 }
+/************************************************************************/
+// Thread slots
+// One bit per slot, a thread takes the lowest free bit and gives it back from its thread_local destructor
+/************************************************************************/
+// Destructors of other thread_locals may still allocate after the slot was given back
+#define THREAD_SLOT_RELEASED (MAX_THREAD_SLOTS + 1)
 
+static tfrg_atomic64_t gUsedThreadSlots = 0;
+
+struct ThreadSlot
+{
+	ThreadSlot() : mIndex(MAX_THREAD_SLOTS), mFullLogged(false) {}
+	~ThreadSlot()
+	{
+		if (mIndex >= MAX_THREAD_SLOTS)
+			return;
+
+		// Per slot data must not be written by this thread anymore once another thread can take the slot
+		confetti::releaseTrackingThreadSlot();
+		const uint64_t mask = 1ULL << mIndex;
+		mIndex = THREAD_SLOT_RELEASED;
+		uint64_t used = tfrg_atomic64_load_relaxed(&gUsedThreadSlots);
+		for (;;)
+		{
+			uint64_t prev = tfrg_atomic64_cas(&gUsedThreadSlots, used, used & ~mask);
+			if (prev == used)
+				break;
+			used = prev;
+		}
+	}
+
+	uint32_t mIndex;
+	/// Threads keep trying to get a slot on later calls but only report once that there was none
+	bool mFullLogged;
+};
+
+static thread_local ThreadSlot gCurrentThreadSlot;
+
+uint32_t Thread::GetCurrentThreadSlot()
+{
+	ThreadSlot& slot = gCurrentThreadSlot;
+	if (slot.mIndex < MAX_THREAD_SLOTS)
+		return slot.mIndex;
+	if (slot.mIndex == THREAD_SLOT_RELEASED)
+		return MAX_THREAD_SLOTS;
+
+	uint64_t used = tfrg_atomic64_load_relaxed(&gUsedThreadSlots);
+	while (used != ~0ULL)
+	{
+		uint32_t index = 0;
+		while (used & (1ULL << index))
+			++index;
+
+		uint64_t prev = tfrg_atomic64_cas(&gUsedThreadSlots, used, used | (1ULL << index));
+		if (prev == used)
+		{
+			slot.mIndex = index;
+			return index;
+		}
+		used = prev;
+	}
+
+	if (!slot.mFullLogged)
+	{
+		slot.mFullLogged = true;
+		LOGERRORF("All %u thread slots are taken", MAX_THREAD_SLOTS);
+	}
+	return MAX_THREAD_SLOTS;
+}
+/************************************************************************/
+// Work stealing queue (Chase-Lev)
+// The owning thread pushes and pops at the bottom, other threads steal from the top
+/************************************************************************/
+struct WorkStealingQueue
+{
+	tfrg_atomic64_t		mTop;
+	char				mPadding0[64 - sizeof(tfrg_atomic64_t)];
+	tfrg_atomic64_t		mBottom;
+	char				mPadding1[64 - sizeof(tfrg_atomic64_t)];
+	tfrg_atomicptr_t*	pItems;
+	int64_t				mMask;
+};
+
+struct WorkerThreadData
+{
+	ThreadPool*	pPool;
+	int32_t		mQueueIndex;
+};
+
+static thread_local WorkerThreadData* pCurrentWorkerData = NULL;
+
+static void initWorkStealingQueue(WorkStealingQueue* pQueue)
+{
+	pQueue->mTop = 0;
+	pQueue->mBottom = 0;
+	pQueue->pItems = (tfrg_atomicptr_t*)conf_calloc(WORK_STEALING_QUEUE_SIZE, sizeof(tfrg_atomicptr_t));
+	pQueue->mMask = WORK_STEALING_QUEUE_SIZE - 1;
+}
+
+static void exitWorkStealingQueue(WorkStealingQueue* pQueue)
+{
+	conf_free((void*)pQueue->pItems);
+}
+
+// Owner only
+static bool pushWorkItem(WorkStealingQueue* pQueue, WorkItem* pItem)
+{
+	int64_t bottom = (int64_t)tfrg_atomic64_load_relaxed(&pQueue->mBottom);
+	int64_t top = (int64_t)tfrg_atomic64_load_acquire(&pQueue->mTop);
+	if (bottom - top > pQueue->mMask)
+		return false;
+
+	tfrg_atomicptr_store_relaxed(&pQueue->pItems[bottom & pQueue->mMask], (uintptr_t)pItem);
+	tfrg_atomic64_store_release(&pQueue->mBottom, (uint64_t)(bottom + 1));
+	return true;
+}
+
+// Owner only
+static WorkItem* popWorkItem(WorkStealingQueue* pQueue)
+{
+	int64_t bottom = (int64_t)tfrg_atomic64_load_relaxed(&pQueue->mBottom) - 1;
+	tfrg_atomic64_store_relaxed(&pQueue->mBottom, (uint64_t)bottom);
+	tfrg_memorybarrier_full();
+	int64_t top = (int64_t)tfrg_atomic64_load_relaxed(&pQueue->mTop);
+
+	if (top > bottom)
+	{
+		// Empty
+		tfrg_atomic64_store_relaxed(&pQueue->mBottom, (uint64_t)(bottom + 1));
+		return NULL;
+	}
+
+	WorkItem* pItem = (WorkItem*)tfrg_atomicptr_load_relaxed(&pQueue->pItems[bottom & pQueue->mMask]);
+	if (top == bottom)
+	{
+		// Last item, race against thieves
+		if (tfrg_atomic64_cas(&pQueue->mTop, (uint64_t)top, (uint64_t)(top + 1)) != (uint64_t)top)
+			pItem = NULL;
+		tfrg_atomic64_store_relaxed(&pQueue->mBottom, (uint64_t)(bottom + 1));
+	}
+
+	return pItem;
+}
+
+// Any thread
+static WorkItem* stealWorkItem(WorkStealingQueue* pQueue)
+{
+	int64_t top = (int64_t)tfrg_atomic64_load_acquire(&pQueue->mTop);
+	tfrg_memorybarrier_full();
+	int64_t bottom = (int64_t)tfrg_atomic64_load_acquire(&pQueue->mBottom);
+
+	if (top >= bottom)
+		return NULL;
+
+	WorkItem* pItem = (WorkItem*)tfrg_atomicptr_load_relaxed(&pQueue->pItems[top & pQueue->mMask]);
+	if (tfrg_atomic64_cas(&pQueue->mTop, (uint64_t)top, (uint64_t)(top + 1)) != (uint64_t)top)
+		return NULL;
+
+	return pItem;
+}
+
+static inline uint32_t getPriorityBucket(unsigned priority)
+{
+	return min(priority, (unsigned)MAX_WORK_ITEM_PRIORITIES - 1);
+}
+/************************************************************************/
+// Thread Pool
+/************************************************************************/
 ThreadPool::ThreadPool() :
+	pQueues(NULL),
+	pWorkerData(NULL),
+	mQueueCount(0),
+	mSharedQueueHead(0),
+	mSharedQueueCount(0),
+	mWakeEpoch(0),
+	mSleepingThreads(0),
+	mCompleteWaiters(0),
 	mShutDown(false),
-	mPausing(false),
 	mPaused(false),
 	mCompleting(false)
 {
+	memset((void*)mPendingItems, 0, sizeof(mPendingItems));
 	Thread::SetMainThread();
+	mOwnerThreadID = Thread::GetCurrentThreadID();
 }
 
 ThreadPool::~ThreadPool()
 {
 	// Stop the worker threads. First make sure they are not waiting for work items
-	mShutDown = true;
-	Resume();
+	Shutdown();
 
 	for (unsigned i = 0; i < mThreads.size(); ++i)
 	{
 		mThreads[i]->~Thread();
 		conf_free(mThreads[i]);
 	}
+
+	for (uint32_t i = 0; i < mQueueCount; ++i)
+		exitWorkStealingQueue(&pQueues[i]);
+
+	conf_free(pQueues);
+	conf_free(pWorkerData);
 }
 
 void ThreadPool::CreateThreads(unsigned numThreads)
 {
 	// Only allow creation of threads once during lifetime of a threadpool instance
-	if (!mThreads.empty())
+	if (!mThreads.empty() || numThreads == 0)
 		return;
 
 	// Start threads in paused mode
 	Pause();
 
+	mQueueCount = numThreads + 1;
+	pQueues = (WorkStealingQueue*)conf_calloc(mQueueCount, sizeof(WorkStealingQueue));
+	pWorkerData = (WorkerThreadData*)conf_calloc(numThreads, sizeof(WorkerThreadData));
+	for (uint32_t i = 0; i < mQueueCount; ++i)
+		initWorkStealingQueue(&pQueues[i]);
+
 	for (unsigned i = 0; i < numThreads; ++i)
 	{
-		Thread* thread(conf_placement_new<Thread>(conf_calloc(1, sizeof(Thread)), this));
+		pWorkerData[i].pPool = this;
+		pWorkerData[i].mQueueIndex = (int32_t)i + 1;
+
+		Thread* thread(conf_placement_new<Thread>(conf_calloc(1, sizeof(Thread)), ThreadPool::ProcessItems, &pWorkerData[i]));
 		mThreads.emplace_back(thread);
 	}
 }
 
+int32_t ThreadPool::GetCurrentQueueIndex() const
+{
+	if (!mQueueCount)
+		return -1;
+
+	if (pCurrentWorkerData && pCurrentWorkerData->pPool == this)
+		return pCurrentWorkerData->mQueueIndex;
+
+	if (Thread::GetCurrentThreadID() == mOwnerThreadID)
+		return 0;
+
+	return -1;
+}
+
 void ThreadPool::AddWorkItem(WorkItem* item)
 {
 	// Check for duplicate / invalid items.
 	ASSERT(item && "Null work item submitted to thread pool");
-	ASSERT(mWorkItems.find(item) == mWorkItems.end());
+	ASSERT(tfrg_atomic32_load_relaxed(&item->mState) == WORK_ITEM_STATE_IDLE && "Work item is already queued");
 
-	// Push to the main thread list to keep item alive
 	// Clear completed flag in case item is reused
-	mWorkItems.push_back(item);
 	item->mCompleted = false;
+	tfrg_atomic32_store_relaxed(&item->mState, WORK_ITEM_STATE_QUEUED);
+	tfrg_atomic32_add(&mPendingItems[getPriorityBucket(item->mPriority)], 1);
 
-	if (mThreads.size() && !mPaused)
-		mQueueMutex.Acquire();
-
-	// Find position for new item
-	if (mWorkQueue.empty())
-		mWorkQueue.push_back(item);
-	else
+	int32_t queueIndex = GetCurrentQueueIndex();
+	if (queueIndex < 0 || !pushWorkItem(&pQueues[queueIndex], item))
 	{
-		for (WorkItem** i = mWorkQueue.begin(); i != mWorkQueue.end(); ++i)
-		{
-			if ((*i)->mPriority <= item->mPriority)
-			{
-				mWorkQueue.insert(i, item);
-				break;
-			}
-		}
+		MutexLock lock(mQueueMutex);
+		mSharedQueue.push_back(item);
+		tfrg_atomic32_add(&mSharedQueueCount, 1);
 	}
 
-	if (mThreads.size())
-	{
-		mQueueMutex.Release();
-		mPaused = false;
-	}
+	mPaused = false;
+	WakeThreads(false);
 }
 
 bool ThreadPool::RemoveWorkItem(WorkItem*& item)
@@ -137,41 +329,33 @@ bool ThreadPool::RemoveWorkItem(WorkItem*& item)
 	if (!item)
 		return false;
 
-	MutexLock lock(mQueueMutex);
+	if (tfrg_atomic32_cas(&item->mState, WORK_ITEM_STATE_QUEUED, WORK_ITEM_STATE_CANCELLED) != WORK_ITEM_STATE_QUEUED)
+		return false;
 
-	tinystl::vector<WorkItem*>::iterator i = mWorkQueue.find(item);
-	if (i != mWorkQueue.end())
+	// The lock-free queues cannot erase from the middle, so the item is retired when it gets dequeued.
+	// Drain the queues until that happened so the caller may free the item once this returns.
+	const int32_t queueIndex = GetCurrentQueueIndex();
+	while (tfrg_atomic32_load_acquire(&item->mState) != WORK_ITEM_STATE_IDLE)
 	{
-		WorkItem** j = mWorkItems.find(item);
-		if (j != mWorkItems.end())
-		{
-			mWorkQueue.erase(i);
-			mWorkItems.erase(j);
-			return true;
-		}
+		WorkItem* pending = AcquireWorkItem(queueIndex);
+		if (pending)
+			ExecuteWorkItem(pending);
+		else
+			// Another thread dequeued the item and is about to retire it
+			Thread::Sleep(0);
 	}
 
-	return false;
+	return true;
 }
 
 unsigned ThreadPool::RemoveWorkItems(const tinystl::vector <WorkItem*>& items)
 {
-	MutexLock lock(mQueueMutex);
 	unsigned removed = 0;
 
-	for (WorkItem* const& i : items)
+	for (WorkItem* i : items)
 	{
-		WorkItem** j = mWorkQueue.find(i);
-		if (j != mWorkQueue.end())
-		{
-			WorkItem** k = mWorkItems.find(i);
-			if (k != mWorkItems.end())
-			{
-				mWorkQueue.erase(j);
-				mWorkItems.erase(k);
-				++removed;
-			}
-		}
+		if (RemoveWorkItem(i))
+			++removed;
 	}
 
 	return removed;
@@ -179,83 +363,185 @@ unsigned ThreadPool::RemoveWorkItems(const tinystl::vector <WorkItem*>& items)
 
 void ThreadPool::Pause()
 {
-	if (!mPaused)
-	{
-		mPausing = true;
-
-		mQueueMutex.Acquire();
-		mPaused = true;
-
-		mPausing = false;
-	}
+	mPaused = true;
 }
 
 void ThreadPool::Resume()
 {
 	if (mPaused)
 	{
-		mQueueMutex.Release();
 		mPaused = false;
+		WakeThreads(true);
 	}
 }
 
+void ThreadPool::Shutdown()
+{
+	mShutDown = true;
+	WakeThreads(true);
+}
 
-void ThreadPool::Complete(unsigned priority)
+WorkItem* ThreadPool::AcquireWorkItem(int32_t queueIndex)
 {
-	mCompleting = true;
+	WorkItem* item = NULL;
 
-	if (mThreads.size())
-	{
-		Resume();
+	if (queueIndex >= 0)
+		item = popWorkItem(&pQueues[queueIndex]);
 
-		while (!mWorkQueue.empty())
+	if (!item && tfrg_atomic32_load_relaxed(&mSharedQueueCount))
+	{
+		MutexLock lock(mQueueMutex);
+		if (mSharedQueueHead < (uint32_t)mSharedQueue.size())
 		{
-			mQueueMutex.Acquire();
-			if (!mWorkQueue.empty() && mWorkQueue.front()->mPriority >= priority)
+			item = mSharedQueue[mSharedQueueHead++];
+			tfrg_atomic32_add(&mSharedQueueCount, -1);
+			if (mSharedQueueHead == (uint32_t)mSharedQueue.size())
 			{
-				WorkItem* item = mWorkQueue.front();
-				mWorkQueue.erase(mWorkQueue.begin());
-				mQueueMutex.Release();
-				item->pFunc(item->pData);
-				item->mCompleted = true;
-			}
-			else
-			{
-				mQueueMutex.Release();
-				break;
+				mSharedQueue.clear();
+				mSharedQueueHead = 0;
 			}
 		}
+	}
 
-		// Wait for threads to complete work
-		while (!IsCompleted(priority))
-		{
-		}
+	// Steal from the other queues, starting with the next one to spread the thieves
+	for (uint32_t i = 1; !item && i <= mQueueCount; ++i)
+	{
+		uint32_t victim = (uint32_t)(queueIndex + i) % mQueueCount;
+		if ((int32_t)victim != queueIndex)
+			item = stealWorkItem(&pQueues[victim]);
+	}
+
+	return item;
+}
 
-		// Pause worker threads
-		if (mWorkQueue.empty())
-			Pause();
+void ThreadPool::ExecuteWorkItem(WorkItem* item)
+{
+	// Read everything needed before the item is released to its owner
+	const uint32_t bucket = getPriorityBucket(item->mPriority);
+	JobCounter* pCounter = item->pCounter;
+
+	if (tfrg_atomic32_cas(&item->mState, WORK_ITEM_STATE_QUEUED, WORK_ITEM_STATE_RUNNING) == WORK_ITEM_STATE_QUEUED)
+	{
+		item->pFunc(item->pData);
+		tfrg_atomic32_store_release(&item->mState, WORK_ITEM_STATE_IDLE);
+		item->mCompleted = true;
 	}
 	else
 	{
-		// Single threaded systems
-		while (!mWorkQueue.empty() && mWorkQueue.front()->mPriority >= priority)
+		// Cancelled through RemoveWorkItem
+		ASSERT(tfrg_atomic32_load_relaxed(&item->mState) == WORK_ITEM_STATE_CANCELLED);
+		tfrg_atomic32_store_release(&item->mState, WORK_ITEM_STATE_IDLE);
+	}
+
+	// Only the last item of a bucket or counter can finish a wait
+	bool notify = tfrg_atomic32_add(&mPendingItems[bucket], -1) == 1;
+	if (pCounter)
+		notify |= tfrg_atomic32_add(&pCounter->mValue, -1) == 1;
+
+	// Pairs with the fence in WaitForCompletion: either the waiter sees the new count or we see the waiter
+	tfrg_memorybarrier_full();
+	if (notify && tfrg_atomic32_load_relaxed(&mCompleteWaiters))
+	{
+		MutexLock lock(mCompleteMutex);
+		mCompleteConditionVar.SetAll();
+	}
+}
+
+void ThreadPool::WakeThreads(bool all)
+{
+	tfrg_atomic32_add(&mWakeEpoch, 1);
+
+	// Pairs with the fences in WaitForWork and WaitForCompletion: either the sleeper sees the new epoch or we see the sleeper
+	tfrg_memorybarrier_full();
+	if (tfrg_atomic32_load_relaxed(&mSleepingThreads))
+	{
+		MutexLock lock(mWaitMutex);
+		if (all)
+			mWaitConditionVar.SetAll();
+		else
+			mWaitConditionVar.Set();
+	}
+
+	// Threads inside Complete() help with new work as well
+	if (tfrg_atomic32_load_relaxed(&mCompleteWaiters))
+	{
+		MutexLock lock(mCompleteMutex);
+		mCompleteConditionVar.SetAll();
+	}
+}
+
+void ThreadPool::WaitForWork(uint32_t wakeEpoch)
+{
+	MutexLock lock(mWaitMutex);
+	tfrg_atomic32_add(&mSleepingThreads, 1);
+	tfrg_memorybarrier_full();
+	// Any submission after wakeEpoch was read changes the epoch, so no wake up can get lost
+	while (!mShutDown && wakeEpoch == tfrg_atomic32_load_relaxed(&mWakeEpoch))
+		mWaitConditionVar.Wait(mWaitMutex, TIMEOUT_INFINITE);
+	tfrg_atomic32_add(&mSleepingThreads, -1);
+}
+
+void ThreadPool::WaitForCompletion(unsigned priority, JobCounter* pCounter, uint32_t wakeEpoch)
+{
+	MutexLock lock(mCompleteMutex);
+	tfrg_atomic32_add(&mCompleteWaiters, 1);
+	tfrg_memorybarrier_full();
+	if (!IsWaitDone(priority, pCounter) && wakeEpoch == tfrg_atomic32_load_relaxed(&mWakeEpoch))
+		mCompleteConditionVar.Wait(mCompleteMutex, TIMEOUT_INFINITE);
+	tfrg_atomic32_add(&mCompleteWaiters, -1);
+}
+
+bool ThreadPool::IsWaitDone(unsigned priority, const JobCounter* pCounter) const
+{
+	return pCounter ? isJobCounterDone(pCounter) : IsCompleted(priority);
+}
+
+void ThreadPool::Wait(unsigned priority, JobCounter* pCounter)
+{
+	const int32_t queueIndex = GetCurrentQueueIndex();
+
+	for (;;)
+	{
+		const uint32_t wakeEpoch = tfrg_atomic32_load_relaxed(&mWakeEpoch);
+
+		if (IsWaitDone(priority, pCounter))
+			break;
+
+		WorkItem* item = AcquireWorkItem(queueIndex);
+		if (item)
 		{
-			WorkItem* item = mWorkQueue.front();
-			mWorkQueue.erase(mWorkQueue.begin());
-			item->pFunc(item->pData);
-			item->mCompleted = true;
+			ExecuteWorkItem(item);
+			continue;
 		}
+
+		// Remaining items are running on worker threads
+		WaitForCompletion(priority, pCounter, wakeEpoch);
 	}
+}
+
+void ThreadPool::Complete(unsigned priority)
+{
+	mCompleting = true;
+
+	Resume();
+	Wait(priority, NULL);
 
-	Cleanup(priority);
 	mCompleting = false;
 }
 
+void ThreadPool::WaitForCounter(JobCounter* pCounter)
+{
+	ASSERT(pCounter);
+
+	Resume();
+	Wait(0, pCounter);
+}
+
 bool ThreadPool::IsCompleted(unsigned priority) const
 {
-	for (WorkItem* const* i = mWorkItems.begin(); i != mWorkItems.end(); ++i)
+	for (uint32_t i = getPriorityBucket(priority); i < MAX_WORK_ITEM_PRIORITIES; ++i)
 	{
-		if ((*i)->mPriority >= priority && !(*i)->mCompleted)
+		if (tfrg_atomic32_load_acquire(&mPendingItems[i]))
 			return false;
 	}
 
@@ -264,50 +550,142 @@ bool ThreadPool::IsCompleted(unsigned priority) const
 
 void ThreadPool::ProcessItems(void* pData)
 {
-	bool wasActive = false;
-
-	ThreadPool* pSystem = (ThreadPool*)pData;
+	WorkerThreadData* pWorkerData = (WorkerThreadData*)pData;
+	ThreadPool* pSystem = pWorkerData->pPool;
+	pCurrentWorkerData = pWorkerData;
 
 	for (;;)
 	{
 		if (pSystem->mShutDown)
 			return;
 
-		if (pSystem->mPausing && !wasActive)
-			Thread::Sleep(0);
-		else
-		{
-			pSystem->mQueueMutex.Acquire();
-			if (!pSystem->mWorkQueue.empty())
-			{
-				wasActive = true;
+		const uint32_t wakeEpoch = tfrg_atomic32_load_relaxed(&pSystem->mWakeEpoch);
 
-				WorkItem* item = pSystem->mWorkQueue.front();
-				pSystem->mWorkQueue.erase(pSystem->mWorkQueue.begin());
-				pSystem->mQueueMutex.Release();
-				item->pFunc(item->pData);
-				item->mCompleted = true;
-			}
-			else
-			{
-				wasActive = false;
+		WorkItem* item = pSystem->mPaused ? NULL : pSystem->AcquireWorkItem(pWorkerData->mQueueIndex);
+		if (item)
+			pSystem->ExecuteWorkItem(item);
+		else
+			pSystem->WaitForWork(wakeEpoch);
+	}
+}
+/************************************************************************/
+// Task graph
+/************************************************************************/
+static void executeJob(void* pData)
+{
+	Job* pJob = (Job*)pData;
+	pJob->pFunc(pJob->pData);
 
-				pSystem->mQueueMutex.Release();
-				Thread::Sleep(0);
-			}
-		}
+	// Release the continuations whose last dependency was this job
+	for (uint32_t i = 0; i < pJob->mContinuationCount; ++i)
+	{
+		Job* pContinuation = pJob->pContinuations[i];
+		if (tfrg_atomic32_add(&pContinuation->mDependencyCount, -1) == 1)
+			pContinuation->pPool->AddWorkItem(&pContinuation->mItem);
 	}
+	// The counter of the job is decremented by the pool once mItem is released
 }
 
-void ThreadPool::Cleanup(unsigned priority)
+void initJob(Job* pJob, JobFunction pFunc, void* pData, JobCounter* pCounter)
 {
-	for (WorkItem** i = mWorkItems.begin(); i != mWorkItems.end();)
+	ASSERT(pJob);
+	ASSERT(pFunc);
+
+	memset((void*)pJob, 0, sizeof(*pJob));
+	pJob->pFunc = pFunc;
+	pJob->pData = pData;
+	pJob->pCounter = pCounter;
+	pJob->mItem.pFunc = executeJob;
+	pJob->mItem.pData = pJob;
+	pJob->mItem.pCounter = pCounter;
+	// Held until the job gets submitted
+	pJob->mDependencyCount = 1;
+	// Counted from here on, so a wait on a partly submitted graph still waits for the jobs submitted later
+	if (pCounter)
+		tfrg_atomic32_add(&pCounter->mValue, 1);
+}
+
+void addJobDependency(Job* pJob, Job* pDependency)
+{
+	ASSERT(pJob && pDependency && pJob != pDependency);
+	ASSERT(pDependency->mContinuationCount < MAX_JOB_CONTINUATIONS);
+
+	pDependency->pContinuations[pDependency->mContinuationCount++] = pJob;
+	tfrg_atomic32_add(&pJob->mDependencyCount, 1);
+}
+
+void submitJob(ThreadPool* pPool, Job* pJob)
+{
+	ASSERT(pPool && pJob);
+
+	pJob->pPool = pPool;
+	if (tfrg_atomic32_add(&pJob->mDependencyCount, -1) == 1)
+		pPool->AddWorkItem(&pJob->mItem);
+}
+
+void submitJobs(ThreadPool* pPool, uint32_t jobCount, Job* pJobs)
+{
+	for (uint32_t i = 0; i < jobCount; ++i)
+		submitJob(pPool, &pJobs[i]);
+}
+
+void waitForJobCounter(ThreadPool* pPool, JobCounter* pCounter)
+{
+	pPool->WaitForCounter(pCounter);
+}
+
+struct ParallelForBatch
+{
+	ParallelForFunction	pFunc;
+	void*				pData;
+	uint32_t			mBegin;
+	uint32_t			mEnd;
+};
+
+static void executeParallelForBatch(void* pData)
+{
+	ParallelForBatch* pBatch = (ParallelForBatch*)pData;
+	pBatch->pFunc(pBatch->pData, pBatch->mBegin, pBatch->mEnd);
+}
+
+void parallelFor(ThreadPool* pPool, uint32_t count, uint32_t minBatchSize, ParallelForFunction pFunc, void* pData)
+{
+	if (!count)
+		return;
+
+	// A few batches per thread so thieves can balance uneven batches
+	const uint32_t targetBatchCount = min((pPool->GetNumThreads() + 1) * 4, (uint32_t)MAX_PARALLEL_FOR_BATCHES);
+	const uint32_t batchSize = max(max(minBatchSize, 1U), (count + targetBatchCount - 1) / targetBatchCount);
+	const uint32_t batchCount = (count + batchSize - 1) / batchSize;
+
+	if (batchCount == 1)
+	{
+		pFunc(pData, 0, count);
+		return;
+	}
+
+	ParallelForBatch batches[MAX_PARALLEL_FOR_BATCHES];
+	WorkItem items[MAX_PARALLEL_FOR_BATCHES];
+	JobCounter counter;
+	counter.mValue = batchCount - 1;
+
+	// Batch 0 runs on the calling thread
+	for (uint32_t i = 0; i < batchCount; ++i)
 	{
-		if ((*i)->mCompleted && (*i)->mPriority >= priority)
+		batches[i].pFunc = pFunc;
+		batches[i].pData = pData;
+		batches[i].mBegin = i * batchSize;
+		batches[i].mEnd = min(count, (i + 1) * batchSize);
+
+		if (i)
 		{
-			i = mWorkItems.erase(i);
+			items[i].pFunc = executeParallelForBatch;
+			items[i].pData = &batches[i];
+			items[i].pCounter = &counter;
+			pPool->AddWorkItem(&items[i]);
 		}
-		else
-			++i;
 	}
+
+	executeParallelForBatch(&batches[0]);
+	pPool->WaitForCounter(&counter);
 }
@@ -29,6 +29,7 @@
 #include "../../ThirdParty/OpenSource/Nothings/stb_image_resize.h"
 #include "../../ThirdParty/OpenSource/Nothings/stb_image_write.h"
 #include "../../ThirdParty/OpenSource/TinyEXR/tinyexr.h"
+#include "../Interfaces/IThread.h"
 #include "../Interfaces/IMemoryManager.h"
 
 // --- IMAGE HEADERS ---
@@ -228,132 +229,1054 @@ const unsigned int gEtcMinTexHeight = 4;
 
 // --- BLOCK DECODING ---
 
-void iDecodeColorBlock(unsigned char *dest, int w, int h, int xOff, int yOff, ImageFormat::Enum format, int red, int blue, unsigned char *src)
+// Block decoders write the 4x4 pixels of one block in the uncompressed format, rows pitch bytes apart.
+// Blocks that overlap the right or bottom edge are decoded into a scratch block and copied from there.
+#if VECTORMATH_MODE_SSE && defined(__SSSE3__)
+#define BLOCK_DECODE_SSSE3
+#endif
+
+// 565 to RGBA8 with the high bits replicated into the low ones, so that white stays white
+static inline uint32_t iExpandColor565(const uint32_t c)
 {
-  unsigned char colors[4][3];
+  const uint32_t r = (c >> 11) & 0x1F;
+  const uint32_t g = (c >> 5) & 0x3F;
+  const uint32_t b = c & 0x1F;
+  return ((r << 3) | (r >> 2)) | (((g << 2) | (g >> 4)) << 8) | (((b << 3) | (b >> 2)) << 16) | 0xFF000000;
+}
 
-  uint16 c0 = *(uint16 *)src;
-  uint16 c1 = *(uint16 *)(src + 2);
+// The 4 RGBA8 palette entries of the color part of a BC1-3 block with endpoints c0 and c1
+static void iDecodeColorPalette(uint32_t palette[4], const uint32_t c0, const uint32_t c1, const bool alwaysFourColors)
+{
+  palette[0] = iExpandColor565(c0);
+  palette[1] = iExpandColor565(c1);
+  palette[2] = palette[3] = 0;
+
+  for (int i = 0; i < 24; i += 8) {
+    const uint32_t a = (palette[0] >> i) & 0xFF;
+    const uint32_t b = (palette[1] >> i) & 0xFF;
+    if (c0 > c1 || alwaysFourColors) {
+      palette[2] |= ((2 * a + b + 1) / 3) << i;
+      palette[3] |= ((a + 2 * b + 1) / 3) << i;
+    }
+    else {
+      palette[2] |= ((a + b + 1) >> 1) << i;
+    }
+  }
+  palette[2] |= 0xFF000000;
+  if (c0 > c1 || alwaysFourColors)
+    palette[3] |= 0xFF000000;
+}
 
-  colors[0][0] = ((c0 >> 11) & 0x1F) << 3;
-  colors[0][1] = ((c0 >> 5) & 0x3F) << 2;
-  colors[0][2] = (c0 & 0x1F) << 3;
+// The 8 palette entries of a BC4 block with endpoints a0 and a1
+static void iDecodeBC4Palette(uint8_t palette[8], const uint32_t a0, const uint32_t a1)
+{
+  palette[0] = (uint8_t)a0;
+  palette[1] = (uint8_t)a1;
+  if (a0 > a1) {
+    for (uint32_t k = 2; k < 8; k++)
+      palette[k] = (uint8_t)(((8 - k) * a0 + (k - 1) * a1) / 7);
+  }
+  else {
+    for (uint32_t k = 2; k < 6; k++)
+      palette[k] = (uint8_t)(((6 - k) * a0 + (k - 1) * a1) / 5);
+    palette[6] = 0;
+    palette[7] = 255;
+  }
+}
 
-  colors[1][0] = ((c1 >> 11) & 0x1F) << 3;
-  colors[1][1] = ((c1 >> 5) & 0x3F) << 2;
-  colors[1][2] = (c1 & 0x1F) << 3;
+#if defined(BLOCK_DECODE_SSSE3)
+// pshufb masks expanding one row of 4 color indices into the palette entries, one for every possible index byte.
+// mRGBA selects whole RGBA8 entries, mRGB only the first 3 bytes of each for 12 bytes of RGB8.
+struct ColorRowShuffleTable
+{
+  __m128i mRGBA[256];
+  __m128i mRGB[256];
 
-  if (c0 > c1 || format == ImageFormat::DXT5) {
-    for (int i = 0; i < 3; i++) {
-      colors[2][i] = (2 * colors[0][i] + colors[1][i] + 1) / 3;
-      colors[3][i] = (colors[0][i] + 2 * colors[1][i] + 1) / 3;
+  ColorRowShuffleTable()
+  {
+    for (uint32_t row = 0; row < 256; ++row)
+    {
+      uint8_t rgba[16];
+      uint8_t rgb[16];
+      memset(rgb, 0x80, sizeof(rgb));
+      for (uint32_t x = 0; x < 4; ++x)
+      {
+        const uint32_t index = (row >> (2 * x)) & 0x3;
+        for (uint32_t c = 0; c < 4; ++c)
+          rgba[x * 4 + c] = (uint8_t)(index * 4 + c);
+        for (uint32_t c = 0; c < 3; ++c)
+          rgb[x * 3 + c] = (uint8_t)(index * 4 + c);
+      }
+      mRGBA[row] = _mm_loadu_si128((const __m128i*)rgba);
+      mRGB[row] = _mm_loadu_si128((const __m128i*)rgb);
     }
   }
+};
+
+static const ColorRowShuffleTable gColorRowShuffleTable;
+
+// The 4 RGBA8 palette entries of the color part of a BC1-3 block
+static inline __m128i iLoadColorPalette(const uint8_t* src, const bool alwaysFourColors)
+{
+  const uint32_t c0 = src[0] | (src[1] << 8);
+  const uint32_t c1 = src[2] | (src[3] << 8);
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i one = _mm_set1_epi16(1);
+  const __m128i e0 = _mm_unpacklo_epi8(_mm_cvtsi32_si128((int)iExpandColor565(c0)), zero);
+  const __m128i e1 = _mm_unpacklo_epi8(_mm_cvtsi32_si128((int)iExpandColor565(c1)), zero);
+
+  // Entries 2 and 3 are interpolated in 16 bits, x / 3 is an exact multiplication for x < 768
+  __m128i interpolated;
+  if (c0 > c1 || alwaysFourColors) {
+    const __m128i sum = _mm_add_epi16(_mm_add_epi16(_mm_unpacklo_epi64(e0, e1), _mm_unpacklo_epi64(e0, e1)), _mm_unpacklo_epi64(e1, e0));
+    interpolated = _mm_mulhi_epu16(_mm_add_epi16(sum, one), _mm_set1_epi16(21846));
+  }
   else {
-    for (int i = 0; i < 3; i++) {
-      colors[2][i] = (colors[0][i] + colors[1][i] + 1) >> 1;
-      colors[3][i] = 0;
-    }
+    interpolated = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(e0, e1), one), 1);
+  }
+  return _mm_packus_epi16(_mm_unpacklo_epi64(e0, e1), interpolated);
+}
+
+// Decodes a BC4 block, which is also the alpha part of BC3 and each channel of BC5, into 16 values
+static inline __m128i iDecodeBC4Values(const uint8_t* src)
+{
+  // Palette entry k is (wa[k] * a0 + wb[k] * a1) / 7 or / 5, the divisions are exact multiplications for these ranges
+  const __m128i a0 = _mm_set1_epi16(src[0]);
+  const __m128i a1 = _mm_set1_epi16(src[1]);
+  __m128i palette;
+  if (src[0] > src[1]) {
+    const __m128i sum = _mm_add_epi16(_mm_mullo_epi16(a0, _mm_setr_epi16(7, 0, 6, 5, 4, 3, 2, 1)), _mm_mullo_epi16(a1, _mm_setr_epi16(0, 7, 1, 2, 3, 4, 5, 6)));
+    palette = _mm_mulhi_epu16(sum, _mm_set1_epi16(9363));
+  }
+  else {
+    const __m128i sum = _mm_add_epi16(_mm_mullo_epi16(a0, _mm_setr_epi16(5, 0, 4, 3, 2, 1, 0, 0)), _mm_mullo_epi16(a1, _mm_setr_epi16(0, 5, 1, 2, 3, 4, 0, 0)));
+    palette = _mm_or_si128(_mm_mulhi_epu16(sum, _mm_set1_epi16(13108)), _mm_setr_epi16(0, 0, 0, 0, 0, 0, 0, 255));
+  }
+  palette = _mm_packus_epi16(palette, palette);
+
+  // Every 16 bit lane receives the two bytes holding the 3 bits of its index, the multiplication shifts them
+  // to the top of the lane. Index i starts at bit 3 * i of the 6 index bytes that follow the endpoints.
+  const __m128i bits = _mm_loadl_epi64((const __m128i*)src);
+  const __m128i lo = _mm_shuffle_epi8(bits, _mm_setr_epi8(2, 3, 2, 3, 2, 3, 3, 4, 3, 4, 3, 4, 4, 5, 4, 5));
+  const __m128i hi = _mm_shuffle_epi8(bits, _mm_setr_epi8(5, 6, 5, 6, 5, 6, 6, 7, 6, 7, 6, 7, 7, 8, 7, 8));
+  const __m128i scale = _mm_setr_epi16(1 << 13, 1 << 10, 1 << 7, 1 << 12, 1 << 9, 1 << 6, 1 << 11, 1 << 8);
+  const __m128i indices = _mm_packus_epi16(_mm_srli_epi16(_mm_mullo_epi16(lo, scale), 13), _mm_srli_epi16(_mm_mullo_epi16(hi, scale), 13));
+  return _mm_shuffle_epi8(palette, indices);
+}
+
+// Writes the 16 RGBA8 pixels of the color part of a BC2/BC3 block with the given alpha values
+static inline void iDecodeColorBlockRGBA(uint8_t* dst, const uint32_t pitch, const uint8_t* src, const __m128i alpha)
+{
+  const __m128i palette = iLoadColorPalette(src, true);
+  const __m128i colorMask = _mm_set1_epi32(0x00FFFFFF);
+  for (int y = 0; y < 4; y++) {
+    const char r = (char)(y * 4);
+    const __m128i spread = _mm_setr_epi8(-1, -1, -1, r, -1, -1, -1, r + 1, -1, -1, -1, r + 2, -1, -1, -1, r + 3);
+    const __m128i row = _mm_and_si128(_mm_shuffle_epi8(palette, gColorRowShuffleTable.mRGBA[src[4 + y]]), colorMask);
+    _mm_storeu_si128((__m128i*)(dst + y * pitch), _mm_or_si128(row, _mm_shuffle_epi8(alpha, spread)));
+  }
+}
+
+// DXT1 to RGB8
+static void iDecodeBC1Block(uint8_t* dst, const uint32_t pitch, const uint8_t* src)
+{
+  const __m128i palette = iLoadColorPalette(src, false);
+  for (int y = 0; y < 4; y++) {
+    const __m128i row = _mm_shuffle_epi8(palette, gColorRowShuffleTable.mRGB[src[4 + y]]);
+    _mm_storel_epi64((__m128i*)(dst + y * pitch), row);
+    const int last = _mm_cvtsi128_si32(_mm_srli_si128(row, 8));
+    memcpy(dst + y * pitch + 8, &last, 4);
   }
+}
 
-  src += 4;
-  for (int y = 0; y < h; y++) {
-    unsigned char *dst = dest + yOff * y;
-    unsigned int indexes = src[y];
-    for (int x = 0; x < w; x++) {
-      unsigned int index = indexes & 0x3;
-      dst[red] = colors[index][0];
-      dst[1] = colors[index][1];
-      dst[blue] = colors[index][2];
-      indexes >>= 2;
+// DXT3 to RGBA8
+static void iDecodeBC2Block(uint8_t* dst, const uint32_t pitch, const uint8_t* src)
+{
+  // 4 bit alpha, the low nibble of each byte comes first. x * 17 is the nibble replicated.
+  const __m128i packed = _mm_loadl_epi64((const __m128i*)src);
+  const __m128i nibbleMask = _mm_set1_epi8(0x0F);
+  __m128i alpha = _mm_unpacklo_epi8(_mm_and_si128(packed, nibbleMask), _mm_and_si128(_mm_srli_epi16(packed, 4), nibbleMask));
+  alpha = _mm_or_si128(alpha, _mm_slli_epi16(alpha, 4));
+  iDecodeColorBlockRGBA(dst, pitch, src + 8, alpha);
+}
+
+// DXT5 to RGBA8
+static void iDecodeBC3Block(uint8_t* dst, const uint32_t pitch, const uint8_t* src)
+{
+  iDecodeColorBlockRGBA(dst, pitch, src + 8, iDecodeBC4Values(src));
+}
+
+// ATI1N to R8
+static void iDecodeBC4Block(uint8_t* dst, const uint32_t pitch, const uint8_t* src)
+{
+  const __m128i values = iDecodeBC4Values(src);
+  const int rows[4] = {
+    _mm_cvtsi128_si32(values), _mm_cvtsi128_si32(_mm_srli_si128(values, 4)),
+    _mm_cvtsi128_si32(_mm_srli_si128(values, 8)), _mm_cvtsi128_si32(_mm_srli_si128(values, 12)) };
+  for (int y = 0; y < 4; y++)
+    memcpy(dst + y * pitch, &rows[y], 4);
+}
+#else
+// Decodes a BC4 block, which is also the alpha part of BC3 and each channel of BC5, into 16 values
+static void iDecodeBC4Values(uint8_t* values, const uint8_t* src)
+{
+  uint8_t palette[8];
+  iDecodeBC4Palette(palette, src[0], src[1]);
+
+  // 16 indices of 3 bits, each half of the block is 24 bits
+  const uint32_t bits0 = src[2] | (src[3] << 8) | (src[4] << 16);
+  const uint32_t bits1 = src[5] | (src[6] << 8) | (src[7] << 16);
+  for (int i = 0; i < 8; i++) {
+    values[i] = palette[(bits0 >> (3 * i)) & 0x7];
+    values[i + 8] = palette[(bits1 >> (3 * i)) & 0x7];
+  }
+}
 
-      dst += xOff;
+// Writes the 16 pixels of the color part of a BC1-3 block, as RGBA8 with the given alpha values or as RGB8 if alpha is NULL
+static void iDecodeColorBlock(uint8_t* dst, const uint32_t pitch, const uint8_t* src, const uint8_t* alpha)
+{
+  uint32_t palette[4];
+  iDecodeColorPalette(palette, src[0] | (src[1] << 8), src[2] | (src[3] << 8), alpha != NULL);
+  const uint32_t bpp = alpha ? 4 : 3;
+
+  for (int y = 0; y < 4; y++) {
+    uint8_t* row = dst + y * pitch;
+    const uint32_t indices = src[4 + y];
+    for (int x = 0; x < 4; x++) {
+      const uint32_t color = palette[(indices >> (2 * x)) & 0x3];
+      row[x * bpp + 0] = (uint8_t)color;
+      row[x * bpp + 1] = (uint8_t)(color >> 8);
+      row[x * bpp + 2] = (uint8_t)(color >> 16);
+      if (alpha)
+        row[x * bpp + 3] = alpha[y * 4 + x];
     }
   }
 }
 
-void iDecodeDXT3Block(unsigned char *dest, int w, int h, int xOff, int yOff, unsigned char *src)
+// DXT1 to RGB8
+static void iDecodeBC1Block(uint8_t* dst, const uint32_t pitch, const uint8_t* src)
+{
+  iDecodeColorBlock(dst, pitch, src, NULL);
+}
+
+// DXT3 to RGBA8
+static void iDecodeBC2Block(uint8_t* dst, const uint32_t pitch, const uint8_t* src)
+{
+  uint8_t alpha[16];
+  for (int i = 0; i < 8; i++) {
+    alpha[i * 2 + 0] = (uint8_t)((src[i] & 0xF) * 17);
+    alpha[i * 2 + 1] = (uint8_t)((src[i] >> 4) * 17);
+  }
+  iDecodeColorBlock(dst, pitch, src + 8, alpha);
+}
+
+// DXT5 to RGBA8
+static void iDecodeBC3Block(uint8_t* dst, const uint32_t pitch, const uint8_t* src)
+{
+  uint8_t alpha[16];
+  iDecodeBC4Values(alpha, src);
+  iDecodeColorBlock(dst, pitch, src + 8, alpha);
+}
+
+// ATI1N to R8
+static void iDecodeBC4Block(uint8_t* dst, const uint32_t pitch, const uint8_t* src)
+{
+  uint8_t values[16];
+  iDecodeBC4Values(values, src);
+  for (int y = 0; y < 4; y++)
+    memcpy(dst + y * pitch, values + y * 4, 4);
+}
+#endif
+
+// ATI2N to RG8, red is stored first
+static void iDecodeBC5Block(uint8_t* dst, const uint32_t pitch, const uint8_t* src)
 {
-  for (int y = 0; y < h; y++) {
-    unsigned char *dst = dest + yOff * y;
-    unsigned int alpha = ((unsigned short *)src)[y];
-    for (int x = 0; x < w; x++) {
-      *dst = (alpha & 0xF) * 17;
-      alpha >>= 4;
-      dst += xOff;
+#if defined(BLOCK_DECODE_SSSE3)
+  const __m128i r = iDecodeBC4Values(src);
+  const __m128i g = iDecodeBC4Values(src + 8);
+  const __m128i lo = _mm_unpacklo_epi8(r, g);
+  const __m128i hi = _mm_unpackhi_epi8(r, g);
+  _mm_storel_epi64((__m128i*)dst, lo);
+  _mm_storel_epi64((__m128i*)(dst + pitch), _mm_srli_si128(lo, 8));
+  _mm_storel_epi64((__m128i*)(dst + 2 * pitch), hi);
+  _mm_storel_epi64((__m128i*)(dst + 3 * pitch), _mm_srli_si128(hi, 8));
+#else
+  uint8_t red[16];
+  uint8_t green[16];
+  iDecodeBC4Values(red, src);
+  iDecodeBC4Values(green, src + 8);
+  for (int y = 0; y < 4; y++) {
+    for (int x = 0; x < 4; x++) {
+      dst[y * pitch + x * 2 + 0] = red[y * 4 + x];
+      dst[y * pitch + x * 2 + 1] = green[y * 4 + x];
     }
   }
+#endif
+}
+
+typedef void(*DecodeBlockFunc)(uint8_t* dst, const uint32_t pitch, const uint8_t* src);
+
+// Block decoder of one of the supported BCn formats and the format it decodes to, NULL if the format can't be decoded
+static DecodeBlockFunc getBlockDecoder(const ImageFormat::Enum format, ImageFormat::Enum* pUncompressedFormat)
+{
+  switch (format)
+  {
+  case ImageFormat::DXT1:
+  case ImageFormat::GNF_BC1:
+    *pUncompressedFormat = ImageFormat::RGB8;
+    return iDecodeBC1Block;
+  case ImageFormat::DXT3:
+  case ImageFormat::GNF_BC2:
+    *pUncompressedFormat = ImageFormat::RGBA8;
+    return iDecodeBC2Block;
+  case ImageFormat::DXT5:
+  case ImageFormat::GNF_BC3:
+    *pUncompressedFormat = ImageFormat::RGBA8;
+    return iDecodeBC3Block;
+  case ImageFormat::ATI1N:
+  case ImageFormat::GNF_BC4:
+    *pUncompressedFormat = ImageFormat::I8;
+    return iDecodeBC4Block;
+  case ImageFormat::ATI2N:
+  case ImageFormat::GNF_BC5:
+    *pUncompressedFormat = ImageFormat::IA8;
+    return iDecodeBC5Block;
+  default:
+    *pUncompressedFormat = ImageFormat::None;
+    return NULL;
+  }
 }
 
-void iDecodeDXT5Block(unsigned char *dest, int w, int h, int xOff, int yOff, unsigned char *src) {
-  unsigned char a0 = src[0];
-  unsigned char a1 = src[1];
-  uint64_t alpha = (*(uint64_t *)src) >> 16;
+// One 2D surface to decode, split over block rows
+struct DecodeSurfaceJob
+{
+  uint8_t* pDst;
+  const uint8_t* pSrc;
+  uint32_t mWidth;
+  uint32_t mHeight;
+  uint32_t mBlockSize;
+  uint32_t mBytesPerPixel;
+  DecodeBlockFunc pDecodeBlock;
+};
 
-  for (int y = 0; y < h; y++) {
-    unsigned char *dst = dest + yOff * y;
-    for (int x = 0; x < w; x++) {
-      int k = ((unsigned int)alpha) & 0x7;
-      if (k == 0) {
-        *dst = a0;
+static void iDecodeBlockRows(void* pData, uint32_t begin, uint32_t end)
+{
+  const DecodeSurfaceJob* pJob = (const DecodeSurfaceJob*)pData;
+  const uint32_t bpp = pJob->mBytesPerPixel;
+  const uint32_t blocksX = (pJob->mWidth + 3) >> 2;
+  const uint32_t fullBlocksX = pJob->mWidth >> 2;
+  const uint32_t pitch = pJob->mWidth * bpp;
+
+  uint8_t block[16 * 4];
+  const uint8_t* src = pJob->pSrc + (size_t)begin * blocksX * pJob->mBlockSize;
+  for (uint32_t by = begin; by < end; by++) {
+    uint8_t* dst = pJob->pDst + (size_t)by * 4 * pitch;
+    const uint32_t sy = min(pJob->mHeight - by * 4, 4u);
+    for (uint32_t bx = 0; bx < blocksX; bx++) {
+      if (sy == 4 && bx < fullBlocksX) {
+        pJob->pDecodeBlock(dst + bx * 4 * bpp, pitch, src);
       }
-      else if (k == 1) {
-        *dst = a1;
+      else {
+        const uint32_t sx = min(pJob->mWidth - bx * 4, 4u);
+        pJob->pDecodeBlock(block, 4 * bpp, src);
+        for (uint32_t y = 0; y < sy; y++)
+          memcpy(dst + y * pitch + bx * 4 * bpp, block + y * 4 * bpp, sx * bpp);
       }
-      else if (a0 > a1) {
-        *dst = (unsigned char)(((8 - k) * a0 + (k - 1) * a1) / 7);
+      src += pJob->mBlockSize;
+    }
+  }
+}
+
+// Block rows below this count are not worth handing to other threads
+#define DECODE_MIN_BLOCK_ROWS_PER_BATCH 16
+
+void iDecodeCompressedImage(unsigned char *dest, unsigned char *src, const int width, const int height, const ImageFormat::Enum format, ThreadPool* pThreadPool = NULL) {
+  ImageFormat::Enum uncompressedFormat;
+  DecodeSurfaceJob job;
+  job.pDecodeBlock = getBlockDecoder(format, &uncompressedFormat);
+  if (!job.pDecodeBlock) return;
+
+  job.pDst = dest;
+  job.pSrc = src;
+  job.mWidth = width;
+  job.mHeight = height;
+  job.mBlockSize = ImageFormat::GetBytesPerBlock(format);
+  job.mBytesPerPixel = ImageFormat::GetBytesPerPixel(uncompressedFormat);
+
+  const uint32_t blockRows = (height + 3) >> 2;
+  if (pThreadPool)
+    parallelFor(pThreadPool, blockRows, DECODE_MIN_BLOCK_ROWS_PER_BATCH, iDecodeBlockRows, &job);
+  else
+    iDecodeBlockRows(&job, 0, blockRows);
+}
+
+// --- BLOCK ENCODING ---
+
+// Block encoders read the 16 RGBA8 pixels of one block in row order. Blocks that overlap the right or bottom edge
+// repeat the last column and row of the surface. Errors are sums of squared differences of the encoded channels.
+
+// Writes the index of the nearest palette entry of every pixel and returns the error of the block.
+// Pixels and entries are RGBA8, only the channels in channelMask count.
+static uint32_t iFitPalette(uint8_t indices[16], const uint8_t* rgba, const uint32_t* palette, const uint32_t paletteSize, const uint32_t channelMask)
+{
+#if VECTORMATH_MODE_SSE
+  // Channels are widened to 16 bits, one madd sums the squares of R and G and of B and A of two pixels
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i mask = _mm_set1_epi32((int)channelMask);
+  __m128i lo[4], hi[4], best[4], bestIndex[4];
+  for (int i = 0; i < 4; i++) {
+    const __m128i pixels = _mm_and_si128(_mm_loadu_si128((const __m128i*)(rgba + 16 * i)), mask);
+    lo[i] = _mm_unpacklo_epi8(pixels, zero);
+    hi[i] = _mm_unpackhi_epi8(pixels, zero);
+    best[i] = _mm_set1_epi32(0x7FFFFFFF);
+    bestIndex[i] = zero;
+  }
+
+  for (uint32_t k = 0; k < paletteSize; k++) {
+    const __m128i entry = _mm_unpacklo_epi8(_mm_and_si128(_mm_set1_epi32((int)palette[k]), mask), zero);
+    const __m128i index = _mm_set1_epi32((int)k);
+    for (int i = 0; i < 4; i++) {
+      const __m128i dl = _mm_sub_epi16(lo[i], entry);
+      const __m128i dh = _mm_sub_epi16(hi[i], entry);
+      const __m128 sl = _mm_castsi128_ps(_mm_madd_epi16(dl, dl));
+      const __m128 sh = _mm_castsi128_ps(_mm_madd_epi16(dh, dh));
+      const __m128i d = _mm_add_epi32(_mm_castps_si128(_mm_shuffle_ps(sl, sh, _MM_SHUFFLE(2, 0, 2, 0))), _mm_castps_si128(_mm_shuffle_ps(sl, sh, _MM_SHUFFLE(3, 1, 3, 1))));
+      const __m128i less = _mm_cmplt_epi32(d, best[i]);
+      best[i] = _mm_or_si128(_mm_and_si128(less, d), _mm_andnot_si128(less, best[i]));
+      bestIndex[i] = _mm_or_si128(_mm_and_si128(less, index), _mm_andnot_si128(less, bestIndex[i]));
+    }
+  }
+
+  __m128i error = _mm_add_epi32(_mm_add_epi32(best[0], best[1]), _mm_add_epi32(best[2], best[3]));
+  error = _mm_add_epi32(error, _mm_shuffle_epi32(error, _MM_SHUFFLE(1, 0, 3, 2)));
+  error = _mm_add_epi32(error, _mm_shuffle_epi32(error, _MM_SHUFFLE(2, 3, 0, 1)));
+  const __m128i packed = _mm_packus_epi16(_mm_packs_epi32(bestIndex[0], bestIndex[1]), _mm_packs_epi32(bestIndex[2], bestIndex[3]));
+  _mm_storeu_si128((__m128i*)indices, packed);
+  return (uint32_t)_mm_cvtsi128_si32(error);
+#else
+  uint32_t error = 0;
+  for (int i = 0; i < 16; i++) {
+    uint32_t best = 0xFFFFFFFF;
+    for (uint32_t k = 0; k < paletteSize; k++) {
+      uint32_t d = 0;
+      for (int c = 0; c < 4; c++) {
+        if (channelMask & (0xFFu << (8 * c))) {
+          const int diff = (int)rgba[4 * i + c] - (int)((palette[k] >> (8 * c)) & 0xFF);
+          d += diff * diff;
+        }
       }
-      else if (k >= 6) {
-        *dst = (k == 6) ? 0 : 255;
+      if (d < best) {
+        best = d;
+        indices[i] = (uint8_t)k;
       }
-      else {
-        *dst = (unsigned char)(((6 - k) * a0 + (k - 1) * a1) / 5);
+    }
+    error += best;
+  }
+  return error;
+#endif
+}
+
+// Single channel version of iFitPalette for the 8 entries of a BC4 palette
+static uint32_t iFitBC4Palette(uint8_t indices[16], const uint8_t values[16], const uint8_t palette[8])
+{
+#if VECTORMATH_MODE_SSE
+  // The nearest entry is the one with the smallest absolute difference, which fits in bytes
+  const __m128i v = _mm_loadu_si128((const __m128i*)values);
+  __m128i best = _mm_set1_epi8((char)0xFF);
+  __m128i bestIndex = _mm_setzero_si128();
+  for (int k = 0; k < 8; k++) {
+    const __m128i entry = _mm_set1_epi8((char)palette[k]);
+    const __m128i d = _mm_or_si128(_mm_subs_epu8(v, entry), _mm_subs_epu8(entry, v));
+    const __m128i nearer = _mm_min_epu8(d, best);
+    const __m128i less = _mm_andnot_si128(_mm_cmpeq_epi8(nearer, best), _mm_set1_epi8(-1));
+    best = nearer;
+    bestIndex = _mm_or_si128(_mm_and_si128(less, _mm_set1_epi8((char)k)), _mm_andnot_si128(less, bestIndex));
+  }
+  _mm_storeu_si128((__m128i*)indices, bestIndex);
+
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i dl = _mm_unpacklo_epi8(best, zero);
+  const __m128i dh = _mm_unpackhi_epi8(best, zero);
+  __m128i error = _mm_add_epi32(_mm_madd_epi16(dl, dl), _mm_madd_epi16(dh, dh));
+  error = _mm_add_epi32(error, _mm_shuffle_epi32(error, _MM_SHUFFLE(1, 0, 3, 2)));
+  error = _mm_add_epi32(error, _mm_shuffle_epi32(error, _MM_SHUFFLE(2, 3, 0, 1)));
+  return (uint32_t)_mm_cvtsi128_si32(error);
+#else
+  uint32_t error = 0;
+  for (int i = 0; i < 16; i++) {
+    uint32_t best = 0xFFFFFFFF;
+    for (uint32_t k = 0; k < 8; k++) {
+      const int diff = (int)values[i] - (int)palette[k];
+      if ((uint32_t)(diff * diff) < best) {
+        best = diff * diff;
+        indices[i] = (uint8_t)k;
       }
-      alpha >>= 3;
+    }
+    error += best;
+  }
+  return error;
+#endif
+}
+
+// Mean of the pixels and the principal axis through it, from a few power iterations of the covariance matrix.
+// The axis is 0 for blocks of a single color.
+static void iPrincipalAxis(float mean[4], float axis[4], const uint8_t* rgba, const uint32_t channels)
+{
+  for (uint32_t c = 0; c < 4; c++)
+    mean[c] = axis[c] = 0.0f;
+  for (int i = 0; i < 16; i++)
+    for (uint32_t c = 0; c < channels; c++)
+      mean[c] += rgba[4 * i + c];
+  for (uint32_t c = 0; c < channels; c++)
+    mean[c] *= 1.0f / 16.0f;
+
+  float covariance[4][4] = {};
+  for (int i = 0; i < 16; i++) {
+    float d[4];
+    for (uint32_t c = 0; c < channels; c++)
+      d[c] = rgba[4 * i + c] - mean[c];
+    for (uint32_t r = 0; r < channels; r++)
+      for (uint32_t c = r; c < channels; c++)
+        covariance[r][c] += d[r] * d[c];
+  }
+  for (uint32_t r = 0; r < channels; r++)
+    for (uint32_t c = 0; c < r; c++)
+      covariance[r][c] = covariance[c][r];
+
+  // Start from the column of the largest variance, which is never orthogonal to the principal axis
+  uint32_t start = 0;
+  for (uint32_t c = 1; c < channels; c++)
+    if (covariance[c][c] > covariance[start][start])
+      start = c;
+  if (covariance[start][start] <= 0.0f)
+    return;
+
+  float v[4] = {};
+  for (uint32_t c = 0; c < channels; c++)
+    v[c] = covariance[c][start];
+  for (int iteration = 0; iteration < 8; iteration++) {
+    float w[4] = {};
+    float scale = 0.0f;
+    for (uint32_t r = 0; r < channels; r++) {
+      for (uint32_t c = 0; c < channels; c++)
+        w[r] += covariance[r][c] * v[c];
+      scale = max(scale, fabsf(w[r]));
+    }
+    if (scale <= 0.0f)
+      return;
+    for (uint32_t c = 0; c < channels; c++)
+      v[c] = w[c] / scale;
+  }
+
+  float length = 0.0f;
+  for (uint32_t c = 0; c < channels; c++)
+    length += v[c] * v[c];
+  length = sqrtf(length);
+  for (uint32_t c = 0; c < channels; c++)
+    axis[c] = v[c] / length;
+}
+
+// Ends of the segment of the principal axis covered by the pixels
+static void iAxisEndpoints(float e0[4], float e1[4], const float mean[4], const float axis[4], const uint8_t* rgba, const uint32_t channels)
+{
+  float tMin = 0.0f, tMax = 0.0f;
+  for (int i = 0; i < 16; i++) {
+    float t = 0.0f;
+    for (uint32_t c = 0; c < channels; c++)
+      t += (rgba[4 * i + c] - mean[c]) * axis[c];
+    tMin = min(tMin, t);
+    tMax = max(tMax, t);
+  }
+  for (uint32_t c = 0; c < 4; c++) {
+    e0[c] = clamp(mean[c] + tMax * axis[c], 0.0f, 255.0f);
+    e1[c] = clamp(mean[c] + tMin * axis[c], 0.0f, 255.0f);
+  }
+}
+
+// Least squares endpoints for the given indices, weights[k] is the share of e1 in palette entry k.
+// Returns false if every pixel uses the same share, which leaves the system singular.
+static bool iRefineEndpoints(float e0[4], float e1[4], const uint8_t* rgba, const uint8_t indices[16], const float* weights, const uint32_t channels)
+{
+  float aa = 0.0f, ab = 0.0f, bb = 0.0f;
+  float ax[4] = {}, bx[4] = {};
+  for (int i = 0; i < 16; i++) {
+    const float b = weights[indices[i]];
+    const float a = 1.0f - b;
+    aa += a * a;
+    ab += a * b;
+    bb += b * b;
+    for (uint32_t c = 0; c < channels; c++) {
+      ax[c] += a * rgba[4 * i + c];
+      bx[c] += b * rgba[4 * i + c];
+    }
+  }
 
-      dst += xOff;
+  const float det = aa * bb - ab * ab;
+  if (fabsf(det) < 1e-4f)
+    return false;
+  const float invDet = 1.0f / det;
+  for (uint32_t c = 0; c < channels; c++) {
+    e0[c] = clamp((ax[c] * bb - bx[c] * ab) * invDet, 0.0f, 255.0f);
+    e1[c] = clamp((bx[c] * aa - ax[c] * ab) * invDet, 0.0f, 255.0f);
+  }
+  return true;
+}
+
+static inline int iQuantize(const float x, const int maxValue)
+{
+  return (int)(x * maxValue / 255.0f + 0.5f);
+}
+
+static inline uint32_t iQuantize565(const float color[4])
+{
+  return (iQuantize(color[0], 31) << 11) | (iQuantize(color[1], 63) << 5) | iQuantize(color[2], 31);
+}
+
+// Fits the pixels to the palette of the color endpoints, swapping them first so that c0 >= c1 and BC1 blocks use 4 colors
+static uint32_t iFitColorEndpoints(uint8_t indices[16], const uint8_t* rgba, uint32_t* c0, uint32_t* c1, const bool alwaysFourColors)
+{
+  if (*c0 < *c1) {
+    const uint32_t c = *c0;
+    *c0 = *c1;
+    *c1 = c;
+  }
+  uint32_t palette[4];
+  iDecodeColorPalette(palette, *c0, *c1, alwaysFourColors);
+  return iFitPalette(indices, rgba, palette, 4, 0x00FFFFFF);
+}
+
+// Shares of the second endpoint in the entries of a 4 color palette
+static const float gColorPaletteWeights[4] = { 0.0f, 1.0f, 1.0f / 3.0f, 2.0f / 3.0f };
+
+// 8 bytes of the color part of a BC1-3 block, alpha is ignored.
+// The endpoints start at the ends of the principal axis and are refined with least squares, the high quality mode
+// refines further and then walks the quantized endpoints to lower errors one step at a time.
+static void iEncodeColorBlock(uint8_t* dst, const uint8_t* rgba, const bool alwaysFourColors, const CompressionQuality quality)
+{
+  float mean[4], axis[4], e0[4], e1[4];
+  iPrincipalAxis(mean, axis, rgba, 3);
+  iAxisEndpoints(e0, e1, mean, axis, rgba, 3);
+
+  uint32_t c0 = iQuantize565(e0);
+  uint32_t c1 = iQuantize565(e1);
+  uint8_t indices[16], trial[16];
+  uint32_t error = iFitColorEndpoints(indices, rgba, &c0, &c1, alwaysFourColors);
+
+  const int refinements = (quality == COMPRESSION_QUALITY_HIGH) ? 4 : 1;
+  for (int r = 0; r < refinements && error > 0; r++) {
+    if (!iRefineEndpoints(e0, e1, rgba, indices, gColorPaletteWeights, 3))
+      break;
+    uint32_t n0 = iQuantize565(e0);
+    uint32_t n1 = iQuantize565(e1);
+    const uint32_t trialError = iFitColorEndpoints(trial, rgba, &n0, &n1, alwaysFourColors);
+    if (trialError >= error)
+      break;
+    error = trialError;
+    c0 = n0;
+    c1 = n1;
+    memcpy(indices, trial, 16);
+  }
+
+  if (quality == COMPRESSION_QUALITY_HIGH) {
+    // Bit offset and maximum of each 565 channel
+    static const uint32_t shifts[3] = { 11, 5, 0 };
+    static const uint32_t limits[3] = { 31, 63, 31 };
+    bool improved = true;
+    for (int pass = 0; pass < 16 && improved && error > 0; pass++) {
+      improved = false;
+      for (int i = 0; i < 12; i++) {
+        const uint32_t endpoint = i / 6;
+        const uint32_t channel = (i / 2) % 3;
+        const int step = (i & 1) ? 1 : -1;
+        uint32_t n[2] = { c0, c1 };
+        const int value = (int)((n[endpoint] >> shifts[channel]) & limits[channel]) + step;
+        if (value < 0 || value > (int)limits[channel])
+          continue;
+        n[endpoint] = (n[endpoint] & ~(limits[channel] << shifts[channel])) | ((uint32_t)value << shifts[channel]);
+        const uint32_t trialError = iFitColorEndpoints(trial, rgba, &n[0], &n[1], alwaysFourColors);
+        if (trialError < error) {
+          error = trialError;
+          c0 = n[0];
+          c1 = n[1];
+          memcpy(indices, trial, 16);
+          improved = true;
+        }
+      }
     }
-    if (w < 4) alpha >>= (3 * (4 - w));
   }
+
+  dst[0] = (uint8_t)c0;
+  dst[1] = (uint8_t)(c0 >> 8);
+  dst[2] = (uint8_t)c1;
+  dst[3] = (uint8_t)(c1 >> 8);
+  for (int y = 0; y < 4; y++)
+    dst[4 + y] = (uint8_t)(indices[4 * y] | (indices[4 * y + 1] << 2) | (indices[4 * y + 2] << 4) | (indices[4 * y + 3] << 6));
 }
 
-void iDecodeCompressedImage(unsigned char *dest, unsigned char *src, const int width, const int height, const ImageFormat::Enum format) {
-  int sx = (width < 4) ? width : 4;
-  int sy = (height < 4) ? height : 4;
+// 8 bytes of a BC4 block, which is also the alpha part of BC3 and each channel of BC5.
+// The fast mode spans the 8 value palette over the range of the block, the high quality mode searches narrower
+// ranges and tries the 6 value palette with explicit 0 and 255.
+static void iEncodeBC4Values(uint8_t* dst, const uint8_t values[16], const CompressionQuality quality)
+{
+  uint32_t lo = 255, hi = 0;
+  for (int i = 0; i < 16; i++) {
+    lo = min(lo, (uint32_t)values[i]);
+    hi = max(hi, (uint32_t)values[i]);
+  }
 
-  int nChannels = ImageFormat::GetChannelCount(format);
+  uint8_t palette[8], indices[16], trial[16];
+  uint32_t a0 = hi, a1 = lo;
+  iDecodeBC4Palette(palette, a0, a1);
+  uint32_t error = iFitBC4Palette(indices, values, palette);
+
+  if (quality == COMPRESSION_QUALITY_HIGH && error > 0) {
+    for (int step = 8; step > 0; step >>= 1) {
+      bool improved = true;
+      while (improved) {
+        improved = false;
+        for (int i = 0; i < 4; i++) {
+          const int n0 = (int)a0 + ((i == 0) ? -step : (i == 1) ? step : 0);
+          const int n1 = (int)a1 + ((i == 2) ? -step : (i == 3) ? step : 0);
+          // Keep the 8 value palette
+          if (n1 < 0 || n0 > 255 || n0 <= n1)
+            continue;
+          iDecodeBC4Palette(palette, (uint32_t)n0, (uint32_t)n1);
+          const uint32_t trialError = iFitBC4Palette(trial, values, palette);
+          if (trialError < error) {
+            error = trialError;
+            a0 = (uint32_t)n0;
+            a1 = (uint32_t)n1;
+            memcpy(indices, trial, 16);
+            improved = true;
+          }
+        }
+      }
+    }
 
-  for (int y = 0; y < height; y += 4) {
-    for (int x = 0; x < width; x += 4) {
-      unsigned char *dst = dest + (y * width + x) * nChannels;
-      if (format == ImageFormat::DXT3) {
-        iDecodeDXT3Block(dst + 3, sx, sy, nChannels, width * nChannels, src);
-        src += 8;
+    uint32_t innerLo = 255, innerHi = 0;
+    for (int i = 0; i < 16; i++) {
+      if (values[i] != 0 && values[i] != 255) {
+        innerLo = min(innerLo, (uint32_t)values[i]);
+        innerHi = max(innerHi, (uint32_t)values[i]);
       }
-      else if (format == ImageFormat::DXT5) {
-        iDecodeDXT5Block(dst + 3, sx, sy, nChannels, width * nChannels, src);
-        src += 8;
+    }
+    if (innerLo <= innerHi) {
+      iDecodeBC4Palette(palette, innerLo, innerHi);
+      const uint32_t trialError = iFitBC4Palette(trial, values, palette);
+      if (trialError < error) {
+        error = trialError;
+        a0 = innerLo;
+        a1 = innerHi;
+        memcpy(indices, trial, 16);
       }
-      if (format <= ImageFormat::DXT5) {
-        iDecodeColorBlock(dst, sx, sy, nChannels, width * nChannels, format, 0, 2, src);
-        src += 8;
+    }
+  }
+
+  dst[0] = (uint8_t)a0;
+  dst[1] = (uint8_t)a1;
+  for (int half = 0; half < 2; half++) {
+    uint32_t bits = 0;
+    for (int i = 0; i < 8; i++)
+      bits |= (uint32_t)indices[8 * half + i] << (3 * i);
+    dst[2 + 3 * half] = (uint8_t)bits;
+    dst[3 + 3 * half] = (uint8_t)(bits >> 8);
+    dst[4 + 3 * half] = (uint8_t)(bits >> 16);
+  }
+}
+
+// One channel of the block as 16 consecutive values
+static inline void iGetBlockChannel(uint8_t values[16], const uint8_t* rgba, const uint32_t channel)
+{
+  for (int i = 0; i < 16; i++)
+    values[i] = rgba[4 * i + channel];
+}
+
+// RGB to DXT1
+static void iEncodeBC1Block(uint8_t* dst, const uint8_t* rgba, const CompressionQuality quality)
+{
+  iEncodeColorBlock(dst, rgba, false, quality);
+}
+
+// RGBA to DXT3
+static void iEncodeBC2Block(uint8_t* dst, const uint8_t* rgba, const CompressionQuality quality)
+{
+  for (int i = 0; i < 8; i++)
+    dst[i] = (uint8_t)(((rgba[8 * i + 3] * 15 + 127) / 255) | (((rgba[8 * i + 7] * 15 + 127) / 255) << 4));
+  iEncodeColorBlock(dst + 8, rgba, true, quality);
+}
+
+// RGBA to DXT5
+static void iEncodeBC3Block(uint8_t* dst, const uint8_t* rgba, const CompressionQuality quality)
+{
+  uint8_t alpha[16];
+  iGetBlockChannel(alpha, rgba, 3);
+  iEncodeBC4Values(dst, alpha, quality);
+  iEncodeColorBlock(dst + 8, rgba, true, quality);
+}
+
+// Red to ATI1N
+static void iEncodeBC4Block(uint8_t* dst, const uint8_t* rgba, const CompressionQuality quality)
+{
+  uint8_t red[16];
+  iGetBlockChannel(red, rgba, 0);
+  iEncodeBC4Values(dst, red, quality);
+}
+
+// Red and green to ATI2N, red is stored first
+static void iEncodeBC5Block(uint8_t* dst, const uint8_t* rgba, const CompressionQuality quality)
+{
+  uint8_t values[16];
+  iGetBlockChannel(values, rgba, 0);
+  iEncodeBC4Values(dst, values, quality);
+  iGetBlockChannel(values, rgba, 1);
+  iEncodeBC4Values(dst + 8, values, quality);
+}
+
+// BC7 is encoded in mode 6 only: one subset with RGBA endpoints of 7 bits plus a shared lowest bit (p-bit) per
+// endpoint and 4 bit indices. The partitioned modes are not searched.
+static const uint32_t gBC7Weights4[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+static const float gBC7PaletteWeights4[16] = {
+  0 / 64.0f, 4 / 64.0f, 9 / 64.0f, 13 / 64.0f, 17 / 64.0f, 21 / 64.0f, 26 / 64.0f, 30 / 64.0f,
+  34 / 64.0f, 38 / 64.0f, 43 / 64.0f, 47 / 64.0f, 51 / 64.0f, 55 / 64.0f, 60 / 64.0f, 64 / 64.0f,
+};
+
+// Endpoints of a mode 6 block, 7 bit channels and the p-bit of each endpoint
+struct BC7Mode6Endpoints
+{
+  uint32_t mColor[2][4];
+  uint32_t mPBit[2];
+};
+
+// Nearest 7 bit value of x once the p-bit is appended
+static inline uint32_t iQuantizeBC7Channel(const float x, const uint32_t pBit)
+{
+  return (uint32_t)clamp((int)((x - pBit) * 0.5f + 0.5f), 0, 127);
+}
+
+static void iQuantizeBC7Endpoint(BC7Mode6Endpoints* pEndpoints, const uint32_t endpoint, const float color[4], const uint32_t pBit)
+{
+  for (int c = 0; c < 4; c++)
+    pEndpoints->mColor[endpoint][c] = iQuantizeBC7Channel(color[c], pBit);
+  pEndpoints->mPBit[endpoint] = pBit;
+}
+
+// Quantizes with the p-bit that is closest to the color
+static void iQuantizeBC7EndpointBestPBit(BC7Mode6Endpoints* pEndpoints, const uint32_t endpoint, const float color[4])
+{
+  float error[2] = {};
+  for (uint32_t p = 0; p < 2; p++) {
+    for (int c = 0; c < 4; c++) {
+      const float d = (float)((iQuantizeBC7Channel(color[c], p) << 1) | p) - color[c];
+      error[p] += d * d;
+    }
+  }
+  iQuantizeBC7Endpoint(pEndpoints, endpoint, color, (error[1] < error[0]) ? 1 : 0);
+}
+
+static uint32_t iFitBC7Mode6(uint8_t indices[16], const uint8_t* rgba, const BC7Mode6Endpoints& endpoints)
+{
+  uint32_t palette[16];
+  for (int k = 0; k < 16; k++) {
+    palette[k] = 0;
+    for (int c = 0; c < 4; c++) {
+      const uint32_t v0 = (endpoints.mColor[0][c] << 1) | endpoints.mPBit[0];
+      const uint32_t v1 = (endpoints.mColor[1][c] << 1) | endpoints.mPBit[1];
+      palette[k] |= (((64 - gBC7Weights4[k]) * v0 + gBC7Weights4[k] * v1 + 32) >> 6) << (8 * c);
+    }
+  }
+  return iFitPalette(indices, rgba, palette, 16, 0xFFFFFFFF);
+}
+
+// Appends the lowest count bits of value to a block being written from bit 0 up
+static inline void iWriteBlockBits(uint8_t* dst, uint32_t* pBitOffset, const uint32_t value, const uint32_t count)
+{
+  for (uint32_t i = 0; i < count; i++, (*pBitOffset)++)
+    dst[*pBitOffset >> 3] |= (uint8_t)(((value >> i) & 1) << (*pBitOffset & 7));
+}
+
+// RGBA to BC7.
+// The endpoints start at the ends of the principal axis and are refined with least squares, the high quality mode
+// tries every p-bit pair and then walks the quantized endpoints to lower errors one step at a time.
+static void iEncodeBC7Block(uint8_t* dst, const uint8_t* rgba, const CompressionQuality quality)
+{
+  float mean[4], axis[4], e0[4], e1[4];
+  iPrincipalAxis(mean, axis, rgba, 4);
+  iAxisEndpoints(e0, e1, mean, axis, rgba, 4);
+
+  BC7Mode6Endpoints best;
+  uint8_t indices[16], trial[16];
+  uint32_t error = 0xFFFFFFFF;
+  // The first candidate picks the p-bits closest to the endpoints, the others are the 4 fixed p-bit pairs
+  const uint32_t candidates = (quality == COMPRESSION_QUALITY_HIGH) ? 5 : 1;
+  for (uint32_t candidate = 0; candidate < candidates; candidate++) {
+    float r0[4], r1[4];
+    memcpy(r0, e0, sizeof(r0));
+    memcpy(r1, e1, sizeof(r1));
+    BC7Mode6Endpoints endpoints;
+    uint32_t candidateError = 0xFFFFFFFF;
+    const int refinements = (quality == COMPRESSION_QUALITY_HIGH) ? 3 : 1;
+    for (int r = 0; r <= refinements; r++) {
+      if (candidate > 0) {
+        iQuantizeBC7Endpoint(&endpoints, 0, r0, (candidate - 1) & 1);
+        iQuantizeBC7Endpoint(&endpoints, 1, r1, (candidate - 1) >> 1);
       }
       else {
-        if (format == ImageFormat::ATI1N) {
-          iDecodeDXT5Block(dst, sx, sy, 1, width, src);
-          src += 8;
+        iQuantizeBC7EndpointBestPBit(&endpoints, 0, r0);
+        iQuantizeBC7EndpointBestPBit(&endpoints, 1, r1);
+      }
+      const uint32_t trialError = iFitBC7Mode6(trial, rgba, endpoints);
+      if (trialError >= candidateError)
+        break;
+      candidateError = trialError;
+      if (trialError < error) {
+        error = trialError;
+        best = endpoints;
+        memcpy(indices, trial, 16);
+      }
+      if (r == refinements || trialError == 0 || !iRefineEndpoints(r0, r1, rgba, trial, gBC7PaletteWeights4, 4))
+        break;
+    }
+  }
+
+  if (quality == COMPRESSION_QUALITY_HIGH) {
+    bool improved = true;
+    for (int pass = 0; pass < 16 && improved && error > 0; pass++) {
+      improved = false;
+      for (int i = 0; i < 16; i++) {
+        BC7Mode6Endpoints endpoints = best;
+        uint32_t& value = endpoints.mColor[i / 8][(i / 2) % 4];
+        if ((i & 1) ? (value == 127) : (value == 0))
+          continue;
+        value = (i & 1) ? value + 1 : value - 1;
+        const uint32_t trialError = iFitBC7Mode6(trial, rgba, endpoints);
+        if (trialError < error) {
+          error = trialError;
+          best = endpoints;
+          memcpy(indices, trial, 16);
+          improved = true;
+        }
+      }
+    }
+  }
+
+  // The highest bit of the first index is implicitly 0, flip the endpoints if it is set
+  if (indices[0] & 0x8) {
+    for (int c = 0; c < 4; c++) {
+      const uint32_t color = best.mColor[0][c];
+      best.mColor[0][c] = best.mColor[1][c];
+      best.mColor[1][c] = color;
+    }
+    const uint32_t pBit = best.mPBit[0];
+    best.mPBit[0] = best.mPBit[1];
+    best.mPBit[1] = pBit;
+    for (int i = 0; i < 16; i++)
+      indices[i] = 15 - indices[i];
+  }
+
+  // Mode 6 is 6 zero bits and a one, then R0 R1 G0 G1 B0 B1 A0 A1, P0 P1 and the indices
+  memset(dst, 0, 16);
+  uint32_t bitOffset = 0;
+  iWriteBlockBits(dst, &bitOffset, 1 << 6, 7);
+  for (int c = 0; c < 4; c++) {
+    iWriteBlockBits(dst, &bitOffset, best.mColor[0][c], 7);
+    iWriteBlockBits(dst, &bitOffset, best.mColor[1][c], 7);
+  }
+  iWriteBlockBits(dst, &bitOffset, best.mPBit[0], 1);
+  iWriteBlockBits(dst, &bitOffset, best.mPBit[1], 1);
+  iWriteBlockBits(dst, &bitOffset, indices[0], 3);
+  for (int i = 1; i < 16; i++)
+    iWriteBlockBits(dst, &bitOffset, indices[i], 4);
+  ASSERT(bitOffset == 128);
+}
+
+typedef void(*EncodeBlockFunc)(uint8_t* dst, const uint8_t* rgba, const CompressionQuality quality);
+
+// Block encoder of one of the supported BCn formats, NULL if the format can't be encoded
+static EncodeBlockFunc getBlockEncoder(const ImageFormat::Enum format)
+{
+  switch (format) {
+  case ImageFormat::DXT1:
+  case ImageFormat::GNF_BC1:
+    return iEncodeBC1Block;
+  case ImageFormat::DXT3:
+  case ImageFormat::GNF_BC2:
+    return iEncodeBC2Block;
+  case ImageFormat::DXT5:
+  case ImageFormat::GNF_BC3:
+    return iEncodeBC3Block;
+  case ImageFormat::ATI1N:
+  case ImageFormat::GNF_BC4:
+    return iEncodeBC4Block;
+  case ImageFormat::ATI2N:
+  case ImageFormat::GNF_BC5:
+    return iEncodeBC5Block;
+  case ImageFormat::GNF_BC7:
+    return iEncodeBC7Block;
+  default:
+    return NULL;
+  }
+}
+
+// One RGBA8 surface to encode, split over block rows
+struct EncodeSurfaceJob
+{
+  uint8_t* pDst;
+  const uint8_t* pSrc;
+  uint32_t mWidth;
+  uint32_t mHeight;
+  uint32_t mBlockSize;
+  CompressionQuality mQuality;
+  EncodeBlockFunc pEncodeBlock;
+};
+
+static void iEncodeBlockRows(void* pData, uint32_t begin, uint32_t end)
+{
+  const EncodeSurfaceJob* pJob = (const EncodeSurfaceJob*)pData;
+  const uint32_t blocksX = (pJob->mWidth + 3) >> 2;
+  const uint32_t pitch = pJob->mWidth * 4;
+
+  uint8_t block[16 * 4];
+  uint8_t* dst = pJob->pDst + (size_t)begin * blocksX * pJob->mBlockSize;
+  for (uint32_t by = begin; by < end; by++) {
+    for (uint32_t bx = 0; bx < blocksX; bx++) {
+      for (uint32_t y = 0; y < 4; y++) {
+        const uint8_t* row = pJob->pSrc + min(by * 4 + y, pJob->mHeight - 1) * pitch;
+        if (bx * 4 + 4 <= pJob->mWidth) {
+          memcpy(block + y * 16, row + bx * 16, 16);
         }
-        else if ((format == ImageFormat::ATI2N)) {
-          iDecodeDXT5Block(dst, sx, sy, 2, width * 2, src + 8);
-          iDecodeDXT5Block(dst + 1, sx, sy, 2, width * 2, src);
-          src += 16;
+        else {
+          for (uint32_t x = 0; x < 4; x++)
+            memcpy(block + y * 16 + x * 4, row + min(bx * 4 + x, pJob->mWidth - 1) * 4, 4);
         }
-        else return;
       }
+      pJob->pEncodeBlock(dst, block, pJob->mQuality);
+      dst += pJob->mBlockSize;
     }
   }
 }
 
+// Block rows below this count are not worth handing to other threads
+#define ENCODE_MIN_BLOCK_ROWS_PER_BATCH 4
+
+static void iEncodeCompressedImage(unsigned char *dest, const unsigned char *src, const int width, const int height, const ImageFormat::Enum format, const CompressionQuality quality, ThreadPool* pThreadPool) {
+  EncodeSurfaceJob job;
+  job.pEncodeBlock = getBlockEncoder(format);
+  if (!job.pEncodeBlock) return;
+
+  job.pDst = dest;
+  job.pSrc = src;
+  job.mWidth = width;
+  job.mHeight = height;
+  job.mBlockSize = ImageFormat::GetBytesPerBlock(format);
+  job.mQuality = quality;
+
+  const uint32_t blockRows = (height + 3) >> 2;
+  if (pThreadPool)
+    parallelFor(pThreadPool, blockRows, ENCODE_MIN_BLOCK_ROWS_PER_BATCH, iEncodeBlockRows, &job);
+  else
+    iEncodeBlockRows(&job, 0, blockRows);
+}
+
 // --- IMAGE FORMATS ---
 
 int ImageFormat::GetBytesPerPixel(const ImageFormat::Enum format)
@@ -378,6 +1301,8 @@ int ImageFormat::GetBytesPerPixel(const ImageFormat::Enum format)
   };
 
 
+  if (format == ImageFormat::BGRA8) return 4;
+
   ASSERT(format <= ImageFormat::D32F);
 
   return bytesPP[format];
@@ -398,6 +1323,7 @@ int ImageFormat::GetBytesPerBlock(const ImageFormat::Enum format)
   case ImageFormat::DXT1:			//	4x4
   case ImageFormat::ATI1N:			//	4x4
   case ImageFormat::GNF_BC1:		//	4x4
+  case ImageFormat::GNF_BC4:		//	4x4
   case ImageFormat::ETC1:			//	4x4
   case ImageFormat::ATC:			//	4x4
   case ImageFormat::PVR_4BPP:		//	4x4
@@ -408,9 +1334,12 @@ int ImageFormat::GetBytesPerBlock(const ImageFormat::Enum format)
 
   case ImageFormat::DXT3:			//	4x4
   case ImageFormat::DXT5:			//	4x4
+  case ImageFormat::GNF_BC2:		//	4x4
   case ImageFormat::GNF_BC3:		//	4x4
   case ImageFormat::GNF_BC5:		//	4x4
   case ImageFormat::ATI2N:			//	4x4
+  case ImageFormat::GNF_BC6:		//	4x4
+  case ImageFormat::GNF_BC7:		//	4x4
   case ImageFormat::ATCA:			//	4x4
   case ImageFormat::ATCI:			//	4x4
     return 16;
@@ -609,6 +1538,8 @@ int ImageFormat::GetChannelCount(const ImageFormat::Enum format)
   };
 
 
+  if (format == ImageFormat::BGRA8) return 4;
+
   if (format >= sizeof(channelCount) / sizeof(int))
   {
     LOGERRORF("Fail to find Channel in format : %s", ImageFormat::GetFormatString(format));
@@ -642,6 +1573,7 @@ Image::Image() {
   mAdditionalDataSize = 0;
   pAdditionalData = NULL;
   mIsRendertarget = false;
+  mIsSrgb = false;
   mOwnsMemory = true;
 }
 
@@ -652,6 +1584,9 @@ Image::Image(const Image &img) {
   mMipMapCount = img.mMipMapCount;
   mArrayCount = img.mArrayCount;
   mFormat = img.mFormat;
+  mIsSrgb = img.mIsSrgb;
+  mIsRendertarget = img.mIsRendertarget;
+  mOwnsMemory = true;
 
   int size = GetMipMappedSize(0, mMipMapCount) * mArrayCount;
   pData = (unsigned char*)conf_malloc(sizeof(unsigned char) * size);
@@ -670,6 +1605,7 @@ unsigned char *Image::Create(const ImageFormat::Enum fmt, const int w, const int
   mDepth = d;
   mMipMapCount = mipMapCount;
   mArrayCount = arraySize;
+  mIsSrgb = false;
   mOwnsMemory = true;
 
   uint holder = GetMipMappedSize(0, mMipMapCount);
@@ -713,6 +1649,7 @@ void Image::Clear()
   mMipMapCount = 0;
   mArrayCount = 0;
   mFormat = ImageFormat::None;
+  mIsSrgb = false;
 
   mAdditionalDataSize = 0;
 }
@@ -850,52 +1787,97 @@ bool Image::Normalize()
   return true;
 }
 
-bool Image::Uncompress()
+bool Image::Uncompress(ThreadPool* pThreadPool)
 {
-  if (((mFormat >= ImageFormat::PVR_2BPP) && (mFormat <= ImageFormat::PVR_4BPPA))
-    || ((mFormat >= ImageFormat::ETC1) && (mFormat <= ImageFormat::ATCI)))
-  {
-    //	no decompression
-    return false;
-  }
-
   if (ImageFormat::IsCompressedFormat(mFormat))
   {
     ImageFormat::Enum destFormat;
-    if (mFormat >= ImageFormat::ATI1N) {
-      destFormat = (mFormat == ImageFormat::ATI1N) ? ImageFormat::I8 : ImageFormat::IA8;
-    }
-    else {
-      destFormat = (mFormat == ImageFormat::DXT1) ? ImageFormat::RGB8 : ImageFormat::RGBA8;
+    if (!getBlockDecoder(mFormat, &destFormat))
+    {
+      //	no decompression
+      return false;
     }
 
-    ubyte *newPixels = (ubyte*)conf_malloc(sizeof(ubyte) * GetMipMappedSize(0, mMipMapCount, destFormat));
+    // Every array slice holds a whole mip chain
+    uint srcChainSize = GetMipMappedSize(0, mMipMapCount);
+    uint dstChainSize = GetMipMappedSize(0, mMipMapCount, destFormat);
+    ubyte *newPixels = (ubyte*)conf_malloc(sizeof(ubyte) * dstChainSize * mArrayCount);
 
-    int level = 0;
-    ubyte *src, *dst = newPixels;
-    while ((src = GetPixels(level)) != NULL) {
-      int w = GetWidth(level);
-      int h = GetHeight(level);
-      int d = (mDepth == 0) ? 6 : GetDepth(level);
+    ubyte *src = pData, *dst = newPixels;
+    for (uint arraySlice = 0; arraySlice < mArrayCount; arraySlice++) {
+      for (uint level = 0; level < mMipMapCount; level++) {
+        int w = GetWidth(level);
+        int h = GetHeight(level);
+        int d = (mDepth == 0) ? 6 : GetDepth(level);
 
-      int dstSliceSize = GetArraySliceSize(level, destFormat);
-      int srcSliceSize = GetArraySliceSize(level, mFormat);
+        int dstSliceSize = GetArraySliceSize(level, destFormat);
+        int srcSliceSize = GetArraySliceSize(level, mFormat);
 
-      for (int slice = 0; slice < d; slice++) {
-        iDecodeCompressedImage(dst, src, w, h, mFormat);
+        for (int slice = 0; slice < d; slice++) {
+          iDecodeCompressedImage(dst, src, w, h, mFormat, pThreadPool);
 
-        dst += dstSliceSize;
-        src += srcSliceSize;
+          dst += dstSliceSize;
+          src += srcSliceSize;
+        }
       }
-      level++;
+      ASSERT(src == pData + srcChainSize * (arraySlice + 1));
+      ASSERT(dst == newPixels + dstChainSize * (arraySlice + 1));
     }
 
     mFormat = destFormat;
 
     Destroy();
     pData = newPixels;
+    mOwnsMemory = true;
+  }
+
+  return true;
+}
+
+bool Image::Compress(const ImageFormat::Enum newFormat, const CompressionQuality quality, ThreadPool* pThreadPool)
+{
+  if (!getBlockEncoder(newFormat) || ImageFormat::IsCompressedFormat(mFormat))
+  {
+    LOGERRORF("Image: %s fail to compress from  %s  to  %s", mLoadFileName.c_str(), ImageFormat::GetFormatString(mFormat), ImageFormat::GetFormatString(newFormat));
+    return false;
+  }
+
+  // The block encoders read RGBA8
+  if (mFormat != ImageFormat::RGBA8 && !Convert(ImageFormat::RGBA8, pThreadPool))
+    return false;
+
+  // Every array slice holds a whole mip chain
+  uint srcChainSize = GetMipMappedSize(0, mMipMapCount);
+  uint dstChainSize = GetMipMappedSize(0, mMipMapCount, newFormat);
+  ubyte *newPixels = (ubyte*)conf_malloc(sizeof(ubyte) * dstChainSize * mArrayCount);
+
+  ubyte *src = pData, *dst = newPixels;
+  for (uint arraySlice = 0; arraySlice < mArrayCount; arraySlice++) {
+    for (uint level = 0; level < mMipMapCount; level++) {
+      int w = GetWidth(level);
+      int h = GetHeight(level);
+      int d = (mDepth == 0) ? 6 : GetDepth(level);
+
+      int dstSliceSize = GetArraySliceSize(level, newFormat);
+      int srcSliceSize = GetArraySliceSize(level, mFormat);
+
+      for (int slice = 0; slice < d; slice++) {
+        iEncodeCompressedImage(dst, src, w, h, newFormat, quality, pThreadPool);
+
+        dst += dstSliceSize;
+        src += srcSliceSize;
+      }
+    }
+    ASSERT(src == pData + srcChainSize * (arraySlice + 1));
+    ASSERT(dst == newPixels + dstChainSize * (arraySlice + 1));
   }
 
+  mFormat = newFormat;
+
+  Destroy();
+  pData = newPixels;
+  mOwnsMemory = true;
+
   return true;
 }
 
@@ -1132,6 +2114,7 @@ bool Image::iLoadDDSFromMemory(const char* memory, uint32_t memSize, const bool
   mDepth = (header.mCaps.mDWCaps2 & DDSCAPS2_CUBEMAP) ? 0 : (header.mDWDepth == 0) ? 1 : header.mDWDepth;
   mMipMapCount = (useMipMaps == false || (header.mDWMipMapCount == 0)) ? 1 : header.mDWMipMapCount;
   mArrayCount = 1;
+  mIsSrgb = false;
 
   if (header.mPixelFormat.mDWFourCC == MAKE_CHAR4('D', 'X', '1', '0'))
   {
@@ -1162,14 +2145,14 @@ bool Image::iLoadDDSFromMemory(const char* memory, uint32_t memSize, const bool
     case 26: mFormat = ImageFormat::RG11B10F; break;
     case 24: mFormat = ImageFormat::RGB10A2; break;
 
-    case 71:
-	case 72:
-		mFormat = ImageFormat::DXT1;
-		break;
+    case 71: mFormat = ImageFormat::DXT1; break;
+    case 72: mFormat = ImageFormat::DXT1; mIsSrgb = true; break;
     case 74: mFormat = ImageFormat::DXT3; break;
     case 77: mFormat = ImageFormat::DXT5; break;
     case 80: mFormat = ImageFormat::ATI1N; break;
     case 83: mFormat = ImageFormat::ATI2N; break;
+    case 98: mFormat = ImageFormat::GNF_BC7; break;
+    case 99: mFormat = ImageFormat::GNF_BC7; mIsSrgb = true; break;
     default:
       return false;
     }
@@ -1859,7 +2842,17 @@ void Image::loadFromMemoryXY(const void *mem, const int topLeftX, const int topL
 	}
 }
 
-bool Image::loadImage(const char *fileName, bool useMipmaps, memoryAllocationFunc pAllocator, void* pUserData, FSRoot root)
+static bool isImageFileSupported(const char* extension)
+{
+  for (int i = 0; i < sizeof(gImageLoaders) / sizeof(gImageLoaders[0]); i++)
+  {
+    if (stricmp(extension, gImageLoaders[i].Extension) == 0)
+      return true;
+  }
+  return false;
+}
+
+bool Image::loadImageFromMemory(const char *fileName, const void* pData, uint32_t size, bool useMipmaps, memoryAllocationFunc pAllocator, void* pUserData)
 {
   // clear current image
   Clear();
@@ -1868,51 +2861,42 @@ bool Image::loadImage(const char *fileName, bool useMipmaps, memoryAllocationFun
   if (extension == NULL)
     return false;
 
-  // open file
-  File file = {};
-  file.Open (fileName, FM_ReadBinary, root);
-  if (!file.IsOpen())
-  {
-    ErrorMsg("\"%s\": Image file not found.", fileName);
-    return false;
-  }
-
-  // load file into memory
-  uint32_t length = file.GetSize();
-  if (length == 0)
+  if (!isImageFileSupported(extension))
   {
-    //char output[256];
-    //sprintf(output, "\"%s\": Image file is empty.", fileName);
-    ErrorMsg("\"%s\": Image is an empty file.", fileName);
-    file.Close();
+    LOGERRORF("Can't load this file format for image  :  %s", fileName);
     return false;
   }
 
-  // read and close file.
-  char *data = (char *) conf_malloc(length*sizeof(char));
-  file.Read(data, (unsigned)length);
-  file.Close();
-
   // try loading the format
   bool loaded = false;
-  bool support = false;
   for (int i = 0; i < sizeof(gImageLoaders) / sizeof(gImageLoaders[0]); i++)
   {
     if (stricmp(extension, gImageLoaders[i].Extension) == 0)
     {
-      support = true;
-      loaded = (this->*(gImageLoaders[i].Loader))(data, length, useMipmaps, pAllocator, pUserData);
+      loaded = (this->*(gImageLoaders[i].Loader))((const char*)pData, size, useMipmaps, pAllocator, pUserData);
 	  if (loaded)
 	  {
 		  break;
 	  }
     }
   }
-  if (!support)
+
+  mLoadFileName = fileName;
+  return loaded;
+}
+
+bool Image::loadImage(const char *fileName, bool useMipmaps, memoryAllocationFunc pAllocator, void* pUserData, FSRoot root)
+{
+  // clear current image
+  Clear();
+
+  const char *extension = strrchr(fileName, '.');
+  if (extension == NULL)
+    return false;
+
+#if defined(TARGET_IOS)
+  if (!isImageFileSupported(extension))
   {
-#if !defined(TARGET_IOS)
-    LOGERRORF("Can't load this file format for image  :  %s", fileName);
-#else
       // Try fallback with uncompressed textures: TODO: this shouldn't be here
       char* uncompressedFileName = strdup(fileName);
       char* uncompressedExtension = strrchr(uncompressedFileName, '.');
@@ -1921,135 +2905,611 @@ bool Image::loadImage(const char *fileName, bool useMipmaps, memoryAllocationFun
       uncompressedExtension[2] = 'g';
       uncompressedExtension[3] = 'a';
       uncompressedExtension[4] = '\0';
-      loaded = loadImage(uncompressedFileName, useMipmaps, pAllocator, pUserData, root);
+      bool loaded = loadImage(uncompressedFileName, useMipmaps, pAllocator, pUserData, root);
       conf_free(uncompressedFileName);
       if (!loaded)
       {
           LOGERRORF("Can't load this file format for image  :  %s", fileName);
       }
+      return loaded;
+  }
 #endif
+
+  // Map the file instead of reading it into a temporary buffer. The loaders parse the headers in place and
+  // copy the pixels straight from the mapping into pData or the memory returned by pAllocator.
+  MappedFile file;
+  if (!file.Open(fileName, root))
+  {
+    ErrorMsg("\"%s\": Image file not found.", fileName);
+    return false;
   }
-  else
+
+  uint32_t length = (uint32_t)file.GetSize();
+  if (length == 0)
   {
-    mLoadFileName = fileName;
+    ErrorMsg("\"%s\": Image is an empty file.", fileName);
+    return false;
   }
-  // cleanup the compressed data
-  conf_free( data);
 
-  return loaded;
+  // the mapping is released with file
+  return loadImageFromMemory(fileName, file.GetData(), length, useMipmaps, pAllocator, pUserData);
 }
 
-bool Image::Convert(const ImageFormat::Enum newFormat) {
-  ubyte *newPixels;
-  uint nPixels = GetNumberOfPixels(0, mMipMapCount) * mArrayCount;
+/************************************************************************/
+// Format conversion
+/************************************************************************/
+// Channel types of the plain formats with dedicated conversion and downsampling kernels
+enum PlainFormatClass
+{
+	PLAIN_FORMAT_UNORM8,
+	PLAIN_FORMAT_UNORM16,
+	PLAIN_FORMAT_HALF,
+	PLAIN_FORMAT_FLOAT,
+	PLAIN_FORMAT_OTHER,
+};
 
-  if (mFormat == ImageFormat::RGBE8 && (newFormat == ImageFormat::RGB32F || newFormat == ImageFormat::RGBA32F)) {
-    newPixels = (ubyte*)conf_malloc(sizeof(ubyte) * GetMipMappedSize(0, mMipMapCount, newFormat) * mArrayCount);
-    float *dest = (float *)newPixels;
-
-    bool writeAlpha = (newFormat == ImageFormat::RGBA32F);
-    ubyte *src = pData;
-    do {
-      *((vec3 *)dest) = rgbeToRGB(src);
-      if (writeAlpha) {
-        dest[3] = 1.0f;
-        dest += 4;
-      }
-      else {
-        dest += 3;
-      }
-      src += 4;
-    } while (--nPixels);
+static PlainFormatClass getPlainFormatClass(const ImageFormat::Enum format)
+{
+	if (format >= ImageFormat::R8 && format <= ImageFormat::RGBA8) return PLAIN_FORMAT_UNORM8;
+	if (format >= ImageFormat::R16 && format <= ImageFormat::RGBA16) return PLAIN_FORMAT_UNORM16;
+	if (format >= ImageFormat::R16F && format <= ImageFormat::RGBA16F) return PLAIN_FORMAT_HALF;
+	if (format >= ImageFormat::R32F && format <= ImageFormat::RGBA32F) return PLAIN_FORMAT_FLOAT;
+	return PLAIN_FORMAT_OTHER;
+}
 
-  }
-  else {
-    if (!ImageFormat::IsPlainFormat(mFormat) || !(ImageFormat::IsPlainFormat(newFormat) || newFormat == ImageFormat::RGB10A2 || newFormat == ImageFormat::RGBE8 || newFormat == ImageFormat::RGB9E5))
-    {
-      LOGERRORF("Image: %s fail to convert from  %s  to  %s",mLoadFileName.c_str(), ImageFormat::GetFormatString(mFormat), ImageFormat::GetFormatString(newFormat));
-      return false;
-    }
-    if (mFormat == newFormat) return true;
-
-    ubyte *src = pData;
-    ubyte *dest = newPixels = (ubyte*)conf_malloc(sizeof(ubyte) * GetMipMappedSize(0, mMipMapCount, newFormat) * mArrayCount);
-
-    if (mFormat == ImageFormat::RGB8 && newFormat == ImageFormat::RGBA8) {
-      // Fast path for RGB->RGBA8
-      do {
-        dest[0] = src[0];
-        dest[1] = src[1];
-        dest[2] = src[2];
-        dest[3] = 255;
-        dest += 4;
-        src += 3;
-      } while (--nPixels);
-    }
-    else {
-      int srcSize = ImageFormat::GetBytesPerPixel(mFormat);
-      int nSrcChannels = ImageFormat::GetChannelCount(mFormat);
+static void halfToFloatRow(float* dst, const uint16_t* src, const uint32_t count)
+{
+	uint32_t i = 0;
+#if VECTORMATH_MODE_SSE && (defined(__F16C__) || defined(__AVX2__))
+	for (; i + 4 <= count; i += 4)
+		_mm_storeu_ps(dst + i, _mm_cvtph_ps(_mm_loadl_epi64((const __m128i*)(src + i))));
+#endif
+	for (; i < count; ++i)
+		dst[i] = ((const half*)src)[i];
+}
 
-      int destSize = ImageFormat::GetBytesPerPixel(newFormat);
-      int nDestChannels = ImageFormat::GetChannelCount(newFormat);
+static void floatToHalfRow(uint16_t* dst, const float* src, const uint32_t count)
+{
+	uint32_t i = 0;
+#if VECTORMATH_MODE_SSE && (defined(__F16C__) || defined(__AVX2__))
+	for (; i + 4 <= count; i += 4)
+		_mm_storel_epi64((__m128i*)(dst + i), _mm_cvtps_ph(_mm_loadu_ps(src + i), 0));
+#endif
+	for (; i < count; ++i)
+		((half*)dst)[i] = half(src[i]);
+}
 
-      do {
-        float rgba[4];
+// Converts count channel values from one channel type to another
+typedef void(*ConvertElementsFunc)(void* pDst, const void* pSrc, uint32_t count);
 
-        if (ImageFormat::IsFloatFormat(mFormat)) {
-          if (mFormat <= ImageFormat::RGBA16F) {
-            for (int i = 0; i < nSrcChannels; i++) rgba[i] = ((half *)src)[i];
-          }
-          else {
-            for (int i = 0; i < nSrcChannels; i++) rgba[i] = ((float *)src)[i];
-          }
-        }
-        else if (mFormat >= ImageFormat::I16 && mFormat <= ImageFormat::RGBA16) {
-          for (int i = 0; i < nSrcChannels; i++) rgba[i] = ((ushort *)src)[i] * (1.0f / 65535.0f);
-        }
-        else {
-          for (int i = 0; i < nSrcChannels; i++) rgba[i] = src[i] * (1.0f / 255.0f);
-        }
-        if (nSrcChannels < 4) rgba[3] = 1.0f;
-        if (nSrcChannels == 1) rgba[2] = rgba[1] = rgba[0];
-
-        if (nDestChannels == 1)	rgba[0] = 0.30f * rgba[0] + 0.59f * rgba[1] + 0.11f * rgba[2];
-
-        if (ImageFormat::IsFloatFormat(newFormat)) {
-          if (newFormat <= ImageFormat::RGBA32F) {
-            if (newFormat <= ImageFormat::RGBA16F) {
-              for (int i = 0; i < nDestChannels; i++)	((half *)dest)[i] = rgba[i];
-            }
-            else {
-              for (int i = 0; i < nDestChannels; i++)	((float *)dest)[i] = rgba[i];
-            }
-          }
-          else {
-            if (newFormat == ImageFormat::RGBE8) {
-              *(uint32 *)dest = rgbToRGBE8(vec3(rgba[0], rgba[1], rgba[2]));
-            }
-            else {
-              *(uint32 *)dest = rgbToRGB9E5(vec3(rgba[0], rgba[1], rgba[2]));
-            }
-          }
-        }
-        else if (newFormat >= ImageFormat::I16 && newFormat <= ImageFormat::RGBA16) {
-          for (int i = 0; i < nDestChannels; i++)	((ushort *)dest)[i] = (ushort)(65535 * saturate(rgba[i]) + 0.5f);
-        }
-        else if (/*isPackedFormat(newFormat)*/newFormat == ImageFormat::RGB10A2) {
-          *(uint *)dest =
-            (uint(1023.0f * saturate(rgba[0]) + 0.5f) << 22) |
-            (uint(1023.0f * saturate(rgba[1]) + 0.5f) << 12) |
-            (uint(1023.0f * saturate(rgba[2]) + 0.5f) << 2) |
-            (uint(3.0f * saturate(rgba[3]) + 0.5f));
-        }
-        else {
-          for (int i = 0; i < nDestChannels; i++)	dest[i] = (unsigned char)(255 * saturate(rgba[i]) + 0.5f);
-        }
+static void convertUNORM8ToUNORM16(void* pDst, const void* pSrc, uint32_t count)
+{
+	const uint8_t* src = (const uint8_t*)pSrc;
+	uint16_t* dst = (uint16_t*)pDst;
+	uint32_t i = 0;
+#if VECTORMATH_MODE_SSE
+	// x * 257 is x replicated into both bytes
+	for (; i + 16 <= count; i += 16)
+	{
+		__m128i v = _mm_loadu_si128((const __m128i*)(src + i));
+		_mm_storeu_si128((__m128i*)(dst + i), _mm_unpacklo_epi8(v, v));
+		_mm_storeu_si128((__m128i*)(dst + i + 8), _mm_unpackhi_epi8(v, v));
+	}
+#endif
+	for (; i < count; ++i)
+		dst[i] = (uint16_t)(src[i] * 257);
+}
 
-        src += srcSize;
-        dest += destSize;
-      } while (--nPixels);
-    }
+#if VECTORMATH_MODE_SSE
+// round(x * 255 / 65535) of 8 values, computed as (x * 255 + 32895) >> 16 in 32 bits
+static inline __m128i unorm16ToUNORM8x8(const __m128i x)
+{
+	const __m128i scale = _mm_set1_epi16(255);
+	const __m128i bias = _mm_set1_epi32(32895);
+	__m128i lo = _mm_mullo_epi16(x, scale);
+	__m128i hi = _mm_mulhi_epu16(x, scale);
+	__m128i p0 = _mm_srli_epi32(_mm_add_epi32(_mm_unpacklo_epi16(lo, hi), bias), 16);
+	__m128i p1 = _mm_srli_epi32(_mm_add_epi32(_mm_unpackhi_epi16(lo, hi), bias), 16);
+	return _mm_packs_epi32(p0, p1);
+}
+#endif
+
+static void convertUNORM16ToUNORM8(void* pDst, const void* pSrc, uint32_t count)
+{
+	const uint16_t* src = (const uint16_t*)pSrc;
+	uint8_t* dst = (uint8_t*)pDst;
+	uint32_t i = 0;
+#if VECTORMATH_MODE_SSE
+	for (; i + 16 <= count; i += 16)
+	{
+		__m128i a = unorm16ToUNORM8x8(_mm_loadu_si128((const __m128i*)(src + i)));
+		__m128i b = unorm16ToUNORM8x8(_mm_loadu_si128((const __m128i*)(src + i + 8)));
+		_mm_storeu_si128((__m128i*)(dst + i), _mm_packus_epi16(a, b));
+	}
+#endif
+	for (; i < count; ++i)
+		dst[i] = (uint8_t)((src[i] * 255u + 32895u) >> 16);
+}
+
+static void convertUNORM8ToFloat(void* pDst, const void* pSrc, uint32_t count)
+{
+	const uint8_t* src = (const uint8_t*)pSrc;
+	float* dst = (float*)pDst;
+	uint32_t i = 0;
+#if VECTORMATH_MODE_SSE
+	const __m128i zero = _mm_setzero_si128();
+	const __m128 scale = _mm_set1_ps(1.0f / 255.0f);
+	for (; i + 16 <= count; i += 16)
+	{
+		__m128i v = _mm_loadu_si128((const __m128i*)(src + i));
+		__m128i lo = _mm_unpacklo_epi8(v, zero);
+		__m128i hi = _mm_unpackhi_epi8(v, zero);
+		_mm_storeu_ps(dst + i, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(lo, zero)), scale));
+		_mm_storeu_ps(dst + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(lo, zero)), scale));
+		_mm_storeu_ps(dst + i + 8, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(hi, zero)), scale));
+		_mm_storeu_ps(dst + i + 12, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(hi, zero)), scale));
+	}
+#endif
+	for (; i < count; ++i)
+		dst[i] = src[i] * (1.0f / 255.0f);
+}
+
+#if VECTORMATH_MODE_SSE
+// (int)(saturate(x) * scale + 0.5f) of 4 values, NaN becomes 0
+static inline __m128i floatToUNORMx4(const __m128 x, const __m128 scale)
+{
+	__m128 v = _mm_min_ps(_mm_max_ps(x, _mm_setzero_ps()), _mm_set1_ps(1.0f));
+	return _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(v, scale), _mm_set1_ps(0.5f)));
+}
+#endif
+
+static void convertFloatToUNORM8(void* pDst, const void* pSrc, uint32_t count)
+{
+	const float* src = (const float*)pSrc;
+	uint8_t* dst = (uint8_t*)pDst;
+	uint32_t i = 0;
+#if VECTORMATH_MODE_SSE
+	const __m128 scale = _mm_set1_ps(255.0f);
+	for (; i + 16 <= count; i += 16)
+	{
+		__m128i a = _mm_packs_epi32(floatToUNORMx4(_mm_loadu_ps(src + i), scale), floatToUNORMx4(_mm_loadu_ps(src + i + 4), scale));
+		__m128i b = _mm_packs_epi32(floatToUNORMx4(_mm_loadu_ps(src + i + 8), scale), floatToUNORMx4(_mm_loadu_ps(src + i + 12), scale));
+		_mm_storeu_si128((__m128i*)(dst + i), _mm_packus_epi16(a, b));
+	}
+#endif
+	for (; i < count; ++i)
+		dst[i] = (uint8_t)(255.0f * saturate(src[i]) + 0.5f);
+}
+
+static void convertUNORM16ToFloat(void* pDst, const void* pSrc, uint32_t count)
+{
+	const uint16_t* src = (const uint16_t*)pSrc;
+	float* dst = (float*)pDst;
+	uint32_t i = 0;
+#if VECTORMATH_MODE_SSE
+	const __m128i zero = _mm_setzero_si128();
+	const __m128 scale = _mm_set1_ps(1.0f / 65535.0f);
+	for (; i + 8 <= count; i += 8)
+	{
+		__m128i v = _mm_loadu_si128((const __m128i*)(src + i));
+		_mm_storeu_ps(dst + i, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(v, zero)), scale));
+		_mm_storeu_ps(dst + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(v, zero)), scale));
+	}
+#endif
+	for (; i < count; ++i)
+		dst[i] = src[i] * (1.0f / 65535.0f);
+}
+
+static void convertFloatToUNORM16(void* pDst, const void* pSrc, uint32_t count)
+{
+	const float* src = (const float*)pSrc;
+	uint16_t* dst = (uint16_t*)pDst;
+	uint32_t i = 0;
+#if VECTORMATH_MODE_SSE
+	// SSE2 only has a signed 32 to 16 bit pack, so the values are biased into the signed range and back
+	const __m128 scale = _mm_set1_ps(65535.0f);
+	const __m128i bias = _mm_set1_epi32(-32768);
+	const __m128i unbias = _mm_set1_epi16(-32768);
+	for (; i + 8 <= count; i += 8)
+	{
+		__m128i a = _mm_add_epi32(floatToUNORMx4(_mm_loadu_ps(src + i), scale), bias);
+		__m128i b = _mm_add_epi32(floatToUNORMx4(_mm_loadu_ps(src + i + 4), scale), bias);
+		_mm_storeu_si128((__m128i*)(dst + i), _mm_xor_si128(_mm_packs_epi32(a, b), unbias));
+	}
+#endif
+	for (; i < count; ++i)
+		dst[i] = (uint16_t)(65535.0f * saturate(src[i]) + 0.5f);
+}
+
+static void convertHalfToFloat(void* pDst, const void* pSrc, uint32_t count)
+{
+	halfToFloatRow((float*)pDst, (const uint16_t*)pSrc, count);
+}
+
+static void convertFloatToHalf(void* pDst, const void* pSrc, uint32_t count)
+{
+	floatToHalfRow((uint16_t*)pDst, (const float*)pSrc, count);
+}
+
+static void convertFloatToFloat(void* pDst, const void* pSrc, uint32_t count)
+{
+	memcpy(pDst, pSrc, count * sizeof(float));
+}
+
+// Direct kernels between channel types, indexed by source and destination PlainFormatClass.
+// Pairs without an entry are converted through float.
+static const ConvertElementsFunc gConvertElementsTable[4][4] =
+{
+	//   UNORM8                 UNORM16                 HALF                FLOAT
+	{ NULL,                   convertUNORM8ToUNORM16, NULL,               convertUNORM8ToFloat },  // UNORM8
+	{ convertUNORM16ToUNORM8, NULL,                   NULL,               convertUNORM16ToFloat }, // UNORM16
+	{ NULL,                   NULL,                   NULL,               convertHalfToFloat },    // HALF
+	{ convertFloatToUNORM8,   convertFloatToUNORM16,  convertFloatToHalf, convertFloatToFloat },   // FLOAT
+};
+
+// Converts pixelCount pixels between two 8 bit layouts
+typedef void(*ConvertPixelsFunc)(uint8_t* pDst, const uint8_t* pSrc, uint32_t pixelCount);
+
+static void convertRGB8ToRGBA8(uint8_t* dst, const uint8_t* src, uint32_t pixelCount)
+{
+	uint32_t i = 0;
+#if VECTORMATH_MODE_SSE && defined(__SSSE3__)
+	// 4 pixels per iteration, the 16 byte load reads ahead by 4 bytes so the last 2 pixels are left to the scalar loop
+	const __m128i shuffle = _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+	const __m128i alpha = _mm_set1_epi32((int)0xFF000000);
+	for (; i + 6 <= pixelCount; i += 4)
+	{
+		__m128i v = _mm_loadu_si128((const __m128i*)(src + i * 3));
+		_mm_storeu_si128((__m128i*)(dst + i * 4), _mm_or_si128(_mm_shuffle_epi8(v, shuffle), alpha));
+	}
+#endif
+	for (; i < pixelCount; ++i)
+	{
+		dst[i * 4 + 0] = src[i * 3 + 0];
+		dst[i * 4 + 1] = src[i * 3 + 1];
+		dst[i * 4 + 2] = src[i * 3 + 2];
+		dst[i * 4 + 3] = 255;
+	}
+}
+
+static void convertRGBA8ToRGB8(uint8_t* dst, const uint8_t* src, uint32_t pixelCount)
+{
+	uint32_t i = 0;
+#if VECTORMATH_MODE_SSE && defined(__SSSE3__)
+	const __m128i shuffle = _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+	for (; i + 4 <= pixelCount; i += 4)
+	{
+		__m128i v = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(src + i * 4)), shuffle);
+		_mm_storel_epi64((__m128i*)(dst + i * 3), v);
+		*(int*)(dst + i * 3 + 8) = _mm_cvtsi128_si32(_mm_srli_si128(v, 8));
+	}
+#endif
+	for (; i < pixelCount; ++i)
+	{
+		dst[i * 3 + 0] = src[i * 4 + 0];
+		dst[i * 3 + 1] = src[i * 4 + 1];
+		dst[i * 3 + 2] = src[i * 4 + 2];
+	}
+}
+
+// RGBA8 <-> BGRA8
+static void convertSwapRB8(uint8_t* dst, const uint8_t* src, uint32_t pixelCount)
+{
+	uint32_t i = 0;
+#if VECTORMATH_MODE_SSE
+	const __m128i maskGA = _mm_set1_epi32((int)0xFF00FF00);
+	const __m128i maskR = _mm_set1_epi32(0x000000FF);
+	for (; i + 4 <= pixelCount; i += 4)
+	{
+		__m128i v = _mm_loadu_si128((const __m128i*)(src + i * 4));
+		__m128i rb = _mm_or_si128(_mm_slli_epi32(_mm_and_si128(v, maskR), 16), _mm_and_si128(_mm_srli_epi32(v, 16), maskR));
+		_mm_storeu_si128((__m128i*)(dst + i * 4), _mm_or_si128(_mm_and_si128(v, maskGA), rb));
+	}
+#endif
+	for (; i < pixelCount; ++i)
+	{
+		dst[i * 4 + 0] = src[i * 4 + 2];
+		dst[i * 4 + 1] = src[i * 4 + 1];
+		dst[i * 4 + 2] = src[i * 4 + 0];
+		dst[i * 4 + 3] = src[i * 4 + 3];
+	}
+}
+
+static ConvertPixelsFunc getConvertPixelsFunc(const ImageFormat::Enum srcFormat, const ImageFormat::Enum dstFormat)
+{
+	if (srcFormat == ImageFormat::RGB8 && dstFormat == ImageFormat::RGBA8) return convertRGB8ToRGBA8;
+	if (srcFormat == ImageFormat::RGBA8 && dstFormat == ImageFormat::RGB8) return convertRGBA8ToRGB8;
+	if ((srcFormat == ImageFormat::RGBA8 && dstFormat == ImageFormat::BGRA8) ||
+		(srcFormat == ImageFormat::BGRA8 && dstFormat == ImageFormat::RGBA8))
+		return convertSwapRB8;
+	return NULL;
+}
+
+// Pixels converted through the RGBA float intermediate at a time, sized to stay in the L1 cache
+#define CONVERT_CHUNK_PIXELS 256
+
+static bool canDecodeToRGBA(const ImageFormat::Enum format)
+{
+	return getPlainFormatClass(format) != PLAIN_FORMAT_OTHER || format == ImageFormat::RGBE8 || format == ImageFormat::BGRA8;
+}
+
+static bool canEncodeFromRGBA(const ImageFormat::Enum format)
+{
+	return getPlainFormatClass(format) != PLAIN_FORMAT_OTHER || format == ImageFormat::RGBE8 || format == ImageFormat::RGB9E5 ||
+		format == ImageFormat::RGB10A2 || format == ImageFormat::BGRA8;
+}
+
+// Decodes count pixels to RGBA float. Missing color channels are 0 (or replicated from red for single channel formats), missing alpha is 1.
+static void decodeToRGBA(float* rgba, const uint8_t* src, const uint32_t count, const ImageFormat::Enum format, float* temp)
+{
+	if (format == ImageFormat::RGBE8)
+	{
+		for (uint32_t i = 0; i < count; ++i, src += 4, rgba += 4)
+		{
+			const float scale = src[3] ? ldexpf(1.0f, src[3] - (int)(128 + 8)) : 0.0f;
+			rgba[0] = src[0] * scale;
+			rgba[1] = src[1] * scale;
+			rgba[2] = src[2] * scale;
+			rgba[3] = 1.0f;
+		}
+		return;
+	}
+	if (format == ImageFormat::BGRA8)
+	{
+		convertUNORM8ToFloat(rgba, src, count * 4);
+		for (uint32_t i = 0; i < count; ++i)
+		{
+			float r = rgba[i * 4 + 2];
+			rgba[i * 4 + 2] = rgba[i * 4];
+			rgba[i * 4] = r;
+		}
+		return;
+	}
+
+	const uint32_t c = ImageFormat::GetChannelCount(format);
+	const PlainFormatClass formatClass = getPlainFormatClass(format);
+	float* values = (c == 4) ? rgba : temp;
+	switch (formatClass)
+	{
+	case PLAIN_FORMAT_UNORM8: convertUNORM8ToFloat(values, src, count * c); break;
+	case PLAIN_FORMAT_UNORM16: convertUNORM16ToFloat(values, src, count * c); break;
+	case PLAIN_FORMAT_HALF: convertHalfToFloat(values, src, count * c); break;
+	case PLAIN_FORMAT_FLOAT: convertFloatToFloat(values, src, count * c); break;
+	default: ASSERT(false);
+	}
+
+	if (c == 4)
+		return;
+	for (uint32_t i = 0; i < count; ++i, values += c, rgba += 4)
+	{
+		rgba[0] = values[0];
+		rgba[1] = (c == 1) ? values[0] : values[1];
+		rgba[2] = (c == 1) ? values[0] : (c == 3) ? values[2] : 0.0f;
+		rgba[3] = 1.0f;
+	}
+}
+
+#if VECTORMATH_MODE_SSE
+// Loads 4 RGBA pixels as one register per channel
+static inline void loadRGBAx4(const float* rgba, __m128& r, __m128& g, __m128& b, __m128& a)
+{
+	r = _mm_loadu_ps(rgba);
+	g = _mm_loadu_ps(rgba + 4);
+	b = _mm_loadu_ps(rgba + 8);
+	a = _mm_loadu_ps(rgba + 12);
+	_MM_TRANSPOSE4_PS(r, g, b, a);
+}
+#endif
+
+static void encodeRGBE8(uint32_t* dst, const float* rgba, const uint32_t count)
+{
+	uint32_t i = 0;
+#if VECTORMATH_MODE_SSE
+	// Same as rgbToRGBE8: the shared exponent comes straight from the exponent bits of the largest channel
+	const __m128 zero = _mm_setzero_ps();
+	for (; i + 4 <= count; i += 4)
+	{
+		__m128 r, g, b, a;
+		loadRGBAx4(rgba + i * 4, r, g, b, a);
+		r = _mm_max_ps(r, zero);
+		g = _mm_max_ps(g, zero);
+		b = _mm_max_ps(b, zero);
+		__m128 v = _mm_max_ps(_mm_max_ps(r, g), b);
+		__m128i e = _mm_srli_epi32(_mm_castps_si128(v), 23);
+		__m128 scale = _mm_castsi128_ps(_mm_slli_epi32(_mm_sub_epi32(_mm_set1_epi32(261), e), 23));
+		__m128i packed = _mm_or_si128(_mm_or_si128(_mm_cvttps_epi32(_mm_mul_ps(r, scale)), _mm_slli_epi32(_mm_cvttps_epi32(_mm_mul_ps(g, scale)), 8)),
+			_mm_or_si128(_mm_slli_epi32(_mm_cvttps_epi32(_mm_mul_ps(b, scale)), 16), _mm_slli_epi32(_mm_add_epi32(e, _mm_set1_epi32(2)), 24)));
+		packed = _mm_andnot_si128(_mm_castps_si128(_mm_cmplt_ps(v, _mm_set1_ps(1e-32f))), packed);
+		_mm_storeu_si128((__m128i*)(dst + i), packed);
+	}
+#endif
+	for (; i < count; ++i)
+		dst[i] = rgbToRGBE8(vec3(rgba[i * 4], rgba[i * 4 + 1], rgba[i * 4 + 2]));
+}
+
+static void encodeRGB9E5(uint32_t* dst, const float* rgba, const uint32_t count)
+{
+	uint32_t i = 0;
+#if VECTORMATH_MODE_SSE
+	// Same as rgbToRGB9E5, values of 65536 and above saturate with the largest exponent
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 limit = _mm_set1_ps(65536.0f);
+	for (; i + 4 <= count; i += 4)
+	{
+		__m128 r, g, b, a;
+		loadRGBAx4(rgba + i * 4, r, g, b, a);
+		r = _mm_max_ps(r, zero);
+		g = _mm_max_ps(g, zero);
+		b = _mm_max_ps(b, zero);
+		__m128 v = _mm_max_ps(_mm_max_ps(r, g), b);
+		__m128i e = _mm_srli_epi32(_mm_castps_si128(v), 23);
+		__m128 scale = _mm_castsi128_ps(_mm_slli_epi32(_mm_sub_epi32(_mm_set1_epi32(262), e), 23));
+		__m128i packed = _mm_or_si128(_mm_or_si128(_mm_cvttps_epi32(_mm_mul_ps(r, scale)), _mm_slli_epi32(_mm_cvttps_epi32(_mm_mul_ps(g, scale)), 9)),
+			_mm_or_si128(_mm_slli_epi32(_mm_cvttps_epi32(_mm_mul_ps(b, scale)), 18), _mm_slli_epi32(_mm_sub_epi32(e, _mm_set1_epi32(111)), 27)));
+
+		const __m128 inv128 = _mm_set1_ps(1.0f / 128.0f);
+		const __m128i maxMantissa = _mm_set1_epi32(0x1FF);
+		__m128i rBig = _mm_castps_si128(_mm_cmpge_ps(r, limit));
+		__m128i gBig = _mm_castps_si128(_mm_cmpge_ps(g, limit));
+		__m128i bBig = _mm_castps_si128(_mm_cmpge_ps(b, limit));
+		__m128i rs = _mm_or_si128(_mm_and_si128(rBig, maxMantissa), _mm_andnot_si128(rBig, _mm_cvttps_epi32(_mm_mul_ps(r, inv128))));
+		__m128i gs = _mm_or_si128(_mm_and_si128(gBig, maxMantissa), _mm_andnot_si128(gBig, _mm_cvttps_epi32(_mm_mul_ps(g, inv128))));
+		__m128i bs = _mm_or_si128(_mm_and_si128(bBig, maxMantissa), _mm_andnot_si128(bBig, _mm_cvttps_epi32(_mm_mul_ps(b, inv128))));
+		__m128i saturated = _mm_or_si128(_mm_or_si128(rs, _mm_slli_epi32(gs, 9)), _mm_or_si128(_mm_slli_epi32(bs, 18), _mm_set1_epi32((int)(31u << 27))));
+
+		__m128i big = _mm_castps_si128(_mm_cmpge_ps(v, limit));
+		packed = _mm_or_si128(_mm_and_si128(big, saturated), _mm_andnot_si128(big, packed));
+		packed = _mm_andnot_si128(_mm_castps_si128(_mm_cmplt_ps(v, _mm_set1_ps(1.52587890625e-5f))), packed);
+		_mm_storeu_si128((__m128i*)(dst + i), packed);
+	}
+#endif
+	for (; i < count; ++i)
+		dst[i] = rgbToRGB9E5(vec3(rgba[i * 4], rgba[i * 4 + 1], rgba[i * 4 + 2]));
+}
+
+static void encodeRGB10A2(uint32_t* dst, const float* rgba, const uint32_t count)
+{
+	uint32_t i = 0;
+#if VECTORMATH_MODE_SSE
+	for (; i + 4 <= count; i += 4)
+	{
+		__m128 r, g, b, a;
+		loadRGBAx4(rgba + i * 4, r, g, b, a);
+		const __m128 scale = _mm_set1_ps(1023.0f);
+		__m128i packed = _mm_or_si128(
+			_mm_or_si128(_mm_slli_epi32(floatToUNORMx4(r, scale), 22), _mm_slli_epi32(floatToUNORMx4(g, scale), 12)),
+			_mm_or_si128(_mm_slli_epi32(floatToUNORMx4(b, scale), 2), floatToUNORMx4(a, _mm_set1_ps(3.0f))));
+		_mm_storeu_si128((__m128i*)(dst + i), packed);
+	}
+#endif
+	for (; i < count; ++i)
+	{
+		const float* p = rgba + i * 4;
+		dst[i] =
+			(uint(1023.0f * saturate(p[0]) + 0.5f) << 22) |
+			(uint(1023.0f * saturate(p[1]) + 0.5f) << 12) |
+			(uint(1023.0f * saturate(p[2]) + 0.5f) << 2) |
+			(uint(3.0f * saturate(p[3]) + 0.5f));
+	}
+}
+
+// Encodes count RGBA float pixels. Single channel formats receive the luminance of the color.
+static void encodeFromRGBA(uint8_t* dst, float* rgba, const uint32_t count, const ImageFormat::Enum format, float* temp)
+{
+	switch (format)
+	{
+	case ImageFormat::RGBE8: encodeRGBE8((uint32_t*)dst, rgba, count); return;
+	case ImageFormat::RGB9E5: encodeRGB9E5((uint32_t*)dst, rgba, count); return;
+	case ImageFormat::RGB10A2: encodeRGB10A2((uint32_t*)dst, rgba, count); return;
+	case ImageFormat::BGRA8:
+		for (uint32_t i = 0; i < count; ++i)
+		{
+			float r = rgba[i * 4];
+			rgba[i * 4] = rgba[i * 4 + 2];
+			rgba[i * 4 + 2] = r;
+		}
+		convertFloatToUNORM8(dst, rgba, count * 4);
+		return;
+	default:
+		break;
+	}
+
+	const uint32_t c = ImageFormat::GetChannelCount(format);
+	const float* values = rgba;
+	if (c == 1)
+	{
+		for (uint32_t i = 0; i < count; ++i)
+			temp[i] = 0.30f * rgba[i * 4] + 0.59f * rgba[i * 4 + 1] + 0.11f * rgba[i * 4 + 2];
+		values = temp;
+	}
+	else if (c < 4)
+	{
+		for (uint32_t i = 0; i < count; ++i)
+			for (uint32_t j = 0; j < c; ++j)
+				temp[i * c + j] = rgba[i * 4 + j];
+		values = temp;
+	}
+
+	gConvertElementsTable[PLAIN_FORMAT_FLOAT][getPlainFormatClass(format)](dst, values, count * c);
+}
+
+struct ConvertJob
+{
+	const uint8_t* pSrc;
+	uint8_t* pDst;
+	ImageFormat::Enum mSrcFormat;
+	ImageFormat::Enum mDstFormat;
+	uint32_t mSrcBytesPerPixel;
+	uint32_t mDstBytesPerPixel;
+	uint32_t mChannels;                 // Channels of both formats if pConvertElements is set
+	ConvertPixelsFunc pConvertPixels;
+	ConvertElementsFunc pConvertElements;
+};
+
+static void convertPixelRange(void* pData, uint32_t begin, uint32_t end)
+{
+	const ConvertJob* pJob = (const ConvertJob*)pData;
+	const uint8_t* src = pJob->pSrc + (size_t)begin * pJob->mSrcBytesPerPixel;
+	uint8_t* dst = pJob->pDst + (size_t)begin * pJob->mDstBytesPerPixel;
+
+	if (pJob->pConvertPixels)
+	{
+		pJob->pConvertPixels(dst, src, end - begin);
+		return;
+	}
+	if (pJob->pConvertElements)
+	{
+		pJob->pConvertElements(dst, src, (end - begin) * pJob->mChannels);
+		return;
+	}
+
+	float rgba[CONVERT_CHUNK_PIXELS * 4];
+	float temp[CONVERT_CHUNK_PIXELS * 4];
+	for (uint32_t i = begin; i < end; i += CONVERT_CHUNK_PIXELS)
+	{
+		const uint32_t count = min(end - i, (uint32_t)CONVERT_CHUNK_PIXELS);
+		decodeToRGBA(rgba, src, count, pJob->mSrcFormat, temp);
+		encodeFromRGBA(dst, rgba, count, pJob->mDstFormat, temp);
+		src += count * pJob->mSrcBytesPerPixel;
+		dst += count * pJob->mDstBytesPerPixel;
+	}
+}
+
+// Pixels below this count are not worth handing to other threads
+#define CONVERT_MIN_PIXELS_PER_BATCH (16 * 1024)
+
+bool Image::Convert(const ImageFormat::Enum newFormat, ThreadPool* pThreadPool) {
+  if (!canDecodeToRGBA(mFormat) || !canEncodeFromRGBA(newFormat))
+  {
+    LOGERRORF("Image: %s fail to convert from  %s  to  %s",mLoadFileName.c_str(), ImageFormat::GetFormatString(mFormat), ImageFormat::GetFormatString(newFormat));
+    return false;
   }
+  if (mFormat == newFormat) return true;
+
+  uint nPixels = GetNumberOfPixels(0, mMipMapCount) * mArrayCount;
+  ubyte *newPixels = (ubyte*)conf_malloc(sizeof(ubyte) * GetMipMappedSize(0, mMipMapCount, newFormat) * mArrayCount);
+
+  ConvertJob job;
+  job.pSrc = pData;
+  job.pDst = newPixels;
+  job.mSrcFormat = mFormat;
+  job.mDstFormat = newFormat;
+  job.mSrcBytesPerPixel = ImageFormat::GetBytesPerPixel(mFormat);
+  job.mDstBytesPerPixel = ImageFormat::GetBytesPerPixel(newFormat);
+  job.mChannels = ImageFormat::GetChannelCount(mFormat);
+  job.pConvertPixels = getConvertPixelsFunc(mFormat, newFormat);
+  job.pConvertElements = NULL;
+
+  const PlainFormatClass srcClass = getPlainFormatClass(mFormat);
+  const PlainFormatClass dstClass = getPlainFormatClass(newFormat);
+  if (srcClass != PLAIN_FORMAT_OTHER && dstClass != PLAIN_FORMAT_OTHER && job.mChannels == (uint32_t)ImageFormat::GetChannelCount(newFormat))
+    job.pConvertElements = gConvertElementsTable[srcClass][dstClass];
+
+  if (pThreadPool)
+    parallelFor(pThreadPool, nPixels, CONVERT_MIN_PIXELS_PER_BATCH, convertPixelRange, &job);
+  else
+    convertPixelRange(&job, 0, nPixels);
+
   conf_free(pData);
   pData = newPixels;
   mFormat = newFormat;
@@ -2057,6 +3517,9 @@ bool Image::Convert(const ImageFormat::Enum newFormat) {
   return true;
 }
 
+/************************************************************************/
+// Mip map generation
+/************************************************************************/
 template <typename T>
 void buildMipMap(T *dst, const T *src, const uint w, const uint h, const uint d, const uint c) {
 	uint xOff = (w < 2) ? 0 : c;
@@ -2078,10 +3541,480 @@ void buildMipMap(T *dst, const T *src, const uint w, const uint h, const uint d,
 	}
 }
 
-bool Image::GenerateMipMaps(const uint32_t mipMaps)
+// sRGB transfer functions. Decoding goes through a table of all 256 values, encoding through a table indexed by
+// the linear value quantized to 12 bits, which is precise enough to round trip every 8 bit value.
+#define SRGB_ENCODE_TABLE_SIZE 4096
+
+struct SRGBTables
+{
+	float mToLinear[256];
+	uint8_t mFromLinear[SRGB_ENCODE_TABLE_SIZE];
+
+	SRGBTables()
+	{
+		for (uint32_t i = 0; i < 256; ++i)
+		{
+			float c = i / 255.0f;
+			mToLinear[i] = (c <= 0.04045f) ? c / 12.92f : powf((c + 0.055f) / 1.055f, 2.4f);
+		}
+		for (uint32_t i = 0; i < SRGB_ENCODE_TABLE_SIZE; ++i)
+		{
+			float l = i / float(SRGB_ENCODE_TABLE_SIZE - 1);
+			float c = (l <= 0.0031308f) ? l * 12.92f : 1.055f * powf(l, 1.0f / 2.4f) - 0.055f;
+			mFromLinear[i] = (uint8_t)(255.0f * c + 0.5f);
+		}
+	}
+};
+
+static const SRGBTables& getSRGBTables()
+{
+	static SRGBTables tables;
+	return tables;
+}
+
+// Box filter of an even source row pair into one destination row. srcWidth is either even or 1,
+// s1 equals s0 when the source is a single row.
+static void boxDownsampleRowUNORM8(uint8_t* dst, const uint8_t* s0, const uint8_t* s1, const uint32_t dstWidth, const uint32_t srcWidth, const uint32_t c)
+{
+	uint32_t x = 0;
+	const uint32_t xOff = (srcWidth < 2) ? 0 : c;
+#if VECTORMATH_MODE_SSE
+	if (xOff)
+	{
+		const __m128i zero = _mm_setzero_si128();
+		const __m128i two = _mm_set1_epi16(2);
+		if (c == 4)
+		{
+			// 4 source pixels per iteration, the two pixels of a pair are summed by adding the high half onto the low half
+			for (; x + 2 <= dstWidth; x += 2)
+			{
+				__m128i a = _mm_loadu_si128((const __m128i*)(s0 + x * 8));
+				__m128i b = _mm_loadu_si128((const __m128i*)(s1 + x * 8));
+				__m128i lo = _mm_add_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero));
+				__m128i hi = _mm_add_epi16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero));
+				__m128i sum = _mm_add_epi16(_mm_unpacklo_epi64(lo, hi), _mm_unpackhi_epi64(lo, hi));
+				sum = _mm_srli_epi16(_mm_add_epi16(sum, two), 2);
+				_mm_storel_epi64((__m128i*)(dst + x * 4), _mm_packus_epi16(sum, sum));
+			}
+		}
+		else if (c == 1)
+		{
+			// 16 source texels per iteration, horizontal pairs are summed with a multiply add by one
+			const __m128i one = _mm_set1_epi16(1);
+			for (; x + 8 <= dstWidth; x += 8)
+			{
+				__m128i a = _mm_loadu_si128((const __m128i*)(s0 + x * 2));
+				__m128i b = _mm_loadu_si128((const __m128i*)(s1 + x * 2));
+				__m128i lo = _mm_madd_epi16(_mm_add_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero)), one);
+				__m128i hi = _mm_madd_epi16(_mm_add_epi16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero)), one);
+				__m128i sum = _mm_srli_epi16(_mm_add_epi16(_mm_packs_epi32(lo, hi), two), 2);
+				_mm_storel_epi64((__m128i*)(dst + x), _mm_packus_epi16(sum, sum));
+			}
+		}
+	}
+#endif
+	for (; x < dstWidth; ++x)
+	{
+		const uint8_t* a = s0 + x * 2 * c;
+		const uint8_t* b = s1 + x * 2 * c;
+		for (uint32_t i = 0; i < c; ++i)
+			dst[x * c + i] = (uint8_t)((a[i] + a[i + xOff] + b[i] + b[i + xOff] + 2) >> 2);
+	}
+}
+
+static void boxDownsampleRowUNORM16(uint16_t* dst, const uint16_t* s0, const uint16_t* s1, const uint32_t dstWidth, const uint32_t srcWidth, const uint32_t c)
+{
+	uint32_t x = 0;
+	const uint32_t xOff = (srcWidth < 2) ? 0 : c;
+#if VECTORMATH_MODE_SSE
+	if (xOff && c == 4)
+	{
+		// Sums are done in 32 bits. SSE2 only has a signed 32 to 16 bit pack, so the result is biased into the signed range and back.
+		const __m128i zero = _mm_setzero_si128();
+		const __m128i unbias = _mm_set1_epi16(-32768);
+		for (; x < dstWidth; ++x)
+		{
+			__m128i a = _mm_loadu_si128((const __m128i*)(s0 + x * 8));
+			__m128i b = _mm_loadu_si128((const __m128i*)(s1 + x * 8));
+			__m128i sum = _mm_add_epi32(_mm_add_epi32(_mm_unpacklo_epi16(a, zero), _mm_unpackhi_epi16(a, zero)),
+				_mm_add_epi32(_mm_unpacklo_epi16(b, zero), _mm_unpackhi_epi16(b, zero)));
+			sum = _mm_srai_epi32(_mm_add_epi32(sum, _mm_set1_epi32(2)), 2);
+			sum = _mm_add_epi32(sum, _mm_set1_epi32(-32768));
+			sum = _mm_xor_si128(_mm_packs_epi32(sum, sum), unbias);
+			_mm_storel_epi64((__m128i*)(dst + x * 4), sum);
+		}
+	}
+#endif
+	for (; x < dstWidth; ++x)
+	{
+		const uint16_t* a = s0 + x * 2 * c;
+		const uint16_t* b = s1 + x * 2 * c;
+		for (uint32_t i = 0; i < c; ++i)
+			dst[x * c + i] = (uint16_t)(((uint32_t)a[i] + a[i + xOff] + b[i] + b[i + xOff] + 2) >> 2);
+	}
+}
+
+static void boxDownsampleRowFloat(float* dst, const float* s0, const float* s1, const uint32_t dstWidth, const uint32_t srcWidth, const uint32_t c)
+{
+	uint32_t x = 0;
+	const uint32_t xOff = (srcWidth < 2) ? 0 : c;
+#if VECTORMATH_MODE_SSE
+	if (xOff)
+	{
+		const __m128 quarter = _mm_set1_ps(0.25f);
+		if (c == 4)
+		{
+			for (; x < dstWidth; ++x)
+			{
+				__m128 a = _mm_add_ps(_mm_loadu_ps(s0 + x * 8), _mm_loadu_ps(s0 + x * 8 + 4));
+				__m128 b = _mm_add_ps(_mm_loadu_ps(s1 + x * 8), _mm_loadu_ps(s1 + x * 8 + 4));
+				_mm_storeu_ps(dst + x * 4, _mm_mul_ps(_mm_add_ps(a, b), quarter));
+			}
+		}
+		else if (c == 1)
+		{
+			for (; x + 4 <= dstWidth; x += 4)
+			{
+				__m128 lo = _mm_add_ps(_mm_loadu_ps(s0 + x * 2), _mm_loadu_ps(s1 + x * 2));
+				__m128 hi = _mm_add_ps(_mm_loadu_ps(s0 + x * 2 + 4), _mm_loadu_ps(s1 + x * 2 + 4));
+				__m128 sum = _mm_add_ps(_mm_shuffle_ps(lo, hi, _MM_SHUFFLE(2, 0, 2, 0)), _mm_shuffle_ps(lo, hi, _MM_SHUFFLE(3, 1, 3, 1)));
+				_mm_storeu_ps(dst + x, _mm_mul_ps(sum, quarter));
+			}
+		}
+	}
+#endif
+	for (; x < dstWidth; ++x)
+	{
+		const float* a = s0 + x * 2 * c;
+		const float* b = s1 + x * 2 * c;
+		for (uint32_t i = 0; i < c; ++i)
+			dst[x * c + i] = (a[i] + a[i + xOff] + b[i] + b[i + xOff]) * 0.25f;
+	}
+}
+
+// Converts one row of texels to linear float, sRGB applies to the color channels of RGB8 and RGBA8 only
+static void decodeMipRow(float* dst, const uint8_t* src, const uint32_t width, const uint32_t c, const PlainFormatClass formatClass, const bool sRGB)
+{
+	const uint32_t count = width * c;
+	switch (formatClass)
+	{
+	case PLAIN_FORMAT_UNORM8:
+		if (sRGB && c >= 3)
+		{
+			const float* toLinear = getSRGBTables().mToLinear;
+			for (uint32_t i = 0; i < count; ++i)
+				dst[i] = (c == 4 && (i & 3) == 3) ? src[i] / 255.0f : toLinear[src[i]];
+		}
+		else
+		{
+			for (uint32_t i = 0; i < count; ++i)
+				dst[i] = src[i] / 255.0f;
+		}
+		break;
+	case PLAIN_FORMAT_UNORM16:
+		for (uint32_t i = 0; i < count; ++i)
+			dst[i] = ((const uint16_t*)src)[i] / 65535.0f;
+		break;
+	case PLAIN_FORMAT_HALF:
+		halfToFloatRow(dst, (const uint16_t*)src, count);
+		break;
+	case PLAIN_FORMAT_FLOAT:
+		memcpy(dst, src, count * sizeof(float));
+		break;
+	default:
+		ASSERT(false);
+	}
+}
+
+static void encodeMipRow(uint8_t* dst, const float* src, const uint32_t width, const uint32_t c, const PlainFormatClass formatClass, const bool sRGB)
+{
+	const uint32_t count = width * c;
+	switch (formatClass)
+	{
+	case PLAIN_FORMAT_UNORM8:
+		if (sRGB && c >= 3)
+		{
+			const uint8_t* fromLinear = getSRGBTables().mFromLinear;
+			for (uint32_t i = 0; i < count; ++i)
+			{
+				if (c == 4 && (i & 3) == 3)
+					dst[i] = (uint8_t)(255.0f * saturate(src[i]) + 0.5f);
+				else
+					dst[i] = fromLinear[(uint32_t)((SRGB_ENCODE_TABLE_SIZE - 1) * saturate(src[i]) + 0.5f)];
+			}
+		}
+		else
+		{
+			for (uint32_t i = 0; i < count; ++i)
+				dst[i] = (uint8_t)(255.0f * saturate(src[i]) + 0.5f);
+		}
+		break;
+	case PLAIN_FORMAT_UNORM16:
+		for (uint32_t i = 0; i < count; ++i)
+			((uint16_t*)dst)[i] = (uint16_t)(65535.0f * saturate(src[i]) + 0.5f);
+		break;
+	case PLAIN_FORMAT_HALF:
+		floatToHalfRow((uint16_t*)dst, src, count);
+		break;
+	case PLAIN_FORMAT_FLOAT:
+		memcpy(dst, src, count * sizeof(float));
+		break;
+	default:
+		ASSERT(false);
+	}
+}
+
+// Resampling weights of one dimension. Every destination texel has mTapCount taps, unused taps have a weight of 0.
+struct MipFilterKernel
+{
+	uint32_t mTapCount;
+	tinystl::vector<uint32_t> mIndices;
+	tinystl::vector<float> mWeights;
+};
+
+static float sinc(const float x)
+{
+	if (fabsf(x) < 1e-5f) return 1.0f;
+	const float px = PI * x;
+	return sinf(px) / px;
+}
+
+static float besselI0(const float x)
+{
+	float sum = 1.0f;
+	float term = 1.0f;
+	const float halfX = 0.5f * x;
+	for (uint32_t k = 1; k < 32; ++k)
+	{
+		term *= (halfX / k) * (halfX / k);
+		sum += term;
+		if (term < sum * 1e-7f) break;
+	}
+	return sum;
+}
+
+#define MIPMAP_KAISER_WIDTH 3.0f
+#define MIPMAP_KAISER_ALPHA 4.0f
+#define MIPMAP_LANCZOS_WIDTH 3.0f
+
+// x is the distance to the destination texel center in destination texels
+static float evaluateMipFilter(const MipMapFilter filter, const float x)
+{
+	const float ax = fabsf(x);
+	if (filter == MIPMAP_FILTER_KAISER)
+	{
+		if (ax >= MIPMAP_KAISER_WIDTH) return 0.0f;
+		const float t = ax / MIPMAP_KAISER_WIDTH;
+		return sinc(x) * besselI0(MIPMAP_KAISER_ALPHA * sqrtf(1.0f - t * t)) / besselI0(MIPMAP_KAISER_ALPHA);
+	}
+	if (ax >= MIPMAP_LANCZOS_WIDTH) return 0.0f;
+	return sinc(x) * sinc(x / MIPMAP_LANCZOS_WIDTH);
+}
+
+static void createMipFilterKernel(const MipMapFilter filter, const uint32_t srcSize, const uint32_t dstSize, MipFilterKernel* pKernel)
+{
+	const float scale = (float)srcSize / (float)dstSize;
+	// Support of the filter in source texels on each side of the destination texel center
+	const float radius = (filter == MIPMAP_FILTER_BOX) ? 0.5f * scale :
+		scale * ((filter == MIPMAP_FILTER_KAISER) ? MIPMAP_KAISER_WIDTH : MIPMAP_LANCZOS_WIDTH);
+
+	pKernel->mTapCount = (uint32_t)ceilf(2.0f * radius) + 1;
+	pKernel->mIndices.resize(dstSize * pKernel->mTapCount);
+	pKernel->mWeights.resize(dstSize * pKernel->mTapCount);
+
+	for (uint32_t i = 0; i < dstSize; ++i)
+	{
+		const float center = (i + 0.5f) * scale;
+		const int first = (int)floorf(center - radius);
+		uint32_t* indices = &pKernel->mIndices[i * pKernel->mTapCount];
+		float* weights = &pKernel->mWeights[i * pKernel->mTapCount];
+		float total = 0.0f;
+
+		for (uint32_t t = 0; t < pKernel->mTapCount; ++t)
+		{
+			const int s = first + (int)t;
+			float w;
+			if (filter == MIPMAP_FILTER_BOX)
+			{
+				// Coverage of the source texel by the destination footprint
+				w = max(0.0f, min((float)s + 1.0f, center + radius) - max((float)s, center - radius));
+			}
+			else
+			{
+				w = evaluateMipFilter(filter, ((float)s + 0.5f - center) / scale);
+			}
+			// Clamp to edge
+			indices[t] = (uint32_t)clamp(s, 0, (int)srcSize - 1);
+			weights[t] = w;
+			total += w;
+		}
+
+		for (uint32_t t = 0; t < pKernel->mTapCount; ++t)
+			weights[t] /= total;
+	}
+}
+
+// State of generating one mip level for every array slice and cube face of the image.
+// A unit is one 2D surface, either an array slice or a face of a cube array slice.
+struct MipLevelJob
+{
+	tinystl::vector<const uint8_t*> mSrc;
+	tinystl::vector<uint8_t*> mDst;
+	uint32_t mSrcWidth, mSrcHeight;
+	uint32_t mDstWidth, mDstHeight;
+	uint32_t mChannels;
+	uint32_t mBytesPerPixel;
+	PlainFormatClass mFormatClass;
+	bool mSRGB;
+	// Resampling path only
+	const MipFilterKernel* pKernelX;
+	const MipFilterKernel* pKernelY;
+	float* pTemp;                  // Horizontally filtered rows, mSrcHeight rows of mDstWidth texels per unit
+};
+
+// Fast path: 2x2 box filter straight from the source format, one destination row per item
+static void boxDownsampleRows(void* pData, uint32_t begin, uint32_t end)
+{
+	const MipLevelJob* pJob = (const MipLevelJob*)pData;
+	const uint32_t c = pJob->mChannels;
+	const uint32_t srcPitch = pJob->mSrcWidth * pJob->mBytesPerPixel;
+	const uint32_t dstPitch = pJob->mDstWidth * pJob->mBytesPerPixel;
+
+	// Half is filtered as float, the scratch holds two converted source rows and the destination row
+	float* scratch = NULL;
+	if (pJob->mFormatClass == PLAIN_FORMAT_HALF)
+		scratch = (float*)conf_malloc(sizeof(float) * c * (pJob->mSrcWidth * 2 + pJob->mDstWidth));
+
+	for (uint32_t item = begin; item < end; ++item)
+	{
+		const uint32_t unit = item / pJob->mDstHeight;
+		const uint32_t y = item % pJob->mDstHeight;
+		const uint8_t* s0 = pJob->mSrc[unit] + (pJob->mSrcHeight < 2 ? y : y * 2) * srcPitch;
+		const uint8_t* s1 = (pJob->mSrcHeight < 2) ? s0 : s0 + srcPitch;
+		uint8_t* dst = pJob->mDst[unit] + y * dstPitch;
+
+		switch (pJob->mFormatClass)
+		{
+		case PLAIN_FORMAT_UNORM8:
+			boxDownsampleRowUNORM8(dst, s0, s1, pJob->mDstWidth, pJob->mSrcWidth, c);
+			break;
+		case PLAIN_FORMAT_UNORM16:
+			boxDownsampleRowUNORM16((uint16_t*)dst, (const uint16_t*)s0, (const uint16_t*)s1, pJob->mDstWidth, pJob->mSrcWidth, c);
+			break;
+		case PLAIN_FORMAT_FLOAT:
+			boxDownsampleRowFloat((float*)dst, (const float*)s0, (const float*)s1, pJob->mDstWidth, pJob->mSrcWidth, c);
+			break;
+		case PLAIN_FORMAT_HALF:
+		{
+			float* f0 = scratch;
+			float* f1 = scratch + pJob->mSrcWidth * c;
+			float* fDst = f1 + pJob->mSrcWidth * c;
+			halfToFloatRow(f0, (const uint16_t*)s0, pJob->mSrcWidth * c);
+			halfToFloatRow(f1, (const uint16_t*)s1, pJob->mSrcWidth * c);
+			boxDownsampleRowFloat(fDst, f0, f1, pJob->mDstWidth, pJob->mSrcWidth, c);
+			floatToHalfRow((uint16_t*)dst, fDst, pJob->mDstWidth * c);
+			break;
+		}
+		default:
+			ASSERT(false);
+		}
+	}
+
+	conf_free(scratch);
+}
+
+// Resampling path, first pass: decode every source row and filter it horizontally into the temporary buffer
+static void resampleRowsHorizontal(void* pData, uint32_t begin, uint32_t end)
+{
+	const MipLevelJob* pJob = (const MipLevelJob*)pData;
+	const uint32_t c = pJob->mChannels;
+	const uint32_t srcPitch = pJob->mSrcWidth * pJob->mBytesPerPixel;
+	const MipFilterKernel* pKernel = pJob->pKernelX;
+	const uint32_t taps = pKernel->mTapCount;
+	float* row = (float*)conf_malloc(sizeof(float) * c * pJob->mSrcWidth);
+
+	for (uint32_t item = begin; item < end; ++item)
+	{
+		const uint32_t unit = item / pJob->mSrcHeight;
+		const uint32_t y = item % pJob->mSrcHeight;
+		decodeMipRow(row, pJob->mSrc[unit] + y * srcPitch, pJob->mSrcWidth, c, pJob->mFormatClass, pJob->mSRGB);
+
+		float* dst = pJob->pTemp + (size_t)item * pJob->mDstWidth * c;
+		for (uint32_t x = 0; x < pJob->mDstWidth; ++x)
+		{
+			const uint32_t* indices = &pKernel->mIndices[x * taps];
+			const float* weights = &pKernel->mWeights[x * taps];
+			float sum[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+			for (uint32_t t = 0; t < taps; ++t)
+			{
+				const float* texel = row + indices[t] * c;
+				for (uint32_t i = 0; i < c; ++i)
+					sum[i] += weights[t] * texel[i];
+			}
+			for (uint32_t i = 0; i < c; ++i)
+				dst[x * c + i] = sum[i];
+		}
+	}
+
+	conf_free(row);
+}
+
+// Resampling path, second pass: filter the temporary rows vertically and encode them into the destination level
+static void resampleRowsVertical(void* pData, uint32_t begin, uint32_t end)
+{
+	const MipLevelJob* pJob = (const MipLevelJob*)pData;
+	const uint32_t c = pJob->mChannels;
+	const uint32_t count = pJob->mDstWidth * c;
+	const uint32_t dstPitch = pJob->mDstWidth * pJob->mBytesPerPixel;
+	const MipFilterKernel* pKernel = pJob->pKernelY;
+	const uint32_t taps = pKernel->mTapCount;
+	float* row = (float*)conf_malloc(sizeof(float) * count);
+
+	for (uint32_t item = begin; item < end; ++item)
+	{
+		const uint32_t unit = item / pJob->mDstHeight;
+		const uint32_t y = item % pJob->mDstHeight;
+		const float* temp = pJob->pTemp + (size_t)unit * pJob->mSrcHeight * count;
+		const uint32_t* indices = &pKernel->mIndices[y * taps];
+		const float* weights = &pKernel->mWeights[y * taps];
+
+		memset(row, 0, sizeof(float) * count);
+		for (uint32_t t = 0; t < taps; ++t)
+		{
+			if (weights[t] == 0.0f) continue;
+			const float* src = temp + indices[t] * count;
+			uint32_t i = 0;
+#if VECTORMATH_MODE_SSE
+			const __m128 w = _mm_set1_ps(weights[t]);
+			for (; i + 4 <= count; i += 4)
+				_mm_storeu_ps(row + i, _mm_add_ps(_mm_loadu_ps(row + i), _mm_mul_ps(w, _mm_loadu_ps(src + i))));
+#endif
+			for (; i < count; ++i)
+				row[i] += weights[t] * src[i];
+		}
+
+		encodeMipRow(pJob->mDst[unit] + y * dstPitch, row, pJob->mDstWidth, c, pJob->mFormatClass, pJob->mSRGB);
+	}
+
+	conf_free(row);
+}
+
+// Rows below this count are not worth handing to other threads
+#define MIPMAP_MIN_ROWS_PER_BATCH 16
+
+static void runMipLevelJob(ThreadPool* pThreadPool, void (*pFunc)(void*, uint32_t, uint32_t), MipLevelJob* pJob, const uint32_t itemCount)
+{
+	if (pThreadPool)
+		parallelFor(pThreadPool, itemCount, MIPMAP_MIN_ROWS_PER_BATCH, pFunc, pJob);
+	else
+		pFunc(pJob, 0, itemCount);
+}
+
+bool Image::GenerateMipMaps(const uint32_t mipMaps, const MipMapFilter filter, const bool sRGB, ThreadPool* pThreadPool)
 {
 	if (ImageFormat::IsCompressedFormat(mFormat)) return false;
-	if (!(mWidth) || !isPowerOf2(mHeight) || !isPowerOf2(mDepth)) return false;
+	// Volumes still go through the legacy box filter, which only handles power of two dimensions
+	if (Is3D() && (!isPowerOf2(mWidth) || !isPowerOf2(mHeight) || !isPowerOf2(mDepth))) return false;
 
 	uint actualMipMaps = min(mipMaps, GetMipMapCountFromDimensions());
 
@@ -2111,36 +4044,93 @@ bool Image::GenerateMipMaps(const uint32_t mipMaps)
 
 	int n = IsCube() ? 6 : 1;
 
-	for (uint arraySlice = 0; arraySlice < mArrayCount; arraySlice++) {
-		ubyte *src = GetPixels(0, arraySlice);
-		ubyte *dst = GetPixels(1, arraySlice);
-
-		for (uint level = 1; level < mMipMapCount; level++) {
-			int w = GetWidth(level - 1);
-			int h = GetHeight(level - 1);
-			int d = GetDepth(level - 1);
+	const PlainFormatClass formatClass = getPlainFormatClass(mFormat);
+	if (Is3D() || formatClass == PLAIN_FORMAT_OTHER) {
+		for (uint arraySlice = 0; arraySlice < mArrayCount; arraySlice++) {
+			ubyte *src = GetPixels(0, arraySlice);
+			ubyte *dst = GetPixels(1, arraySlice);
+
+			for (uint level = 1; level < mMipMapCount; level++) {
+				int w = GetWidth(level - 1);
+				int h = GetHeight(level - 1);
+				int d = GetDepth(level - 1);
+
+				int srcSize = GetMipMappedSize(level - 1, 1) / n;
+				int dstSize = GetMipMappedSize(level, 1) / n;
+
+				for (int i = 0; i < n; i++) {
+					if (ImageFormat::IsPlainFormat(mFormat)) {
+						if (ImageFormat::IsFloatFormat(mFormat)) {
+							buildMipMap((float *)dst, (float *)src, w, h, d, nChannels);
+						}
+						else if (mFormat >= ImageFormat::I16) {
+							buildMipMap((ushort *)dst, (ushort *)src, w, h, d, nChannels);
+						}
+						else {
+							buildMipMap(dst, src, w, h, d, nChannels);
+						}
+					}
+					src += srcSize;
+					dst += dstSize;
+				}
+			}
+		}
 
-			int srcSize = GetMipMappedSize(level - 1, 1) / n;
-			int dstSize = GetMipMappedSize(level, 1) / n;
+		return true;
+	}
 
+	// Every level depends on the previous one, the rows of all slices and faces of a level are filtered in parallel
+	const uint32_t unitCount = mArrayCount * n;
+	MipLevelJob job;
+	job.mSrc.resize(unitCount);
+	job.mDst.resize(unitCount);
+	job.mChannels = nChannels;
+	job.mBytesPerPixel = ImageFormat::GetBytesPerPixel(mFormat);
+	job.mFormatClass = formatClass;
+	job.mSRGB = sRGB && formatClass == PLAIN_FORMAT_UNORM8;
+
+	MipFilterKernel kernelX;
+	MipFilterKernel kernelY;
+	float* pTemp = NULL;
+
+	for (uint level = 1; level < mMipMapCount; level++) {
+		job.mSrcWidth = GetWidth(level - 1);
+		job.mSrcHeight = GetHeight(level - 1);
+		job.mDstWidth = GetWidth(level);
+		job.mDstHeight = GetHeight(level);
+
+		const uint32_t srcSize = GetMipMappedSize(level - 1, 1) / n;
+		const uint32_t dstSize = GetMipMappedSize(level, 1) / n;
+		for (uint arraySlice = 0; arraySlice < mArrayCount; arraySlice++) {
 			for (int i = 0; i < n; i++) {
-				if (ImageFormat::IsPlainFormat(mFormat)) {
-					if (ImageFormat::IsFloatFormat(mFormat)) {
-						buildMipMap((float *)dst, (float *)src, w, h, d, nChannels);
-					}
-					else if (mFormat >= ImageFormat::I16) {
-						buildMipMap((ushort *)dst, (ushort *)src, w, h, d, nChannels);
-					}
-					else {
-						buildMipMap(dst, src, w, h, d, nChannels);
-					}
-				}
-				src += srcSize;
-				dst += dstSize;
+				job.mSrc[arraySlice * n + i] = GetPixels(level - 1, arraySlice) + i * srcSize;
+				job.mDst[arraySlice * n + i] = GetPixels(level, arraySlice) + i * dstSize;
 			}
 		}
+
+		// The 2x2 box filter is exact for even dimensions, everything else needs proper resampling weights
+		const bool evenWidth = job.mSrcWidth == 1 || !(job.mSrcWidth & 1);
+		const bool evenHeight = job.mSrcHeight == 1 || !(job.mSrcHeight & 1);
+		if (filter == MIPMAP_FILTER_BOX && !job.mSRGB && evenWidth && evenHeight) {
+			runMipLevelJob(pThreadPool, boxDownsampleRows, &job, unitCount * job.mDstHeight);
+			continue;
+		}
+
+		createMipFilterKernel(filter, job.mSrcWidth, job.mDstWidth, &kernelX);
+		createMipFilterKernel(filter, job.mSrcHeight, job.mDstHeight, &kernelY);
+		// Levels only get smaller, so the first allocation is large enough for the whole chain
+		if (!pTemp)
+			pTemp = (float*)conf_malloc(sizeof(float) * unitCount * job.mSrcHeight * job.mDstWidth * nChannels);
+		job.pKernelX = &kernelX;
+		job.pKernelY = &kernelY;
+		job.pTemp = pTemp;
+
+		runMipLevelJob(pThreadPool, resampleRowsHorizontal, &job, unitCount * job.mSrcHeight);
+		runMipLevelJob(pThreadPool, resampleRowsVertical, &job, unitCount * job.mDstHeight);
 	}
 
+	conf_free(pTemp);
+
 	return true;
 }
 
@@ -2246,6 +4236,7 @@ bool Image::iSaveDDS(const char *fileName)
       case ImageFormat::RGB32F:   headerDX10.mDXGIFormat = 6; break;
       case ImageFormat::RGB9E5:   headerDX10.mDXGIFormat = 67; break;
       case ImageFormat::RG11B10F: headerDX10.mDXGIFormat = 26; break;
+      case ImageFormat::GNF_BC7:  headerDX10.mDXGIFormat = 98; break;
       default:
         return false;
       }
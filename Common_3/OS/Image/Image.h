@@ -57,6 +57,21 @@ namespace ImageFormat
   ImageFormat::Enum GetFormatFromString(char *string);
 };
 
+// Reconstruction filter used by Image::GenerateMipMaps
+enum MipMapFilter
+{
+  MIPMAP_FILTER_BOX = 0,
+  MIPMAP_FILTER_KAISER,
+  MIPMAP_FILTER_LANCZOS,
+};
+
+// Endpoint search effort of Image::Compress
+enum CompressionQuality
+{
+  COMPRESSION_QUALITY_FAST = 0,
+  COMPRESSION_QUALITY_HIGH,
+};
+
 typedef void*(*memoryAllocationFunc)(class Image* pImage, uint64_t memoryRequirement, void* pUserData);
 
 class Image
@@ -87,11 +102,22 @@ public:
   uint GetNumberOfPixels(const uint firstMipLevel = 0, uint numMipLevels = ALL_MIPLEVELS) const;
   bool GetColorRange(float &min, float &max);
   bool Normalize();
-  bool Uncompress();
+  // Decodes DXT1/3/5 and BC4/5 (ATI1N/ATI2N and their GNF counterparts) to RGB8, RGBA8, R8 and RG8.
+  // Block rows of large surfaces are distributed over pThreadPool when it is not NULL.
+  bool Uncompress(class ThreadPool* pThreadPool = NULL);
+  // Encodes every mip level, array slice and cube face to DXT1/3/5, ATI1N/ATI2N, their GNF counterparts or GNF_BC7 (BC7).
+  // Other formats are converted to RGBA8 first. Block rows are distributed over pThreadPool when it is not NULL.
+  bool Compress(const ImageFormat::Enum newFormat, const CompressionQuality quality = COMPRESSION_QUALITY_FAST, class ThreadPool* pThreadPool = NULL);
   bool Unpack();
 
-  bool Convert(const ImageFormat::Enum newFormat);
-  bool GenerateMipMaps(const uint32_t mipMaps = ALL_MIPLEVELS);
+  // Converts between the 8 and 16 bit UNORM, half and float formats, BGRA8, RGBE8 and into RGB9E5 and RGB10A2.
+  // Common pairs run on dedicated kernels, everything else goes through RGBA float in cache sized chunks.
+  // Pixels are distributed over pThreadPool when it is not NULL.
+  bool Convert(const ImageFormat::Enum newFormat, class ThreadPool* pThreadPool = NULL);
+  // Box filtering of even dimensions runs on dedicated kernels, odd dimensions, sRGB (RGB8 and RGBA8 only)
+  // and the windowed sinc filters go through a separable float resampler. Volumes need power of two dimensions.
+  // Rows of all array slices and cube faces of a level are distributed over pThreadPool when it is not NULL.
+  bool GenerateMipMaps(const uint32_t mipMaps = ALL_MIPLEVELS, const MipMapFilter filter = MIPMAP_FILTER_BOX, const bool sRGB = false, class ThreadPool* pThreadPool = NULL);
 
   uint GetArrayCount() const { return mArrayCount; }
   uint GetMipMappedSize(const uint firstMipLevel = 0, uint numMipLevels = ALL_MIPLEVELS, ImageFormat::Enum srcFormat = ImageFormat::None) const;
@@ -106,6 +132,8 @@ public:
   bool IsArray() const { return (mArrayCount > 1); }
   bool IsCube()  const { return (mDepth == 0); }
   bool IsRenderTarget() const { return mIsRendertarget; }
+  // The format enums have no sRGB variants, loaders flag files which store sRGB encoded colors instead
+  bool IsSrgb() const { return mIsSrgb; }
 
   // Image Format Loading from mData
   bool iLoadDDSFromMemory(const char* memory, uint32_t memsize, const bool useMipMaps, memoryAllocationFunc pAllocator = NULL, void* pUserData = NULL);
@@ -122,6 +150,8 @@ public:
 
   //load image
   bool loadImage(const char *fileName, bool useMipmaps, memoryAllocationFunc pAllocator = NULL, void* pUserData = NULL, FSRoot root = FSR_Textures);
+  // Decode the contents of an image file which is already in memory, the format is picked from the extension of fileName
+  bool loadImageFromMemory(const char *fileName, const void* pData, uint32_t size, bool useMipmaps, memoryAllocationFunc pAllocator = NULL, void* pUserData = NULL);
 
   bool iSwap(const int c0, const int c1);
 
@@ -144,6 +174,7 @@ protected:
   int mAdditionalDataSize;
   unsigned char *pAdditionalData;
   bool mIsRendertarget;
+  bool mIsSrgb;
   bool mOwnsMemory;
 };
 
@@ -39,6 +39,7 @@
 #include <cstring>
 #include "../Interfaces/ILogManager.h"
 #include "../Interfaces/IFileSystem.h"
+#include "../Interfaces/IMemoryManager.h"
 
 #define KTX_IDENTIFIER_REF  { 0xAB, 0x4B, 0x54, 0x58, 0x20, 0x31, 0x31, 0xBB, 0x0D, 0x0A, 0x1A, 0x0A }
 #define KTX_ENDIAN_REF      (0x04030201)
@@ -124,8 +125,6 @@ static void SwapEndian32(uint32* pData32, int count)
 
 bool Image::iLoadKTXFromMemory(const char *memory, uint32_t bytes, const bool useMipmaps, memoryAllocationFunc pAllocator, void* pUserData)
 {
-  UNREF_PARAM(pUserData);
-  UNREF_PARAM(pAllocator);
 	uint8 identifier_reference[12] = KTX_IDENTIFIER_REF;
 	KTXHeader header;
 
@@ -244,7 +243,15 @@ bool Image::iLoadKTXFromMemory(const char *memory, uint32_t bytes, const bool us
 	}
 
 	int size = GetMipMappedSize(0, mMipMapCount);
-	pData = new unsigned char[size];
+	if (pAllocator)
+	{
+		pData = (unsigned char*)pAllocator(this, size, pUserData);
+		mOwnsMemory = false;
+	}
+	else
+	{
+		pData = (unsigned char*)conf_malloc(sizeof(unsigned char) * size);
+	}
 
 	uint32 mipLevelDataSize;
 
@@ -28,6 +28,7 @@
 
 #include "../Interfaces/IOperatingSystem.h"
 #include "../../ThirdParty/OpenSource/TinySTL/string.h"
+#include "../../ThirdParty/OpenSource/TinySTL/string_view.h"
 #include "../../ThirdParty/OpenSource/TinySTL/vector.h"
 
 typedef void* FileHandle;
@@ -50,6 +51,9 @@ size_t _readFile(void *buffer, size_t byteCount, FileHandle handle);
 bool _seekFile(FileHandle handle, long offset, int origin);
 long _tellFile(FileHandle handle);
 size_t _writeFile(const void *buffer, size_t byteCount, FileHandle handle);
+/// Maps the whole file read only, returns NULL on failure or for empty files
+void* _mapFile(const char* filename, size_t* pSize, void** ppMapHandle);
+void _unmapFile(void* pData, size_t size, void* pMapHandle);
 size_t _getFileLastModifiedTime(const char* _fileName);
 
 String _getCurrentDir();
@@ -215,7 +219,7 @@ class File : public Deserializer, public Serializer
 public:
 	File();
 
-	bool Open(const String& fileName, FileMode mode, FSRoot root);
+	bool Open(StringView fileName, FileMode mode, FSRoot root);
 	void Close();
 	void Flush();
 
@@ -244,6 +248,28 @@ protected:
 	bool mWriteSyncNeeded;
 };
 
+/// Read only memory mapping of a whole file, the data stays valid until Close
+class MappedFile
+{
+public:
+	MappedFile();
+	~MappedFile();
+
+	bool Open(StringView fileName, FSRoot root);
+	void Close();
+
+	const String& GetName() const { return mFileName; }
+	const void* GetData() const { return pData; }
+	size_t GetSize() const { return mSize; }
+	bool IsOpen() const { return pData != NULL; }
+
+private:
+	String mFileName;
+	void* pData;
+	size_t mSize;
+	void* pMapHandle;
+};
+
 /// Memory area simulating a stream
 class  MemoryBuffer : public Deserializer, public Serializer
 {
@@ -278,8 +304,8 @@ public:
 	static unsigned	GetLastModifiedTime(const String& _fileName);
 	// First looks it root exists in m_ModifiedRootPaths
 	// otherwise uses App static defined pszRoots[]
-	static String	FixPath(const String& pszFileName, FSRoot root);
-    static bool		FileExists(const String& pszFileName, FSRoot root);
+	static String	FixPath(StringView fileName, FSRoot root);
+	static bool		FileExists(StringView fileName, FSRoot root);
 
 	static String	GetCurrentDir() { return AddTrailingSlash(_getCurrentDir()); }
 	static String	GetProgramDir() { return GetPath(_getExePath()); }
@@ -288,17 +314,18 @@ public:
 
 	static void		SetCurrentDir(const String& path) { _setCurrentDir(path.c_str()); }
 
-	static void		SplitPath(const String& fullPath, String* pathName, String* fileName, String* extension, bool lowercaseExtension = true);
-	static String	GetPath(const String& fullPath);
-	static String	GetFileName(const String& fullPath);
-	static String	GetExtension(const String& fullPath, bool lowercaseExtension = true);
-	static String	GetFileNameAndExtension(const String& fullPath, bool lowercaseExtension = false);
-	static String	ReplaceExtension(const String& fullPath, const String& newExtension);
-	static String	AddTrailingSlash(const String& pathName);
-	static String	RemoveTrailingSlash(const String& pathName);
-	static String	GetParentPath(const String& pathName);
-	static String	GetInternalPath(const String& pathName);
-	static String	GetNativePath(const String& pathName);
+	// The path functions only copy the part of the path they return
+	static void		SplitPath(StringView fullPath, String* pathName, String* fileName, String* extension, bool lowercaseExtension = true);
+	static String	GetPath(StringView fullPath);
+	static String	GetFileName(StringView fullPath);
+	static String	GetExtension(StringView fullPath, bool lowercaseExtension = true);
+	static String	GetFileNameAndExtension(StringView fullPath, bool lowercaseExtension = false);
+	static String	ReplaceExtension(StringView fullPath, StringView newExtension);
+	static String	AddTrailingSlash(StringView pathName);
+	static String	RemoveTrailingSlash(StringView pathName);
+	static String	GetParentPath(StringView pathName);
+	static String	GetInternalPath(StringView pathName);
+	static String	GetNativePath(StringView pathName);
 
 	static bool		DirExists(const String& pathName);
 	static bool		CreateDir(const String& pathName);
@@ -310,3 +337,17 @@ private:
 	static String	mModifiedRootPaths[FSRoot::FSR_Count];
 	static String	mProgramDir;
 };
+
+/// Interned names: one shared copy of every resource, file and descriptor name, identified by a 32 bit id.
+/// The id is the hash of the name (tinystl::hash), so it can be computed without the table and names are compared by id.
+/// Names whose hashes collide still get their own copy, but share the id, which is reported as a warning.
+typedef uint32_t NameId;
+
+/// Adds the name to the name table if it is not there yet and returns its id.
+/// ppName receives the interned copy of this exact name, which stays valid until exitNameTable.
+NameId internName(StringView name, const char** ppName = NULL);
+/// Interned copy of the name with this id, NULL if it was never interned. On a collision this is the first name interned with the id.
+const char* getInternedName(NameId id);
+/// Id of a name without interning it
+inline NameId getNameId(StringView name) { return tinystl::hash(name); }
+void exitNameTable();
@@ -77,16 +77,16 @@ void _PrintUnicodeLine(const String& str, bool error = false);
 
 #ifdef USE_LOGGING
 
-#define LOGDEBUG( message ) LogManager::Write( LogLevel::LL_Debug, ToString( __FUNCTION__, message, "" ) )
-#define LOGINFO( message ) LogManager::Write( LogLevel::LL_Info, ToString( __FUNCTION__, message, "" ) )
-#define LOGWARNING( message ) LogManager::Write( LogLevel::LL_Warning, ToString( __FUNCTION__, message, "" ) )
-#define LOGERROR( message ) LogManager::Write( LogLevel::LL_Error, ToString( __FUNCTION__, message, "" ) )
-#define LOGRAW( message ) LogManager::WriteRaw( ToString( __FUNCTION__, message, "" ) )
-#define LOGDEBUGF( format, ... ) LogManager::Write( LogLevel::LL_Debug, ToString( __FUNCTION__, format, ##__VA_ARGS__ ) )
-#define LOGINFOF( format, ... ) LogManager::Write( LogLevel::LL_Info, ToString( __FUNCTION__, format, ##__VA_ARGS__ ) )
-#define LOGWARNINGF( format, ... ) LogManager::Write( LogLevel::LL_Warning, ToString( __FUNCTION__, format, ##__VA_ARGS__ ) )
-#define LOGERRORF( format, ... ) LogManager::Write( LogLevel::LL_Error, ToString( __FUNCTION__, format, ##__VA_ARGS__ ) )
-#define LOGRAWF( format, ... ) LogManager::WriteRaw( ToString( __FUNCTION__, format, ##__VA_ARGS__ ) )
+#define LOGDEBUG( message ) LogManager::WriteFormat( LogLevel::LL_Debug, __FUNCTION__, message, "" )
+#define LOGINFO( message ) LogManager::WriteFormat( LogLevel::LL_Info, __FUNCTION__, message, "" )
+#define LOGWARNING( message ) LogManager::WriteFormat( LogLevel::LL_Warning, __FUNCTION__, message, "" )
+#define LOGERROR( message ) LogManager::WriteFormat( LogLevel::LL_Error, __FUNCTION__, message, "" )
+#define LOGRAW( message ) LogManager::WriteRawFormat( __FUNCTION__, message, "" )
+#define LOGDEBUGF( format, ... ) LogManager::WriteFormat( LogLevel::LL_Debug, __FUNCTION__, format, ##__VA_ARGS__ )
+#define LOGINFOF( format, ... ) LogManager::WriteFormat( LogLevel::LL_Info, __FUNCTION__, format, ##__VA_ARGS__ )
+#define LOGWARNINGF( format, ... ) LogManager::WriteFormat( LogLevel::LL_Warning, __FUNCTION__, format, ##__VA_ARGS__ )
+#define LOGERRORF( format, ... ) LogManager::WriteFormat( LogLevel::LL_Error, __FUNCTION__, format, ##__VA_ARGS__ )
+#define LOGRAWF( format, ... ) LogManager::WriteRawFormat( __FUNCTION__, format, ##__VA_ARGS__ )
 
 
 #else
@@ -24,8 +24,10 @@
 
 #pragma once
 #include <new>
+#include <stdint.h>
 
-#ifndef USE_MEMORY_TRACKING
+// Tracking is on in debug builds, release builds define USE_MEMORY_TRACKING to keep it
+#if !defined( USE_MEMORY_TRACKING ) && !defined( NDEBUG )
 #define USE_MEMORY_TRACKING 1
 #endif
 
@@ -33,13 +35,29 @@
 #define USE_DLMALLOC 1
 #endif
 
-#if defined( USE_MEMORY_TRACKING )
+// Memory tracking counts the live bytes of every conf_malloc callsite, see confetti::takeMemorySnapshot.
+// Define USE_MMGR_TRACKING to track every single allocation with FluidStudios mmgr instead, which is a lot slower.
+#if defined( USE_MEMORY_TRACKING ) && defined( USE_MMGR_TRACKING )
 #include "ThirdParty/OpenSource/FluidStudios/MemoryManager/mmgr.h"
 
 #define conf_malloc( size )           m_allocator( __FILE__, __LINE__, __FUNCTION__, m_alloc_malloc, ( size ) )
 #define conf_calloc( count, size )    m_allocator( __FILE__, __LINE__, __FUNCTION__, m_alloc_calloc, ( ( size ) * ( count ) ) )
 #define conf_realloc( ptr, size )   m_reallocator( __FILE__, __LINE__, __FUNCTION__, m_alloc_realloc, ( size ), ( ptr ) )
 #define conf_free( ptr )            m_deallocator( __FILE__, __LINE__, __FUNCTION__, m_alloc_free, ( ptr ) )
+// mmgr has no aligned allocations, its blocks only have the default alignment
+#define conf_memalign( align, size )  m_allocator( __FILE__, __LINE__, __FUNCTION__, m_alloc_malloc, ( size ) )
+
+#elif defined( USE_MEMORY_TRACKING )
+
+// A static callsite per expansion, its address identifies the callsite without hashing file and line
+#define CONF_ALLOCATION_CALLSITE() \
+    ( []() -> confetti::AllocationCallsite* { static confetti::AllocationCallsite callsite = { __FILE__, __LINE__, 0 }; return &callsite; }() )
+
+#define conf_malloc( size )           confetti::trackedAllocate( CONF_ALLOCATION_CALLSITE(), ( size ) )
+#define conf_calloc( count, size )    confetti::trackedCallocate( CONF_ALLOCATION_CALLSITE(), ( count ), ( size ) )
+#define conf_realloc( ptr, size )     confetti::trackedReallocate( CONF_ALLOCATION_CALLSITE(), ( ptr ), ( size ) )
+#define conf_free( ptr )              confetti::trackedDeallocate( ( ptr ) )
+#define conf_memalign( align, size )  confetti::trackedAllocateAligned( CONF_ALLOCATION_CALLSITE(), ( align ), ( size ) )
 
 #else
 
@@ -47,6 +65,7 @@ void* conf_malloc( size_t size );
 void* conf_calloc( size_t count, size_t size );
 void* conf_realloc( void* p, size_t size );
 void conf_free( void* p );
+void* conf_memalign( size_t align, size_t size );
 
 #endif
 
@@ -60,6 +79,8 @@ namespace confetti {
     /**
      * The regular malloc call with aligment.
      * Do not align with less then kDefaultAlignment bytes.
+     * Sizes up to 1KB come from per thread size class pools without taking a lock,
+     * from 256KB on the memory is mapped directly.
      * @param size The byte size of the memory chunk.
      * @param alignment The byte alignment of the memory chunk.
      * @return The allocated memory chunk address.
@@ -67,7 +88,7 @@ namespace confetti {
     void* allocate( size_t size, size_t alignment = DEFAULT_ALIGNMENT );
 
     /**
-     * The regular calloc call with aligment.
+     * The regular calloc call with aligment, the memory is zeroed.
      * Do not align with less then kDefaultAlignment bytes.
      * @param num Element count.
      * @param size The byte size of the element.
@@ -116,34 +137,156 @@ namespace confetti {
      */
     void threadLocalDeallocate( void* p );
 
+    /**
+     * Frames the memory of a frame arena stays valid for, counting the frame it was allocated in.
+     * Lets data written in one frame still be read while the following frames are recorded.
+     */
+    static const uint32_t FRAME_ARENA_FRAME_COUNT = 3;
+
+    typedef struct FrameArenaStats {
+        /// Bytes allocated from the frame arenas in the last finished frame
+        uint64_t mLastFrameBytes;
+        /// Most bytes allocated in one frame so far
+        uint64_t mPeakFrameBytes;
+        /// Memory held by the frame arenas of all threads and frames
+        uint64_t mReservedBytes;
+    } FrameArenaStats;
+
+    /**
+     * Allocates transient memory which is released FRAME_ARENA_FRAME_COUNT frames later.
+     * Every thread bumps a pointer in an arena of its own, there is nothing to free.
+     * @param size The byte size of the memory chunk.
+     * @param alignment The byte alignment of the memory chunk.
+     * @return The allocated memory chunk address.
+     */
+    void* frameAllocate( size_t size, size_t alignment = DEFAULT_ALIGNMENT );
+
+    /**
+     * frameAllocate for num elements of the given size, the memory is zeroed.
+     */
+    void* frameCallocate( size_t num, size_t size, size_t alignment = DEFAULT_ALIGNMENT );
+
+    /**
+     * Starts the next frame of the frame arenas, the platform main loop calls it before every update.
+     */
+    void frameArenaNextFrame();
+
+    /**
+     * Frees the memory of all frame arenas, no frame memory may be in use anymore.
+     */
+    void exitFrameArenas();
+
+    void getFrameArenaStats( FrameArenaStats* pStats );
+
+    /**
+     * Allocator for tinystl containers of transient data,
+     * e.g. tinystl::vector< uint32_t, confetti::FrameArenaAllocator > or tinystl::basic_string< confetti::FrameArenaAllocator >.
+     * Memory given back on growth stays in the arena until its frame is reused.
+     */
+    struct FrameArenaAllocator {
+        static void* static_allocate( size_t bytes ) { return frameAllocate( bytes ); }
+        static void static_deallocate( void* /*ptr*/, size_t /*bytes*/ ) {}
+    };
+
+    typedef struct AllocationCallsite {
+        const char* pFile;
+        uint32_t mLine;
+        /// Index of the callsite's counters, assigned on its first allocation
+        volatile uint32_t mId;
+    } AllocationCallsite;
+
+    /**
+     * conf_malloc and friends of tracked builds, the allocation is counted for its callsite.
+     * Memory of tracked allocations must be freed with conf_free and nothing else.
+     */
+    void* trackedAllocate( AllocationCallsite* pCallsite, size_t size );
+    void* trackedCallocate( AllocationCallsite* pCallsite, size_t count, size_t size );
+    void* trackedReallocate( AllocationCallsite* pCallsite, void* p, size_t size );
+    void trackedDeallocate( void* p );
+    /**
+     * conf_memalign of tracked builds. Reallocating the memory keeps only the default alignment.
+     */
+    void* trackedAllocateAligned( AllocationCallsite* pCallsite, size_t alignment, size_t size );
+
+    /**
+     * Called by an exiting thread right before it gives back its thread slot.
+     * Later allocations and frees of the thread are counted in the shared table.
+     */
+    void releaseTrackingThreadSlot();
+
+    typedef struct MemoryCallsiteStats {
+        /// NULL for the allocations of callsites which did not fit in the tracking tables
+        const char* pFile;
+        uint32_t mLine;
+        int64_t mLiveBytes;
+        int64_t mLiveCount;
+    } MemoryCallsiteStats;
+
+    typedef struct MemorySnapshot {
+        int64_t mLiveBytes;
+        int64_t mLiveCount;
+        uint32_t mCallsiteCount;
+        MemoryCallsiteStats* pCallsites;
+    } MemorySnapshot;
+
+    /**
+     * Sums the counters of all threads, a callsite keeps its index in the snapshots taken after it was first seen.
+     * Allocations racing with the snapshot may be missed. Empty without tracking.
+     */
+    void takeMemorySnapshot( MemorySnapshot** ppSnapshot );
+
+    /**
+     * What changed from pBefore to pAfter, e.g. the memory a level load left behind.
+     */
+    void diffMemorySnapshots( const MemorySnapshot* pBefore, const MemorySnapshot* pAfter, MemorySnapshot** ppDiff );
+
+    void removeMemorySnapshot( MemorySnapshot* pSnapshot );
+
+    /**
+     * Writes the callsites of a snapshot sorted by live bytes to a text file.
+     */
+    void dumpMemorySnapshot( const MemorySnapshot* pSnapshot, const char* fileName );
+
+    /**
+     * Writes the live bytes by callsite and the stacks of the sampled live allocations to a text file.
+     * Tracked builds write memleaks.log on exit.
+     */
+    void dumpLiveMemory( const char* fileName );
+
+    /**
+     * Captures the stack of about one allocation per sampleInterval bytes, 0 turns sampling off which is the default.
+     * Sampled allocations show up in dumpLiveMemory, the callsite counters are exact either way.
+     */
+    void setMemoryTrackingSampleInterval( uint64_t sampleInterval );
+
     template < size_t uAlignment = DEFAULT_ALIGNMENT, bool bThreadLocal = false >
     struct TNew {
         inline static void* operator new( size_t size ) {
             if ( bThreadLocal )
-                return apemode::thread_local_malloc( size, uAlignment );
+                return threadLocalAllocate( size, uAlignment );
             else
-                return apemode::malloc( size, uAlignment );
+                return allocate( size, uAlignment );
         }
 
         inline static void* operator new[]( size_t size ) {
             if ( bThreadLocal )
-                return apemode::thread_local_malloc( size, uAlignment );
+                return threadLocalAllocate( size, uAlignment );
             else
-                return apemode::malloc( size, uAlignment );
+                return allocate( size, uAlignment );
         }
 
         inline static void operator delete( void* ptr ) {
             if ( bThreadLocal )
-                apemode::thread_local_free( ptr );
+                threadLocalDeallocate( ptr );
             else
-                apemode::free( ptr );
+                deallocate( ptr );
         }
 
         inline static void operator delete[]( void* ptr ) {
             if ( bThreadLocal )
-                apemode::thread_local_free( ptr );
+                threadLocalDeallocate( ptr );
             else
-                apemode::free( ptr );
+                deallocate( ptr );
         }
     };
 
@@ -160,11 +303,6 @@ inline T* conf_placement_new( void* ptr, Args... args ) {
     return new ( ptr ) T( args... );
 }
 
-template < typename T, typename... Args >
-inline T* conf_new_impl( const char* sourceFile, const unsigned int sourceLine, const char* sourceFunc, Args... args ) {
-    return new ( m_allocator( sourceFile, sourceLine, sourceFunc, m_alloc_calloc, ( sizeof( T ) ) ) ) T( args... );
-}
-
-#define conf_new( T, ... ) conf_new_impl< T >( __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__ )
+#define conf_new( T, ... ) conf_placement_new< T >( conf_calloc( 1, sizeof( T ) ), __VA_ARGS__ )
 
 #pragma pop_macro( "new" )
@@ -24,6 +24,7 @@
 
 #include "../Interfaces/IOperatingSystem.h"
 #include "../Math/FloatUtil.h"
+#include "../Core/Atomics.h"
 #include "../../ThirdParty/OpenSource/TinySTL/vector.h"
 
 #ifndef _THREAD_H_
@@ -39,6 +40,11 @@
 typedef unsigned ThreadID;
 #endif
 
+/// Wait forever in ConditionVariable::Wait (same value as INFINITE on Windows)
+#define TIMEOUT_INFINITE 0xFFFFFFFF
+/// Threads which can hold a thread slot at the same time
+#define MAX_THREAD_SLOTS 64
+
 /// Operating system mutual exclusion primitive.
 struct Mutex
 {
@@ -74,7 +80,10 @@ struct ConditionVariable
 	~ConditionVariable();
 
 	void Wait(const Mutex& mutex, unsigned md);
+	/// Wake one waiting thread
 	void Set();
+	/// Wake all waiting threads
+	void SetAll();
 
 #ifdef _WIN32
 	void* pHandle;
@@ -85,15 +94,33 @@ struct ConditionVariable
 
 typedef void(*JobFunction)(void*);
 
+/// Atomic wait counter. The submitter adds one per item that references the counter,
+/// the ThreadPool subtracts one once such item has completed.
+struct JobCounter
+{
+	tfrg_atomic32_t mValue;
+};
+
+/// Scheduling state of a work item. Managed by the ThreadPool.
+enum WorkItemState
+{
+	WORK_ITEM_STATE_IDLE = 0,
+	WORK_ITEM_STATE_QUEUED,
+	WORK_ITEM_STATE_RUNNING,
+	WORK_ITEM_STATE_CANCELLED,
+};
+
 /// Work queue item.
 struct WorkItem
 {
 	// Construct
 	WorkItem() :
+		pFunc(0),
+		pData(0),
 		mPriority(0),
 		mCompleted(false),
-		pData(0),
-		pFunc(0)
+		mState(WORK_ITEM_STATE_IDLE),
+		pCounter(0)
 	{
 	}
 
@@ -102,6 +129,10 @@ struct WorkItem
 	void*			pData;
 	unsigned		mPriority;
 	volatile bool	mCompleted;
+	/// WorkItemState, only touched by the ThreadPool
+	tfrg_atomic32_t	mState;
+	/// Optional counter decremented after the item completed or was cancelled
+	JobCounter*		pCounter;
 };
     
 #ifndef _WIN32
@@ -109,7 +140,19 @@ struct WorkItem
 struct Thread;
 #endif
 
+/// Priorities above this value share the highest completion bucket
+#define MAX_WORK_ITEM_PRIORITIES 16
+/// Capacity of each per-thread work stealing queue. Overflow goes to the shared queue.
+#define WORK_STEALING_QUEUE_SIZE 4096
+
+struct WorkStealingQueue;
+struct WorkerThreadData;
+
 /// Work queue subsystem for multithreading.
+/// Every worker owns a lock-free work stealing queue. The thread which created the pool owns one more queue.
+/// Items are pushed to the queue of the submitting thread and idle workers steal from the other queues.
+/// Threads which do not own a queue submit through a shared queue. Idle workers park on a condition variable.
+/// Priorities only group items for Complete() / IsCompleted(), they do not order execution.
 class  ThreadPool
 {
 public:
@@ -121,34 +164,104 @@ public:
 	/// Can only be called once during lifetime of program
 	void CreateThreads(unsigned numThreads);
 	void AddWorkItem(WorkItem* item);
+	/// Cancel an item which has not started yet. Returns true once the pool no longer references the item, so it can be freed.
+	/// Other queued items may run on the calling thread until the cancelled item got drained from its queue.
 	bool RemoveWorkItem(WorkItem*& item);
 	unsigned RemoveWorkItems(const tinystl::vector<WorkItem*>& items);
 	void Pause();
 	void Resume();
-	void Shutdown() { mShutDown = true; }
+	void Shutdown();
+	/// Execute queued items on the calling thread until every item with a priority >= priority has completed
 	void Complete(unsigned priority);
+	/// Execute queued items on the calling thread until the counter reaches zero
+	void WaitForCounter(JobCounter* pCounter);
 
 	unsigned GetNumThreads() const { return (uint32_t)mThreads.size(); }
 	bool IsCompleted(unsigned priority) const;
 	bool IsCompleting() const { return mCompleting; }
 
-	static void ProcessItems(void* pThreadSystem);
+	static void ProcessItems(void* pWorkerThreadData);
 
 private:
-	void Cleanup(unsigned priority);
+	int32_t GetCurrentQueueIndex() const;
+	WorkItem* AcquireWorkItem(int32_t queueIndex);
+	void ExecuteWorkItem(WorkItem* item);
+	void WakeThreads(bool all);
+	void WaitForWork(uint32_t wakeEpoch);
+	bool IsWaitDone(unsigned priority, const JobCounter* pCounter) const;
+	void Wait(unsigned priority, JobCounter* pCounter);
+	void WaitForCompletion(unsigned priority, JobCounter* pCounter, uint32_t wakeEpoch);
 
 	tinystl::vector<struct Thread*> mThreads;
-	tinystl::vector <WorkItem*>		mWorkItems;
-	tinystl::vector<WorkItem*>		mWorkQueue;
+	/// [0] is owned by the creating thread, [i + 1] by worker i
+	WorkStealingQueue*				pQueues;
+	WorkerThreadData*				pWorkerData;
+	uint32_t						mQueueCount;
+	ThreadID						mOwnerThreadID;
+	/// Shared queue for threads without a queue of their own and for overflow
+	tinystl::vector<WorkItem*>		mSharedQueue;
+	uint32_t						mSharedQueueHead;
+	tfrg_atomic32_t					mSharedQueueCount;
 	Mutex							mQueueMutex;
+	/// Parking of idle workers
 	ConditionVariable				mWaitConditionVar;
 	Mutex							mWaitMutex;
+	tfrg_atomic32_t					mWakeEpoch;
+	tfrg_atomic32_t					mSleepingThreads;
+	/// Parking of threads inside Complete()
+	ConditionVariable				mCompleteConditionVar;
+	Mutex							mCompleteMutex;
+	tfrg_atomic32_t					mCompleteWaiters;
+	/// Items which were added and not yet completed, per priority
+	tfrg_atomic32_t					mPendingItems[MAX_WORK_ITEM_PRIORITIES];
 	volatile bool					mShutDown;
-	volatile bool					mPausing;
-	bool							mPaused;
+	volatile bool					mPaused;
 	bool							mCompleting;
 };
 
+/************************************************************************/
+// Task graph on top of the ThreadPool
+/************************************************************************/
+/// Jobs which can be released by the completion of a single job
+#define MAX_JOB_CONTINUATIONS 16
+/// Upper bound of the batches parallelFor splits its range into
+#define MAX_PARALLEL_FOR_BATCHES 256
+
+/// Node of a task graph. Initialize with initJob.
+/// Dependencies have to be declared before the jobs they connect are submitted.
+/// The memory of a job has to stay alive until its counter was waited on.
+struct Job
+{
+	JobFunction		pFunc;
+	void*			pData;
+	/// Optional counter decremented once the job finished
+	JobCounter*		pCounter;
+
+	WorkItem		mItem;
+	ThreadPool*		pPool;
+	Job*			pContinuations[MAX_JOB_CONTINUATIONS];
+	uint32_t		mContinuationCount;
+	/// Unfinished dependencies plus one for the pending submit
+	tfrg_atomic32_t	mDependencyCount;
+};
+
+typedef void(*ParallelForFunction)(void* pData, uint32_t begin, uint32_t end);
+
+/// pCounter counts the job from here on, so every job initialized with a counter has to be submitted before the counter is waited on to return
+void initJob(Job* pJob, JobFunction pFunc, void* pData, JobCounter* pCounter = NULL);
+/// pJob starts after pDependency has finished
+void addJobDependency(Job* pJob, Job* pDependency);
+/// pContinuation starts after pJob has finished
+static inline void addJobContinuation(Job* pJob, Job* pContinuation) { addJobDependency(pContinuation, pJob); }
+/// Jobs are queued once all their dependencies have finished
+void submitJob(ThreadPool* pPool, Job* pJob);
+void submitJobs(ThreadPool* pPool, uint32_t jobCount, Job* pJobs);
+/// Executes queued items on the calling thread while waiting. Jobs may still be submitted by other threads during the wait.
+void waitForJobCounter(ThreadPool* pPool, JobCounter* pCounter);
+static inline bool isJobCounterDone(const JobCounter* pCounter) { return tfrg_atomic32_load_acquire(&pCounter->mValue) == 0; }
+/// Splits [0, count) into batches of at least minBatchSize, runs them on the pool and the calling thread and waits for them
+void parallelFor(ThreadPool* pPool, uint32_t count, uint32_t minBatchSize, ParallelForFunction pFunc, void* pData);
+
 #ifdef _WIN32
 typedef void* ThreadHandle;
 #else
@@ -161,7 +274,7 @@ void _joinThread(ThreadHandle handle);
 
 struct Thread
 {
-	Thread(ThreadPool* threadSystem);
+	Thread(JobFunction pFunc, void* pData);
 	~Thread();
 
 	ThreadHandle pHandle;
@@ -171,6 +284,10 @@ struct Thread
 
 	static void SetMainThread();
 	static ThreadID GetCurrentThreadID();
+	/// Index of the calling thread in [0, MAX_THREAD_SLOTS) to index per thread arrays without a lookup.
+	/// Assigned on first use and released when the thread exits, so threads which never use one don't take one.
+	/// Returns MAX_THREAD_SLOTS if every slot is taken, users have to handle such threads, e.g. with shared locked data.
+	static uint32_t GetCurrentThreadSlot();
 	static bool IsMainThread();
 	static void Sleep(unsigned mSec);
 	static unsigned int GetNumCPUCores(void);
@@ -176,6 +176,21 @@ typedef struct Gui
 	class UI*					pUI;
 } Gui;
 
+/// Counters of one UI frame, from cmdUIBeginRender to cmdUIEndRender
+typedef struct UIRenderStats
+{
+	/// Draws submitted by text runs and widgets
+	uint32_t mRequestedDrawCount;
+	/// Draw calls recorded after merging adjacent draws
+	uint32_t mDrawCount;
+	/// Draws which did not fit into the vertex stream
+	uint32_t mDroppedDrawCount;
+	/// Vertex data written to the vertex streams
+	uint64_t mVertexBytes;
+	/// Times the CPU waited for the GPU before it could reuse vertex stream memory
+	uint32_t mStreamWaitCount;
+} UIRenderStats;
+
 typedef struct UIManager
 {
 	UISettings			mSettings;
@@ -229,4 +244,9 @@ void cmdUIDrawTexturedQuad(struct Cmd* pCmd, UIManager* pUIManager, const vec2&
 void cmdUIDrawGUI(struct Cmd* pCmd, UIManager* pUIManager, Gui* pGui);
 /// Helper function to draw the gpu profiler time tree
 void cmdUIDrawGpuProfileData(Cmd* pCmd, struct UIManager* pUIManager, const vec2& startPos, struct GpuProfiler* pGpuProfiler, const GpuProfileDrawDesc* pDrawDesc = NULL);
-void cmdUIEndRender(struct Cmd* pCmd, UIManager* pUIManager);
+/// Records the UI draws batched since cmdUIBeginRender, has to be called before the render pass ends.
+/// pFence is the fence signaled by the submission of pCmd. The UI waits on it before reusing the vertex memory of this frame,
+/// without a fence the vertex streams have to be larger than the frames in flight.
+void cmdUIEndRender(struct Cmd* pCmd, UIManager* pUIManager, struct Fence* pFence = NULL);
+/// Counters of the last frame drawn between cmdUIBeginRender and cmdUIEndRender
+void getUIRenderStats(UIManager* pUIManager, UIRenderStats* pStats);
@@ -93,7 +93,7 @@ LogManager::~LogManager( ) {
     pLogInstance = nullptr;
 }
 
-void LogManager::Open( const String& fileName ) {
+void LogManager::Open( StringView fileName ) {
 
     if ( 0 == fileName.size( ) )
         return;
@@ -114,14 +114,58 @@ LogLevel LogManager::GetLevel( ) const {
     return mLogLevel;
 }
 
-void LogManager::Write( int level, const String& message ) {
+static const unsigned LOG_BUFFER_SIZE = 4096;
+
+// The view is not necessarily null terminated, longer messages are truncated
+static void CopyLogMessage( char* buf, StringView message ) {
+    size_t size = message.size( ) < LOG_BUFFER_SIZE - 1 ? message.size( ) : LOG_BUFFER_SIZE - 1;
+    memcpy( buf, message.data( ), size );
+    buf[ size ] = '\0';
+}
+
+static void FormatLogMessage( char* buf, const char* function, const char* format, va_list arglist ) {
+    int prefixSize = snprintf( buf, LOG_BUFFER_SIZE, "[%s] ", function );
+    if ( prefixSize < 0 || prefixSize >= (int)LOG_BUFFER_SIZE )
+        prefixSize = 0;
+    vsprintf_s( buf + prefixSize, LOG_BUFFER_SIZE - prefixSize, format, arglist );
+}
+
+void LogManager::Write( int level, StringView message ) {
     ASSERT( pLogInstance && pLogInstance->mSpdLogger );
-    pLogInstance->mSpdLogger->log( ToSpdLogLevel( level ), message.c_str( ) );
+    char buf[ LOG_BUFFER_SIZE ];
+    CopyLogMessage( buf, message );
+    pLogInstance->mSpdLogger->log( ToSpdLogLevel( level ), buf );
 }
 
-void LogManager::WriteRaw( const String& message, bool error ) {
+void LogManager::WriteRaw( StringView message, bool error ) {
     ASSERT( pLogInstance && pLogInstance->mSpdLogger );
-    pLogInstance->mSpdLogger->log( ToSpdLogLevel( pLogInstance->mLogLevel ), message.c_str( ) );
+    char buf[ LOG_BUFFER_SIZE ];
+    CopyLogMessage( buf, message );
+    pLogInstance->mSpdLogger->log( ToSpdLogLevel( pLogInstance->mLogLevel ), buf );
+}
+
+void LogManager::WriteFormat( int level, const char* function, const char* format, ... ) {
+    ASSERT( pLogInstance && pLogInstance->mSpdLogger );
+    char buf[ LOG_BUFFER_SIZE ];
+
+    va_list arglist;
+    va_start( arglist, format );
+    FormatLogMessage( buf, function, format, arglist );
+    va_end( arglist );
+
+    pLogInstance->mSpdLogger->log( ToSpdLogLevel( level ), buf );
+}
+
+void LogManager::WriteRawFormat( const char* function, const char* format, ... ) {
+    ASSERT( pLogInstance && pLogInstance->mSpdLogger );
+    char buf[ LOG_BUFFER_SIZE ];
+
+    va_list arglist;
+    va_start( arglist, format );
+    FormatLogMessage( buf, function, format, arglist );
+    va_end( arglist );
+
+    pLogInstance->mSpdLogger->log( ToSpdLogLevel( pLogInstance->mLogLevel ), buf );
 }
 
 String ToString( const char* function, const char* str, ... ) {
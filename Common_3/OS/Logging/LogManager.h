@@ -25,6 +25,7 @@
 #pragma once
 #include "../../ThirdParty/OpenSource/TinySTL/vector.h"
 #include "../../ThirdParty/OpenSource/TinySTL/string.h"
+#include "../../ThirdParty/OpenSource/TinySTL/string_view.h"
 #include "../../OS/Interfaces/IThread.h"
 
 #include "../../ThirdParty/OpenSource/spdlog/include/spdlog/spdlog.h"
@@ -47,14 +48,18 @@ public:
     LogManager( LogLevel level );
     ~LogManager( );
 
-    void Open( const String& fileName );
+    void Open( StringView fileName );
     void Close( );
 
     void     SetLevel( LogLevel level );
     LogLevel GetLevel( ) const;
 
-    static void Write( int level, const String& message );
-    static void WriteRaw( const String& message, bool error = false );
+    static void Write( int level, StringView message );
+    static void WriteRaw( StringView message, bool error = false );
+
+    // Format "[function] message" into a stack buffer, used by the LOG macros so logging does not allocate
+    static void WriteFormat( int level, const char* function, const char* format, ... );
+    static void WriteRawFormat( const char* function, const char* format, ... );
 
     inline static spdlog::level::level_enum ToSpdLogLevel( const int logLevel ) {
         return static_cast< spdlog::level::level_enum >( logLevel );
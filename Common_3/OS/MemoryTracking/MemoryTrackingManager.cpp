@@ -28,6 +28,9 @@
 #include "../Interfaces/IOperatingSystem.h"
 #include "../Interfaces/IMemoryManager.h"
 
+#include <new>
+#include <string.h>
+
 void *operator new( size_t size ) {
     return conf_calloc( 1, size );
 }
@@ -40,33 +43,77 @@ void *operator new[](size_t size, const char * /*name*/, int /*flags*/, unsigned
     return conf_calloc( 1, size );
 }
 
+// Aligned operator new keeps the zeroed memory of the unaligned ones
+static inline void* alignedNew( size_t size, size_t alignment ) {
+    void* p = conf_memalign( alignment, size );
+    if ( p )
+        memset( p, 0, size );
+    return p;
+}
+
+// The alignment offset of EASTL is not supported, it is always 0 in the containers used here
 void *operator new[]( size_t size,
-                      size_t /*alignment*/,
+                      size_t alignment,
                       size_t /*alignmentOffset*/,
                       const char * /*name*/,
                       int /*flags*/,
                       unsigned /*debugFlags*/,
                       const char * /*file*/,
                       int /*line*/ ) {
-    return conf_calloc( 1, size );
+    return alignedNew( size, alignment );
 }
 
-void *operator new( size_t size, size_t /*alignment*/ ) {
-    return conf_calloc( 1, size );
+void *operator new( size_t size, size_t alignment ) {
+    return alignedNew( size, alignment );
 }
 
-void *operator new( size_t size, size_t /*alignment*/, const std::nothrow_t & ) throw( ) {
-    return conf_calloc( 1, size );
+void *operator new( size_t size, size_t alignment, const std::nothrow_t & ) throw( ) {
+    return alignedNew( size, alignment );
 }
 
-void *operator new[]( size_t size, size_t /*alignment*/ ) {
-    return conf_calloc( 1, size );
+void *operator new[]( size_t size, size_t alignment ) {
+    return alignedNew( size, alignment );
 }
 
-void *operator new[]( size_t size, size_t /*alignment*/, const std::nothrow_t & ) throw( ) {
-    return conf_calloc( 1, size );
+void *operator new[]( size_t size, size_t alignment, const std::nothrow_t & ) throw( ) {
+    return alignedNew( size, alignment );
 }
 
+#if defined( __cpp_aligned_new )
+// C++17 new and delete of over-aligned types
+void *operator new( size_t size, std::align_val_t alignment ) {
+    return alignedNew( size, (size_t)alignment );
+}
+
+void *operator new( size_t size, std::align_val_t alignment, const std::nothrow_t & ) throw( ) {
+    return alignedNew( size, (size_t)alignment );
+}
+
+void *operator new[]( size_t size, std::align_val_t alignment ) {
+    return alignedNew( size, (size_t)alignment );
+}
+
+void *operator new[]( size_t size, std::align_val_t alignment, const std::nothrow_t & ) throw( ) {
+    return alignedNew( size, (size_t)alignment );
+}
+
+void operator delete( void *p, std::align_val_t ) throw( ) {
+    conf_free( p );
+}
+
+void operator delete[]( void *p, std::align_val_t ) throw( ) {
+    conf_free( p );
+}
+
+void operator delete( void *p, std::size_t, std::align_val_t ) throw( ) {
+    conf_free( p );
+}
+
+void operator delete[]( void *p, std::size_t, std::align_val_t ) throw( ) {
+    conf_free( p );
+}
+#endif
+
 // C++14 deleter
 void operator delete( void *p, std::size_t /*sz*/ ) throw( ) {
     conf_free( p );
@@ -88,27 +135,71 @@ void operator delete[]( void *p ) throw( ) {
 #undef conf_calloc
 #undef conf_realloc
 #undef conf_free
+#undef conf_memalign
 
+#if defined( USE_MEMORY_TRACKING ) && !defined( USE_MMGR_TRACKING )
+#define USE_CALLSITE_TRACKING 1
+#endif
+
+// Calls which did not see the macros, e.g. of the tinystl allocator, are counted for the callsites in here
 void *conf_malloc( size_t size ) {
+#if defined( USE_CALLSITE_TRACKING )
+    return confetti::trackedAllocate( CONF_ALLOCATION_CALLSITE(), size );
+#else
     return confetti::allocate( size );
+#endif
 }
 
 void *conf_calloc( size_t count, size_t size ) {
-    return confetti::allocate( size * count );
+#if defined( USE_CALLSITE_TRACKING )
+    return confetti::trackedCallocate( CONF_ALLOCATION_CALLSITE(), count, size );
+#else
+    return confetti::callocate( count, size );
+#endif
 }
 
 void *conf_realloc( void *p, size_t size ) {
+#if defined( USE_CALLSITE_TRACKING )
+    return confetti::trackedReallocate( CONF_ALLOCATION_CALLSITE(), p, size );
+#else
     return confetti::reallocate( p, size );
+#endif
 }
 
 void conf_free( void *p ) {
+#if defined( USE_CALLSITE_TRACKING )
+    confetti::trackedDeallocate( p );
+#else
     confetti::deallocate( p );
+#endif
+}
+
+void *conf_memalign( size_t align, size_t size ) {
+#if defined( USE_CALLSITE_TRACKING )
+    return confetti::trackedAllocateAligned( CONF_ALLOCATION_CALLSITE(), align, size );
+#else
+    return confetti::allocate( size, align );
+#endif
 }
 
-#include <new>
 #include <time.h>
+#include <math.h>
+#include <stdio.h>
 #include <cstdlib>
 
+#include "../Core/Atomics.h"
+#include "../Interfaces/IThread.h"
+
+#if !defined( _WIN32 )
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#if defined( __APPLE__ ) || ( defined( __linux__ ) && !defined( __ANDROID__ ) )
+#include <execinfo.h>
+#define HAS_BACKTRACE 1
+#endif
+
 #ifdef USE_DLMALLOC
 
 #define MSPACES 1
@@ -121,82 +212,1164 @@ static thread_local mspace tlms = create_mspace( 0, 0 );
 #endif
 
 namespace confetti {
-    void *allocate( size_t size, size_t alignment ) {
-#if defined( USE_DLMALLOC )
 
-        (void) alignment;
-        return dlmalloc( size );
+    /************************************************************************/
+    // Small allocations come from size class pools. The pools are carved
+    // out of one reserved address range, so a pointer belongs to a pool
+    // if it lies inside the range and its slab tells the size class.
+    // Every thread keeps a free list per size class and trades batches of
+    // blocks with lock-free global stacks, so the common case takes no lock.
+    // Everything else carries a header in front of the returned pointer:
+    // medium sizes go to dlmalloc, large ones are mapped directly.
+    /************************************************************************/
+    static const size_t POOL_MAX_SIZE = 1024;
+    static const size_t POOL_GRANULARITY = 16;
+    static const size_t POOL_SLAB_SIZE = 64 * 1024;
+    static const size_t POOL_RANGE_SIZE = sizeof( void* ) == 8 ? ( (size_t)1 << 30 ) : ( (size_t)64 << 20 );
+    static const uint32_t POOL_SLAB_COUNT = (uint32_t)( POOL_RANGE_SIZE / POOL_SLAB_SIZE );
+    // A thread returns a batch of this many bytes to the global stack once it holds twice as many
+    static const size_t POOL_BATCH_SIZE = 16 * 1024;
+    static const size_t LARGE_ALLOCATION_SIZE = 256 * 1024;
 
-#elif defined( __ANDROID__ )
-        void *p = nullptr;
-        ::posix_memalign( &p, alignment, size );
-        return p;
+    static const uint32_t gPoolClassSizes[] = {
+        16, 32, 48, 64, 80, 96, 112, 128,
+        160, 192, 224, 256, 320, 384, 448, 512,
+        640, 768, 896, 1024,
+    };
+    static const uint32_t POOL_CLASS_COUNT = sizeof( gPoolClassSizes ) / sizeof( gPoolClassSizes[0] );
+
+    // Reserved range of the pools, 0 until the first pool allocation and POOL_UNAVAILABLE if it could not be reserved
+    static const uintptr_t POOL_UNAVAILABLE = ~(uintptr_t)0;
+    static tfrg_atomicptr_t gPoolBase = 0;
+    static tfrg_atomic32_t gPoolSlabsUsed = 0;
+    static uint8_t gPoolSlabClass[POOL_SLAB_COUNT];
+    // Per size class stack of batches: upper 32 bits are an ABA tag, lower 32 bits the 1 based index of the first block
+    static tfrg_atomic64_t gPoolBatches[POOL_CLASS_COUNT];
+
+    struct PoolThreadCache {
+        void* pFree[POOL_CLASS_COUNT];
+        uint32_t mCount[POOL_CLASS_COUNT];
+        bool mReleased;
+    };
+
+    // Trivial so it needs no guard on access, its blocks are handed back by PoolThreadCacheReleaser
+    static thread_local PoolThreadCache gPoolThreadCache;
+
+    static void releasePoolThreadCache();
+
+    struct PoolThreadCacheReleaser {
+        bool mRegistered;
+        ~PoolThreadCacheReleaser() { releasePoolThreadCache(); }
+    };
+
+    static thread_local PoolThreadCacheReleaser gPoolThreadCacheReleaser;
+
+    /// Header in front of every allocation which does not come from a pool
+    struct AllocationHeader {
+        void* pBase;
+        /// Requested size shifted left by one, the lowest bit is set if the memory was mapped directly
+        size_t mSizeAndMapped;
+    };
+    static_assert( sizeof( AllocationHeader ) == DEFAULT_ALIGNMENT, "Header has to keep the default alignment" );
+
+    static inline uint32_t getPoolBatchCount( uint32_t sizeClass ) {
+        uint32_t count = (uint32_t)( POOL_BATCH_SIZE / gPoolClassSizes[sizeClass] );
+        return count < 8 ? 8 : ( count > 256 ? 256 : count );
+    }
+
+    // Returns POOL_CLASS_COUNT if no size class fits
+    static inline uint32_t getPoolSizeClass( size_t size, size_t alignment ) {
+        if ( size > POOL_MAX_SIZE || alignment > POOL_MAX_SIZE )
+            return POOL_CLASS_COUNT;
+
+        size = ( size + alignment - 1 ) & ~( alignment - 1 );
+        if ( !size )
+            size = alignment;
+
+        uint32_t sizeClass;
+        if ( size <= 128 ) {
+            sizeClass = (uint32_t)( ( size - 1 ) / POOL_GRANULARITY );
+        } else {
+            // Four classes per power of two above 128 bytes
+            const size_t last = size - 1;
+            uint32_t msb = 7;
+            while ( last >> ( msb + 1 ) )
+                ++msb;
+            sizeClass = 8 + ( msb - 7 ) * 4 + (uint32_t)( ( last >> ( msb - 2 ) ) & 3 );
+        }
+
+        // Blocks are aligned to the largest power of two dividing their size
+        while ( sizeClass < POOL_CLASS_COUNT && ( gPoolClassSizes[sizeClass] & ( alignment - 1 ) ) )
+            ++sizeClass;
+        return sizeClass;
+    }
+
+    static inline uintptr_t getPoolBase() {
+        uintptr_t base = tfrg_atomicptr_load_relaxed( &gPoolBase );
+        return base == POOL_UNAVAILABLE ? 0 : base;
+    }
+
+    // Returns the size class of a pool block or POOL_CLASS_COUNT if p does not belong to a pool
+    static inline uint32_t getPoolBlockClass( const void* p ) {
+        const uintptr_t base = getPoolBase();
+        const uintptr_t offset = (uintptr_t)p - base;
+        if ( !base || offset >= POOL_RANGE_SIZE )
+            return POOL_CLASS_COUNT;
+        return gPoolSlabClass[offset / POOL_SLAB_SIZE];
+    }
+
+    static size_t getPageSize() {
+#if defined( _WIN32 )
+        SYSTEM_INFO info;
+        GetSystemInfo( &info );
+        return (size_t)info.dwPageSize;
 #else
-        (void) alignment;
-        return ::malloc( size );
-        //return ::_aligned_malloc( size, alignment );
+        return (size_t)sysconf( _SC_PAGESIZE );
 #endif
     }
 
-    void *callocate( size_t num, size_t size, size_t alignment ) {
-#if defined( USE_DLMALLOC )
+    static uintptr_t reservePoolRange() {
+        uintptr_t base = tfrg_atomicptr_load_acquire( &gPoolBase );
+        if ( base )
+            return base == POOL_UNAVAILABLE ? 0 : base;
 
-        (void) alignment;
-        return dlcalloc( num, size );
+#if defined( _WIN32 )
+        void* pRange = VirtualAlloc( NULL, POOL_RANGE_SIZE, MEM_RESERVE, PAGE_NOACCESS );
+#else
+        void* pRange = mmap( NULL, POOL_RANGE_SIZE, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0 );
+        if ( pRange == MAP_FAILED )
+            pRange = NULL;
+#endif
+        const uintptr_t newBase = pRange ? (uintptr_t)pRange : POOL_UNAVAILABLE;
 
-#elif defined( __ANDROID__ )
-        static_assert(true, "Not implemented.");
+        base = tfrg_atomicptr_cas( &gPoolBase, 0, newBase );
+        if ( base ) {
+            // Another thread reserved the range first
+            if ( pRange ) {
+#if defined( _WIN32 )
+                VirtualFree( pRange, 0, MEM_RELEASE );
 #else
-        (void) alignment;
-        return ::calloc( num, size );
-        //return ::_aligned_calloc( num, size, alignment );
+                munmap( pRange, POOL_RANGE_SIZE );
 #endif
+            }
+            return base == POOL_UNAVAILABLE ? 0 : base;
+        }
+        return newBase == POOL_UNAVAILABLE ? 0 : newBase;
     }
 
-    void *reallocate( void *p, size_t size, size_t alignment ) {
-#if defined( USE_DLMALLOC )
+    static void* allocatePoolSlab( uint32_t sizeClass ) {
+        const uintptr_t base = reservePoolRange();
+        if ( !base )
+            return NULL;
 
-        (void) alignment;
-        return dlrealloc( p, size );
+        // Checked before the increment so the counter cannot wrap around once the range is used up
+        if ( tfrg_atomic32_load_relaxed( &gPoolSlabsUsed ) >= POOL_SLAB_COUNT )
+            return NULL;
+        const uint32_t slab = tfrg_atomic32_add( &gPoolSlabsUsed, 1 );
+        if ( slab >= POOL_SLAB_COUNT )
+            return NULL;
 
-#elif defined( __ANDROID__ )
-        static_assert( true, "Not implemented." );
+        void* pSlab = (void*)( base + (uintptr_t)slab * POOL_SLAB_SIZE );
+#if defined( _WIN32 )
+        if ( !VirtualAlloc( pSlab, POOL_SLAB_SIZE, MEM_COMMIT, PAGE_READWRITE ) )
+            return NULL;
 #else
-        (void) alignment;
-        return ::realloc( p, size );
-        //return ::_aligned_realloc( p, size, alignment );
+        if ( mprotect( pSlab, POOL_SLAB_SIZE, PROT_READ | PROT_WRITE ) != 0 )
+            return NULL;
 #endif
+        gPoolSlabClass[slab] = (uint8_t)sizeClass;
+        return pSlab;
     }
 
-    void deallocate( void *p ) {
+    // A batch is a list linked through the first word of its blocks, the second word of the first block links the next batch
+    static void pushPoolBatch( uint32_t sizeClass, void* pBatch ) {
+        const uint64_t index = ( (uintptr_t)pBatch - getPoolBase() ) / POOL_GRANULARITY + 1;
+        tfrg_atomic64_t* pHead = &gPoolBatches[sizeClass];
+        uint64_t head = tfrg_atomic64_load_relaxed( pHead );
+        for ( ;; ) {
+            const uint64_t next = head & 0xFFFFFFFFULL;
+            tfrg_atomicptr_store_relaxed( (tfrg_atomicptr_t*)pBatch + 1, next ? getPoolBase() + (uintptr_t)( next - 1 ) * POOL_GRANULARITY : 0 );
+            const uint64_t newHead = ( ( ( head >> 32 ) + 1 ) << 32 ) | index;
+            const uint64_t prev = tfrg_atomic64_cas( pHead, head, newHead );
+            if ( prev == head )
+                break;
+            head = prev;
+        }
+    }
+
+    static void* popPoolBatch( uint32_t sizeClass ) {
+        const uintptr_t base = getPoolBase();
+        tfrg_atomic64_t* pHead = &gPoolBatches[sizeClass];
+        uint64_t head = tfrg_atomic64_load_acquire( pHead );
+        for ( ;; ) {
+            const uint64_t index = head & 0xFFFFFFFFULL;
+            if ( !index )
+                return NULL;
+            // The block may be taken by another thread meanwhile, the pool memory stays mapped and the tag makes the exchange fail then
+            void* pBatch = (void*)( base + (uintptr_t)( index - 1 ) * POOL_GRANULARITY );
+            const uintptr_t next = tfrg_atomicptr_load_relaxed( (tfrg_atomicptr_t*)pBatch + 1 );
+            const uint64_t nextIndex = next ? ( next - base ) / POOL_GRANULARITY + 1 : 0;
+            const uint64_t newHead = ( ( ( head >> 32 ) + 1 ) << 32 ) | nextIndex;
+            const uint64_t prev = tfrg_atomic64_cas( pHead, head, newHead );
+            if ( prev == head )
+                return pBatch;
+            head = prev;
+        }
+    }
+
+    static bool refillPoolThreadCache( PoolThreadCache* pCache, uint32_t sizeClass ) {
+        // Registers the destructor which hands the blocks back when the thread exits
+        gPoolThreadCacheReleaser.mRegistered = true;
+
+        void* pBatch = popPoolBatch( sizeClass );
+        if ( pBatch ) {
+            uint32_t count = 0;
+            for ( void* p = pBatch; p; p = *(void**)p )
+                ++count;
+            pCache->pFree[sizeClass] = pBatch;
+            pCache->mCount[sizeClass] = count;
+            return true;
+        }
+
+        uint8_t* pSlab = (uint8_t*)allocatePoolSlab( sizeClass );
+        if ( !pSlab )
+            return false;
+
+        const uint32_t blockSize = gPoolClassSizes[sizeClass];
+        const uint32_t count = (uint32_t)( POOL_SLAB_SIZE / blockSize );
+        for ( uint32_t i = 0; i + 1 < count; ++i )
+            *(void**)( pSlab + i * blockSize ) = pSlab + ( i + 1 ) * blockSize;
+        *(void**)( pSlab + ( count - 1 ) * blockSize ) = NULL;
+
+        pCache->pFree[sizeClass] = pSlab;
+        pCache->mCount[sizeClass] = count;
+        return true;
+    }
+
+    static void releasePoolThreadCache() {
+        PoolThreadCache* pCache = &gPoolThreadCache;
+        for ( uint32_t i = 0; i < POOL_CLASS_COUNT; ++i ) {
+            if ( pCache->pFree[i] )
+                pushPoolBatch( i, pCache->pFree[i] );
+            pCache->pFree[i] = NULL;
+            pCache->mCount[i] = 0;
+        }
+        // Blocks freed by destructors running after this one go straight to the global stacks
+        pCache->mReleased = true;
+    }
+
+    static inline void* poolAllocate( uint32_t sizeClass ) {
+        PoolThreadCache* pCache = &gPoolThreadCache;
+        if ( pCache->mReleased )
+            return NULL;
+
+        void* p = pCache->pFree[sizeClass];
+        if ( !p ) {
+            if ( !refillPoolThreadCache( pCache, sizeClass ) )
+                return NULL;
+            p = pCache->pFree[sizeClass];
+        }
+
+        pCache->pFree[sizeClass] = *(void**)p;
+        --pCache->mCount[sizeClass];
+        return p;
+    }
+
+    static inline void poolDeallocate( void* p, uint32_t sizeClass ) {
+        PoolThreadCache* pCache = &gPoolThreadCache;
+        if ( pCache->mReleased ) {
+            *(void**)p = NULL;
+            pushPoolBatch( sizeClass, p );
+            return;
+        }
+
+        *(void**)p = pCache->pFree[sizeClass];
+        pCache->pFree[sizeClass] = p;
+
+        const uint32_t batchCount = getPoolBatchCount( sizeClass );
+        if ( ++pCache->mCount[sizeClass] < 2 * batchCount )
+            return;
+
+        // Keep the recently freed blocks, they are the ones most likely still in the cache
+        void* pLastKept = p;
+        for ( uint32_t i = 1; i < batchCount; ++i )
+            pLastKept = *(void**)pLastKept;
+        void* pBatch = *(void**)pLastKept;
+        *(void**)pLastKept = NULL;
+        pCache->mCount[sizeClass] = batchCount;
+        pushPoolBatch( sizeClass, pBatch );
+    }
+
+    static inline AllocationHeader* getAllocationHeader( void* p ) {
+        return (AllocationHeader*)p - 1;
+    }
+
+    static inline void* setAllocationHeader( void* pBase, size_t size, size_t alignment, bool mapped ) {
+        uintptr_t p = ( (uintptr_t)pBase + sizeof( AllocationHeader ) + alignment - 1 ) & ~( (uintptr_t)alignment - 1 );
+        AllocationHeader* pHeader = getAllocationHeader( (void*)p );
+        pHeader->pBase = pBase;
+        pHeader->mSizeAndMapped = ( size << 1 ) | ( mapped ? 1 : 0 );
+        return (void*)p;
+    }
+
+    static void* mapAllocate( size_t size, size_t alignment ) {
+        static const size_t pageSize = getPageSize();
+        const size_t length = ( size + alignment + pageSize - 1 ) & ~( pageSize - 1 );
+#if defined( _WIN32 )
+        void* pBase = VirtualAlloc( NULL, length, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE );
+        if ( !pBase )
+            return NULL;
+        return setAllocationHeader( pBase, size, alignment, true );
+#else
+        void* pBase = mmap( NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 );
+        if ( pBase == MAP_FAILED )
+            return NULL;
+        void* p = setAllocationHeader( pBase, size, alignment, true );
+        // Alignments above the page size leave whole pages behind the allocation
+        const size_t usedLength = ( (uintptr_t)p - (uintptr_t)pBase + size + pageSize - 1 ) & ~( pageSize - 1 );
+        if ( usedLength < length )
+            munmap( (uint8_t*)pBase + usedLength, length - usedLength );
+        return p;
+#endif
+    }
+
+    static void mapDeallocate( void* p, AllocationHeader* pHeader ) {
+#if defined( _WIN32 )
+        (void) p;
+        VirtualFree( pHeader->pBase, 0, MEM_RELEASE );
+#else
+        static const size_t pageSize = getPageSize();
+        const size_t size = pHeader->mSizeAndMapped >> 1;
+        void* pBase = pHeader->pBase;
+        munmap( pBase, ( (uintptr_t)p - (uintptr_t)pBase + size + pageSize - 1 ) & ~( pageSize - 1 ) );
+#endif
+    }
+
+    static inline void* heapAllocate( size_t size ) {
 #if defined( USE_DLMALLOC )
+        return dlmalloc( size );
+#else
+        return ::malloc( size );
+#endif
+    }
 
-        return dlfree( p );
+    static inline void* heapReallocate( void* p, size_t size ) {
+#if defined( USE_DLMALLOC )
+        return dlrealloc( p, size );
+#else
+        return ::realloc( p, size );
+#endif
+    }
 
-#elif defined( __ANDROID__ )
-        ::free( p );
+    static inline void heapDeallocate( void* p ) {
+#if defined( USE_DLMALLOC )
+        dlfree( p );
 #else
         ::free( p );
-        //::_aligned_free( p );
 #endif
     }
 
+    // Inlined into the tracked allocations, which saves them a call and folds the alignment checks
+    static inline void* allocateAligned( size_t size, size_t alignment ) {
+        const uint32_t sizeClass = getPoolSizeClass( size, alignment );
+        if ( sizeClass < POOL_CLASS_COUNT ) {
+            void* p = poolAllocate( sizeClass );
+            if ( p )
+                return p;
+        }
+
+        if ( size >= LARGE_ALLOCATION_SIZE ) {
+            void* p = mapAllocate( size, alignment );
+            if ( p )
+                return p;
+        }
+
+        void* pBase = heapAllocate( size + alignment );
+        if ( !pBase )
+            return NULL;
+        return setAllocationHeader( pBase, size, alignment, false );
+    }
+
+    void *allocate( size_t size, size_t alignment ) {
+        if ( alignment < DEFAULT_ALIGNMENT )
+            alignment = DEFAULT_ALIGNMENT;
+        return allocateAligned( size, alignment );
+    }
+
+    void *callocate( size_t num, size_t size, size_t alignment ) {
+        if ( size && num > ~(size_t)0 / size )
+            return NULL;
+
+        void* p = allocate( num * size, alignment );
+        // Directly mapped pages are zero already
+        if ( p && ( getPoolBlockClass( p ) < POOL_CLASS_COUNT || !( getAllocationHeader( p )->mSizeAndMapped & 1 ) ) )
+            memset( p, 0, num * size );
+        return p;
+    }
+
+    void *reallocate( void *p, size_t size, size_t alignment ) {
+        if ( !p )
+            return allocate( size, alignment );
+        if ( !size ) {
+            deallocate( p );
+            return NULL;
+        }
+        if ( alignment < DEFAULT_ALIGNMENT )
+            alignment = DEFAULT_ALIGNMENT;
+
+        size_t oldSize;
+        const uint32_t sizeClass = getPoolBlockClass( p );
+        if ( sizeClass < POOL_CLASS_COUNT ) {
+            oldSize = gPoolClassSizes[sizeClass];
+            if ( size <= oldSize && !( (uintptr_t)p & ( alignment - 1 ) ) )
+                return p;
+        } else {
+            AllocationHeader* pHeader = getAllocationHeader( p );
+            oldSize = pHeader->mSizeAndMapped >> 1;
+            const bool mapped = ( pHeader->mSizeAndMapped & 1 ) != 0;
+            // Default aligned heap blocks grow in place when dlmalloc can
+            if ( !mapped && size < LARGE_ALLOCATION_SIZE && alignment == DEFAULT_ALIGNMENT &&
+                 (uintptr_t)p - (uintptr_t)pHeader->pBase == sizeof( AllocationHeader ) ) {
+                void* pBase = heapReallocate( pHeader->pBase, size + alignment );
+                if ( !pBase )
+                    return NULL;
+                return setAllocationHeader( pBase, size, alignment, false );
+            }
+        }
+
+        void* pNew = allocate( size, alignment );
+        if ( !pNew )
+            return NULL;
+        memcpy( pNew, p, oldSize < size ? oldSize : size );
+        deallocate( p );
+        return pNew;
+    }
+
+    static inline void deallocateBlock( void* p ) {
+        const uint32_t sizeClass = getPoolBlockClass( p );
+        if ( sizeClass < POOL_CLASS_COUNT ) {
+            poolDeallocate( p, sizeClass );
+            return;
+        }
+
+        AllocationHeader* pHeader = getAllocationHeader( p );
+        if ( pHeader->mSizeAndMapped & 1 )
+            mapDeallocate( p, pHeader );
+        else
+            heapDeallocate( pHeader->pBase );
+    }
+
+    void deallocate( void *p ) {
+        if ( p )
+            deallocateBlock( p );
+    }
+
     void *threadLocalAllocate( size_t size, size_t alignment ) {
-        (void) alignment;
+        if ( alignment > DEFAULT_ALIGNMENT )
+            return mspace_memalign( tlms, alignment, size );
         return mspace_malloc( tlms, size );
     }
 
     void *threadLocalReallocate( void *p, size_t size, size_t alignment ) {
-        (void) alignment;
+        if ( alignment > DEFAULT_ALIGNMENT && p ) {
+            void* pNew = mspace_memalign( tlms, alignment, size );
+            if ( !pNew )
+                return NULL;
+            const size_t oldSize = mspace_usable_size( p );
+            memcpy( pNew, p, oldSize < size ? oldSize : size );
+            mspace_free( tlms, p );
+            return pNew;
+        }
+        if ( alignment > DEFAULT_ALIGNMENT )
+            return mspace_memalign( tlms, alignment, size );
         return mspace_realloc( tlms, p, size );
     }
 
     void threadLocalDeallocate( void *p ) {
         mspace_free( tlms, p );
     }
+
+    /************************************************************************/
+    // Frame arenas
+    // One arena per thread slot, so allocating takes no lock and a thread
+    // taking over a slot keeps using the memory of the one before. Each
+    // arena has a list of chunks per buffered frame; a frame's chunks are
+    // reset lazily the first time the arena allocates in the frame which
+    // reuses them, FRAME_ARENA_FRAME_COUNT frames later.
+    /************************************************************************/
+    static const size_t FRAME_ARENA_CHUNK_SIZE = 64 * 1024;
+
+    struct FrameArenaChunk {
+        FrameArenaChunk* pNext;
+        size_t mSize;
+        size_t mUsed;
+        size_t mPad;
+    };
+
+    struct FrameArenaFrame {
+        /// The chunk allocated from comes first
+        FrameArenaChunk* pChunks;
+        tfrg_atomic64_t mFrame;
+        tfrg_atomic64_t mAllocatedBytes;
+    };
+
+    struct FrameArena {
+        FrameArenaFrame mFrames[FRAME_ARENA_FRAME_COUNT];
+        // Arenas of different threads do not share cache lines
+        char mPadding[64 - ( sizeof( FrameArenaFrame ) * FRAME_ARENA_FRAME_COUNT ) % 64];
+    };
+
+    // The last arena is shared by the threads which did not get a thread slot
+    static FrameArena gFrameArenas[MAX_THREAD_SLOTS + 1];
+    static tfrg_atomic32_t gSharedFrameArenaLock = 0;
+    static tfrg_atomic64_t gFrameArenaFrame = 0;
+    static tfrg_atomic64_t gFrameArenaReservedBytes = 0;
+    static uint64_t gFrameArenaLastFrameBytes = 0;
+    static uint64_t gFrameArenaPeakFrameBytes = 0;
+
+    static FrameArenaChunk* addFrameArenaChunk( FrameArenaFrame* pFrame, size_t size ) {
+        FrameArenaChunk* pChunk = (FrameArenaChunk*)allocate( sizeof( FrameArenaChunk ) + size );
+        if ( !pChunk )
+            return NULL;
+        pChunk->pNext = pFrame->pChunks;
+        pChunk->mSize = size;
+        pChunk->mUsed = 0;
+        pFrame->pChunks = pChunk;
+        tfrg_atomic64_add( &gFrameArenaReservedBytes, (int64_t)size );
+        return pChunk;
+    }
+
+    static void removeFrameArenaChunks( FrameArenaFrame* pFrame ) {
+        for ( FrameArenaChunk* pChunk = pFrame->pChunks; pChunk; ) {
+            FrameArenaChunk* pNext = pChunk->pNext;
+            tfrg_atomic64_add( &gFrameArenaReservedBytes, -(int64_t)pChunk->mSize );
+            deallocate( pChunk );
+            pChunk = pNext;
+        }
+        pFrame->pChunks = NULL;
+    }
+
+    static void resetFrameArenaFrame( FrameArenaFrame* pFrame, uint64_t frame ) {
+        FrameArenaChunk* pChunk = pFrame->pChunks;
+        if ( pChunk && pChunk->pNext ) {
+            // The frame outgrew its chunk, one chunk with room for all of it saves the chaining next time
+            size_t size = 0;
+            for ( FrameArenaChunk* p = pChunk; p; p = p->pNext )
+                size += p->mSize;
+            removeFrameArenaChunks( pFrame );
+            addFrameArenaChunk( pFrame, size );
+        } else if ( pChunk ) {
+            pChunk->mUsed = 0;
+        }
+        tfrg_atomic64_store_relaxed( &pFrame->mAllocatedBytes, 0 );
+        tfrg_atomic64_store_relaxed( &pFrame->mFrame, frame );
+    }
+
+    static inline void* bumpFrameArenaChunk( FrameArenaChunk* pChunk, size_t size, size_t alignment ) {
+        const uintptr_t begin = (uintptr_t)( pChunk + 1 );
+        const uintptr_t p = ( begin + pChunk->mUsed + alignment - 1 ) & ~( (uintptr_t)alignment - 1 );
+        if ( p + size > begin + pChunk->mSize )
+            return NULL;
+        pChunk->mUsed = p + size - begin;
+        return (void*)p;
+    }
+
+    static void* frameArenaAllocate( FrameArena* pArena, size_t size, size_t alignment ) {
+        const uint64_t frame = tfrg_atomic64_load_relaxed( &gFrameArenaFrame );
+        FrameArenaFrame* pFrame = &pArena->mFrames[frame % FRAME_ARENA_FRAME_COUNT];
+        if ( tfrg_atomic64_load_relaxed( &pFrame->mFrame ) != frame )
+            resetFrameArenaFrame( pFrame, frame );
+
+        void* p = pFrame->pChunks ? bumpFrameArenaChunk( pFrame->pChunks, size, alignment ) : NULL;
+        if ( !p ) {
+            const size_t chunkSize = size + alignment > FRAME_ARENA_CHUNK_SIZE ? size + alignment : FRAME_ARENA_CHUNK_SIZE;
+            FrameArenaChunk* pChunk = addFrameArenaChunk( pFrame, chunkSize );
+            if ( !pChunk )
+                return NULL;
+            p = bumpFrameArenaChunk( pChunk, size, alignment );
+        }
+
+        tfrg_atomic64_store_relaxed( &pFrame->mAllocatedBytes, tfrg_atomic64_load_relaxed( &pFrame->mAllocatedBytes ) + size );
+        return p;
+    }
+
+    void* frameAllocate( size_t size, size_t alignment ) {
+        if ( alignment < DEFAULT_ALIGNMENT )
+            alignment = DEFAULT_ALIGNMENT;
+
+        const uint32_t slot = Thread::GetCurrentThreadSlot();
+        if ( slot < MAX_THREAD_SLOTS )
+            return frameArenaAllocate( &gFrameArenas[slot], size, alignment );
+
+        while ( tfrg_atomic32_cas( &gSharedFrameArenaLock, 0, 1 ) != 0 )
+            ;
+        void* p = frameArenaAllocate( &gFrameArenas[MAX_THREAD_SLOTS], size, alignment );
+        tfrg_atomic32_store_release( &gSharedFrameArenaLock, 0 );
+        return p;
+    }
+
+    void* frameCallocate( size_t num, size_t size, size_t alignment ) {
+        if ( size && num > ~(size_t)0 / size )
+            return NULL;
+
+        void* p = frameAllocate( num * size, alignment );
+        if ( p )
+            memset( p, 0, num * size );
+        return p;
+    }
+
+    void frameArenaNextFrame() {
+        const uint64_t frame = tfrg_atomic64_load_relaxed( &gFrameArenaFrame );
+
+        // Allocations racing with the end of the frame may be missed, the numbers are for budgeting only
+        uint64_t bytes = 0;
+        for ( uint32_t i = 0; i <= MAX_THREAD_SLOTS; ++i ) {
+            const FrameArenaFrame* pFrame = &gFrameArenas[i].mFrames[frame % FRAME_ARENA_FRAME_COUNT];
+            if ( tfrg_atomic64_load_relaxed( &pFrame->mFrame ) == frame )
+                bytes += tfrg_atomic64_load_relaxed( &pFrame->mAllocatedBytes );
+        }
+        gFrameArenaLastFrameBytes = bytes;
+        if ( bytes > gFrameArenaPeakFrameBytes )
+            gFrameArenaPeakFrameBytes = bytes;
+
+        tfrg_atomic64_store_release( &gFrameArenaFrame, frame + 1 );
+    }
+
+    void exitFrameArenas() {
+        for ( uint32_t i = 0; i <= MAX_THREAD_SLOTS; ++i ) {
+            for ( uint32_t j = 0; j < FRAME_ARENA_FRAME_COUNT; ++j ) {
+                removeFrameArenaChunks( &gFrameArenas[i].mFrames[j] );
+                tfrg_atomic64_store_relaxed( &gFrameArenas[i].mFrames[j].mAllocatedBytes, 0 );
+            }
+        }
+    }
+
+    void getFrameArenaStats( FrameArenaStats* pStats ) {
+        pStats->mLastFrameBytes = gFrameArenaLastFrameBytes;
+        pStats->mPeakFrameBytes = gFrameArenaPeakFrameBytes;
+        pStats->mReservedBytes = tfrg_atomic64_load_relaxed( &gFrameArenaReservedBytes );
+    }
+
+    /************************************************************************/
+    // Callsite tracking
+    // Every conf_malloc expansion has a static AllocationCallsite, which gets
+    // an index into the counter tables on its first allocation. Each thread
+    // slot counts into a table of its own without atomics. Allocations add
+    // to the live bytes and count of their callsite and frees subtract for
+    // the freeing thread, so the live memory of a callsite is the sum over
+    // all tables. A header in front of the memory keeps the callsite
+    // and size for the free. If sampling is on, about one allocation per
+    // sample interval bytes keeps its stack until it is freed.
+    /************************************************************************/
+    static const uint32_t MAX_TRACKED_CALLSITES = 4096;
+    // Power of two, only three quarters are filled to keep the probe sequences short
+    static const uint32_t SAMPLED_ALLOCATION_TABLE_SIZE = 8192;
+    static const uint32_t MAX_SAMPLED_STACK_DEPTH = 16;
+
+    struct TrackedAllocationHeader {
+        uint32_t mCallsite;
+        uint32_t mSampled;
+        uint64_t mSize;
+    };
+    static_assert( sizeof( TrackedAllocationHeader ) % DEFAULT_ALIGNMENT == 0, "Header has to keep the default alignment" );
+
+    // One 16 byte record per callsite keeps the counter updates of an allocation on a single cache line
+    struct CallsiteCounters {
+        tfrg_atomic64_t mLiveBytes;
+        tfrg_atomic64_t mLiveCount;
+    };
+
+    struct SampledAllocation {
+        void* p;
+        uint64_t mSize;
+        uint32_t mCallsite;
+        uint32_t mStackDepth;
+        void* pStack[MAX_SAMPLED_STACK_DEPTH];
+    };
+
+    // Index 0 counts the callsites which did not fit in the table
+    static const AllocationCallsite* gTrackedCallsites[MAX_TRACKED_CALLSITES];
+    static tfrg_atomic32_t gTrackedCallsiteCount = 0;
+    static tfrg_atomic32_t gTrackedCallsiteLock = 0;
+    // The last table is shared by the threads which did not get a thread slot
+    static tfrg_atomicptr_t gCallsiteCounters[MAX_THREAD_SLOTS + 1];
+
+    static tfrg_atomic64_t gSampleInterval = 0;
+    static tfrg_atomic32_t gSampledAllocationLock = 0;
+    static SampledAllocation* gSampledAllocations = NULL;
+    static uint32_t gSampledAllocationCount = 0;
+    static uint64_t gDroppedSampleCount = 0;
+
+    struct TrackingThreadState {
+        CallsiteCounters* pCounters;
+        uint32_t mSlot;
+        int64_t mBytesUntilSample;
+        uint64_t mSampleRandomState;
+    };
+    static thread_local TrackingThreadState gTrackingThreadState = { NULL, ~0u, 0, 0 };
+
+    static inline void acquireSpinLock( tfrg_atomic32_t* pLock ) {
+        while ( tfrg_atomic32_cas( pLock, 0, 1 ) != 0 )
+            ;
+    }
+
+    static inline void releaseSpinLock( tfrg_atomic32_t* pLock ) {
+        tfrg_atomic32_store_release( pLock, 0 );
+    }
+
+    static uint32_t registerCallsite( AllocationCallsite* pCallsite ) {
+        acquireSpinLock( &gTrackedCallsiteLock );
+        uint32_t id = tfrg_atomic32_load_relaxed( &pCallsite->mId );
+        if ( !id ) {
+            const uint32_t count = tfrg_atomic32_load_relaxed( &gTrackedCallsiteCount );
+            if ( count + 1 < MAX_TRACKED_CALLSITES ) {
+                id = count + 1;
+                gTrackedCallsites[id] = pCallsite;
+                tfrg_atomic32_store_release( &gTrackedCallsiteCount, id );
+            } else {
+                id = MAX_TRACKED_CALLSITES;
+            }
+            tfrg_atomic32_store_relaxed( &pCallsite->mId, id );
+        }
+        releaseSpinLock( &gTrackedCallsiteLock );
+        return id < MAX_TRACKED_CALLSITES ? id : 0;
+    }
+
+    static inline uint32_t getCallsiteIndex( AllocationCallsite* pCallsite ) {
+        const uint32_t id = tfrg_atomic32_load_relaxed( &pCallsite->mId );
+        if ( !id )
+            return registerCallsite( pCallsite );
+        return id < MAX_TRACKED_CALLSITES ? id : 0;
+    }
+
+    static CallsiteCounters* getCallsiteCounters( uint32_t slot ) {
+        CallsiteCounters* pCounters = (CallsiteCounters*)tfrg_atomicptr_load_acquire( &gCallsiteCounters[slot] );
+        if ( pCounters )
+            return pCounters;
+
+        pCounters = (CallsiteCounters*)callocate( MAX_TRACKED_CALLSITES, sizeof( CallsiteCounters ) );
+        if ( !pCounters )
+            return NULL;
+        // Only the shared table can be created by two threads at once
+        const uintptr_t prev = tfrg_atomicptr_cas( &gCallsiteCounters[slot], 0, (uintptr_t)pCounters );
+        if ( prev ) {
+            deallocate( pCounters );
+            return (CallsiteCounters*)prev;
+        }
+        return pCounters;
+    }
+
+    static inline void addCounters( CallsiteCounters* pCallsite, int64_t bytes, int64_t count ) {
+        tfrg_atomic64_store_relaxed( &pCallsite->mLiveBytes, tfrg_atomic64_load_relaxed( &pCallsite->mLiveBytes ) + bytes );
+        tfrg_atomic64_store_relaxed( &pCallsite->mLiveCount, tfrg_atomic64_load_relaxed( &pCallsite->mLiveCount ) + count );
+    }
+
+    // First count of a thread and every count of the threads without a slot
+    static void addCallsiteCountersSlow( TrackingThreadState* pState, uint32_t callsite, int64_t bytes, int64_t count ) {
+        if ( pState->mSlot == ~0u ) {
+            // Allocations made while looking up the slot count to the shared table instead of recursing
+            pState->mSlot = MAX_THREAD_SLOTS;
+            pState->mSlot = Thread::GetCurrentThreadSlot();
+        }
+
+        CallsiteCounters* pCounters = getCallsiteCounters( pState->mSlot );
+        if ( !pCounters )
+            return;
+
+        if ( pState->mSlot < MAX_THREAD_SLOTS ) {
+            pState->pCounters = pCounters;
+            addCounters( &pCounters[callsite], bytes, count );
+        } else {
+            tfrg_atomic64_add( &pCounters[callsite].mLiveBytes, bytes );
+            tfrg_atomic64_add( &pCounters[callsite].mLiveCount, count );
+        }
+    }
+
+    void releaseTrackingThreadSlot() {
+        // The following counts go to the shared table, which takes atomic adds
+        TrackingThreadState* pState = &gTrackingThreadState;
+        pState->mSlot = MAX_THREAD_SLOTS;
+        pState->pCounters = NULL;
+    }
+
+    static inline void addCallsiteCounters( uint32_t callsite, int64_t bytes, int64_t count ) {
+        // Only set for a thread holding a slot, which is the only one writing its table
+        TrackingThreadState* pState = &gTrackingThreadState;
+        if ( pState->pCounters )
+            addCounters( &pState->pCounters[callsite], bytes, count );
+        else
+            addCallsiteCountersSlow( pState, callsite, bytes, count );
+    }
+
+    static inline void countAllocation( uint32_t callsite, uint64_t size ) {
+        addCallsiteCounters( callsite, (int64_t)size, 1 );
+    }
+
+    static inline void countFree( uint32_t callsite, uint64_t size ) {
+        addCallsiteCounters( callsite, -(int64_t)size, -1 );
+    }
+
+    static int64_t drawSampleDistance( uint64_t sampleInterval ) {
+        // Exponentially distributed distances give every allocated byte the same chance to be sampled
+        TrackingThreadState* pState = &gTrackingThreadState;
+        uint64_t state = pState->mSampleRandomState;
+        if ( !state )
+            state = ( (uint64_t)(uintptr_t)pState ^ (uint64_t)time( NULL ) * 0x9E3779B97F4A7C15ULL ) | 1;
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        pState->mSampleRandomState = state;
+
+        const double u = ( (double)( state >> 11 ) + 1.0 ) * ( 1.0 / 9007199254740992.0 );
+        return (int64_t)( -log( u ) * (double)sampleInterval ) + 1;
+    }
+
+    static uint32_t captureStack( void** pStack, uint32_t maxDepth ) {
+#if defined( _WIN32 )
+        return (uint32_t)CaptureStackBackTrace( 0, (DWORD)maxDepth, pStack, NULL );
+#elif defined( HAS_BACKTRACE )
+        return (uint32_t)backtrace( pStack, (int)maxDepth );
+#else
+        (void)pStack;
+        (void)maxDepth;
+        return 0;
+#endif
+    }
+
+    static inline uint32_t getSampledAllocationBucket( const void* p ) {
+        return (uint32_t)( ( (uint64_t)(uintptr_t)p * 0x9E3779B97F4A7C15ULL ) >> 32 ) & ( SAMPLED_ALLOCATION_TABLE_SIZE - 1 );
+    }
+
+    static uint32_t addSampledAllocation( void* p, uint64_t size, uint32_t callsite ) {
+        void* pStack[MAX_SAMPLED_STACK_DEPTH];
+        const uint32_t stackDepth = captureStack( pStack, MAX_SAMPLED_STACK_DEPTH );
+
+        uint32_t sampled = 0;
+        acquireSpinLock( &gSampledAllocationLock );
+        if ( !gSampledAllocations )
+            gSampledAllocations = (SampledAllocation*)callocate( SAMPLED_ALLOCATION_TABLE_SIZE, sizeof( SampledAllocation ) );
+        if ( gSampledAllocations && gSampledAllocationCount < SAMPLED_ALLOCATION_TABLE_SIZE / 4 * 3 ) {
+            uint32_t i = getSampledAllocationBucket( p );
+            while ( gSampledAllocations[i].p )
+                i = ( i + 1 ) & ( SAMPLED_ALLOCATION_TABLE_SIZE - 1 );
+
+            SampledAllocation* pSample = &gSampledAllocations[i];
+            pSample->p = p;
+            pSample->mSize = size;
+            pSample->mCallsite = callsite;
+            pSample->mStackDepth = stackDepth;
+            memcpy( pSample->pStack, pStack, stackDepth * sizeof( void* ) );
+            ++gSampledAllocationCount;
+            sampled = 1;
+        } else {
+            ++gDroppedSampleCount;
+        }
+        releaseSpinLock( &gSampledAllocationLock );
+        return sampled;
+    }
+
+    static void removeSampledAllocation( void* p ) {
+        const uint32_t mask = SAMPLED_ALLOCATION_TABLE_SIZE - 1;
+        acquireSpinLock( &gSampledAllocationLock );
+        uint32_t hole = getSampledAllocationBucket( p );
+        while ( gSampledAllocations[hole].p != p )
+            hole = ( hole + 1 ) & mask;
+
+        // Shifts the following entries back instead of leaving a tombstone, an entry moves
+        // into the hole unless its bucket lies between the hole and where it is now
+        for ( uint32_t i = ( hole + 1 ) & mask; gSampledAllocations[i].p; i = ( i + 1 ) & mask ) {
+            const uint32_t bucket = getSampledAllocationBucket( gSampledAllocations[i].p );
+            if ( ( ( i - bucket ) & mask ) >= ( ( i - hole ) & mask ) ) {
+                gSampledAllocations[hole] = gSampledAllocations[i];
+                hole = i;
+            }
+        }
+        gSampledAllocations[hole].p = NULL;
+        --gSampledAllocationCount;
+        releaseSpinLock( &gSampledAllocationLock );
+    }
+
+    static inline void* trackAllocation( TrackedAllocationHeader* pHeader, uint32_t callsite, size_t size ) {
+        pHeader->mCallsite = callsite;
+        pHeader->mSampled = 0;
+        pHeader->mSize = size;
+        countAllocation( callsite, size );
+
+        void* p = pHeader + 1;
+        const uint64_t sampleInterval = tfrg_atomic64_load_relaxed( &gSampleInterval );
+        if ( sampleInterval ) {
+            TrackingThreadState* pState = &gTrackingThreadState;
+            pState->mBytesUntilSample -= (int64_t)size;
+            if ( pState->mBytesUntilSample < 0 ) {
+                pState->mBytesUntilSample = drawSampleDistance( sampleInterval );
+                pHeader->mSampled = addSampledAllocation( p, size, callsite );
+            }
+        }
+        return p;
+    }
+
+    void* trackedAllocate( AllocationCallsite* pCallsite, size_t size ) {
+        if ( size > ~(size_t)0 - sizeof( TrackedAllocationHeader ) )
+            return NULL;
+
+        TrackedAllocationHeader* pHeader = (TrackedAllocationHeader*)allocateAligned( sizeof( TrackedAllocationHeader ) + size, DEFAULT_ALIGNMENT );
+        if ( !pHeader )
+            return NULL;
+        return trackAllocation( pHeader, getCallsiteIndex( pCallsite ), size );
+    }
+
+    // The payload behind the tracked header gets the alignment, not the block. Over-aligned blocks
+    // always come from the heap with the allocation header in front of the block, so deallocateBlock
+    // frees them and reallocate moves them to a default aligned block.
+    static void* allocateTrackedBlock( size_t size, size_t alignment ) {
+        const size_t headerSize = sizeof( TrackedAllocationHeader );
+        if ( alignment <= DEFAULT_ALIGNMENT )
+            return allocateAligned( headerSize + size, DEFAULT_ALIGNMENT );
+
+        void* pBase = heapAllocate( sizeof( AllocationHeader ) + headerSize + size + alignment );
+        if ( !pBase )
+            return NULL;
+        const uintptr_t p = ( (uintptr_t)pBase + sizeof( AllocationHeader ) + headerSize + alignment - 1 ) & ~( (uintptr_t)alignment - 1 );
+        AllocationHeader* pHeader = getAllocationHeader( (void*)( p - headerSize ) );
+        pHeader->pBase = pBase;
+        pHeader->mSizeAndMapped = ( headerSize + size ) << 1;
+        return (void*)( p - headerSize );
+    }
+
+    void* trackedAllocateAligned( AllocationCallsite* pCallsite, size_t alignment, size_t size ) {
+        if ( alignment < DEFAULT_ALIGNMENT )
+            alignment = DEFAULT_ALIGNMENT;
+        if ( size > ~(size_t)0 - sizeof( AllocationHeader ) - sizeof( TrackedAllocationHeader ) - alignment )
+            return NULL;
+
+        TrackedAllocationHeader* pHeader = (TrackedAllocationHeader*)allocateTrackedBlock( size, alignment );
+        if ( !pHeader )
+            return NULL;
+        return trackAllocation( pHeader, getCallsiteIndex( pCallsite ), size );
+    }
+
+    void* trackedCallocate( AllocationCallsite* pCallsite, size_t count, size_t size ) {
+        if ( size && count > ( ~(size_t)0 - sizeof( TrackedAllocationHeader ) ) / size )
+            return NULL;
+
+        TrackedAllocationHeader* pHeader = (TrackedAllocationHeader*)callocate( 1, sizeof( TrackedAllocationHeader ) + count * size );
+        if ( !pHeader )
+            return NULL;
+        return trackAllocation( pHeader, getCallsiteIndex( pCallsite ), count * size );
+    }
+
+    void* trackedReallocate( AllocationCallsite* pCallsite, void* p, size_t size ) {
+        if ( !p )
+            return trackedAllocate( pCallsite, size );
+        if ( !size ) {
+            trackedDeallocate( p );
+            return NULL;
+        }
+        if ( size > ~(size_t)0 - sizeof( TrackedAllocationHeader ) )
+            return NULL;
+
+        // The sample goes before the memory can be reused by another thread, it is lost if the reallocation fails
+        TrackedAllocationHeader* pHeader = (TrackedAllocationHeader*)p - 1;
+        if ( pHeader->mSampled ) {
+            removeSampledAllocation( p );
+            pHeader->mSampled = 0;
+        }
+        const uint32_t oldCallsite = pHeader->mCallsite;
+        const uint64_t oldSize = pHeader->mSize;
+
+        pHeader = (TrackedAllocationHeader*)reallocate( pHeader, sizeof( TrackedAllocationHeader ) + size );
+        if ( !pHeader )
+            return NULL;
+
+        // Counted as a free of the old block and an allocation of the new one by the reallocating callsite
+        countFree( oldCallsite, oldSize );
+        return trackAllocation( pHeader, getCallsiteIndex( pCallsite ), size );
+    }
+
+    void trackedDeallocate( void* p ) {
+        if ( !p )
+            return;
+
+        TrackedAllocationHeader* pHeader = (TrackedAllocationHeader*)p - 1;
+        if ( pHeader->mSampled )
+            removeSampledAllocation( p );
+        countFree( pHeader->mCallsite, pHeader->mSize );
+        deallocateBlock( pHeader );
+    }
+
+    static MemorySnapshot* createMemorySnapshot( uint32_t callsiteCount ) {
+        MemorySnapshot* pSnapshot = (MemorySnapshot*)callocate( 1, sizeof( MemorySnapshot ) + callsiteCount * sizeof( MemoryCallsiteStats ) );
+        if ( !pSnapshot )
+            return NULL;
+        pSnapshot->mCallsiteCount = callsiteCount;
+        pSnapshot->pCallsites = (MemoryCallsiteStats*)( pSnapshot + 1 );
+        return pSnapshot;
+    }
+
+    void takeMemorySnapshot( MemorySnapshot** ppSnapshot ) {
+        const uint32_t callsiteCount = tfrg_atomic32_load_acquire( &gTrackedCallsiteCount ) + 1;
+        MemorySnapshot* pSnapshot = createMemorySnapshot( callsiteCount );
+        *ppSnapshot = pSnapshot;
+        if ( !pSnapshot )
+            return;
+
+        for ( uint32_t i = 1; i < callsiteCount; ++i ) {
+            pSnapshot->pCallsites[i].pFile = gTrackedCallsites[i]->pFile;
+            pSnapshot->pCallsites[i].mLine = gTrackedCallsites[i]->mLine;
+        }
+
+        for ( uint32_t slot = 0; slot <= MAX_THREAD_SLOTS; ++slot ) {
+            const CallsiteCounters* pCounters = (const CallsiteCounters*)tfrg_atomicptr_load_acquire( &gCallsiteCounters[slot] );
+            if ( !pCounters )
+                continue;
+
+            for ( uint32_t i = 0; i < callsiteCount; ++i ) {
+                MemoryCallsiteStats* pStats = &pSnapshot->pCallsites[i];
+                pStats->mLiveBytes += (int64_t)tfrg_atomic64_load_relaxed( &pCounters[i].mLiveBytes );
+                pStats->mLiveCount += (int64_t)tfrg_atomic64_load_relaxed( &pCounters[i].mLiveCount );
+            }
+        }
+
+        for ( uint32_t i = 0; i < callsiteCount; ++i ) {
+            pSnapshot->mLiveBytes += pSnapshot->pCallsites[i].mLiveBytes;
+            pSnapshot->mLiveCount += pSnapshot->pCallsites[i].mLiveCount;
+        }
+    }
+
+    void diffMemorySnapshots( const MemorySnapshot* pBefore, const MemorySnapshot* pAfter, MemorySnapshot** ppDiff ) {
+        // Callsites keep their index, the later snapshot may only have more of them
+        const uint32_t callsiteCount = pBefore->mCallsiteCount > pAfter->mCallsiteCount ? pBefore->mCallsiteCount : pAfter->mCallsiteCount;
+        MemorySnapshot* pDiff = createMemorySnapshot( callsiteCount );
+        *ppDiff = pDiff;
+        if ( !pDiff )
+            return;
+
+        for ( uint32_t i = 0; i < callsiteCount; ++i ) {
+            static const MemoryCallsiteStats empty = {};
+            const MemoryCallsiteStats* pFrom = i < pBefore->mCallsiteCount ? &pBefore->pCallsites[i] : &empty;
+            const MemoryCallsiteStats* pTo = i < pAfter->mCallsiteCount ? &pAfter->pCallsites[i] : &empty;
+            MemoryCallsiteStats* pStats = &pDiff->pCallsites[i];
+            pStats->pFile = pTo->pFile ? pTo->pFile : pFrom->pFile;
+            pStats->mLine = pTo->pFile ? pTo->mLine : pFrom->mLine;
+            pStats->mLiveBytes = pTo->mLiveBytes - pFrom->mLiveBytes;
+            pStats->mLiveCount = pTo->mLiveCount - pFrom->mLiveCount;
+        }
+        pDiff->mLiveBytes = pAfter->mLiveBytes - pBefore->mLiveBytes;
+        pDiff->mLiveCount = pAfter->mLiveCount - pBefore->mLiveCount;
+    }
+
+    void removeMemorySnapshot( MemorySnapshot* pSnapshot ) {
+        deallocate( pSnapshot );
+    }
+
+    static int compareCallsiteLiveBytes( const void* pA, const void* pB ) {
+        const MemoryCallsiteStats* a = (const MemoryCallsiteStats*)pA;
+        const MemoryCallsiteStats* b = (const MemoryCallsiteStats*)pB;
+        if ( a->mLiveBytes != b->mLiveBytes )
+            return a->mLiveBytes > b->mLiveBytes ? -1 : 1;
+        return a->mLiveCount > b->mLiveCount ? -1 : a->mLiveCount < b->mLiveCount ? 1 : 0;
+    }
+
+    static void writeMemorySnapshot( FILE* fp, const MemorySnapshot* pSnapshot ) {
+        fprintf( fp, "Live memory: %lld bytes in %lld allocations\n\n", (long long)pSnapshot->mLiveBytes, (long long)pSnapshot->mLiveCount );
+
+        MemoryCallsiteStats* pSorted = (MemoryCallsiteStats*)allocate( pSnapshot->mCallsiteCount * sizeof( MemoryCallsiteStats ) );
+        if ( !pSorted )
+            return;
+        memcpy( pSorted, pSnapshot->pCallsites, pSnapshot->mCallsiteCount * sizeof( MemoryCallsiteStats ) );
+        qsort( pSorted, pSnapshot->mCallsiteCount, sizeof( MemoryCallsiteStats ), compareCallsiteLiveBytes );
+
+        fprintf( fp, "%16s %12s  %s\n", "Live bytes", "Live count", "Callsite" );
+        for ( uint32_t i = 0; i < pSnapshot->mCallsiteCount; ++i ) {
+            const MemoryCallsiteStats* pStats = &pSorted[i];
+            if ( !pStats->mLiveBytes && !pStats->mLiveCount )
+                continue;
+            fprintf( fp, "%16lld %12lld  ", (long long)pStats->mLiveBytes, (long long)pStats->mLiveCount );
+            if ( pStats->pFile )
+                fprintf( fp, "%s(%u)\n", pStats->pFile, pStats->mLine );
+            else
+                fprintf( fp, "<callsites past the tracking table>\n" );
+        }
+        deallocate( pSorted );
+    }
+
+    static void writeSampledAllocations( FILE* fp ) {
+        // Copied so the lock is not held while writing
+        acquireSpinLock( &gSampledAllocationLock );
+        const uint32_t count = gSampledAllocationCount;
+        const uint64_t droppedCount = gDroppedSampleCount;
+        SampledAllocation* pSamples = count ? (SampledAllocation*)allocate( count * sizeof( SampledAllocation ) ) : NULL;
+        if ( pSamples ) {
+            uint32_t j = 0;
+            for ( uint32_t i = 0; i < SAMPLED_ALLOCATION_TABLE_SIZE && j < count; ++i ) {
+                if ( gSampledAllocations[i].p )
+                    pSamples[j++] = gSampledAllocations[i];
+            }
+        }
+        releaseSpinLock( &gSampledAllocationLock );
+
+        const uint64_t sampleInterval = tfrg_atomic64_load_relaxed( &gSampleInterval );
+        fprintf( fp, "\nSampled live allocations: %u, one per %llu allocated bytes, %llu samples dropped\n", pSamples ? count : 0,
+                 (unsigned long long)sampleInterval, (unsigned long long)droppedCount );
+        if ( !pSamples )
+            return;
+
+        for ( uint32_t i = 0; i < count; ++i ) {
+            const SampledAllocation* pSample = &pSamples[i];
+            const AllocationCallsite* pCallsite = pSample->mCallsite ? gTrackedCallsites[pSample->mCallsite] : NULL;
+            fprintf( fp, "\n%llu bytes at %p from %s(%u)\n", (unsigned long long)pSample->mSize, pSample->p,
+                     pCallsite ? pCallsite->pFile : "<callsites past the tracking table>", pCallsite ? pCallsite->mLine : 0 );
+#if defined( HAS_BACKTRACE )
+            // backtrace_symbols allocates with the system malloc
+            char** ppSymbols = backtrace_symbols( pSample->pStack, (int)pSample->mStackDepth );
+            for ( uint32_t j = 0; j < pSample->mStackDepth; ++j )
+                fprintf( fp, "    %s\n", ppSymbols ? ppSymbols[j] : "" );
+            ::free( ppSymbols );
+#else
+            for ( uint32_t j = 0; j < pSample->mStackDepth; ++j )
+                fprintf( fp, "    %p\n", pSample->pStack[j] );
+#endif
+        }
+        deallocate( pSamples );
+    }
+
+    void dumpMemorySnapshot( const MemorySnapshot* pSnapshot, const char* fileName ) {
+        FILE* fp = fopen( fileName, "w" );
+        if ( !fp )
+            return;
+        writeMemorySnapshot( fp, pSnapshot );
+        fclose( fp );
+    }
+
+    void dumpLiveMemory( const char* fileName ) {
+        MemorySnapshot* pSnapshot = NULL;
+        takeMemorySnapshot( &pSnapshot );
+        if ( !pSnapshot )
+            return;
+
+        FILE* fp = fopen( fileName, "w" );
+        if ( fp ) {
+            writeMemorySnapshot( fp, pSnapshot );
+            writeSampledAllocations( fp );
+            fclose( fp );
+        }
+        removeMemorySnapshot( pSnapshot );
+    }
+
+    void setMemoryTrackingSampleInterval( uint64_t sampleInterval ) {
+        tfrg_atomic64_store_relaxed( &gSampleInterval, sampleInterval );
+    }
+
+#if defined( USE_CALLSITE_TRACKING )
+    // Whatever is still allocated when the statics go away, like mmgr's report
+    struct MemoryTrackingExitReport {
+        ~MemoryTrackingExitReport() { dumpLiveMemory( "memleaks.log" ); }
+    };
+    static MemoryTrackingExitReport gMemoryTrackingExitReport;
+#endif
 }
 
-#if defined( USE_MEMORY_TRACKING )
+#if defined( USE_MEMORY_TRACKING ) && defined( USE_MMGR_TRACKING )
 // Just include the cpp here so we don't have to add it to the all projects
 #include "ThirdParty/OpenSource/FluidStudios/MemoryManager/mmgr.cpp"
 #endif
\ No newline at end of file
@@ -276,8 +276,13 @@ void cmdUIDrawGpuProfileData(Cmd* pCmd, struct UIManager* pUIManager, const vec2
 #endif
 }
 
-void cmdUIEndRender(Cmd* pCmd, UIManager* pUIManager)
+void cmdUIEndRender(Cmd* pCmd, UIManager* pUIManager, Fence* pFence)
 {
 	UNREF_PARAM(pCmd);
-	pUIManager->pUIRenderer->reset();
+	pUIManager->pUIRenderer->reset(pFence);
+}
+
+void getUIRenderStats(UIManager* pUIManager, UIRenderStats* pStats)
+{
+	pUIManager->pUIRenderer->getStats(pStats);
 }
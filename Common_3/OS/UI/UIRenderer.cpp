@@ -46,7 +46,8 @@
 #define MAX_UNIFORM_BUFFER_SIZE 65536U
 
 static const uint32_t gMaxDrawCallsPerFrame = 1024;
-static const uint32_t gMaxVerticesPerMesh = 1024;
+// Vertices of each stream. The streams wrap around and hold several frames of UI, so vertices are not overwritten while the GPU still reads them
+static const uint32_t gMaxVerticesPerStream = 256 * 1024;
 
 static uint32_t gWindowWidth = 0;
 static uint32_t gWindowHeight = 0;
@@ -72,10 +73,12 @@ UIRenderer::UIRenderer(Renderer* renderer) :
 	pPointSampler(NULL),
 	/// Ring buffer for dynamic constant buffers (same buffer bound at different locations)
 	pUniformRingBuffer(NULL),
-	pPlainMeshRingBuffer(NULL),
-	pTextureMeshRingBuffer(NULL),
+	mPlainStream(),
+	mTextureStream(),
 	pCurrentRootSignature(NULL),
-	pCurrentCmd(NULL)
+	pCurrentCmd(NULL),
+	mFrameStats(),
+	mLastFrameStats()
 {
 #if defined(METAL)
 	String vsPlainFile = "builtin_plain";
@@ -112,17 +115,24 @@ UIRenderer::UIRenderer(Renderer* renderer) :
 	addDepthState(pRenderer, &pDepthNone, false, false);
 	addRasterizerState(&pRasterizerNoCull, CullMode::CULL_MODE_NONE, 0, 0.0f, FillMode::FILL_MODE_SOLID, false, true);
 
-	BufferDesc vbDesc = {};
-	vbDesc.mUsage = BUFFER_USAGE_VERTEX;
-	vbDesc.mMemoryUsage = RESOURCE_MEMORY_USAGE_CPU_TO_GPU;
-	vbDesc.mSize = gMaxVerticesPerMesh * sizeof(float2);
-	vbDesc.mVertexStride = sizeof(float2);
-	vbDesc.mFlags = BUFFER_CREATION_FLAG_PERSISTENT_MAP_BIT;
-	addMeshRingBuffer(gMaxDrawCallsPerFrame, &vbDesc, NULL, &pPlainMeshRingBuffer);
-
-	vbDesc.mSize = gMaxVerticesPerMesh * sizeof(TexVertex);
-	vbDesc.mVertexStride = sizeof(TexVertex);
-	addMeshRingBuffer(gMaxDrawCallsPerFrame, &vbDesc, NULL, &pTextureMeshRingBuffer);
+	// Draws write their vertices straight into the mapped streams
+	BufferLoadDesc vbDesc = {};
+	vbDesc.mDesc.mUsage = BUFFER_USAGE_VERTEX;
+	vbDesc.mDesc.mMemoryUsage = RESOURCE_MEMORY_USAGE_CPU_TO_GPU;
+	vbDesc.mDesc.mSize = gMaxVerticesPerStream * sizeof(float2);
+	vbDesc.mDesc.mVertexStride = sizeof(float2);
+	vbDesc.mDesc.mFlags = BUFFER_CREATION_FLAG_PERSISTENT_MAP_BIT;
+	vbDesc.ppBuffer = &mPlainStream.pBuffer;
+	addResource(&vbDesc);
+	mPlainStream.mStride = sizeof(float2);
+	mPlainStream.mVertexCapacity = gMaxVerticesPerStream;
+
+	vbDesc.mDesc.mSize = gMaxVerticesPerStream * sizeof(TexVertex);
+	vbDesc.mDesc.mVertexStride = sizeof(TexVertex);
+	vbDesc.ppBuffer = &mTextureStream.pBuffer;
+	addResource(&vbDesc);
+	mTextureStream.mStride = sizeof(TexVertex);
+	mTextureStream.mVertexCapacity = gMaxVerticesPerStream;
 
 	addUniformRingBuffer(pRenderer, gMaxDrawCallsPerFrame * 2 * (uint32_t)pRenderer->pActiveGpuSettings->mUniformBufferAlignment, &pUniformRingBuffer);
 
@@ -139,6 +149,12 @@ UIRenderer::UIRenderer(Renderer* renderer) :
 	addRootSignature(pRenderer, 1, &pBuiltinPlainShader, &pRootSignaturePlainMesh, &plainRootDesc);
 	addRootSignature(pRenderer, 1, &pBuiltinTextShader, &pRootSignatureTextureMesh, &textureRootDesc);
 
+	mPlainUniformVSIndex = getDescriptorIndexFromName(pRootSignaturePlainMesh, "uniformBlockVS");
+	mPlainUniformPSIndex = getDescriptorIndexFromName(pRootSignaturePlainMesh, "uniformBlockPS");
+	mTextureUniformVSIndex = getDescriptorIndexFromName(pRootSignatureTextureMesh, "uniformBlockVS");
+	mTextureUniformPSIndex = getDescriptorIndexFromName(pRootSignatureTextureMesh, "uniformBlockPS");
+	mTextureIndex = getDescriptorIndexFromName(pRootSignatureTextureMesh, "uTex0");
+
 	registerWindowResizeEvent(onWindowResize);
 }
 
@@ -171,8 +187,8 @@ UIRenderer::~UIRenderer()
 	}
 
 	removeUniformRingBuffer(pUniformRingBuffer);
-	removeMeshRingBuffer(pPlainMeshRingBuffer);
-	removeMeshRingBuffer(pTextureMeshRingBuffer);
+	removeResource(mPlainStream.pBuffer);
+	removeResource(mTextureStream.pBuffer);
 
 	for (Texture* tex : mTextureRemoveQueue)
 	{
@@ -302,14 +318,29 @@ void UIRenderer::beginRender(Cmd* pCmd, uint32_t renderTargetCount, RenderTarget
 		pCurrentPipelineTextureMesh = &mPipelineTextureMesh[hash];
 	}
 
+	if (!mBatches.empty())
+	{
+		LOGWARNINGF("%u UI draws were discarded, call cmdUIEndRender before the render pass ends", (uint32_t)mBatches.size());
+		mBatches.clear();
+		mScissors.clear();
+		endStreamFrame(&mPlainStream, NULL);
+		endStreamFrame(&mTextureStream, NULL);
+	}
+
 	pCurrentCmd = pCmd;
 }
 
-void UIRenderer::reset()
+void UIRenderer::reset(Fence* pFence)
 {
+	flush(pFence);
 	pCurrentRootSignature = NULL;
 }
 
+void UIRenderer::getStats(UIRenderStats* pStats) const
+{
+	*pStats = mLastFrameStats;
+}
+
 void UIRenderer::onWindowResize(const struct WindowResizeEventData* pData)
 {
 	gWindowWidth = getRectWidth(pData->rect);
@@ -377,105 +408,264 @@ void UIRenderer::removeFont(int fontID)
 
 void UIRenderer::drawTexturedR8AsAlpha(PrimitiveTopology primitives, TexVertex* pVertices, const uint32_t nVertices, Texture* pTexture, const float4* pColor)
 {
-	ASSERT(primitives != PRIMITIVE_TOPO_PATCH_LIST && "Primitive type not supported for UI rendering");
-
-	uint32_t vertexDataSize = sizeof(TexVertex) * nVertices;
-	float4 scaleBias2D(2.0f / (float)gWindowWidth, -2.0f / (float)gWindowHeight, -1.0f, 1.0f);
-	float uniBuffer[6] = { scaleBias2D.getX(), scaleBias2D.getY(), scaleBias2D.getZ(), scaleBias2D.getW(), (float)pTexture->mDesc.mWidth, (float)pTexture->mDesc.mHeight };
-
-	Buffer* buffer = getVertexBuffer(pTextureMeshRingBuffer);
-	UniformBufferOffset vs = getUniformBufferOffset(pUniformRingBuffer, sizeof(uniBuffer));
-	UniformBufferOffset ps = getUniformBufferOffset(pUniformRingBuffer, sizeof(*pColor));
-
-	BufferUpdateDesc vbUpdate = { buffer, pVertices, 0, 0, vertexDataSize };
-	updateResource(&vbUpdate);
-	BufferUpdateDesc updateDesc = { vs.pUniformBuffer, uniBuffer, 0, vs.mOffset, sizeof(uniBuffer) };
-	updateResource(&updateDesc);
-	updateDesc = { ps.pUniformBuffer, pColor, 0, ps.mOffset, sizeof(*pColor) };
-	updateResource(&updateDesc);
-
-	DescriptorData params[3] = {};
-	params[0].pName = "uniformBlockVS";
-	params[0].ppBuffers = &vs.pUniformBuffer;
-	params[0].mOffset = vs.mOffset;
-	params[1].pName = "uniformBlockPS";
-	params[1].ppBuffers = &ps.pUniformBuffer;
-	params[1].mOffset = ps.mOffset;
-	params[2].pName = "uTex0";
-	params[2].ppTextures = &pTexture;
-	cmdBindPipeline(pCurrentCmd, pCurrentPipelineTextMesh->operator[](primitives));
-	cmdBindDescriptors(pCurrentCmd, pRootSignatureTextureMesh, 3, params);
-	cmdBindVertexBuffer(pCurrentCmd, 1, &buffer);
-	cmdDraw(pCurrentCmd, nVertices, 0);
+	addDraw(UI_PIPELINE_TEXT, primitives, pVertices, nVertices, pTexture, pColor);
 }
 
 void UIRenderer::drawPlain(PrimitiveTopology primitives, float2* pVertices, const uint32_t nVertices, const float4* pColor)
 {
-	ASSERT(primitives != PRIMITIVE_TOPO_PATCH_LIST && "Primitive type not supported for UI rendering");
-
-	uint32_t vertexDataSize = sizeof(float2) * nVertices;
-	float data[4] = { 2.0f / (float)gWindowWidth, -2.0f / (float)gWindowHeight, -1.0f, 1.0f };
-
-	Buffer* buffer = getVertexBuffer(pPlainMeshRingBuffer);
-	UniformBufferOffset vs = getUniformBufferOffset(pUniformRingBuffer, sizeof(data));
-	UniformBufferOffset ps = getUniformBufferOffset(pUniformRingBuffer, sizeof(*pColor));
-
-	BufferUpdateDesc vbUpdate = { buffer, pVertices, 0, 0, vertexDataSize };
-	updateResource(&vbUpdate);
-	BufferUpdateDesc updateDesc = { vs.pUniformBuffer, data, 0, vs.mOffset, sizeof(data) };
-	updateResource(&updateDesc);
-	updateDesc = { ps.pUniformBuffer, pColor, 0, ps.mOffset, sizeof(*pColor) };
-	updateResource(&updateDesc);
-
-	DescriptorData params[2] = {};
-	params[0].pName = "uniformBlockVS";
-	params[0].ppBuffers = &vs.pUniformBuffer;
-	params[0].mOffset = vs.mOffset;
-	params[1].pName = "uniformBlockPS";
-	params[1].ppBuffers = &ps.pUniformBuffer;
-	params[1].mOffset = ps.mOffset;
-
-	cmdBindPipeline(pCurrentCmd, pCurrentPipelinePlainMesh->operator[](primitives));
-	cmdBindDescriptors(pCurrentCmd, pRootSignaturePlainMesh, 2, params);
-	cmdBindVertexBuffer(pCurrentCmd, 1, &buffer);
-	cmdDraw(pCurrentCmd, nVertices, 0);
+	addDraw(UI_PIPELINE_PLAIN, primitives, pVertices, nVertices, NULL, pColor);
 }
 
 void UIRenderer::drawTextured(PrimitiveTopology primitives, TexVertex* pVertices, const uint32_t nVertices, Texture* pTexture, const float4* pColor)
+{
+	addDraw(UI_PIPELINE_TEXTURE, primitives, pVertices, nVertices, pTexture, pColor);
+}
+
+void UIRenderer::setScissor(const RectDesc* pRect)
+{
+	if (!mScissors.empty())
+	{
+		const RectDesc& last = mScissors.back();
+		if (last.left == pRect->left && last.top == pRect->top && last.right == pRect->right && last.bottom == pRect->bottom)
+			return;
+	}
+	mScissors.push_back(*pRect);
+}
+
+void* UIRenderer::allocateVertices(UIVertexStream* pStream, uint32_t vertexCount, uint32_t* pFirstVertex)
+{
+	uint32_t firstVertex = pStream->mVertexOffset;
+	bool wrapped = pStream->mWrapped;
+	if (firstVertex + vertexCount > pStream->mVertexCapacity)
+	{
+		// Wrap around once, but never onto vertices of this frame which are not drawn yet
+		if (wrapped)
+			return NULL;
+		firstVertex = 0;
+		wrapped = true;
+	}
+	if (wrapped && firstVertex + vertexCount > pStream->mFrameFirstVertex)
+		return NULL;
+
+	// Frames complete in submission order, once the youngest frame still reading the range is done every older one is too
+	uint32_t overlapCount = 0;
+	for (uint32_t i = 0; i < pStream->mPendingRegionCount; ++i)
+	{
+		const UIStreamRegion& region = pStream->mPendingRegions[i];
+		if (firstVertex < region.mEndVertex && region.mFirstVertex < firstVertex + vertexCount)
+			overlapCount = i + 1;
+	}
+	if (overlapCount)
+		waitForPendingRegions(pStream, overlapCount);
+
+	pStream->mVertexOffset = firstVertex + vertexCount;
+	pStream->mWrapped = wrapped;
+	*pFirstVertex = firstVertex;
+	return (uint8_t*)pStream->pBuffer->pCpuMappedAddress + (uint64_t)firstVertex * pStream->mStride;
+}
+
+void UIRenderer::addPendingRegion(UIVertexStream* pStream, uint32_t firstVertex, uint32_t endVertex, Fence* pFence)
+{
+	if (firstVertex == endVertex)
+		return;
+	if (pStream->mPendingRegionCount == UI_MAX_PENDING_STREAM_REGIONS)
+		waitForPendingRegions(pStream, 1);
+
+	UIStreamRegion& region = pStream->mPendingRegions[pStream->mPendingRegionCount++];
+	region.mFirstVertex = firstVertex;
+	region.mEndVertex = endVertex;
+	region.pFence = pFence;
+	region.pQueue = pCurrentCmd->pCmdPool->pQueue;
+}
+
+// Waits for the oldest regionCount regions and forgets them
+void UIRenderer::waitForPendingRegions(UIVertexStream* pStream, uint32_t regionCount)
+{
+	UIStreamRegion& region = pStream->mPendingRegions[regionCount - 1];
+	FenceStatus fenceStatus;
+	getFenceStatus(region.pFence, &fenceStatus);
+	if (fenceStatus == FENCE_STATUS_INCOMPLETE)
+	{
+		waitForFences(region.pQueue, 1, &region.pFence);
+		++mFrameStats.mStreamWaitCount;
+	}
+
+	pStream->mPendingRegionCount -= regionCount;
+	memmove(pStream->mPendingRegions, pStream->mPendingRegions + regionCount, pStream->mPendingRegionCount * sizeof(UIStreamRegion));
+}
+
+void UIRenderer::endStreamFrame(UIVertexStream* pStream, Fence* pFence)
+{
+	if (pFence)
+	{
+		if (pStream->mWrapped)
+		{
+			addPendingRegion(pStream, pStream->mFrameFirstVertex, pStream->mVertexCapacity, pFence);
+			addPendingRegion(pStream, 0, pStream->mVertexOffset, pFence);
+		}
+		else
+		{
+			addPendingRegion(pStream, pStream->mFrameFirstVertex, pStream->mVertexOffset, pFence);
+		}
+	}
+
+	pStream->mFrameFirstVertex = pStream->mVertexOffset;
+	pStream->mWrapped = false;
+}
+
+void UIRenderer::addDraw(UIPipelineType pipelineType, PrimitiveTopology primitives, const void* pVertices, const uint32_t nVertices, Texture* pTexture, const float4* pColor)
 {
 	ASSERT(primitives != PRIMITIVE_TOPO_PATCH_LIST && "Primitive type not supported for UI rendering");
 
-	uint32_t vertexDataSize = sizeof(TexVertex) * nVertices;
-	float4 scaleBias2D(2.0f / (float)gWindowWidth, -2.0f / (float)gWindowHeight, -1.0f, 1.0f);
-	float uniBuffer[6] = { scaleBias2D.getX(), scaleBias2D.getY(), scaleBias2D.getZ(), scaleBias2D.getW(), (float)pTexture->mDesc.mWidth, (float)pTexture->mDesc.mHeight };
-
-	Buffer* buffer = getVertexBuffer(pTextureMeshRingBuffer);
-	UniformBufferOffset vs = getUniformBufferOffset(pUniformRingBuffer, sizeof(uniBuffer));
-	UniformBufferOffset ps = getUniformBufferOffset(pUniformRingBuffer, sizeof(*pColor));
-
-	BufferUpdateDesc vbUpdate = { buffer, pVertices, 0, 0, vertexDataSize };
-	updateResource(&vbUpdate);
-	BufferUpdateDesc updateDesc = { vs.pUniformBuffer, uniBuffer, 0, vs.mOffset, sizeof(uniBuffer) };
-	updateResource(&updateDesc);
-	updateDesc = { ps.pUniformBuffer, pColor, 0, ps.mOffset, sizeof(*pColor) };
-	updateResource(&updateDesc);
-
-	DescriptorData params[3] = {};
-	params[0].pName = "uniformBlockVS";
-	params[0].ppBuffers = &vs.pUniformBuffer;
-	params[0].mOffset = vs.mOffset;
-	params[1].pName = "uniformBlockPS";
-	params[1].ppBuffers = &ps.pUniformBuffer;
-	params[1].mOffset = ps.mOffset;
-	params[2].pName = "uTex0";
-	params[2].ppTextures = &pTexture;
-	cmdBindPipeline(pCurrentCmd, pCurrentPipelineTextureMesh->operator[](primitives));
-	cmdBindDescriptors(pCurrentCmd, pRootSignatureTextureMesh, 3, params);
-	cmdBindVertexBuffer(pCurrentCmd, 1, &buffer);
-	cmdDraw(pCurrentCmd, nVertices, 0);
+	++mFrameStats.mRequestedDrawCount;
+
+	// Triangle strips are stored as lists so they can share a draw with their neighbours.
+	// The UI is drawn without culling, so the alternating winding of the strip does not matter.
+	const bool strip = primitives == PRIMITIVE_TOPO_TRI_STRIP;
+	const PrimitiveTopology topology = strip ? PRIMITIVE_TOPO_TRI_LIST : primitives;
+	const uint32_t vertexCount = strip ? (nVertices >= 3 ? (nVertices - 2) * 3 : 0) : nVertices;
+	if (!vertexCount)
+		return;
+
+	UIVertexStream* pStream = pipelineType == UI_PIPELINE_PLAIN ? &mPlainStream : &mTextureStream;
+	uint32_t firstVertex = 0;
+	uint8_t* pDst = (uint8_t*)allocateVertices(pStream, vertexCount, &firstVertex);
+	if (!pDst)
+	{
+		++mFrameStats.mDroppedDrawCount;
+		return;
+	}
+
+	const uint32_t stride = pStream->mStride;
+	if (strip)
+	{
+		const uint8_t* pSrc = (const uint8_t*)pVertices;
+		for (uint32_t i = 0; i + 2 < nVertices; ++i, pDst += 3 * stride)
+			memcpy(pDst, pSrc + i * stride, 3 * stride);
+	}
+	else
+	{
+		memcpy(pDst, pVertices, (size_t)vertexCount * stride);
+	}
+	mFrameStats.mVertexBytes += (uint64_t)vertexCount * stride;
+
+	// Only adjacent draws are merged, reordering would change how the alpha blended UI overlaps
+	const int32_t scissorIndex = (int32_t)mScissors.size() - 1;
+	const bool listTopology = topology == PRIMITIVE_TOPO_POINT_LIST || topology == PRIMITIVE_TOPO_LINE_LIST || topology == PRIMITIVE_TOPO_TRI_LIST;
+	UIDrawBatch* pLast = mBatches.empty() ? NULL : &mBatches.back();
+	if (pLast && listTopology && pLast->mPipelineType == pipelineType && pLast->mTopology == topology && pLast->pTexture == pTexture &&
+		pLast->mScissorIndex == scissorIndex && pLast->mFirstVertex + pLast->mVertexCount == firstVertex &&
+		pLast->mColor[0] == pColor->getX() && pLast->mColor[1] == pColor->getY() && pLast->mColor[2] == pColor->getZ() && pLast->mColor[3] == pColor->getW())
+	{
+		pLast->mVertexCount += vertexCount;
+		return;
+	}
+
+	UIDrawBatch batch;
+	batch.mPipelineType = pipelineType;
+	batch.mTopology = topology;
+	batch.pTexture = pTexture;
+	batch.mColor[0] = pColor->getX();
+	batch.mColor[1] = pColor->getY();
+	batch.mColor[2] = pColor->getZ();
+	batch.mColor[3] = pColor->getW();
+	batch.mScissorIndex = scissorIndex;
+	batch.mFirstVertex = firstVertex;
+	batch.mVertexCount = vertexCount;
+	mBatches.push_back(batch);
 }
 
-void UIRenderer::setScissor(const RectDesc* pRect)
+void UIRenderer::flush(Fence* pFence)
 {
-	cmdSetScissor(pCurrentCmd, max(0, pRect->left), max(0, pRect->top), getRectWidth(*pRect), getRectHeight(*pRect));
+	Pipeline* pBoundPipeline = NULL;
+	Buffer* pBoundVertexBuffer = NULL;
+	int32_t boundScissorIndex = -1;
+
+	for (uint32_t i = 0; i < (uint32_t)mBatches.size(); ++i)
+	{
+		const UIDrawBatch& batch = mBatches[i];
+
+		if (batch.mScissorIndex != boundScissorIndex)
+		{
+			const RectDesc& rect = mScissors[batch.mScissorIndex];
+			cmdSetScissor(pCurrentCmd, max(0, rect.left), max(0, rect.top), getRectWidth(rect), getRectHeight(rect));
+			boundScissorIndex = batch.mScissorIndex;
+		}
+
+		Pipeline* pPipeline = NULL;
+		RootSignature* pRootSignature = NULL;
+		Buffer* pVertexBuffer = NULL;
+		DescriptorData params[3] = {};
+		uint32_t paramCount = 0;
+		float uniBuffer[6] = { 2.0f / (float)gWindowWidth, -2.0f / (float)gWindowHeight, -1.0f, 1.0f, 0.0f, 0.0f };
+		uint32_t uniBufferSize = 4 * sizeof(float);
+
+		if (batch.mPipelineType == UI_PIPELINE_PLAIN)
+		{
+			pPipeline = pCurrentPipelinePlainMesh->operator[](batch.mTopology);
+			pRootSignature = pRootSignaturePlainMesh;
+			pVertexBuffer = mPlainStream.pBuffer;
+			params[0].mIndex = mPlainUniformVSIndex;
+			params[1].mIndex = mPlainUniformPSIndex;
+			paramCount = 2;
+		}
+		else
+		{
+			pPipeline = (batch.mPipelineType == UI_PIPELINE_TEXT ? pCurrentPipelineTextMesh : pCurrentPipelineTextureMesh)->operator[](batch.mTopology);
+			pRootSignature = pRootSignatureTextureMesh;
+			pVertexBuffer = mTextureStream.pBuffer;
+			uniBuffer[4] = (float)batch.pTexture->mDesc.mWidth;
+			uniBuffer[5] = (float)batch.pTexture->mDesc.mHeight;
+			uniBufferSize = sizeof(uniBuffer);
+			params[0].mIndex = mTextureUniformVSIndex;
+			params[1].mIndex = mTextureUniformPSIndex;
+			params[2].mIndex = mTextureIndex;
+			params[2].ppTextures = (Texture**)&batch.pTexture;
+			paramCount = 3;
+		}
+
+		UniformBufferOffset vs = getUniformBufferOffset(pUniformRingBuffer, uniBufferSize);
+		UniformBufferOffset ps = getUniformBufferOffset(pUniformRingBuffer, sizeof(batch.mColor));
+		BufferUpdateDesc updateDesc = { vs.pUniformBuffer, uniBuffer, 0, vs.mOffset, uniBufferSize };
+		updateResource(&updateDesc);
+		updateDesc = { ps.pUniformBuffer, batch.mColor, 0, ps.mOffset, sizeof(batch.mColor) };
+		updateResource(&updateDesc);
+
+		params[0].ppBuffers = &vs.pUniformBuffer;
+		params[0].mOffset = vs.mOffset;
+		params[1].ppBuffers = &ps.pUniformBuffer;
+		params[1].mOffset = ps.mOffset;
+
+		if (pPipeline != pBoundPipeline)
+		{
+			cmdBindPipeline(pCurrentCmd, pPipeline);
+			pBoundPipeline = pPipeline;
+		}
+		cmdBindDescriptors(pCurrentCmd, pRootSignature, paramCount, params);
+		if (pVertexBuffer != pBoundVertexBuffer)
+		{
+			cmdBindVertexBuffer(pCurrentCmd, 1, &pVertexBuffer);
+			pBoundVertexBuffer = pVertexBuffer;
+		}
+		cmdDraw(pCurrentCmd, batch.mVertexCount, batch.mFirstVertex);
+		++mFrameStats.mDrawCount;
+	}
+
+	// Keep the last scissor set even if no draw followed it
+	if (!mScissors.empty() && boundScissorIndex != (int32_t)mScissors.size() - 1)
+	{
+		const RectDesc& rect = mScissors.back();
+		cmdSetScissor(pCurrentCmd, max(0, rect.left), max(0, rect.top), getRectWidth(rect), getRectHeight(rect));
+	}
+
+	if (mFrameStats.mDroppedDrawCount)
+		LOGWARNINGF("%u UI draws did not fit into the vertex streams", mFrameStats.mDroppedDrawCount);
+
+	mBatches.clear();
+	mScissors.clear();
+	endStreamFrame(&mPlainStream, pFence);
+	endStreamFrame(&mTextureStream, pFence);
+
+	mLastFrameStats = mFrameStats;
+	mFrameStats = {};
 }
@@ -26,6 +26,7 @@
 
 #include "../../Renderer/IRenderer.h"
 #include "../Math/MathTypes.h"
+#include "../Interfaces/IUIManager.h"
 
 struct TexVertex
 {
@@ -39,6 +40,9 @@ struct TexVertex
 	float2 texCoord;
 };
 
+/// Earlier frames whose vertices a stream keeps track of until their fence completed
+#define UI_MAX_PENDING_STREAM_REGIONS 16
+
 class Fontstash;
 class Image;
 struct TextDrawDesc;
@@ -60,7 +64,12 @@ public:
 	void		setScissor(const RectDesc* rect);
 
 	void		beginRender(Cmd* pCmd, uint32_t renderTargetCount, RenderTarget** ppRenderTargets, RenderTarget* pDepthStencil);
-	void		reset();
+	/// Records the draws batched since beginRender and ends the UI frame.
+	/// pFence is signaled by the submission of the command buffer, the vertices of the frame are not overwritten before.
+	void		reset(Fence* pFence = NULL);
+
+	/// Counters of the last UI frame
+	void		getStats(UIRenderStats* pStats) const;
 
 	Texture*	addTexture(Image* image, uint32_t flags);
 	void		removeTexture(Texture* tex);
@@ -71,6 +80,58 @@ public:
 	int			addFont(const char* filename, const char* fontName = "", FSRoot root = FSRoot::FSR_Builtin_Fonts);
 	
 private:
+	enum UIPipelineType
+	{
+		UI_PIPELINE_PLAIN = 0,
+		UI_PIPELINE_TEXT,
+		UI_PIPELINE_TEXTURE,
+	};
+
+	/// Vertices of an earlier frame which the GPU may still read
+	struct UIStreamRegion
+	{
+		uint32_t	mFirstVertex;
+		uint32_t	mEndVertex;
+		Fence*		pFence;
+		Queue*		pQueue;
+	};
+
+	/// Persistently mapped vertex buffer the draws of a frame are appended to
+	struct UIVertexStream
+	{
+		Buffer*		pBuffer;
+		uint32_t	mStride;
+		uint32_t	mVertexCapacity;
+		/// Next free vertex
+		uint32_t	mVertexOffset;
+		/// First vertex of the current frame, vertices from there on are not drawn yet
+		uint32_t	mFrameFirstVertex;
+		bool		mWrapped;
+		/// Regions of earlier frames, oldest first
+		UIStreamRegion	mPendingRegions[UI_MAX_PENDING_STREAM_REGIONS];
+		uint32_t		mPendingRegionCount;
+	};
+
+	/// Adjacent draws which share pipeline, texture, color and scissor
+	struct UIDrawBatch
+	{
+		UIPipelineType		mPipelineType;
+		PrimitiveTopology	mTopology;
+		Texture*			pTexture;
+		float				mColor[4];
+		/// Index into mScissors or -1 if no scissor was set this frame
+		int32_t				mScissorIndex;
+		uint32_t			mFirstVertex;
+		uint32_t			mVertexCount;
+	};
+
+	void		addDraw(UIPipelineType pipelineType, PrimitiveTopology primitives, const void* pVertices, const uint32_t nVertices, Texture* pTexture, const float4* pColor);
+	void*		allocateVertices(UIVertexStream* pStream, uint32_t vertexCount, uint32_t* pFirstVertex);
+	void		addPendingRegion(UIVertexStream* pStream, uint32_t firstVertex, uint32_t endVertex, Fence* pFence);
+	void		waitForPendingRegions(UIVertexStream* pStream, uint32_t regionCount);
+	void		endStreamFrame(UIVertexStream* pStream, Fence* pFence);
+	void		flush(Fence* pFence);
+
 	using PipelineVector = tinystl::vector <Pipeline*>;
 	using PipelineMap = tinystl::unordered_map<uint64_t, PipelineVector>;
 	using PipelineMapNode = tinystl::unordered_hash_node<uint64_t, PipelineVector>;
@@ -102,9 +163,16 @@ private:
 
 	/// Ring buffer for dynamic constant buffers (same buffer bound at different locations)
 	struct UniformRingBuffer*		pUniformRingBuffer;
-	/// Ring buffers for dynamic vertex buffers / index buffers 
-	struct MeshRingBuffer*			pPlainMeshRingBuffer;
-	struct MeshRingBuffer*			pTextureMeshRingBuffer;
+	/// Vertex streams of float2 and TexVertex vertices
+	UIVertexStream					mPlainStream;
+	UIVertexStream					mTextureStream;
+
+	/// Descriptor indices resolved once in the constructor
+	uint32_t						mPlainUniformVSIndex;
+	uint32_t						mPlainUniformPSIndex;
+	uint32_t						mTextureUniformVSIndex;
+	uint32_t						mTextureUniformPSIndex;
+	uint32_t						mTextureIndex;
 
 	/// Mutable data
 	RootSignature*					pCurrentRootSignature;
@@ -112,4 +180,10 @@ private:
 	PipelineVector*					pCurrentPipelinePlainMesh;
 	PipelineVector*					pCurrentPipelineTextMesh;
 	PipelineVector*					pCurrentPipelineTextureMesh;
+
+	/// Draws of the current frame, recorded in order in reset()
+	tinystl::vector<UIDrawBatch>	mBatches;
+	tinystl::vector<RectDesc>		mScissors;
+	UIRenderStats					mFrameStats;
+	UIRenderStats					mLastFrameStats;
 };
@@ -964,6 +964,7 @@ int WindowsMain(int argc, char** argv, IApp* app)
 			deltaTime = 0.05f;
 
 		handleMessages();
+		confetti::frameArenaNextFrame();
 		pApp->Update(deltaTime);
 		pApp->Draw();
 		
@@ -977,6 +978,8 @@ int WindowsMain(int argc, char** argv, IApp* app)
 	}
 
 	pApp->Exit();
+	confetti::exitFrameArenas();
+	exitNameTable();
 
 	return 0;
 }
@@ -66,6 +66,43 @@ size_t _writeFile(const void *buffer, size_t byteCount, FileHandle handle)
 	return fwrite(buffer, byteCount, 1, (::FILE*)handle);
 }
 
+void* _mapFile(const char* filename, size_t* pSize, void** ppMapHandle)
+{
+	HANDLE file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+		return NULL;
+
+	LARGE_INTEGER fileSize = {};
+	if (!GetFileSizeEx(file, &fileSize) || !fileSize.QuadPart)
+	{
+		CloseHandle(file);
+		return NULL;
+	}
+
+	// The mapping keeps its own reference to the file
+	HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	CloseHandle(file);
+	if (!mapping)
+		return NULL;
+
+	void* pData = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	if (!pData)
+	{
+		CloseHandle(mapping);
+		return NULL;
+	}
+
+	*pSize = (size_t)fileSize.QuadPart;
+	*ppMapHandle = mapping;
+	return pData;
+}
+
+void _unmapFile(void* pData, size_t size, void* pMapHandle)
+{
+	UnmapViewOfFile(pData);
+	CloseHandle((HANDLE)pMapHandle);
+}
+
 size_t _getFileLastModifiedTime(const char* _fileName)
 {
 	struct stat fileInfo;
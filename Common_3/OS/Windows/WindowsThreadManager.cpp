@@ -81,6 +81,11 @@ void ConditionVariable::Set()
 	WakeConditionVariable((PCONDITION_VARIABLE)pHandle);
 }
 
+void ConditionVariable::SetAll()
+{
+	WakeAllConditionVariable((PCONDITION_VARIABLE)pHandle);
+}
+
 ThreadID Thread::mainThreadID;
 
 void Thread::SetMainThread()
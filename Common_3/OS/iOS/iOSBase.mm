@@ -341,6 +341,13 @@ uint32_t testingCurrentFrameCount;
 uint32_t testingMaxFrameCount = 120;
 bool automatedTesting = false;
 
+// The Apple bases never call IApp::Exit, so this releases what the OS layer keeps for the app when it terminates
+static void onAppWillTerminate()
+{
+    confetti::exitFrameArenas();
+    exitNameTable();
+}
+
 // Metal application implementation.
 @implementation MetalKitApplication{}
 -(nonnull instancetype) initWithMetalDevice:(nonnull id<MTLDevice>)device
@@ -386,6 +393,10 @@ bool automatedTesting = false;
         @autoreleasepool {
             pApp->Init();
         }
+        
+        [[NSNotificationCenter defaultCenter] addObserverForName:UIApplicationWillTerminateNotification object:nil queue:nil usingBlock:^(NSNotification* notification) {
+            onAppWillTerminate();
+        }];
     }
     
     return self;
@@ -407,6 +418,7 @@ bool automatedTesting = false;
     if (deltaTime > 0.15f)
         deltaTime = 0.05f;
     
+    confetti::frameArenaNextFrame();
     pApp->Update(deltaTime);
     pApp->Draw();
     
@@ -415,6 +427,8 @@ bool automatedTesting = false;
         testingCurrentFrameCount++;
         if(testingCurrentFrameCount >= testingMaxFrameCount)
         {
+            // exit does not post UIApplicationWillTerminateNotification
+            onAppWillTerminate();
             exit(0);
         }
     }
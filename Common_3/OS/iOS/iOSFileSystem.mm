@@ -28,7 +28,9 @@
 #include "../Interfaces/IOperatingSystem.h"
 #include "../Interfaces/IMemoryManager.h"
 
+#include <sys/mman.h>
 #include <sys/stat.h>
+#include <fcntl.h>
 #include <unistd.h>
 
 FileHandle _openFile(const char* filename, const char* flags)
@@ -67,7 +69,7 @@ long _tellFile(FileHandle handle)
 
 size_t _writeFile(const void *buffer, size_t byteCount, FileHandle handle)
 {
-  return fwrite(buffer, 1, byteCount, (::FILE*)handle);
+  return fwrite(buffer, byteCount, 1, (::FILE*)handle);
 }
 
 String _getCurrentDir()
@@ -85,6 +87,40 @@ String _getExePath()
     return str;
 }
 
+void* _mapFile(const char* filename, size_t* pSize, void** ppMapHandle)
+{
+  NSString *fileUrl = [[NSBundle mainBundle] pathForResource:[NSString stringWithUTF8String:filename] ofType:@""];
+  filename = [fileUrl fileSystemRepresentation];
+  if (!filename)
+    return NULL;
+
+  int fd = open(filename, O_RDONLY);
+  if (fd < 0)
+    return NULL;
+
+  struct stat fileInfo;
+  if (fstat(fd, &fileInfo) || !fileInfo.st_size)
+  {
+    close(fd);
+    return NULL;
+  }
+
+  // The mapping stays valid after the descriptor is closed
+  void* pData = mmap(NULL, (size_t)fileInfo.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (pData == MAP_FAILED)
+    return NULL;
+
+  *pSize = (size_t)fileInfo.st_size;
+  *ppMapHandle = NULL;
+  return pData;
+}
+
+void _unmapFile(void* pData, size_t size, void* pMapHandle)
+{
+  munmap(pData, size);
+}
+
 size_t _getFileLastModifiedTime(const char* _fileName)
 {
   struct stat fileInfo;
@@ -34,6 +34,7 @@
 #include "../Interfaces/ITimeManager.h"
 #include "../Interfaces/IThread.h"
 #include "../Interfaces/IMemoryManager.h"
+#include "../Interfaces/IFileSystem.h"
 
 #define CONFETTI_WINDOW_CLASS L"confetti"
 #define MAX_KEYS 256
@@ -259,6 +260,13 @@ int macOSMain(int argc, char** argv, IApp* app)
 Timer deltaTimer;
 float retinaScale = 1.0f;
 
+// The Apple bases never call IApp::Exit, so this releases what the OS layer keeps for the app when it terminates
+static void onAppWillTerminate()
+{
+	confetti::exitFrameArenas();
+	exitNameTable();
+}
+
 // Metal application implementation.
 @implementation MetalKitApplication{}
 -(nonnull instancetype) initWithMetalDevice:(nonnull id<MTLDevice>)device
@@ -293,6 +301,10 @@ renderDestinationProvider : (nonnull id<RenderDestinationProvider>)renderDestina
 			pApp->mSettings.mFullScreen = false;
 			pApp->Init();
 		}
+
+		[[NSNotificationCenter defaultCenter] addObserverForName:NSApplicationWillTerminateNotification object:nil queue:nil usingBlock:^(NSNotification* notification) {
+			onAppWillTerminate();
+		}];
 	}
 
 	return self;
@@ -314,6 +326,7 @@ renderDestinationProvider : (nonnull id<RenderDestinationProvider>)renderDestina
 	if (deltaTime > 0.15f)
 		deltaTime = 0.05f;
 
+	confetti::frameArenaNextFrame();
 	pApp->Update(deltaTime);
 	pApp->Draw();
 }
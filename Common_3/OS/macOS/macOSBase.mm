@@ -537,6 +537,13 @@ uint32_t testingCurrentFrameCount;
 uint32_t testingMaxFrameCount = 120;
 bool automatedTesting = false;
 
+// The Apple bases never call IApp::Exit, so this releases what the OS layer keeps for the app when it terminates
+static void onAppWillTerminate()
+{
+	confetti::exitFrameArenas();
+	exitNameTable();
+}
+
 // Metal application implementation.
 @implementation MetalKitApplication{}
 -(nonnull instancetype) initWithMetalDevice:(nonnull id<MTLDevice>)device
@@ -579,6 +586,10 @@ bool automatedTesting = false;
 		@autoreleasepool {
 			pApp->Init();
 		}
+
+		[[NSNotificationCenter defaultCenter] addObserverForName:NSApplicationWillTerminateNotification object:nil queue:nil usingBlock:^(NSNotification* notification) {
+			onAppWillTerminate();
+		}];
 	}
 
 	return self;
@@ -600,6 +611,7 @@ bool automatedTesting = false;
 	if (deltaTime > 0.15f)
 		deltaTime = 0.05f;
 
+	confetti::frameArenaNextFrame();
 	pApp->Update(deltaTime);
 	pApp->Draw();
     
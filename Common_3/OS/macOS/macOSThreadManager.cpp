@@ -31,6 +31,7 @@
 #ifndef _WIN32
 #include <unistd.h>
 #include <sys/sysctl.h>
+#include <sys/time.h>
 #endif
 
 Mutex::Mutex()
@@ -75,11 +76,20 @@ void* ThreadFunctionStatic(void* data)
   
   void ConditionVariable::Wait(const Mutex &mutex, unsigned int ms)
   {
-      timespec ts;
-      ts.tv_sec = 0;
-      ts.tv_nsec = ms*1000;
-      
       pthread_mutex_t* mutexHandle = (pthread_mutex_t*)&mutex.pHandle;
+      if (ms == TIMEOUT_INFINITE)
+      {
+          pthread_cond_wait(&pHandle, mutexHandle);
+          return;
+      }
+
+      // pthread_cond_timedwait expects an absolute time
+      timeval now;
+      gettimeofday(&now, NULL);
+      uint64_t nsec = (uint64_t)now.tv_usec * 1000 + (uint64_t)(ms % 1000) * 1000000;
+      timespec ts;
+      ts.tv_sec = now.tv_sec + ms / 1000 + (time_t)(nsec / 1000000000);
+      ts.tv_nsec = (long)(nsec % 1000000000);
       pthread_cond_timedwait(&pHandle, mutexHandle, &ts);
   }
   
@@ -88,6 +98,11 @@ void* ThreadFunctionStatic(void* data)
       pthread_cond_signal(&pHandle);
   }
   
+  void ConditionVariable::SetAll()
+  {
+      pthread_cond_broadcast(&pHandle);
+  }
+  
 ThreadID Thread::mainThreadID;
 
 /*	void Thread::SetPriority(int priority)
@@ -123,7 +138,13 @@ bool Thread::IsMainThread()
   void _destroyThread(ThreadHandle handle)
   {
       assert(handle!=nullptr);
-      // thread is destroyed automatically when function exitsß
+      // thread is destroyed automatically when function exits, wait for it like on Windows
+      pthread_join(handle, NULL);
+  }
+  
+  void _joinThread(ThreadHandle handle)
+  {
+      pthread_join(handle, NULL);
   }
   
 void Thread::Sleep(unsigned mSec)
@@ -24,6 +24,7 @@
 
 #include "IRenderer.h"
 #include "../OS/Interfaces/ILogManager.h"
+#include "../OS/Interfaces/IFileSystem.h"
 
 #include "../../Common_3/OS/Interfaces/IMemoryManager.h"
 
@@ -89,6 +90,46 @@ void destroyShaderReflection(ShaderReflection* pReflection)
 }
 
 
+// FNV-1a, used to find the resources and variables shared by several stages
+static uint32_t ShaderReflectionHash(const void* pData, uint32_t size, uint32_t hash)
+{
+	const uint8_t* pBytes = (const uint8_t*)pData;
+	for (uint32_t i = 0; i < size; ++i)
+		hash = (hash ^ pBytes[i]) * 16777619u;
+	return hash;
+}
+
+static uint32_t ShaderResourceHash(const ShaderResource* a)
+{
+	uint32_t hash = 2166136261u;
+	hash = ShaderReflectionHash(&a->type, sizeof(a->type), hash);
+	hash = ShaderReflectionHash(&a->set, sizeof(a->set), hash);
+	hash = ShaderReflectionHash(&a->reg, sizeof(a->reg), hash);
+	hash = ShaderReflectionHash(&a->size, sizeof(a->size), hash);
+#ifdef RESOURCE_NAME_CHECK
+	hash = ShaderReflectionHash(a->name, a->name_size, hash);
+#endif
+	return hash;
+}
+
+static uint32_t ShaderVariableHash(const ShaderVariable* a)
+{
+	uint32_t hash = 2166136261u;
+	hash = ShaderReflectionHash(&a->offset, sizeof(a->offset), hash);
+	hash = ShaderReflectionHash(&a->size, sizeof(a->size), hash);
+	hash = ShaderReflectionHash(a->name, a->name_size, hash);
+	return hash;
+}
+
+// Size of an open addressing table for count elements, a power of two so the hash can be masked
+static uint32_t getReflectionTableSize(uint32_t count)
+{
+	uint32_t size = 16;
+	while (size < count * 2)
+		size <<= 1;
+	return size;
+}
+
 void createPipelineReflection(ShaderReflection* pReflection, uint32_t stageCount, PipelineReflection* pOutReflection)
 {
 	//Parameter checks
@@ -113,6 +154,8 @@ void createPipelineReflection(ShaderReflection* pReflection, uint32_t stageCount
 
 	// Sanity check to make sure we don't have repeated stages.
 	ShaderStage combinedShaderStages = (ShaderStage)0;
+	uint32_t totalResourceCount = 0;
+	uint32_t totalVariableCount = 0;
 	for (uint32_t i = 0; i < stageCount; ++i)
 	{
 		if ((combinedShaderStages & pReflection[i].mShaderStage) != 0)
@@ -121,11 +164,13 @@ void createPipelineReflection(ShaderReflection* pReflection, uint32_t stageCount
 			return;
 		}
 		combinedShaderStages = (ShaderStage)(combinedShaderStages | pReflection[i].mShaderStage);
+		totalResourceCount += pReflection[i].mShaderResourceCount;
+		totalVariableCount += pReflection[i].mVariableCount;
 	}
 
 	// Combine all shaders
-	// this will have a large amount of looping
-	// 1. count number of resources
+	// Resources and variables which are already added from a different stage are found through hash tables
+	// holding the index of the unique element plus one, zero marks an empty slot
 	uint32_t vertexStageIndex = ~0u;
 	uint32_t hullStageIndex = ~0u;
 	uint32_t domainStageIndex = ~0u;
@@ -136,12 +181,21 @@ void createPipelineReflection(ShaderReflection* pReflection, uint32_t stageCount
 	ShaderVariable* pVariables = NULL;
 	uint32_t variableCount = 0;
 
-	//Should we be using dynamic arrays for these? Perhaps we can add std::vector
-	// like functionality?
-	ShaderResource* uniqueResources[512];
-	ShaderStage     shaderUsage[512];
-	ShaderVariable* uniqueVariable[512];
-	ShaderResource* uniqueVariableParent[512];
+	tinystl::vector<ShaderResource*> uniqueResources;
+	tinystl::vector<ShaderStage> shaderUsage;
+	tinystl::vector<ShaderVariable*> uniqueVariables;
+	tinystl::vector<uint32_t> uniqueVariableParents;
+	uniqueResources.reserve(totalResourceCount);
+	shaderUsage.reserve(totalResourceCount);
+	uniqueVariables.reserve(totalVariableCount);
+	uniqueVariableParents.reserve(totalVariableCount);
+	// Unique resource of every stage resource, so the parents of the variables don't have to be searched
+	tinystl::vector<uint32_t> resourceRemap(totalResourceCount);
+	tinystl::vector<uint32_t> resourceTable(getReflectionTableSize(totalResourceCount), 0);
+	tinystl::vector<uint32_t> variableTable(getReflectionTableSize(totalVariableCount), 0);
+	const uint32_t resourceMask = (uint32_t)resourceTable.size() - 1;
+	const uint32_t variableMask = (uint32_t)variableTable.size() - 1;
+	uint32_t firstResource = 0;
 	for (uint32_t i = 0; i < stageCount; ++i)
 	{
 		ShaderReflection* pSrcRef = pReflection + i;
@@ -173,59 +227,48 @@ void createPipelineReflection(ShaderReflection* pReflection, uint32_t stageCount
 		//Loop through all shader resources
 		for (uint32_t j = 0; j < pSrcRef->mShaderResourceCount; ++j)
 		{
-			bool unique = true;
-
-			//Go through all already added shader resources to see if this shader
-			// resource was already added from a different shader stage. If we find a
-			// duplicate shader resource, we add the shader stage to the shader stage
-			// mask of that resource instead.
-			for (uint32_t k = 0; k < resourceCount; ++k)
+			ShaderResource* pResource = &pSrcRef->pShaderResources[j];
+			uint32_t slot = ShaderResourceHash(pResource) & resourceMask;
+			while (resourceTable[slot] && !ShaderResourceCmp(pResource, uniqueResources[resourceTable[slot] - 1]))
+				slot = (slot + 1) & resourceMask;
+
+			//If the shader resource was already added from a different shader stage, we add the shader
+			// stage to the shader stage mask of that resource instead.
+			if (resourceTable[slot])
 			{
-				unique = !ShaderResourceCmp(&pSrcRef->pShaderResources[j], uniqueResources[k]);
-				if (unique == false)
-				{
-					// update shader usage
-					// NOT SURE
-					//shaderUsage[k] = (ShaderStage)(shaderUsage[k] & pSrcRef->pShaderResources[j].used_stages);
-					shaderUsage[k] |= pSrcRef->pShaderResources[j].used_stages;
-					break;
-				}
+				shaderUsage[resourceTable[slot] - 1] |= pResource->used_stages;
 			}
-
-			//If it's unique, we add it to the list of shader resourceas
-			if (unique == true)
+			else
 			{
-				shaderUsage[resourceCount] = pSrcRef->pShaderResources[j].used_stages;
-				uniqueResources[resourceCount] = &pSrcRef->pShaderResources[j];
-				resourceCount++;
+				uniqueResources.push_back(pResource);
+				shaderUsage.push_back(pResource->used_stages);
+				resourceTable[slot] = (uint32_t)uniqueResources.size();
 			}
+			resourceRemap[firstResource + j] = resourceTable[slot] - 1;
 		}
 
 		//Loop through all shader variables (constant/uniform buffer members)
 		for (uint32_t j = 0; j < pSrcRef->mVariableCount; ++j)
 		{
-			bool unique = true;
-			//Go through all already added shader variables to see if this shader
-			// variable was already added from a different shader stage. If we find a 
-			// duplicate shader variables, we don't add it.
-			for (uint32_t k = 0; k < variableCount; ++k)
-			{
-				unique = !ShaderVariableCmp(&pSrcRef->pVariables[j], uniqueVariable[k]);
-				if (unique == false)
-					break;
-			}
+			ShaderVariable* pVariable = &pSrcRef->pVariables[j];
+			uint32_t slot = ShaderVariableHash(pVariable) & variableMask;
+			while (variableTable[slot] && !ShaderVariableCmp(pVariable, uniqueVariables[variableTable[slot] - 1]))
+				slot = (slot + 1) & variableMask;
 
 			//If it's unique we add it to the list of shader variables
-			if (unique)
+			if (!variableTable[slot])
 			{
-				uniqueVariableParent[variableCount] = &pSrcRef->pShaderResources[pSrcRef->pVariables[j].parent_index];
-				uniqueVariable[variableCount] = &pSrcRef->pVariables[j];
-				variableCount++;
+				uniqueVariables.push_back(pVariable);
+				uniqueVariableParents.push_back(resourceRemap[firstResource + pVariable->parent_index]);
+				variableTable[slot] = (uint32_t)uniqueVariables.size();
 			}
 		}
+
+		firstResource += pSrcRef->mShaderResourceCount;
 	}
 
 	//Copy over the shader resources in a dynamic array of the correct size
+	resourceCount = (uint32_t)uniqueResources.size();
 	if (resourceCount)
 	{
 		pResources = (ShaderResource*)conf_malloc(sizeof(ShaderResource) * resourceCount);
@@ -238,23 +281,15 @@ void createPipelineReflection(ShaderReflection* pReflection, uint32_t stageCount
 	}
 
 	//Copy over the shader variables in a dynamic array of the correct size
+	variableCount = (uint32_t)uniqueVariables.size();
 	if (variableCount)
 	{
 		pVariables = (ShaderVariable*)conf_malloc(sizeof(ShaderVariable) * variableCount);
 
 		for (uint32_t i = 0; i < variableCount; ++i)
 		{
-			pVariables[i] = *uniqueVariable[i];
-			ShaderResource* parentResource = uniqueVariableParent[i];
-			// look for parent
-			for (uint32_t j = 0; j < resourceCount; ++j)
-			{
-				if (ShaderResourceCmp(&pResources[j], parentResource))
-				{
-					pVariables[i].parent_index = j;
-					break;
-				}
-			}
+			pVariables[i] = *uniqueVariables[i];
+			pVariables[i].parent_index = uniqueVariableParents[i];
 		}
 	}
 
@@ -288,3 +323,233 @@ void destroyPipelineReflection(PipelineReflection* pReflection)
 	conf_free(pReflection->pVariables);
 }
 
+/************************************************************************/
+// Serialization
+/************************************************************************/
+#define SHADER_REFLECTION_MAGIC 0x52534654U // "TFSR"
+#define SHADER_REFLECTION_VERSION 1U
+
+// Magic, version, stage, name pool size, the three counts, thread group size, control point count and entry point
+static const uint32_t SERIALIZED_REFLECTION_HEADER_SIZE = 12 * sizeof(uint32_t);
+static const uint32_t SERIALIZED_VERTEX_INPUT_SIZE = 3 * sizeof(uint32_t);
+#if defined(METAL)
+static const uint32_t SERIALIZED_SHADER_RESOURCE_SIZE = 9 * sizeof(uint32_t);
+#else
+static const uint32_t SERIALIZED_SHADER_RESOURCE_SIZE = 7 * sizeof(uint32_t);
+#endif
+static const uint32_t SERIALIZED_SHADER_VARIABLE_SIZE = 5 * sizeof(uint32_t);
+
+static uint32_t getReflectionNameOffset(const ShaderReflection* pReflection, const char* name)
+{
+	return name ? (uint32_t)(name - pReflection->pNamePool) : ~0u;
+}
+
+// Returns NULL unless the name and its null terminator are inside the name pool
+static const char* getReflectionName(const ShaderReflection* pReflection, uint32_t offset, uint32_t size)
+{
+	if (offset >= pReflection->mNamePoolSize || size >= pReflection->mNamePoolSize - offset || pReflection->pNamePool[offset + size] != '\0')
+		return NULL;
+	return pReflection->pNamePool + offset;
+}
+
+uint32_t getSerializedReflectionSize(const ShaderReflection* pReflection)
+{
+	return SERIALIZED_REFLECTION_HEADER_SIZE + pReflection->mNamePoolSize +
+		pReflection->mVertexInputsCount * SERIALIZED_VERTEX_INPUT_SIZE +
+		pReflection->mShaderResourceCount * SERIALIZED_SHADER_RESOURCE_SIZE +
+		pReflection->mVariableCount * SERIALIZED_SHADER_VARIABLE_SIZE;
+}
+
+bool serializeReflection(Serializer* pOutFile, const ShaderReflection* pReflection)
+{
+	ASSERT(pOutFile);
+	ASSERT(pReflection);
+
+#if defined(VULKAN)
+	uint32_t entryPointOffset = getReflectionNameOffset(pReflection, pReflection->pEntryPoint);
+#else
+	uint32_t entryPointOffset = ~0u;
+#endif
+
+	bool success = pOutFile->WriteUInt(SHADER_REFLECTION_MAGIC);
+	success = success && pOutFile->WriteUInt(SHADER_REFLECTION_VERSION);
+	success = success && pOutFile->WriteUInt((uint32_t)pReflection->mShaderStage);
+	success = success && pOutFile->WriteUInt(pReflection->mNamePoolSize);
+	success = success && pOutFile->WriteUInt(pReflection->mVertexInputsCount);
+	success = success && pOutFile->WriteUInt(pReflection->mShaderResourceCount);
+	success = success && pOutFile->WriteUInt(pReflection->mVariableCount);
+	for (uint32_t i = 0; i < 3; ++i)
+		success = success && pOutFile->WriteUInt(pReflection->mNumThreadsPerGroup[i]);
+	success = success && pOutFile->WriteUInt(pReflection->mNumControlPoint);
+	success = success && pOutFile->WriteUInt(entryPointOffset);
+	if (pReflection->mNamePoolSize)
+		success = success && pOutFile->Write(pReflection->pNamePool, pReflection->mNamePoolSize) == pReflection->mNamePoolSize;
+
+	for (uint32_t i = 0; i < pReflection->mVertexInputsCount; ++i)
+	{
+		const VertexInput* pInput = &pReflection->pVertexInputs[i];
+		success = success && pOutFile->WriteUInt(pInput->size);
+		success = success && pOutFile->WriteUInt(getReflectionNameOffset(pReflection, pInput->name));
+		success = success && pOutFile->WriteUInt(pInput->name_size);
+	}
+
+	for (uint32_t i = 0; i < pReflection->mShaderResourceCount; ++i)
+	{
+		const ShaderResource* pResource = &pReflection->pShaderResources[i];
+		success = success && pOutFile->WriteUInt((uint32_t)pResource->type);
+		success = success && pOutFile->WriteUInt(pResource->set);
+		success = success && pOutFile->WriteUInt(pResource->reg);
+		success = success && pOutFile->WriteUInt(pResource->size);
+		success = success && pOutFile->WriteUInt((uint32_t)pResource->used_stages);
+		success = success && pOutFile->WriteUInt(getReflectionNameOffset(pReflection, pResource->name));
+		success = success && pOutFile->WriteUInt(pResource->name_size);
+#if defined(METAL)
+		success = success && pOutFile->WriteUInt(pResource->mtlTextureType);
+		success = success && pOutFile->WriteUInt(pResource->mtlArgumentBufferType);
+#endif
+	}
+
+	for (uint32_t i = 0; i < pReflection->mVariableCount; ++i)
+	{
+		const ShaderVariable* pVariable = &pReflection->pVariables[i];
+		success = success && pOutFile->WriteUInt(pVariable->parent_index);
+		success = success && pOutFile->WriteUInt(pVariable->offset);
+		success = success && pOutFile->WriteUInt(pVariable->size);
+		success = success && pOutFile->WriteUInt(getReflectionNameOffset(pReflection, pVariable->name));
+		success = success && pOutFile->WriteUInt(pVariable->name_size);
+	}
+
+	return success;
+}
+
+static bool readSerializedReflection(Deserializer* pInFile, ShaderReflection* pOutReflection)
+{
+	uint32_t header[SERIALIZED_REFLECTION_HEADER_SIZE / sizeof(uint32_t)];
+	if (pInFile->Read(header, sizeof(header)) != sizeof(header) || header[0] != SHADER_REFLECTION_MAGIC || header[1] != SHADER_REFLECTION_VERSION)
+		return false;
+
+	const uint32_t namePoolSize = header[3];
+	const uint32_t vertexInputCount = header[4];
+	const uint32_t resourceCount = header[5];
+	const uint32_t variableCount = header[6];
+	const uint64_t dataSize = (uint64_t)namePoolSize + (uint64_t)vertexInputCount * SERIALIZED_VERTEX_INPUT_SIZE +
+		(uint64_t)resourceCount * SERIALIZED_SHADER_RESOURCE_SIZE + (uint64_t)variableCount * SERIALIZED_SHADER_VARIABLE_SIZE;
+	if (dataSize > pInFile->GetSize() - pInFile->GetPosition())
+		return false;
+
+	pOutReflection->mShaderStage = (ShaderStage)header[2];
+	pOutReflection->mNumThreadsPerGroup[0] = header[7];
+	pOutReflection->mNumThreadsPerGroup[1] = header[8];
+	pOutReflection->mNumThreadsPerGroup[2] = header[9];
+	pOutReflection->mNumControlPoint = header[10];
+
+	if (namePoolSize)
+	{
+		pOutReflection->pNamePool = (char*)conf_malloc(namePoolSize);
+		pOutReflection->mNamePoolSize = namePoolSize;
+		pInFile->Read(pOutReflection->pNamePool, namePoolSize);
+	}
+
+#if defined(VULKAN)
+	if (header[11] != ~0u)
+	{
+		if (header[11] >= namePoolSize || !memchr(pOutReflection->pNamePool + header[11], '\0', namePoolSize - header[11]))
+			return false;
+		pOutReflection->pEntryPoint = pOutReflection->pNamePool + header[11];
+	}
+#endif
+
+	if (vertexInputCount)
+	{
+		pOutReflection->pVertexInputs = (VertexInput*)conf_malloc(sizeof(VertexInput) * vertexInputCount);
+		pOutReflection->mVertexInputsCount = vertexInputCount;
+		for (uint32_t i = 0; i < vertexInputCount; ++i)
+		{
+			VertexInput* pInput = &pOutReflection->pVertexInputs[i];
+			pInput->size = pInFile->ReadUInt();
+			uint32_t nameOffset = pInFile->ReadUInt();
+			pInput->name_size = pInFile->ReadUInt();
+			pInput->name = getReflectionName(pOutReflection, nameOffset, pInput->name_size);
+			if (!pInput->name)
+				return false;
+		}
+	}
+
+	if (resourceCount)
+	{
+		pOutReflection->pShaderResources = (ShaderResource*)conf_malloc(sizeof(ShaderResource) * resourceCount);
+		pOutReflection->mShaderResourceCount = resourceCount;
+		for (uint32_t i = 0; i < resourceCount; ++i)
+		{
+			ShaderResource* pResource = &pOutReflection->pShaderResources[i];
+			pResource->type = (DescriptorType)pInFile->ReadUInt();
+			pResource->set = pInFile->ReadUInt();
+			pResource->reg = pInFile->ReadUInt();
+			pResource->size = pInFile->ReadUInt();
+			pResource->used_stages = (ShaderStage)pInFile->ReadUInt();
+			uint32_t nameOffset = pInFile->ReadUInt();
+			pResource->name_size = pInFile->ReadUInt();
+#if defined(METAL)
+			pResource->mtlTextureType = pInFile->ReadUInt();
+			pResource->mtlArgumentBufferType = pInFile->ReadUInt();
+#endif
+			pResource->name = getReflectionName(pOutReflection, nameOffset, pResource->name_size);
+			if (!pResource->name)
+				return false;
+		}
+	}
+
+	if (variableCount)
+	{
+		pOutReflection->pVariables = (ShaderVariable*)conf_malloc(sizeof(ShaderVariable) * variableCount);
+		pOutReflection->mVariableCount = variableCount;
+		for (uint32_t i = 0; i < variableCount; ++i)
+		{
+			ShaderVariable* pVariable = &pOutReflection->pVariables[i];
+			pVariable->parent_index = pInFile->ReadUInt();
+			pVariable->offset = pInFile->ReadUInt();
+			pVariable->size = pInFile->ReadUInt();
+			uint32_t nameOffset = pInFile->ReadUInt();
+			pVariable->name_size = pInFile->ReadUInt();
+			pVariable->name = getReflectionName(pOutReflection, nameOffset, pVariable->name_size);
+			if (!pVariable->name || pVariable->parent_index >= resourceCount)
+				return false;
+		}
+	}
+
+	return true;
+}
+
+bool deserializeReflection(Deserializer* pInFile, ShaderReflection* pOutReflection)
+{
+	ASSERT(pInFile);
+	ASSERT(pOutReflection);
+
+	memset(pOutReflection, 0, sizeof(*pOutReflection));
+	if (!readSerializedReflection(pInFile, pOutReflection))
+	{
+		destroyShaderReflection(pOutReflection);
+		memset(pOutReflection, 0, sizeof(*pOutReflection));
+		return false;
+	}
+
+	return true;
+}
+
+#ifndef METAL
+void loadShaderReflection(const uint8_t* shaderCode, uint32_t shaderSize, const void* pReflection, uint32_t reflectionSize, ShaderStage shaderStage, ShaderReflection* pOutReflection)
+{
+	if (pReflection)
+	{
+		MemoryBuffer buffer(pReflection, reflectionSize);
+		if (deserializeReflection(&buffer, pOutReflection) && pOutReflection->mShaderStage == shaderStage)
+			return;
+
+		LOGWARNING("Ignoring invalid serialized shader reflection, reflecting the byte code instead");
+		destroyShaderReflection(pOutReflection);
+		memset(pOutReflection, 0, sizeof(*pOutReflection));
+	}
+
+	createShaderReflection(shaderCode, shaderSize, shaderStage, pOutReflection);
+}
+#endif
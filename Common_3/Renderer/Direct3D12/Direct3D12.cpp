@@ -224,7 +224,7 @@ namespace RENDERER_CPP_NAMESPACE {
 		DXGI_FORMAT_UNKNOWN, // GNF_BC4 = 75,
 		DXGI_FORMAT_UNKNOWN, // GNF_BC5 = 76,
 		DXGI_FORMAT_UNKNOWN, // GNF_BC6 = 77,
-		DXGI_FORMAT_UNKNOWN, // GNF_BC7 = 78,
+		DXGI_FORMAT_BC7_TYPELESS, // GNF_BC7 = 78,
 		// Reveser Form
 		DXGI_FORMAT_B8G8R8A8_UNORM, // BGRA8 = 79,
 		// Extend for DXGI
@@ -315,7 +315,7 @@ namespace RENDERER_CPP_NAMESPACE {
 		DXGI_FORMAT_UNKNOWN, // GNF_BC4 = 75,
 		DXGI_FORMAT_UNKNOWN, // GNF_BC5 = 76,
 		DXGI_FORMAT_UNKNOWN, // GNF_BC6 = 77,
-		DXGI_FORMAT_UNKNOWN, // GNF_BC7 = 78,
+		DXGI_FORMAT_BC7_UNORM, // GNF_BC7 = 78,
 		// Reveser Form
 		DXGI_FORMAT_B8G8R8A8_UNORM, // BGRA8 = 79,
 		// Extend for DXGI
@@ -756,10 +756,10 @@ namespace RENDERER_CPP_NAMESPACE {
 		D3D12_GPU_DESCRIPTOR_HANDLE		mBaseSamplerGpuHandle;
 	} DescriptorTable;
 
-	using DescriptorTableMap = tinystl::unordered_map<uint64_t, DescriptorTable>;
-	using ConstDescriptorTableMapIterator = tinystl::unordered_map<uint64_t, DescriptorTable>::const_iterator;
-	using DescriptorTableMapNode = tinystl::unordered_hash_node<uint64_t, DescriptorTable>;
-	using DescriptorNameToIndexMap = tinystl::unordered_map<uint32_t, uint32_t>;
+	using DescriptorTableMap = tinystl::flat_hash_map<uint64_t, DescriptorTable>;
+	using ConstDescriptorTableMapIterator = tinystl::flat_hash_map<uint64_t, DescriptorTable>::const_iterator;
+	using DescriptorTableMapNode = tinystl::flat_hash_map<uint64_t, DescriptorTable>::value_type;
+	using DescriptorNameToIndexMap = tinystl::flat_hash_map<uint32_t, uint32_t>;
 
 	typedef struct DescriptorManager
 	{
@@ -781,8 +781,6 @@ namespace RENDERER_CPP_NAMESPACE {
 		uint32_t						mFrameIdx;
 	} DescriptorManager;
 
-	Mutex gDescriptorMutex;
-
 	void add_descriptor_manager(Renderer* pRenderer, RootSignature* pRootSignature, DescriptorManager** ppManager)
 	{
 		DescriptorManager* pManager = (DescriptorManager*)conf_calloc(1, sizeof(*pManager));
@@ -876,40 +874,55 @@ namespace RENDERER_CPP_NAMESPACE {
 		SAFE_FREE(pManager);
 	}
 
+	// Threads without a thread slot share the descriptor manager at MAX_THREAD_SLOTS of each root signature and bind one at a time
+	static Mutex gSharedDescriptorMutex;
+
+	/// Holds gSharedDescriptorMutex while a thread without a thread slot uses the shared descriptor manager
+	struct SharedDescriptorLock
+	{
+		SharedDescriptorLock(uint32_t slot) : mShared(slot >= MAX_THREAD_SLOTS) { if (mShared) gSharedDescriptorMutex.Acquire(); }
+		~SharedDescriptorLock() { if (mShared) gSharedDescriptorMutex.Release(); }
+		bool mShared;
+	};
+
 	// This function returns the descriptor manager belonging to this thread
 	// If a descriptor manager does not exist for this thread, a new one is created
-	// With this approach we make sure that descriptor binding is thread safe and lock conf_free at the same time
-	DescriptorManager* get_descriptor_manager(Renderer* pRenderer, RootSignature* pRootSignature)
+	// Managers are indexed by the thread slot and only the thread owning a slot writes it, so binding needs neither a lookup nor a lock.
+	// Threads without a slot get the shared manager and have to hold a SharedDescriptorLock while they use it.
+	DescriptorManager* get_descriptor_manager(Renderer* pRenderer, RootSignature* pRootSignature, uint32_t slot)
 	{
-		tinystl::unordered_hash_node<ThreadID, DescriptorManager*>* pNode = pRootSignature->pDescriptorManagerMap.find(Thread::GetCurrentThreadID()).node;
-		if (pNode == NULL)
+		DescriptorManager* pManager = pRootSignature->pDescriptorManagers[slot];
+		if (!pManager)
 		{
-			// Only need a lock when creating a new descriptor manager for this thread
-			MutexLock lock(gDescriptorMutex);
-			DescriptorManager* pManager = NULL;
+			if (slot >= MAX_THREAD_SLOTS)
+				LOGERROR("All thread slots are taken, threads without one bind through a shared descriptor manager under a lock");
 			add_descriptor_manager(pRenderer, pRootSignature, &pManager);
-			pRootSignature->pDescriptorManagerMap.insert({ Thread::GetCurrentThreadID(), pManager });
-			return pManager;
-		}
-		else
-		{
-			return pNode->second;
+			pRootSignature->pDescriptorManagers[slot] = pManager;
 		}
+		return pManager;
 	}
 
-	const DescriptorInfo* get_descriptor(const RootSignature* pRootSignature, const char* pResName, uint32_t* pIndex)
+	uint32_t getDescriptorIndexFromName(const RootSignature* pRootSignature, const char* pName)
 	{
-		DescriptorNameToIndexMap::const_iterator it = pRootSignature->pDescriptorNameToIndexMap.find(tinystl::hash(pResName));
-		if (it.node)
-		{
-			*pIndex = it.node->second;
-			return &pRootSignature->pDescriptors[it.node->second];
-		}
-		else
+		DescriptorNameToIndexMap::const_iterator it = pRootSignature->pDescriptorNameToIndexMap.find(tinystl::hash(pName));
+		return it != pRootSignature->pDescriptorNameToIndexMap.end() ? it->second : (uint32_t)-1;
+	}
+
+	// Descriptors are found by index if the param has one, otherwise by the precomputed hash of the name or by the name
+	const DescriptorInfo* get_descriptor(const RootSignature* pRootSignature, const DescriptorData* pParam, uint32_t* pIndex)
+	{
+		const uint32_t index = findDescriptorIndex(pRootSignature, pParam);
+		if (index == (uint32_t)-1)
 		{
-			LOGERRORF("Invalid descriptor param (%s)", pResName);
+			if (pParam->mIndex != (uint32_t)-1)
+				LOGERRORF("Invalid descriptor index (%u)", pParam->mIndex);
+			else
+				LOGERRORF("Invalid descriptor param (%s)", pParam->pName ? pParam->pName : "");
 			return NULL;
 		}
+
+		*pIndex = index;
+		return &pRootSignature->pDescriptors[index];
 	}
 
 #define MAX_DYNAMIC_VIEW_DESCRIPTORS_PER_FRAME gGpuDescriptorHeapProperties[0].mMaxDescriptors / 16
@@ -919,7 +932,9 @@ namespace RENDERER_CPP_NAMESPACE {
 	{
 		Renderer* pRenderer = pCmd->pCmdPool->pRenderer;
 		const uint32_t setCount = DESCRIPTOR_UPDATE_FREQ_COUNT;
-		DescriptorManager* pm = get_descriptor_manager(pRenderer, pRootSignature);
+		const uint32_t slot = Thread::GetCurrentThreadSlot();
+		SharedDescriptorLock lock(slot);
+		DescriptorManager* pm = get_descriptor_manager(pRenderer, pRootSignature, slot);
 
 		for (uint32_t setIndex = 0; setIndex < setCount; ++setIndex)
 		{
@@ -960,14 +975,14 @@ namespace RENDERER_CPP_NAMESPACE {
 			const DescriptorData* pParam = &pDescParams[i];
 
 			ASSERT(pParam);
-			if (!pParam->pName)
+			if (!pParam->pName && !pParam->mNameHash && pParam->mIndex == (uint32_t)-1)
 			{
 				LOGERRORF("Name of Descriptor at index (%u) is NULL", i);
 				return;
 			}
 
 			uint32_t descIndex = ~0u;
-			const DescriptorInfo* pDesc = get_descriptor(pRootSignature, pParam->pName, &descIndex);
+			const DescriptorInfo* pDesc = get_descriptor(pRootSignature, pParam, &descIndex);
 			if (!pDesc)
 				continue;
 
@@ -979,7 +994,7 @@ namespace RENDERER_CPP_NAMESPACE {
 			{
 				if (!pParam->pRootConstant)
 				{
-					LOGERRORF("Root constant (%s) is NULL", pParam->pName);
+					LOGERRORF("Root constant (%s) is NULL", pDesc->mDesc.name);
 					continue;
 				}
 				if (pRootSignature->mPipelineType == PIPELINE_TYPE_COMPUTE)
@@ -1000,7 +1015,7 @@ namespace RENDERER_CPP_NAMESPACE {
 			{
 				if (!pParam->ppBuffers[0])
 				{
-					LOGERRORF("Root descriptor CBV (%s) is NULL", pParam->pName);
+					LOGERRORF("Root descriptor CBV (%s) is NULL", pDesc->mDesc.name);
 					continue;
 				}
 				D3D12_GPU_VIRTUAL_ADDRESS cbv = D3D12_GPU_VIRTUAL_ADDRESS_UNKNOWN;
@@ -1047,18 +1062,18 @@ namespace RENDERER_CPP_NAMESPACE {
 			case DESCRIPTOR_TYPE_SAMPLER:
 				if (pDesc->mIndexInParent == -1)
 				{
-					LOGERRORF("Trying to bind a static sampler (%s). All static samplers must be bound in addRootSignature through RootSignatureDesc::mStaticSamplers", pParam->pName);
+					LOGERRORF("Trying to bind a static sampler (%s). All static samplers must be bound in addRootSignature through RootSignatureDesc::mStaticSamplers", pDesc->mDesc.name);
 					continue;
 				}
 				if (!pParam->ppSamplers)
 				{
-					LOGERRORF("Sampler descriptor (%s) is NULL", pParam->pName);
+					LOGERRORF("Sampler descriptor (%s) is NULL", pDesc->mDesc.name);
 					return;
 				}
 				for (uint32_t j = 0; j < pParam->mCount; ++j)
 				{
 					if (!pParam->ppSamplers[j]) {
-						LOGERRORF("Sampler descriptor (%s) at array index (%u) is NULL", pParam->pName, j);
+						LOGERRORF("Sampler descriptor (%s) at array index (%u) is NULL", pDesc->mDesc.name, j);
 						return;
 					}
 					pHash[setIndex] = tinystl::hash_state(&pParam->ppSamplers[j]->mSamplerId, 1, pHash[setIndex]);
@@ -1069,7 +1084,7 @@ namespace RENDERER_CPP_NAMESPACE {
 			{
 				if (!pParam->ppTextures)
 				{
-					LOGERRORF("Texture descriptor (%s) is NULL", pParam->pName);
+					LOGERRORF("Texture descriptor (%s) is NULL", pDesc->mDesc.name);
 					return;
 				}
 				D3D12_CPU_DESCRIPTOR_HANDLE* handlePtr = &pm->pViewDescriptorHandles[setIndex][pDesc->mHandleIndex];
@@ -1079,7 +1094,7 @@ namespace RENDERER_CPP_NAMESPACE {
 #ifdef _DEBUG
 					if (!pParam->ppTextures[j])
 					{
-						LOGERRORF("Texture descriptor (%s) at array index (%u) is NULL", pParam->pName, j);
+						LOGERRORF("Texture descriptor (%s) at array index (%u) is NULL", pDesc->mDesc.name, j);
 						return;
 					}
 #endif
@@ -1096,14 +1111,14 @@ namespace RENDERER_CPP_NAMESPACE {
 			case DESCRIPTOR_TYPE_RW_TEXTURE:
 				if (!pParam->ppTextures)
 				{
-					LOGERRORF("Texture descriptor (%s) is NULL", pParam->pName);
+					LOGERRORF("Texture descriptor (%s) is NULL", pDesc->mDesc.name);
 					return;
 				}
 				for (uint32_t j = 0; j < pParam->mCount; ++j)
 				{
 					if (!pParam->ppBuffers[j])
 					{
-						LOGERRORF("Texture descriptor (%s) at array index (%u) is NULL", pParam->pName, j);
+						LOGERRORF("Texture descriptor (%s) at array index (%u) is NULL", pDesc->mDesc.name, j);
 						return;
 					}
 					pHash[setIndex] = tinystl::hash_state(&pParam->ppTextures[j]->mTextureId, 1, pHash[setIndex]);
@@ -1119,14 +1134,14 @@ namespace RENDERER_CPP_NAMESPACE {
 			case DESCRIPTOR_TYPE_BUFFER:
 				if (!pParam->ppBuffers)
 				{
-					LOGERRORF("Buffer descriptor (%s) is NULL", pParam->pName);
+					LOGERRORF("Buffer descriptor (%s) is NULL", pDesc->mDesc.name);
 					return;
 				}
 				for (uint32_t j = 0; j < pParam->mCount; ++j)
 				{
 					if (!pParam->ppBuffers[j])
 					{
-						LOGERRORF("Buffer descriptor (%s) at array index (%u) is NULL", pParam->pName, j);
+						LOGERRORF("Buffer descriptor (%s) at array index (%u) is NULL", pDesc->mDesc.name, j);
 						return;
 					}
 					pHash[setIndex] = tinystl::hash_state(&pParam->ppBuffers[j]->mBufferId, 1, pHash[setIndex]);
@@ -1149,14 +1164,14 @@ namespace RENDERER_CPP_NAMESPACE {
 			case DESCRIPTOR_TYPE_RW_BUFFER:
 				if (!pParam->ppBuffers)
 				{
-					LOGERRORF("Buffer descriptor (%s) is NULL", pParam->pName);
+					LOGERRORF("Buffer descriptor (%s) is NULL", pDesc->mDesc.name);
 					return;
 				}
 				for (uint32_t j = 0; j < pParam->mCount; ++j)
 				{
 					if (!pParam->ppBuffers[j])
 					{
-						LOGERRORF("Buffer descriptor (%s) at array index (%u) is NULL", pParam->pName, j);
+						LOGERRORF("Buffer descriptor (%s) at array index (%u) is NULL", pDesc->mDesc.name, j);
 						return;
 					}
 					pHash[setIndex] = tinystl::hash_state(&pParam->ppBuffers[j]->mBufferId, 1, pHash[setIndex]);
@@ -1172,14 +1187,14 @@ namespace RENDERER_CPP_NAMESPACE {
 			case DESCRIPTOR_TYPE_UNIFORM_BUFFER:
 				if (!pParam->ppBuffers)
 				{
-					LOGERRORF("Buffer descriptor (%s) is NULL", pParam->pName);
+					LOGERRORF("Buffer descriptor (%s) is NULL", pDesc->mDesc.name);
 					return;
 				}
 				for (uint32_t j = 0; j < pParam->mCount; ++j)
 				{
 					if (!pParam->ppBuffers[j])
 					{
-						LOGERRORF("Buffer descriptor (%s) at array index (%u) is NULL", pParam->pName, j);
+						LOGERRORF("Buffer descriptor (%s) at array index (%u) is NULL", pDesc->mDesc.name, j);
 						return;
 					}
 					pHash[setIndex] = tinystl::hash_state(&pParam->ppBuffers[j]->mBufferId, 1, pHash[setIndex]);
@@ -1213,9 +1228,9 @@ namespace RENDERER_CPP_NAMESPACE {
 					// If the hash already exists, it means we have already created a descriptor table with the input descriptors
 					// Now we just bind that descriptor table and no other op is required
 					ConstDescriptorTableMapIterator it = pm->mStaticDescriptorTableMap[pm->mFrameIdx].find(pHash[setIndex]);
-					if (it.node)
+					if (it != pm->mStaticDescriptorTableMap[pm->mFrameIdx].end())
 					{
-						descTable = it.node->second;
+						descTable = it->second;
 					}
 					// If the given hash does not exist, we create a new descriptor table and insert it into the descriptor table map
 					else
@@ -1238,7 +1253,7 @@ namespace RENDERER_CPP_NAMESPACE {
 							{ descTable.mBaseSamplerCpuHandle.ptr + i * pRenderer->pSamplerHeap->mDescriptorSize },
 								pm->pSamplerDescriptorHandles[setIndex][i], pRenderer->pSamplerHeap->mType);
 
-						pm->mStaticDescriptorTableMap[pm->mFrameIdx].insert({ pHash[setIndex], descTable }).first.node->second;
+						pm->mStaticDescriptorTableMap[pm->mFrameIdx].insert({ pHash[setIndex], descTable });
 					}
 				}
 				// Dynamic descriptors
@@ -2943,9 +2958,11 @@ namespace RENDERER_CPP_NAMESPACE {
 				D3DCreateBlob(pStage->mByteCodeSize, compiled_code);
 				memcpy((*compiled_code)->GetBufferPointer(), pStage->pByteCode, pStage->mByteCodeSize);
 
-				createShaderReflection(
+				loadShaderReflection(
 					(uint8_t*)((*compiled_code)->GetBufferPointer()),
 					(uint32_t)(*compiled_code)->GetBufferSize(),
+					pStage->pReflection,
+					pStage->mReflectionSize,
 					stage_mask,
 					&pShaderProgram->mReflection.mStageReflections[reflectionCount]);
 
@@ -3114,7 +3131,7 @@ namespace RENDERER_CPP_NAMESPACE {
 		const RootSignatureDesc* pRootSignatureDesc = pRootDesc ? pRootDesc : &gDefaultRootSignatureDesc;
 
 		//pRootSignature->pDescriptorNameToIndexMap;
-		conf_placement_new<tinystl::unordered_map<uint32_t, uint32_t> >(
+		conf_placement_new<tinystl::flat_hash_map<uint32_t, uint32_t> >(
 			&pRootSignature->pDescriptorNameToIndexMap);
 
 		// Collect all unique shader resources in the given shaders
@@ -3149,10 +3166,10 @@ namespace RENDERER_CPP_NAMESPACE {
 					setIndex = 0;
 
 				// Find all unique resources
-				tinystl::unordered_hash_node<uint32_t, uint32_t>* pNode = pRootSignature->pDescriptorNameToIndexMap.find(tinystl::hash(pRes->name)).node;
-				if (!pNode)
+				const NameId nameId = internName(pRes->name);
+				if (pRootSignature->pDescriptorNameToIndexMap.find(nameId) == pRootSignature->pDescriptorNameToIndexMap.end())
 				{
-					pRootSignature->pDescriptorNameToIndexMap.insert({ tinystl::hash(pRes->name), (uint32_t)shaderResources.size() });
+					pRootSignature->pDescriptorNameToIndexMap.insert({ nameId, (uint32_t)shaderResources.size() });
 					shaderResources.push_back(*pRes);
 
 					uint32_t constantSize = 0;
@@ -3175,7 +3192,7 @@ namespace RENDERER_CPP_NAMESPACE {
 				{
 					for (ShaderResource& res : shaderResources)
 					{
-						if (tinystl::hash(res.name) == pNode->first)
+						if (getNameId(res.name) == nameId)
 						{
 							res.used_stages |= pRes->used_stages;
 							break;
@@ -3595,24 +3612,22 @@ namespace RENDERER_CPP_NAMESPACE {
 
 		SAFE_RELEASE (error_msgs);
 
-		conf_placement_new<RootSignature::ThreadLocalDescriptorManager>(&pRootSignature->pDescriptorManagerMap);
 		// Create descriptor manager for this thread
-		DescriptorManager* pManager = NULL;
-		add_descriptor_manager(pRenderer, pRootSignature, &pManager);
-		pRootSignature->pDescriptorManagerMap.insert({ Thread::GetCurrentThreadID(), pManager });
+		const uint32_t slot = Thread::GetCurrentThreadSlot();
+		if (slot < MAX_THREAD_SLOTS)
+			get_descriptor_manager(pRenderer, pRootSignature, slot);
 
 		*ppRootSignature = pRootSignature;
 	}
 
 	void removeRootSignature(Renderer* pRenderer, RootSignature* pRootSignature)
 	{
-		for (tinystl::unordered_hash_node<ThreadID, DescriptorManager*>& it : pRootSignature->pDescriptorManagerMap)
+		for (uint32_t i = 0; i <= MAX_THREAD_SLOTS; ++i)
 		{
-			remove_descriptor_manager(pRenderer, pRootSignature, it.second);
+			if (pRootSignature->pDescriptorManagers[i])
+				remove_descriptor_manager(pRenderer, pRootSignature, pRootSignature->pDescriptorManagers[i]);
 		}
 
-		pRootSignature->pDescriptorManagerMap.~unordered_map();
-
 		SAFE_RELEASE(pRootSignature->pDxRootSignature);
 		SAFE_RELEASE(pRootSignature->pDxSerializedRootSignatureString);
 
@@ -3629,7 +3644,7 @@ namespace RENDERER_CPP_NAMESPACE {
 			SAFE_FREE((void*)pRootSignature->pDescriptors[i].mDesc.name);
 		}
 
-		pRootSignature->pDescriptorNameToIndexMap.~unordered_map();
+		pRootSignature->pDescriptorNameToIndexMap.~flat_hash_map();
 
 		SAFE_FREE(pRootSignature->pDescriptors);
 		SAFE_FREE(pRootSignature->pViewTableLayouts);
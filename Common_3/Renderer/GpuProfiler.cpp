@@ -160,6 +160,8 @@ void addGpuProfiler(Renderer* pRenderer, Queue* pQueue, GpuProfiler** ppGpuProfi
 
 	pGpuProfiler->mMaxTimerCount = maxTimers;
 	pGpuProfiler->pGpuTimerPool = (GpuTimerTree*)conf_calloc(maxTimers, sizeof(*pGpuProfiler->pGpuTimerPool));
+	// The calloc'd map is a valid empty map, size it once for all timers
+	pGpuProfiler->mGpuPoolHash.reserve(maxTimers);
 	pGpuProfiler->pCurrentNode = &pGpuProfiler->mRoot;
 
 	*ppGpuProfiler = pGpuProfiler;
@@ -182,7 +184,7 @@ void removeGpuProfiler(Renderer* pRenderer, GpuProfiler* pGpuProfiler)
 	}
 
 	pGpuProfiler->mRoot.mChildren.~vector();
-	pGpuProfiler->mGpuPoolHash.~unordered_map();
+	pGpuProfiler->mGpuPoolHash.~flat_hash_map();
 
 	conf_free(pGpuProfiler->pGpuTimerPool);
 	conf_free(pGpuProfiler);
@@ -198,11 +200,12 @@ void cmdBeginGpuTimestampQuery(Cmd* pCmd, struct GpuProfiler* pGpuProfiler, cons
 	uint32_t hash = tinystl::hash(buffer);
 
 	GpuTimerTree* node = nullptr;
-	if (pGpuProfiler->mGpuPoolHash.find(hash) == pGpuProfiler->mGpuPoolHash.end())
+	tinystl::pair<tinystl::flat_hash_map<uint32_t, uint32_t>::iterator, bool> poolEntry =
+		pGpuProfiler->mGpuPoolHash.insert({ hash, pGpuProfiler->mCurrentPoolIndex });
+	if (poolEntry.second)
 	{
 		// frist time seeing this
 		node = &pGpuProfiler->pGpuTimerPool[pGpuProfiler->mCurrentPoolIndex];
-		pGpuProfiler->mGpuPoolHash[hash] = pGpuProfiler->mCurrentPoolIndex;
 
 		++pGpuProfiler->mCurrentPoolIndex;
 
@@ -213,8 +216,7 @@ void cmdBeginGpuTimestampQuery(Cmd* pCmd, struct GpuProfiler* pGpuProfiler, cons
 	}
 	else
 	{
-		uint32_t index = pGpuProfiler->mGpuPoolHash[hash];
-		node = &pGpuProfiler->pGpuTimerPool[index];
+		node = &pGpuProfiler->pGpuTimerPool[poolEntry.first->second];
 	}
 
 	// Record gpu time
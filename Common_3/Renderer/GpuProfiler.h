@@ -64,7 +64,7 @@ typedef struct GpuProfiler
 	uint32_t		mCurrentTimerCount;
 	uint32_t		mCurrentPoolIndex;
 
-	tinystl::unordered_map<uint32_t, uint32_t> mGpuPoolHash;
+	tinystl::flat_hash_map<uint32_t, uint32_t> mGpuPoolHash;
 	GpuTimerTree*	pGpuTimerPool;
 	GpuTimerTree	mRoot;
 	GpuTimerTree*	pCurrentNode;
@@ -55,6 +55,7 @@
 #include "../ThirdParty/OpenSource/TinySTL/string.h"
 #include "../ThirdParty/OpenSource/TinySTL/vector.h"
 #include "../ThirdParty/OpenSource/TinySTL/unordered_map.h"
+#include "../ThirdParty/OpenSource/TinySTL/flat_hash_map.h"
 #include "../OS/Interfaces/IOperatingSystem.h"
 #include "../OS/Interfaces/IThread.h"
 
@@ -976,7 +977,7 @@ typedef struct RootSignature
 	/// Array of all descriptors declared in the root signature layout
 	DescriptorInfo*								pDescriptors;
 	/// Translates hash of descriptor name to descriptor index
-	tinystl::unordered_map<uint32_t, uint32_t>	pDescriptorNameToIndexMap;
+	tinystl::flat_hash_map<uint32_t, uint32_t>	pDescriptorNameToIndexMap;
 
 	/// Number of root constants in the root signature
 	uint32_t									mRootConstantCount;
@@ -1003,10 +1004,9 @@ typedef struct RootSignature
 #elif defined(METAL)
 #endif
 
-	using ThreadLocalDescriptorManager = tinystl::unordered_map<ThreadID, struct DescriptorManager*>;
-
-	/// Api specific binding manager
-	ThreadLocalDescriptorManager				pDescriptorManagerMap;
+	/// Api specific binding manager of each thread, indexed by Thread::GetCurrentThreadSlot.
+	/// Threads without a slot share the last one.
+	struct DescriptorManager*					pDescriptorManagers[MAX_THREAD_SLOTS + 1];
 } RootSignature;
 
 typedef struct DescriptorData
@@ -1014,6 +1014,7 @@ typedef struct DescriptorData
     //TODO: Remove constructor to keep C-Style interface
     DescriptorData() :
 			pName(NULL),
+			mNameHash(0),
 			mIndex((uint32_t)-1),
 			mCount(1),
             mOffset(0),
@@ -1022,7 +1023,9 @@ typedef struct DescriptorData
 	/// User can either set name of descriptor or index (index in pRootSignature->pDescriptors array)
     /// Name of descriptor
     const char*     pName;
-	/// Index of descriptor
+	/// Hash of pName from getDescriptorNameHash, looked up instead of hashing pName on every bind if non zero
+	uint32_t		mNameHash;
+	/// Index of descriptor from getDescriptorIndexFromName, takes precedence over the name if set
 	uint32_t		mIndex;
     /// Number of resources in the descriptor(applies to array of textures, buffers,...)
     uint32_t        mCount;
@@ -1043,6 +1046,24 @@ typedef struct DescriptorData
     };
 } DescriptorData;
 
+/// Hash of a descriptor name as stored in RootSignature::pDescriptorNameToIndexMap
+inline uint32_t getDescriptorNameHash(const char* pName)
+{
+	return getNameId(pName);
+}
+
+/// Index in pRootSignature->pDescriptors of the descriptor pParam refers to, by mIndex, else by mNameHash, else by pName.
+/// Returns -1 if there is no such descriptor.
+inline uint32_t findDescriptorIndex(const RootSignature* pRootSignature, const DescriptorData* pParam)
+{
+	if (pParam->mIndex != (uint32_t)-1)
+		return pParam->mIndex < pRootSignature->mDescriptorCount ? pParam->mIndex : (uint32_t)-1;
+
+	const uint32_t hash = pParam->mNameHash ? pParam->mNameHash : getDescriptorNameHash(pParam->pName);
+	tinystl::flat_hash_map<uint32_t, uint32_t>::const_iterator it = pRootSignature->pDescriptorNameToIndexMap.find(hash);
+	return it != pRootSignature->pDescriptorNameToIndexMap.end() ? it->second : (uint32_t)-1;
+}
+
 typedef struct CmdPoolDesc
 {
 	CmdPoolType mCmdPoolType;
@@ -1210,6 +1231,9 @@ typedef struct BinaryShaderStageDesc
 	/// Entry point is needed for Metal
 	tinystl::string			mEntryPoint;
 #endif
+	/// Optional reflection of the byte code written by serializeReflection. The byte code is reflected if it is NULL
+	const char*				pReflection;
+	uint32_t				mReflectionSize;
 } BinaryShaderStageDesc;
 
 typedef struct BinaryShaderDesc
@@ -1657,6 +1681,8 @@ ApiExport void removeShader(Renderer* pRenderer, Shader* p_shader_program);
 
 // pipeline functions
 ApiExport void addRootSignature(Renderer* pRenderer, uint32_t num_shaders, Shader* const* pp_shaders, RootSignature** pp_root_signature, const RootSignatureDesc* pRootDesc = NULL);
+/// Returns the index of a descriptor in pRootSignature->pDescriptors to set in DescriptorData::mIndex, or -1 if there is no descriptor with this name
+ApiExport uint32_t getDescriptorIndexFromName(const RootSignature* pRootSignature, const char* pName);
 ApiExport void removeRootSignature(Renderer* pRenderer, RootSignature* pRootSignature);
 ApiExport void addPipeline(Renderer* pRenderer, const GraphicsPipelineDesc* p_pipeline_settings, Pipeline** pp_pipeline);
 ApiExport void addComputePipeline(Renderer* pRenderer, const ComputePipelineDesc* p_pipeline_settings, Pipeline** p_pipeline);
@@ -30,6 +30,8 @@
 namespace confetti {
    class File;
 }
+class Serializer;
+class Deserializer;
 
 static const uint32_t MAX_SHADER_STAGE_COUNT = 5;
 
@@ -151,5 +153,14 @@ void destroyShaderReflection(ShaderReflection* pReflection);
 void createPipelineReflection(ShaderReflection* pReflection, uint32_t stageCount, PipelineReflection* pOutReflection);
 void destroyPipelineReflection(PipelineReflection* pReflection);
 
-//void serializeReflection(File* pInFile, Reflection* pReflection);
-//void deserializeReflection(File* pOutFile, Reflection* pReflection);
+// Compact binary form of a stage reflection, so it can be stored with the byte code instead of reflecting the byte code on every load.
+// Names are written as offsets into the name pool.
+uint32_t getSerializedReflectionSize(const ShaderReflection* pReflection);
+bool serializeReflection(Serializer* pOutFile, const ShaderReflection* pReflection);
+// Returns false and leaves pOutReflection empty if the data is not a complete reflection of this version
+bool deserializeReflection(Deserializer* pInFile, ShaderReflection* pOutReflection);
+
+#ifndef METAL
+// Deserializes pReflection if it is a reflection of shaderStage, reflects the byte code otherwise. pReflection may be NULL
+void loadShaderReflection(const uint8_t* shaderCode, uint32_t shaderSize, const void* pReflection, uint32_t reflectionSize, ShaderStage shaderStage, ShaderReflection* pOutReflection);
+#endif
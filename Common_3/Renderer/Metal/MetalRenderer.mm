@@ -240,7 +240,11 @@ namespace RENDERER_CPP_NAMESPACE {
         MTLPixelFormatInvalid, // GNF_BC4 = 75,
         MTLPixelFormatInvalid, // GNF_BC5 = 76,
         MTLPixelFormatInvalid, // GNF_BC6 = 77,
+#ifndef TARGET_IOS
+        MTLPixelFormatBC7_RGBAUnorm, // GNF_BC7 = 78,
+#else
         MTLPixelFormatInvalid, // GNF_BC7 = 78,
+#endif
         // Reveser Form
         MTLPixelFormatBGRA8Unorm, // BGRA8 = 79,
         // Extend for DXGI
@@ -402,7 +406,7 @@ namespace RENDERER_CPP_NAMESPACE {
     using DescriptorMap = tinystl::unordered_map<uint64_t, DescriptorInfo>;
     using ConstDescriptorMapIterator = tinystl::unordered_map<uint64_t, DescriptorInfo>::const_iterator;
     using DescriptorMapNode = tinystl::unordered_hash_node<uint64_t, DescriptorInfo>;
-    using DescriptorNameToIndexMap = tinystl::unordered_map<uint32_t, uint32_t>;
+    using DescriptorNameToIndexMap = tinystl::flat_hash_map<uint32_t, uint32_t>;
     
     typedef struct DescriptorManager
     {
@@ -417,8 +421,6 @@ namespace RENDERER_CPP_NAMESPACE {
         tinystl::unordered_map<uint32_t, tinystl::pair<Buffer*, bool>>                  mArgumentBuffers;
     } DescriptorManager;
     
-    Mutex gDescriptorMutex;
-    
     void add_descriptor_manager(Renderer* pRenderer, RootSignature* pRootSignature, DescriptorManager** ppManager)
     {
         DescriptorManager* pManager = (DescriptorManager*)conf_calloc(1, sizeof(*pManager));
@@ -490,40 +492,55 @@ namespace RENDERER_CPP_NAMESPACE {
         SAFE_FREE(pManager);
     }
     
+    // Threads without a thread slot share the descriptor manager at MAX_THREAD_SLOTS of each root signature and bind one at a time
+    static Mutex gSharedDescriptorMutex;
+
+    /// Holds gSharedDescriptorMutex while a thread without a thread slot uses the shared descriptor manager
+    struct SharedDescriptorLock
+    {
+        SharedDescriptorLock(uint32_t slot) : mShared(slot >= MAX_THREAD_SLOTS) { if (mShared) gSharedDescriptorMutex.Acquire(); }
+        ~SharedDescriptorLock() { if (mShared) gSharedDescriptorMutex.Release(); }
+        bool mShared;
+    };
+
     // This function returns the descriptor manager belonging to this thread
     // If a descriptor manager does not exist for this thread, a new one is created
-    // With this approach we make sure that descriptor binding is thread safe and lock conf_free at the same time
-    DescriptorManager* get_descriptor_manager(Renderer* pRenderer, RootSignature* pRootSignature)
+    // Managers are indexed by the thread slot and only the thread owning a slot writes it, so binding needs neither a lookup nor a lock.
+    // Threads without a slot get the shared manager and have to hold a SharedDescriptorLock while they use it.
+    DescriptorManager* get_descriptor_manager(Renderer* pRenderer, RootSignature* pRootSignature, uint32_t slot)
     {
-        tinystl::unordered_hash_node<ThreadID, DescriptorManager*>* pNode = pRootSignature->pDescriptorManagerMap.find(Thread::GetCurrentThreadID()).node;
-        if (pNode == NULL)
+        DescriptorManager* pManager = pRootSignature->pDescriptorManagers[slot];
+        if (!pManager)
         {
-            // Only need a lock when creating a new descriptor manager for this thread
-            MutexLock lock(gDescriptorMutex);
-            DescriptorManager* pManager = NULL;
+            if (slot >= MAX_THREAD_SLOTS)
+                LOGERROR("All thread slots are taken, threads without one bind through a shared descriptor manager under a lock");
             add_descriptor_manager(pRenderer, pRootSignature, &pManager);
-            pRootSignature->pDescriptorManagerMap.insert({ Thread::GetCurrentThreadID(), pManager });
-            return pManager;
-        }
-        else
-        {
-            return pNode->second;
+            pRootSignature->pDescriptorManagers[slot] = pManager;
         }
+        return pManager;
     }
-    
-    const DescriptorInfo* get_descriptor(const RootSignature* pRootSignature, const char* pResName, uint32_t* pIndex)
+
+    uint32_t getDescriptorIndexFromName(const RootSignature* pRootSignature, const char* pName)
     {
-        DescriptorNameToIndexMap::const_iterator it = pRootSignature->pDescriptorNameToIndexMap.find(tinystl::hash(pResName));
-        if (it.node)
-        {
-            *pIndex = it.node->second;
-            return &pRootSignature->pDescriptors[it.node->second];
-        }
-        else
+        DescriptorNameToIndexMap::const_iterator it = pRootSignature->pDescriptorNameToIndexMap.find(tinystl::hash(pName));
+        return it != pRootSignature->pDescriptorNameToIndexMap.end() ? it->second : (uint32_t)-1;
+    }
+
+    // Descriptors are found by index if the param has one, otherwise by the precomputed hash of the name or by the name
+    const DescriptorInfo* get_descriptor(const RootSignature* pRootSignature, const DescriptorData* pParam, uint32_t* pIndex)
+    {
+        const uint32_t index = findDescriptorIndex(pRootSignature, pParam);
+        if (index == (uint32_t)-1)
         {
-            LOGERRORF("Invalid descriptor param (%s)", pResName);
+            if (pParam->mIndex != (uint32_t)-1)
+                LOGERRORF("Invalid descriptor index (%u)", pParam->mIndex);
+            else
+                LOGERRORF("Invalid descriptor param (%s)", pParam->pName ? pParam->pName : "");
             return NULL;
         }
+
+        *pIndex = index;
+        return &pRootSignature->pDescriptors[index];
     }
     
     void reset_bound_resources(DescriptorManager* pManager)
@@ -576,13 +593,24 @@ namespace RENDERER_CPP_NAMESPACE {
         }
     }
     
+    // Resets the bound resources of the descriptor manager of this thread if it has one
+    void reset_thread_bound_resources(const RootSignature* pRootSignature)
+    {
+        const uint32_t slot = Thread::GetCurrentThreadSlot();
+        SharedDescriptorLock lock(slot);
+        DescriptorManager* pManager = pRootSignature->pDescriptorManagers[slot];
+        if (pManager) reset_bound_resources(pManager);
+    }
+    
     void cmdBindDescriptors(Cmd* pCmd, RootSignature* pRootSignature, uint32_t numDescriptors, DescriptorData* pDescParams)
     {
         ASSERT(pCmd);
         ASSERT(pRootSignature);
         
         Renderer* pRenderer = pCmd->pCmdPool->pRenderer;
-        DescriptorManager* pManager = get_descriptor_manager(pRenderer, pRootSignature);
+        const uint32_t slot = Thread::GetCurrentThreadSlot();
+        SharedDescriptorLock lock(slot);
+        DescriptorManager* pManager = get_descriptor_manager(pRenderer, pRootSignature, slot);
         
         // Compare the currently bound root signature with the root signature of the descriptor manager
         // If these values dont match, we must bind the root signature of the descriptor manager
@@ -599,20 +627,19 @@ namespace RENDERER_CPP_NAMESPACE {
         {
             const DescriptorData* pParam = &pDescParams[paramIdx];
             ASSERT(pParam);
-            if (!pParam->pName)
+            if (!pParam->pName && !pParam->mNameHash && pParam->mIndex == (uint32_t)-1)
             {
                 LOGERRORF("Name of Descriptor at index (%u) is NULL", paramIdx);
                 return;
             }
             
-            uint32_t hash = tinystl::hash(pParam->pName);
             uint32_t descIndex = -1;
-            const DescriptorInfo* pDesc = get_descriptor(pRootSignature, pParam->pName, &descIndex);
+            const DescriptorInfo* pDesc = get_descriptor(pRootSignature, pParam, &descIndex);
             if (!pDesc)
                 continue;
             
             // Replace the default DescriptorData by the new data pased into this function.
-            pManager->pDescriptorDataArray[descIndex].pName = pParam->pName;
+            pManager->pDescriptorDataArray[descIndex].pName = pDesc->mDesc.name;
             pManager->pDescriptorDataArray[descIndex].mIndex = pParam->mIndex;
             pManager->pDescriptorDataArray[descIndex].mCount = pParam->mCount;
             pManager->pDescriptorDataArray[descIndex].mOffset = pParam->mOffset;
@@ -621,21 +648,21 @@ namespace RENDERER_CPP_NAMESPACE {
                 case DESCRIPTOR_TYPE_RW_TEXTURE:
                 case DESCRIPTOR_TYPE_TEXTURE:
                     if (!pParam->ppTextures) {
-                        LOGERRORF("Texture descriptor (%s) is NULL", pParam->pName);
+                        LOGERRORF("Texture descriptor (%s) is NULL", pDesc->mDesc.name);
                         return;
                     }
                     pManager->pDescriptorDataArray[descIndex].ppTextures = pParam->ppTextures;
                     break;
                 case DESCRIPTOR_TYPE_SAMPLER:
                     if (!pParam->ppSamplers) {
-                        LOGERRORF("Sampler descriptor (%s) is NULL", pParam->pName);
+                        LOGERRORF("Sampler descriptor (%s) is NULL", pDesc->mDesc.name);
                         return;
                     }
                     pManager->pDescriptorDataArray[descIndex].ppSamplers = pParam->ppSamplers;
                     break;
                 case DESCRIPTOR_TYPE_ROOT_CONSTANT:
                     if (!pParam->pRootConstant) {
-                        LOGERRORF("RootConstant array (%s) is NULL", pParam->pName);
+                        LOGERRORF("RootConstant array (%s) is NULL", pDesc->mDesc.name);
                         return;
                     }
                     pManager->pDescriptorDataArray[descIndex].pRootConstant = pParam->pRootConstant;
@@ -644,13 +671,17 @@ namespace RENDERER_CPP_NAMESPACE {
                 case DESCRIPTOR_TYPE_RW_BUFFER:
                 case DESCRIPTOR_TYPE_BUFFER:
                     if (!pParam->ppBuffers) {
-                        LOGERRORF("Buffer descriptor (%s) is NULL", pParam->pName);
+                        LOGERRORF("Buffer descriptor (%s) is NULL", pDesc->mDesc.name);
                         return;
                     }
                     pManager->pDescriptorDataArray[descIndex].ppBuffers = pParam->ppBuffers;
                     
                     // In case we're binding an argument buffer, signal that we need to re-encode the resources into the buffer.
-                    if(pParam->mCount > 1 && pManager->mArgumentBuffers.find(hash).node) pManager->mArgumentBuffers[hash].second = true;
+                    if(pParam->mCount > 1)
+                    {
+                        uint32_t hash = tinystl::hash(pDesc->mDesc.name);
+                        if (pManager->mArgumentBuffers.find(hash).node) pManager->mArgumentBuffers[hash].second = true;
+                    }
                     
                     break;
                 default: break;
@@ -1398,7 +1429,7 @@ namespace RENDERER_CPP_NAMESPACE {
         RootSignature* pRootSignature = (RootSignature*)conf_calloc(1, sizeof(*pRootSignature));
         tinystl::vector<ShaderResource const*> shaderResources;
         
-        conf_placement_new<tinystl::unordered_map<uint32_t, uint32_t>>(&pRootSignature->pDescriptorNameToIndexMap);
+        conf_placement_new<tinystl::flat_hash_map<uint32_t, uint32_t>>(&pRootSignature->pDescriptorNameToIndexMap);
         
         // Collect all unique shader resources in the given shaders
         // Resources are parsed by name (two resources named "XYZ" in two shaders will be considered the same resource)
@@ -1416,10 +1447,10 @@ namespace RENDERER_CPP_NAMESPACE {
                 ShaderResource const* pRes = &pReflection->pShaderResources[i];
                 
                 // Find all unique resources
-                tinystl::unordered_hash_node<uint32_t, uint32_t>* pNode = pRootSignature->pDescriptorNameToIndexMap.find(tinystl::hash(pRes->name)).node;
-                if (!pNode)
+                const NameId nameId = internName(pRes->name);
+                if (pRootSignature->pDescriptorNameToIndexMap.find(nameId) == pRootSignature->pDescriptorNameToIndexMap.end())
                 {
-                    pRootSignature->pDescriptorNameToIndexMap.insert({ tinystl::hash(pRes->name), (uint32_t)shaderResources.size() });
+                    pRootSignature->pDescriptorNameToIndexMap.insert({ nameId, (uint32_t)shaderResources.size() });
                     shaderResources.emplace_back(pRes);
                 }
             }
@@ -1463,23 +1494,22 @@ namespace RENDERER_CPP_NAMESPACE {
         }
         
         // Create descriptor manager for this thread.
-        DescriptorManager* pManager = NULL;
-        add_descriptor_manager(pRenderer, pRootSignature, &pManager);
-        pRootSignature->pDescriptorManagerMap.insert({ Thread::GetCurrentThreadID(), pManager });
+        const uint32_t slot = Thread::GetCurrentThreadSlot();
+        if (slot < MAX_THREAD_SLOTS)
+            get_descriptor_manager(pRenderer, pRootSignature, slot);
         
         *ppRootSignature = pRootSignature;
     }
     
     void removeRootSignature(Renderer* pRenderer, RootSignature* pRootSignature)
     {
-        for (tinystl::unordered_hash_node<ThreadID, DescriptorManager*>& it : pRootSignature->pDescriptorManagerMap)
+        for (uint32_t i = 0; i <= MAX_THREAD_SLOTS; ++i)
         {
-            remove_descriptor_manager(pRenderer, pRootSignature, it.second);
+            if (pRootSignature->pDescriptorManagers[i])
+                remove_descriptor_manager(pRenderer, pRootSignature, pRootSignature->pDescriptorManagers[i]);
         }
         
-        pRootSignature->pDescriptorManagerMap.~unordered_map();
-        
-        pRootSignature->pDescriptorNameToIndexMap.~unordered_map();
+        pRootSignature->pDescriptorNameToIndexMap.~flat_hash_map();
         
         SAFE_FREE(pRootSignature);
     }
@@ -1835,8 +1865,7 @@ namespace RENDERER_CPP_NAMESPACE {
         // Reset the bound resources flags for the current root signature's descriptor manager.
         if(pCmd->pBoundRootSignature)
         {
-            const tinystl::unordered_hash_node<ThreadID, DescriptorManager*>* pNode = pCmd->pBoundRootSignature->pDescriptorManagerMap.find(Thread::GetCurrentThreadID()).node;
-            if (pNode) reset_bound_resources(pNode->second);
+            reset_thread_bound_resources(pCmd->pBoundRootSignature);
         }
     }
     
@@ -1950,8 +1979,8 @@ namespace RENDERER_CPP_NAMESPACE {
         ASSERT(pCmd);
         
         // Reset the bound resources flags for the current root signature's descriptor manager.
-        const tinystl::unordered_hash_node<ThreadID, DescriptorManager*>* pNode = pCmd->pBoundRootSignature->pDescriptorManagerMap.find(Thread::GetCurrentThreadID()).node;
-        if (pNode) reset_bound_resources(pNode->second);
+        if (pCmd->pBoundRootSignature)
+            reset_thread_bound_resources(pCmd->pBoundRootSignature);
 
         @autoreleasepool {
             util_end_current_encoders(pCmd);
@@ -2309,39 +2338,44 @@ namespace RENDERER_CPP_NAMESPACE {
         util_end_current_encoders(pCmd);
         pCmd->mtlBlitEncoder = [pCmd->mtlCommandBuffer blitCommandEncoder];
         
-        uint nLayers = pTexture->mDesc.mArraySize;
         uint nFaces = pTexture->mDesc.mType == TEXTURE_TYPE_CUBE ? 6 : 1;
         uint nMips = pTexture->mDesc.mMipLevels;
         
+        // pSubresources holds numSubresources entries starting at startSubresource, ordered by layer, face and mip
         uint32_t subresourceOffset = 0;
-        for (uint32_t layer = 0; layer < nLayers; ++layer)
-        {
-            for (uint32_t face = 0; face < nFaces; ++face)
+        for (uint32_t i = 0; i < numSubresources; ++i)
+        {
+            uint32_t subresource = startSubresource + i;
+            uint32_t mip = subresource % nMips;
+            uint32_t face = (subresource / nMips) % nFaces;
+            uint32_t layer = subresource / (nMips * nFaces);
+            SubresourceDataDesc* pRes = &pSubresources[i];
+            uint32_t mipmapWidth = max(pTexture->mDesc.mWidth >> mip, 1);
+            uint32_t mipmapHeight = max(pTexture->mDesc.mHeight >> mip, 1);
+            
+            // Data which already is in the intermediate buffer is copied from where it is, the rest is copied to it first.
+            uint64_t sourceOffset = (const uint8_t*)pRes->pData - (const uint8_t*)pIntermediate->pCpuMappedAddress;
+            if ((const uint8_t*)pRes->pData >= (const uint8_t*)pIntermediate->pCpuMappedAddress && sourceOffset < pIntermediate->mDesc.mSize)
             {
-                for (uint32_t mip = 0; mip < nMips; ++mip)
-                {
-                    SubresourceDataDesc* pRes = &pSubresources[(layer * nFaces * nMips) + (face * nMips) + mip];
-                    uint32_t mipmapWidth = max(pTexture->mDesc.mWidth >> mip, 1);
-                    uint32_t mipmapHeight = max(pTexture->mDesc.mHeight >> mip, 1);
-                    
-                    // Copy the data for this resource to an intermediate buffer.
-                    memcpy((uint8_t*)pIntermediate->pCpuMappedAddress + intermediateOffset + subresourceOffset, pRes->pData, pRes->mSlicePitch);
-                    
-                    // Copy to the texture's final subresource.
-                    [pCmd->mtlBlitEncoder copyFromBuffer:pIntermediate->mtlBuffer
-                                            sourceOffset:intermediateOffset + subresourceOffset
-                                       sourceBytesPerRow:pRes->mRowPitch
-                                     sourceBytesPerImage:pRes->mSlicePitch
-                                              sourceSize:MTLSizeMake(mipmapWidth, mipmapHeight, 1)
-                                               toTexture:pTexture->mtlTexture
-                                        destinationSlice:layer * nFaces + face
-                                        destinationLevel:mip
-                                       destinationOrigin:MTLOriginMake(0, 0, 0)];
-                    
-                    // Increase the subresource offset.
-                    subresourceOffset += pRes->mSlicePitch;
-                }
+                sourceOffset += pIntermediate->mPositionInHeap;
             }
+            else
+            {
+                sourceOffset = intermediateOffset + subresourceOffset;
+                memcpy((uint8_t*)pIntermediate->pCpuMappedAddress + sourceOffset, pRes->pData, pRes->mSlicePitch);
+                subresourceOffset += pRes->mSlicePitch;
+            }
+            
+            // Copy to the texture's final subresource.
+            [pCmd->mtlBlitEncoder copyFromBuffer:pIntermediate->mtlBuffer
+                                    sourceOffset:sourceOffset
+                               sourceBytesPerRow:pRes->mRowPitch
+                             sourceBytesPerImage:pRes->mSlicePitch
+                                      sourceSize:MTLSizeMake(mipmapWidth, mipmapHeight, 1)
+                                       toTexture:pTexture->mtlTexture
+                                destinationSlice:layer * nFaces + face
+                                destinationLevel:mip
+                               destinationOrigin:MTLOriginMake(0, 0, 0)];
         }
     }
     
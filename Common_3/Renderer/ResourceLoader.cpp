@@ -24,6 +24,8 @@
 
 #include "IRenderer.h"
 #include "ResourceLoader.h"
+#include "StagingRing.h"
+#include "ShaderCache.h"
 #include "../OS/Interfaces/ILogManager.h"
 #include "../OS/Interfaces/IMemoryManager.h"
 
@@ -49,12 +51,26 @@ extern void cmdUpdateSubresources(Cmd* pCmd, uint32_t startSubresource, uint32_t
 #define RESOURCE_BUFFER_ALIGNMENT 4U
 #if defined(DIRECT3D12)
 #define RESOURCE_TEXTURE_ALIGNMENT 512U
+#define RESOURCE_TEXTURE_ROW_ALIGNMENT 256U
 #else
 #define RESOURCE_TEXTURE_ALIGNMENT 16U
+#define RESOURCE_TEXTURE_ROW_ALIGNMENT 1U
 #endif
-
-#define MAX_LOAD_THREADS 3U
-#define MAX_COPY_THREADS 1U
+// The staging budget is split into this many pages, each one is created on first use
+#define RESOURCE_STAGING_PAGE_COUNT 4U
+#define RESOURCE_STAGING_PAGE_ALIGNMENT 65536U
+#define RESOURCE_STAGING_MIN_CHUNK_SIZE 65536U
+
+// Number of copy submissions that can be in flight at the same time
+#define MAX_COPY_BATCHES 3U
+
+// Capacity of the queues of the threaded loading pipeline: requests waiting to be read, mapped texture files per
+// decode thread and requests waiting for their upload. Decoded images are held in memory until they are uploaded.
+#define RESOURCE_READ_QUEUE_SIZE 1024U
+#define RESOURCE_DECODE_QUEUE_SIZE_PER_THREAD 2U
+#define RESOURCE_UPLOAD_QUEUE_SIZE 16U
+// Stride the read stage touches mapped texture files with to fault them in
+#define RESOURCE_READ_PAGE_SIZE 4096U
 //////////////////////////////////////////////////////////////////////////
 // Resource Loader Structures
 //////////////////////////////////////////////////////////////////////////
@@ -66,28 +82,91 @@ typedef struct MappedMemoryRange
 	uint64_t mSize;
 } MappedMemoryRange;
 
+typedef struct CopyBatch
+{
+	Cmd* pCmd;
+	Fence* pFence;
+	/// Token of the submission this batch is in flight as, 0 if the GPU is done with it
+	SyncToken mToken;
+
+	tinystl::vector<Buffer*> mTempStagingBuffers;
+
+	bool mRecording;
+} CopyBatch;
+
 typedef struct ResourceLoader
 {
 	Renderer* pRenderer;
-	Buffer* pStagingBuffer;
-	uint64_t mCurrentPos;
-
-	Cmd* pCopyCmd;
-	Cmd* pBatchCopyCmd;
+	Queue* pQueue;
 	CmdPool* pCopyCmdPool;
 
-	tinystl::vector<Buffer*> mTempStagingBuffers;
+	/// One upload buffer per page of the staging ring, NULL until the ring first hands out memory from it
+	StagingRing mStagingRing;
+	Buffer** ppStagingPages;
+	uint64_t mTempStagingSize;
+
+	/// Batches are recorded and submitted in ring order, mActiveBatch is the one currently recording
+	CopyBatch mBatches[MAX_COPY_BATCHES];
+	uint32_t mActiveBatch;
 
-    bool mOpen = false;
+	/// Token of the last submitted batch and of the last batch the GPU finished
+	SyncToken mSubmittedToken;
+	SyncToken mCompletedToken;
 } ResourceLoader;
 
-typedef struct ResourceThread
+/// Threaded load on its way through the pipeline
+typedef struct ResourceLoadRequest
 {
-	Renderer* pRenderer;
-	ResourceLoader* pLoader;
-	WorkItem* pItem;
-	uint64_t mMemoryBudget;
-} ResourceThread;
+	ResourceLoadRequest(const ResourceLoadDesc& desc) : mDesc(desc), pStagingBuffer(NULL), mDecoded(false) {}
+
+	ResourceLoadDesc mDesc;
+	/// Texture file mapped by the read stage, closed once the decode stage is done with it
+	MappedFile mFile;
+	/// Decoded by the decode stage, destroyed once the upload stage recorded its copies
+	Image mImage;
+	/// Upload buffer the decode stage decoded mImage into, handed to the copy batch that reads from it
+	Buffer* pStagingBuffer;
+	bool mDecoded;
+} ResourceLoadRequest;
+
+/// Bounded queue in front of a pipeline stage and the counters of the stage. Producers block while the queue is
+/// full and consumers while it is empty, so no stage runs further ahead of the next one than the queue in between.
+typedef struct LoadStage
+{
+	ResourceLoadRequest** ppQueue;
+	uint32_t mCapacity;
+	uint32_t mHead;
+	uint32_t mCount;
+	uint32_t mMaxCount;
+	bool mClosed;
+	Mutex mMutex;
+	ConditionVariable mNotEmpty;
+	ConditionVariable mNotFull;
+
+	uint32_t mThreadCount;
+	tfrg_atomic32_t mRequestCount;
+	/// Microseconds spent working, waiting for input and waiting for room in the queue of the next stage
+	tfrg_atomic64_t mBusyTime;
+	tfrg_atomic64_t mInputWaitTime;
+	tfrg_atomic64_t mOutputWaitTime;
+} LoadStage;
+
+/// One thread reads texture files, the decode threads turn them into images and one thread records the uploads
+/// of all threaded requests into the copy batches of the main loader
+typedef struct ResourceLoadPipeline
+{
+	LoadStage mStages[RESOURCE_LOAD_STAGE_COUNT];
+	ThreadPool* pThreadPool;
+	WorkItem* pItems;
+	JobCounter mThreadCounter;
+
+	/// Requests which were added and are not recorded into a copy batch yet
+	uint32_t mPendingRequests;
+	Mutex mPendingMutex;
+	ConditionVariable mIdleCondition;
+	/// Time the pipeline last went from idle to busy, waiting for input before that doesn't count towards the stats
+	tfrg_atomic64_t mBusyStartTime;
+} ResourceLoadPipeline;
 //////////////////////////////////////////////////////////////////////////
 // Resource Loader Internal Functions
 //////////////////////////////////////////////////////////////////////////
@@ -95,43 +174,139 @@ static void addResourceLoader (Renderer* pRenderer, uint64_t mSize, ResourceLoad
 {
 	ResourceLoader* pLoader = conf_placement_new< ResourceLoader >( conf_calloc(1, sizeof(*pLoader)) );
 	pLoader->pRenderer = pRenderer;
+	pLoader->pQueue = pCopyQueue;
 
-	BufferDesc bufferDesc = {};
-	bufferDesc.mUsage = BUFFER_USAGE_UPLOAD;
-	bufferDesc.mSize = mSize;
-	bufferDesc.mMemoryUsage = RESOURCE_MEMORY_USAGE_CPU_ONLY;
-	bufferDesc.mFlags = BUFFER_CREATION_FLAG_OWN_MEMORY_BIT | BUFFER_CREATION_FLAG_PERSISTENT_MAP_BIT;
-	addBuffer (pRenderer, &bufferDesc, &pLoader->pStagingBuffer);
+	const uint64_t pageSize = round_up_64(max(mSize / RESOURCE_STAGING_PAGE_COUNT, (uint64_t)1), RESOURCE_STAGING_PAGE_ALIGNMENT);
+	initStagingRing(&pLoader->mStagingRing, pageSize, RESOURCE_STAGING_PAGE_COUNT);
+	pLoader->ppStagingPages = (Buffer**)conf_calloc(RESOURCE_STAGING_PAGE_COUNT, sizeof(Buffer*));
 
 	addCmdPool(pLoader->pRenderer, pCopyQueue, false, &pLoader->pCopyCmdPool);
-	addCmd(pLoader->pCopyCmdPool, false, &pLoader->pCopyCmd);
-	addCmd(pLoader->pCopyCmdPool, false, &pLoader->pBatchCopyCmd);
+
+	for (uint32_t i = 0; i < MAX_COPY_BATCHES; ++i)
+	{
+		CopyBatch* pBatch = &pLoader->mBatches[i];
+		addCmd(pLoader->pCopyCmdPool, false, &pBatch->pCmd);
+		addFence(pRenderer, &pBatch->pFence);
+	}
 
 	*ppLoader = pLoader;
 }
 
-static void cleanupResourceLoader(ResourceLoader* pLoader)
+static void cleanupCopyBatch(ResourceLoader* pLoader, CopyBatch* pBatch)
 {
-	for (uint32_t i = 0; i < (uint32_t)pLoader->mTempStagingBuffers.size(); ++i)
-		removeBuffer(pLoader->pRenderer, pLoader->mTempStagingBuffers[i]);
+	for (uint32_t i = 0; i < (uint32_t)pBatch->mTempStagingBuffers.size(); ++i)
+		removeBuffer(pLoader->pRenderer, pBatch->mTempStagingBuffers[i]);
 
-	pLoader->mTempStagingBuffers.clear();
+	pBatch->mTempStagingBuffers.clear();
 }
 
 static void removeResourceLoader (ResourceLoader* pLoader)
 {
-	removeBuffer (pLoader->pRenderer, pLoader->pStagingBuffer);
-	cleanupResourceLoader(pLoader);
+	for (uint32_t i = 0; i < pLoader->mStagingRing.mPageCount; ++i)
+	{
+		if (pLoader->ppStagingPages[i])
+			removeBuffer(pLoader->pRenderer, pLoader->ppStagingPages[i]);
+	}
+	conf_free(pLoader->ppStagingPages);
 
-	removeCmd(pLoader->pCopyCmdPool, pLoader->pCopyCmd);
-	removeCmd(pLoader->pCopyCmdPool, pLoader->pBatchCopyCmd);
+	for (uint32_t i = 0; i < MAX_COPY_BATCHES; ++i)
+	{
+		CopyBatch* pBatch = &pLoader->mBatches[i];
+		cleanupCopyBatch(pLoader, pBatch);
+		removeCmd(pLoader->pCopyCmdPool, pBatch->pCmd);
+		removeFence(pLoader->pRenderer, pBatch->pFence);
+	}
 	removeCmdPool(pLoader->pRenderer, pLoader->pCopyCmdPool);
 
-	pLoader->mTempStagingBuffers.~vector();
+	pLoader->~ResourceLoader();
 
 	conf_free(pLoader);
 }
 
+/// Returns the command buffer of the batch currently recording, opening it on first use
+static Cmd* getCopyCmd(ResourceLoader* pLoader)
+{
+	CopyBatch* pBatch = &pLoader->mBatches[pLoader->mActiveBatch];
+	if (!pBatch->mRecording)
+	{
+		beginCmd(pBatch->pCmd);
+		pBatch->mRecording = true;
+	}
+	return pBatch->pCmd;
+}
+
+/// Recycles submitted batches oldest first until token completed. Only polls the fences if wait is false.
+static void retireCopyBatches(ResourceLoader* pLoader, SyncToken token, bool wait)
+{
+	while (pLoader->mCompletedToken < token && pLoader->mCompletedToken < pLoader->mSubmittedToken)
+	{
+		CopyBatch* pBatch = NULL;
+		for (uint32_t i = 0; i < MAX_COPY_BATCHES; ++i)
+		{
+			if (pLoader->mBatches[i].mToken == pLoader->mCompletedToken + 1)
+				pBatch = &pLoader->mBatches[i];
+		}
+		ASSERT(pBatch);
+
+		if (wait)
+		{
+			waitForFences(pLoader->pQueue, 1, &pBatch->pFence);
+		}
+		else
+		{
+			FenceStatus fenceStatus;
+			getFenceStatus(pBatch->pFence, &fenceStatus);
+			if (fenceStatus == FENCE_STATUS_INCOMPLETE)
+				break;
+		}
+
+		// Staging memory and temporary buffers of the batch are only reused once the GPU is done reading them
+		cleanupCopyBatch(pLoader, pBatch);
+		stagingRingRelease(&pLoader->mStagingRing, pBatch->mToken);
+		pLoader->mCompletedToken = pBatch->mToken;
+		pBatch->mToken = 0;
+	}
+}
+
+/// Submits the batch currently recording without waiting for it and continues in the next batch of the ring.
+/// Only blocks if the next batch is still in flight.
+static void submitCopyBatch(ResourceLoader* pLoader)
+{
+	CopyBatch* pBatch = &pLoader->mBatches[pLoader->mActiveBatch];
+	Cmd* pCmd = getCopyCmd(pLoader);
+	endCmd(pCmd);
+	queueSubmit(pLoader->pQueue, 1, &pCmd, pBatch->pFence, 0, 0, 0, 0);
+	pBatch->mRecording = false;
+	pBatch->mToken = ++pLoader->mSubmittedToken;
+
+	pLoader->mActiveBatch = (pLoader->mActiveBatch + 1) % MAX_COPY_BATCHES;
+	CopyBatch* pNextBatch = &pLoader->mBatches[pLoader->mActiveBatch];
+	if (pNextBatch->mToken)
+		retireCopyBatches(pLoader, pNextBatch->mToken, true);
+}
+
+/// Token that work recorded into the current batch will complete with
+static SyncToken getCurrentToken(ResourceLoader* pLoader)
+{
+	return pLoader->mSubmittedToken + 1;
+}
+
+/// Hands the batch of token to the GPU if it is still recording. Returns the submission that has to finish for token to complete.
+static SyncToken submitCopyToken(ResourceLoader* pLoader, SyncToken token)
+{
+	ASSERT(token <= getCurrentToken(pLoader));
+
+	if (token > pLoader->mSubmittedToken)
+	{
+		// Nothing was recorded into the current batch yet, so the token only depends on earlier submissions
+		if (pLoader->mBatches[pLoader->mActiveBatch].mRecording)
+			submitCopyBatch(pLoader);
+		else
+			token = pLoader->mSubmittedToken;
+	}
+	return token;
+}
+
 static ResourceState util_determine_resource_start_state(TextureUsage usage)
 {
 	ResourceState state = RESOURCE_STATE_UNDEFINED;
@@ -173,64 +348,74 @@ static ResourceState util_determine_resource_start_state(const BufferDesc* pBuff
 	}
 }
 
-/// Return memory from pre-allocated staging buffer or create a temporary buffer if the loader ran out of memory
-static MappedMemoryRange consumeResourceLoaderMemory(uint64_t memoryRequirement, uint32_t alignment, ResourceLoader* pLoader)
+static MappedMemoryRange addTempStagingBuffer(uint64_t memoryRequirement, ResourceLoader* pLoader)
 {
-	if (alignment != 0 && pLoader->mCurrentPos % alignment != 0)
-		pLoader->mCurrentPos = round_up_64(pLoader->mCurrentPos, alignment);
-
-	if (memoryRequirement > pLoader->pStagingBuffer->mDesc.mSize ||
-		pLoader->mCurrentPos + memoryRequirement > pLoader->pStagingBuffer->mDesc.mSize)
+	// Try creating a temporary staging buffer which we will clean up after resource is uploaded
+	Buffer* tempStagingBuffer = NULL;
+	BufferDesc desc = {};
+	desc.mUsage = BUFFER_USAGE_UPLOAD;
+	desc.mMemoryUsage = RESOURCE_MEMORY_USAGE_CPU_ONLY;
+	desc.mFlags = BUFFER_CREATION_FLAG_OWN_MEMORY_BIT | BUFFER_CREATION_FLAG_PERSISTENT_MAP_BIT;
+	desc.mSize = memoryRequirement;
+	addBuffer(pLoader->pRenderer, &desc, &tempStagingBuffer);
+
+	if (tempStagingBuffer)
 	{
-		// Try creating a temporary staging buffer which we will clean up after resource is uploaded
-		Buffer* tempStagingBuffer = NULL;
-		BufferDesc desc = {};
-		desc.mUsage = BUFFER_USAGE_UPLOAD;
-		desc.mMemoryUsage = RESOURCE_MEMORY_USAGE_CPU_ONLY;
-		desc.mFlags = BUFFER_CREATION_FLAG_OWN_MEMORY_BIT | BUFFER_CREATION_FLAG_PERSISTENT_MAP_BIT;
-		desc.mSize = memoryRequirement;
-		addBuffer(pLoader->pRenderer, &desc, &tempStagingBuffer);
-
-		if (tempStagingBuffer)
-		{
-			pLoader->mTempStagingBuffers.emplace_back(tempStagingBuffer);
-			return { tempStagingBuffer->pCpuMappedAddress, tempStagingBuffer, 0, memoryRequirement };
-		}
-		else
-		{
-			LOGERRORF("Failed to allocate memory (%llu) for resource", memoryRequirement);
-			return { NULL };
-		}
+		pLoader->mBatches[pLoader->mActiveBatch].mTempStagingBuffers.emplace_back(tempStagingBuffer);
+		pLoader->mTempStagingSize += memoryRequirement;
+		return { tempStagingBuffer->pCpuMappedAddress, tempStagingBuffer, 0, memoryRequirement };
+	}
+	else
+	{
+		LOGERRORF("Failed to allocate memory (%llu) for resource", memoryRequirement);
+		return { NULL };
 	}
-
-	void* pDstData = (uint8_t*) pLoader->pStagingBuffer->pCpuMappedAddress + pLoader->mCurrentPos;
-	uint64_t currentOffset = pLoader->mCurrentPos;
-	pLoader->mCurrentPos += memoryRequirement;
-	return { pDstData, pLoader->pStagingBuffer, currentOffset, memoryRequirement };
 }
 
-///
-static MappedMemoryRange consumeResourceUpdateMemory(uint64_t memoryRequirement, uint32_t alignment, ResourceLoader* pLoader)
+/// Return memory from the staging ring. Requests larger than a staging page get a temporary buffer, callers split
+/// their uploads into chunks of at most getStagingChunkSize so this only happens for single huge subresources.
+/// If the ring is full the loader submits the current batch and waits for the oldest one in flight.
+static MappedMemoryRange consumeResourceLoaderMemory(uint64_t memoryRequirement, uint32_t alignment, ResourceLoader* pLoader)
 {
-	if (alignment != 0 && pLoader->mCurrentPos % alignment != 0)
-		pLoader->mCurrentPos = round_up_64(pLoader->mCurrentPos, alignment);
+	StagingRing* pRing = &pLoader->mStagingRing;
+	if (memoryRequirement > pRing->mPageSize)
+		return addTempStagingBuffer(memoryRequirement, pLoader);
 
-	if (memoryRequirement > pLoader->pStagingBuffer->mDesc.mSize)
+	uint64_t offset = 0;
+	if (!stagingRingAllocate(pRing, memoryRequirement, alignment, getCurrentToken(pLoader), &offset))
 	{
-		LOGERRORF("ResourceLoader::updateResource Out of memory");
-		return { 0 };
+		const int64_t start = getUSec();
+		do
+		{
+			if (isStagingRingTokenPending(pRing, getCurrentToken(pLoader)))
+				submitCopyBatch(pLoader);
+			else
+				retireCopyBatches(pLoader, pLoader->mCompletedToken + 1, true);
+		} while (!stagingRingAllocate(pRing, memoryRequirement, alignment, getCurrentToken(pLoader), &offset));
+		stagingRingAddStall(pRing, (uint64_t)(getUSec() - start));
 	}
 
-	if (pLoader->mCurrentPos + memoryRequirement > pLoader->pStagingBuffer->mDesc.mSize)
+	const uint32_t page = (uint32_t)(offset / pRing->mPageSize);
+	if (!pLoader->ppStagingPages[page])
 	{
-		//LOGINFO ("ResourceLoader::Reached end of staging buffer. Reseting staging buffer");
-		pLoader->mCurrentPos = 0;
+		BufferDesc bufferDesc = {};
+		bufferDesc.mUsage = BUFFER_USAGE_UPLOAD;
+		bufferDesc.mSize = pRing->mPageSize;
+		bufferDesc.mMemoryUsage = RESOURCE_MEMORY_USAGE_CPU_ONLY;
+		bufferDesc.mFlags = BUFFER_CREATION_FLAG_OWN_MEMORY_BIT | BUFFER_CREATION_FLAG_PERSISTENT_MAP_BIT;
+		addBuffer(pLoader->pRenderer, &bufferDesc, &pLoader->ppStagingPages[page]);
 	}
 
-	void* pDstData = (uint8_t*)pLoader->pStagingBuffer->pCpuMappedAddress + pLoader->mCurrentPos;
-	uint64_t currentOffset = pLoader->mCurrentPos;
-	pLoader->mCurrentPos += memoryRequirement;
-	return{ pDstData, pLoader->pStagingBuffer, currentOffset, memoryRequirement };
+	Buffer* pPage = pLoader->ppStagingPages[page];
+	const uint64_t pageOffset = offset % pRing->mPageSize;
+	return { (uint8_t*)pPage->pCpuMappedAddress + pageOffset, pPage, pageOffset, memoryRequirement };
+}
+
+/// Largest part of an upload that is staged at once. Fills up the current staging page unless only little of it is left.
+static uint64_t getStagingChunkSize(ResourceLoader* pLoader, uint32_t alignment)
+{
+	const uint64_t pageSpace = getStagingRingPageSpace(&pLoader->mStagingRing, alignment);
+	return pageSpace >= RESOURCE_STAGING_MIN_CHUNK_SIZE ? pageSpace : pLoader->mStagingRing.mPageSize;
 }
 
 static void cmdLoadBuffer(BufferLoadDesc* pBufferDesc, ResourceLoader* pLoader)
@@ -247,16 +432,21 @@ static void cmdLoadBuffer(BufferLoadDesc* pBufferDesc, ResourceLoader* pLoader)
 
 		if (pBufferDesc->mDesc.mMemoryUsage == RESOURCE_MEMORY_USAGE_GPU_ONLY || pBufferDesc->mDesc.mMemoryUsage == RESOURCE_MEMORY_USAGE_GPU_TO_CPU)
 		{
-			MappedMemoryRange range = consumeResourceLoaderMemory(pBufferDesc->mDesc.mSize, RESOURCE_BUFFER_ALIGNMENT, pLoader);
-			ASSERT(range.pData);
-			ASSERT(range.pBuffer);
+			// Large buffers are staged in chunks so they fit the staging ring
+			for (uint64_t offset = 0, chunkSize = 0; offset < pBuffer->mDesc.mSize; offset += chunkSize)
+			{
+				chunkSize = min(getStagingChunkSize(pLoader, RESOURCE_BUFFER_ALIGNMENT), pBuffer->mDesc.mSize - offset);
+				MappedMemoryRange range = consumeResourceLoaderMemory(chunkSize, RESOURCE_BUFFER_ALIGNMENT, pLoader);
+				ASSERT(range.pData);
+				ASSERT(range.pBuffer);
 
-			if (pBufferDesc->pData)
-				memcpy(range.pData, pBufferDesc->pData, pBuffer->mDesc.mSize);
-			else
-				memset(range.pData, NULL, pBuffer->mDesc.mSize);
+				if (pBufferDesc->pData)
+					memcpy(range.pData, (const uint8_t*)pBufferDesc->pData + offset, range.mSize);
+				else
+					memset(range.pData, NULL, range.mSize);
 
-			cmdUpdateBuffer(pLoader->pCopyCmd, range.mOffset, pBuffer->mPositionInHeap, range.mSize, range.pBuffer, pBuffer);
+				cmdUpdateBuffer(getCopyCmd(pLoader), range.mOffset, pBuffer->mPositionInHeap + offset, range.mSize, range.pBuffer, pBuffer);
+			}
 		}
 		else
 		{
@@ -281,7 +471,7 @@ static void cmdLoadBuffer(BufferLoadDesc* pBufferDesc, ResourceLoader* pLoader)
 #ifdef _DURANGO
 		// XBox One needs explicit resource transitions
 		BufferBarrier bufferBarriers[] = { { pBuffer, state } };
-		cmdResourceBarrier(pLoader->pCopyCmd, 1, bufferBarriers, 0, NULL, false);
+		cmdResourceBarrier(getCopyCmd(pLoader), 1, bufferBarriers, 0, NULL, false);
 #else
 		// Resource will automatically transition so just set the next state without a barrier
 		pBuffer->mCurrentState = state;
@@ -294,17 +484,42 @@ static void cmdLoadBuffer(BufferLoadDesc* pBufferDesc, ResourceLoader* pLoader)
 	}
 }
 
-static void* imageLoadAllocationFunc(Image* pImage, uint64_t memoryRequirement, void* pUserData)
+/// Size of one row of blocks or pixels of a mip level and the number of those rows
+static void util_get_surface_rows(const Image& img, uint32_t mipLevel, uint32_t* pRowSize, uint32_t* pRowCount)
+{
+	if (ImageFormat::IsCompressedFormat(img.getFormat()))
+	{
+		*pRowSize = ((img.GetWidth(mipLevel) + 3) >> 2) * ImageFormat::GetBytesPerBlock(img.getFormat());
+		*pRowCount = (img.GetHeight(mipLevel) + 3) >> 2;
+	}
+	else
+	{
+		*pRowSize = img.GetWidth(mipLevel) * ImageFormat::GetBytesPerPixel(img.getFormat());
+		*pRowCount = img.GetHeight(mipLevel);
+	}
+}
+
+#if !defined(DIRECT3D12)
+/// Staging memory a texture file is decoded into
+typedef struct ImageStagingMemory
 {
-  UNREF_PARAM(pImage);
-	ResourceLoader* pLoader = (ResourceLoader*) pUserData;
-	ASSERT (pLoader);
+	ResourceLoader* pLoader;
+	MappedMemoryRange mRange;
+} ImageStagingMemory;
 
-	MappedMemoryRange range = consumeResourceLoaderMemory(memoryRequirement, 0, pLoader);
-	return range.pData;
+static void* imageLoadAllocationFunc(Image* pImage, uint64_t memoryRequirement, void* pUserData)
+{
+	UNREF_PARAM(pImage);
+	ImageStagingMemory* pMemory = (ImageStagingMemory*)pUserData;
+	ASSERT(pMemory);
+	pMemory->mRange = consumeResourceLoaderMemory(memoryRequirement, RESOURCE_TEXTURE_ALIGNMENT, pMemory->pLoader);
+	return pMemory->mRange.pData;
 }
+#endif
 
-static void upload_texture_data(TextureLoadDesc* pTextureFileDesc, const Image& img, ResourceLoader* pLoader)
+/// pStagedImage is the staging memory img was decoded into, NULL if its pixels are somewhere else and have to be
+/// copied to staging memory first
+static void upload_texture_data(TextureLoadDesc* pTextureFileDesc, const Image& img, ResourceLoader* pLoader, const MappedMemoryRange* pStagedImage = NULL)
 {
 	TextureType textureType = TEXTURE_TYPE_2D;
 	if (img.Is3D())
@@ -339,12 +554,12 @@ static void upload_texture_data(TextureLoadDesc* pTextureFileDesc, const Image&
 	// Only need transition for vulkan and durango since resource will auto promote to copy dest on copy queue in PC dx12
 #if defined(VULKAN) || defined(_DURANGO)
 	TextureBarrier barrier = { pTexture, RESOURCE_STATE_COPY_DEST };
-	cmdResourceBarrier(pLoader->pCopyCmd, 0, NULL, 1, &barrier, false);
+	cmdResourceBarrier(getCopyCmd(pLoader), 0, NULL, 1, &barrier, false);
 #endif
-	MappedMemoryRange range = consumeResourceLoaderMemory(pTexture->mTextureSize, RESOURCE_TEXTURE_ALIGNMENT, pLoader);
 
-	// create source subres data structs
+	// create source subres data structs together with the staging memory each of them needs
 	SubresourceDataDesc texData[1024];
+	uint64_t texDataSize[1024];
 	SubresourceDataDesc *dest = texData;
 	uint nSlices = img.IsCube() ? 6 : 1;
 
@@ -355,72 +570,104 @@ static void upload_texture_data(TextureLoadDesc* pTextureFileDesc, const Image&
 		{
 			for (uint32_t i = 0; i < img.GetMipMapCount(); ++i)
 			{
-				uint32_t pitch, slicePitch;
-				if (ImageFormat::IsCompressedFormat(img.getFormat()))
-				{
-					pitch = ((img.GetWidth(i) + 3) >> 2) * ImageFormat::GetBytesPerBlock(img.getFormat());
-					slicePitch = pitch * ((img.GetHeight(i) + 3) >> 2);
-				}
-				else
-				{
-					pitch = img.GetWidth(i) * ImageFormat::GetBytesPerPixel(img.getFormat());
-					slicePitch = pitch * img.GetHeight(i);
-				}
+				uint32_t pitch, rowCount;
+				util_get_surface_rows(img, i, &pitch, &rowCount);
+				uint32_t slicePitch = pitch * rowCount;
 
 				dest->pData = img.GetPixels(i, n) + k * slicePitch;
 				dest->mRowPitch = pitch;
 				dest->mSlicePitch = slicePitch;
+				texDataSize[dest - texData] = round_up_64(
+					round_up_64(pitch, RESOURCE_TEXTURE_ROW_ALIGNMENT) * rowCount * img.GetDepth(i), RESOURCE_TEXTURE_ALIGNMENT);
 				++dest;
 			}
 		}
 	}
 #else
-	uint offset = 0;
 	for (uint i = 0; i < img.GetMipMapCount(); ++i)
 	{
-		for (uint k = 0; k < nSlices; ++k)
+		const uint32_t faceSize = img.GetMipMappedSize(i, 1) / nSlices;
+		if (pStagedImage)
 		{
-			uint pitch, slicePitch, dataSize;
-			if (ImageFormat::IsCompressedFormat(img.getFormat()))
-			{
-				dataSize = ImageFormat::GetBytesPerBlock(img.getFormat());
-				pitch = ((img.GetWidth(i) + 3) >> 2);
-				slicePitch = ((img.GetHeight(i) + 3) >> 2);
-			}
-			else
+			// Each face of each array slice is copied from where it was decoded to
+			for (uint n = 0; n < img.GetArrayCount(); ++n)
 			{
-				dataSize = ImageFormat::GetBytesPerPixel(img.getFormat());
-				pitch = img.GetWidth(i);
-				slicePitch = img.GetHeight(i);
+				for (uint k = 0; k < nSlices; ++k)
+				{
+					dest->mMipLevel = i;
+					dest->mArrayLayer = n * nSlices + k;
+					dest->mWidth = img.GetWidth(i);
+					dest->mHeight = img.GetHeight(i);
+					dest->mDepth = img.GetDepth(i);
+					dest->mArraySize = 1;
+					dest->mBufferOffset = pStagedImage->mOffset + (uint64_t)(img.GetPixels(i, n) - img.GetPixels()) + k * faceSize;
+					texDataSize[dest - texData] = faceSize;
+					++dest;
+				}
 			}
+			continue;
+		}
 
+		for (uint k = 0; k < nSlices; ++k)
+		{
 			dest->mMipLevel = i;
 			dest->mArrayLayer = k;
-			dest->mBufferOffset = range.mOffset + offset;
 			dest->mWidth = img.GetWidth(i);
 			dest->mHeight = img.GetHeight(i);
 			dest->mDepth = img.GetDepth(i);
 			dest->mArraySize = img.GetArrayCount();
+			texDataSize[dest - texData] = (uint64_t)img.GetArrayCount() * faceSize;
 			++dest;
+		}
+	}
+#endif
 
-			for (uint n = 0; n < img.GetArrayCount(); ++n)
+	const uint32_t numSubresources = (uint32_t)(dest - texData);
+	if (pStagedImage)
+	{
+		// The pixels are in staging memory already, the copies read them from where they were decoded to
+		cmdUpdateSubresources(getCopyCmd(pLoader), 0, numSubresources, texData, pStagedImage->pBuffer, pStagedImage->mOffset, pTexture);
+	}
+	else
+	{
+		// Copy whole subresources in chunks which fit the staging ring
+		for (uint32_t first = 0; first < numSubresources;)
+		{
+			uint32_t count = 1;
+			uint64_t chunkSize = texDataSize[first];
+			while (first + count < numSubresources && chunkSize + texDataSize[first + count] <= getStagingChunkSize(pLoader, RESOURCE_TEXTURE_ALIGNMENT))
+				chunkSize += texDataSize[first + count++];
+
+			MappedMemoryRange range = consumeResourceLoaderMemory(chunkSize, RESOURCE_TEXTURE_ALIGNMENT, pLoader);
+			ASSERT(range.pData);
+
+#if !defined(DIRECT3D12) && !defined(METAL)
+			uint64_t offset = 0;
+			for (uint32_t j = first; j < first + count; ++j)
 			{
-				uint8_t* pSrcData = (uint8_t*)img.GetPixels(i, n) + k * slicePitch * pitch * dataSize;
-				memcpy((uint8_t*)range.pData + offset, pSrcData, (img.GetMipMappedSize(i, 1) / nSlices));
-				offset += (img.GetMipMappedSize(i, 1) / nSlices);
+				uint32_t i = texData[j].mMipLevel;
+				uint32_t pitch, rowCount;
+				util_get_surface_rows(img, i, &pitch, &rowCount);
+
+				texData[j].mBufferOffset = range.mOffset + offset;
+				for (uint n = 0; n < img.GetArrayCount(); ++n)
+				{
+					uint8_t* pSrcData = (uint8_t*)img.GetPixels(i, n) + texData[j].mArrayLayer * pitch * rowCount;
+					memcpy((uint8_t*)range.pData + offset, pSrcData, (img.GetMipMappedSize(i, 1) / nSlices));
+					offset += (img.GetMipMappedSize(i, 1) / nSlices);
+				}
 			}
-		}
-	}
 #endif
 
-	// calculate number of subresources
-	int numSubresources = (int)(dest - texData);
-	cmdUpdateSubresources(pLoader->pCopyCmd, 0, numSubresources, texData, range.pBuffer, range.mOffset, pTexture);
+			cmdUpdateSubresources(getCopyCmd(pLoader), first, count, texData + first, range.pBuffer, range.mOffset, pTexture);
+			first += count;
+		}
+	}
 
 	// Only need transition for vulkan and durango since resource will decay to srv on graphics queue in PC dx12
 #if defined(VULKAN) || defined(_DURANGO)
 	barrier = { pTexture, util_determine_resource_start_state(pTexture->mDesc.mUsage) };
-	cmdResourceBarrier(pLoader->pCopyCmd, 0, NULL, 1, &barrier, true);
+	cmdResourceBarrier(getCopyCmd(pLoader), 0, NULL, 1, &barrier, true);
 #endif
 }
 
@@ -429,12 +676,19 @@ static void cmdLoadTextureFile(TextureLoadDesc* pTextureFileDesc, ResourceLoader
 	ASSERT (pTextureFileDesc->ppTexture);
 
 	Image img;
-	//uint64_t pos = pLoader->mCurrentPos; //unused
-	bool res = img.loadImage(pTextureFileDesc->pFilename, pTextureFileDesc->mUseMipmaps, imageLoadAllocationFunc, pLoader, pTextureFileDesc->mRoot);
+#if defined(DIRECT3D12)
+	// upload_texture_data lays out the rows for the copy, so the image is decoded to memory of its own
+	bool res = img.loadImage(pTextureFileDesc->pFilename, pTextureFileDesc->mUseMipmaps, NULL, NULL, pTextureFileDesc->mRoot);
 	if (res)
-	{
 		upload_texture_data(pTextureFileDesc, img, pLoader);
-	}
+#else
+	// Loaders which support it decode straight into staging memory, nothing has to copy the pixels again before the
+	// GPU reads them. Images larger than a staging page go to a temporary staging buffer.
+	ImageStagingMemory memory = { pLoader };
+	bool res = img.loadImage(pTextureFileDesc->pFilename, pTextureFileDesc->mUseMipmaps, imageLoadAllocationFunc, &memory, pTextureFileDesc->mRoot);
+	if (res)
+		upload_texture_data(pTextureFileDesc, img, pLoader, memory.mRange.pData && img.GetPixels() == memory.mRange.pData ? &memory.mRange : NULL);
+#endif
 	img.Destroy();
 }
 
@@ -453,7 +707,7 @@ static void cmdLoadEmptyTexture(TextureLoadDesc* pEmptyTexture, ResourceLoader*
 	// Only need transition for vulkan and durango since resource will decay to srv on graphics queue in PC dx12
 #if defined(VULKAN) || defined(_DURANGO)
 	TextureBarrier barrier = { *pEmptyTexture->ppTexture, pEmptyTexture->pDesc->mStartState };
-	cmdResourceBarrier(pLoader->pCopyCmd, 0, NULL, 1, &barrier, true);
+	cmdResourceBarrier(getCopyCmd(pLoader), 0, NULL, 1, &barrier, true);
 #endif
 }
 
@@ -477,7 +731,7 @@ static void cmdLoadResource(ResourceLoadDesc* pResourceLoadDesc, ResourceLoader*
 	}
 }
 
-static void cmdUpdateResource(Cmd* pCmd, BufferUpdateDesc* pBufferUpdate, ResourceLoader* pLoader)
+static void cmdUpdateResource(BufferUpdateDesc* pBufferUpdate, ResourceLoader* pLoader)
 {
 	Buffer* pBuffer = pBufferUpdate->pBuffer;
     const uint64_t bufferSize = (pBufferUpdate->mSize > 0) ? pBufferUpdate->mSize : pBuffer->mDesc.mSize;
@@ -514,25 +768,29 @@ static void cmdUpdateResource(Cmd* pCmd, BufferUpdateDesc* pBufferUpdate, Resour
 	// If buffer is only in Device Local memory, stage an update from the pre-allocated staging buffer
 	else
 	{
-		MappedMemoryRange range = consumeResourceUpdateMemory(bufferSize, RESOURCE_BUFFER_ALIGNMENT, pLoader);
-		ASSERT(range.pData);
+		for (uint64_t chunkOffset = 0, chunkSize = 0; chunkOffset < bufferSize; chunkOffset += chunkSize)
+		{
+			chunkSize = min(getStagingChunkSize(pLoader, RESOURCE_BUFFER_ALIGNMENT), bufferSize - chunkOffset);
+			MappedMemoryRange range = consumeResourceLoaderMemory(chunkSize, RESOURCE_BUFFER_ALIGNMENT, pLoader);
+			ASSERT(range.pData);
 
-        if (pSrcBufferAddress)
-            memcpy(range.pData, pSrcBufferAddress, range.mSize);
-		else
-			memset(range.pData, NULL, range.mSize);
+			if (pSrcBufferAddress)
+				memcpy(range.pData, (uint8_t*)pSrcBufferAddress + chunkOffset, range.mSize);
+			else
+				memset(range.pData, NULL, range.mSize);
 
-		cmdUpdateBuffer(pCmd, range.mOffset, pBuffer->mPositionInHeap + offset,
-            bufferSize, range.pBuffer, pBuffer);
+			cmdUpdateBuffer(getCopyCmd(pLoader), range.mOffset, pBuffer->mPositionInHeap + offset + chunkOffset,
+				range.mSize, range.pBuffer, pBuffer);
+		}
 	}
 }
 
-void cmdUpdateResource(Cmd* pCmd, ResourceUpdateDesc* pResourceUpdate, ResourceLoader* pLoader)
+static void cmdUpdateResource(ResourceUpdateDesc* pResourceUpdate, ResourceLoader* pLoader)
 {
 	switch (pResourceUpdate->mType)
 	{
 	case RESOURCE_TYPE_BUFFER:
-		cmdUpdateResource(pCmd, &pResourceUpdate->buf, pLoader);
+		cmdUpdateResource(&pResourceUpdate->buf, pLoader);
 		break;
 	case RESOURCE_TYPE_TEXTURE:
 		break;
@@ -544,348 +802,557 @@ void cmdUpdateResource(Cmd* pCmd, ResourceUpdateDesc* pResourceUpdate, ResourceL
 // Resource Loader Globals
 //////////////////////////////////////////////////////////////////////////
 static Queue* pCopyQueue = NULL;
-static Fence* pWaitFence = NULL;
 
 static ResourceLoader* pMainResourceLoader = NULL;
-static ThreadPool* pThreadPool = NULL;
-static tinystl::vector <ResourceThread*> gResourceThreads;
-static tinystl::vector <ResourceLoadDesc*> gResourceQueue;
-static Mutex gResourceQueueMutex;
-static bool gFinishLoading = false;
+static Mutex gMainResourceLoaderMutex;
+static ResourceLoadPipeline* pLoadPipeline = NULL;
 static bool gUseThreads = false;
+
+static const char* gLoadStageNames[RESOURCE_LOAD_STAGE_COUNT] = { "Read", "Decode", "Upload" };
+
+// Defined with the shader loading functions
+static void releaseShaderCache();
 //////////////////////////////////////////////////////////////////////////
-// Resource Loader Implementation
+// Resource Loader Pipeline
 //////////////////////////////////////////////////////////////////////////
-static void loadThread(void* pThreadData)
+static void initLoadStage(LoadStage* pStage, uint32_t capacity, uint32_t threadCount)
 {
-	ResourceThread* pThread = (ResourceThread*) pThreadData;
-	ASSERT (pThread);
+	pStage->ppQueue = (ResourceLoadRequest**)conf_calloc(capacity, sizeof(ResourceLoadRequest*));
+	pStage->mCapacity = capacity;
+	pStage->mThreadCount = threadCount;
+}
 
-	ResourceLoader* pLoader = pThread->pLoader;
+/// Threads of a closed stage finish the requests left in its queue and exit
+static void closeLoadStage(LoadStage* pStage)
+{
+	MutexLock lock(pStage->mMutex);
+	pStage->mClosed = true;
+	pStage->mNotEmpty.SetAll();
+}
 
-	beginCmd (pLoader->pCopyCmd);
+/// Blocks while the queue of the stage is full. pProducer is the stage pushing the request, NULL for the application.
+static void pushLoadRequest(LoadStage* pStage, ResourceLoadRequest* pRequest, LoadStage* pProducer)
+{
+	const int64_t start = getUSec();
 
-	while (true)
-	{
-		if (gFinishLoading)
-			break;
+	MutexLock lock(pStage->mMutex);
+	while (pStage->mCount == pStage->mCapacity)
+		pStage->mNotFull.Wait(pStage->mMutex, TIMEOUT_INFINITE);
 
-		gResourceQueueMutex.Acquire();
-		if (!gResourceQueue.empty())
-		{
-			ResourceLoadDesc* item = gResourceQueue.front();
-			gResourceQueue.erase(gResourceQueue.begin());
-			gResourceQueueMutex.Release();
-			cmdLoadResource (item, pLoader);
-			if (item->mType == RESOURCE_TYPE_TEXTURE && item->tex.pFilename)
-				conf_free((char*)item->tex.pFilename);
-			conf_free(item);
-		}
-		else
-		{
-			gResourceQueueMutex.Release();
-			Thread::Sleep (0);
-		}
-	}
+	if (pProducer)
+		tfrg_atomic64_add(&pProducer->mOutputWaitTime, getUSec() - start);
 
-	endCmd(pLoader->pCopyCmd);
+	pStage->ppQueue[(pStage->mHead + pStage->mCount) % pStage->mCapacity] = pRequest;
+	pStage->mMaxCount = max(pStage->mMaxCount, ++pStage->mCount);
+	pStage->mNotEmpty.Set();
 }
 
-void initResourceLoaderInterface(Renderer* pRenderer, uint64_t memoryBudget, bool useThreads)
+/// Blocks until the stage has requests and takes up to maxCount of them. Returns 0 once the stage was closed and is empty.
+static uint32_t popLoadRequests(ResourceLoadPipeline* pPipeline, LoadStage* pStage, uint32_t maxCount, ResourceLoadRequest** ppRequests)
 {
-	uint32_t numCores = Thread::GetNumCPUCores();
+	const int64_t start = getUSec();
 
-	gUseThreads = useThreads && numCores > 1;
+	MutexLock lock(pStage->mMutex);
+	while (!pStage->mCount && !pStage->mClosed)
+		pStage->mNotEmpty.Wait(pStage->mMutex, TIMEOUT_INFINITE);
 
-	QueueDesc desc = { QUEUE_FLAG_NONE, QUEUE_PRIORITY_NORMAL, CMD_POOL_COPY };
-	addQueue(pRenderer, &desc, &pCopyQueue);
-	addFence(pRenderer, &pWaitFence);
+	const int64_t busyStart = (int64_t)tfrg_atomic64_load_acquire(&pPipeline->mBusyStartTime);
+	tfrg_atomic64_add(&pStage->mInputWaitTime, max(getUSec() - max(start, busyStart), (int64_t)0));
 
-	if (useThreads)
+	const uint32_t count = min(maxCount, pStage->mCount);
+	for (uint32_t i = 0; i < count; ++i)
 	{
-		uint32_t numLoaders = min (MAX_LOAD_THREADS, numCores - 1);
-
-		pThreadPool = conf_placement_new<ThreadPool>(conf_calloc(1, sizeof(ThreadPool)));
-		pThreadPool->CreateThreads(numLoaders);
-
-		for (unsigned i = 0; i < numLoaders; ++i)
-		{
-			WorkItem* pItem = (WorkItem*)conf_calloc(1, sizeof(*pItem));
-
-			pItem->pFunc = loadThread;
-
-            ResourceThread* thread = conf_placement_new<ResourceThread>(conf_calloc(1, sizeof(*thread)));
-
-			addResourceLoader (pRenderer, memoryBudget, &thread->pLoader, pCopyQueue);
-
-			thread->pRenderer = pRenderer;
-			// Consider worst case budget for each thread
-			thread->mMemoryBudget = memoryBudget;
-			thread->pItem = pItem;
-			gResourceThreads.push_back (thread);
-
-			pItem->pData = gResourceThreads [i];
-
-			pThreadPool->AddWorkItem (pItem);
-		}
+		ppRequests[i] = pStage->ppQueue[pStage->mHead];
+		pStage->mHead = (pStage->mHead + 1) % pStage->mCapacity;
 	}
+	pStage->mCount -= count;
 
-	addResourceLoader(pRenderer, memoryBudget, &pMainResourceLoader, pCopyQueue);
-}
-
-void removeResourceLoaderInterface(Renderer* pRenderer)
-{
-	removeResourceLoader(pMainResourceLoader);
-
-	removeQueue(pCopyQueue);
-	removeFence(pRenderer, pWaitFence);
+	if (count)
+		pStage->mNotFull.SetAll();
+	return count;
 }
 
-void addResource(ResourceLoadDesc* pResourceLoadDesc, bool threaded /* = false */)
+static void readThread(void* pData)
 {
-	if (threaded && !gUseThreads)
-	{
-		LOGWARNING("Threaded Option specified for loading but no threads were created in initResourceLoaderInterface - Using single threaded loading");
-	}
+	ResourceLoadPipeline* pPipeline = (ResourceLoadPipeline*)pData;
+	LoadStage* pStage = &pPipeline->mStages[RESOURCE_LOAD_STAGE_READ];
 
-	if (!threaded || !gUseThreads)
+	ResourceLoadRequest* pRequest = NULL;
+	while (popLoadRequests(pPipeline, pStage, 1, &pRequest))
 	{
-		gResourceQueueMutex.Acquire();
-		beginCmd(pMainResourceLoader->pCopyCmd);
-
-		cmdLoadResource(pResourceLoadDesc, pMainResourceLoader);
-
-		endCmd (pMainResourceLoader->pCopyCmd);
+		const int64_t start = getUSec();
 
-		queueSubmit(pCopyQueue, 1, &pMainResourceLoader->pCopyCmd, pWaitFence, 0, 0, 0, 0);
-		waitForFences(pCopyQueue, 1, &pWaitFence);
-		cleanupResourceLoader(pMainResourceLoader);
+		// Touch every page of the mapping so the decode threads don't stall on the disk
+		TextureLoadDesc* pDesc = &pRequest->mDesc.tex;
+		if (pRequest->mFile.Open(pDesc->pFilename, pDesc->mRoot))
+		{
+			const volatile uint8_t* pBytes = (const uint8_t*)pRequest->mFile.GetData();
+			uint8_t sum = 0;
+			for (size_t i = 0; i < pRequest->mFile.GetSize(); i += RESOURCE_READ_PAGE_SIZE)
+				sum += pBytes[i];
+			(void)sum;
+		}
 
-		pMainResourceLoader->mCurrentPos = 0;
-		gResourceQueueMutex.Release();
-	}
-	else
-	{
-		ResourceLoadDesc* pResource = (ResourceLoadDesc*)conf_malloc(sizeof(*pResourceLoadDesc));
-		memcpy(pResource, pResourceLoadDesc, sizeof(*pResourceLoadDesc));
-		gResourceQueueMutex.Acquire();
-		gResourceQueue.emplace_back(pResource);
-		gResourceQueueMutex.Release();
+		tfrg_atomic32_add(&pStage->mRequestCount, 1);
+		tfrg_atomic64_add(&pStage->mBusyTime, getUSec() - start);
+		pushLoadRequest(&pPipeline->mStages[RESOURCE_LOAD_STAGE_DECODE], pRequest, pStage);
 	}
 }
 
-void addResource(BufferLoadDesc* pBuffer, bool threaded)
+#if !defined(DIRECT3D12)
+/// The decode stage can't take staging ring memory, the ring belongs to the thread recording the copies. Images are
+/// decoded into an upload buffer of their own instead, which the upload stage copies from.
+static void* imageDecodeAllocationFunc(Image* pImage, uint64_t memoryRequirement, void* pUserData)
 {
-	ResourceLoadDesc resourceDesc = *pBuffer;
-	addResource(&resourceDesc, threaded);
+	UNREF_PARAM(pImage);
+	ResourceLoadRequest* pRequest = (ResourceLoadRequest*)pUserData;
+	ASSERT(pRequest);
+
+	BufferDesc desc = {};
+	desc.mUsage = BUFFER_USAGE_UPLOAD;
+	desc.mMemoryUsage = RESOURCE_MEMORY_USAGE_CPU_ONLY;
+	desc.mFlags = BUFFER_CREATION_FLAG_PERSISTENT_MAP_BIT;
+	desc.mSize = memoryRequirement;
+	addBuffer(pMainResourceLoader->pRenderer, &desc, &pRequest->pStagingBuffer);
+	return pRequest->pStagingBuffer ? pRequest->pStagingBuffer->pCpuMappedAddress : NULL;
 }
+#define RESOURCE_DECODE_ALLOCATOR imageDecodeAllocationFunc
+#else
+// upload_texture_data lays out the rows for the copy, so images are decoded to memory of their own
+#define RESOURCE_DECODE_ALLOCATOR NULL
+#endif
 
-void addResource(TextureLoadDesc* pTexture, bool threaded)
+static void decodeThread(void* pData)
 {
-	if (threaded && !gUseThreads)
-	{
-		LOGWARNING("Threaded Option specified for loading but no threads were created in initResourceLoaderInterface - Using single threaded loading");
-	}
-
-	if (!threaded || !gUseThreads)
-	{
-		ResourceLoadDesc resourceLoadDesc = *pTexture;
-		gResourceQueueMutex.Acquire();
-		beginCmd(pMainResourceLoader->pCopyCmd);
-
-		cmdLoadResource(&resourceLoadDesc, pMainResourceLoader);
-
-		endCmd(pMainResourceLoader->pCopyCmd);
-
-		queueSubmit(pCopyQueue, 1, &pMainResourceLoader->pCopyCmd, pWaitFence, 0, 0, 0, 0);
-		waitForFences(pCopyQueue, 1, &pWaitFence);
-		cleanupResourceLoader(pMainResourceLoader);
+	ResourceLoadPipeline* pPipeline = (ResourceLoadPipeline*)pData;
+	LoadStage* pStage = &pPipeline->mStages[RESOURCE_LOAD_STAGE_DECODE];
 
-		pMainResourceLoader->mCurrentPos = 0;
-		gResourceQueueMutex.Release();
-	}
-	else
+	ResourceLoadRequest* pRequest = NULL;
+	while (popLoadRequests(pPipeline, pStage, 1, &pRequest))
 	{
-		ResourceLoadDesc* pResource = (ResourceLoadDesc*)conf_malloc(sizeof(ResourceLoadDesc));
-		pResource->mType = RESOURCE_TYPE_TEXTURE;
-		pResource->tex = *pTexture;
-		if (pTexture->pFilename)
+		const int64_t start = getUSec();
+
+		TextureLoadDesc* pDesc = &pRequest->mDesc.tex;
+#if defined(TARGET_IOS)
+		// loadImage falls back to an uncompressed version of textures in formats which can't be loaded on iOS,
+		// the read stage still brought the file into the page cache
+		pRequest->mFile.Close();
+		pRequest->mDecoded = pRequest->mImage.loadImage(pDesc->pFilename, pDesc->mUseMipmaps, RESOURCE_DECODE_ALLOCATOR, pRequest, pDesc->mRoot);
+#else
+		if (pRequest->mFile.IsOpen())
 		{
-			pResource->tex.pFilename = (char*)conf_calloc(strlen(pTexture->pFilename) + 1, sizeof(char));
-			memcpy((char*)pResource->tex.pFilename, pTexture->pFilename, strlen(pTexture->pFilename));
+			pRequest->mDecoded = pRequest->mImage.loadImageFromMemory(pDesc->pFilename, pRequest->mFile.GetData(),
+				(uint32_t)pRequest->mFile.GetSize(), pDesc->mUseMipmaps, RESOURCE_DECODE_ALLOCATOR, pRequest);
+			pRequest->mFile.Close();
 		}
-		gResourceQueueMutex.Acquire();
-		gResourceQueue.emplace_back(pResource);
-		gResourceQueueMutex.Release();
+#endif
+
+		tfrg_atomic32_add(&pStage->mRequestCount, 1);
+		tfrg_atomic64_add(&pStage->mBusyTime, getUSec() - start);
+		pushLoadRequest(&pPipeline->mStages[RESOURCE_LOAD_STAGE_UPLOAD], pRequest, pStage);
 	}
 }
 
-void addResources(uint32_t resourceCount, ResourceLoadDesc* pResources, bool threaded /* = false */)
+static uint64_t getUploadSize(const ResourceLoadRequest* pRequest)
 {
-	if (threaded && !gUseThreads)
-	{
-		LOGWARNING("Threaded Option specified for loading but no threads were created in initResourceLoaderInterface - Using single threaded loading");
-	}
-
-	if (!threaded || !gUseThreads)
-	{
-		gResourceQueueMutex.Acquire();
-		beginCmd(pMainResourceLoader->pCopyCmd);
+	const ResourceLoadDesc* pDesc = &pRequest->mDesc;
+	if (pDesc->mType == RESOURCE_TYPE_BUFFER)
+		return pDesc->buf.mDesc.mSize;
 
-		for (uint32_t i = 0; i < resourceCount; ++i)
-		{
-			cmdLoadResource(&pResources[i], pMainResourceLoader);
-		}
+	const Image* pImage = pRequest->mDecoded ? &pRequest->mImage : pDesc->tex.pImage;
+	return pImage ? (uint64_t)pImage->GetMipMappedSize(0, pImage->GetMipMapCount()) * pImage->GetArrayCount() : 0;
+}
 
-		endCmd(pMainResourceLoader->pCopyCmd);
+static void uploadThread(void* pData)
+{
+	ResourceLoadPipeline* pPipeline = (ResourceLoadPipeline*)pData;
+	LoadStage* pStage = &pPipeline->mStages[RESOURCE_LOAD_STAGE_UPLOAD];
 
-		queueSubmit(pCopyQueue, 1, &pMainResourceLoader->pCopyCmd, pWaitFence, 0, 0, 0, 0);
-		waitForFences(pCopyQueue, 1, &pWaitFence);
-		cleanupResourceLoader(pMainResourceLoader);
+	ResourceLoadRequest* pRequests[RESOURCE_UPLOAD_QUEUE_SIZE];
+	// Staging memory recorded into the current batch of the main loader by this thread
+	uint64_t batchSize = 0;
+	SyncToken batchToken = 0;
 
-		pMainResourceLoader->mCurrentPos = 0;
-		gResourceQueueMutex.Release();
-	}
-	else
+	while (uint32_t count = popLoadRequests(pPipeline, pStage, RESOURCE_UPLOAD_QUEUE_SIZE, pRequests))
 	{
-		gResourceQueueMutex.Acquire();
-		for (uint32_t i = 0; i < resourceCount; ++i)
+		const int64_t start = getUSec();
+
+		// Everything that is ready is recorded under one lock, so small textures share a copy batch
+		gMainResourceLoaderMutex.Acquire();
+		for (uint32_t i = 0; i < count; ++i)
 		{
-			ResourceLoadDesc* pResource = (ResourceLoadDesc*)conf_malloc(sizeof(ResourceLoadDesc));
-			if (pResources[i].mType == RESOURCE_TYPE_TEXTURE && pResources[i].tex.pFilename)
+			ResourceLoadDesc* pDesc = &pRequests[i]->mDesc;
+			if (pDesc->mType == RESOURCE_TYPE_TEXTURE && pDesc->tex.pFilename)
 			{
-				pResource->mType = RESOURCE_TYPE_TEXTURE;
-				pResource->tex = pResources[i].tex;
-				pResource->tex.pFilename = (char*)conf_calloc(strlen(pResources[i].tex.pFilename) + 1, sizeof(char));
-				memcpy((char*)pResource->tex.pFilename, pResources[i].tex.pFilename, strlen(pResources[i].tex.pFilename));
+				Buffer* pStagingBuffer = pRequests[i]->pStagingBuffer;
+				if (pRequests[i]->mDecoded)
+				{
+					const Image& img = pRequests[i]->mImage;
+					MappedMemoryRange range = {};
+					if (pStagingBuffer && img.GetPixels() == pStagingBuffer->pCpuMappedAddress)
+						range = { pStagingBuffer->pCpuMappedAddress, pStagingBuffer, 0, pStagingBuffer->mDesc.mSize };
+					upload_texture_data(&pDesc->tex, img, pMainResourceLoader, range.pBuffer ? &range : NULL);
+				}
+
+				// The decode buffer lives until the GPU is done with the batch holding the copies from it
+				if (pStagingBuffer)
+				{
+					pMainResourceLoader->mBatches[pMainResourceLoader->mActiveBatch].mTempStagingBuffers.emplace_back(pStagingBuffer);
+					pMainResourceLoader->mTempStagingSize += pStagingBuffer->mDesc.mSize;
+				}
 			}
 			else
 			{
-				memcpy(pResource, &pResources[i], sizeof(ResourceLoadDesc));
+				cmdLoadResource(pDesc, pMainResourceLoader);
 			}
-			gResourceQueue.emplace_back(pResource);
 		}
-		gResourceQueueMutex.Release();
-	}
-}
 
-void updateResource(BufferUpdateDesc* pBufferUpdate, bool batch /* = false*/)
-{
-	if (pBufferUpdate->pBuffer->mDesc.mMemoryUsage == RESOURCE_MEMORY_USAGE_GPU_ONLY || pBufferUpdate->pBuffer->mDesc.mMemoryUsage == RESOURCE_MEMORY_USAGE_GPU_TO_CPU)
-	{
-        if (!batch)
-        {
-            // TODO : Make updating resources thread safe. This lock is a temporary solution
-            MutexLock lock(gResourceQueueMutex);
+		// The staging ring submits full batches on its own. In between hand the batch to the GPU once it holds a
+		// staging page worth of uploads or nothing else is on its way, so copies overlap with reading and decoding.
+		if (batchToken != getCurrentToken(pMainResourceLoader))
+		{
+			batchToken = getCurrentToken(pMainResourceLoader);
+			batchSize = 0;
+		}
+		for (uint32_t i = 0; i < count; ++i)
+			batchSize += getUploadSize(pRequests[i]);
 
-			Cmd* pCmd = pMainResourceLoader->pCopyCmd;
+		pPipeline->mPendingMutex.Acquire();
+		const bool drained = pPipeline->mPendingRequests == count;
+		pPipeline->mPendingMutex.Release();
 
-            beginCmd(pCmd);
-            cmdUpdateResource(pCmd, pBufferUpdate, pMainResourceLoader);
-            endCmd(pCmd);
+		if (drained || batchSize >= pMainResourceLoader->mStagingRing.mPageSize)
+		{
+			submitCopyToken(pMainResourceLoader, batchToken);
+			retireCopyBatches(pMainResourceLoader, pMainResourceLoader->mSubmittedToken, false);
+		}
+		gMainResourceLoaderMutex.Release();
 
-            queueSubmit(pCopyQueue, 1, &pCmd, pWaitFence, 0, 0, 0, 0);
-            waitForFences(pCopyQueue, 1, &pWaitFence);
-			cleanupResourceLoader(pMainResourceLoader);
-        }
-        else
-        {
-			Cmd* pCmd = pMainResourceLoader->pBatchCopyCmd;
+		for (uint32_t i = 0; i < count; ++i)
+		{
+			ResourceLoadRequest* pRequest = pRequests[i];
+			pRequest->mImage.Destroy();
+			pRequest->~ResourceLoadRequest();
+			conf_free(pRequest);
+		}
 
-            if (!pMainResourceLoader->mOpen)
-            {
-                beginCmd(pCmd);
-                pMainResourceLoader->mOpen = true;
-            }
+		tfrg_atomic32_add(&pStage->mRequestCount, count);
+		tfrg_atomic64_add(&pStage->mBusyTime, getUSec() - start);
 
-            cmdUpdateResource(pCmd, pBufferUpdate, pMainResourceLoader);
-        }
-	}
-	else
-	{
-		cmdUpdateResource(NULL, pBufferUpdate, pMainResourceLoader);
+		MutexLock lock(pPipeline->mPendingMutex);
+		pPipeline->mPendingRequests -= count;
+		if (!pPipeline->mPendingRequests)
+			pPipeline->mIdleCondition.SetAll();
 	}
 }
 
-void updateResources(uint32_t resourceCount, ResourceUpdateDesc* pResources)
+static void addLoadPipeline(uint32_t decodeThreadCount, ResourceLoadPipeline** ppPipeline)
 {
-	Cmd* pCmd = pMainResourceLoader->pCopyCmd;
+	ResourceLoadPipeline* pPipeline = conf_placement_new<ResourceLoadPipeline>(conf_calloc(1, sizeof(*pPipeline)));
 
-	beginCmd(pCmd);
+	initLoadStage(&pPipeline->mStages[RESOURCE_LOAD_STAGE_READ], RESOURCE_READ_QUEUE_SIZE, 1);
+	initLoadStage(&pPipeline->mStages[RESOURCE_LOAD_STAGE_DECODE], decodeThreadCount * RESOURCE_DECODE_QUEUE_SIZE_PER_THREAD, decodeThreadCount);
+	initLoadStage(&pPipeline->mStages[RESOURCE_LOAD_STAGE_UPLOAD], RESOURCE_UPLOAD_QUEUE_SIZE, 1);
 
-	for (uint32_t i = 0; i < resourceCount; ++i)
+	// The threads run until removeLoadPipeline closes the stages, they block on the queues while there is nothing to do
+	const uint32_t threadCount = decodeThreadCount + 2;
+	pPipeline->pThreadPool = conf_placement_new<ThreadPool>(conf_calloc(1, sizeof(ThreadPool)));
+	pPipeline->pThreadPool->CreateThreads(threadCount);
+
+	pPipeline->pItems = (WorkItem*)conf_calloc(threadCount, sizeof(WorkItem));
+	pPipeline->mThreadCounter.mValue = threadCount;
+	for (uint32_t i = 0; i < threadCount; ++i)
 	{
-		cmdUpdateResource(pCmd, &pResources[i], pMainResourceLoader);
+		WorkItem* pItem = conf_placement_new<WorkItem>(&pPipeline->pItems[i]);
+		pItem->pFunc = i == 0 ? readThread : (i == 1 ? uploadThread : decodeThread);
+		pItem->pData = pPipeline;
+		pItem->pCounter = &pPipeline->mThreadCounter;
+		pPipeline->pThreadPool->AddWorkItem(pItem);
 	}
 
-	endCmd(pCmd);
+	*ppPipeline = pPipeline;
+}
 
-	queueSubmit(pCopyQueue, 1, &pCmd, pWaitFence, 0, 0, 0, 0);
-	waitForFences(pCopyQueue, 1, &pWaitFence);
-	cleanupResourceLoader(pMainResourceLoader);
+/// Blocks until every request added so far was recorded into a copy batch
+static void waitForLoadPipeline(ResourceLoadPipeline* pPipeline)
+{
+	MutexLock lock(pPipeline->mPendingMutex);
+	while (pPipeline->mPendingRequests)
+		pPipeline->mIdleCondition.Wait(pPipeline->mPendingMutex, TIMEOUT_INFINITE);
 }
 
-void flushResourceUpdates()
+static void removeLoadPipeline(ResourceLoadPipeline* pPipeline)
 {
-    if (pMainResourceLoader->mOpen)
-    {
-        endCmd(pMainResourceLoader->pBatchCopyCmd);
+	waitForLoadPipeline(pPipeline);
 
-        queueSubmit(pCopyQueue, 1, &pMainResourceLoader->pBatchCopyCmd, pWaitFence, 0, 0, 0, 0);
-        waitForFences(pCopyQueue, 1, &pWaitFence);
+	for (uint32_t i = 0; i < RESOURCE_LOAD_STAGE_COUNT; ++i)
+		closeLoadStage(&pPipeline->mStages[i]);
+	pPipeline->pThreadPool->WaitForCounter(&pPipeline->mThreadCounter);
 
-		cleanupResourceLoader(pMainResourceLoader);
-        pMainResourceLoader->mOpen = false;
-    }
+	pPipeline->pThreadPool->~ThreadPool();
+	conf_free(pPipeline->pThreadPool);
+	conf_free(pPipeline->pItems);
+
+	for (uint32_t i = 0; i < RESOURCE_LOAD_STAGE_COUNT; ++i)
+		conf_free(pPipeline->mStages[i].ppQueue);
+
+	pPipeline->~ResourceLoadPipeline();
+	conf_free(pPipeline);
+}
+//////////////////////////////////////////////////////////////////////////
+// Resource Loader Implementation
+//////////////////////////////////////////////////////////////////////////
+static void waitForCopyToken(ResourceLoader* pLoader, SyncToken token)
+{
+	retireCopyBatches(pLoader, submitCopyToken(pLoader, token), true);
 }
 
-void removeResource(Texture* pTexture)
+void initResourceLoaderInterface(Renderer* pRenderer, uint64_t memoryBudget, bool useThreads)
 {
-	removeTexture(pMainResourceLoader->pRenderer, pTexture);
+	uint32_t numCores = Thread::GetNumCPUCores();
+
+	gUseThreads = useThreads && numCores > 1;
+
+	QueueDesc desc = { QUEUE_FLAG_NONE, QUEUE_PRIORITY_NORMAL, CMD_POOL_COPY };
+	addQueue(pRenderer, &desc, &pCopyQueue);
+
+	addResourceLoader(pRenderer, memoryBudget, &pMainResourceLoader, pCopyQueue);
+
+	if (gUseThreads)
+	{
+		// Leave one core to the application and one to the read and upload threads, which mostly wait for the disk and the GPU
+		addLoadPipeline(max(numCores, 3U) - 2, &pLoadPipeline);
+	}
 }
 
-void removeResource(Buffer* pBuffer)
+void removeResourceLoaderInterface(Renderer* pRenderer)
 {
-	removeBuffer(pMainResourceLoader->pRenderer, pBuffer);
+	if (pLoadPipeline)
+	{
+		removeLoadPipeline(pLoadPipeline);
+		pLoadPipeline = NULL;
+	}
+
+	waitForCopyToken(pMainResourceLoader, getCurrentToken(pMainResourceLoader));
+	removeResourceLoader(pMainResourceLoader);
+
+	removeQueue(pCopyQueue);
+
+	releaseShaderCache();
 }
 
-void finishResourceLoading()
+void addResources(uint32_t resourceCount, ResourceLoadDesc* pResources, SyncToken* pToken)
 {
-	if ((uint32_t)gResourceThreads.size())
+	ASSERT(pToken);
+	MutexLock lock(gMainResourceLoaderMutex);
+
+	for (uint32_t i = 0; i < resourceCount; ++i)
 	{
-        while (!gResourceQueue.empty ())
-            Thread::Sleep (0);
+		cmdLoadResource(&pResources[i], pMainResourceLoader);
+	}
 
-        gFinishLoading = true;
+	// Resources which didn't fit the current batch were submitted with an earlier token
+	*pToken = getCurrentToken(pMainResourceLoader);
+}
 
-        // Wait till all resources are loaded
-        while (!pThreadPool->IsCompleted(0))
-            Thread::Sleep(0);
+void addResources(uint32_t resourceCount, ResourceLoadDesc* pResources, bool threaded /* = false */)
+{
+	if (threaded && !gUseThreads)
+	{
+		LOGWARNING("Threaded Option specified for loading but no threads were created in initResourceLoaderInterface - Using single threaded loading");
+	}
+
+	if (!threaded || !gUseThreads)
+	{
+		SyncToken token = 0;
+		addResources(resourceCount, pResources, &token);
+		waitForToken(token);
+	}
+	else
+	{
+		pLoadPipeline->mPendingMutex.Acquire();
+		if (!pLoadPipeline->mPendingRequests)
+			tfrg_atomic64_store_release(&pLoadPipeline->mBusyStartTime, (uint64_t)getUSec());
+		pLoadPipeline->mPendingRequests += resourceCount;
+		pLoadPipeline->mPendingMutex.Release();
 
-		Cmd* pCmds[MAX_LOAD_THREADS + 1];
-		for (uint32_t i = 0; i < (uint32_t)gResourceThreads.size(); ++i)
+		for (uint32_t i = 0; i < resourceCount; ++i)
 		{
-			pCmds[i] = gResourceThreads[i]->pLoader->pCopyCmd;
+			ResourceLoadRequest* pRequest = conf_placement_new<ResourceLoadRequest>(conf_calloc(1, sizeof(ResourceLoadRequest)), pResources[i]);
+
+			// Texture files are read and decoded by the pipeline threads, everything else only needs its upload recorded
+			if (pResources[i].mType == RESOURCE_TYPE_TEXTURE && pResources[i].tex.pFilename)
+			{
+				// The interned copy outlives the request, so the caller's name may go away before the file is read
+				internName(pResources[i].tex.pFilename, &pRequest->mDesc.tex.pFilename);
+				pushLoadRequest(&pLoadPipeline->mStages[RESOURCE_LOAD_STAGE_READ], pRequest, NULL);
+			}
+			else
+			{
+				pushLoadRequest(&pLoadPipeline->mStages[RESOURCE_LOAD_STAGE_UPLOAD], pRequest, NULL);
+			}
 		}
+	}
+}
+
+void addResource(BufferLoadDesc* pBuffer, bool threaded)
+{
+	ResourceLoadDesc resourceDesc = *pBuffer;
+	addResources(1, &resourceDesc, threaded);
+}
+
+void addResource(TextureLoadDesc* pTexture, bool threaded)
+{
+	ResourceLoadDesc resourceDesc = *pTexture;
+	addResources(1, &resourceDesc, threaded);
+}
+
+void addResource(BufferLoadDesc* pBuffer, SyncToken* pToken)
+{
+	ResourceLoadDesc resourceDesc = *pBuffer;
+	addResources(1, &resourceDesc, pToken);
+}
+
+void addResource(TextureLoadDesc* pTexture, SyncToken* pToken)
+{
+	ResourceLoadDesc resourceDesc = *pTexture;
+	addResources(1, &resourceDesc, pToken);
+}
+
+void updateResource(BufferUpdateDesc* pBufferUpdate, SyncToken* pToken)
+{
+	ASSERT(pToken);
+	MutexLock lock(gMainResourceLoaderMutex);
+
+	cmdUpdateResource(pBufferUpdate, pMainResourceLoader);
+	*pToken = getCurrentToken(pMainResourceLoader);
+}
+
+void updateResource(BufferUpdateDesc* pBufferUpdate, bool batch /* = false*/)
+{
+	if (pBufferUpdate->pBuffer->mDesc.mMemoryUsage == RESOURCE_MEMORY_USAGE_GPU_ONLY || pBufferUpdate->pBuffer->mDesc.mMemoryUsage == RESOURCE_MEMORY_USAGE_GPU_TO_CPU)
+	{
+		SyncToken token = 0;
+		updateResource(pBufferUpdate, &token);
+
+		// Batched updates are completed by flushResourceUpdates
+		if (!batch)
+			waitForToken(token);
+	}
+	else
+	{
+		cmdUpdateResource(pBufferUpdate, pMainResourceLoader);
+	}
+}
+
+void updateResources(uint32_t resourceCount, ResourceUpdateDesc* pResources, SyncToken* pToken)
+{
+	ASSERT(pToken);
+	MutexLock lock(gMainResourceLoaderMutex);
 
-		pCmds[(uint32_t)gResourceThreads.size()] = pMainResourceLoader->pCopyCmd;
+	for (uint32_t i = 0; i < resourceCount; ++i)
+	{
+		cmdUpdateResource(&pResources[i], pMainResourceLoader);
+	}
 
-		queueSubmit(pCopyQueue, (uint32_t)gResourceThreads.size(), pCmds, pWaitFence, 0, 0, 0, 0);
-		waitForFences(pCopyQueue, 1, &pWaitFence);
-		cleanupResourceLoader(pMainResourceLoader);
+	*pToken = getCurrentToken(pMainResourceLoader);
+}
 
-		for (uint32_t i = 0; i < (uint32_t)gResourceThreads.size(); ++i)
-			removeResourceLoader(gResourceThreads[i]->pLoader);
+void updateResources(uint32_t resourceCount, ResourceUpdateDesc* pResources)
+{
+	SyncToken token = 0;
+	updateResources(resourceCount, pResources, &token);
+	waitForToken(token);
+}
 
-		pThreadPool->~ThreadPool();
-        conf_free(pThreadPool);
+bool isTokenCompleted(SyncToken token)
+{
+	MutexLock lock(gMainResourceLoaderMutex);
 
-        for (unsigned i = 0; i < (uint32_t)gResourceThreads.size(); ++i)
+	if (token <= pMainResourceLoader->mCompletedToken)
+		return true;
+
+	// Polling hands the batch of the token to the GPU, otherwise it would only complete once the batch is full
+	token = submitCopyToken(pMainResourceLoader, token);
+	retireCopyBatches(pMainResourceLoader, token, false);
+	return token <= pMainResourceLoader->mCompletedToken;
+}
+
+void waitForToken(SyncToken token)
+{
+	MutexLock lock(gMainResourceLoaderMutex);
+	waitForCopyToken(pMainResourceLoader, token);
+}
+
+void getResourceLoaderStats(ResourceLoaderStats* pStats)
+{
+	MutexLock lock(gMainResourceLoaderMutex);
+
+	const StagingRing* pRing = &pMainResourceLoader->mStagingRing;
+	pStats->mStagingBudget = getStagingRingSize(pRing);
+	pStats->mStagingHighWaterMark = pRing->mHighWaterMark;
+	pStats->mStagingWastedBytes = pRing->mWastedBytes;
+	pStats->mStagingStallCount = pRing->mStallCount;
+	pStats->mStagingStallTime = pRing->mStallTime;
+	pStats->mTempStagingBytes = pMainResourceLoader->mTempStagingSize;
+	pStats->mCopySubmitCount = pMainResourceLoader->mSubmittedToken;
+
+	for (uint32_t i = 0; i < RESOURCE_LOAD_STAGE_COUNT; ++i)
+	{
+		ResourceLoadStageStats* pStageStats = &pStats->mStages[i];
+		*pStageStats = {};
+		if (!pLoadPipeline)
+			continue;
+
+		LoadStage* pStage = &pLoadPipeline->mStages[i];
+		MutexLock stageLock(pStage->mMutex);
+		pStageStats->mThreadCount = pStage->mThreadCount;
+		pStageStats->mRequestCount = tfrg_atomic32_load_relaxed(&pStage->mRequestCount);
+		pStageStats->mQueueCapacity = pStage->mCapacity;
+		pStageStats->mMaxQueueDepth = pStage->mMaxCount;
+		pStageStats->mBusyTime = tfrg_atomic64_load_relaxed(&pStage->mBusyTime);
+		pStageStats->mInputWaitTime = tfrg_atomic64_load_relaxed(&pStage->mInputWaitTime);
+		pStageStats->mOutputWaitTime = tfrg_atomic64_load_relaxed(&pStage->mOutputWaitTime);
+	}
+}
+
+void flushResourceUpdates()
+{
+	MutexLock lock(gMainResourceLoaderMutex);
+	waitForCopyToken(pMainResourceLoader, getCurrentToken(pMainResourceLoader));
+}
+
+void removeResource(Texture* pTexture)
+{
+	removeTexture(pMainResourceLoader->pRenderer, pTexture);
+}
+
+void removeResource(Buffer* pBuffer)
+{
+	removeBuffer(pMainResourceLoader->pRenderer, pBuffer);
+}
+
+void finishResourceLoading()
+{
+	if (pLoadPipeline)
+	{
+		waitForLoadPipeline(pLoadPipeline);
+
+		ResourceLoaderStats stats;
+		getResourceLoaderStats(&stats);
+		for (uint32_t i = 0; i < RESOURCE_LOAD_STAGE_COUNT; ++i)
 		{
-			conf_free(gResourceThreads[i]->pItem);
-			conf_free(gResourceThreads[i]);
-        }
+			const ResourceLoadStageStats* pStage = &stats.mStages[i];
+			LOGINFOF("%s stage: %u requests on %u threads, busy %.1f ms, waiting for input %.1f ms, waiting for the next stage %.1f ms, queue depth %u of %u",
+				gLoadStageNames[i], pStage->mRequestCount, pStage->mThreadCount, pStage->mBusyTime / 1000.0,
+				pStage->mInputWaitTime / 1000.0, pStage->mOutputWaitTime / 1000.0, pStage->mMaxQueueDepth, pStage->mQueueCapacity);
+		}
+		LOGINFOF("Staging ring: %llu stalls waiting for copies for %.1f ms", (unsigned long long)stats.mStagingStallCount,
+			stats.mStagingStallTime / 1000.0);
 	}
+
+	// Everything recorded with a sync token or by the loading threads is finished as well
+	flushResourceUpdates();
 }
 /************************************************************************/
 // Shader loading
@@ -940,13 +1407,13 @@ void compileShader(Renderer* pRenderer, const String& fileName, const String& ou
 		// If for some reason the error file could not be created just log error msg
 		if (!errorFile.IsOpen())
 		{
-			ErrorMsg("Failed to compile shader %s", fileName);
+			LOGERRORF("Failed to compile shader %s", fileName.c_str());
 		}
 		else
 		{
 			String errorLog = errorFile.ReadText();
 			errorFile.Close();
-			ErrorMsg("Failed to compile shader %s with error\n%s", fileName.c_str(), errorLog.c_str());
+			LOGERRORF("Failed to compile shader %s with error\n%s", fileName.c_str(), errorLog.c_str());
 			errorFile.Close();
 		}
 	}
@@ -1007,97 +1474,376 @@ void compileShader(Renderer* pRenderer, const String& fileName, const String& ou
             memcpy(pByteCode->data(), file.ReadText().c_str(), pByteCode->size());
             file.Close();
         }
-        else ErrorMsg("Failed to assemble shader's %s .metallib file", fileName.c_str());
+        else LOGERRORF("Failed to assemble shader's %s .metallib file", fileName.c_str());
     }
-    else ErrorMsg("Failed to compile shader %s", fileName.c_str());
+    else LOGERRORF("Failed to compile shader %s", fileName.c_str());
 }
 #else
 extern void compileShader(Renderer* pRenderer, ShaderStage stage, const String& fileName, const String& code, uint32_t macroCount, ShaderMacro* pMacros, tinystl::vector<char>* pByteCode);
 #endif
 
-// Function to generate the timestamp of this shader source file considering all include file timestamp
-static bool process_source_file(File* original, File* file, uint32_t& outTimeStamp, String& outCode)
+/************************************************************************/
+// Shader bytecode cache
+/************************************************************************/
+// Unused entries are dropped from the cache file once they take up more space than the used ones
+typedef struct ShaderByteCodeCache
 {
-	// If the source if a non-packaged file, store the timestamp
-	if (file)
-	{
-		String fullName = file->GetName();
-		unsigned fileTimeStamp = FileSystem::GetLastModifiedTime(fullName);
-		if (fileTimeStamp > outTimeStamp)
-			outTimeStamp = fileTimeStamp;
-	}
+	Mutex mMutex;
+	String mFileName;
+	MappedFile mFile;
+	/// Copy of the file contents if it could not be written and mapped again
+	tinystl::vector<char> mFileData;
+	const char* pFileData;
+	const ShaderCacheEntry* pEntries;
+	uint32_t mEntryCount;
+	/// One flag per entry of the file, set when the entry was loaded since the file was opened
+	tinystl::vector<uint8_t> mEntryUsed;
+	/// Compiled since the file was written, the offsets are relative to mNewData
+	tinystl::vector<ShaderCacheEntry> mNewEntries;
+	tinystl::vector<char> mNewData;
+
+	uint32_t mHitCount;
+	uint32_t mMissCount;
+	uint32_t mDuplicateCount;
+	uint64_t mKeyTime;
+	uint64_t mCompileTime;
+} ShaderByteCodeCache;
+
+static ShaderByteCodeCache gShaderCache = {};
+
+static void setShaderCacheData(ShaderByteCodeCache* pCache, const char* pData, uint64_t size)
+{
+	pCache->pFileData = pData;
+	pCache->pEntries = getShaderCacheIndex(pData, size, &pCache->mEntryCount);
+	if (!pCache->pEntries && size)
+		LOGWARNINGF("Ignoring invalid shader cache file %s", pCache->mFileName.c_str());
+}
 
-	while (!file->IsEof())
+// Merges the compiled entries into the cache file. Has to be called with the cache mutex held
+static void saveShaderCache(ShaderByteCodeCache* pCache)
+{
+	if (pCache->mNewEntries.empty())
+		return;
+
+	uint32_t newCount = (uint32_t)pCache->mNewEntries.size();
+	sortShaderCacheEntries(pCache->mNewEntries.data(), newCount);
+
+	uint64_t usedSize = 0;
+	uint64_t unusedSize = 0;
+	for (uint32_t i = 0; i < pCache->mEntryCount; ++i)
+		(pCache->mEntryUsed[i] ? usedSize : unusedSize) += pCache->pEntries[i].mSize;
+	for (uint32_t i = 0; i < newCount; ++i)
+		usedSize += pCache->mNewEntries[i].mSize;
+	const bool dropUnused = unusedSize > usedSize;
+
+	// Both lists are sorted, merge them into the index of the new file
+	tinystl::vector<ShaderCacheEntry> entries;
+	tinystl::vector<const char*> sources;
+	tinystl::vector<uint8_t> used;
+	entries.reserve(pCache->mEntryCount + newCount);
+	sources.reserve(pCache->mEntryCount + newCount);
+	used.reserve(pCache->mEntryCount + newCount);
+	uint32_t oldIndex = 0;
+	uint32_t newIndex = 0;
+	while (oldIndex < pCache->mEntryCount || newIndex < newCount)
 	{
-		String line = file->ReadLine();
-
-		if (line.find("#include \"", 0) != String::npos)
+		if (oldIndex < pCache->mEntryCount &&
+			(newIndex == newCount || compareShaderCacheKeys(pCache->pEntries[oldIndex].mKey, pCache->mNewEntries[newIndex].mKey) < 0))
 		{
-			String includeFileName = FileSystem::GetPath(file->GetName()) + line.substring(9).replaced("\"", "").trimmed();
-			File includeFile = {};
-			includeFile.Open(includeFileName, FM_ReadBinary, FSR_Absolute);
-			if (!includeFile.IsOpen())
-				return false;
-
-			// Add the include file into the current code recursively
-			if (!process_source_file(original, &includeFile, outTimeStamp, outCode))
+			if (!dropUnused || pCache->mEntryUsed[oldIndex])
 			{
-				includeFile.Close();
-				return false;
+				entries.push_back(pCache->pEntries[oldIndex]);
+				sources.push_back(pCache->pFileData + pCache->pEntries[oldIndex].mOffset);
+				used.push_back(pCache->mEntryUsed[oldIndex]);
 			}
-
-			includeFile.Close();
+			++oldIndex;
+		}
+		else
+		{
+			entries.push_back(pCache->mNewEntries[newIndex]);
+			sources.push_back(pCache->mNewData.data() + pCache->mNewEntries[newIndex].mOffset);
+			used.push_back(1);
+			++newIndex;
 		}
+	}
+
+	uint32_t entryCount = (uint32_t)entries.size();
+	uint64_t fileSize = getShaderCacheDataOffset(entryCount);
+	for (uint32_t i = 0; i < entryCount; ++i)
+	{
+		entries[i].mOffset = fileSize;
+		fileSize += (entries[i].mSize + SHADER_CACHE_DATA_ALIGNMENT - 1) & ~(SHADER_CACHE_DATA_ALIGNMENT - 1);
+	}
+
+	tinystl::vector<char> fileData;
+	fileData.resize((size_t)fileSize, 0);
+	ShaderCacheHeader header = {};
+	header.mMagic = SHADER_CACHE_MAGIC;
+	header.mVersion = SHADER_CACHE_VERSION;
+	header.mEntryCount = entryCount;
+	header.mFileSize = fileSize;
+	memcpy(fileData.data(), &header, sizeof(header));
+	memcpy(fileData.data() + sizeof(header), entries.data(), entryCount * sizeof(ShaderCacheEntry));
+	for (uint32_t i = 0; i < entryCount; ++i)
+		memcpy(fileData.data() + entries[i].mOffset, sources[i], entries[i].mSize);
+
+	// The mapping has to be closed before the file can be replaced
+	pCache->mFile.Close();
+	String path = FileSystem::GetPath(pCache->mFileName);
+	if (!FileSystem::DirExists(path))
+		FileSystem::CreateDir(path);
+	File file = {};
+	file.Open(pCache->mFileName, FM_WriteBinary, FSR_Absolute);
+	bool written = file.IsOpen() && file.Write(fileData.data(), (unsigned)fileData.size()) == fileData.size();
+	file.Close();
+
+	if (written && pCache->mFile.Open(pCache->mFileName, FSR_Absolute))
+	{
+		pCache->mFileData.clear();
+		setShaderCacheData(pCache, (const char*)pCache->mFile.GetData(), pCache->mFile.GetSize());
+	}
+	else
+	{
+		LOGWARNINGF("Failed to save shader cache file %s", pCache->mFileName.c_str());
+		pCache->mFileData.swap(fileData);
+		setShaderCacheData(pCache, pCache->mFileData.data(), pCache->mFileData.size());
+	}
+
+	pCache->mEntryUsed.swap(used);
+	pCache->mNewEntries.clear();
+	pCache->mNewData.clear();
+}
+
+// Saves and releases the cache file. Has to be called with the cache mutex held
+static void closeShaderCache(ShaderByteCodeCache* pCache)
+{
+	if (pCache->mFileName.size())
+	{
+		saveShaderCache(pCache);
+		LOGINFOF("Shader cache %s: %u entries, %u hits, %u misses, %.1f ms hashing sources, %.1f ms compiling",
+			pCache->mFileName.c_str(), pCache->mEntryCount, pCache->mHitCount, pCache->mMissCount,
+			pCache->mKeyTime / 1000.0, pCache->mCompileTime / 1000.0);
+	}
+
+	pCache->mFile.Close();
+	pCache->mFileData.clear();
+	pCache->mFileName = "";
+	pCache->pFileData = NULL;
+	pCache->pEntries = NULL;
+	pCache->mEntryCount = 0;
+	pCache->mEntryUsed.clear();
+}
 
-		if (file == original)
+// Opens the cache file of the application on first use. Has to be called with the cache mutex held
+static void openShaderCache(ShaderByteCodeCache* pCache, const String& fileName)
+{
+	if (pCache->mFileName == fileName)
+		return;
+
+	closeShaderCache(pCache);
+	pCache->mFileName = fileName;
+	if (FileSystem::FileExists(fileName, FSR_Absolute) && pCache->mFile.Open(fileName, FSR_Absolute))
+		setShaderCacheData(pCache, (const char*)pCache->mFile.GetData(), pCache->mFile.GetSize());
+	pCache->mEntryUsed.resize(pCache->mEntryCount, 0);
+}
+
+static bool findShaderByteCode(ShaderByteCodeCache* pCache, const ShaderCacheKey& key, tinystl::vector<char>& byteCode)
+{
+	const ShaderCacheEntry* pEntry = findShaderCacheEntry(pCache->pEntries, pCache->mEntryCount, key);
+	if (pEntry)
+	{
+		pCache->mEntryUsed[pEntry - pCache->pEntries] = 1;
+		byteCode.assign(pCache->pFileData + pEntry->mOffset, pCache->pFileData + pEntry->mOffset + pEntry->mSize);
+		return true;
+	}
+
+	for (uint32_t i = 0; i < (uint32_t)pCache->mNewEntries.size(); ++i)
+	{
+		if (compareShaderCacheKeys(pCache->mNewEntries[i].mKey, key) == 0)
 		{
-			outCode += line;
-			outCode += "\n";
+			const char* pData = pCache->mNewData.data() + pCache->mNewEntries[i].mOffset;
+			byteCode.assign(pData, pData + pCache->mNewEntries[i].mSize);
+			return true;
 		}
 	}
 
-	return true;
+	return false;
 }
 
-// Loads the bytecode from file if the binary shader file is newer than the source
-bool check_for_byte_code(const String& binaryShaderName, uint32_t sourceTimeStamp, tinystl::vector<char>& byteCode)
+static void addShaderByteCode(ShaderByteCodeCache* pCache, const ShaderCacheKey& key, const tinystl::vector<char>& byteCode)
 {
-	if (!FileSystem::FileExists(binaryShaderName, FSR_Absolute))
-		return false;
+	ShaderCacheEntry entry = {};
+	entry.mKey = key;
+	entry.mOffset = pCache->mNewData.size();
+	entry.mSize = (uint32_t)byteCode.size();
+	pCache->mNewEntries.push_back(entry);
+	pCache->mNewData.insert(pCache->mNewData.end(), byteCode.data(), byteCode.data() + byteCode.size());
+}
 
-	// If source code is loaded from a package, its timestamp will be zero. Else check that binary is not older
-	// than source
-	if (sourceTimeStamp && FileSystem::GetLastModifiedTime(binaryShaderName) < sourceTimeStamp)
-		return false;
+void getShaderCacheStats(ShaderCacheStats* pStats)
+{
+	ASSERT(pStats);
+
+	MutexLock lock(gShaderCache.mMutex);
+	pStats->mHitCount = gShaderCache.mHitCount;
+	pStats->mMissCount = gShaderCache.mMissCount;
+	pStats->mDuplicateCount = gShaderCache.mDuplicateCount;
+	pStats->mEntryCount = gShaderCache.mEntryCount + (uint32_t)gShaderCache.mNewEntries.size();
+	pStats->mFileSize = gShaderCache.pEntries ? ((const ShaderCacheHeader*)gShaderCache.pFileData)->mFileSize : 0;
+	pStats->mKeyTime = gShaderCache.mKeyTime;
+	pStats->mCompileTime = gShaderCache.mCompileTime;
+}
+
+static void releaseShaderCache()
+{
+	MutexLock lock(gShaderCache.mMutex);
+	closeShaderCache(&gShaderCache);
+}
+
+/************************************************************************/
+// Shader source preprocessing
+/************************************************************************/
+// A source file of the shaders of one addShaders call. Each file is read once, however many stages include it.
+typedef struct ShaderSourceFile
+{
+	String mName;
+	tinystl::vector<char> mText;
+	/// Files named by the include directives of this file, in order
+	tinystl::vector<uint32_t> mIncludes;
+	/// The file or one of its includes could not be read
+	bool mFailed;
+} ShaderSourceFile;
+
+typedef struct ShaderSourceCache
+{
+	tinystl::vector<ShaderSourceFile> mFiles;
+	/// Scratch flags of collect_shader_dependencies, one per file
+	tinystl::vector<uint8_t> mVisited;
+} ShaderSourceCache;
 
-	File file = {}; file.Open(binaryShaderName, FM_ReadBinary, FSR_Absolute);
-	if (!file.IsOpen())
+// Finds the '"' delimited file names of the include directives in pText
+static void find_shader_includes(const char* pText, uint32_t size, tinystl::vector<String>& outNames)
+{
+	static const char directive[] = "#include \"";
+	const uint32_t directiveLength = sizeof(directive) - 1;
+	const char* pEnd = pText + size;
+	const char* pCurrent = pText;
+
+	// memchr is vectorized by the C runtime, directives are rare compared to other characters
+	while ((pCurrent = (const char*)memchr(pCurrent, '#', pEnd - pCurrent)) != NULL)
 	{
-		LOGERROR(binaryShaderName + " is not a valid shader bytecode file");
-		return false;
+		if ((uint32_t)(pEnd - pCurrent) < directiveLength || memcmp(pCurrent, directive, directiveLength) != 0)
+		{
+			++pCurrent;
+			continue;
+		}
+
+		const char* pName = pCurrent + directiveLength;
+		const char* pLineEnd = (const char*)memchr(pName, '\n', pEnd - pName);
+		if (!pLineEnd)
+			pLineEnd = pEnd;
+		const char* pNameEnd = (const char*)memchr(pName, '"', pLineEnd - pName);
+		if (pNameEnd)
+			outNames.push_back(String(pName, pNameEnd - pName));
+		pCurrent = pLineEnd;
 	}
+}
 
-	byteCode.resize(file.GetSize());
-	memcpy(byteCode.data(), file.ReadText().c_str(), byteCode.size());
-	return true;
+// Returns the index of the file in the source cache, reading it and the files it includes if they are not cached yet.
+// Returns UINT32_MAX if the file or one of its includes could not be read
+static uint32_t load_shader_source(ShaderSourceCache* pCache, const String& fileName, FSRoot root)
+{
+	String fullName = FileSystem::FixPath(fileName, root);
+	for (uint32_t i = 0; i < (uint32_t)pCache->mFiles.size(); ++i)
+	{
+		if (pCache->mFiles[i].mName == fullName)
+			return pCache->mFiles[i].mFailed ? UINT32_MAX : i;
+	}
+
+	// The file is added before its includes are loaded so include cycles end here
+	uint32_t index = (uint32_t)pCache->mFiles.size();
+	pCache->mFiles.push_back(ShaderSourceFile());
+	pCache->mVisited.push_back(0);
+	ShaderSourceFile* pFile = &pCache->mFiles[index];
+	pFile->mName = fullName;
+	pFile->mFailed = true;
+
+	// One block read per file instead of reading it line by line
+	File file = {};
+	if (!file.Open(fullName, FM_ReadBinary, FSR_Absolute))
+		return UINT32_MAX;
+	pFile->mText.resize(file.GetSize());
+	uint32_t readSize = file.Read(pFile->mText.data(), file.GetSize());
+	file.Close();
+	if (readSize != pFile->mText.size())
+		return UINT32_MAX;
+	pFile->mFailed = false;
+
+	tinystl::vector<String> includeNames;
+	find_shader_includes(pFile->mText.data(), readSize, includeNames);
+	String path = FileSystem::GetPath(fullName);
+	for (uint32_t i = 0; i < (uint32_t)includeNames.size(); ++i)
+	{
+		// Loading the include may grow mFiles, so the file is looked up again afterwards
+		uint32_t includeIndex = load_shader_source(pCache, path + includeNames[i], FSR_Absolute);
+		if (includeIndex == UINT32_MAX)
+		{
+			LOGERRORF("Could not open %s included by %s", (path + includeNames[i]).c_str(), fullName.c_str());
+			pCache->mFiles[index].mFailed = true;
+			return UINT32_MAX;
+		}
+		pCache->mFiles[index].mIncludes.push_back(includeIndex);
+	}
+
+	return index;
 }
 
-// Saves bytecode to a file
-bool save_byte_code(const String& binaryShaderName, const tinystl::vector<char>& byteCode)
+// Appends every file the source depends on to outDependencies, in include order. A file which is included several
+// times, by the same or by different files, is listed once: the key only has to cover its text once.
+static void collect_shader_dependencies(ShaderSourceCache* pCache, uint32_t file, tinystl::vector<uint32_t>& outDependencies)
 {
-	String path = FileSystem::GetPath(binaryShaderName);
-	if (!FileSystem::DirExists(path))
-		FileSystem::CreateDir(path);
+	if (pCache->mVisited[file])
+		return;
 
-	File outFile = {};
-	outFile.Open(binaryShaderName, FM_WriteBinary, FSR_Absolute);
+	pCache->mVisited[file] = 1;
+	outDependencies.push_back(file);
+	for (uint32_t i = 0; i < (uint32_t)pCache->mFiles[file].mIncludes.size(); ++i)
+		collect_shader_dependencies(pCache, pCache->mFiles[file].mIncludes[i], outDependencies);
+}
 
-	if (!outFile.IsOpen())
+// Appends the text of the source file and everything it depends on to outKeyData.
+// pOutCode receives the text of the source file only, if it is not NULL.
+static bool preprocess_shader_source(ShaderSourceCache* pCache, const String& fileName, FSRoot root, tinystl::vector<char>& outKeyData, String* pOutCode)
+{
+	uint32_t file = load_shader_source(pCache, fileName, root);
+	if (file == UINT32_MAX)
 		return false;
 
-	outFile.Write(byteCode.data(), (uint32_t)byteCode.size() * sizeof(char));
-	outFile.Close();
+	tinystl::vector<uint32_t> dependencies;
+	collect_shader_dependencies(pCache, file, dependencies);
 
+	// Size the key buffer once, then copy every file into it
+	size_t keySize = outKeyData.size();
+	for (uint32_t i = 0; i < (uint32_t)dependencies.size(); ++i)
+	{
+		pCache->mVisited[dependencies[i]] = 0;
+		keySize += pCache->mFiles[dependencies[i]].mText.size();
+	}
+	size_t offset = outKeyData.size();
+	outKeyData.resize(keySize);
+	for (uint32_t i = 0; i < (uint32_t)dependencies.size(); ++i)
+	{
+		const tinystl::vector<char>& text = pCache->mFiles[dependencies[i]].mText;
+		if (text.size())
+			memcpy(outKeyData.data() + offset, text.data(), text.size());
+		offset += text.size();
+	}
+
+	if (pOutCode)
+	{
+		const tinystl::vector<char>& code = pCache->mFiles[file].mText;
+		*pOutCode = String(code.data(), code.size());
+	}
 	return true;
 }
 
@@ -1109,66 +1855,206 @@ bool save_byte_code(const String& binaryShaderName, const tinystl::vector<char>&
 #define RENDERER_API "OSXMetal"
 #endif
 
-bool load_shader_stage_byte_code(Renderer* pRenderer, ShaderStage stage, const char* fileName, FSRoot root, uint32_t macroCount, ShaderMacro* pMacros, tinystl::vector<char>& byteCode)
+// Part of every cache key, so bytecode of another compiler or compiler configuration is never loaded
+static String getShaderCompilerVersion(Renderer* pRenderer)
 {
-	File shaderSource = {};
-	String code;
-	uint32_t timeStamp = 0;
-    
-#ifndef METAL
-    const char* shaderName = fileName;
+#if defined(VULKAN)
+	// glslangValidator is run from the SDK, whose path contains its version
+	const char* vulkanSdk = getenv("VULKAN_SDK");
+	return String("glslangValidator ") + (vulkanSdk ? vulkanSdk : "");
+#elif defined(METAL)
+#if defined(MAC_OS_X_VERSION_MAX_ALLOWED)
+	return String::format("metal %d", MAC_OS_X_VERSION_MAX_ALLOWED);
+#else
+	return String("metal");
+#endif
+#else
+	// compileShader picks its flags from the build configuration and the shader target
+#if defined(_DEBUG)
+	return String::format("d3dcompiler_47 debug %u", (uint32_t)pRenderer->mSettings.mShaderTarget);
+#else
+	return String::format("d3dcompiler_47 release %u", (uint32_t)pRenderer->mSettings.mShaderTarget);
+#endif
+#endif
+}
+
+static String getShaderCacheFileName(Renderer* pRenderer)
+{
+#ifdef _DURANGO
+	return FileSystem::GetAppPreferencesDir(NULL, NULL) + "/" + pRenderer->pName + "/CompiledShadersBinary/ShaderCache.bin";
 #else
-    // Metal shader files need to have the .metal extension.
-    String metalShaderName = String(fileName) + ".metal";
-    const char* shaderName = metalShaderName.c_str();
+	return FileSystem::GetProgramDir() + "/" + pRenderer->pName + String("/" RENDERER_API "/CompiledShadersBinary/ShaderCache.bin");
 #endif
+}
 
-	shaderSource.Open(shaderName, FM_ReadBinary, root);
-	ASSERT(shaderSource.IsOpen());
+// One stage of a shader loaded by addShaders
+typedef struct ShaderStageLoad
+{
+	const ShaderStageLoadDesc* pDesc;
+	ShaderStage mStage;
+	ShaderCacheKey mKey;
+	String mSourceName;
+	/// Source of the stage without the included files, passed to the D3D12 compiler
+	String mCode;
+	tinystl::vector<char> mByteCode;
+	/// Serialized reflection of the bytecode, empty until the renderer reflected it once
+	tinystl::vector<char> mReflection;
+	/// Stage with the same key which is compiled in place of this one, or UINT32_MAX
+	uint32_t mDuplicateOf;
+	bool mFailed;
+} ShaderStageLoad;
+
+typedef struct ShaderStageCompileBatch
+{
+	Renderer* pRenderer;
+	ShaderStageLoad* pStages;
+	const uint32_t* pIndices;
+} ShaderStageCompileBatch;
 
-	if (!process_source_file(&shaderSource, &shaderSource, timeStamp, code))
-		return false;
+// Computes the cache key of the stage and loads its bytecode if the key is in the cache
+static bool prepare_shader_stage(Renderer* pRenderer, ShaderSourceCache* pSourceCache, ShaderStageLoad* pLoad)
+{
+	const ShaderStageLoadDesc* pDesc = pLoad->pDesc;
+	int64_t keyStartTime = getUSec();
 
-	String name, extension, path;
-	FileSystem::SplitPath(fileName, &path, &name, &extension);
-	String shaderDefines;
-	for (uint32_t i = 0; i < macroCount; ++i)
+#ifndef METAL
+	const String& shaderName = pDesc->mFileName;
+#else
+	// Metal shader files need to have the .metal extension.
+	String shaderName = pDesc->mFileName + ".metal";
+#endif
+
+	pLoad->mSourceName = FileSystem::FixPath(shaderName, pDesc->mRoot);
+
+	// The key covers everything the bytecode depends on: target API, compiler, stage, macros and the preprocessed source
+	String header = RENDERER_API "\n";
+	header += getShaderCompilerVersion(pRenderer) + String::format("\n%u\n%u\n", (uint32_t)pLoad->mStage, pDesc->mMacroCount);
+	for (uint32_t i = 0; i < pDesc->mMacroCount; ++i)
 	{
-		shaderDefines += (pMacros[i].definition + pMacros[i].value);
+		header += pDesc->pMacros[i].definition + "=" + pDesc->pMacros[i].value + "\n";
 	}
+	tinystl::vector<char> keyData(header.c_str(), header.c_str() + header.size());
 
-#ifdef _DURANGO
-	String binaryShaderName = FileSystem::GetAppPreferencesDir(NULL,NULL) + "/" + pRenderer->pName + "/CompiledShadersBinary/" +
-		FileSystem::GetFileName(fileName) + String::format("_%zu", tinystl::hash(shaderDefines)) + extension + ".bin";
+#if defined(VULKAN) || defined(METAL)
+	String* pCode = NULL;
 #else
-	String binaryShaderName = FileSystem::GetProgramDir() + "/" + pRenderer->pName + String("/" RENDERER_API "/CompiledShadersBinary/") +
-		FileSystem::GetFileName(fileName) + String::format("_%zu", tinystl::hash(shaderDefines)) + extension + ".bin";
+	// The D3D12 compiler gets the code of the stage, the other compilers read the file themselves
+	String* pCode = &pLoad->mCode;
+#endif
+	if (!preprocess_shader_source(pSourceCache, pLoad->mSourceName, FSR_Absolute, keyData, pCode))
+		return false;
+
+#if defined(VULKAN)
+	// compileShader passes the limits in the config file of the shader directory to the compiler
+	String configFileName = FileSystem::GetPath(pLoad->mSourceName) + "/config.conf";
+	if (FileSystem::FileExists(configFileName, FSR_Absolute) && !preprocess_shader_source(pSourceCache, configFileName, FSR_Absolute, keyData, NULL))
+		return false;
 #endif
 
-	// Shader source is newer than binary
-	if (!check_for_byte_code(binaryShaderName, timeStamp, byteCode))
+	pLoad->mKey = hashShaderCacheKey(keyData.data(), keyData.size());
+	String cacheFileName = getShaderCacheFileName(pRenderer);
+
+	MutexLock lock(gShaderCache.mMutex);
+	gShaderCache.mKeyTime += getUSec() - keyStartTime;
+	openShaderCache(&gShaderCache, cacheFileName);
+	if (findShaderByteCode(&gShaderCache, pLoad->mKey, pLoad->mByteCode))
 	{
+		++gShaderCache.mHitCount;
+#if !defined(METAL)
+		findShaderByteCode(&gShaderCache, getShaderReflectionCacheKey(pLoad->mKey), pLoad->mReflection);
+#endif
+	}
+
+	return true;
+}
+
+// Compiles a stage which was not in the cache and adds it to the cache. Called on the compile threads
+static bool compile_shader_stage(Renderer* pRenderer, ShaderStageLoad* pLoad)
+{
+	const ShaderStageLoadDesc* pDesc = pLoad->pDesc;
+	int64_t compileStartTime = getUSec();
+
 #if defined(VULKAN) || defined(METAL)
-		compileShader(pRenderer, shaderSource.GetName(), binaryShaderName, macroCount, pMacros, &byteCode);
+	// The compilers write the bytecode to a file, it is only needed until it is in the cache.
+	// The key is part of the name so permutations compiled at the same time don't overwrite each other.
+	String name, extension, path;
+	FileSystem::SplitPath(pDesc->mFileName, &path, &name, &extension);
+	String intermediateFileName = FileSystem::GetPath(getShaderCacheFileName(pRenderer)) + FileSystem::GetFileName(pDesc->mFileName) +
+		String::format("_%016llx%016llx", (unsigned long long)pLoad->mKey.mHash[0], (unsigned long long)pLoad->mKey.mHash[1]) + extension + ".bin";
+	compileShader(pRenderer, pLoad->mSourceName, intermediateFileName, pDesc->mMacroCount, pDesc->pMacros, &pLoad->mByteCode);
+	if (pLoad->mByteCode.size())
+	{
+		FileSystem::Delete(intermediateFileName);
+#if defined(VULKAN)
+		FileSystem::Delete(intermediateFileName + "_compile.log");
+#endif
+	}
 #else
-		compileShader(pRenderer, stage, shaderSource.GetName(), code, macroCount, pMacros, &byteCode);
-		if (!save_byte_code(binaryShaderName, byteCode))
-		{
-            const char* shaderName = shaderSource.GetName();
-			LOGWARNINGF("Failed to save byte code for file %s", shaderName);
-		}
+	compileShader(pRenderer, pLoad->mStage, pLoad->mSourceName, pLoad->mCode, pDesc->mMacroCount, pDesc->pMacros, &pLoad->mByteCode);
 #endif
-		if (!byteCode.size())
+	int64_t compileTime = getUSec() - compileStartTime;
+
+	// Logged instead of a message box, the compile threads would block on one box per failed stage.
+	// The shaders with a failed stage stay NULL.
+	if (!pLoad->mByteCode.size())
+	{
+		LOGERRORF("Error while generating bytecode for shader %s", pDesc->mFileName.c_str());
+		return false;
+	}
+
+	LOGINFOF("Compiled shader %s in %.1f ms", pDesc->mFileName.c_str(), compileTime / 1000.0);
+
+	MutexLock lock(gShaderCache.mMutex);
+	++gShaderCache.mMissCount;
+	gShaderCache.mCompileTime += compileTime;
+	addShaderByteCode(&gShaderCache, pLoad->mKey, pLoad->mByteCode);
+	return true;
+}
+
+#if !defined(METAL)
+// Adds the reflection the renderer created for the stages of the shader to the cache, so the next load doesn't have to
+// reflect the bytecode. Metal reflects the shader source instead.
+static void add_shader_reflections(Shader* pShader, ShaderStageLoad* pStages, uint32_t stageCount)
+{
+	const PipelineReflection* pReflection = &pShader->mReflection;
+	MutexLock lock(gShaderCache.mMutex);
+	for (uint32_t i = 0; i < stageCount; ++i)
+	{
+		ShaderStageLoad* pLoad = &pStages[i];
+		if (pLoad->mReflection.size())
+			continue;
+
+		// Stages shared by several shaders are only added once
+		ShaderCacheKey key = getShaderReflectionCacheKey(pLoad->mKey);
+		if (findShaderByteCode(&gShaderCache, key, pLoad->mReflection))
+			continue;
+
+		for (uint32_t j = 0; j < pReflection->mStageReflectionCount; ++j)
 		{
-			ErrorMsg("Error while generating bytecode for shader %s", fileName);
-            shaderSource.Close();
-			return false;
+			const ShaderReflection* pStageReflection = &pReflection->mStageReflections[j];
+			if (pStageReflection->mShaderStage != pLoad->mStage)
+				continue;
+
+			pLoad->mReflection.resize(getSerializedReflectionSize(pStageReflection));
+			MemoryBuffer buffer(pLoad->mReflection.data(), (unsigned)pLoad->mReflection.size());
+			if (serializeReflection(&buffer, pStageReflection))
+				addShaderByteCode(&gShaderCache, key, pLoad->mReflection);
+			break;
 		}
 	}
+}
+#endif
 
-    shaderSource.Close();
-	return true;
+static void compileShaderStages(void* pData, uint32_t begin, uint32_t end)
+{
+	ShaderStageCompileBatch* pBatch = (ShaderStageCompileBatch*)pData;
+	for (uint32_t i = begin; i < end; ++i)
+	{
+		ShaderStageLoad* pLoad = &pBatch->pStages[pBatch->pIndices[i]];
+		pLoad->mFailed = !compile_shader_stage(pBatch->pRenderer, pLoad);
+	}
 }
+
 #ifdef TARGET_IOS
 bool find_shader_stage(const String& fileName, ShaderDesc* pDesc, ShaderStageDesc** pOutStage, ShaderStage* pStage)
 {
@@ -1260,38 +2146,143 @@ bool find_shader_stage(const String& fileName, BinaryShaderDesc* pBinaryDesc, Bi
 	return true;
 }
 #endif
-void addShader(Renderer* pRenderer, const ShaderLoadDesc* pDesc, Shader** ppShader)
+void addShaders(Renderer* pRenderer, uint32_t shaderCount, const ShaderLoadDesc* pDescs, Shader** ppShaders)
 {
 #ifndef TARGET_IOS
-	BinaryShaderDesc binaryDesc = {};
-	tinystl::vector<char> byteCodes[SHADER_STAGE_COUNT] = {};
-	for (uint32_t i = 0; i < SHADER_STAGE_COUNT; ++i)
+	tinystl::vector<ShaderStageLoad> stages;
+	tinystl::vector<uint32_t> firstStages(shaderCount + 1);
+	for (uint32_t i = 0; i < shaderCount; ++i)
 	{
-		if (pDesc->mStages[i].mFileName.size() != 0)
+		firstStages[i] = (uint32_t)stages.size();
+		for (uint32_t j = 0; j < SHADER_STAGE_COUNT; ++j)
 		{
-			ShaderStage stage;
+			BinaryShaderDesc binaryDesc = {};
 			BinaryShaderStageDesc* pStage = NULL;
-			if (find_shader_stage(pDesc->mStages[i].mFileName, &binaryDesc, &pStage, &stage))
+			ShaderStageLoad load = {};
+			load.pDesc = &pDescs[i].mStages[j];
+			load.mDuplicateOf = UINT32_MAX;
+			if (load.pDesc->mFileName.size() != 0 && find_shader_stage(load.pDesc->mFileName, &binaryDesc, &pStage, &load.mStage))
+				stages.push_back(load);
+		}
+	}
+	firstStages[shaderCount] = (uint32_t)stages.size();
+
+	// Hashing the sources is cheap compared to starting the compile threads, so all keys are computed here
+	ShaderSourceCache sourceCache;
+	tinystl::vector<uint32_t> misses;
+	for (uint32_t i = 0; i < (uint32_t)stages.size(); ++i)
+	{
+		ShaderStageLoad* pLoad = &stages[i];
+		pLoad->mFailed = !prepare_shader_stage(pRenderer, &sourceCache, pLoad);
+		if (pLoad->mFailed || pLoad->mByteCode.size())
+			continue;
+
+		// Permutations requested more than once are only compiled once
+		for (uint32_t j = 0; j < (uint32_t)misses.size(); ++j)
+		{
+			if (compareShaderCacheKeys(stages[misses[j]].mKey, pLoad->mKey) == 0)
 			{
-				if (!load_shader_stage_byte_code(pRenderer, stage, pDesc->mStages[i].mFileName, pDesc->mStages[i].mRoot, pDesc->mStages[i].mMacroCount, pDesc->mStages[i].pMacros, byteCodes[i]))
-					return;
+				pLoad->mDuplicateOf = misses[j];
+				break;
+			}
+		}
+		if (pLoad->mDuplicateOf == UINT32_MAX)
+			misses.push_back(i);
+	}
+
+	if (misses.size())
+	{
+		// The compilers run as separate processes, the threads mostly wait for them
+		uint32_t missCount = (uint32_t)misses.size();
+		uint32_t threadCount = min(Thread::GetNumCPUCores(), missCount) - 1;
+		ThreadPool* pThreadPool = NULL;
+		if (threadCount)
+		{
+			pThreadPool = conf_placement_new<ThreadPool>(conf_calloc(1, sizeof(ThreadPool)));
+			pThreadPool->CreateThreads(threadCount);
+		}
+
+		int64_t startTime = getUSec();
+		ShaderStageCompileBatch batch = { pRenderer, stages.data(), misses.data() };
+		if (pThreadPool)
+			parallelFor(pThreadPool, missCount, 1, compileShaderStages, &batch);
+		else
+			compileShaderStages(&batch, 0, missCount);
+		int64_t compileTime = getUSec() - startTime;
+
+		if (pThreadPool)
+		{
+			pThreadPool->~ThreadPool();
+			conf_free(pThreadPool);
+		}
+
+		uint32_t duplicateCount = 0;
+		for (uint32_t i = 0; i < (uint32_t)stages.size(); ++i)
+		{
+			if (stages[i].mDuplicateOf != UINT32_MAX)
+			{
+				stages[i].mByteCode = stages[stages[i].mDuplicateOf].mByteCode;
+				stages[i].mFailed = stages[stages[i].mDuplicateOf].mFailed;
+				++duplicateCount;
+			}
+		}
 
-				binaryDesc.mStages |= stage;
-				pStage->pByteCode = byteCodes[i].data();
-				pStage->mByteCodeSize = (uint32_t)byteCodes[i].size();
+		LOGINFOF("Compiled %u shader stages on %u threads in %.1f ms, %.1f stages per second, %u duplicate stages skipped",
+			missCount, threadCount + 1, compileTime / 1000.0, missCount * 1e6 / max(compileTime, (int64_t)1), duplicateCount);
+
+		MutexLock lock(gShaderCache.mMutex);
+		gShaderCache.mDuplicateCount += duplicateCount;
+	}
+
+	for (uint32_t i = 0; i < shaderCount; ++i)
+	{
+		BinaryShaderDesc binaryDesc = {};
+		bool failed = false;
+		for (uint32_t j = firstStages[i]; j < firstStages[i + 1]; ++j)
+		{
+			ShaderStageLoad* pLoad = &stages[j];
+			ShaderStage stage;
+			BinaryShaderStageDesc* pStage = NULL;
+			find_shader_stage(pLoad->pDesc->mFileName, &binaryDesc, &pStage, &stage);
+			failed |= pLoad->mFailed;
+
+			binaryDesc.mStages |= stage;
+			pStage->pByteCode = pLoad->mByteCode.data();
+			pStage->mByteCodeSize = (uint32_t)pLoad->mByteCode.size();
+			pStage->pReflection = pLoad->mReflection.size() ? pLoad->mReflection.data() : NULL;
+			pStage->mReflectionSize = (uint32_t)pLoad->mReflection.size();
 #if defined(METAL)
-                pStage->mEntryPoint = "stageMain";
-				// In metal, we need the shader source for our reflection system.
-                File metalFile = {};
-                metalFile.Open(pDesc->mStages[i].mFileName + ".metal", FM_Read, pDesc->mStages[i].mRoot);
-                pStage->mSource = metalFile.ReadText();
-                metalFile.Close();
+			pStage->mEntryPoint = "stageMain";
+			// In metal, we need the shader source for our reflection system.
+			File metalFile = {};
+			metalFile.Open(pLoad->pDesc->mFileName + ".metal", FM_Read, pLoad->pDesc->mRoot);
+			pStage->mSource = metalFile.ReadText();
+			metalFile.Close();
+#endif
+		}
+
+		if (!failed)
+		{
+			addShader(pRenderer, &binaryDesc, &ppShaders[i]);
+#if !defined(METAL)
+			add_shader_reflections(ppShaders[i], &stages[firstStages[i]], firstStages[i + 1] - firstStages[i]);
 #endif
-			}
 		}
 	}
 
-	addShader(pRenderer, &binaryDesc, ppShader);
+	// Write what was compiled and reflected right away, shaders are also added outside the lifetime of the resource loader
+	MutexLock lock(gShaderCache.mMutex);
+	saveShaderCache(&gShaderCache);
+#else
+	for (uint32_t i = 0; i < shaderCount; ++i)
+		addShader(pRenderer, &pDescs[i], &ppShaders[i]);
+#endif
+}
+
+void addShader(Renderer* pRenderer, const ShaderLoadDesc* pDesc, Shader** ppShader)
+{
+#ifndef TARGET_IOS
+	addShaders(pRenderer, 1, pDesc, ppShader);
 #else
     // Binary shaders are not supported on iOS.
     ShaderDesc desc = {};
@@ -36,6 +36,10 @@
 #define DEFAULT_MEMORY_BUDGET (uint64_t)6e+7
 #endif
 
+/// Identifies the copy submission an asynchronous load or update was recorded into.
+/// The resource may only be used on the GPU once the token completed.
+typedef uint64_t SyncToken;
+
 typedef struct BufferLoadDesc
 {
 	Buffer** ppBuffer;
@@ -117,6 +121,65 @@ typedef struct ResourceUpdateDesc
 	};
 } ResourceUpdateDesc;
 
+/// Stages threaded loads go through. Texture files are mapped and read by the read stage and decoded by the
+/// decode stage, the upload stage records the uploads of all threaded requests into the copy batches.
+typedef enum ResourceLoadStage
+{
+	RESOURCE_LOAD_STAGE_READ = 0,
+	RESOURCE_LOAD_STAGE_DECODE,
+	RESOURCE_LOAD_STAGE_UPLOAD,
+	RESOURCE_LOAD_STAGE_COUNT,
+} ResourceLoadStage;
+
+typedef struct ResourceLoadStageStats
+{
+	uint32_t mThreadCount;
+	uint32_t mRequestCount;
+	/// Most requests which waited in the input queue of the stage at the same time, and how many fit
+	uint32_t mMaxQueueDepth;
+	uint32_t mQueueCapacity;
+	/// Microseconds the threads of the stage spent working, waiting for input while other requests were
+	/// loading and waiting for room in the queue of the next stage, summed over all threads of the stage
+	uint64_t mBusyTime;
+	uint64_t mInputWaitTime;
+	uint64_t mOutputWaitTime;
+} ResourceLoadStageStats;
+
+typedef struct ResourceLoaderStats
+{
+	/// Staging memory the loader may use, uploads wait for earlier copies once it is used up
+	uint64_t mStagingBudget;
+	/// Most staging memory in use at the same time
+	uint64_t mStagingHighWaterMark;
+	/// Staging memory skipped for alignment and at the end of staging pages
+	uint64_t mStagingWastedBytes;
+	/// Staging allocations which waited for earlier copies to finish, and the microseconds they waited
+	uint64_t mStagingStallCount;
+	uint64_t mStagingStallTime;
+	/// Temporary staging buffers created for subresources larger than a staging page and for textures decoded by the
+	/// load threads
+	uint64_t mTempStagingBytes;
+	/// Copy batches handed to the GPU
+	uint64_t mCopySubmitCount;
+	/// Threaded loading, all zero if the loader was initialized without threads
+	ResourceLoadStageStats mStages[RESOURCE_LOAD_STAGE_COUNT];
+} ResourceLoaderStats;
+
+typedef struct ShaderCacheStats
+{
+	/// Shader stages loaded from the cache and stages compiled because their key was not in it
+	uint32_t mHitCount;
+	uint32_t mMissCount;
+	/// Stages skipped by addShaders because another stage of the same call had the same key
+	uint32_t mDuplicateCount;
+	/// Entries in the cache including the ones not written to the cache file yet, and the size of the file
+	uint32_t mEntryCount;
+	uint64_t mFileSize;
+	/// Microseconds spent reading and hashing shader sources and compiling the stages which missed
+	uint64_t mKeyTime;
+	uint64_t mCompileTime;
+} ShaderCacheStats;
+
 typedef struct ShaderStageLoadDesc
 {
 	String			mFileName;
@@ -140,12 +203,37 @@ void addResources(uint32_t resourceCount, ResourceLoadDesc* pResources, bool thr
 void updateResource(BufferUpdateDesc* pBuffer, bool batch = false);
 void updateResources(uint32_t resourceCount, ResourceUpdateDesc* pResources);
 
+/// Asynchronous versions which record into the current copy batch and return without waiting for the GPU.
+/// Batches are submitted once their staging memory is used up or a token of them is waited on or polled.
+void addResource(BufferLoadDesc* pBuffer, SyncToken* pToken);
+void addResource(TextureLoadDesc* pTexture, SyncToken* pToken);
+void addResources(uint32_t resourceCount, ResourceLoadDesc* pResources, SyncToken* pToken);
+
+void updateResource(BufferUpdateDesc* pBuffer, SyncToken* pToken);
+void updateResources(uint32_t resourceCount, ResourceUpdateDesc* pResources, SyncToken* pToken);
+
+bool isTokenCompleted(SyncToken token);
+void waitForToken(SyncToken token);
+
+/// Staging memory counters and the timings and queue depths of the threaded loading stages
+void getResourceLoaderStats(ResourceLoaderStats* pStats);
+
 void flushResourceUpdates();
 
 void removeResource(Buffer* pBuffer);
 void removeResource(Texture* pTexture);
 
+/// Waits for threaded loads and every other upload, logs the stats of the loading stages
 void finishResourceLoading();
 
-/// Either loads the cached shader bytecode or compiles the shader to create new bytecode depending on whether source is newer than binary
+/// Loads the bytecode of each stage from the shader cache or compiles it and adds it to the cache.
+/// Entries are keyed by a hash of the target API, the compiler, the macros and the source including every included file,
+/// all of them are stored in one cache file per application which is mapped on first use.
+/// The reflection of the bytecode is cached next to it, so loading from the cache doesn't reflect the bytecode again.
 void addShader(Renderer* pRenderer, const ShaderLoadDesc* pDesc, Shader** ppShader);
+/// Loads several shaders at once. Stages missing from the cache are compiled on a thread per core,
+/// stages with the same key are only compiled once.
+void addShaders(Renderer* pRenderer, uint32_t shaderCount, const ShaderLoadDesc* pDescs, Shader** ppShaders);
+
+/// Hit and miss counts of the shader cache
+void getShaderCacheStats(ShaderCacheStats* pStats);
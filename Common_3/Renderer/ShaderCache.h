@@ -0,0 +1,221 @@
+/*
+ * Copyright (c) 2018 Confetti Interactive Inc.
+ *
+ * This file is part of The-Forge
+ * (see https://github.com/ConfettiFX/The-Forge).
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+// Layout of the shader bytecode cache file.
+// All compiled permutations of an application live in one file: a header, an index sorted by key and the bytecode.
+// Keys are 128 bit hashes of everything the bytecode depends on, so the index can be searched in place after
+// mapping the file. Only does the layout and hashing so it can be tested without a compiler.
+
+#define SHADER_CACHE_MAGIC 0x43534654U // "TFSC"
+#define SHADER_CACHE_VERSION 1U
+#define SHADER_CACHE_DATA_ALIGNMENT 16U
+
+typedef struct ShaderCacheKey
+{
+	uint64_t mHash[2];
+} ShaderCacheKey;
+
+typedef struct ShaderCacheEntry
+{
+	ShaderCacheKey mKey;
+	/// Offset of the bytecode from the start of the file
+	uint64_t mOffset;
+	uint32_t mSize;
+	uint32_t mPad;
+} ShaderCacheEntry;
+
+typedef struct ShaderCacheHeader
+{
+	uint32_t mMagic;
+	uint32_t mVersion;
+	uint32_t mEntryCount;
+	uint32_t mPad;
+	/// Size of the whole file, a shorter file was not written completely
+	uint64_t mFileSize;
+	uint64_t mPad1;
+	// ShaderCacheEntry mEntries[mEntryCount] follow, then the bytecode
+} ShaderCacheHeader;
+
+static inline uint64_t rotlShaderCacheHash(uint64_t x, int r)
+{
+	return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t fmixShaderCacheHash(uint64_t k)
+{
+	k ^= k >> 33;
+	k *= 0xff51afd7ed558ccdULL;
+	k ^= k >> 33;
+	k *= 0xc4ceb9fe1a85ec53ULL;
+	k ^= k >> 33;
+	return k;
+}
+
+// MurmurHash3 x64 128 by Austin Appleby, public domain
+static inline ShaderCacheKey hashShaderCacheKey(const void* pData, size_t size)
+{
+	const uint8_t* pBytes = (const uint8_t*)pData;
+	const size_t blockCount = size / 16;
+	const uint64_t c1 = 0x87c37b91114253d5ULL;
+	const uint64_t c2 = 0x4cf5ad432745937fULL;
+	uint64_t h1 = 0;
+	uint64_t h2 = 0;
+
+	for (size_t i = 0; i < blockCount; ++i)
+	{
+		uint64_t k1, k2;
+		memcpy(&k1, pBytes + i * 16, sizeof(k1));
+		memcpy(&k2, pBytes + i * 16 + 8, sizeof(k2));
+
+		k1 *= c1; k1 = rotlShaderCacheHash(k1, 31); k1 *= c2; h1 ^= k1;
+		h1 = rotlShaderCacheHash(h1, 27); h1 += h2; h1 = h1 * 5 + 0x52dce729;
+		k2 *= c2; k2 = rotlShaderCacheHash(k2, 33); k2 *= c1; h2 ^= k2;
+		h2 = rotlShaderCacheHash(h2, 31); h2 += h1; h2 = h2 * 5 + 0x38495ab5;
+	}
+
+	const uint8_t* pTail = pBytes + blockCount * 16;
+	uint64_t k1 = 0;
+	uint64_t k2 = 0;
+	switch (size & 15)
+	{
+	case 15: k2 ^= (uint64_t)pTail[14] << 48; /* fallthrough */
+	case 14: k2 ^= (uint64_t)pTail[13] << 40; /* fallthrough */
+	case 13: k2 ^= (uint64_t)pTail[12] << 32; /* fallthrough */
+	case 12: k2 ^= (uint64_t)pTail[11] << 24; /* fallthrough */
+	case 11: k2 ^= (uint64_t)pTail[10] << 16; /* fallthrough */
+	case 10: k2 ^= (uint64_t)pTail[9] << 8; /* fallthrough */
+	case 9: k2 ^= (uint64_t)pTail[8];
+		k2 *= c2; k2 = rotlShaderCacheHash(k2, 33); k2 *= c1; h2 ^= k2; /* fallthrough */
+	case 8: k1 ^= (uint64_t)pTail[7] << 56; /* fallthrough */
+	case 7: k1 ^= (uint64_t)pTail[6] << 48; /* fallthrough */
+	case 6: k1 ^= (uint64_t)pTail[5] << 40; /* fallthrough */
+	case 5: k1 ^= (uint64_t)pTail[4] << 32; /* fallthrough */
+	case 4: k1 ^= (uint64_t)pTail[3] << 24; /* fallthrough */
+	case 3: k1 ^= (uint64_t)pTail[2] << 16; /* fallthrough */
+	case 2: k1 ^= (uint64_t)pTail[1] << 8; /* fallthrough */
+	case 1: k1 ^= (uint64_t)pTail[0];
+		k1 *= c1; k1 = rotlShaderCacheHash(k1, 31); k1 *= c2; h1 ^= k1;
+	}
+
+	h1 ^= (uint64_t)size;
+	h2 ^= (uint64_t)size;
+	h1 += h2;
+	h2 += h1;
+	h1 = fmixShaderCacheHash(h1);
+	h2 = fmixShaderCacheHash(h2);
+	h1 += h2;
+	h2 += h1;
+
+	ShaderCacheKey key = { { h1, h2 } };
+	return key;
+}
+
+// The reflection of a stage is stored as an entry of its own, under a key derived from the key of the bytecode
+static inline ShaderCacheKey getShaderReflectionCacheKey(const ShaderCacheKey& byteCodeKey)
+{
+	const char tag[] = "reflection";
+	uint8_t data[sizeof(ShaderCacheKey) + sizeof(tag)];
+	memcpy(data, &byteCodeKey, sizeof(ShaderCacheKey));
+	memcpy(data + sizeof(ShaderCacheKey), tag, sizeof(tag));
+	return hashShaderCacheKey(data, sizeof(data));
+}
+
+static inline int compareShaderCacheKeys(const ShaderCacheKey& a, const ShaderCacheKey& b)
+{
+	if (a.mHash[0] != b.mHash[0])
+		return a.mHash[0] < b.mHash[0] ? -1 : 1;
+	if (a.mHash[1] != b.mHash[1])
+		return a.mHash[1] < b.mHash[1] ? -1 : 1;
+	return 0;
+}
+
+static inline uint64_t getShaderCacheDataOffset(uint32_t entryCount)
+{
+	uint64_t offset = sizeof(ShaderCacheHeader) + (uint64_t)entryCount * sizeof(ShaderCacheEntry);
+	return (offset + SHADER_CACHE_DATA_ALIGNMENT - 1) & ~(uint64_t)(SHADER_CACHE_DATA_ALIGNMENT - 1);
+}
+
+/// Returns the index of a cache file or NULL if pData is not a complete cache file of this version
+static inline const ShaderCacheEntry* getShaderCacheIndex(const void* pData, uint64_t size, uint32_t* pEntryCount)
+{
+	*pEntryCount = 0;
+	if (!pData || size < sizeof(ShaderCacheHeader))
+		return NULL;
+
+	const ShaderCacheHeader* pHeader = (const ShaderCacheHeader*)pData;
+	if (pHeader->mMagic != SHADER_CACHE_MAGIC || pHeader->mVersion != SHADER_CACHE_VERSION || pHeader->mFileSize != size ||
+		getShaderCacheDataOffset(pHeader->mEntryCount) > size)
+		return NULL;
+
+	const ShaderCacheEntry* pEntries = (const ShaderCacheEntry*)(pHeader + 1);
+	for (uint32_t i = 0; i < pHeader->mEntryCount; ++i)
+	{
+		if (pEntries[i].mOffset > size || pEntries[i].mSize > size - pEntries[i].mOffset)
+			return NULL;
+	}
+
+	*pEntryCount = pHeader->mEntryCount;
+	return pEntries;
+}
+
+/// Binary search in an index sorted by key, returns NULL if the key is not in the index
+static inline const ShaderCacheEntry* findShaderCacheEntry(const ShaderCacheEntry* pEntries, uint32_t entryCount, const ShaderCacheKey& key)
+{
+	uint32_t first = 0;
+	uint32_t last = entryCount;
+	while (first < last)
+	{
+		uint32_t middle = first + (last - first) / 2;
+		int order = compareShaderCacheKeys(pEntries[middle].mKey, key);
+		if (order == 0)
+			return &pEntries[middle];
+		if (order < 0)
+			first = middle + 1;
+		else
+			last = middle;
+	}
+
+	return NULL;
+}
+
+static inline void sortShaderCacheEntries(ShaderCacheEntry* pEntries, uint32_t entryCount)
+{
+	// Insertion sort, the entries are mostly sorted already since new ones are appended to a sorted index
+	for (uint32_t i = 1; i < entryCount; ++i)
+	{
+		ShaderCacheEntry entry = pEntries[i];
+		uint32_t j = i;
+		while (j > 0 && compareShaderCacheKeys(pEntries[j - 1].mKey, entry.mKey) > 0)
+		{
+			pEntries[j] = pEntries[j - 1];
+			--j;
+		}
+		pEntries[j] = entry;
+	}
+}
@@ -0,0 +1,168 @@
+/*
+ * Copyright (c) 2018 Confetti Interactive Inc.
+ * 
+ * This file is part of The-Forge
+ * (see https://github.com/ConfettiFX/The-Forge).
+ * 
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ * 
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include "../OS/Interfaces/ILogManager.h"
+
+// Staging memory ring of the resource loader.
+// Only does the offset bookkeeping so it can be tested without a GPU. The ring covers mPageCount pages of mPageSize bytes
+// and allocations never cross a page, so every page can be backed by its own upload buffer. Each allocation is tagged
+// with the token of the copy submission reading it and becomes reusable once that token is released.
+
+#define STAGING_RING_MAX_PENDING_TOKENS 16U
+
+typedef struct StagingRingMarker
+{
+	uint64_t mToken;
+	/// Ring position right after the last allocation of mToken
+	uint64_t mEnd;
+} StagingRingMarker;
+
+typedef struct StagingRing
+{
+	uint64_t mPageSize;
+	uint32_t mPageCount;
+
+	/// Positions grow monotonically, the offset of a position in the ring is position % (mPageSize * mPageCount)
+	uint64_t mHead;
+	uint64_t mTail;
+
+	/// Tokens owning memory between mTail and mHead, oldest first
+	StagingRingMarker mMarkers[STAGING_RING_MAX_PENDING_TOKENS];
+	uint32_t mMarkerCount;
+
+	/// Most bytes in use at the same time
+	uint64_t mHighWaterMark;
+	/// Bytes skipped for alignment and at the end of pages while they were held by older allocations
+	uint64_t mWastedBytes;
+	/// Allocations which had to wait for older tokens to be released, and the microseconds they waited
+	uint64_t mStallCount;
+	uint64_t mStallTime;
+} StagingRing;
+
+static inline void initStagingRing(StagingRing* pRing, uint64_t pageSize, uint32_t pageCount)
+{
+	ASSERT(pageSize && pageCount);
+
+	memset(pRing, 0, sizeof(*pRing));
+	pRing->mPageSize = pageSize;
+	pRing->mPageCount = pageCount;
+}
+
+static inline uint64_t getStagingRingSize(const StagingRing* pRing)
+{
+	return pRing->mPageSize * pRing->mPageCount;
+}
+
+static inline uint64_t getStagingRingUsage(const StagingRing* pRing)
+{
+	return pRing->mHead - pRing->mTail;
+}
+
+/// Bytes left in the page the next allocation with this alignment goes to
+static inline uint64_t getStagingRingPageSpace(const StagingRing* pRing, uint64_t alignment)
+{
+	uint64_t position = pRing->mHead;
+	if (alignment != 0 && position % alignment != 0)
+		position = position - position % alignment + alignment;
+	return pRing->mPageSize - position % pRing->mPageSize;
+}
+
+/// Returns true if token owns memory which is not released yet
+static inline bool isStagingRingTokenPending(const StagingRing* pRing, uint64_t token)
+{
+	for (uint32_t i = 0; i < pRing->mMarkerCount; ++i)
+	{
+		if (pRing->mMarkers[i].mToken == token)
+			return true;
+	}
+	return false;
+}
+
+/// Allocates size bytes for token and returns their offset in the ring.
+/// Returns false without changing the ring if there is not enough free memory before older tokens are released.
+/// Tokens have to be allocated for in increasing order and size can't be larger than a page.
+static inline bool stagingRingAllocate(StagingRing* pRing, uint64_t size, uint64_t alignment, uint64_t token, uint64_t* pOffset)
+{
+	ASSERT(size <= pRing->mPageSize);
+	ASSERT(alignment == 0 || pRing->mPageSize % alignment == 0);
+	ASSERT(!pRing->mMarkerCount || pRing->mMarkers[pRing->mMarkerCount - 1].mToken <= token);
+
+	uint64_t position = pRing->mHead;
+	if (alignment != 0 && position % alignment != 0)
+		position = position - position % alignment + alignment;
+	if (position % pRing->mPageSize + size > pRing->mPageSize)
+		position = position - position % pRing->mPageSize + pRing->mPageSize;
+
+	// Skipped memory of an empty ring isn't held by anything
+	uint64_t tail = pRing->mHead == pRing->mTail ? position : pRing->mTail;
+	if (position + size - tail > getStagingRingSize(pRing))
+		return false;
+
+	if (!pRing->mMarkerCount || pRing->mMarkers[pRing->mMarkerCount - 1].mToken != token)
+	{
+		if (pRing->mMarkerCount == STAGING_RING_MAX_PENDING_TOKENS)
+			return false;
+		pRing->mMarkers[pRing->mMarkerCount++].mToken = token;
+	}
+
+	if (pRing->mHead != pRing->mTail)
+		pRing->mWastedBytes += position - pRing->mHead;
+	pRing->mTail = tail;
+	pRing->mHead = position + size;
+	pRing->mMarkers[pRing->mMarkerCount - 1].mEnd = pRing->mHead;
+	if (pRing->mHead - pRing->mTail > pRing->mHighWaterMark)
+		pRing->mHighWaterMark = pRing->mHead - pRing->mTail;
+
+	*pOffset = position % getStagingRingSize(pRing);
+	return true;
+}
+
+/// Counts an allocation which waited time microseconds for the release of older tokens after stagingRingAllocate failed
+static inline void stagingRingAddStall(StagingRing* pRing, uint64_t time)
+{
+	++pRing->mStallCount;
+	pRing->mStallTime += time;
+}
+
+/// Makes the memory of all tokens up to and including completedToken reusable
+static inline void stagingRingRelease(StagingRing* pRing, uint64_t completedToken)
+{
+	uint32_t released = 0;
+	while (released < pRing->mMarkerCount && pRing->mMarkers[released].mToken <= completedToken)
+		pRing->mTail = pRing->mMarkers[released++].mEnd;
+
+	pRing->mMarkerCount -= released;
+	memmove(pRing->mMarkers, pRing->mMarkers + released, pRing->mMarkerCount * sizeof(StagingRingMarker));
+
+	// Nothing is held anymore, start over at the beginning of the page to keep reusing memory that is still in the cache
+	if (!pRing->mMarkerCount)
+	{
+		pRing->mTail -= pRing->mTail % pRing->mPageSize;
+		pRing->mHead = pRing->mTail;
+	}
+}
@@ -207,7 +207,7 @@ namespace RENDERER_CPP_NAMESPACE {
 		VK_FORMAT_UNDEFINED, // GNF_BC4 = 75,
 		VK_FORMAT_UNDEFINED, // GNF_BC5 = 76,
 		VK_FORMAT_UNDEFINED, // GNF_BC6 = 77,
-		VK_FORMAT_UNDEFINED, // GNF_BC7 = 78,
+		VK_FORMAT_BC7_UNORM_BLOCK, // GNF_BC7 = 78,
 		// Reveser Form
 		VK_FORMAT_B8G8R8A8_UNORM, // BGRA8 = 79,
 		// Extend for DXGI
@@ -532,10 +532,10 @@ namespace RENDERER_CPP_NAMESPACE {
   /************************************************************************/
   // Descriptor Manager Implementation
   /************************************************************************/
-  using DescriptorSetMap = tinystl::unordered_map<uint64_t, VkDescriptorSet>;
-  using ConstDescriptorSetMapIterator = tinystl::unordered_map<uint64_t, VkDescriptorSet>::const_iterator;
-  using DescriptorSetMapNode = tinystl::unordered_hash_node<uint64_t, VkDescriptorSet>;
-  using DescriptorNameToIndexMap = tinystl::unordered_map<uint32_t, uint32_t>;
+  using DescriptorSetMap = tinystl::flat_hash_map<uint64_t, VkDescriptorSet>;
+  using ConstDescriptorSetMapIterator = tinystl::flat_hash_map<uint64_t, VkDescriptorSet>::const_iterator;
+  using DescriptorSetMapNode = tinystl::flat_hash_map<uint64_t, VkDescriptorSet>::value_type;
+  using DescriptorNameToIndexMap = tinystl::flat_hash_map<uint32_t, uint32_t>;
 
   typedef struct DescriptorManager
   {
@@ -562,8 +562,6 @@ namespace RENDERER_CPP_NAMESPACE {
 	  uint32_t					mFrameIdx;
   } DescriptorManager;
 
-  static Mutex gDescriptorMutex;
-
   void add_descriptor_manager(Renderer* pRenderer, RootSignature* pRootSignature, DescriptorManager** ppManager)
   {
       DescriptorManager* pManager = conf_placement_new<DescriptorManager>(conf_calloc(1, sizeof(*pManager)));
@@ -666,40 +664,55 @@ namespace RENDERER_CPP_NAMESPACE {
 	  SAFE_FREE(pManager);
   }
 
+  // Threads without a thread slot share the descriptor manager at MAX_THREAD_SLOTS of each root signature and bind one at a time
+  static Mutex gSharedDescriptorMutex;
+
+  /// Holds gSharedDescriptorMutex while a thread without a thread slot uses the shared descriptor manager
+  struct SharedDescriptorLock
+  {
+	  SharedDescriptorLock(uint32_t slot) : mShared(slot >= MAX_THREAD_SLOTS) { if (mShared) gSharedDescriptorMutex.Acquire(); }
+	  ~SharedDescriptorLock() { if (mShared) gSharedDescriptorMutex.Release(); }
+	  bool mShared;
+  };
+
   // This function returns the descriptor manager belonging to this thread
   // If a descriptor manager does not exist for this thread, a new one is created
-  // With this approach we make sure that descriptor binding is thread safe and lock conf_free at the same time
-  DescriptorManager* get_descriptor_manager(Renderer* pRenderer, RootSignature* pRootSignature)
+  // Managers are indexed by the thread slot and only the thread owning a slot writes it, so binding needs neither a lookup nor a lock.
+  // Threads without a slot get the shared manager and have to hold a SharedDescriptorLock while they use it.
+  DescriptorManager* get_descriptor_manager(Renderer* pRenderer, RootSignature* pRootSignature, uint32_t slot)
   {
-	  tinystl::unordered_hash_node<ThreadID, DescriptorManager*>* pNode = pRootSignature->pDescriptorManagerMap.find(Thread::GetCurrentThreadID()).node;
-	  if (pNode == NULL)
+	  DescriptorManager* pManager = pRootSignature->pDescriptorManagers[slot];
+	  if (!pManager)
 	  {
-		  // Only need a lock when creating a new descriptor manager for this thread
-		  MutexLock lock(gDescriptorMutex);
-		  DescriptorManager* pManager = NULL;
+		  if (slot >= MAX_THREAD_SLOTS)
+			  LOGERROR("All thread slots are taken, threads without one bind through a shared descriptor manager under a lock");
 		  add_descriptor_manager(pRenderer, pRootSignature, &pManager);
-		  pRootSignature->pDescriptorManagerMap.insert({ Thread::GetCurrentThreadID(), pManager });
-		  return pManager;
-	  }
-	  else
-	  {
-		  return pNode->second;
+		  pRootSignature->pDescriptorManagers[slot] = pManager;
 	  }
+	  return pManager;
   }
 
-  const DescriptorInfo* get_descriptor(const RootSignature* pRootSignature, const char* pResName, uint32_t* pIndex)
+  uint32_t getDescriptorIndexFromName(const RootSignature* pRootSignature, const char* pName)
   {
-	  DescriptorNameToIndexMap::const_iterator it = pRootSignature->pDescriptorNameToIndexMap.find(tinystl::hash(pResName));
-	  if (it.node)
-	  {
-		  *pIndex = it.node->second;
-		  return &pRootSignature->pDescriptors[it.node->second];
-	  }
-	  else
+	  DescriptorNameToIndexMap::const_iterator it = pRootSignature->pDescriptorNameToIndexMap.find(tinystl::hash(pName));
+	  return it != pRootSignature->pDescriptorNameToIndexMap.end() ? it->second : (uint32_t)-1;
+  }
+
+  // Descriptors are found by index if the param has one, otherwise by the precomputed hash of the name or by the name
+  const DescriptorInfo* get_descriptor(const RootSignature* pRootSignature, const DescriptorData* pParam, uint32_t* pIndex)
+  {
+	  const uint32_t index = findDescriptorIndex(pRootSignature, pParam);
+	  if (index == (uint32_t)-1)
 	  {
-		  LOGERRORF("Invalid descriptor param (%s)", pResName);
+		  if (pParam->mIndex != (uint32_t)-1)
+			  LOGERRORF("Invalid descriptor index (%u)", pParam->mIndex);
+		  else
+			  LOGERRORF("Invalid descriptor param (%s)", pParam->pName ? pParam->pName : "");
 		  return NULL;
 	  }
+
+	  *pIndex = index;
+	  return &pRootSignature->pDescriptors[index];
   }
 
   VkPipelineBindPoint gPipelineBindPoint[PIPELINE_TYPE_COUNT] =
@@ -713,7 +726,9 @@ namespace RENDERER_CPP_NAMESPACE {
   {
 	  Renderer* pRenderer = pCmd->pCmdPool->pRenderer;
 	  const uint32_t setCount = DESCRIPTOR_UPDATE_FREQ_COUNT;
-	  DescriptorManager* pm = get_descriptor_manager(pRenderer, pRootSignature);
+	  const uint32_t slot = Thread::GetCurrentThreadSlot();
+	  SharedDescriptorLock lock(slot);
+	  DescriptorManager* pm = get_descriptor_manager(pRenderer, pRootSignature, slot);
 
 	  // Logic to detect beginning of a new frame so we dont run this code everytime user calls cmdBindDescriptors
 	  for (uint32_t setIndex = 0; setIndex < setCount; ++setIndex)
@@ -738,14 +753,14 @@ namespace RENDERER_CPP_NAMESPACE {
 	  {
 		  const DescriptorData* pParam = &pDescParams[i];
 		  ASSERT(pParam);
-		  if (!pParam->pName)
+		  if (!pParam->pName && !pParam->mNameHash && pParam->mIndex == (uint32_t)-1)
 		  {
 			  LOGERRORF("Name of Descriptor at index (%u) is NULL", i);
 			  return;
 		  }
 
 		  uint32_t descIndex = -1;
-		  const DescriptorInfo* pDesc = get_descriptor(pRootSignature, pParam->pName, &descIndex);
+		  const DescriptorInfo* pDesc = get_descriptor(pRootSignature, pParam, &descIndex);
 		  if (!pDesc)
 			  continue;
 
@@ -765,17 +780,17 @@ namespace RENDERER_CPP_NAMESPACE {
 		  {
 			  if (pDesc->mIndexInParent == -1)
 			  {
-				  LOGERRORF("Trying to bind a static sampler (%s). All static samplers must be bound in addRootSignature through RootSignatureDesc::mStaticSamplers", pParam->pName);
+				  LOGERRORF("Trying to bind a static sampler (%s). All static samplers must be bound in addRootSignature through RootSignatureDesc::mStaticSamplers", pDesc->mDesc.name);
 				  continue;
 			  }
 			  if (!pParam->ppSamplers) {
-				  LOGERRORF("Sampler descriptor (%s) is NULL", pParam->pName);
+				  LOGERRORF("Sampler descriptor (%s) is NULL", pDesc->mDesc.name);
 				  return;
 			  }
 			  for (uint32_t i = 0; i < pParam->mCount; ++i)
 			  {
 				  if (!pParam->ppSamplers[i]) {
-					  LOGERRORF("Sampler descriptor (%s) at array index (%u) is NULL", pParam->pName, i);
+					  LOGERRORF("Sampler descriptor (%s) at array index (%u) is NULL", pDesc->mDesc.name, i);
 					  return;
 				  }
 				  pHash[setIndex] = tinystl::hash_state(&pParam->ppSamplers[i]->mSamplerId, 1, pHash[setIndex]);
@@ -785,13 +800,13 @@ namespace RENDERER_CPP_NAMESPACE {
 		  else if (pDesc->mDesc.type == DESCRIPTOR_TYPE_TEXTURE || pDesc->mDesc.type == DESCRIPTOR_TYPE_RW_TEXTURE)
 		  {
 			  if (!pParam->ppTextures) {
-				  LOGERRORF("Texture descriptor (%s) is NULL", pParam->pName);
+				  LOGERRORF("Texture descriptor (%s) is NULL", pDesc->mDesc.name);
 				  return;
 			  }
 			  for (uint32_t i = 0; i < pParam->mCount; ++i)
 			  {
 				  if (!pParam->ppTextures[i]) {
-					  LOGERRORF("Texture descriptor (%s) at array index (%u) is NULL", pParam->pName, i);
+					  LOGERRORF("Texture descriptor (%s) at array index (%u) is NULL", pDesc->mDesc.name, i);
 					  return;
 				  }
 
@@ -809,13 +824,13 @@ namespace RENDERER_CPP_NAMESPACE {
 		  else
 		  {
 			  if (!pParam->ppBuffers) {
-				  LOGERRORF("Buffer descriptor (%s) is NULL", pParam->pName);
+				  LOGERRORF("Buffer descriptor (%s) is NULL", pDesc->mDesc.name);
 				  return;
 			  }
 			  for (uint32_t i = 0; i < pParam->mCount; ++i)
 			  {
 				  if (!pParam->ppBuffers[i]) {
-					  LOGERRORF("Buffer descriptor (%s) at array index (%u) is NULL", pParam->pName, i);
+					  LOGERRORF("Buffer descriptor (%s) at array index (%u) is NULL", pDesc->mDesc.name, i);
 					  return;
 				  }
 				  pHash[setIndex] = tinystl::hash_state(&pParam->ppBuffers[i]->mBufferId, 1, pHash[setIndex]);
@@ -864,9 +879,9 @@ namespace RENDERER_CPP_NAMESPACE {
 			  if (setIndex == DESCRIPTOR_UPDATE_FREQ_NONE)
 			  {
 				  ConstDescriptorSetMapIterator it = pm->mStaticDescriptorSetMap[pm->mFrameIdx].find(pHash[setIndex]);
-				  if (it.node)
+				  if (it != pm->mStaticDescriptorSetMap[pm->mFrameIdx].end())
 				  {
-					  pDescriptorSet = it.node->second;
+					  pDescriptorSet = it->second;
 				  }
 				  // If the given hash does not exist, we create a new descriptor set and insert it into the descriptor set map
 				  else
@@ -1128,11 +1143,12 @@ namespace RENDERER_CPP_NAMESPACE {
   /************************************************************************/
   /// Render-passes are not exposed to the app code since they are not available on all apis
   /// This map takes care of hashing a render pass based on the render targets passed to cmdBeginRender
-  using RenderPassMap = tinystl::unordered_map<uint64_t, struct RenderPass*>;
-  using RenderPassMapNode = tinystl::unordered_hash_node<uint64_t, struct RenderPass*>;
-  using FrameBufferMap = tinystl::unordered_map<uint64_t, struct FrameBuffer*>;
-  using FrameBufferMapNode = tinystl::unordered_hash_node<uint64_t, struct FrameBuffer*>;
+  using RenderPassMap = tinystl::flat_hash_map<uint64_t, struct RenderPass*>;
+  using RenderPassMapNode = tinystl::flat_hash_map<uint64_t, struct RenderPass*>::value_type;
+  using FrameBufferMap = tinystl::flat_hash_map<uint64_t, struct FrameBuffer*>;
+  using FrameBufferMapNode = tinystl::flat_hash_map<uint64_t, struct FrameBuffer*>::value_type;
 
+  // The per thread maps stay node based, references to the map of a thread must survive other threads inserting theirs
   // RenderPass map per thread (this will make lookups lock free and we only need a lock when inserting a RenderPass Map for the first time)
   tinystl::unordered_map<ThreadID, RenderPassMap >	mRenderPassMap;
   // FrameBuffer map per thread (this will make lookups lock free and we only need a lock when inserting a FrameBuffer map for the first time)
@@ -2445,7 +2461,7 @@ namespace RENDERER_CPP_NAMESPACE {
 				create_info.flags = 0;
 				switch (stage_mask) {
 				case SHADER_STAGE_VERT: {
-					createShaderReflection((const uint8_t*)pDesc->mVert.pByteCode, (uint32_t)pDesc->mVert.mByteCodeSize, SHADER_STAGE_VERT, &stageReflections[counter++]);
+					loadShaderReflection((const uint8_t*)pDesc->mVert.pByteCode, (uint32_t)pDesc->mVert.mByteCodeSize, pDesc->mVert.pReflection, pDesc->mVert.mReflectionSize, SHADER_STAGE_VERT, &stageReflections[counter++]);
 
 					create_info.codeSize = pDesc->mVert.mByteCodeSize;
 					create_info.pCode = (const uint32_t*)pDesc->mVert.pByteCode;
@@ -2453,7 +2469,7 @@ namespace RENDERER_CPP_NAMESPACE {
 					ASSERT(VK_SUCCESS == vk_res);
 				} break;
 				case SHADER_STAGE_TESC: {
-					createShaderReflection((const uint8_t*)pDesc->mHull.pByteCode, (uint32_t)pDesc->mHull.mByteCodeSize, SHADER_STAGE_TESC, &stageReflections[counter++]);
+					loadShaderReflection((const uint8_t*)pDesc->mHull.pByteCode, (uint32_t)pDesc->mHull.mByteCodeSize, pDesc->mHull.pReflection, pDesc->mHull.mReflectionSize, SHADER_STAGE_TESC, &stageReflections[counter++]);
 
 					memcpy(&pShaderProgram->mNumControlPoint, &stageReflections[counter - 1].mNumControlPoint, sizeof(pShaderProgram->mNumControlPoint));
 
@@ -2463,7 +2479,7 @@ namespace RENDERER_CPP_NAMESPACE {
 					ASSERT(VK_SUCCESS == vk_res);
 				} break;
 				case SHADER_STAGE_TESE: {
-					createShaderReflection((const uint8_t*)pDesc->mDomain.pByteCode, (uint32_t)pDesc->mDomain.mByteCodeSize, SHADER_STAGE_TESE, &stageReflections[counter++]);
+					loadShaderReflection((const uint8_t*)pDesc->mDomain.pByteCode, (uint32_t)pDesc->mDomain.mByteCodeSize, pDesc->mDomain.pReflection, pDesc->mDomain.mReflectionSize, SHADER_STAGE_TESE, &stageReflections[counter++]);
 
 					create_info.codeSize = pDesc->mDomain.mByteCodeSize;
 					create_info.pCode = (const uint32_t*)pDesc->mDomain.pByteCode;
@@ -2471,7 +2487,7 @@ namespace RENDERER_CPP_NAMESPACE {
 					ASSERT(VK_SUCCESS == vk_res);
 				} break;
 				case SHADER_STAGE_GEOM: {
-					createShaderReflection((const uint8_t*)pDesc->mGeom.pByteCode, (uint32_t)pDesc->mGeom.mByteCodeSize, SHADER_STAGE_GEOM, &stageReflections[counter++]);
+					loadShaderReflection((const uint8_t*)pDesc->mGeom.pByteCode, (uint32_t)pDesc->mGeom.mByteCodeSize, pDesc->mGeom.pReflection, pDesc->mGeom.mReflectionSize, SHADER_STAGE_GEOM, &stageReflections[counter++]);
 
 					create_info.codeSize = pDesc->mGeom.mByteCodeSize;
 					create_info.pCode = (const uint32_t*)pDesc->mGeom.pByteCode;
@@ -2479,7 +2495,7 @@ namespace RENDERER_CPP_NAMESPACE {
 					ASSERT(VK_SUCCESS == vk_res);
 				} break;
 				case SHADER_STAGE_FRAG: {
-					createShaderReflection((const uint8_t*)pDesc->mFrag.pByteCode, (uint32_t)pDesc->mFrag.mByteCodeSize, SHADER_STAGE_FRAG, &stageReflections[counter++]);
+					loadShaderReflection((const uint8_t*)pDesc->mFrag.pByteCode, (uint32_t)pDesc->mFrag.mByteCodeSize, pDesc->mFrag.pReflection, pDesc->mFrag.mReflectionSize, SHADER_STAGE_FRAG, &stageReflections[counter++]);
 
 					create_info.codeSize = pDesc->mFrag.mByteCodeSize;
 					create_info.pCode = (const uint32_t*)pDesc->mFrag.pByteCode;
@@ -2487,7 +2503,7 @@ namespace RENDERER_CPP_NAMESPACE {
 					ASSERT(VK_SUCCESS == vk_res);
 				} break;
 				case SHADER_STAGE_COMP: {
-					createShaderReflection((const uint8_t*)pDesc->mComp.pByteCode, (uint32_t)pDesc->mComp.mByteCodeSize, SHADER_STAGE_COMP, &stageReflections[counter++]);
+					loadShaderReflection((const uint8_t*)pDesc->mComp.pByteCode, (uint32_t)pDesc->mComp.mByteCodeSize, pDesc->mComp.pReflection, pDesc->mComp.mReflectionSize, SHADER_STAGE_COMP, &stageReflections[counter++]);
 
 					memcpy(pShaderProgram->mNumThreadsPerGroup, stageReflections[counter - 1].mNumThreadsPerGroup, sizeof(pShaderProgram->mNumThreadsPerGroup));
 
@@ -2564,7 +2580,7 @@ namespace RENDERER_CPP_NAMESPACE {
 		tinystl::vector<ShaderResource const*> shaderResources;
 		const RootSignatureDesc* pRootSignatureDesc = pRootDesc ? pRootDesc : &gDefaultRootSignatureDesc;
 
-		conf_placement_new<tinystl::unordered_map<uint32_t,uint32_t> >(&pRootSignature->pDescriptorNameToIndexMap);
+		conf_placement_new<tinystl::flat_hash_map<uint32_t,uint32_t> >(&pRootSignature->pDescriptorNameToIndexMap);
 
 		// Collect all unique shader resources in the given shaders
 		// Resources are parsed by name (two resources named "XYZ" in two shaders will be considered the same resource)
@@ -2585,9 +2601,10 @@ namespace RENDERER_CPP_NAMESPACE {
 				if (pRes->type == DESCRIPTOR_TYPE_ROOT_CONSTANT)
 					setIndex = 0;
 
-				if (pRootSignature->pDescriptorNameToIndexMap.find(tinystl::hash(pRes->name)).node == 0)
+				const NameId nameId = internName(pRes->name);
+				if (pRootSignature->pDescriptorNameToIndexMap.find(nameId) == pRootSignature->pDescriptorNameToIndexMap.end())
 				{
-					pRootSignature->pDescriptorNameToIndexMap.insert({ tinystl::hash(pRes->name), (uint32_t)shaderResources.size() });
+					pRootSignature->pDescriptorNameToIndexMap.insert({ nameId, (uint32_t)shaderResources.size() });
 					shaderResources.emplace_back(pRes);
 				}
 			}
@@ -2792,24 +2809,22 @@ namespace RENDERER_CPP_NAMESPACE {
 		/************************************************************************/
 		/************************************************************************/
 
-		conf_placement_new<RootSignature::ThreadLocalDescriptorManager>(&pRootSignature->pDescriptorManagerMap);
 		// Create descriptor manager for this thread
-		DescriptorManager* pManager = NULL;
-		add_descriptor_manager(pRenderer, pRootSignature, &pManager);
-		pRootSignature->pDescriptorManagerMap.insert({ Thread::GetCurrentThreadID(), pManager });
+		const uint32_t slot = Thread::GetCurrentThreadSlot();
+		if (slot < MAX_THREAD_SLOTS)
+			get_descriptor_manager(pRenderer, pRootSignature, slot);
 
 		*ppRootSignature = pRootSignature;
 	}
 
 	void removeRootSignature(Renderer* pRenderer, RootSignature* pRootSignature)
 	{
-		for (tinystl::unordered_hash_node<ThreadID, DescriptorManager*>& it : pRootSignature->pDescriptorManagerMap)
+		for (uint32_t i = 0; i <= MAX_THREAD_SLOTS; ++i)
 		{
-			remove_descriptor_manager(pRenderer, pRootSignature, it.second);
+			if (pRootSignature->pDescriptorManagers[i])
+				remove_descriptor_manager(pRenderer, pRootSignature, pRootSignature->pDescriptorManagers[i]);
 		}
 
-		pRootSignature->pDescriptorManagerMap.~unordered_map();
-
 		vkDestroyPipelineLayout(pRenderer->pDevice, pRootSignature->pPipelineLayout, NULL);
 
 		for (uint32_t i = 0; i < DESCRIPTOR_UPDATE_FREQ_COUNT; ++i)
@@ -2831,7 +2846,7 @@ namespace RENDERER_CPP_NAMESPACE {
 		SAFE_FREE(pRootSignature->pRootDescriptorLayouts);
 
 		// Need delete since the destructor frees allocated memory
-		pRootSignature->pDescriptorNameToIndexMap.~unordered_map();
+		pRootSignature->pDescriptorNameToIndexMap.~flat_hash_map();
 
 		SAFE_FREE(pRootSignature);
 	}
@@ -3378,16 +3393,16 @@ namespace RENDERER_CPP_NAMESPACE {
 		RenderPassMap& renderPassMap = get_render_pass_map();
 		FrameBufferMap& frameBufferMap = get_frame_buffer_map();
 
-		const RenderPassMapNode* pNode = renderPassMap.find(renderPassHash).node;
-		const FrameBufferMapNode* pFrameBufferNode = frameBufferMap.find(frameBufferHash).node;
+		RenderPassMap::const_iterator renderPassIt = renderPassMap.find(renderPassHash);
+		FrameBufferMap::const_iterator frameBufferIt = frameBufferMap.find(frameBufferHash);
 
 		RenderPass* pRenderPass = NULL;
 		FrameBuffer* pFrameBuffer = NULL;
 
 		// If a render pass of this combination already exists just use it or create a new one
-		if (pNode)
+		if (renderPassIt != renderPassMap.end())
 		{
-			pRenderPass = pNode->second;
+			pRenderPass = renderPassIt->second;
 		}
 		else
 		{
@@ -3418,9 +3433,9 @@ namespace RENDERER_CPP_NAMESPACE {
 		}
 
 		// If a frame buffer of this combination already exists just use it or create a new one
-		if (pFrameBufferNode)
+		if (frameBufferIt != frameBufferMap.end())
 		{
-			pFrameBuffer = pFrameBufferNode->second;
+			pFrameBuffer = frameBufferIt->second;
 		}
 		else
 		{
@@ -3806,8 +3821,9 @@ namespace RENDERER_CPP_NAMESPACE {
 
 	void cmdUpdateSubresources(Cmd* pCmd, uint32_t startSubresource, uint32_t numSubresources, SubresourceDataDesc* pSubresources, Buffer* pIntermediate, uint64_t intermediateOffset, Texture* pTexture)
 	{
+		// pSubresources holds numSubresources entries starting at startSubresource
 		VkBufferImageCopy* pCopyRegions = (VkBufferImageCopy*)alloca(numSubresources * sizeof(VkBufferImageCopy));
-		for (uint32_t i = startSubresource; i < startSubresource + numSubresources; ++i)
+		for (uint32_t i = 0; i < numSubresources; ++i)
 		{
 			VkBufferImageCopy* pCopy = &pCopyRegions[i];
 			SubresourceDataDesc* pRes = &pSubresources[i];
@@ -0,0 +1,507 @@
+/*
+ * Copyright (c) 2018 Confetti Interactive Inc.
+ *
+ * This file is part of The-Forge
+ * (see https://github.com/ConfettiFX/The-Forge).
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+*/
+
+#ifndef TINYSTL_FLAT_HASH_MAP_H
+#define TINYSTL_FLAT_HASH_MAP_H
+
+#include "allocator.h"
+#include "hash.h"
+#include "hash_base.h"
+#include "new.h"
+#include "traits.h"
+
+#include <string.h>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define TINYSTL_FLAT_HASH_SSE2 1
+#endif
+
+// Open addressing hash map in the spirit of Abseil's Swiss tables.
+// Entries live in one flat array next to an array of control bytes. A control byte tells if
+// its slot is empty, deleted or full and keeps 7 bits of the hash of a full slot, so a lookup
+// compares the control bytes of a whole group of slots at once (16 with SSE2, 8 in a 64 bit
+// register elsewhere) and only touches the entries whose bits match.
+// Groups are aligned and probed in triangular order, which visits every group since the group
+// count is a power of two. At most 7/8 of the slots are used.
+// A map whose bytes are all zero is a valid empty map, as for the calloc'd renderer structs.
+// Inserting and erasing invalidates iterators and pointers to entries when the table grows.
+
+namespace tinystl {
+
+	static inline uint64_t flat_hash_mix(uint64_t h) {
+		h ^= h >> 33;
+		h *= 0xff51afd7ed558ccdULL;
+		h ^= h >> 33;
+		return h;
+	}
+
+	// Integer and pointer keys are mixed directly, everything else goes through tinystl::hash first
+	static inline uint64_t flat_hash(uint32_t value) { return flat_hash_mix(value); }
+	static inline uint64_t flat_hash(int32_t value) { return flat_hash_mix((uint32_t)value); }
+	static inline uint64_t flat_hash(uint64_t value) { return flat_hash_mix(value); }
+	static inline uint64_t flat_hash(int64_t value) { return flat_hash_mix((uint64_t)value); }
+
+	template<typename T>
+	static inline uint64_t flat_hash(T* value) { return flat_hash_mix((uint64_t)(uintptr_t)value); }
+
+	template<typename T>
+	static inline uint64_t flat_hash(const T& value) { return flat_hash_mix(hash(value)); }
+
+	enum {
+		flat_hash_empty = -128,
+		flat_hash_deleted = -2,
+		flat_hash_sentinel = -1,
+	};
+
+	static inline uint32_t flat_hash_lowest_bit(uint64_t mask) {
+#if defined(_MSC_VER)
+		unsigned long index;
+#if defined(_M_X64) || defined(_M_ARM64)
+		_BitScanForward64(&index, mask);
+#else
+		if ((uint32_t)mask)
+			_BitScanForward(&index, (uint32_t)mask);
+		else {
+			_BitScanForward(&index, (uint32_t)(mask >> 32));
+			index += 32;
+		}
+#endif
+		return (uint32_t)index;
+#else
+		return (uint32_t)__builtin_ctzll(mask);
+#endif
+	}
+
+#if TINYSTL_FLAT_HASH_SSE2
+	struct flat_hash_group {
+		enum { width = 16, shift = 0 };
+
+		explicit flat_hash_group(const int8_t* ctrl) : ctrl(_mm_loadu_si128((const __m128i*)ctrl)) {}
+
+		// Bit i is set for every control byte i matching
+		uint64_t match(int8_t h2) const {
+			return (uint64_t)_mm_movemask_epi8(_mm_cmpeq_epi8(ctrl, _mm_set1_epi8(h2)));
+		}
+
+		uint64_t match_empty() const {
+			return (uint64_t)_mm_movemask_epi8(_mm_cmpeq_epi8(ctrl, _mm_set1_epi8(flat_hash_empty)));
+		}
+
+		uint64_t match_empty_or_deleted() const {
+			return (uint64_t)_mm_movemask_epi8(_mm_cmpgt_epi8(_mm_set1_epi8(flat_hash_sentinel), ctrl));
+		}
+
+		__m128i ctrl;
+	};
+#else
+	// The group in a 64 bit word, the high bit of byte i is set for every control byte i matching.
+	// match() may also report a byte right after a real match, which the key compare rejects.
+	struct flat_hash_group {
+		enum { width = 8, shift = 3 };
+
+		explicit flat_hash_group(const int8_t* pCtrl) { memcpy(&ctrl, pCtrl, sizeof(ctrl)); }
+
+		uint64_t match(int8_t h2) const {
+			const uint64_t lsbs = 0x0101010101010101ULL;
+			const uint64_t x = ctrl ^ (lsbs * (uint8_t)h2);
+			return (x - lsbs) & ~x & 0x8080808080808080ULL;
+		}
+
+		uint64_t match_empty() const {
+			return (ctrl & (~ctrl << 6)) & 0x8080808080808080ULL;
+		}
+
+		uint64_t match_empty_or_deleted() const {
+			return (ctrl & (~ctrl << 7)) & 0x8080808080808080ULL;
+		}
+
+		uint64_t ctrl;
+	};
+#endif
+
+	template<typename Node>
+	struct flat_hash_iterator {
+		flat_hash_iterator() : ctrl(0), slot(0) {}
+		flat_hash_iterator(const int8_t* pCtrl, Node* pSlot) : ctrl(pCtrl), slot(pSlot) {}
+		template<typename Other>
+		flat_hash_iterator(const flat_hash_iterator<Other>& other) : ctrl(other.ctrl), slot(other.slot) {}
+
+		Node& operator*() const { return *slot; }
+		Node* operator->() const { return slot; }
+
+		flat_hash_iterator& operator++() {
+			++ctrl;
+			++slot;
+			skip_free();
+			return *this;
+		}
+
+		void skip_free() {
+			while (*ctrl < 0 && *ctrl != flat_hash_sentinel) {
+				++ctrl;
+				++slot;
+			}
+		}
+
+		template<typename Other>
+		bool operator==(const flat_hash_iterator<Other>& other) const { return slot == other.slot; }
+		template<typename Other>
+		bool operator!=(const flat_hash_iterator<Other>& other) const { return slot != other.slot; }
+
+		const int8_t* ctrl;
+		Node* slot;
+	};
+
+	template<typename Key, typename Value, typename Alloc = TINYSTL_ALLOCATOR>
+	class flat_hash_map {
+	public:
+		flat_hash_map();
+		flat_hash_map(const flat_hash_map& other);
+		~flat_hash_map();
+
+		flat_hash_map& operator=(const flat_hash_map& other);
+
+		typedef pair<Key, Value> value_type;
+
+		typedef flat_hash_iterator<const value_type> const_iterator;
+		typedef flat_hash_iterator<value_type> iterator;
+
+		iterator begin();
+		iterator end();
+
+		const_iterator begin() const;
+		const_iterator end() const;
+
+		void clear();
+		bool empty() const;
+		size_t size() const;
+		uint32_t getCount() const { return (uint32_t)size(); }
+		/// Slots of the table, it grows once size() would pass 7/8 of them
+		size_t capacity() const;
+
+		/// Makes room for count entries without growing on the way
+		void reserve(size_t count);
+		/// Rebuilds the table with at least count slots, or as few as the entries need, which drops deleted slots
+		void rehash(size_t count);
+
+		const_iterator find(const Key& key) const;
+		iterator find(const Key& key);
+		pair<iterator, bool> insert(const pair<Key, Value>& p);
+		void erase(const_iterator where);
+		size_t erase(const Key& key);
+
+		Value& operator[](const Key& key);
+
+		void swap(flat_hash_map& other);
+
+	private:
+		size_t find_index(const Key& key, uint64_t hash) const;
+		size_t find_insert_index(uint64_t hash) const;
+		void resize(size_t newCapacity);
+
+		static size_t capacity_for(size_t count);
+
+		int8_t* m_ctrl;
+		value_type* m_slots;
+		size_t m_size;
+		size_t m_capacity;
+		/// Entries which can be added before the table has to grow, deleted slots count as used
+		size_t m_growth_left;
+	};
+
+	template<typename Key, typename Value, typename Alloc>
+	flat_hash_map<Key, Value, Alloc>::flat_hash_map()
+		: m_ctrl(0)
+		, m_slots(0)
+		, m_size(0)
+		, m_capacity(0)
+		, m_growth_left(0)
+	{
+	}
+
+	template<typename Key, typename Value, typename Alloc>
+	flat_hash_map<Key, Value, Alloc>::flat_hash_map(const flat_hash_map& other)
+		: m_ctrl(0)
+		, m_slots(0)
+		, m_size(0)
+		, m_capacity(0)
+		, m_growth_left(0)
+	{
+		reserve(other.m_size);
+		for (const_iterator it = other.begin(), end = other.end(); it != end; ++it)
+			insert(*it);
+	}
+
+	template<typename Key, typename Value, typename Alloc>
+	flat_hash_map<Key, Value, Alloc>::~flat_hash_map() {
+		clear();
+		if (m_ctrl)
+			Alloc::static_deallocate(m_ctrl, 0);
+	}
+
+	template<typename Key, typename Value, typename Alloc>
+	flat_hash_map<Key, Value, Alloc>& flat_hash_map<Key, Value, Alloc>::operator=(const flat_hash_map& other) {
+		flat_hash_map<Key, Value, Alloc>(other).swap(*this);
+		return *this;
+	}
+
+	template<typename Key, typename Value, typename Alloc>
+	inline typename flat_hash_map<Key, Value, Alloc>::iterator flat_hash_map<Key, Value, Alloc>::begin() {
+		iterator it(m_ctrl, m_slots);
+		if (m_ctrl)
+			it.skip_free();
+		return it;
+	}
+
+	template<typename Key, typename Value, typename Alloc>
+	inline typename flat_hash_map<Key, Value, Alloc>::iterator flat_hash_map<Key, Value, Alloc>::end() {
+		return iterator(m_ctrl + m_capacity, m_slots + m_capacity);
+	}
+
+	template<typename Key, typename Value, typename Alloc>
+	inline typename flat_hash_map<Key, Value, Alloc>::const_iterator flat_hash_map<Key, Value, Alloc>::begin() const {
+		const_iterator it(m_ctrl, m_slots);
+		if (m_ctrl)
+			it.skip_free();
+		return it;
+	}
+
+	template<typename Key, typename Value, typename Alloc>
+	inline typename flat_hash_map<Key, Value, Alloc>::const_iterator flat_hash_map<Key, Value, Alloc>::end() const {
+		return const_iterator(m_ctrl + m_capacity, m_slots + m_capacity);
+	}
+
+	template<typename Key, typename Value, typename Alloc>
+	inline bool flat_hash_map<Key, Value, Alloc>::empty() const {
+		return m_size == 0;
+	}
+
+	template<typename Key, typename Value, typename Alloc>
+	inline size_t flat_hash_map<Key, Value, Alloc>::size() const {
+		return m_size;
+	}
+
+	template<typename Key, typename Value, typename Alloc>
+	inline size_t flat_hash_map<Key, Value, Alloc>::capacity() const {
+		return m_capacity;
+	}
+
+	template<typename Key, typename Value, typename Alloc>
+	void flat_hash_map<Key, Value, Alloc>::clear() {
+		// Keeps the table, maps cleared every frame do not allocate again
+		if (!m_ctrl)
+			return;
+
+		for (size_t i = 0; i < m_capacity; ++i) {
+			if (m_ctrl[i] >= 0)
+				m_slots[i].~value_type();
+		}
+		memset(m_ctrl, flat_hash_empty, m_capacity);
+		m_size = 0;
+		m_growth_left = m_capacity - m_capacity / 8;
+	}
+
+	template<typename Key, typename Value, typename Alloc>
+	size_t flat_hash_map<Key, Value, Alloc>::capacity_for(size_t count) {
+		size_t capacity = 16;
+		while (capacity - capacity / 8 < count)
+			capacity *= 2;
+		return capacity;
+	}
+
+	template<typename Key, typename Value, typename Alloc>
+	void flat_hash_map<Key, Value, Alloc>::reserve(size_t count) {
+		if (count > m_size + m_growth_left)
+			resize(capacity_for(count));
+	}
+
+	template<typename Key, typename Value, typename Alloc>
+	void flat_hash_map<Key, Value, Alloc>::rehash(size_t count) {
+		size_t capacity = capacity_for(m_size);
+		while (capacity < count)
+			capacity *= 2;
+		resize(capacity);
+	}
+
+	template<typename Key, typename Value, typename Alloc>
+	size_t flat_hash_map<Key, Value, Alloc>::find_index(const Key& key, uint64_t hash) const {
+		if (!m_capacity)
+			return 0;
+
+		const int8_t h2 = (int8_t)(hash & 0x7F);
+		const size_t groupMask = m_capacity / flat_hash_group::width - 1;
+		size_t group = (size_t)(hash >> 7) & groupMask;
+		for (size_t step = 1;; ++step) {
+			const size_t first = group * flat_hash_group::width;
+			const flat_hash_group g(m_ctrl + first);
+			for (uint64_t mask = g.match(h2); mask; mask &= mask - 1) {
+				const size_t index = first + (flat_hash_lowest_bit(mask) >> flat_hash_group::shift);
+				if (m_slots[index].first == key)
+					return index;
+			}
+			// A search for the key would have ended here when it was inserted
+			if (g.match_empty())
+				return m_capacity;
+			group = (group + step) & groupMask;
+		}
+	}
+
+	template<typename Key, typename Value, typename Alloc>
+	size_t flat_hash_map<Key, Value, Alloc>::find_insert_index(uint64_t hash) const {
+		const size_t groupMask = m_capacity / flat_hash_group::width - 1;
+		size_t group = (size_t)(hash >> 7) & groupMask;
+		for (size_t step = 1;; ++step) {
+			const uint64_t mask = flat_hash_group(m_ctrl + group * flat_hash_group::width).match_empty_or_deleted();
+			if (mask)
+				return group * flat_hash_group::width + (flat_hash_lowest_bit(mask) >> flat_hash_group::shift);
+			group = (group + step) & groupMask;
+		}
+	}
+
+	template<typename Key, typename Value, typename Alloc>
+	void flat_hash_map<Key, Value, Alloc>::resize(size_t newCapacity) {
+		int8_t* oldCtrl = m_ctrl;
+		value_type* oldSlots = m_slots;
+		const size_t oldCapacity = m_capacity;
+
+		// Control bytes with the sentinel ending the iteration, then the slots
+		const size_t slotOffset = (newCapacity + 1 + 15) & ~(size_t)15;
+		m_ctrl = (int8_t*)Alloc::static_allocate(slotOffset + newCapacity * sizeof(value_type));
+		m_slots = (value_type*)((char*)m_ctrl + slotOffset);
+		memset(m_ctrl, flat_hash_empty, newCapacity);
+		m_ctrl[newCapacity] = flat_hash_sentinel;
+		m_capacity = newCapacity;
+		m_growth_left = newCapacity - newCapacity / 8 - m_size;
+
+		for (size_t i = 0; i < oldCapacity; ++i) {
+			if (oldCtrl[i] < 0)
+				continue;
+
+			const uint64_t hash = flat_hash(oldSlots[i].first);
+			const size_t index = find_insert_index(hash);
+			m_ctrl[index] = (int8_t)(hash & 0x7F);
+			value_type* pSlot = &m_slots[index];
+			move_construct(&pSlot->first, oldSlots[i].first);
+			move_construct(&pSlot->second, oldSlots[i].second);
+			oldSlots[i].~value_type();
+		}
+
+		if (oldCtrl)
+			Alloc::static_deallocate(oldCtrl, 0);
+	}
+
+	template<typename Key, typename Value, typename Alloc>
+	inline typename flat_hash_map<Key, Value, Alloc>::iterator flat_hash_map<Key, Value, Alloc>::find(const Key& key) {
+		const size_t index = find_index(key, flat_hash(key));
+		return iterator(m_ctrl + index, m_slots + index);
+	}
+
+	template<typename Key, typename Value, typename Alloc>
+	inline typename flat_hash_map<Key, Value, Alloc>::const_iterator flat_hash_map<Key, Value, Alloc>::find(const Key& key) const {
+		const size_t index = find_index(key, flat_hash(key));
+		return const_iterator(m_ctrl + index, m_slots + index);
+	}
+
+	template<typename Key, typename Value, typename Alloc>
+	pair<typename flat_hash_map<Key, Value, Alloc>::iterator, bool> flat_hash_map<Key, Value, Alloc>::insert(const pair<Key, Value>& p) {
+		pair<iterator, bool> result;
+		const uint64_t hash = flat_hash(p.first);
+		size_t index = find_index(p.first, hash);
+		if (index != m_capacity) {
+			result.first = iterator(m_ctrl + index, m_slots + index);
+			result.second = false;
+			return result;
+		}
+
+		if (!m_growth_left) {
+			// Rebuilding at the same size is enough when deleted slots took the room
+			if (!m_capacity)
+				resize(16);
+			else if (m_size < (m_capacity - m_capacity / 8) / 2)
+				resize(m_capacity);
+			else
+				resize(m_capacity * 2);
+		}
+
+		index = find_insert_index(hash);
+		if (m_ctrl[index] == flat_hash_empty)
+			--m_growth_left;
+		m_ctrl[index] = (int8_t)(hash & 0x7F);
+		new(placeholder(), &m_slots[index]) value_type(p);
+		++m_size;
+
+		result.first = iterator(m_ctrl + index, m_slots + index);
+		result.second = true;
+		return result;
+	}
+
+	template<typename Key, typename Value, typename Alloc>
+	void flat_hash_map<Key, Value, Alloc>::erase(const_iterator where) {
+		const size_t index = (size_t)(where.slot - m_slots);
+		m_slots[index].~value_type();
+		--m_size;
+
+		// An empty slot in the group means no search ever went past it, the slot can be empty again
+		const size_t first = index & ~(size_t)(flat_hash_group::width - 1);
+		if (flat_hash_group(m_ctrl + first).match_empty()) {
+			m_ctrl[index] = flat_hash_empty;
+			++m_growth_left;
+		}
+		else {
+			m_ctrl[index] = flat_hash_deleted;
+		}
+	}
+
+	template<typename Key, typename Value, typename Alloc>
+	size_t flat_hash_map<Key, Value, Alloc>::erase(const Key& key) {
+		const_iterator it = find(key);
+		if (it == end())
+			return 0;
+		erase(it);
+		return 1;
+	}
+
+	template<typename Key, typename Value, typename Alloc>
+	Value& flat_hash_map<Key, Value, Alloc>::operator[](const Key& key) {
+		const size_t index = find_index(key, flat_hash(key));
+		if (index != m_capacity)
+			return m_slots[index].second;
+		return insert(pair<Key, Value>(key, Value())).first->second;
+	}
+
+	template<typename Key, typename Value, typename Alloc>
+	void flat_hash_map<Key, Value, Alloc>::swap(flat_hash_map& other) {
+		int8_t* ctrl = m_ctrl; m_ctrl = other.m_ctrl; other.m_ctrl = ctrl;
+		value_type* slots = m_slots; m_slots = other.m_slots; other.m_slots = slots;
+		size_t size = m_size; m_size = other.m_size; other.m_size = size;
+		size_t capacity = m_capacity; m_capacity = other.m_capacity; other.m_capacity = capacity;
+		size_t growthLeft = m_growth_left; m_growth_left = other.m_growth_left; other.m_growth_left = growthLeft;
+	}
+}
+#endif
@@ -31,6 +31,7 @@
 #include "vector.h"
 #include "stddef.h"
 #include "hash.h"
+#include "string_view.h"
 
 
  // For memcpy
@@ -48,19 +49,24 @@
 #endif
 
 namespace tinystl {
-	class string {
+	template<typename Alloc = TINYSTL_ALLOCATOR>
+	class basic_string {
 	public:
 		typedef char* iterator;
 
-		string();
-		string(const string& other);
-		string(const char* sz);
-		string(const char* sz, size_t len);
-		~string();
+		basic_string();
+		basic_string(const basic_string& other);
+		basic_string(const char* sz);
+		basic_string(const char* sz, size_t len);
+		explicit basic_string(const string_view& view);
+		basic_string(basic_string&& other);
+		~basic_string();
 
-		string& operator=(const string& other);
+		basic_string& operator=(const basic_string& other);
+		basic_string& operator=(basic_string&& other);
 
 		operator const char*() const { return m_first; }
+		operator string_view() const { return string_view(m_first, (size_t)(m_last - m_first)); }
 		const char& at(size_t index) const { return m_first[index]; }
 		char& at(size_t index) { return m_first[index]; }
 
@@ -76,37 +82,37 @@ namespace tinystl {
 		void append(const char* first, const char* last);
 		void push_back(char c);
 
-		void swap(string& other);
+		void swap(basic_string& other);
 
-		string substring(unsigned pos) const;
-		string substring(unsigned pos, unsigned length) const;
+		basic_string substring(unsigned pos) const;
+		basic_string substring(unsigned pos, unsigned length) const;
 
 		unsigned find(char c, unsigned startPos, bool caseSensitive = true) const;
-		unsigned find(const string& str, unsigned startPos, bool caseSensitive = true) const;
+		unsigned find(const basic_string& str, unsigned startPos, bool caseSensitive = true) const;
 		bool rfind(const char ch, int pos = -1, unsigned int* index = nullptr) const;
 
 		unsigned find_last(char c, unsigned startPos = npos, bool caseSensitive = true) const;
-		unsigned find_last(const string& str, unsigned startPos = npos, bool caseSensitive = true) const;
+		unsigned find_last(const basic_string& str, unsigned startPos = npos, bool caseSensitive = true) const;
 
 		void replace(char replaceThis, char replaceWith, bool caseSensitive = true);
-		void replace(const string& replaceThis, const string& replaceWith, bool caseSensitive = true);
+		void replace(const basic_string& replaceThis, const basic_string& replaceWith, bool caseSensitive = true);
 
 		bool insert(const unsigned int pos, const char *string, const unsigned int len);
 
-		string replaced(char s, char r) const;
-		string replaced(const string& replaceThis, const string& replaceWith, bool caseSensitive = true) const;
+		basic_string replaced(char s, char r) const;
+		basic_string replaced(const basic_string& replaceThis, const basic_string& replaceWith, bool caseSensitive = true) const;
 
-		string trimmed() const;
+		basic_string trimmed() const;
 
-		string to_lower() const;
-		string to_upper() const;
+		basic_string to_lower() const;
+		basic_string to_upper() const;
 
-		vector<string> split(char separator, bool keepEmptyStrings = false) const;
+		vector<basic_string> split(char separator, bool keepEmptyStrings = false) const;
 
 		/// Copy chars from one buffer to another.
 		static inline void copy_chars(char* dest, const char* src, unsigned count);
 		static inline int compare(const char* lhs, const char* rhs, bool caseSensitive);
-		static inline string format(const char* fmt, ...);
+		static inline basic_string format(const char* fmt, ...);
 
 		/// Position for "not found."
 		static const unsigned npos = 0xffffffff;
@@ -125,11 +131,15 @@ namespace tinystl {
 		pointer m_last;
 		pointer m_capacity;
 
-		static const size_t c_nbuffer = 12;
-		char m_buffer[12];
+		// Names and file names of up to 39 characters (plus the terminator) are stored inline, which makes the string 64 bytes on 64 bit targets
+		static const size_t c_nbuffer = 40;
+		char m_buffer[c_nbuffer];
 	};
 
-	inline string::string()
+	typedef basic_string<> string;
+
+	template<typename Alloc>
+	inline basic_string<Alloc>::basic_string()
 		: m_first(m_buffer)
 		, m_last(m_buffer)
 		, m_capacity(m_buffer + c_nbuffer)
@@ -137,7 +147,8 @@ namespace tinystl {
 		resize(0);
 	}
 
-	inline string::string(const string& other)
+	template<typename Alloc>
+	inline basic_string<Alloc>::basic_string(const basic_string& other)
 		: m_first(m_buffer)
 		, m_last(m_buffer)
 		, m_capacity(m_buffer + c_nbuffer)
@@ -146,7 +157,8 @@ namespace tinystl {
 		append(other.m_first, other.m_last);
 	}
 
-	inline string::string(const char* sz)
+	template<typename Alloc>
+	inline basic_string<Alloc>::basic_string(const char* sz)
 		: m_first(m_buffer)
 		, m_last(m_buffer)
 		, m_capacity(m_buffer + c_nbuffer)
@@ -164,7 +176,8 @@ namespace tinystl {
 		append(sz, sz + len);
 	}
 
-	inline string::string(const char* sz, size_t len)
+	template<typename Alloc>
+	inline basic_string<Alloc>::basic_string(const char* sz, size_t len)
 		: m_first(m_buffer)
 		, m_last(m_buffer)
 		, m_capacity(m_buffer + c_nbuffer)
@@ -173,51 +186,85 @@ namespace tinystl {
 		append(sz, sz + len);
 	}
 
-	inline string::~string() {
+	template<typename Alloc>
+	inline basic_string<Alloc>::basic_string(const string_view& view)
+		: m_first(m_buffer)
+		, m_last(m_buffer)
+		, m_capacity(m_buffer + c_nbuffer)
+	{
+		reserve(view.size());
+		append(view.begin(), view.end());
+	}
+
+	template<typename Alloc>
+	inline basic_string<Alloc>::basic_string(basic_string&& other)
+		: m_first(m_buffer)
+		, m_last(m_buffer)
+		, m_capacity(m_buffer + c_nbuffer)
+	{
+		*m_buffer = 0;
+		swap(other);
+	}
+
+	template<typename Alloc>
+	inline basic_string<Alloc>::~basic_string() {
 		if (m_first != m_buffer)
-			TINYSTL_ALLOCATOR::static_deallocate(m_first, m_capacity - m_first);
+			Alloc::static_deallocate(m_first, m_capacity - m_first);
+	}
+
+	template<typename Alloc>
+	inline basic_string<Alloc>& basic_string<Alloc>::operator=(const basic_string& other) {
+		basic_string(other).swap(*this);
+		return *this;
 	}
 
-	inline string& string::operator=(const string& other) {
-		string(other).swap(*this);
+	template<typename Alloc>
+	inline basic_string<Alloc>& basic_string<Alloc>::operator=(basic_string&& other) {
+		swap(other);
 		return *this;
 	}
 
-	inline const char* string::c_str() const {
+	template<typename Alloc>
+	inline const char* basic_string<Alloc>::c_str() const {
 		return m_first;
 	}
 
-	inline size_t string::size() const
+	template<typename Alloc>
+	inline size_t basic_string<Alloc>::size() const
 	{
 		return (size_t)(m_last - m_first);
 	}
 
-	inline void string::reserve(size_t capacity) {
+	template<typename Alloc>
+	inline void basic_string<Alloc>::reserve(size_t capacity) {
 		if (m_first + capacity + 1 <= m_capacity)
 			return;
 
 		const size_t size = (size_t)(m_last - m_first);
 
-		pointer newfirst = (pointer)TINYSTL_ALLOCATOR::static_allocate(capacity + 1);
+		pointer newfirst = (pointer)Alloc::static_allocate(capacity + 1);
 		for (pointer it = m_first, newit = newfirst, end = m_last; it != end; ++it, ++newit)
 			*newit = *it;
 		if (m_first != m_buffer)
-			TINYSTL_ALLOCATOR::static_deallocate(m_first, m_capacity - m_first);
+			Alloc::static_deallocate(m_first, m_capacity - m_first);
 
 		m_first = newfirst;
 		m_last = newfirst + size;
-		m_capacity = m_first + capacity;
+		m_capacity = m_first + capacity + 1;
 	}
 
-	inline void string::resize(size_t size) {
+	template<typename Alloc>
+	inline void basic_string<Alloc>::resize(size_t size) {
 		reserve(size);
 		for (pointer it = m_last, end = m_first + size + 1; it < end; ++it)
 			*it = 0;
 
 		m_last = m_first + size;
+		*m_last = 0;
 	}
 
-	inline void string::append(const char* first, const char* last) {
+	template<typename Alloc>
+	inline void basic_string<Alloc>::append(const char* first, const char* last) {
 		const size_t newsize = (size_t)((m_last - m_first) + (last - first) + 1);
 		if (m_first + newsize > m_capacity)
 			reserve((newsize * 3) / 2);
@@ -227,12 +274,14 @@ namespace tinystl {
 		*m_last = 0;
 	}
 
-	inline void string::push_back(char c)
+	template<typename Alloc>
+	inline void basic_string<Alloc>::push_back(char c)
 	{
 		append(&c, (&c) + 1);
 	}
 
-	inline void string::swap(string& other) {
+	template<typename Alloc>
+	inline void basic_string<Alloc>::swap(basic_string& other) {
 		const pointer tfirst = m_first, tlast = m_last, tcapacity = m_capacity;
 		m_first = other.m_first, m_last = other.m_last, m_capacity = other.m_capacity;
 		other.m_first = tfirst, other.m_last = tlast, other.m_capacity = tcapacity;
@@ -264,25 +313,27 @@ namespace tinystl {
 		}
 	}
 
-	inline string string::substring(unsigned pos) const
+	template<typename Alloc>
+	inline basic_string<Alloc> basic_string<Alloc>::substring(unsigned pos) const
 	{
 		if (pos < (unsigned)size())
 		{
-			string ret;
+			basic_string ret;
 			ret.resize((unsigned)size() - pos);
 			copy_chars(ret.m_first, m_first + pos, (unsigned)ret.size());
 
 			return ret;
 		}
 		else
-			return string();
+			return basic_string();
 	}
 
-	inline string string::substring(unsigned pos, unsigned length) const
+	template<typename Alloc>
+	inline basic_string<Alloc> basic_string<Alloc>::substring(unsigned pos, unsigned length) const
 	{
 		if (pos < (unsigned)size())
 		{
-			string ret;
+			basic_string ret;
 			if (pos + length > (unsigned)size())
 				length = (unsigned)size() - pos;
 			ret.resize(length);
@@ -291,10 +342,11 @@ namespace tinystl {
 			return ret;
 		}
 		else
-			return string();
+			return basic_string();
 	}
 
-	inline unsigned string::find(char c, unsigned startPos, bool caseSensitive /* = true*/) const
+	template<typename Alloc>
+	inline unsigned basic_string<Alloc>::find(char c, unsigned startPos, bool caseSensitive /* = true*/) const
 	{
 		if (caseSensitive)
 		{
@@ -317,7 +369,8 @@ namespace tinystl {
 		return npos;
 	}
 
-	inline unsigned string::find(const string& str, unsigned startPos, bool caseSensitive /* = true*/) const
+	template<typename Alloc>
+	inline unsigned basic_string<Alloc>::find(const basic_string& str, unsigned startPos, bool caseSensitive /* = true*/) const
 	{
 		if (!(unsigned)str.size() || (unsigned)str.size() > (unsigned)size())
 			return npos;
@@ -365,7 +418,8 @@ namespace tinystl {
 		return npos;
 	}
 
-	inline bool string::rfind(const char ch, int pos, unsigned int* index) const
+	template<typename Alloc>
+	inline bool basic_string<Alloc>::rfind(const char ch, int pos, unsigned int* index) const
 	{
 		unsigned int i = (pos < 0) ? static_cast<unsigned int>(size()) : pos;
 
@@ -385,7 +439,8 @@ namespace tinystl {
 		return false;
 	}
 
-	inline unsigned string::find_last(char c, unsigned startPos /* = npos*/, bool caseSensitive /* = true*/) const
+	template<typename Alloc>
+	inline unsigned basic_string<Alloc>::find_last(char c, unsigned startPos /* = npos*/, bool caseSensitive /* = true*/) const
 	{
 		if (startPos >= (unsigned)size())
 			startPos = (unsigned)size() - 1;
@@ -411,7 +466,8 @@ namespace tinystl {
 		return npos;
 	}
 
-	inline unsigned string::find_last(const string& str, unsigned startPos /* = npos*/, bool caseSensitive /* = true*/) const
+	template<typename Alloc>
+	inline unsigned basic_string<Alloc>::find_last(const basic_string& str, unsigned startPos /* = npos*/, bool caseSensitive /* = true*/) const
 	{
 		if (!(unsigned)str.size() || (unsigned)str.size() > (unsigned)size())
 			return npos;
@@ -455,7 +511,8 @@ namespace tinystl {
 		return npos;
 	}
 
-	inline void string::replace(char replaceThis, char replaceWith, bool caseSensitive /* = true*/)
+	template<typename Alloc>
+	inline void basic_string<Alloc>::replace(char replaceThis, char replaceWith, bool caseSensitive /* = true*/)
 	{
 		if (caseSensitive)
 		{
@@ -476,7 +533,8 @@ namespace tinystl {
 		}
 	}
 
-	inline void string::replace(const string& replaceThis, const string& replaceWith, bool caseSensitive /* = true*/)
+	template<typename Alloc>
+	inline void basic_string<Alloc>::replace(const basic_string& replaceThis, const basic_string& replaceWith, bool caseSensitive /* = true*/)
 	{
 		unsigned nextPos = 0;
 
@@ -515,7 +573,8 @@ namespace tinystl {
 		}
 	}
 
-	inline bool string::insert(const unsigned int pos, const char *string, const unsigned int len)
+	template<typename Alloc>
+	inline bool basic_string<Alloc>::insert(const unsigned int pos, const char *string, const unsigned int len)
 	{
 		if (pos > size())
 			return false;
@@ -534,21 +593,24 @@ namespace tinystl {
 		return true;
 	}
 
-	inline string string::replaced(char s, char r) const
+	template<typename Alloc>
+	inline basic_string<Alloc> basic_string<Alloc>::replaced(char s, char r) const
 	{
-		string str = *this;
+		basic_string str = *this;
 		str.replace(s, r);
 		return str;
 	}
 
-	inline string string::replaced(const string& replaceThis, const string& replaceWith, bool caseSensitive /* = true*/) const
+	template<typename Alloc>
+	inline basic_string<Alloc> basic_string<Alloc>::replaced(const basic_string& replaceThis, const basic_string& replaceWith, bool caseSensitive /* = true*/) const
 	{
-		string ret = *this;
+		basic_string ret = *this;
 		ret.replace(replaceThis, replaceWith, caseSensitive);
 		return ret;
 	}
 
-	inline string string::trimmed() const
+	template<typename Alloc>
+	inline basic_string<Alloc> basic_string<Alloc>::trimmed() const
 	{
 		unsigned trimStart = 0;
 		unsigned trimEnd = (unsigned)size();
@@ -571,28 +633,31 @@ namespace tinystl {
 		return substring(trimStart, trimEnd - trimStart);
 	}
 
-	inline string string::to_lower() const
+	template<typename Alloc>
+	inline basic_string<Alloc> basic_string<Alloc>::to_lower() const
 	{
-		string ret = *this;
+		basic_string ret = *this;
 		for (unsigned i = 0; i < (unsigned)ret.size(); ++i)
 			ret.m_first[i] = (char)tolower(m_first[i]);
 
 		return ret;
 	}
 
-	inline string string::to_upper() const
+	template<typename Alloc>
+	inline basic_string<Alloc> basic_string<Alloc>::to_upper() const
 	{
-		string ret = *this;
+		basic_string ret = *this;
 		for (unsigned i = 0; i < (unsigned)ret.size(); ++i)
 			ret.m_first[i] = (char)toupper(m_first[i]);
 
 		return ret;
 	}
 
-	inline vector<string> string::split(char separator, bool keepEmptyStrings /* = false*/) const
+	template<typename Alloc>
+	inline vector<basic_string<Alloc>> basic_string<Alloc>::split(char separator, bool keepEmptyStrings /* = false*/) const
 	{
 		const char* str = c_str();
-		vector<string> ret;
+		vector<basic_string> ret;
 		const char* strEnd = str + strlen(str);
 
 		for (const char* splitEnd = str; splitEnd != strEnd; ++splitEnd)
@@ -601,14 +666,14 @@ namespace tinystl {
 			{
 				const ptrdiff_t splitLen = splitEnd - str;
 				if (splitLen > 0 || keepEmptyStrings)
-					ret.push_back(string(str, splitLen));
+					ret.push_back(basic_string(str, splitLen));
 				str = splitEnd + 1;
 			}
 		}
 
 		const ptrdiff_t splitLen = strEnd - str;
 		if (splitLen > 0 || keepEmptyStrings)
-			ret.push_back(string(str, splitLen));
+			ret.push_back(basic_string(str, splitLen));
 
 		return ret;
 	}
@@ -668,22 +733,81 @@ namespace tinystl {
 		return !(rhs == lhs);
 	}
 
-	inline string operator+(const string& lhs, const string& rhs) {
-		string ret(lhs);
+	// Comparisons of strings with other allocators, the overloads above keep the implicit conversions of string
+	template<typename Alloc>
+	inline bool operator==(const basic_string<Alloc>& lhs, const basic_string<Alloc>& rhs) {
+		return lhs.size() == rhs.size() && memcmp(lhs.c_str(), rhs.c_str(), lhs.size()) == 0;
+	}
+
+	template<typename Alloc>
+	inline bool operator==(const basic_string<Alloc>& lhs, const char* rhs) {
+		return lhs.size() == strlen(rhs) && memcmp(lhs.c_str(), rhs, lhs.size()) == 0;
+	}
+
+	template<typename Alloc>
+	inline bool operator!=(const basic_string<Alloc>& lhs, const basic_string<Alloc>& rhs) {
+		return !(lhs == rhs);
+	}
+
+	template<typename Alloc>
+	inline bool operator!=(const basic_string<Alloc>& lhs, const char* rhs) {
+		return !(lhs == rhs);
+	}
+
+	inline string operator+(const string_view& lhs, const string_view& rhs) {
+		string ret;
+		ret.reserve(lhs.size() + rhs.size());
+		ret.append(lhs.begin(), lhs.end());
 		ret.append(rhs.begin(), rhs.end());
 		return ret;
 	}
 
+	inline string operator+(const string& lhs, const string& rhs) {
+		return string_view(lhs.c_str(), lhs.size()) + string_view(rhs.c_str(), rhs.size());
+	}
+
+	inline string operator+(const string& lhs, const char* rhs) {
+		return string_view(lhs.c_str(), lhs.size()) + string_view(rhs);
+	}
+
+	inline string operator+(const char* lhs, const string& rhs) {
+		return string_view(lhs) + string_view(rhs.c_str(), rhs.size());
+	}
+
+	// Appends to the temporary on the left, a + b + c only allocates for the first sum
+	inline string operator+(string&& lhs, const string_view& rhs) {
+		lhs.append(rhs.begin(), rhs.end());
+		return static_cast<string&&>(lhs);
+	}
+
+	inline string operator+(string&& lhs, const string& rhs) {
+		return static_cast<string&&>(lhs) + string_view(rhs.c_str(), rhs.size());
+	}
+
+	inline string operator+(string&& lhs, const char* rhs) {
+		return static_cast<string&&>(lhs) + string_view(rhs);
+	}
+
+	inline string& operator+=(string& lhs, const string_view& rhs) {
+		lhs.append(rhs.begin(), rhs.end());
+		return lhs;
+	}
+
 	inline string& operator+=(string& lhs, const string& rhs) {
 		lhs.append(rhs.begin(), rhs.end());
 		return lhs;
 	}
 
+	inline string& operator+=(string& lhs, const char* rhs) {
+		return lhs += string_view(rhs);
+	}
+
 	static inline unsigned int hash(const string& value) {
 		return hash_string(value.c_str(), value.size());
 	}
 
-	inline void string::copy_chars(char* dest, const char* src, unsigned count)
+	template<typename Alloc>
+	inline void basic_string<Alloc>::copy_chars(char* dest, const char* src, unsigned count)
 	{
 #ifdef _MSC_VER
 		if (count)
@@ -699,7 +823,8 @@ namespace tinystl {
 #endif
 	}
 
-	inline int string::compare(const char* lhs, const char* rhs, bool caseSensitive)
+	template<typename Alloc>
+	inline int basic_string<Alloc>::compare(const char* lhs, const char* rhs, bool caseSensitive)
 	{
 		if (!lhs || !rhs)
 			return lhs ? 1 : (rhs ? -1 : 0);
@@ -725,10 +850,11 @@ namespace tinystl {
 		}
 	}
 
-	inline string string::format(const char* fmt, ...)
+	template<typename Alloc>
+	inline basic_string<Alloc> basic_string<Alloc>::format(const char* fmt, ...)
 	{
 		int size = int(strlen(fmt) * 2 + 50);
-		string str;
+		basic_string str;
 		va_list ap;
 		while (1) {     // Maximum two passes on a POSIX system...
 			str.resize(size);
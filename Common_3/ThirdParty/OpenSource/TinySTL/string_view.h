@@ -0,0 +1,119 @@
+/*
+ * Copyright (c) 2018 Confetti Interactive Inc.
+ *
+ * This file is part of The-Forge
+ * (see https://github.com/ConfettiFX/The-Forge).
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+*/
+
+#ifndef TINYSTL_STRING_VIEW_H
+#define TINYSTL_STRING_VIEW_H
+
+#include "stddef.h"
+#include "hash.h"
+
+#include <string.h>
+
+namespace tinystl {
+
+	// Characters owned by someone else, used to pass names and paths without copying them into a string.
+	// The characters are not necessarily null terminated, use size() instead of searching for the end.
+	class string_view {
+	public:
+		typedef const char* iterator;
+
+		string_view() : m_first(""), m_size(0) {}
+		string_view(const char* sz) : m_first(sz ? sz : ""), m_size(sz ? strlen(sz) : 0) {}
+		string_view(const char* sz, size_t len) : m_first(sz), m_size(len) {}
+
+		iterator begin() const { return m_first; }
+		iterator end() const { return m_first + m_size; }
+
+		const char* data() const { return m_first; }
+		size_t size() const { return m_size; }
+		bool empty() const { return m_size == 0; }
+
+		const char& operator[](size_t index) const { return m_first[index]; }
+
+		string_view substring(unsigned pos) const;
+		string_view substring(unsigned pos, unsigned length) const;
+
+		unsigned find(char c, unsigned startPos = 0) const;
+		unsigned find_last(char c, unsigned startPos = npos) const;
+
+		/// Position for "not found."
+		static const unsigned npos = 0xffffffff;
+
+	private:
+		const char* m_first;
+		size_t m_size;
+	};
+
+	inline string_view string_view::substring(unsigned pos) const {
+		if (pos >= m_size)
+			return string_view();
+		return string_view(m_first + pos, m_size - pos);
+	}
+
+	inline string_view string_view::substring(unsigned pos, unsigned length) const {
+		if (pos >= m_size)
+			return string_view();
+		if (pos + length > m_size)
+			length = (unsigned)m_size - pos;
+		return string_view(m_first + pos, length);
+	}
+
+	inline unsigned string_view::find(char c, unsigned startPos) const {
+		for (unsigned i = startPos; i < (unsigned)m_size; ++i) {
+			if (m_first[i] == c)
+				return i;
+		}
+		return npos;
+	}
+
+	inline unsigned string_view::find_last(char c, unsigned startPos) const {
+		if (!m_size)
+			return npos;
+		if (startPos >= (unsigned)m_size)
+			startPos = (unsigned)m_size - 1;
+
+		for (unsigned i = startPos + 1; i-- > 0;) {
+			if (m_first[i] == c)
+				return i;
+		}
+		return npos;
+	}
+
+	inline bool operator==(const string_view& lhs, const string_view& rhs) {
+		return lhs.size() == rhs.size() && memcmp(lhs.data(), rhs.data(), lhs.size()) == 0;
+	}
+
+	inline bool operator!=(const string_view& lhs, const string_view& rhs) {
+		return !(lhs == rhs);
+	}
+
+	// Same hash as the string with these characters
+	static inline unsigned int hash(const string_view& value) {
+		return hash_string(value.data(), value.size());
+	}
+}
+
+typedef tinystl::string_view StringView;
+
+#endif
@@ -1105,7 +1105,7 @@ public:
         cmdUIDrawFrameTime(cmd, pUIManager, { 8, 30 }, "GPU ", (float)pGpuProfiler->mCumulativeTime * 1000.0f);
 #endif
 
-        cmdUIEndRender(cmd, pUIManager);
+        cmdUIEndRender(cmd, pUIManager, pRenderCompleteFence);
         cmdEndRender(cmd, 1, &pRenderTarget, NULL);
 
         // Transition our texture to present state
@@ -760,7 +760,7 @@ public:
 #endif
         
 		cmdUIDrawFrameTime(cmd, pUIManager, { 8, 15 }, "CPU ", gTimer.GetUSecAverage() / 1000.0f);
-		cmdUIEndRender(cmd, pUIManager);
+		cmdUIEndRender(cmd, pUIManager, pRenderCompleteFence);
 		cmdEndRender(cmd, 1, &pRenderTarget, NULL);
 		cmdEndDebugMarker(cmd);
 
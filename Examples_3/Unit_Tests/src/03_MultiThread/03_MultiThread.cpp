@@ -970,7 +970,7 @@ public:
 			cmdUIDrawFrameTime(cmd, pUIManager, { 8, (130 + gThreadCount * 25.0f) + i * 25.0f }, String::format("- Thread %u  ", i), (float)pGpuProfilers[i]->mCumulativeTime * 1000.0f);
 		}
 #endif
-		cmdUIEndRender(cmd, pUIManager);
+		cmdUIEndRender(cmd, pUIManager, pRenderCompleteFence);
 
 		cmdEndRender(cmd, 1, &pRenderTarget, NULL);
 		endCmd(cmd);
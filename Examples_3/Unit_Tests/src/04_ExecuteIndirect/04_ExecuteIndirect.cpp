@@ -243,6 +243,8 @@ Pipeline*				pBasicPipeline = nullptr;
 RasterizerState*		pBasicRast = nullptr;
 RootSignature*			pBasicRoot = nullptr;
 Sampler*				pBasicSampler = nullptr;
+// Resolved once so the per asteroid root constant bind skips the name lookup
+uint32_t				gBasicRootConstantIndex = (uint32_t)-1;
 
 // Execute Indirect variables
 Shader*					pIndirectShader = nullptr;
@@ -425,12 +427,12 @@ public:
         addResource(&textureDesc, true);
 #endif
 
+		gThreadSystem.CreateThreads(gNumSubsets);
+
 		CreateTextures(gTextureCount);
 
 		CreateSubsets();
 
-		gThreadSystem.CreateThreads(gNumSubsets);
-
 		ShaderLoadDesc instanceShader = {};
 		instanceShader.mStages[0] = { "basic.vert", NULL, 0, FSR_SrcShaders };
 		instanceShader.mStages[1] = { "basic.frag", NULL, 0, FSR_SrcShaders };
@@ -455,6 +457,7 @@ public:
 		addRootSignature(pRenderer, 1, &pSkyBoxDrawShader, &pSkyBoxRoot);
 		addRootSignature(pRenderer, 1, &pComputeShader, &pComputeRoot);
 		addRootSignature(pRenderer, 1, &pIndirectShader, &pIndirectRoot);
+		gBasicRootConstantIndex = getDescriptorIndexFromName(pBasicRoot, "rootConstant");
 
 		/* Setup Pipelines */
 
@@ -638,7 +641,7 @@ public:
 		tinystl::vector<IndirectArgumentDescriptor> indirectArgDescs(2);
 		indirectArgDescs[0] = {};
 		indirectArgDescs[0].mType = INDIRECT_CONSTANT;  // Root Constant
-		indirectArgDescs[0].mRootParameterIndex = pIndirectRoot->pRootConstantLayouts[pIndirectRoot->pDescriptors[pIndirectRoot->pDescriptorNameToIndexMap[tinystl::hash("rootConstant")]].mIndexInParent].mRootIndex;
+		indirectArgDescs[0].mRootParameterIndex = pIndirectRoot->pRootConstantLayouts[pIndirectRoot->pDescriptors[getDescriptorIndexFromName(pIndirectRoot, "rootConstant")].mIndexInParent].mRootIndex;
 		indirectArgDescs[0].mCount = 1;
 		indirectArgDescs[1] = {};
 		indirectArgDescs[1].mType = INDIRECT_DRAW_INDEX; // Indirect Index Draw Arguments
@@ -1245,7 +1248,7 @@ public:
 
 		cmdUIDrawGpuProfileData(cmd, pUIManager, vec2(8.0f, 110.0f), pGpuProfiler);
 
-		cmdUIEndRender(cmd, pUIManager);
+		cmdUIEndRender(cmd, pUIManager, pRenderCompleteFence);
 
 		cmdEndRender(cmd, 1, &pSwapchainRenderTarget, NULL);
 		barrier = { pSwapchainRenderTarget->pTexture, RESOURCE_STATE_PRESENT };
@@ -1613,7 +1616,11 @@ public:
 	void CreateTextures(uint32_t texture_count)
 	{
 		Image image;
-		genTextures(texture_count, &image);
+		genTextures(texture_count, &image, &gThreadSystem);
+#ifndef TARGET_IOS
+		// BC1 needs an eighth of the memory and upload bandwidth of the generated RGBA8 array
+		image.Compress(ImageFormat::DXT1, COMPRESSION_QUALITY_FAST, &gThreadSystem);
+#endif
 
 		TextureLoadDesc textureDesc = {};
 		textureDesc.pImage = &image;
@@ -1739,7 +1746,7 @@ public:
 					continue;
 
 				DescriptorData rootConst;
-				rootConst.pName = "rootConstant";
+				rootConst.mIndex = gBasicRootConstantIndex;
 				rootConst.pRootConstant = &i;
 				cmdBindDescriptors(cmd, pBasicRoot, 1, &rootConst);
 				cmdDrawIndexed(cmd, dynamicAsteroid.indexCount, dynamicAsteroid.indexStart);
@@ -1751,8 +1758,10 @@ public:
 			// Setup indirect draw arguments
 			uint32_t numToDraw = 0;
 
-			IndirectArguments* argData = (IndirectArguments*)conf_calloc(gNumAsteroidsPerSubset, sizeof(IndirectArguments));
-			tinystl::vector<uint32_t> drawIDs;
+			// Transient data of this frame, released by the frame arena a few frames later
+			IndirectArguments* argData = (IndirectArguments*)confetti::frameCallocate(gNumAsteroidsPerSubset, sizeof(IndirectArguments));
+			tinystl::vector<uint32_t, confetti::FrameArenaAllocator> drawIDs;
+			drawIDs.reserve(endIdx - startIdx);
 			for (uint32_t i = startIdx; i < endIdx; ++i)
 			{
 				AsteroidStatic staticAsteroid = gAsteroidSim.asteroidsStatic[i];
@@ -1813,7 +1822,6 @@ public:
 			cmdBindIndexBuffer(cmd, pAsteroidIndexBuffer);
 			cmdExecuteIndirect(cmd, pIndirectSubsetCommandSignature, numToDraw, subset.pSubsetIndirect, 0, nullptr, 0);
 			cmdEndRender(cmd, 1, &pRenderTarget, pDepthBuffer);
-			conf_free(argData);
 		}
 
 		endCmd(cmd);
@@ -42,7 +42,7 @@
 #include "NoiseOctaves.h"
 #include "Random.h"
 
-void genTextures(uint32_t texture_count, Image* out_texture)
+void genTextures(uint32_t texture_count, Image* out_texture, ThreadPool* pThreadPool)
 {
 	static const int textureDim = 256;
 
@@ -95,5 +95,8 @@ void genTextures(uint32_t texture_count, Image* out_texture)
 		}
 	}	
 
+	// The Kaiser window keeps the noise from blurring out in the lower mips
+	image->GenerateMipMaps(ALL_MIPLEVELS, MIPMAP_FILTER_KAISER, false, pThreadPool);
+
 	//*out_textures = images;
 }
@@ -42,4 +42,5 @@
 #include "../../Common_3/OS/Image/Image.h"
 #include <cstdint>
 
-void genTextures(uint32_t texture_count, Image* out_textures);
\ No newline at end of file
+// Mip chains are filtered on pThreadPool when it is not NULL
+void genTextures(uint32_t texture_count, Image* out_textures, class ThreadPool* pThreadPool = NULL);
\ No newline at end of file
@@ -421,7 +421,7 @@ public:
 		uiTextDesc.mFontSize = 18;
 		cmdUIDrawFrameTime(cmd, pUIManager, vec2(8.0f, 15.0f), "CPU ", gTimer.GetUSec(true) / 1000.0f, &uiTextDesc);
 		cmdUIDrawFrameTime(cmd, pUIManager, vec2(8.0f, 40.0f), "GPU ", (float)pGpuProfiler->mCumulativeTime * 1000.0f, &uiTextDesc);
-		cmdUIEndRender(cmd, pUIManager);
+		cmdUIEndRender(cmd, pUIManager, pRenderCompleteFence);
 
 		cmdEndRender(cmd, 1, &pRenderTarget, NULL);
 		barrier = { pRenderTarget->pTexture, RESOURCE_STATE_PRESENT };
@@ -930,7 +930,7 @@ public:
 #endif
 
 		cmdUIDrawGpuProfileData(cmd, pUIManager, { 8, 65 }, pGpuProfiler);
-		cmdUIEndRender(cmd, pUIManager);
+		cmdUIEndRender(cmd, pUIManager, pRenderCompleteFence);
 		cmdEndRender(cmd, 1, &pRenderTarget, NULL);
 
 		barriers[0] = { pRenderTarget->pTexture, RESOURCE_STATE_PRESENT };
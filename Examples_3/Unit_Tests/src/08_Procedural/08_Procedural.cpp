@@ -835,7 +835,7 @@ public:
 		cmdUIDrawGUI(cmd, pUIManager, pGuiWindow);
 #endif
 
-		cmdUIEndRender(cmd, pUIManager);
+		cmdUIEndRender(cmd, pUIManager, pRenderCompleteFence);
 		cmdEndRender(cmd, 1, &pRenderTarget, NULL);
 
 		// Transition our texture to present state
@@ -0,0 +1,420 @@
+/*
+ * Copyright (c) 2018 Confetti Interactive Inc.
+ *
+ * This file is part of The-Forge
+ * (see https://github.com/ConfettiFX/The-Forge).
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+*/
+
+// confetti::allocate and friends over the size class pools, dlmalloc and directly mapped memory. Checks alignment,
+// zeroing and reallocation on every path, conf_memalign and the aligned operator new, and blocks freed by other threads
+// than the ones allocating them. Compares an alloc / free mix with plain dlmalloc behind a 16 byte header, the path
+// every allocation took before the pools, on 1 to 8 threads.
+
+#include <stdlib.h>
+
+#include "../../../../Common_3/OS/Interfaces/IThread.h"
+#include "../../../../Common_3/OS/Interfaces/ITimeManager.h"
+#include "../../../../Common_3/OS/Interfaces/ILogManager.h"
+#include "../../../../Common_3/OS/Interfaces/IMemoryManager.h"
+
+#include "TestFramework.h"
+
+extern "C"
+{
+	void* dlmalloc(size_t size);
+	void  dlfree(void* p);
+}
+
+// Defined next to the other operator new replacements in MemoryTrackingManager.cpp
+void* operator new(size_t size, size_t alignment);
+void* operator new[](size_t size, size_t alignment);
+
+static uint32_t nextRandom(uint32_t* pSeed)
+{
+	uint32_t x = *pSeed;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	*pSeed = x;
+	return x;
+}
+
+static bool isFilled(const uint8_t* pData, size_t size, uint8_t value)
+{
+	for (size_t i = 0; i < size; ++i)
+	{
+		if (pData[i] != value)
+			return false;
+	}
+	return true;
+}
+
+// Sizes of the pools, the heap and the mapped path with every power of two alignment up to 8KB
+static void testAlignment()
+{
+	uint32_t seed = 7;
+	uint32_t misalignedCount = 0;
+	for (size_t alignment = 1; alignment <= 8192; alignment <<= 1)
+	{
+		for (uint32_t i = 0; i < 2000; ++i)
+		{
+			const size_t size = i < 1500 ? nextRandom(&seed) % 2048 :
+				(i < 1990 ? nextRandom(&seed) % 200000 : 256 * 1024 + nextRandom(&seed) % 1000000);
+			uint8_t* pData = (uint8_t*)confetti::allocate(size, alignment);
+			const size_t minAlignment = alignment < confetti::DEFAULT_ALIGNMENT ? confetti::DEFAULT_ALIGNMENT : alignment;
+			TEST_CHECK(pData != NULL);
+			misalignedCount += ((uintptr_t)pData % minAlignment) != 0;
+			memset(pData, 0xcd, size);
+			confetti::deallocate(pData);
+		}
+	}
+	TEST_CHECK_MSG(misalignedCount == 0, "%u blocks misaligned", misalignedCount);
+
+	// TNew and the thread local space honor the alignment as well
+	struct Aligned : confetti::TNew<256> { uint8_t mData[40]; };
+	Aligned* pAligned = new Aligned;
+	TEST_CHECK(((uintptr_t)pAligned & 255) == 0);
+	delete pAligned;
+
+	void* pLocal = confetti::threadLocalAllocate(100, 256);
+	TEST_CHECK(((uintptr_t)pLocal & 255) == 0);
+	pLocal = confetti::threadLocalReallocate(pLocal, 5000, 256);
+	TEST_CHECK(((uintptr_t)pLocal & 255) == 0);
+	confetti::threadLocalDeallocate(pLocal);
+}
+
+// conf_memalign and the aligned operator new of EASTL and C++17, freed through conf_free and delete
+static void testAlignedNew()
+{
+	const size_t sizes[] = { 1, 24, 200, 1000, 5000, 300000 };
+	uint32_t misalignedCount = 0;
+	for (size_t alignment = 1; alignment <= 4096; alignment <<= 1)
+	{
+		const size_t minAlignment = alignment < confetti::DEFAULT_ALIGNMENT ? confetti::DEFAULT_ALIGNMENT : alignment;
+		for (uint32_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); ++i)
+		{
+			uint8_t* pData = (uint8_t*)conf_memalign(alignment, sizes[i]);
+			TEST_CHECK(pData != NULL);
+			misalignedCount += ((uintptr_t)pData % minAlignment) != 0;
+			memset(pData, 0xcd, sizes[i]);
+			// Reallocating keeps the contents, only the default alignment is kept
+			pData = (uint8_t*)conf_realloc(pData, sizes[i] * 2);
+			TEST_CHECK(isFilled(pData, sizes[i], 0xcd));
+			conf_free(pData);
+
+			pData = (uint8_t*)operator new(sizes[i], alignment);
+			misalignedCount += ((uintptr_t)pData % minAlignment) != 0;
+			TEST_CHECK_MSG(isFilled(pData, sizes[i], 0), "aligned new of %u bytes not zeroed", (uint32_t)sizes[i]);
+			memset(pData, 0xab, sizes[i]);
+			operator delete(pData);
+
+			pData = (uint8_t*)operator new[](sizes[i], alignment);
+			misalignedCount += ((uintptr_t)pData % minAlignment) != 0;
+			TEST_CHECK_MSG(isFilled(pData, sizes[i], 0), "aligned new[] of %u bytes not zeroed", (uint32_t)sizes[i]);
+			memset(pData, 0xab, sizes[i]);
+			operator delete[](pData);
+		}
+	}
+	TEST_CHECK_MSG(misalignedCount == 0, "%u aligned blocks misaligned", misalignedCount);
+
+#if defined(__cpp_aligned_new)
+	struct alignas(128) OverAligned { uint8_t mData[300]; };
+	OverAligned* pObject = new OverAligned;
+	TEST_CHECK(((uintptr_t)pObject & 127) == 0);
+	delete pObject;
+	OverAligned* pArray = new OverAligned[7];
+	TEST_CHECK(((uintptr_t)pArray & 127) == 0);
+	delete[] pArray;
+#endif
+}
+
+// Memory recycled dirty comes back zeroed from callocate and conf_calloc
+static void testZeroing()
+{
+	const size_t sizes[] = { 8, 100, 1000, 1024, 5000, 300000 };
+	for (uint32_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); ++i)
+	{
+		for (uint32_t j = 0; j < 50; ++j)
+		{
+			uint8_t* pDirty = (uint8_t*)confetti::allocate(sizes[i]);
+			memset(pDirty, 0xab, sizes[i]);
+			confetti::deallocate(pDirty);
+			uint8_t* pZeroed = (uint8_t*)confetti::callocate(1, sizes[i], j % 2 ? 64 : confetti::DEFAULT_ALIGNMENT);
+			TEST_CHECK_MSG(isFilled(pZeroed, sizes[i], 0), "callocate of %u bytes not zeroed", (uint32_t)sizes[i]);
+			confetti::deallocate(pZeroed);
+
+			pDirty = (uint8_t*)conf_malloc(sizes[i]);
+			memset(pDirty, 0xab, sizes[i]);
+			conf_free(pDirty);
+			pZeroed = (uint8_t*)conf_calloc(sizes[i] / 4, 4);
+			TEST_CHECK_MSG(isFilled(pZeroed, sizes[i], 0), "conf_calloc of %u bytes not zeroed", (uint32_t)sizes[i]);
+			conf_free(pZeroed);
+		}
+	}
+
+	// count * size overflowing
+	TEST_CHECK(confetti::callocate((size_t)1 << (sizeof(size_t) * 4), (size_t)1 << (sizeof(size_t) * 4)) == NULL);
+}
+
+// Blocks growing and shrinking from the pools to mapped memory and back keep their contents
+static void testReallocate()
+{
+	const size_t alignments[] = { confetti::DEFAULT_ALIGNMENT, 64, 4096 };
+	const size_t sizes[] = { 50, 700, 1024, 3000, 100000, 600000, 2000000, 40000, 900, 20, 3 };
+	for (uint32_t a = 0; a < sizeof(alignments) / sizeof(alignments[0]); ++a)
+	{
+		const size_t alignment = alignments[a];
+		size_t size = 10;
+		uint8_t* pData = (uint8_t*)confetti::reallocate(NULL, size, alignment);
+		for (size_t i = 0; i < size; ++i)
+			pData[i] = (uint8_t)i;
+
+		for (uint32_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s)
+		{
+			const size_t nextSize = sizes[s];
+			pData = (uint8_t*)confetti::reallocate(pData, nextSize, alignment);
+			TEST_CHECK(((uintptr_t)pData % alignment) == 0);
+
+			bool same = true;
+			for (size_t i = 0; i < (size < nextSize ? size : nextSize); ++i)
+				same &= pData[i] == (uint8_t)i;
+			TEST_CHECK_MSG(same, "contents lost from %u to %u bytes with alignment %u", (uint32_t)size, (uint32_t)nextSize, (uint32_t)alignment);
+
+			for (size_t i = 0; i < nextSize; ++i)
+				pData[i] = (uint8_t)i;
+			size = nextSize;
+		}
+		TEST_CHECK(confetti::reallocate(pData, 0, alignment) == NULL);
+	}
+
+	// The tracked path over the same sizes
+	uint32_t* pValues = (uint32_t*)conf_malloc(4 * sizeof(uint32_t));
+	uint32_t count = 4;
+	for (uint32_t i = 0; i < count; ++i)
+		pValues[i] = i;
+	while (count < 200000)
+	{
+		pValues = (uint32_t*)conf_realloc(pValues, count * 2 * sizeof(uint32_t));
+		for (uint32_t i = count; i < count * 2; ++i)
+			pValues[i] = i;
+		count *= 2;
+	}
+	uint32_t wrongCount = 0;
+	for (uint32_t i = 0; i < count; ++i)
+		wrongCount += pValues[i] != i;
+	TEST_CHECK(wrongCount == 0);
+	conf_free(pValues);
+}
+
+#define SHARED_SLOT_COUNT 4096
+
+typedef struct SharedBlocks
+{
+	/// Blocks any thread may take and free, each filled with a pattern of its address
+	tfrg_atomic64_t* pSlots;
+	tfrg_atomic32_t mCorruptCount;
+	tfrg_atomic32_t mNextSeed;
+} SharedBlocks;
+
+static uint64_t exchangeSlot(tfrg_atomic64_t* pSlot, uint64_t value)
+{
+	uint64_t current = tfrg_atomic64_load_relaxed(pSlot);
+	for (;;)
+	{
+		const uint64_t prev = tfrg_atomic64_cas(pSlot, current, value);
+		if (prev == current)
+			return prev;
+		current = prev;
+	}
+}
+
+static void freeSharedBlock(SharedBlocks* pShared, uint64_t* pBlock)
+{
+	const size_t count = (size_t)pBlock[0];
+	for (size_t i = 1; i < count; ++i)
+	{
+		if (pBlock[i] != ((uint64_t)(uintptr_t)pBlock ^ i))
+		{
+			tfrg_atomic32_add(&pShared->mCorruptCount, 1);
+			break;
+		}
+	}
+	confetti::deallocate(pBlock);
+}
+
+static void tradeBlocks(void* pData)
+{
+	SharedBlocks* pShared = (SharedBlocks*)pData;
+	uint32_t seed = 1 + 77 * tfrg_atomic32_add(&pShared->mNextSeed, 1);
+	for (uint32_t i = 0; i < 50000; ++i)
+	{
+		tfrg_atomic64_t* pSlot = &pShared->pSlots[nextRandom(&seed) % SHARED_SLOT_COUNT];
+		uint64_t* pBlock = (uint64_t*)(uintptr_t)exchangeSlot(pSlot, 0);
+		if (pBlock)
+		{
+			freeSharedBlock(pShared, pBlock);
+			continue;
+		}
+
+		// Mostly pool sizes, a few from the heap
+		const size_t count = 2 + nextRandom(&seed) % (nextRandom(&seed) % 100 == 0 ? 4000 : 60);
+		pBlock = (uint64_t*)confetti::allocate(count * sizeof(uint64_t));
+		pBlock[0] = count;
+		for (size_t j = 1; j < count; ++j)
+			pBlock[j] = (uint64_t)(uintptr_t)pBlock ^ j;
+		uint64_t* pPrev = (uint64_t*)(uintptr_t)exchangeSlot(pSlot, (uint64_t)(uintptr_t)pBlock);
+		if (pPrev)
+			freeSharedBlock(pShared, pPrev);
+	}
+}
+
+// Rounds of short lived threads, so pool lists of exited threads are reused by the next ones
+static void testCrossThread()
+{
+	const uint32_t threadCount = 4;
+	SharedBlocks shared = {};
+	shared.pSlots = (tfrg_atomic64_t*)conf_calloc(SHARED_SLOT_COUNT, sizeof(tfrg_atomic64_t));
+	Thread* pThreads[threadCount];
+	for (uint32_t round = 0; round < 20; ++round)
+	{
+		for (uint32_t i = 0; i < threadCount; ++i)
+			pThreads[i] = conf_placement_new<Thread>(conf_calloc(1, sizeof(Thread)), tradeBlocks, &shared);
+		for (uint32_t i = 0; i < threadCount; ++i)
+		{
+			pThreads[i]->~Thread();
+			conf_free(pThreads[i]);
+		}
+	}
+
+	for (uint32_t i = 0; i < SHARED_SLOT_COUNT; ++i)
+	{
+		uint64_t* pBlock = (uint64_t*)(uintptr_t)shared.pSlots[i];
+		if (pBlock)
+			freeSharedBlock(&shared, pBlock);
+	}
+	TEST_CHECK_MSG(shared.mCorruptCount == 0, "%u blocks were overwritten", shared.mCorruptCount);
+	conf_free((void*)shared.pSlots);
+}
+
+// dlmalloc with the base pointer and size in 16 bytes in front of the block, as allocate did before the pools
+static void* headerAllocate(size_t size)
+{
+	uint8_t* pBase = (uint8_t*)dlmalloc(size + 16);
+	if (!pBase)
+		return NULL;
+	void** p = (void**)(pBase + 16);
+	p[-2] = pBase;
+	p[-1] = (void*)size;
+	return p;
+}
+
+static void headerDeallocate(void* p)
+{
+	if (p)
+		dlfree(((void**)p)[-2]);
+}
+
+typedef struct BenchmarkDesc
+{
+	uint32_t mOpCount;
+	bool mUseHeaderHeap;
+	tfrg_atomic32_t mNextSeed;
+} BenchmarkDesc;
+
+// Random alloc / free mix, mostly under 1KB with a few large blocks
+static void allocateAndFree(void* pData)
+{
+	BenchmarkDesc* pDesc = (BenchmarkDesc*)pData;
+	uint32_t seed = 12345 + tfrg_atomic32_add(&pDesc->mNextSeed, 1);
+	void* pSlots[1024] = {};
+	for (uint32_t i = 0; i < pDesc->mOpCount; ++i)
+	{
+		const uint32_t slot = nextRandom(&seed) & 1023;
+		if (pSlots[slot])
+		{
+			if (pDesc->mUseHeaderHeap)
+				headerDeallocate(pSlots[slot]);
+			else
+				confetti::deallocate(pSlots[slot]);
+			pSlots[slot] = NULL;
+			continue;
+		}
+
+		const uint32_t r = nextRandom(&seed) % 1000;
+		const size_t size = r < 800 ? 16 + nextRandom(&seed) % 240 :
+			(r < 950 ? 256 + nextRandom(&seed) % 768 : (r < 999 ? 1024 + nextRandom(&seed) % 63000 : 256 * 1024 + nextRandom(&seed) % 768000));
+		pSlots[slot] = pDesc->mUseHeaderHeap ? headerAllocate(size) : confetti::allocate(size);
+		*(volatile char*)pSlots[slot] = 1;
+	}
+
+	for (uint32_t i = 0; i < 1024; ++i)
+	{
+		if (pDesc->mUseHeaderHeap)
+			headerDeallocate(pSlots[i]);
+		else
+			confetti::deallocate(pSlots[i]);
+	}
+}
+
+static float timeAllocations(uint32_t threadCount, bool useHeaderHeap)
+{
+	BenchmarkDesc desc = { 2000000 / threadCount, useHeaderHeap, 0 };
+	Thread* pThreads[8];
+	HiresTimer timer;
+	for (uint32_t i = 0; i < threadCount; ++i)
+		pThreads[i] = conf_placement_new<Thread>(conf_calloc(1, sizeof(Thread)), allocateAndFree, &desc);
+	for (uint32_t i = 0; i < threadCount; ++i)
+	{
+		pThreads[i]->~Thread();
+		conf_free(pThreads[i]);
+	}
+	return timer.GetUSec(false) * 1000.0f / (desc.mOpCount * threadCount);
+}
+
+static void timeAllocators()
+{
+	for (uint32_t threadCount = 1; threadCount <= 8; threadCount *= 2)
+	{
+		float bestTimes[2] = { 1e9f, 1e9f };
+		for (uint32_t run = 0; run < 3; ++run)
+		{
+			for (uint32_t heap = 0; heap < 2; ++heap)
+			{
+				const float time = timeAllocations(threadCount, heap == 1);
+				bestTimes[heap] = time < bestTimes[heap] ? time : bestTimes[heap];
+			}
+		}
+		printf("%u threads: %.1f ns per op with confetti::allocate, %.1f ns with dlmalloc and a header\n", threadCount, bestTimes[0], bestTimes[1]);
+	}
+}
+
+int main(int argc, char** argv)
+{
+	LogManager logManager;
+
+	testAlignment();
+	testAlignedNew();
+	testZeroing();
+	testReallocate();
+	testCrossThread();
+	timeAllocators();
+
+	return finishTest("AllocatorTest");
+}
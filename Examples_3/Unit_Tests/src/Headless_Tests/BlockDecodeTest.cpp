@@ -0,0 +1,307 @@
+/*
+ * Copyright (c) 2018 Confetti Interactive Inc.
+ *
+ * This file is part of The-Forge
+ * (see https://github.com/ConfettiFX/The-Forge).
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+*/
+
+// Image::Uncompress of every BCn format against a scalar per texel decoder written from the format specification,
+// including edge blocks, mip chains and array slices, and the decode and Convert throughput.
+
+#include <stdlib.h>
+
+#include "../../../../Common_3/OS/Image/Image.h"
+#include "../../../../Common_3/OS/Interfaces/IThread.h"
+#include "../../../../Common_3/OS/Interfaces/ITimeManager.h"
+#include "../../../../Common_3/OS/Interfaces/ILogManager.h"
+#include "../../../../Common_3/OS/Interfaces/IMemoryManager.h"
+
+#include "TestFramework.h"
+
+using namespace ImageFormat;
+
+static void referenceColor565(uint8_t rgb[3], uint32_t c)
+{
+	const uint32_t r = (c >> 11) & 0x1F;
+	const uint32_t g = (c >> 5) & 0x3F;
+	const uint32_t b = c & 0x1F;
+	rgb[0] = (uint8_t)((r << 3) | (r >> 2));
+	rgb[1] = (uint8_t)((g << 2) | (g >> 4));
+	rgb[2] = (uint8_t)((b << 3) | (b >> 2));
+}
+
+// Color of texel i of a BC1-3 color block. BC2 and BC3 always use the 4 color mode.
+static void referenceColorTexel(uint8_t rgb[3], const uint8_t* block, uint32_t i, bool alwaysFourColors)
+{
+	const uint32_t c0 = block[0] | (block[1] << 8);
+	const uint32_t c1 = block[2] | (block[3] << 8);
+	const uint32_t index = (block[4 + i / 4] >> (2 * (i % 4))) & 0x3;
+	uint8_t e0[3], e1[3];
+	referenceColor565(e0, c0);
+	referenceColor565(e1, c1);
+
+	for (uint32_t k = 0; k < 3; ++k)
+	{
+		if (index == 0)
+			rgb[k] = e0[k];
+		else if (index == 1)
+			rgb[k] = e1[k];
+		else if (c0 > c1 || alwaysFourColors)
+			rgb[k] = (uint8_t)(index == 2 ? (2 * e0[k] + e1[k] + 1) / 3 : (e0[k] + 2 * e1[k] + 1) / 3);
+		else
+			rgb[k] = (uint8_t)(index == 2 ? (e0[k] + e1[k] + 1) / 2 : 0);
+	}
+}
+
+// Value of texel i of a BC4 block
+static uint8_t referenceBC4Texel(const uint8_t* block, uint32_t i)
+{
+	const uint32_t a0 = block[0];
+	const uint32_t a1 = block[1];
+	const uint32_t bit = 16 + 3 * i;
+	const uint32_t index = ((block[bit / 8] | (block[bit / 8 + 1] << 8)) >> (bit % 8)) & 0x7;
+
+	if (index == 0) return (uint8_t)a0;
+	if (index == 1) return (uint8_t)a1;
+	if (a0 > a1) return (uint8_t)(((8 - index) * a0 + (index - 1) * a1) / 7);
+	if (index < 6) return (uint8_t)(((6 - index) * a0 + (index - 1) * a1) / 5);
+	return index == 6 ? 0 : 255;
+}
+
+// Decodes one surface texel by texel. BC1 decodes to RGB8, BC2 and BC3 to RGBA8, BC4 to I8, BC5 to IA8.
+static void referenceDecode(uint8_t* pDst, const uint8_t* pSrc, uint32_t width, uint32_t height, ImageFormat::Enum format)
+{
+	const uint32_t blockSize = (format == DXT1 || format == ATI1N) ? 8 : 16;
+	const uint32_t bpp = format == DXT1 ? 3 : (format == ATI1N ? 1 : (format == ATI2N ? 2 : 4));
+	const uint32_t blocksX = (width + 3) / 4;
+
+	for (uint32_t y = 0; y < height; ++y)
+	{
+		for (uint32_t x = 0; x < width; ++x)
+		{
+			const uint8_t* block = pSrc + ((y / 4) * blocksX + x / 4) * blockSize;
+			const uint32_t i = (y % 4) * 4 + x % 4;
+			uint8_t* texel = pDst + (y * width + x) * bpp;
+			switch (format)
+			{
+			case DXT1:
+				referenceColorTexel(texel, block, i, false);
+				break;
+			case DXT3:
+				referenceColorTexel(texel, block + 8, i, true);
+				texel[3] = (uint8_t)(((block[i / 2] >> (4 * (i % 2))) & 0xF) * 17);
+				break;
+			case DXT5:
+				referenceColorTexel(texel, block + 8, i, true);
+				texel[3] = referenceBC4Texel(block, i);
+				break;
+			case ATI1N:
+				texel[0] = referenceBC4Texel(block, i);
+				break;
+			case ATI2N:
+				texel[0] = referenceBC4Texel(block, i);
+				texel[1] = referenceBC4Texel(block + 8, i);
+				break;
+			default:
+				break;
+			}
+		}
+	}
+}
+
+static void referenceDecodeImage(uint8_t* pDst, const Image& image, ImageFormat::Enum dstFormat)
+{
+	const ImageFormat::Enum format = image.getFormat();
+	const uint8_t* pSrc = image.GetPixels();
+	for (uint32_t slice = 0; slice < image.GetArrayCount(); ++slice)
+	{
+		for (uint32_t level = 0; level < image.GetMipMapCount(); ++level)
+		{
+			referenceDecode(pDst, pSrc, image.GetWidth(level), image.GetHeight(level), format);
+			pDst += image.GetMipMappedSize(level, 1, dstFormat);
+			pSrc += image.GetMipMappedSize(level, 1);
+		}
+	}
+}
+
+// Random blocks hit both BC1 color modes and both BC4 interpolation modes about equally often
+static void fillRandomBlocks(Image* pImage, uint32_t seed)
+{
+	const uint32_t size = pImage->GetMipMappedSize(0, pImage->GetMipMapCount()) * pImage->GetArrayCount();
+	uint8_t* pPixels = pImage->GetPixels();
+	srand(seed);
+	for (uint32_t i = 0; i < size; ++i)
+		pPixels[i] = (uint8_t)rand();
+}
+
+struct DecodeTestCase
+{
+	ImageFormat::Enum mFormat;
+	ImageFormat::Enum mDecodedFormat;
+};
+
+static const DecodeTestCase gTestCases[] = {
+	{ DXT1, RGB8 }, { DXT3, RGBA8 }, { DXT5, RGBA8 }, { ATI1N, I8 }, { ATI2N, IA8 },
+};
+
+static void testAgainstReference(ThreadPool* pPool)
+{
+	// Multiples of the block size, edge blocks on both sides and mip chains down to 1x1
+	struct Size { uint32_t mWidth, mHeight, mMipMapCount, mArrayCount; };
+	const Size sizes[] = { { 64, 32, 1, 1 }, { 70, 38, 1, 1 }, { 3, 5, 1, 1 }, { 128, 64, 8, 1 }, { 37, 91, 7, 2 } };
+
+	for (uint32_t t = 0; t < sizeof(gTestCases) / sizeof(gTestCases[0]); ++t)
+	{
+		for (uint32_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s)
+		{
+			const DecodeTestCase& testCase = gTestCases[t];
+			const Size& size = sizes[s];
+			Image image;
+			image.Create(testCase.mFormat, size.mWidth, size.mHeight, 1, size.mMipMapCount, size.mArrayCount);
+			fillRandomBlocks(&image, t * 100 + s);
+
+			const uint32_t decodedSize = image.GetMipMappedSize(0, size.mMipMapCount, testCase.mDecodedFormat) * size.mArrayCount;
+			uint8_t* pReference = (uint8_t*)conf_malloc(decodedSize);
+			referenceDecodeImage(pReference, image, testCase.mDecodedFormat);
+			Image serialImage(image);
+
+			TEST_CHECK(image.Uncompress(pPool) && image.getFormat() == testCase.mDecodedFormat);
+			TEST_CHECK(serialImage.Uncompress() && serialImage.getFormat() == testCase.mDecodedFormat);
+
+			uint32_t mismatches = 0;
+			for (uint32_t i = 0; i < decodedSize; ++i)
+				mismatches += image.GetPixels()[i] != pReference[i] ? 1 : 0;
+			TEST_CHECK_MSG(mismatches == 0, "%s %ux%u with %u mips and %u slices: %u bytes differ from the reference", GetFormatString(testCase.mFormat),
+				size.mWidth, size.mHeight, size.mMipMapCount, size.mArrayCount, mismatches);
+			TEST_CHECK_MSG(memcmp(image.GetPixels(), serialImage.GetPixels(), decodedSize) == 0, "%s %ux%u: threaded and serial decode differ",
+				GetFormatString(testCase.mFormat), size.mWidth, size.mHeight);
+
+			conf_free(pReference);
+			image.Destroy();
+			serialImage.Destroy();
+		}
+	}
+}
+
+// Decoded BC1 goes through the RGB8 to RGBA8 kernel of Convert before it is uploaded, and back for the encoder
+static void testConvertDecoded(ThreadPool* pPool)
+{
+	const uint32_t width = 70;
+	const uint32_t height = 38;
+	Image image;
+	image.Create(DXT1, width, height, 1, 1);
+	fillRandomBlocks(&image, 7);
+	uint8_t* pReference = (uint8_t*)conf_malloc(width * height * 3);
+	referenceDecode(pReference, image.GetPixels(), width, height, DXT1);
+
+	TEST_CHECK(image.Uncompress(pPool));
+	TEST_CHECK(image.Convert(RGBA8, pPool));
+	uint32_t mismatches = 0;
+	for (uint32_t i = 0; i < width * height; ++i)
+	{
+		for (uint32_t c = 0; c < 3; ++c)
+			mismatches += image.GetPixels()[i * 4 + c] != pReference[i * 3 + c] ? 1 : 0;
+		mismatches += image.GetPixels()[i * 4 + 3] != 255 ? 1 : 0;
+	}
+	TEST_CHECK_MSG(mismatches == 0, "DXT1 -> RGB8 -> RGBA8: %u bytes differ from the reference", mismatches);
+
+	TEST_CHECK(image.Convert(RGB8, pPool));
+	TEST_CHECK_MSG(memcmp(image.GetPixels(), pReference, width * height * 3) == 0, "DXT1 -> RGB8 -> RGBA8 -> RGB8 does not restore the pixels");
+
+	conf_free(pReference);
+	image.Destroy();
+}
+
+// Megapixels per second of the reference decoder, Uncompress and Uncompress on the pool, best of a few runs
+static void timeDecode(ThreadPool* pPool)
+{
+	const uint32_t width = 2048;
+	const uint32_t height = 2048;
+	const uint32_t runCount = 3;
+	const double megaPixels = width * height / 1e6;
+
+#if defined(__SSSE3__)
+	printf("Block decoders built with SSSE3\n");
+#else
+	printf("Block decoders built without SSSE3, the scalar kernels are timed\n");
+#endif
+
+	for (uint32_t t = 0; t < sizeof(gTestCases) / sizeof(gTestCases[0]); ++t)
+	{
+		const DecodeTestCase& testCase = gTestCases[t];
+		Image compressed;
+		compressed.Create(testCase.mFormat, width, height, 1, 1);
+		fillRandomBlocks(&compressed, t);
+		uint8_t* pReference = (uint8_t*)conf_malloc(compressed.GetMipMappedSize(0, 1, testCase.mDecodedFormat));
+
+		int64_t referenceTime = INT64_MAX;
+		int64_t serialTime = INT64_MAX;
+		int64_t pooledTime = INT64_MAX;
+		int64_t convertTime = INT64_MAX;
+		HiresTimer timer;
+		for (uint32_t run = 0; run < runCount; ++run)
+		{
+			timer.Reset();
+			referenceDecode(pReference, compressed.GetPixels(), width, height, testCase.mFormat);
+			referenceTime = min(referenceTime, timer.GetUSec(false));
+
+			Image serialImage(compressed);
+			timer.Reset();
+			serialImage.Uncompress();
+			serialTime = min(serialTime, timer.GetUSec(false));
+			serialImage.Destroy();
+
+			Image pooledImage(compressed);
+			timer.Reset();
+			pooledImage.Uncompress(pPool);
+			pooledTime = min(pooledTime, timer.GetUSec(false));
+			// What a loader does with BC1 on an API without RGB8 textures
+			if (testCase.mDecodedFormat == RGB8)
+			{
+				timer.Reset();
+				pooledImage.Convert(RGBA8, pPool);
+				convertTime = min(convertTime, timer.GetUSec(false));
+			}
+			pooledImage.Destroy();
+		}
+
+		printf("%-6s: reference %7.1f, Uncompress %7.1f, Uncompress on the pool %7.1f megapixels per second", GetFormatString(testCase.mFormat),
+			megaPixels / (referenceTime / 1e6 + 1e-9), megaPixels / (serialTime / 1e6 + 1e-9), megaPixels / (pooledTime / 1e6 + 1e-9));
+		if (testCase.mDecodedFormat == RGB8)
+			printf(", then Convert to RGBA8 %7.1f", megaPixels / (convertTime / 1e6 + 1e-9));
+		printf("\n");
+
+		conf_free(pReference);
+		compressed.Destroy();
+	}
+}
+
+int main(int argc, char** argv)
+{
+	LogManager logManager;
+	ThreadPool pool;
+	pool.CreateThreads(Thread::GetNumCPUCores() > 1 ? Thread::GetNumCPUCores() - 1 : 1);
+
+	testAgainstReference(&pool);
+	testConvertDecoded(&pool);
+	timeDecode(&pool);
+
+	return finishTest("BlockDecodeTest");
+}
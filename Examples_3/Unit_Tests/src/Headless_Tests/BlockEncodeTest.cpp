@@ -0,0 +1,287 @@
+/*
+ * Copyright (c) 2018 Confetti Interactive Inc.
+ *
+ * This file is part of The-Forge
+ * (see https://github.com/ConfettiFX/The-Forge).
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+*/
+
+// Image::Compress of every BCn format on generated reference images. The decoded result has to stay above a PSNR floor
+// per format and quality, the high quality search must not lose to the fast one, and the encode throughput is reported.
+
+#include <stdlib.h>
+#include <math.h>
+
+#include "../../../../Common_3/OS/Image/Image.h"
+#include "../../../../Common_3/OS/Interfaces/IThread.h"
+#include "../../../../Common_3/OS/Interfaces/ITimeManager.h"
+#include "../../../../Common_3/OS/Interfaces/ILogManager.h"
+#include "../../../../Common_3/OS/Interfaces/IMemoryManager.h"
+
+#include "TestFramework.h"
+
+using namespace ImageFormat;
+
+enum ReferenceImage
+{
+	REFERENCE_GRADIENT = 0,    // Smooth color and alpha ramps
+	REFERENCE_DETAIL,          // Hard edged shapes over stripes of rising frequency
+	REFERENCE_NOISE,           // Grain over a slow gradient, like a photographed surface
+	REFERENCE_COUNT,
+};
+
+static const char* gReferenceNames[REFERENCE_COUNT] = { "gradient", "detail", "noise" };
+
+static uint8_t toUnorm8(float x) { return (uint8_t)(x <= 0.0f ? 0.0f : (x >= 1.0f ? 255.0f : 255.0f * x + 0.5f)); }
+
+static void createReferenceImage(Image* pImage, ReferenceImage reference, uint32_t width, uint32_t height)
+{
+	pImage->Create(RGBA8, width, height, 1, 1);
+	uint8_t* pPixels = pImage->GetPixels();
+	srand(reference + 1);
+
+	for (uint32_t y = 0; y < height; ++y)
+	{
+		for (uint32_t x = 0; x < width; ++x)
+		{
+			const float u = (float)x / width;
+			const float v = (float)y / height;
+			float rgba[4];
+			if (reference == REFERENCE_GRADIENT)
+			{
+				const float radius = sqrtf((u - 0.5f) * (u - 0.5f) + (v - 0.5f) * (v - 0.5f));
+				rgba[0] = u;
+				rgba[1] = v;
+				rgba[2] = 1.0f - radius * 1.4f;
+				rgba[3] = 0.5f + 0.5f * sinf(u * 6.28f);
+			}
+			else if (reference == REFERENCE_DETAIL)
+			{
+				const float stripes = 0.5f + 0.5f * sinf(u * u * 400.0f);
+				const bool inCircle = (u - 0.3f) * (u - 0.3f) + (v - 0.4f) * (v - 0.4f) < 0.04f;
+				const bool inBox = u > 0.55f && u < 0.9f && v > 0.2f && v < 0.7f;
+				rgba[0] = inCircle ? 0.9f : (inBox ? 0.1f : stripes);
+				rgba[1] = inCircle ? 0.2f : (inBox ? 0.6f : 0.5f * stripes + 0.25f * v);
+				rgba[2] = inCircle ? 0.1f : (inBox ? 0.9f : 1.0f - stripes);
+				rgba[3] = (inCircle || inBox) ? 1.0f : (v < 0.5f ? 0.0f : stripes);
+			}
+			else
+			{
+				const float grain = ((rand() % 64) - 32) / 255.0f;
+				rgba[0] = 0.4f + 0.3f * u + grain;
+				rgba[1] = 0.3f + 0.2f * v + grain * 0.8f;
+				rgba[2] = 0.2f + 0.1f * (u + v) + grain * 0.6f;
+				rgba[3] = 0.8f + grain;
+			}
+			for (uint32_t c = 0; c < 4; ++c)
+				pPixels[(y * width + x) * 4 + c] = toUnorm8(rgba[c]);
+		}
+	}
+}
+
+// Reads bits [offset, offset + count) of a 128 bit block
+static uint32_t readBlockBits(const uint8_t* block, uint32_t offset, uint32_t count)
+{
+	uint32_t value = 0;
+	for (uint32_t i = 0; i < count; ++i)
+		value |= ((block[(offset + i) >> 3] >> ((offset + i) & 7)) & 1) << i;
+	return value;
+}
+
+// Decodes BC7 mode 6 blocks to RGBA8, which is the only mode the encoder writes. Returns false on any other mode.
+static bool decodeBC7Mode6(uint8_t* pDst, const uint8_t* pSrc, uint32_t width, uint32_t height)
+{
+	static const uint32_t weights[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+	const uint32_t blocksX = (width + 3) / 4;
+
+	for (uint32_t by = 0; by < (height + 3) / 4; ++by)
+	{
+		for (uint32_t bx = 0; bx < blocksX; ++bx)
+		{
+			const uint8_t* block = pSrc + (by * blocksX + bx) * 16;
+			if (readBlockBits(block, 0, 7) != 1 << 6)
+				return false;
+
+			uint32_t endpoints[2][4];
+			for (uint32_t c = 0; c < 4; ++c)
+			{
+				endpoints[0][c] = readBlockBits(block, 7 + c * 14, 7) << 1;
+				endpoints[1][c] = readBlockBits(block, 14 + c * 14, 7) << 1;
+			}
+			for (uint32_t c = 0; c < 4; ++c)
+			{
+				endpoints[0][c] |= readBlockBits(block, 63, 1);
+				endpoints[1][c] |= readBlockBits(block, 64, 1);
+			}
+
+			for (uint32_t i = 0; i < 16; ++i)
+			{
+				const uint32_t x = bx * 4 + i % 4;
+				const uint32_t y = by * 4 + i / 4;
+				const uint32_t index = (i == 0) ? readBlockBits(block, 65, 3) : readBlockBits(block, 64 + 4 * i, 4);
+				if (x >= width || y >= height)
+					continue;
+				for (uint32_t c = 0; c < 4; ++c)
+					pDst[(y * width + x) * 4 + c] = (uint8_t)(((64 - weights[index]) * endpoints[0][c] + weights[index] * endpoints[1][c] + 32) >> 6);
+			}
+		}
+	}
+	return true;
+}
+
+struct EncodeTestCase
+{
+	ImageFormat::Enum mFormat;
+	uint32_t mChannels;          // Channels the format keeps, compared from the first one
+	float mFloor[2];             // Lowest PSNR in dB accepted for the fast and the high quality search
+};
+
+// The floors sit about a decibel under what the encoder reaches on the worst reference image, which is the detail image
+// for every format. BC7 only uses mode 6, so hard edges between three colors in a block cost it as much as BC3.
+static const EncodeTestCase gTestCases[] = {
+	{ DXT1, 3, { 28.5f, 28.5f } },
+	{ DXT3, 4, { 29.5f, 29.5f } },
+	{ DXT5, 4, { 29.5f, 29.5f } },
+	{ ATI1N, 1, { 34.0f, 37.0f } },
+	{ ATI2N, 2, { 36.0f, 39.0f } },
+	{ GNF_BC7, 4, { 29.0f, 29.0f } },
+};
+
+static float computePSNR(const Image& original, const uint8_t* pDecoded, uint32_t decodedChannels, uint32_t channels)
+{
+	const uint32_t pixelCount = original.GetWidth() * original.GetHeight();
+	const uint8_t* pOriginal = original.GetPixels();
+	double squaredError = 0.0;
+	for (uint32_t i = 0; i < pixelCount; ++i)
+	{
+		for (uint32_t c = 0; c < channels; ++c)
+		{
+			const double d = (double)pOriginal[i * 4 + c] - (double)pDecoded[i * decodedChannels + c];
+			squaredError += d * d;
+		}
+	}
+	const double mse = squaredError / (pixelCount * channels);
+	return mse > 0.0 ? (float)(10.0 * log10(255.0 * 255.0 / mse)) : 99.0f;
+}
+
+// Compresses a copy of the original and returns the PSNR of its decoded pixels
+static float encodeAndMeasure(const Image& original, const EncodeTestCase& testCase, CompressionQuality quality, ThreadPool* pPool)
+{
+	Image image(original);
+	Image serialImage(original);
+	TEST_CHECK(image.Compress(testCase.mFormat, quality, pPool) && image.getFormat() == testCase.mFormat);
+	TEST_CHECK(serialImage.Compress(testCase.mFormat, quality));
+	TEST_CHECK_MSG(memcmp(image.GetPixels(), serialImage.GetPixels(), image.GetMipMappedSize(0, 1)) == 0,
+		"%s: threaded and serial encode differ", GetFormatString(testCase.mFormat));
+	serialImage.Destroy();
+
+	float psnr = 0.0f;
+	if (testCase.mFormat == GNF_BC7)
+	{
+		uint8_t* pDecoded = (uint8_t*)conf_malloc(original.GetWidth() * original.GetHeight() * 4);
+		TEST_CHECK_MSG(decodeBC7Mode6(pDecoded, image.GetPixels(), original.GetWidth(), original.GetHeight()), "BC7 block in another mode than 6");
+		psnr = computePSNR(original, pDecoded, 4, testCase.mChannels);
+		conf_free(pDecoded);
+	}
+	else
+	{
+		TEST_CHECK(image.Uncompress());
+		psnr = computePSNR(original, image.GetPixels(), GetChannelCount(image.getFormat()), testCase.mChannels);
+	}
+	image.Destroy();
+	return psnr;
+}
+
+static void testQualityFloors(ThreadPool* pPool)
+{
+	// Block aligned and with partial edge blocks
+	const uint32_t sizes[][2] = { { 256, 256 }, { 253, 127 } };
+
+	for (uint32_t r = 0; r < REFERENCE_COUNT; ++r)
+	{
+		for (uint32_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s)
+		{
+			Image original;
+			createReferenceImage(&original, (ReferenceImage)r, sizes[s][0], sizes[s][1]);
+
+			for (uint32_t t = 0; t < sizeof(gTestCases) / sizeof(gTestCases[0]); ++t)
+			{
+				const EncodeTestCase& testCase = gTestCases[t];
+				const float fast = encodeAndMeasure(original, testCase, COMPRESSION_QUALITY_FAST, pPool);
+				const float high = encodeAndMeasure(original, testCase, COMPRESSION_QUALITY_HIGH, pPool);
+				printf("%-8s %-8s %3ux%-3u: fast %5.2f dB, high %5.2f dB\n", GetFormatString(testCase.mFormat), gReferenceNames[r], sizes[s][0],
+					sizes[s][1], fast, high);
+
+				TEST_CHECK_MSG(fast >= testCase.mFloor[0], "%s %s: fast quality %.2f dB is under the floor of %.2f dB", GetFormatString(testCase.mFormat),
+					gReferenceNames[r], fast, testCase.mFloor[0]);
+				TEST_CHECK_MSG(high >= testCase.mFloor[1], "%s %s: high quality %.2f dB is under the floor of %.2f dB", GetFormatString(testCase.mFormat),
+					gReferenceNames[r], high, testCase.mFloor[1]);
+				TEST_CHECK_MSG(high >= fast - 0.05f, "%s %s: high quality %.2f dB is worse than fast %.2f dB", GetFormatString(testCase.mFormat),
+					gReferenceNames[r], high, fast);
+			}
+
+			original.Destroy();
+		}
+	}
+}
+
+// Megapixels per second of Compress with and without the pool
+static void timeEncode(ThreadPool* pPool)
+{
+	const uint32_t width = 1024;
+	const uint32_t height = 1024;
+	const double megaPixels = width * height / 1e6;
+	Image original;
+	createReferenceImage(&original, REFERENCE_DETAIL, width, height);
+
+	for (uint32_t t = 0; t < sizeof(gTestCases) / sizeof(gTestCases[0]); ++t)
+	{
+		for (uint32_t q = 0; q < 2; ++q)
+		{
+			const CompressionQuality quality = (CompressionQuality)q;
+			Image serialImage(original);
+			Image pooledImage(original);
+			HiresTimer timer;
+			serialImage.Compress(gTestCases[t].mFormat, quality);
+			const int64_t serialTime = timer.GetUSec(true);
+			pooledImage.Compress(gTestCases[t].mFormat, quality, pPool);
+			const int64_t pooledTime = timer.GetUSec(true);
+
+			printf("%-8s %-4s: Compress %7.1f, Compress on the pool %7.1f megapixels per second\n", GetFormatString(gTestCases[t].mFormat),
+				quality == COMPRESSION_QUALITY_HIGH ? "high" : "fast", megaPixels / (serialTime / 1e6 + 1e-9), megaPixels / (pooledTime / 1e6 + 1e-9));
+
+			serialImage.Destroy();
+			pooledImage.Destroy();
+		}
+	}
+
+	original.Destroy();
+}
+
+int main(int argc, char** argv)
+{
+	LogManager logManager;
+	ThreadPool pool;
+	pool.CreateThreads(Thread::GetNumCPUCores() > 1 ? Thread::GetNumCPUCores() - 1 : 1);
+
+	testQualityFloors(&pool);
+	timeEncode(&pool);
+
+	return finishTest("BlockEncodeTest");
+}
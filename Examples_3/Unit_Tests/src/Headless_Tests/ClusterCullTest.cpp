@@ -0,0 +1,451 @@
+/*
+ * Copyright (c) 2018 Confetti Interactive Inc.
+ *
+ * This file is part of The-Forge
+ * (see https://github.com/ConfettiFX/The-Forge).
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+*/
+
+// Cluster generation and CPU cluster culling of the Visibility Buffer on generated scenes. Checks that CreateClusters
+// on the thread pool matches the per mesh version, and that cullClusters matches a per cluster reference computed in
+// double precision from the clusters.
+
+#include <stdlib.h>
+#include <math.h>
+
+#include "../../../Visibility_Buffer/src/Geometry.h"
+#include "../../../../Common_3/ThirdParty/OpenSource/TinySTL/vector.h"
+#include "../../../../Common_3/OS/Interfaces/IThread.h"
+#include "../../../../Common_3/OS/Interfaces/ITimeManager.h"
+#include "../../../../Common_3/OS/Interfaces/ILogManager.h"
+#include "../../../../Common_3/OS/Interfaces/IMemoryManager.h"
+
+#include "TestFramework.h"
+
+typedef struct TestScene
+{
+	Scene mScene;
+	tinystl::vector<SceneVertexPos> mPositions;
+	tinystl::vector<uint32_t> mIndices;
+	tinystl::vector<Mesh> mMeshes;
+	Material mMaterials[2];
+} TestScene;
+
+static float randomFloat(float minValue, float maxValue)
+{
+	return minValue + (maxValue - minValue) * (rand() / (float)RAND_MAX);
+}
+
+/// Grid of quads in the plane spanned by the axes, facing cross(axisU, axisV). bump > 0 moves the vertices off the plane.
+static void addGridMesh(TestScene* pTest, const vec3& origin, const vec3& axisU, const vec3& axisV, uint32_t sizeU, uint32_t sizeV, float bump, bool twoSided)
+{
+	const vec3 normal = normalize(cross(axisU, axisV));
+	const uint32_t firstVertex = (uint32_t)pTest->mPositions.size();
+	for (uint32_t v = 0; v <= sizeV; ++v)
+	{
+		for (uint32_t u = 0; u <= sizeU; ++u)
+		{
+			const vec3 position = origin + axisU * (float)u + axisV * (float)v + normal * (bump ? randomFloat(-bump, bump) : 0.0f);
+			SceneVertexPos vertex = { position.getX(), position.getY(), position.getZ() };
+			pTest->mPositions.push_back(vertex);
+		}
+	}
+
+	Mesh mesh = {};
+	mesh.startIndex = (uint32_t)pTest->mIndices.size();
+	mesh.materialId = twoSided ? 1 : 0;
+	for (uint32_t v = 0; v < sizeV; ++v)
+	{
+		for (uint32_t u = 0; u < sizeU; ++u)
+		{
+			const uint32_t i = firstVertex + v * (sizeU + 1) + u;
+			const uint32_t quad[6] = { i, i + 1, i + sizeU + 1, i + 1, i + sizeU + 2, i + sizeU + 1 };
+			for (uint32_t j = 0; j < 6; ++j)
+				pTest->mIndices.push_back(quad[j]);
+		}
+	}
+	mesh.indexCount = (uint32_t)pTest->mIndices.size() - mesh.startIndex;
+	pTest->mMeshes.push_back(mesh);
+}
+
+/// Triangles between random vertices of a box, the clusters can't be cone culled
+static void addSoupMesh(TestScene* pTest, const vec3& origin, float size, uint32_t triangleCount)
+{
+	Mesh mesh = {};
+	mesh.startIndex = (uint32_t)pTest->mIndices.size();
+	for (uint32_t i = 0; i < triangleCount * 3; ++i)
+	{
+		SceneVertexPos vertex = { origin.getX() + randomFloat(0, size), origin.getY() + randomFloat(0, size), origin.getZ() + randomFloat(0, size) };
+		pTest->mIndices.push_back((uint32_t)pTest->mPositions.size());
+		pTest->mPositions.push_back(vertex);
+	}
+	mesh.indexCount = triangleCount * 3;
+	pTest->mMeshes.push_back(mesh);
+}
+
+static void finishTestScene(TestScene* pTest)
+{
+	pTest->mMaterials[0].twoSided = false;
+	pTest->mMaterials[0].alphaTested = false;
+	pTest->mMaterials[1].twoSided = true;
+	pTest->mMaterials[1].alphaTested = false;
+
+	Scene* pScene = &pTest->mScene;
+	memset(pScene, 0, sizeof(Scene));
+	pScene->numMeshes = (uint32_t)pTest->mMeshes.size();
+	pScene->numMaterials = 2;
+	pScene->totalVertices = (uint32_t)pTest->mPositions.size();
+	pScene->totalTriangles = (uint32_t)pTest->mIndices.size() / 3;
+	pScene->meshes = pTest->mMeshes.data();
+	pScene->materials = pTest->mMaterials;
+	pScene->positions = pTest->mPositions.data();
+	pScene->indices = pTest->mIndices.data();
+}
+
+static void removeClusters(Scene* pScene)
+{
+	for (uint32_t i = 0; i < pScene->numMeshes; ++i)
+	{
+		conf_free(pScene->meshes[i].clusters);
+		conf_free(pScene->meshes[i].clusterCompacts);
+	}
+}
+
+/// View with the planes x >= minX, x <= maxX, y >= minY, y <= maxY
+static ClusterCullView getBoxView(float minX, float maxX, float minY, float maxY, const vec3& eye)
+{
+	ClusterCullView view = {};
+	const float planes[4][4] = { { 1, 0, 0, -minX }, { -1, 0, 0, maxX }, { 0, 1, 0, -minY }, { 0, -1, 0, maxY } };
+	memcpy(view.planes, planes, sizeof(planes));
+	view.eye[0] = eye.getX();
+	view.eye[1] = eye.getY();
+	view.eye[2] = eye.getZ();
+	return view;
+}
+
+static void cullScene(const ClusterCullData* pCullData, uint32_t viewCount, const ClusterCullView* pViews, uint8_t* pVisibility)
+{
+	memset(pVisibility, 0xcd, pCullData->paddedClusterCount);
+	cullClusters(pCullData, 0, pCullData->paddedClusterCount, viewCount, pViews, pVisibility);
+}
+
+// Known answers on a grid facing +z, a two sided copy of it and a soup
+static void testKnownVisibility(ThreadPool* pPool)
+{
+	TestScene test;
+	addGridMesh(&test, vec3(0, 0, 0), vec3(1, 0, 0), vec3(0, 1, 0), 16, 16, 0.0f, false);
+	addGridMesh(&test, vec3(0, 0, 0), vec3(1, 0, 0), vec3(0, 1, 0), 16, 16, 0.0f, true);
+	addSoupMesh(&test, vec3(0, 0, -1), 2.0f, 300);
+	finishTestScene(&test);
+	Scene* pScene = &test.mScene;
+	CreateClusters(pPool, pScene);
+
+	TEST_CHECK(pScene->meshes[0].clusterCount == 2 && pScene->meshes[1].clusterCount == 2 && pScene->meshes[2].clusterCount == 2);
+	for (uint32_t i = 0; i < pScene->meshes[0].clusterCount; ++i)
+	{
+		const Cluster& cluster = pScene->meshes[0].clusters[i];
+		TEST_CHECK(cluster.valid);
+		TEST_CHECK(cluster.coneAxis.x == 0.0f && cluster.coneAxis.y == 0.0f && fabsf(cluster.coneAxis.z + 1.0f) < 1e-5f);
+		TEST_CHECK(!pScene->meshes[1].clusters[i].valid);
+		TEST_CHECK(!pScene->meshes[2].clusters[i].valid);
+		TEST_CHECK(pScene->meshes[0].clusterCompacts[i].triangleCount == CLUSTER_SIZE);
+		TEST_CHECK(pScene->meshes[0].clusterCompacts[i].clusterStart == i * CLUSTER_SIZE);
+	}
+
+	ClusterCullData* pCullData = NULL;
+	addClusterCullData(pScene, &pCullData);
+	TEST_CHECK(pCullData->clusterCount == 6);
+	TEST_CHECK(pCullData->paddedClusterCount % CLUSTER_CULL_LANES == 0 && pCullData->paddedClusterCount >= 6);
+	TEST_CHECK(pCullData->meshClusterOffsets[0] == 0 && pCullData->meshClusterOffsets[1] == 2 && pCullData->meshClusterOffsets[2] == 4);
+	uint8_t visibility[64];
+
+	// In front of the grid
+	ClusterCullView views[2];
+	views[0] = getBoxView(-1, 17, -1, 17, vec3(8, 8, 20));
+	cullScene(pCullData, 1, views, visibility);
+	for (uint32_t i = 0; i < 6; ++i)
+		TEST_CHECK_MSG(visibility[i] == 1, "cluster %u culled from the front", i);
+
+	// Behind the grid only the one sided clusters are culled
+	views[0] = getBoxView(-1, 17, -1, 17, vec3(8, 8, -20));
+	cullScene(pCullData, 1, views, visibility);
+	for (uint32_t i = 0; i < 6; ++i)
+		TEST_CHECK_MSG(visibility[i] == (i < 2 ? 0 : 1), "cluster %u from behind", i);
+
+	// The first cluster covers the rows y < 8, the second one the rows above
+	views[0] = getBoxView(-1, 17, 9, 17, vec3(8, 8, 20));
+	cullScene(pCullData, 1, views, visibility);
+	TEST_CHECK(visibility[0] == 0 && visibility[1] == 1 && visibility[2] == 0 && visibility[3] == 1);
+	views[0] = getBoxView(20, 30, -1, 17, vec3(8, 8, 20));
+	cullScene(pCullData, 1, views, visibility);
+	for (uint32_t i = 0; i < 6; ++i)
+		TEST_CHECK(visibility[i] == 0);
+
+	// Visible from any view is visible
+	views[0] = getBoxView(-1, 17, -1, 17, vec3(8, 8, -20));
+	views[1] = getBoxView(-1, 17, 9, 17, vec3(8, 8, 20));
+	cullScene(pCullData, 2, views, visibility);
+	TEST_CHECK(visibility[0] == 0 && visibility[1] == 1);
+
+	// The padding is never visible
+	views[0] = getBoxView(-1000, 1000, -1000, 1000, vec3(0, 0, 1000));
+	cullScene(pCullData, 1, views, visibility);
+	for (uint32_t i = pCullData->clusterCount; i < pCullData->paddedClusterCount; ++i)
+		TEST_CHECK(visibility[i] == 0);
+
+	// The identity matrix keeps the side planes of the clip space cube
+	ClusterCullView view;
+	getClusterCullView(mat4::identity(), vec3(1, 2, 3), &view);
+	const float expectedPlanes[4][4] = { { 1, 0, 0, 1 }, { -1, 0, 0, 1 }, { 0, 1, 0, 1 }, { 0, -1, 0, 1 } };
+	TEST_CHECK(memcmp(view.planes, expectedPlanes, sizeof(expectedPlanes)) == 0);
+	TEST_CHECK(view.eye[0] == 1 && view.eye[1] == 2 && view.eye[2] == 3);
+
+	removeClusterCullData(pCullData);
+	removeClusters(pScene);
+}
+
+static bool clustersEqual(const Mesh& a, const Mesh& b)
+{
+	if (a.clusterCount != b.clusterCount)
+		return false;
+	for (uint32_t i = 0; i < a.clusterCount; ++i)
+	{
+		const Cluster& x = a.clusters[i];
+		const Cluster& y = b.clusters[i];
+		if (memcmp(&x.aabbMin, &y.aabbMin, sizeof(float3)) || memcmp(&x.aabbMax, &y.aabbMax, sizeof(float3)) || x.valid != y.valid)
+			return false;
+		if (x.valid && (memcmp(&x.coneCenter, &y.coneCenter, sizeof(float3)) || memcmp(&x.coneAxis, &y.coneAxis, sizeof(float3)) ||
+			x.coneAngleCosine != y.coneAngleCosine))
+			return false;
+		if (memcmp(&a.clusterCompacts[i], &b.clusterCompacts[i], sizeof(ClusterCompact)))
+			return false;
+	}
+	return true;
+}
+
+/// Visibility of a cluster from a view in double precision. Returns -1 if the result is too close to call in float.
+static int getReferenceVisibility(const Cluster& cluster, const ClusterCullView& view)
+{
+	const double epsilon = 1e-4;
+	const double apex[3] = { cluster.coneCenter.x, cluster.coneCenter.y, cluster.coneCenter.z };
+	const double axis[3] = { cluster.coneAxis.x, cluster.coneAxis.y, cluster.coneAxis.z };
+	const double aabbMin[3] = { cluster.aabbMin.x, cluster.aabbMin.y, cluster.aabbMin.z };
+	const double aabbMax[3] = { cluster.aabbMax.x, cluster.aabbMax.y, cluster.aabbMax.z };
+	bool tooClose = false;
+
+	if (cluster.valid)
+	{
+		double length = 0.0;
+		double coneDot = 0.0;
+		for (uint32_t c = 0; c < 3; ++c)
+		{
+			const double d = view.eye[c] - apex[c];
+			length += d * d;
+			coneDot += d * axis[c];
+		}
+		length = sqrt(length);
+		const double margin = cluster.coneAngleCosine * length - coneDot;
+		if (fabs(margin) <= epsilon * (length + 1.0))
+			tooClose = true;
+		else if (margin < 0.0)
+			return 0;
+	}
+
+	for (uint32_t p = 0; p < 4; ++p)
+	{
+		const float* plane = view.planes[p];
+		double distance = plane[3];
+		double scale = fabs(plane[3]) + 1.0;
+		for (uint32_t c = 0; c < 3; ++c)
+		{
+			const double center = (aabbMin[c] + aabbMax[c]) * 0.5;
+			const double extent = (aabbMax[c] - aabbMin[c]) * 0.5;
+			distance += plane[c] * center + fabs(plane[c]) * extent;
+			scale += fabs(plane[c]) * (fabs(center) + extent);
+		}
+		if (fabs(distance) <= epsilon * scale)
+			tooClose = true;
+		else if (distance < 0.0)
+			return 0;
+	}
+
+	return tooClose ? -1 : 1;
+}
+
+static ClusterCullView getRandomView()
+{
+	ClusterCullView view = {};
+	const vec3 eye(randomFloat(-60, 60), randomFloat(-60, 60), randomFloat(-60, 60));
+	for (uint32_t p = 0; p < 4; ++p)
+	{
+		const vec3 normal = normalize(vec3(randomFloat(-1, 1), randomFloat(-1, 1), randomFloat(-1, 1)));
+		const vec3 pointOnPlane = eye + vec3(randomFloat(-20, 20), randomFloat(-20, 20), randomFloat(-20, 20));
+		view.planes[p][0] = normal.getX();
+		view.planes[p][1] = normal.getY();
+		view.planes[p][2] = normal.getZ();
+		view.planes[p][3] = -dot(normal, pointOnPlane);
+	}
+	view.eye[0] = eye.getX();
+	view.eye[1] = eye.getY();
+	view.eye[2] = eye.getZ();
+	return view;
+}
+
+typedef struct CullRangeData
+{
+	const ClusterCullData* pCullData;
+	const ClusterCullView* pViews;
+	uint8_t* pVisibility;
+} CullRangeData;
+
+// Same split as runClusterCulling of the Visibility Buffer
+static void cullClusterRange(void* pData, uint32_t begin, uint32_t end)
+{
+	const CullRangeData* pRange = (const CullRangeData*)pData;
+	cullClusters(pRange->pCullData, begin * CLUSTER_CULL_LANES, end * CLUSTER_CULL_LANES, 2, pRange->pViews, pRange->pVisibility);
+}
+
+// Generated scene with oriented, bumpy and two sided grids and soups, culled from random views
+static void testRandomScene(ThreadPool* pPool)
+{
+	TestScene test;
+	srand(3);
+	for (uint32_t i = 0; i < 120; ++i)
+	{
+		const vec3 origin(randomFloat(-50, 50), randomFloat(-50, 50), randomFloat(-50, 50));
+		const vec3 axisU = normalize(vec3(randomFloat(-1, 1), randomFloat(-1, 1), randomFloat(-1, 1)));
+		const vec3 axisV = normalize(cross(axisU, vec3(randomFloat(-1, 1), randomFloat(-1, 1), randomFloat(-1, 1))));
+		const uint32_t size = 4 + rand() % 60;
+		if (i % 4 == 3)
+			addSoupMesh(&test, origin, randomFloat(1, 10), 1 + rand() % 2000);
+		else
+			addGridMesh(&test, origin, axisU * 0.5f, axisV * 0.5f, size, size, i % 4 == 1 ? 0.02f : 0.0f, i % 5 == 0);
+	}
+	// Meshes without triangles and a big one spanning many clusters
+	for (uint32_t i = 0; i < 3; ++i)
+	{
+		Mesh mesh = {};
+		test.mMeshes.push_back(mesh);
+	}
+	addGridMesh(&test, vec3(-40, -40, 0), vec3(0.5f, 0, 0), vec3(0, 0.5f, 0), 300, 300, 0.01f, false);
+	finishTestScene(&test);
+	Scene* pScene = &test.mScene;
+
+	// Serial per mesh clusters as reference
+	tinystl::vector<Mesh> serialMeshes = test.mMeshes;
+	HiresTimer timer;
+	for (uint32_t i = 0; i < pScene->numMeshes; ++i)
+		CreateClusters(pScene->materials[serialMeshes[i].materialId].twoSided, pScene, &serialMeshes[i]);
+	const float serialTime = timer.GetUSec(true) / 1000.0f;
+	CreateClusters(pPool, pScene);
+	const float parallelTime = timer.GetUSec(true) / 1000.0f;
+
+	uint32_t clusterCount = 0;
+	uint32_t validCount = 0;
+	for (uint32_t i = 0; i < pScene->numMeshes; ++i)
+	{
+		TEST_CHECK_MSG(clustersEqual(pScene->meshes[i], serialMeshes[i]), "clusters of mesh %u differ from the per mesh version", i);
+		clusterCount += pScene->meshes[i].clusterCount;
+		for (uint32_t j = 0; j < pScene->meshes[i].clusterCount; ++j)
+			validCount += pScene->meshes[i].clusters[j].valid;
+		conf_free(serialMeshes[i].clusters);
+		conf_free(serialMeshes[i].clusterCompacts);
+	}
+	TEST_CHECK(validCount > 0 && validCount < clusterCount);
+	printf("%u clusters, %u with a valid cone: %.2f ms per mesh, %.2f ms on the thread pool\n", clusterCount, validCount, serialTime, parallelTime);
+
+	ClusterCullData* pCullData = NULL;
+	addClusterCullData(pScene, &pCullData);
+	TEST_CHECK(pCullData->clusterCount == clusterCount);
+	uint8_t* pVisibility = (uint8_t*)conf_malloc(pCullData->paddedClusterCount);
+
+	uint32_t visibleCount = 0;
+	uint32_t tooCloseCount = 0;
+	uint32_t mismatchCount = 0;
+	for (uint32_t round = 0; round < 50; ++round)
+	{
+		ClusterCullView views[2] = { getRandomView(), getRandomView() };
+		const uint32_t viewCount = 1 + round % 2;
+		CullRangeData range = { pCullData, views, pVisibility };
+		memset(pVisibility, 0xcd, pCullData->paddedClusterCount);
+		if (viewCount == 2)
+			parallelFor(pPool, pCullData->paddedClusterCount / CLUSTER_CULL_LANES, 256, cullClusterRange, &range);
+		else
+			cullClusters(pCullData, 0, pCullData->paddedClusterCount, viewCount, views, pVisibility);
+
+		for (uint32_t i = 0; i < pScene->numMeshes; ++i)
+		{
+			for (uint32_t j = 0; j < pScene->meshes[i].clusterCount; ++j)
+			{
+				int expected = 0;
+				for (uint32_t v = 0; v < viewCount && expected != 1; ++v)
+				{
+					const int visibility = getReferenceVisibility(pScene->meshes[i].clusters[j], views[v]);
+					expected = visibility != 0 ? visibility : expected;
+				}
+
+				const uint8_t visible = pVisibility[pCullData->meshClusterOffsets[i] + j];
+				if (expected < 0)
+					++tooCloseCount;
+				else if (visible != (uint8_t)expected)
+					++mismatchCount;
+				visibleCount += visible == 1;
+			}
+		}
+		for (uint32_t i = pCullData->clusterCount; i < pCullData->paddedClusterCount; ++i)
+			TEST_CHECK(pVisibility[i] == 0);
+	}
+	TEST_CHECK_MSG(mismatchCount == 0, "%u clusters differ from the reference", mismatchCount);
+	// Both outcomes have to be covered for the comparison to mean anything
+	TEST_CHECK(visibleCount > 0 && visibleCount < 50 * clusterCount);
+
+	// The calling thread alone against the thread pool, split the same way as in the Visibility Buffer
+	ClusterCullView views[2] = { getRandomView(), getRandomView() };
+	CullRangeData range = { pCullData, views, pVisibility };
+	const uint32_t repeatCount = 100;
+	timer.Reset();
+	for (uint32_t i = 0; i < repeatCount; ++i)
+		cullClusters(pCullData, 0, pCullData->paddedClusterCount, 2, views, pVisibility);
+	const float singleTime = timer.GetUSec(true) / 1000.0f / repeatCount;
+	for (uint32_t i = 0; i < repeatCount; ++i)
+		parallelFor(pPool, pCullData->paddedClusterCount / CLUSTER_CULL_LANES, 256, cullClusterRange, &range);
+	const float poolTime = timer.GetUSec(true) / 1000.0f / repeatCount;
+	printf("Culling %u clusters against 2 views, %u lanes: %.3f ms on one thread, %.3f ms on the thread pool, %u close calls skipped\n",
+		clusterCount, CLUSTER_CULL_LANES, singleTime, poolTime, tooCloseCount);
+
+	conf_free(pVisibility);
+	removeClusterCullData(pCullData);
+	removeClusters(pScene);
+}
+
+int main(int argc, char** argv)
+{
+	LogManager logManager;
+
+	ThreadPool* pPool = conf_placement_new<ThreadPool>(conf_calloc(1, sizeof(ThreadPool)));
+	const uint32_t coreCount = Thread::GetNumCPUCores();
+	pPool->CreateThreads(coreCount > 1 ? coreCount - 1 : 1);
+
+	testKnownVisibility(pPool);
+	testRandomScene(pPool);
+
+	pPool->~ThreadPool();
+	conf_free(pPool);
+	return finishTest("ClusterCullTest");
+}
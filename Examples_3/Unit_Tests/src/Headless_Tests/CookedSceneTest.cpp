@@ -0,0 +1,346 @@
+/*
+ * Copyright (c) 2018 Confetti Interactive Inc.
+ *
+ * This file is part of The-Forge
+ * (see https://github.com/ConfettiFX/The-Forge).
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+*/
+
+// Cooked scenes of the Visibility Buffer on a generated source scene. Checks that a cooked scene maps back to exactly
+// what loadScene and CreateClusters produced, that changed sources and damaged cooked files are rejected, and compares
+// the load times of both paths.
+
+#include "../../../Visibility_Buffer/src/Geometry.h"
+#include "../../../../Common_3/ThirdParty/OpenSource/TinySTL/vector.h"
+#include "../../../../Common_3/OS/Interfaces/IFileSystem.h"
+#include "../../../../Common_3/OS/Interfaces/IThread.h"
+#include "../../../../Common_3/OS/Interfaces/ITimeManager.h"
+#include "../../../../Common_3/OS/Interfaces/ILogManager.h"
+#include "../../../../Common_3/OS/Interfaces/IMemoryManager.h"
+
+#include "TestFramework.h"
+
+#define GRID_SIZE 96
+#define GRID_COUNT 24
+
+static String gSceneDir;
+
+static void writeFile(const String& fileName, const void* pData, uint32_t size)
+{
+	File file = {};
+	file.Open(fileName, FM_WriteBinary, FSR_Absolute);
+	TEST_CHECK(file.IsOpen());
+	file.Write(pData, size);
+	file.Close();
+}
+
+static void readFile(const String& fileName, tinystl::vector<uint8_t>& data)
+{
+	File file = {};
+	file.Open(fileName, FM_ReadBinary, FSR_Absolute);
+	TEST_CHECK(file.IsOpen());
+	data.resize(file.GetSize());
+	file.Read(data.data(), (unsigned)data.size());
+	file.Close();
+}
+
+static void appendBytes(tinystl::vector<uint8_t>& data, const void* pData, size_t size)
+{
+	data.insert(data.end(), (const uint8_t*)pData, (const uint8_t*)pData + size);
+}
+
+static void appendUint(tinystl::vector<uint8_t>& data, uint32_t value)
+{
+	appendBytes(data, &value, sizeof(value));
+}
+
+static void appendName(tinystl::vector<uint8_t>& data, const char* pName)
+{
+	appendUint(data, (uint32_t)strlen(pName) + 1);
+	appendBytes(data, pName, strlen(pName) + 1);
+}
+
+/// Source scene in the format read by loadScene, made of bumpy grids sharing one vertex and index stream
+static void createSourceScene(tinystl::vector<uint8_t>& data)
+{
+	const uint32_t vertexCount = GRID_COUNT * (GRID_SIZE + 1) * (GRID_SIZE + 1);
+	const uint32_t indexCount = GRID_COUNT * GRID_SIZE * GRID_SIZE * 6;
+	tinystl::vector<uint32_t> indices;
+	tinystl::vector<float3> positions;
+	tinystl::vector<float2> texCoords;
+	tinystl::vector<float3> normals;
+	tinystl::vector<float3> tangents;
+	for (uint32_t g = 0; g < GRID_COUNT; ++g)
+	{
+		const uint32_t firstVertex = (uint32_t)positions.size();
+		for (uint32_t v = 0; v <= GRID_SIZE; ++v)
+		{
+			for (uint32_t u = 0; u <= GRID_SIZE; ++u)
+			{
+				positions.push_back(float3((float)u, (float)v, (float)g * 4.0f + sinf(u * 0.3f + g) * cosf(v * 0.2f)));
+				texCoords.push_back(float2(u / (float)GRID_SIZE, v / (float)GRID_SIZE));
+				normals.push_back(float3(0.0f, sinf(u * 0.1f) * 0.5f, 1.0f));
+				tangents.push_back(float3(1.0f, 0.0f, cosf(v * 0.1f) * 0.5f));
+			}
+		}
+		for (uint32_t v = 0; v < GRID_SIZE; ++v)
+		{
+			for (uint32_t u = 0; u < GRID_SIZE; ++u)
+			{
+				const uint32_t i = firstVertex + v * (GRID_SIZE + 1) + u;
+				const uint32_t quad[6] = { i, i + 1, i + GRID_SIZE + 1, i + 1, i + GRID_SIZE + 2, i + GRID_SIZE + 1 };
+				indices.insert(indices.end(), quad, quad + 6);
+			}
+		}
+	}
+	TEST_CHECK(positions.size() == vertexCount && indices.size() == indexCount);
+
+	data.clear();
+	appendUint(data, GRID_COUNT);
+	appendUint(data, vertexCount);
+	appendUint(data, indexCount);
+	appendBytes(data, indices.data(), indices.size() * sizeof(uint32_t));
+	appendBytes(data, positions.data(), positions.size() * sizeof(float3));
+	appendBytes(data, texCoords.data(), texCoords.size() * sizeof(float2));
+	appendBytes(data, normals.data(), normals.size() * sizeof(float3));
+	appendBytes(data, tangents.data(), tangents.size() * sizeof(float3));
+	for (uint32_t g = 0; g < GRID_COUNT; ++g)
+	{
+		appendUint(data, g % 4);
+		appendUint(data, (GRID_SIZE + 1) * (GRID_SIZE + 1));
+		appendUint(data, g * GRID_SIZE * GRID_SIZE * 6);
+		appendUint(data, GRID_SIZE * GRID_SIZE * 6);
+	}
+
+	// Default textures, a texture with a path, a two sided and an alpha tested material by name
+	const char* materialNames[4] = { "Default", "Wall", "Tronco", "aglaonema_Leaf" };
+	const char* albedoNames[4] = { "", "Textures/Wall.dds", "Bark.dds", "Leaf.dds" };
+	const uint32_t twoSided[4] = { 0, 1, 0, 0 };
+	appendUint(data, 4);
+	for (uint32_t i = 0; i < 4; ++i)
+	{
+		appendName(data, materialNames[i]);
+		appendName(data, albedoNames[i]);
+		const float shininess = 8.0f;
+		appendBytes(data, &shininess, sizeof(shininess));
+		appendUint(data, twoSided[i]);
+	}
+}
+
+static void checkScenesEqual(const Scene* pScene, const Scene* pCooked)
+{
+	TEST_CHECK(pCooked->numMeshes == pScene->numMeshes && pCooked->numMaterials == pScene->numMaterials);
+	TEST_CHECK(pCooked->totalVertices == pScene->totalVertices && pCooked->totalTriangles == pScene->totalTriangles);
+	if (pCooked->numMeshes != pScene->numMeshes || pCooked->numMaterials != pScene->numMaterials ||
+		pCooked->totalVertices != pScene->totalVertices || pCooked->totalTriangles != pScene->totalTriangles)
+		return;
+
+	const uint32_t vertexCount = pScene->totalVertices;
+	TEST_CHECK(!memcmp(pCooked->positions, pScene->positions, vertexCount * sizeof(SceneVertexPos)));
+	TEST_CHECK(!memcmp(pCooked->texCoords, pScene->texCoords, vertexCount * sizeof(SceneVertexTexCoord)));
+	TEST_CHECK(!memcmp(pCooked->normals, pScene->normals, vertexCount * sizeof(SceneVertexNormal)));
+	TEST_CHECK(!memcmp(pCooked->tangents, pScene->tangents, vertexCount * sizeof(SceneVertexTangent)));
+#if !defined(METAL)
+	TEST_CHECK(!memcmp(pCooked->indices, pScene->indices, pScene->totalTriangles * sizeof(uint32_t)));
+#endif
+
+	// Streams are handed to the GPU buffers straight from the mapping
+	TEST_CHECK(((uintptr_t)pCooked->positions & 63) == 0 && ((uintptr_t)pCooked->normals & 63) == 0);
+
+	for (uint32_t i = 0; i < pScene->numMeshes; ++i)
+	{
+		const Mesh& mesh = pScene->meshes[i];
+		const Mesh& cooked = pCooked->meshes[i];
+#if defined(METAL)
+		TEST_CHECK(cooked.startVertex == mesh.startVertex && cooked.triangleCount == mesh.triangleCount);
+#else
+		TEST_CHECK(cooked.startIndex == mesh.startIndex && cooked.indexCount == mesh.indexCount);
+#endif
+		TEST_CHECK(cooked.vertexCount == mesh.vertexCount && cooked.materialId == mesh.materialId);
+		TEST_CHECK_MSG(cooked.clusterCount == mesh.clusterCount &&
+			!memcmp(cooked.clusters, mesh.clusters, mesh.clusterCount * sizeof(Cluster)) &&
+			!memcmp(cooked.clusterCompacts, mesh.clusterCompacts, mesh.clusterCount * sizeof(ClusterCompact)),
+			"clusters of mesh %u differ", i);
+	}
+
+	for (uint32_t i = 0; i < pScene->numMaterials; ++i)
+	{
+		TEST_CHECK(pCooked->materials[i].twoSided == pScene->materials[i].twoSided);
+		TEST_CHECK(pCooked->materials[i].alphaTested == pScene->materials[i].alphaTested);
+		TEST_CHECK(!strcmp(pCooked->textures[i], pScene->textures[i]));
+		TEST_CHECK(!strcmp(pCooked->normalMaps[i], pScene->normalMaps[i]));
+		TEST_CHECK(!strcmp(pCooked->specularMaps[i], pScene->specularMaps[i]));
+	}
+}
+
+// Rewrites the source until its modification time changed, so loads can't skip comparing its contents
+static void rewriteSource(const String& fileName, const tinystl::vector<uint8_t>& data)
+{
+	const unsigned modifiedTime = FileSystem::GetLastModifiedTime(fileName);
+	do
+	{
+		Thread::Sleep(100);
+		writeFile(fileName, data.data(), (uint32_t)data.size());
+	} while (FileSystem::GetLastModifiedTime(fileName) == modifiedTime);
+}
+
+static bool canLoadCookedScene(const String& fileName, const char* pSourceFileName)
+{
+	Scene* pScene = loadCookedScene(fileName.c_str(), pSourceFileName);
+	if (pScene)
+		removeScene(pScene);
+	return pScene != NULL;
+}
+
+static void testRoundTrip(ThreadPool* pPool)
+{
+	const String sourceName = gSceneDir + "scene.bin";
+	const String cookedName = gSceneDir + "scene.cooked";
+	tinystl::vector<uint8_t> source;
+	createSourceScene(source);
+	writeFile(sourceName, source.data(), (uint32_t)source.size());
+	FileSystem::Delete(cookedName);
+	TEST_CHECK(!canLoadCookedScene(cookedName, sourceName.c_str()));
+
+	Scene* pScene = loadScene(sourceName.c_str());
+	TEST_CHECK(pScene != NULL);
+	if (!pScene)
+		return;
+	CreateClusters(pPool, pScene);
+
+	// Names resolved while loading
+	TEST_CHECK(!strcmp(pScene->textures[0], "default.dds") && !strcmp(pScene->normalMaps[0], "default_nrm.dds"));
+	TEST_CHECK(!strcmp(pScene->textures[1], "Wall.dds"));
+	TEST_CHECK(!pScene->materials[0].twoSided && pScene->materials[1].twoSided && pScene->materials[2].twoSided);
+	TEST_CHECK(!pScene->materials[2].alphaTested && pScene->materials[3].alphaTested);
+
+	TEST_CHECK(cookScene(pScene, sourceName.c_str(), cookedName.c_str()));
+	Scene* pCooked = loadCookedScene(cookedName.c_str(), sourceName.c_str());
+	TEST_CHECK(pCooked != NULL);
+	if (pCooked)
+	{
+		checkScenesEqual(pScene, pCooked);
+		removeScene(pCooked);
+	}
+	// Shipped without the source
+	TEST_CHECK(canLoadCookedScene(cookedName, NULL));
+	removeScene(pScene);
+
+	// A source with the same contents but a new time still matches, a changed one doesn't
+	rewriteSource(sourceName, source);
+	TEST_CHECK(canLoadCookedScene(cookedName, sourceName.c_str()));
+	source[source.size() / 2] ^= 1;
+	rewriteSource(sourceName, source);
+	TEST_CHECK(!canLoadCookedScene(cookedName, sourceName.c_str()));
+	source[source.size() / 2] ^= 1;
+	source.push_back(0);
+	rewriteSource(sourceName, source);
+	TEST_CHECK(!canLoadCookedScene(cookedName, sourceName.c_str()));
+	source.pop_back();
+	writeFile(sourceName, source.data(), (uint32_t)source.size());
+	TEST_CHECK(!canLoadCookedScene(cookedName, (gSceneDir + "missing.bin").c_str()));
+}
+
+// Damaged cooked files are rejected before any section is used
+static void testDamagedCookedScene()
+{
+	const String cookedName = gSceneDir + "scene.cooked";
+	const String damagedName = gSceneDir + "damaged.cooked";
+	tinystl::vector<uint8_t> cooked;
+	readFile(cookedName, cooked);
+	TEST_CHECK(cooked.size() > 64);
+
+	const uint32_t truncatedSizes[] = { 0, 8, 64, (uint32_t)cooked.size() / 2, (uint32_t)cooked.size() - 1 };
+	for (uint32_t i = 0; i < sizeof(truncatedSizes) / sizeof(truncatedSizes[0]); ++i)
+	{
+		writeFile(damagedName, cooked.data(), truncatedSizes[i]);
+		TEST_CHECK_MSG(!canLoadCookedScene(damagedName, NULL), "cooked scene truncated to %u bytes was loaded", truncatedSizes[i]);
+	}
+
+	// Magic and version lead the header
+	for (uint32_t i = 0; i < 8; i += 4)
+	{
+		cooked[i] ^= 0x10;
+		writeFile(damagedName, cooked.data(), (uint32_t)cooked.size());
+		TEST_CHECK(!canLoadCookedScene(damagedName, NULL));
+		cooked[i] ^= 0x10;
+	}
+
+	writeFile(damagedName, cooked.data(), (uint32_t)cooked.size());
+	TEST_CHECK(canLoadCookedScene(damagedName, NULL));
+	FileSystem::Delete(damagedName);
+}
+
+static void timeLoads(ThreadPool* pPool)
+{
+	const String sourceName = gSceneDir + "scene.bin";
+	const String cookedName = gSceneDir + "scene.cooked";
+	const uint32_t loadCount = 5;
+	HiresTimer timer;
+	float sourceTime = 0.0f;
+	float cookedTime = 0.0f;
+	for (uint32_t i = 0; i < loadCount; ++i)
+	{
+		timer.Reset();
+		Scene* pScene = loadScene(sourceName.c_str());
+		CreateClusters(pPool, pScene);
+		sourceTime += timer.GetUSec(true) / 1000.0f;
+
+		// Touch every vertex so the pages of the mapping are counted as well
+		Scene* pCooked = loadCookedScene(cookedName.c_str(), sourceName.c_str());
+		TEST_CHECK(pCooked != NULL);
+		if (!pCooked)
+		{
+			removeScene(pScene);
+			return;
+		}
+		float sum = 0.0f;
+		for (uint32_t v = 0; v < pCooked->totalVertices; ++v)
+			sum += pCooked->positions[v].z + (float)(pCooked->normals[v].normal & 1);
+		cookedTime += timer.GetUSec(true) / 1000.0f;
+		TEST_CHECK(sum == sum);
+
+		removeScene(pCooked);
+		removeScene(pScene);
+	}
+	printf("Loading %u vertices, %u indices: %.2f ms from the source with clusters, %.2f ms cooked\n", GRID_COUNT * (GRID_SIZE + 1) * (GRID_SIZE + 1),
+		GRID_COUNT * GRID_SIZE * GRID_SIZE * 6, sourceTime / loadCount, cookedTime / loadCount);
+}
+
+int main(int argc, char** argv)
+{
+	LogManager logManager;
+
+	gSceneDir = FileSystem::GetProgramDir() + "/CookedSceneTest/";
+	FileSystem::CreateDir(gSceneDir);
+
+	ThreadPool* pPool = conf_placement_new<ThreadPool>(conf_calloc(1, sizeof(ThreadPool)));
+	const uint32_t coreCount = Thread::GetNumCPUCores();
+	pPool->CreateThreads(coreCount > 1 ? coreCount - 1 : 1);
+
+	testRoundTrip(pPool);
+	testDamagedCookedScene();
+	timeLoads(pPool);
+
+	pPool->~ThreadPool();
+	conf_free(pPool);
+	// Texture names of loadScene are interned, the platform layer frees them on exit otherwise
+	exitNameTable();
+	return finishTest("CookedSceneTest");
+}
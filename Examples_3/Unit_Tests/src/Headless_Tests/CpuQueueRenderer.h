@@ -0,0 +1,421 @@
+/*
+ * Copyright (c) 2018 Confetti Interactive Inc.
+ *
+ * This file is part of The-Forge
+ * (see https://github.com/ConfettiFX/The-Forge).
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+*/
+
+#pragma once
+
+// Stand-in for the renderer functions the resource loader calls, for tests which link ResourceLoader.cpp without a GPU.
+// Buffers and textures live in CPU memory. A worker thread per queue executes the copies of submitted command buffers
+// in order, some time after the submit, and signals the fence afterwards. Staging memory is only read when the copy
+// executes, so staging memory reused before the fence signalled shows up as corrupted resources.
+// Shaders are not compiled, their reflection is made up from the byte code size.
+// Defines the renderer functions, include it in a single source file of the test.
+
+#include "../../../../Common_3/ThirdParty/OpenSource/TinySTL/vector.h"
+#include "../../../../Common_3/Renderer/IRenderer.h"
+#include "../../../../Common_3/Renderer/IShaderReflection.h"
+#include "../../../../Common_3/OS/Image/Image.h"
+#include "../../../../Common_3/OS/Interfaces/IThread.h"
+#include "../../../../Common_3/OS/Interfaces/IMemoryManager.h"
+
+#include "TestFramework.h"
+
+/// Milliseconds between the submit of a command buffer and the execution of its copies
+static uint32_t gCpuQueueLatency = 1;
+static tfrg_atomic32_t gCpuQueueSubmitCount = 0;
+/// Stages which were reflected because the byte code came without a serialized reflection
+static tfrg_atomic32_t gCpuReflectionCount = 0;
+/// Called by cmdUpdateSubresources before it records the copies, while the loader still holds the pixels of the upload
+static void (*gCpuUpdateSubresourcesCallback)(Texture* pTexture) = NULL;
+
+typedef struct CpuCopy
+{
+	const Buffer*	pSrcBuffer;
+	uint64_t		mSrcOffset;
+	uint8_t*		pDst;
+	uint64_t		mSize;
+} CpuCopy;
+
+/// The real objects come first so the loader can use them as usual
+typedef struct CpuCmd
+{
+	Cmd							mCmd;
+	tinystl::vector<CpuCopy>	mCopies;
+	bool						mRecording;
+	/// Submitted and not executed yet
+	bool						mPending;
+} CpuCmd;
+
+typedef struct CpuFence
+{
+	Fence		mFence;
+	struct CpuQueue* pQueue;
+	bool		mSignaled;
+} CpuFence;
+
+typedef struct CpuSubmission
+{
+	tinystl::vector<CpuCmd*>	mCmds;
+	CpuFence*					pFence;
+} CpuSubmission;
+
+typedef struct CpuQueue
+{
+	Queue							mQueue;
+	Thread*							pThread;
+	/// Guards the submissions, the pending flags of the command buffers and the signaled flags of the fences
+	Mutex							mMutex;
+	ConditionVariable				mSubmitCondition;
+	ConditionVariable				mExecuteCondition;
+	tinystl::vector<CpuSubmission>	mSubmissions;
+	bool							mQuit;
+} CpuQueue;
+
+static void executeCpuQueue(void* pData)
+{
+	CpuQueue* pQueue = (CpuQueue*)pData;
+	for (;;)
+	{
+		pQueue->mMutex.Acquire();
+		while (!pQueue->mQuit && pQueue->mSubmissions.empty())
+			pQueue->mSubmitCondition.Wait(pQueue->mMutex, TIMEOUT_INFINITE);
+		if (pQueue->mSubmissions.empty())
+		{
+			pQueue->mMutex.Release();
+			return;
+		}
+		CpuSubmission submission = pQueue->mSubmissions[0];
+		pQueue->mMutex.Release();
+
+		Thread::Sleep(gCpuQueueLatency);
+		for (uint32_t i = 0; i < (uint32_t)submission.mCmds.size(); ++i)
+		{
+			const tinystl::vector<CpuCopy>& copies = submission.mCmds[i]->mCopies;
+			for (uint32_t j = 0; j < (uint32_t)copies.size(); ++j)
+				memcpy(copies[j].pDst, (const uint8_t*)copies[j].pSrcBuffer->pCpuMappedAddress + copies[j].mSrcOffset, (size_t)copies[j].mSize);
+		}
+
+		pQueue->mMutex.Acquire();
+		pQueue->mSubmissions.erase(pQueue->mSubmissions.begin());
+		for (uint32_t i = 0; i < (uint32_t)submission.mCmds.size(); ++i)
+			submission.mCmds[i]->mPending = false;
+		if (submission.pFence)
+			submission.pFence->mSignaled = true;
+		pQueue->mExecuteCondition.SetAll();
+		pQueue->mMutex.Release();
+	}
+}
+
+void addQueue(Renderer* pRenderer, QueueDesc* pDesc, Queue** ppQueue)
+{
+	CpuQueue* pQueue = conf_placement_new<CpuQueue>(conf_calloc(1, sizeof(CpuQueue)));
+	pQueue->mQueue.pRenderer = pRenderer;
+	pQueue->mQueue.mQueueDesc = *pDesc;
+	pQueue->pThread = conf_placement_new<Thread>(conf_calloc(1, sizeof(Thread)), executeCpuQueue, pQueue);
+	*ppQueue = &pQueue->mQueue;
+}
+
+void removeQueue(Queue* pQueue)
+{
+	CpuQueue* pCpuQueue = (CpuQueue*)pQueue;
+	pCpuQueue->mMutex.Acquire();
+	pCpuQueue->mQuit = true;
+	pCpuQueue->mSubmitCondition.SetAll();
+	pCpuQueue->mMutex.Release();
+
+	// Joins the worker, which finishes the submissions still pending first
+	pCpuQueue->pThread->~Thread();
+	conf_free(pCpuQueue->pThread);
+	pCpuQueue->~CpuQueue();
+	conf_free(pCpuQueue);
+}
+
+void addCmdPool(Renderer* pRenderer, Queue* pQueue, bool, CmdPool** ppCmdPool, CmdPoolDesc*)
+{
+	CmdPool* pCmdPool = (CmdPool*)conf_calloc(1, sizeof(CmdPool));
+	pCmdPool->pRenderer = pRenderer;
+	pCmdPool->pQueue = pQueue;
+	*ppCmdPool = pCmdPool;
+}
+void removeCmdPool(Renderer*, CmdPool* pCmdPool) { conf_free(pCmdPool); }
+
+void addCmd(CmdPool* pCmdPool, bool, Cmd** ppCmd)
+{
+	CpuCmd* pCmd = conf_placement_new<CpuCmd>(conf_calloc(1, sizeof(CpuCmd)));
+	pCmd->mCmd.pCmdPool = pCmdPool;
+	*ppCmd = &pCmd->mCmd;
+}
+
+void removeCmd(CmdPool*, Cmd* pCmd)
+{
+	CpuCmd* pCpuCmd = (CpuCmd*)pCmd;
+	TEST_CHECK(!pCpuCmd->mPending);
+	pCpuCmd->~CpuCmd();
+	conf_free(pCpuCmd);
+}
+
+void beginCmd(Cmd* pCmd)
+{
+	CpuCmd* pCpuCmd = (CpuCmd*)pCmd;
+	CpuQueue* pQueue = (CpuQueue*)pCmd->pCmdPool->pQueue;
+
+	// Resetting a command buffer the queue did not execute yet is a bug of the caller
+	MutexLock lock(pQueue->mMutex);
+	TEST_CHECK(!pCpuCmd->mPending && !pCpuCmd->mRecording);
+	pCpuCmd->mCopies.clear();
+	pCpuCmd->mRecording = true;
+}
+
+void endCmd(Cmd* pCmd)
+{
+	CpuCmd* pCpuCmd = (CpuCmd*)pCmd;
+	TEST_CHECK(pCpuCmd->mRecording);
+	pCpuCmd->mRecording = false;
+}
+
+void cmdResourceBarrier(Cmd* pCmd, uint32_t, BufferBarrier*, uint32_t, TextureBarrier*, bool)
+{
+	TEST_CHECK(((CpuCmd*)pCmd)->mRecording);
+}
+
+void addFence(Renderer* pRenderer, Fence** ppFence, uint64)
+{
+	CpuFence* pFence = (CpuFence*)conf_calloc(1, sizeof(CpuFence));
+	pFence->mFence.pRenderer = pRenderer;
+	*ppFence = &pFence->mFence;
+}
+
+void removeFence(Renderer*, Fence* pFence)
+{
+	TEST_CHECK(!pFence->mSubmitted);
+	conf_free(pFence);
+}
+
+void queueSubmit(Queue* pQueue, uint32_t cmdCount, Cmd** ppCmds, Fence* pFence, uint32_t, Semaphore**, uint32_t, Semaphore**)
+{
+	CpuQueue* pCpuQueue = (CpuQueue*)pQueue;
+	CpuSubmission submission;
+	submission.pFence = (CpuFence*)pFence;
+
+	MutexLock lock(pCpuQueue->mMutex);
+	for (uint32_t i = 0; i < cmdCount; ++i)
+	{
+		CpuCmd* pCmd = (CpuCmd*)ppCmds[i];
+		TEST_CHECK(!pCmd->mRecording && !pCmd->mPending);
+		pCmd->mPending = true;
+		submission.mCmds.push_back(pCmd);
+	}
+	if (pFence)
+	{
+		// Like vkQueueSubmit, a fence may only be submitted again after it was waited on or polled as complete
+		TEST_CHECK(!pFence->mSubmitted);
+		pFence->mSubmitted = true;
+		submission.pFence->pQueue = pCpuQueue;
+		submission.pFence->mSignaled = false;
+	}
+	pCpuQueue->mSubmissions.push_back(submission);
+	pCpuQueue->mSubmitCondition.Set();
+	tfrg_atomic32_add(&gCpuQueueSubmitCount, 1);
+}
+
+void getFenceStatus(Fence* pFence, FenceStatus* pFenceStatus)
+{
+	*pFenceStatus = FENCE_STATUS_COMPLETE;
+	if (!pFence->mSubmitted)
+		return;
+
+	CpuFence* pCpuFence = (CpuFence*)pFence;
+	MutexLock lock(pCpuFence->pQueue->mMutex);
+	if (pCpuFence->mSignaled)
+		pFence->mSubmitted = false;
+	else
+		*pFenceStatus = FENCE_STATUS_INCOMPLETE;
+}
+
+void waitForFences(Queue*, uint32_t fenceCount, Fence** ppFences)
+{
+	for (uint32_t i = 0; i < fenceCount; ++i)
+	{
+		CpuFence* pFence = (CpuFence*)ppFences[i];
+		if (!pFence->mFence.mSubmitted)
+			continue;
+
+		MutexLock lock(pFence->pQueue->mMutex);
+		while (!pFence->mSignaled)
+			pFence->pQueue->mExecuteCondition.Wait(pFence->pQueue->mMutex, TIMEOUT_INFINITE);
+		pFence->mFence.mSubmitted = false;
+	}
+}
+
+void addBuffer(Renderer* pRenderer, const BufferDesc* pDesc, Buffer** ppBuffer)
+{
+	Buffer* pBuffer = (Buffer*)conf_calloc(1, sizeof(Buffer));
+	pBuffer->pRenderer = pRenderer;
+	pBuffer->mDesc = *pDesc;
+	pBuffer->pCpuMappedAddress = conf_calloc(1, (size_t)pDesc->mSize);
+	*ppBuffer = pBuffer;
+}
+
+void removeBuffer(Renderer*, Buffer* pBuffer)
+{
+	conf_free(pBuffer->pCpuMappedAddress);
+	conf_free(pBuffer);
+}
+
+// Buffers stay mapped
+void mapBuffer(Renderer*, Buffer*, ReadRange*) {}
+void unmapBuffer(Renderer*, Buffer*) {}
+
+/// Mip levels are stored one after the other, each with all of its array layers. Only uncompressed formats.
+static uint64_t getCpuTextureMipOffset(const TextureDesc* pDesc, uint32_t mipLevel)
+{
+	uint64_t pixelCount = 0;
+	for (uint32_t i = 0; i < mipLevel; ++i)
+		pixelCount += (uint64_t)max(pDesc->mWidth >> i, 1U) * max(pDesc->mHeight >> i, 1U) * max(pDesc->mDepth >> i, 1U);
+	return pixelCount * pDesc->mArraySize * ImageFormat::GetBytesPerPixel(pDesc->mFormat);
+}
+
+void addTexture(Renderer* pRenderer, const TextureDesc* pDesc, Texture** ppTexture)
+{
+	TEST_CHECK(!ImageFormat::IsCompressedFormat(pDesc->mFormat));
+	Texture* pTexture = (Texture*)conf_calloc(1, sizeof(Texture));
+	pTexture->pRenderer = pRenderer;
+	pTexture->mDesc = *pDesc;
+	pTexture->mTextureSize = getCpuTextureMipOffset(pDesc, pDesc->mMipLevels);
+	pTexture->pCpuMappedAddress = conf_calloc(1, (size_t)pTexture->mTextureSize);
+	*ppTexture = pTexture;
+}
+
+void removeTexture(Renderer*, Texture* pTexture)
+{
+	conf_free(pTexture->pCpuMappedAddress);
+	conf_free(pTexture);
+}
+
+static void recordCpuCopy(Cmd* pCmd, const Buffer* pSrcBuffer, uint64_t srcOffset, uint8_t* pDst, uint64_t size)
+{
+	CpuCmd* pCpuCmd = (CpuCmd*)pCmd;
+	TEST_CHECK(pCpuCmd->mRecording);
+	TEST_CHECK_MSG(srcOffset + size <= pSrcBuffer->mDesc.mSize, "copy of %llu bytes at %llu from a buffer of %llu bytes", (unsigned long long)size,
+		(unsigned long long)srcOffset, (unsigned long long)pSrcBuffer->mDesc.mSize);
+	CpuCopy copy = { pSrcBuffer, srcOffset, pDst, size };
+	pCpuCmd->mCopies.push_back(copy);
+}
+
+void cmdUpdateBuffer(Cmd* pCmd, uint64_t srcOffset, uint64_t dstOffset, uint64_t size, Buffer* pSrcBuffer, Buffer* pBuffer)
+{
+	TEST_CHECK(dstOffset + size <= pBuffer->mDesc.mSize);
+	recordCpuCopy(pCmd, pSrcBuffer, srcOffset, (uint8_t*)pBuffer->pCpuMappedAddress + dstOffset, size);
+}
+
+void cmdUpdateSubresources(Cmd* pCmd, uint32_t, uint32_t subresourceCount, SubresourceDataDesc* pSubresources, Buffer* pIntermediate, uint64_t,
+	Texture* pTexture)
+{
+	if (gCpuUpdateSubresourcesCallback)
+		gCpuUpdateSubresourcesCallback(pTexture);
+
+	const TextureDesc* pDesc = &pTexture->mDesc;
+	for (uint32_t i = 0; i < subresourceCount; ++i)
+	{
+		const SubresourceDataDesc* pSubresource = &pSubresources[i];
+		TEST_CHECK(pSubresource->mMipLevel < pDesc->mMipLevels && pSubresource->mArrayLayer == 0);
+		TEST_CHECK(pSubresource->mWidth == max(pDesc->mWidth >> pSubresource->mMipLevel, 1U));
+
+		const uint64_t offset = getCpuTextureMipOffset(pDesc, pSubresource->mMipLevel);
+		const uint64_t size = getCpuTextureMipOffset(pDesc, pSubresource->mMipLevel + 1) - offset;
+		recordCpuCopy(pCmd, pIntermediate, pSubresource->mBufferOffset, (uint8_t*)pTexture->pCpuMappedAddress + offset, size);
+	}
+}
+
+// One texture resource in register byte code size, so stages with different byte code have different reflections
+void createShaderReflection(const uint8_t* shaderCode, uint32_t shaderSize, ShaderStage shaderStage, ShaderReflection* pOutReflection)
+{
+	static const char namePool[] = "main\0gTexture";
+	memset(pOutReflection, 0, sizeof(*pOutReflection));
+	pOutReflection->mShaderStage = shaderStage;
+	pOutReflection->mNamePoolSize = sizeof(namePool);
+	pOutReflection->pNamePool = (char*)conf_malloc(sizeof(namePool));
+	memcpy(pOutReflection->pNamePool, namePool, sizeof(namePool));
+	pOutReflection->pEntryPoint = pOutReflection->pNamePool;
+
+	pOutReflection->mShaderResourceCount = 1;
+	pOutReflection->pShaderResources = (ShaderResource*)conf_calloc(1, sizeof(ShaderResource));
+	pOutReflection->pShaderResources[0].type = DESCRIPTOR_TYPE_TEXTURE;
+	pOutReflection->pShaderResources[0].reg = shaderSize;
+	pOutReflection->pShaderResources[0].size = 1;
+	pOutReflection->pShaderResources[0].used_stages = shaderStage;
+	pOutReflection->pShaderResources[0].name = pOutReflection->pNamePool + 5;
+	pOutReflection->pShaderResources[0].name_size = 8;
+
+	tfrg_atomic32_add(&gCpuReflectionCount, 1);
+}
+
+static const ShaderStage gCpuShaderStages[] = { SHADER_STAGE_VERT, SHADER_STAGE_HULL, SHADER_STAGE_DOMN, SHADER_STAGE_GEOM, SHADER_STAGE_FRAG, SHADER_STAGE_COMP };
+#define CPU_SHADER_STAGE_COUNT (sizeof(gCpuShaderStages) / sizeof(gCpuShaderStages[0]))
+
+/// Keeps the byte code of the stages so tests can check which permutation a shader got
+typedef struct CpuShader
+{
+	Shader				mShader;
+	tinystl::string		mByteCode[CPU_SHADER_STAGE_COUNT];
+} CpuShader;
+
+void addShader(Renderer* pRenderer, const BinaryShaderDesc* pDesc, Shader** ppShader)
+{
+	CpuShader* pShader = conf_placement_new<CpuShader>(conf_calloc(1, sizeof(CpuShader)));
+	pShader->mShader.pRenderer = pRenderer;
+	pShader->mShader.mStages = pDesc->mStages;
+
+	const BinaryShaderStageDesc* pStages[] = { &pDesc->mVert, &pDesc->mHull, &pDesc->mDomain, &pDesc->mGeom, &pDesc->mFrag, &pDesc->mComp };
+	ShaderReflection reflections[MAX_SHADER_STAGE_COUNT] = {};
+	uint32_t reflectionCount = 0;
+	for (uint32_t i = 0; i < CPU_SHADER_STAGE_COUNT; ++i)
+	{
+		if (!(pDesc->mStages & gCpuShaderStages[i]))
+			continue;
+
+		const BinaryShaderStageDesc* pStage = pStages[i];
+		pShader->mByteCode[i] = tinystl::string(pStage->pByteCode, pStage->mByteCodeSize);
+		loadShaderReflection((const uint8_t*)pStage->pByteCode, pStage->mByteCodeSize, pStage->pReflection, pStage->mReflectionSize,
+			gCpuShaderStages[i], &reflections[reflectionCount++]);
+	}
+
+	createPipelineReflection(reflections, reflectionCount, &pShader->mShader.mReflection);
+	*ppShader = &pShader->mShader;
+}
+
+void removeShader(Renderer*, Shader* pShader)
+{
+	CpuShader* pCpuShader = (CpuShader*)pShader;
+	destroyPipelineReflection(&pShader->mReflection);
+	pCpuShader->~CpuShader();
+	conf_free(pCpuShader);
+}
+
+static const tinystl::string& getCpuShaderByteCode(const Shader* pShader, ShaderStage stage)
+{
+	uint32_t index = 0;
+	while (index + 1 < CPU_SHADER_STAGE_COUNT && gCpuShaderStages[index] != stage)
+		++index;
+	return ((const CpuShader*)pShader)->mByteCode[index];
+}
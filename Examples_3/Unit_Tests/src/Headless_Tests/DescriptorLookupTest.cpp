@@ -0,0 +1,162 @@
+/*
+ * Copyright (c) 2018 Confetti Interactive Inc.
+ *
+ * This file is part of The-Forge
+ * (see https://github.com/ConfettiFX/The-Forge).
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+*/
+
+// Descriptor lookup of cmdBindDescriptors on a root signature filled the way addRootSignature does. Checks that
+// findDescriptorIndex resolves DescriptorData by index, precomputed name hash and name alike, and compares the cost of
+// binding a draw with each.
+
+#include "../../../../Common_3/Renderer/IRenderer.h"
+#include "../../../../Common_3/OS/Interfaces/ITimeManager.h"
+#include "../../../../Common_3/OS/Interfaces/ILogManager.h"
+#include "../../../../Common_3/OS/Interfaces/IMemoryManager.h"
+
+#include "TestFramework.h"
+
+static const char* gDescriptorNames[] =
+{
+	"uniformBlock", "rootConstant", "uSampler0", "RightText", "LeftText", "TopText", "BotText", "FrontText", "BackText",
+	"vertexDataBuffer", "indexDataBuffer", "meshConstantsBuffer", "materialProps", "diffuseMaps", "normalMaps", "specularMaps",
+};
+
+static const uint32_t gDescriptorCount = sizeof(gDescriptorNames) / sizeof(gDescriptorNames[0]);
+
+static RootSignature* addTestRootSignature()
+{
+	RootSignature* pRootSignature = (RootSignature*)conf_calloc(1, sizeof(RootSignature));
+	conf_placement_new<tinystl::flat_hash_map<uint32_t, uint32_t> >(&pRootSignature->pDescriptorNameToIndexMap);
+	pRootSignature->mDescriptorCount = gDescriptorCount;
+	for (uint32_t i = 0; i < gDescriptorCount; ++i)
+		pRootSignature->pDescriptorNameToIndexMap.insert({ getNameId(gDescriptorNames[i]), i });
+	return pRootSignature;
+}
+
+static void removeTestRootSignature(RootSignature* pRootSignature)
+{
+	pRootSignature->pDescriptorNameToIndexMap.~flat_hash_map();
+	conf_free(pRootSignature);
+}
+
+static void testLookup(const RootSignature* pRootSignature)
+{
+	TEST_CHECK(pRootSignature->pDescriptorNameToIndexMap.size() == gDescriptorCount);
+
+	DescriptorData param;
+	TEST_CHECK(param.mIndex == (uint32_t)-1 && param.mNameHash == 0);
+	for (uint32_t i = 0; i < gDescriptorCount; ++i)
+	{
+		// The name is looked up by contents, not by pointer
+		char name[64];
+		strcpy(name, gDescriptorNames[i]);
+
+		DescriptorData byName;
+		byName.pName = name;
+		TEST_CHECK_MSG(findDescriptorIndex(pRootSignature, &byName) == i, "%s not found by name", name);
+
+		DescriptorData byHash;
+		byHash.mNameHash = getDescriptorNameHash(name);
+		TEST_CHECK_MSG(findDescriptorIndex(pRootSignature, &byHash) == i, "%s not found by hash", name);
+
+		// The index and the hash win over the name
+		DescriptorData byIndex;
+		byIndex.pName = gDescriptorNames[(i + 1) % gDescriptorCount];
+		byIndex.mIndex = i;
+		TEST_CHECK(findDescriptorIndex(pRootSignature, &byIndex) == i);
+		byHash.pName = byIndex.pName;
+		TEST_CHECK(findDescriptorIndex(pRootSignature, &byHash) == i);
+	}
+
+	// Unknown names and hashes and indices outside the root signature find nothing, whatever else is set
+	DescriptorData unknown;
+	unknown.pName = "uniformBlock2";
+	TEST_CHECK(findDescriptorIndex(pRootSignature, &unknown) == (uint32_t)-1);
+	unknown.pName = "";
+	TEST_CHECK(findDescriptorIndex(pRootSignature, &unknown) == (uint32_t)-1);
+	unknown.mNameHash = getDescriptorNameHash("diffuseMap");
+	unknown.pName = "diffuseMaps";
+	TEST_CHECK(findDescriptorIndex(pRootSignature, &unknown) == (uint32_t)-1);
+	unknown.mNameHash = 0;
+	unknown.mIndex = gDescriptorCount;
+	TEST_CHECK(findDescriptorIndex(pRootSignature, &unknown) == (uint32_t)-1);
+	unknown.mIndex = (uint32_t)-2;
+	TEST_CHECK(findDescriptorIndex(pRootSignature, &unknown) == (uint32_t)-1);
+}
+
+typedef enum LookupMode
+{
+	LOOKUP_NAME,
+	LOOKUP_HASH,
+	LOOKUP_INDEX,
+} LookupMode;
+
+// Draws binding a root constant and a few resources each, as in the per asteroid path of 04_ExecuteIndirect
+static uint32_t bindDraws(const RootSignature* pRootSignature, LookupMode mode, uint32_t drawCount)
+{
+	const uint32_t paramCount = 4;
+	const uint32_t paramNames[paramCount] = { 1, 0, 9, 13 };
+	DescriptorData params[paramCount];
+	for (uint32_t i = 0; i < paramCount; ++i)
+	{
+		const char* pName = gDescriptorNames[paramNames[i]];
+		if (mode == LOOKUP_NAME)
+			params[i].pName = pName;
+		else if (mode == LOOKUP_HASH)
+			params[i].mNameHash = getDescriptorNameHash(pName);
+		else
+			params[i].mIndex = paramNames[i];
+	}
+
+	uint32_t sum = 0;
+	for (uint32_t draw = 0; draw < drawCount; ++draw)
+	{
+		for (uint32_t i = 0; i < paramCount; ++i)
+			sum += findDescriptorIndex(pRootSignature, &params[i]);
+	}
+	return sum;
+}
+
+static void timeLookups(const RootSignature* pRootSignature)
+{
+	const uint32_t drawCount = 2000000;
+	const char* modeNames[] = { "name", "hash", "index" };
+	for (uint32_t mode = LOOKUP_NAME; mode <= LOOKUP_INDEX; ++mode)
+	{
+		HiresTimer timer;
+		const uint32_t sum = bindDraws(pRootSignature, (LookupMode)mode, drawCount);
+		const float drawTime = timer.GetUSec(false) * 1000.0f / drawCount;
+		TEST_CHECK(sum == drawCount * (1 + 0 + 9 + 13));
+		printf("%u draws binding 4 descriptors by %s: %.2f ns per draw\n", drawCount, modeNames[mode], drawTime);
+	}
+}
+
+int main(int argc, char** argv)
+{
+	LogManager logManager;
+
+	RootSignature* pRootSignature = addTestRootSignature();
+	testLookup(pRootSignature);
+	timeLookups(pRootSignature);
+	removeTestRootSignature(pRootSignature);
+
+	return finishTest("DescriptorLookupTest");
+}
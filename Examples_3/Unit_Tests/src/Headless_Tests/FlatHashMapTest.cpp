@@ -0,0 +1,265 @@
+/*
+ * Copyright (c) 2018 Confetti Interactive Inc.
+ *
+ * This file is part of The-Forge
+ * (see https://github.com/ConfettiFX/The-Forge).
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+*/
+
+// Randomized operations on tinystl::flat_hash_map checked against a dense reference table,
+// followed by a short timing comparison with tinystl::unordered_map.
+
+#include "../../../../Common_3/ThirdParty/OpenSource/TinySTL/flat_hash_map.h"
+#include "../../../../Common_3/ThirdParty/OpenSource/TinySTL/unordered_map.h"
+#include "../../../../Common_3/ThirdParty/OpenSource/TinySTL/string.h"
+#include "../../../../Common_3/OS/Interfaces/ITimeManager.h"
+#include "../../../../Common_3/OS/Interfaces/IMemoryManager.h"
+
+#include "TestFramework.h"
+
+static uint64_t gRandomState = 88172645463325252ULL;
+
+static uint64_t nextRandom()
+{
+	gRandomState ^= gRandomState << 13;
+	gRandomState ^= gRandomState >> 7;
+	gRandomState ^= gRandomState << 17;
+	return gRandomState;
+}
+
+/// Value which counts its live instances to catch missing destructor calls
+struct CountedValue
+{
+	CountedValue() : mValue(0) { ++sLiveCount; }
+	CountedValue(const CountedValue& other) : mValue(other.mValue) { ++sLiveCount; }
+	~CountedValue() { --sLiveCount; }
+	CountedValue& operator=(const CountedValue& other) { mValue = other.mValue; return *this; }
+
+	int mValue;
+	static int sLiveCount;
+};
+
+int CountedValue::sLiveCount = 0;
+
+// Key ranges from 4 to 8192 keys go from almost no collisions to many tombstones and rehashes
+static void testAgainstReference()
+{
+	const uint32_t maxRange = 1 << 13;
+	bool* pPresent = (bool*)conf_calloc(maxRange, sizeof(bool));
+	uint32_t* pValues = (uint32_t*)conf_calloc(maxRange, sizeof(uint32_t));
+
+	for (uint32_t round = 0; round < 24 && !gTestFailures; ++round)
+	{
+		const uint32_t range = 1u << (round % 12 + 2);
+		memset(pPresent, 0, maxRange * sizeof(bool));
+		size_t referenceSize = 0;
+
+		tinystl::flat_hash_map<uint32_t, uint32_t> map;
+		for (uint32_t i = 0; i < 100000 && !gTestFailures; ++i)
+		{
+			const uint32_t key = (uint32_t)(nextRandom() % range);
+			const uint32_t op = (uint32_t)(nextRandom() % 5);
+			if (op < 2)
+			{
+				tinystl::pair<tinystl::flat_hash_map<uint32_t, uint32_t>::iterator, bool> result = map.insert(tinystl::make_pair(key, i));
+				TEST_CHECK(result.second == !pPresent[key]);
+				if (!pPresent[key])
+				{
+					pPresent[key] = true;
+					pValues[key] = i;
+					++referenceSize;
+				}
+				TEST_CHECK(result.first->first == key && result.first->second == pValues[key]);
+			}
+			else if (op == 2)
+			{
+				TEST_CHECK(map.erase(key) == (pPresent[key] ? 1u : 0u));
+				referenceSize -= pPresent[key] ? 1 : 0;
+				pPresent[key] = false;
+			}
+			else if (op == 3)
+			{
+				// Erase through an iterator
+				tinystl::flat_hash_map<uint32_t, uint32_t>::iterator it = map.find(key);
+				TEST_CHECK((it != map.end()) == pPresent[key]);
+				if (it != map.end())
+				{
+					map.erase(it);
+					pPresent[key] = false;
+					--referenceSize;
+				}
+			}
+			else
+			{
+				map[key] = i;
+				referenceSize += pPresent[key] ? 0 : 1;
+				pPresent[key] = true;
+				pValues[key] = i;
+			}
+			TEST_CHECK(map.size() == referenceSize);
+		}
+
+		// Iteration visits every element exactly once
+		size_t visited = 0;
+		for (tinystl::flat_hash_map<uint32_t, uint32_t>::iterator it = map.begin(); it != map.end(); ++it, ++visited)
+			TEST_CHECK(it->first < range && pPresent[it->first] && pValues[it->first] == it->second);
+		TEST_CHECK(visited == referenceSize);
+
+		// Rehash, copy and clear keep the contents consistent
+		map.rehash(0);
+		tinystl::flat_hash_map<uint32_t, uint32_t> copy(map);
+		for (uint32_t key = 0; key < range; ++key)
+		{
+			tinystl::flat_hash_map<uint32_t, uint32_t>::const_iterator it = map.find(key);
+			TEST_CHECK((it != map.end()) == pPresent[key]);
+			TEST_CHECK(it == map.end() || it->second == pValues[key]);
+			TEST_CHECK((copy.find(key) != copy.end()) == pPresent[key]);
+		}
+		TEST_CHECK(copy.size() == map.size());
+		copy.clear();
+		TEST_CHECK(copy.empty() && copy.begin() == copy.end());
+	}
+
+	conf_free(pValues);
+	conf_free(pPresent);
+}
+
+static void testKeyAndValueTypes()
+{
+	// Maps live in calloc'ed renderer structures, a zeroed map has to work without construction
+	{
+		typedef tinystl::flat_hash_map<uint64_t, int> Map;
+		Map* pMap = (Map*)conf_calloc(1, sizeof(Map));
+		TEST_CHECK(pMap->find(5) == pMap->end() && pMap->begin() == pMap->end() && pMap->empty());
+		(*pMap)[5] = 3;
+		TEST_CHECK(pMap->find(5) != pMap->end() && pMap->find(5)->second == 3);
+		pMap->~Map();
+		conf_free(pMap);
+	}
+
+	// String keys and values with destructors
+	{
+		tinystl::flat_hash_map<tinystl::string, CountedValue> map;
+		char name[32];
+		for (int i = 0; i < 1000; ++i)
+		{
+			sprintf(name, "gDescriptorName%d", i);
+			map[tinystl::string(name)].mValue = i;
+		}
+		for (int i = 0; i < 1000; ++i)
+		{
+			sprintf(name, "gDescriptorName%d", i);
+			TEST_CHECK(map.find(tinystl::string(name)) != map.end() && map.find(tinystl::string(name))->second.mValue == i);
+		}
+		for (int i = 0; i < 1000; i += 2)
+		{
+			sprintf(name, "gDescriptorName%d", i);
+			TEST_CHECK(map.erase(tinystl::string(name)) == 1);
+		}
+		TEST_CHECK(map.size() == 500);
+		TEST_CHECK(CountedValue::sLiveCount == 500);
+	}
+	TEST_CHECK(CountedValue::sLiveCount == 0);
+
+	// Pointer keys
+	{
+		tinystl::flat_hash_map<const void*, int> map;
+		int values[100];
+		for (int i = 0; i < 100; ++i)
+			map[&values[i]] = i;
+		for (int i = 0; i < 100; ++i)
+			TEST_CHECK(map[&values[i]] == i);
+		TEST_CHECK(map.size() == 100);
+	}
+
+	// Reserve avoids rehashing while the reserved count is not exceeded
+	{
+		tinystl::flat_hash_map<uint32_t, uint32_t> map;
+		map.reserve(1000);
+		const size_t capacity = map.capacity();
+		for (uint32_t i = 0; i < 1000; ++i)
+			map[i] = i;
+		TEST_CHECK(map.capacity() == capacity);
+	}
+}
+
+template <typename Map>
+static void timeMap(const uint64_t* pKeys, const uint64_t* pMissingKeys, uint32_t count, double* pNsPerOp)
+{
+	HiresTimer timer;
+	uint64_t sum = 0;
+	Map map;
+	for (uint32_t i = 0; i < count; ++i)
+		map.insert(tinystl::make_pair(pKeys[i], i));
+	pNsPerOp[0] = timer.GetUSec(true) * 1000.0 / count;
+
+	for (uint32_t r = 0; r < 8; ++r)
+		for (uint32_t i = 0; i < count; ++i)
+			sum += map.find(pKeys[(i * 7919) % count])->second;
+	pNsPerOp[1] = timer.GetUSec(true) * 1000.0 / (8.0 * count);
+
+	for (uint32_t r = 0; r < 8; ++r)
+		for (uint32_t i = 0; i < count; ++i)
+			sum += map.find(pMissingKeys[i]) == map.end() ? 1 : 0;
+	pNsPerOp[2] = timer.GetUSec(true) * 1000.0 / (8.0 * count);
+
+	// Keeps the lookups from being optimized away
+	TEST_CHECK(sum != 0);
+}
+
+static void timeAgainstUnorderedMap()
+{
+	const uint32_t counts[] = { 32, 1000, 100000 };
+	for (uint32_t c = 0; c < sizeof(counts) / sizeof(counts[0]); ++c)
+	{
+		const uint32_t count = counts[c];
+		uint64_t* pKeys = (uint64_t*)conf_malloc(count * sizeof(uint64_t));
+		uint64_t* pMissingKeys = (uint64_t*)conf_malloc(count * sizeof(uint64_t));
+		for (uint32_t i = 0; i < count; ++i)
+		{
+			pKeys[i] = nextRandom();
+			pMissingKeys[i] = nextRandom();
+		}
+
+		// Best of a few runs, the machine running the tests is not idle
+		double best[2][3] = { { 1e30, 1e30, 1e30 }, { 1e30, 1e30, 1e30 } };
+		for (uint32_t run = 0; run < 5; ++run)
+		{
+			double nsPerOp[2][3];
+			timeMap<tinystl::unordered_map<uint64_t, uint32_t> >(pKeys, pMissingKeys, count, nsPerOp[0]);
+			timeMap<tinystl::flat_hash_map<uint64_t, uint32_t> >(pKeys, pMissingKeys, count, nsPerOp[1]);
+			for (uint32_t m = 0; m < 2; ++m)
+				for (uint32_t op = 0; op < 3; ++op)
+					best[m][op] = nsPerOp[m][op] < best[m][op] ? nsPerOp[m][op] : best[m][op];
+		}
+		printf("%6u keys: insert %6.1f / %6.1f ns, hit %5.1f / %5.1f ns, miss %5.1f / %5.1f ns (unordered_map / flat_hash_map)\n", count,
+			best[0][0], best[1][0], best[0][1], best[1][1], best[0][2], best[1][2]);
+
+		conf_free(pMissingKeys);
+		conf_free(pKeys);
+	}
+}
+
+int main(int argc, char** argv)
+{
+	testAgainstReference();
+	testKeyAndValueTypes();
+	timeAgainstUnorderedMap();
+	return finishTest("FlatHashMapTest");
+}
@@ -0,0 +1,327 @@
+/*
+ * Copyright (c) 2018 Confetti Interactive Inc.
+ *
+ * This file is part of The-Forge
+ * (see https://github.com/ConfettiFX/The-Forge).
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+*/
+
+// confetti::frameAllocate and the per thread frame arenas. Checks alignment, that memory stays valid for
+// FRAME_ARENA_FRAME_COUNT frames and is reused after, the tinystl adapter, threads allocating side by side and the frame
+// statistics, and compares a frame of transient allocations with the same frame on conf_calloc / conf_free.
+
+#include "../../../../Common_3/ThirdParty/OpenSource/TinySTL/vector.h"
+#include "../../../../Common_3/ThirdParty/OpenSource/TinySTL/string.h"
+#include "../../../../Common_3/OS/Interfaces/IThread.h"
+#include "../../../../Common_3/OS/Interfaces/ITimeManager.h"
+#include "../../../../Common_3/OS/Interfaces/ILogManager.h"
+#include "../../../../Common_3/OS/Interfaces/IMemoryManager.h"
+
+#include "TestFramework.h"
+
+static bool isFilled(const uint8_t* pData, size_t size, uint8_t value)
+{
+	for (size_t i = 0; i < size; ++i)
+	{
+		if (pData[i] != value)
+			return false;
+	}
+	return true;
+}
+
+// Odd sizes between aligned ones, inside a chunk and past the chunk size
+static void testAlignment()
+{
+	const size_t sizes[] = { 1, 13, 100, 4000, 70000, 300000 };
+	for (uint32_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s)
+	{
+		for (size_t alignment = 1; alignment <= 4096; alignment <<= 1)
+		{
+			uint8_t* pData = (uint8_t*)confetti::frameAllocate(sizes[s], alignment);
+			const size_t minAlignment = alignment < confetti::DEFAULT_ALIGNMENT ? confetti::DEFAULT_ALIGNMENT : alignment;
+			TEST_CHECK(pData != NULL);
+			TEST_CHECK_MSG(((uintptr_t)pData % minAlignment) == 0, "%u bytes misaligned for %u", (uint32_t)sizes[s], (uint32_t)alignment);
+			memset(pData, 0xcd, sizes[s]);
+		}
+	}
+	confetti::frameArenaNextFrame();
+}
+
+// Every frame fills a few blocks, which must hold until FRAME_ARENA_FRAME_COUNT frames later
+static void testLifetime()
+{
+	const uint32_t frameCount = 20;
+	const uint32_t blockCount = 8;
+	const size_t blockSize = 20000;
+	uint8_t* pBlocks[confetti::FRAME_ARENA_FRAME_COUNT][blockCount] = {};
+	for (uint32_t frame = 0; frame < frameCount; ++frame)
+	{
+		uint8_t** ppFrameBlocks = pBlocks[frame % confetti::FRAME_ARENA_FRAME_COUNT];
+		for (uint32_t i = 0; i < blockCount; ++i)
+		{
+			ppFrameBlocks[i] = (uint8_t*)confetti::frameAllocate(blockSize);
+			memset(ppFrameBlocks[i], (uint8_t)(frame * blockCount + i), blockSize);
+		}
+
+		for (uint32_t age = 0; age < confetti::FRAME_ARENA_FRAME_COUNT && age <= frame; ++age)
+		{
+			const uint32_t written = frame - age;
+			for (uint32_t i = 0; i < blockCount; ++i)
+			{
+				TEST_CHECK_MSG(isFilled(pBlocks[written % confetti::FRAME_ARENA_FRAME_COUNT][i], blockSize, (uint8_t)(written * blockCount + i)),
+					"block %u of frame %u overwritten in frame %u", i, written, frame);
+			}
+		}
+		confetti::frameArenaNextFrame();
+	}
+
+	// Frames of the same size reuse the memory of the frame before last instead of taking more
+	confetti::FrameArenaStats stats;
+	confetti::getFrameArenaStats(&stats);
+	const uint64_t reservedBytes = stats.mReservedBytes;
+	for (uint32_t frame = 0; frame < frameCount; ++frame)
+	{
+		for (uint32_t i = 0; i < blockCount; ++i)
+			memset(confetti::frameAllocate(blockSize), 0xee, blockSize);
+		confetti::frameArenaNextFrame();
+	}
+	confetti::getFrameArenaStats(&stats);
+	TEST_CHECK_MSG(stats.mReservedBytes == reservedBytes, "reserved bytes grew from %llu to %llu",
+		(unsigned long long)reservedBytes, (unsigned long long)stats.mReservedBytes);
+}
+
+// Memory reused dirty comes back zeroed from frameCallocate
+static void testCallocate()
+{
+	for (uint32_t frame = 0; frame < confetti::FRAME_ARENA_FRAME_COUNT * 2; ++frame)
+	{
+		uint8_t* pData = (uint8_t*)confetti::frameCallocate(25000, 4);
+		TEST_CHECK_MSG(isFilled(pData, 100000, 0), "frameCallocate not zeroed in frame %u", frame);
+		memset(pData, 0xab, 100000);
+		confetti::frameArenaNextFrame();
+	}
+
+	// count * size overflowing
+	TEST_CHECK(confetti::frameCallocate((size_t)1 << (sizeof(size_t) * 4), (size_t)1 << (sizeof(size_t) * 4)) == NULL);
+}
+
+static void testContainers()
+{
+	tinystl::vector<uint32_t, confetti::FrameArenaAllocator> values;
+	for (uint32_t i = 0; i < 50000; ++i)
+		values.push_back(i * 3);
+	uint32_t wrongCount = 0;
+	for (uint32_t i = 0; i < 50000; ++i)
+		wrongCount += values[i] != i * 3;
+	TEST_CHECK(values.size() == 50000 && wrongCount == 0);
+
+	tinystl::basic_string<confetti::FrameArenaAllocator> text("transient");
+	const char* pSuffix = " text past the small string buffer of tinystl";
+	text.append(pSuffix, pSuffix + strlen(pSuffix));
+	TEST_CHECK(text == "transient text past the small string buffer of tinystl");
+	confetti::frameArenaNextFrame();
+}
+
+#define ARENA_THREAD_COUNT 6
+#define ARENA_THREAD_BLOCK_COUNT 500
+
+typedef struct ThreadBlocks
+{
+	/// Blocks of each thread in the frames still valid, filled with the thread and frame they belong to
+	uint32_t* pBlocks[confetti::FRAME_ARENA_FRAME_COUNT][ARENA_THREAD_COUNT][ARENA_THREAD_BLOCK_COUNT];
+	uint32_t mFrame;
+	tfrg_atomic32_t mNextThread;
+} ThreadBlocks;
+
+static const uint32_t gThreadBlockWords = 24;
+
+static uint32_t threadBlockTag(uint32_t frame, uint32_t thread) { return frame * ARENA_THREAD_COUNT + thread + 1; }
+
+static void fillThreadBlocks(void* pData)
+{
+	ThreadBlocks* pShared = (ThreadBlocks*)pData;
+	const uint32_t thread = tfrg_atomic32_add(&pShared->mNextThread, 1) % ARENA_THREAD_COUNT;
+	uint32_t** ppBlocks = pShared->pBlocks[pShared->mFrame % confetti::FRAME_ARENA_FRAME_COUNT][thread];
+	for (uint32_t i = 0; i < ARENA_THREAD_BLOCK_COUNT; ++i)
+	{
+		// Some blocks larger than a chunk, so threads add chunks while the others bump theirs
+		const uint32_t wordCount = i % 100 == 99 ? 20000 : gThreadBlockWords;
+		ppBlocks[i] = (uint32_t*)confetti::frameAllocate(wordCount * sizeof(uint32_t));
+		ppBlocks[i][0] = wordCount;
+		for (uint32_t j = 1; j < wordCount; ++j)
+			ppBlocks[i][j] = threadBlockTag(pShared->mFrame, thread);
+	}
+}
+
+// Threads allocating in the same frames never hand out the same memory
+static void testThreads()
+{
+	ThreadBlocks* pShared = (ThreadBlocks*)conf_calloc(1, sizeof(ThreadBlocks));
+	Thread* pThreads[ARENA_THREAD_COUNT];
+	uint32_t corruptCount = 0;
+	for (uint32_t frame = 0; frame < 12; ++frame)
+	{
+		pShared->mFrame = frame;
+		for (uint32_t i = 0; i < ARENA_THREAD_COUNT; ++i)
+			pThreads[i] = conf_placement_new<Thread>(conf_calloc(1, sizeof(Thread)), fillThreadBlocks, pShared);
+		for (uint32_t i = 0; i < ARENA_THREAD_COUNT; ++i)
+		{
+			pThreads[i]->~Thread();
+			conf_free(pThreads[i]);
+		}
+
+		for (uint32_t age = 0; age < confetti::FRAME_ARENA_FRAME_COUNT && age <= frame; ++age)
+		{
+			const uint32_t written = frame - age;
+			for (uint32_t thread = 0; thread < ARENA_THREAD_COUNT; ++thread)
+			{
+				for (uint32_t i = 0; i < ARENA_THREAD_BLOCK_COUNT; ++i)
+				{
+					const uint32_t* pBlock = pShared->pBlocks[written % confetti::FRAME_ARENA_FRAME_COUNT][thread][i];
+					for (uint32_t j = 1; j < pBlock[0]; ++j)
+					{
+						if (pBlock[j] != threadBlockTag(written, thread))
+						{
+							++corruptCount;
+							break;
+						}
+					}
+				}
+			}
+		}
+		confetti::frameArenaNextFrame();
+	}
+	TEST_CHECK_MSG(corruptCount == 0, "%u blocks were overwritten", corruptCount);
+	conf_free(pShared);
+}
+
+static void testStats()
+{
+	// Padding for the alignment is not counted
+	confetti::frameAllocate(1000);
+	confetti::frameAllocate(3, 256);
+	confetti::frameCallocate(10, 100);
+	confetti::frameArenaNextFrame();
+	confetti::FrameArenaStats stats;
+	confetti::getFrameArenaStats(&stats);
+	TEST_CHECK_MSG(stats.mLastFrameBytes == 2003, "%llu bytes in the last frame", (unsigned long long)stats.mLastFrameBytes);
+	TEST_CHECK(stats.mReservedBytes >= 2003);
+
+	confetti::frameAllocate(4 * 1024 * 1024);
+	confetti::frameArenaNextFrame();
+	confetti::frameAllocate(10);
+	confetti::frameArenaNextFrame();
+	confetti::getFrameArenaStats(&stats);
+	TEST_CHECK(stats.mLastFrameBytes == 10);
+	TEST_CHECK(stats.mPeakFrameBytes >= 4 * 1024 * 1024);
+	TEST_CHECK(stats.mReservedBytes >= 4 * 1024 * 1024);
+
+	confetti::frameArenaNextFrame();
+	confetti::getFrameArenaStats(&stats);
+	TEST_CHECK(stats.mLastFrameBytes == 0);
+
+	confetti::exitFrameArenas();
+	confetti::getFrameArenaStats(&stats);
+	TEST_CHECK(stats.mReservedBytes == 0);
+}
+
+typedef struct DrawArgs
+{
+	uint32_t mIndexCount;
+	uint32_t mInstanceCount;
+	uint32_t mStartIndex;
+	uint32_t mStartInstance;
+} DrawArgs;
+
+// Per frame argument and index lists of a few dozen subsets, as a CPU side culling pass builds them
+static float timeFrames(uint32_t drawCount, bool useFrameArena)
+{
+	const uint32_t frameCount = 1000;
+	const uint32_t subsetCount = 64;
+	uint32_t checksum = 0;
+	HiresTimer timer;
+	for (uint32_t frame = 0; frame < frameCount; ++frame)
+	{
+		for (uint32_t subset = 0; subset < subsetCount; ++subset)
+		{
+			if (useFrameArena)
+			{
+				DrawArgs* pArgs = (DrawArgs*)confetti::frameCallocate(drawCount, sizeof(DrawArgs));
+				tinystl::vector<uint32_t, confetti::FrameArenaAllocator> visible;
+				for (uint32_t i = 0; i < drawCount; i += 4)
+				{
+					visible.push_back(i);
+					pArgs[i].mIndexCount = i;
+				}
+				checksum += visible.size() + pArgs[drawCount - 4].mIndexCount;
+			}
+			else
+			{
+				DrawArgs* pArgs = (DrawArgs*)conf_calloc(drawCount, sizeof(DrawArgs));
+				tinystl::vector<uint32_t> visible;
+				for (uint32_t i = 0; i < drawCount; i += 4)
+				{
+					visible.push_back(i);
+					pArgs[i].mIndexCount = i;
+				}
+				checksum += visible.size() + pArgs[drawCount - 4].mIndexCount;
+				conf_free(pArgs);
+			}
+		}
+		confetti::frameArenaNextFrame();
+	}
+	const float frameTime = timer.GetUSec(false) / (float)frameCount;
+	TEST_CHECK(checksum == frameCount * subsetCount * (drawCount / 4 + drawCount - 4));
+	return frameTime;
+}
+
+// Small lists stay in cache either way, large ones cycle through FRAME_ARENA_FRAME_COUNT frames of arena memory
+static void timeAllocators()
+{
+	const uint32_t drawCounts[] = { 16, 128, 1024 };
+	for (uint32_t d = 0; d < sizeof(drawCounts) / sizeof(drawCounts[0]); ++d)
+	{
+		float bestTimes[2] = { 1e9f, 1e9f };
+		for (uint32_t run = 0; run < 3; ++run)
+		{
+			for (uint32_t arena = 0; arena < 2; ++arena)
+			{
+				const float time = timeFrames(drawCounts[d], arena == 1);
+				bestTimes[arena] = time < bestTimes[arena] ? time : bestTimes[arena];
+			}
+		}
+		printf("64 subsets of %u draws: %.1f us per frame with conf_calloc, %.1f us with the frame arena\n", drawCounts[d], bestTimes[0], bestTimes[1]);
+	}
+	confetti::exitFrameArenas();
+}
+
+int main(int argc, char** argv)
+{
+	LogManager logManager;
+
+	testAlignment();
+	testLifetime();
+	testCallocate();
+	testContainers();
+	testThreads();
+	testStats();
+	timeAllocators();
+
+	return finishTest("FrameArenaTest");
+}
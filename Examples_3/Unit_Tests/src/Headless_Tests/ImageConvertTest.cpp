@@ -0,0 +1,337 @@
+/*
+ * Copyright (c) 2018 Confetti Interactive Inc.
+ *
+ * This file is part of The-Forge
+ * (see https://github.com/ConfettiFX/The-Forge).
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+*/
+
+// Image::Convert for every supported format pair against a per pixel reference conversion through RGBA float,
+// lossless round trips and the throughput of the common pairs.
+
+#include <stdlib.h>
+#include <math.h>
+
+#include "../../../../Common_3/OS/Image/Image.h"
+#include "../../../../Common_3/OS/Interfaces/IThread.h"
+#include "../../../../Common_3/OS/Interfaces/ITimeManager.h"
+#include "../../../../Common_3/OS/Interfaces/ILogManager.h"
+#include "../../../../Common_3/OS/Math/FloatUtil.h"
+#include "../../../../Common_3/OS/Math/half.h"
+#include "../../../../Common_3/OS/Interfaces/IMemoryManager.h"
+
+#include "TestFramework.h"
+
+using namespace ImageFormat;
+
+static const ImageFormat::Enum gSourceFormats[] = {
+	R8, RG8, RGB8, RGBA8, R16, RG16, RGB16, RGBA16, R16F, RG16F, RGB16F, RGBA16F, R32F, RG32F, RGB32F, RGBA32F, RGBE8, BGRA8
+};
+static const ImageFormat::Enum gDestinationFormats[] = {
+	R8, RG8, RGB8, RGBA8, R16, RG16, RGB16, RGBA16, R16F, RG16F, RGB16F, RGBA16F, R32F, RG32F, RGB32F, RGBA32F, RGBE8, RGB9E5, RGB10A2, BGRA8
+};
+
+static bool isHalfFormat(ImageFormat::Enum format) { return format >= R16F && format <= RGBA16F; }
+static bool isFloat32Format(ImageFormat::Enum format) { return format >= R32F && format <= RGBA32F; }
+static bool isUnorm16Format(ImageFormat::Enum format) { return format >= R16 && format <= RGBA16; }
+static bool isPackedFormat(ImageFormat::Enum format) { return format == RGBE8 || format == RGB9E5 || format == RGB10A2; }
+
+// The per pixel loop Image::Convert used before it got dedicated kernels
+static void referenceConvert(uint8_t* pDst, const uint8_t* pSrc, uint32_t pixelCount, ImageFormat::Enum srcFormat, ImageFormat::Enum dstFormat)
+{
+	const int srcSize = GetBytesPerPixel(srcFormat);
+	const int srcChannels = GetChannelCount(srcFormat);
+	const int dstSize = GetBytesPerPixel(dstFormat);
+	const int dstChannels = GetChannelCount(dstFormat);
+
+	for (uint32_t p = 0; p < pixelCount; ++p, pSrc += srcSize, pDst += dstSize)
+	{
+		float rgba[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+		if (srcFormat == RGBE8)
+		{
+			const float scale = pSrc[3] ? ldexpf(1.0f, pSrc[3] - 136) : 0.0f;
+			for (int i = 0; i < 3; ++i)
+				rgba[i] = pSrc[i] * scale;
+			rgba[3] = 1.0f;
+		}
+		else if (srcFormat == BGRA8)
+		{
+			rgba[0] = pSrc[2] / 255.0f;
+			rgba[1] = pSrc[1] / 255.0f;
+			rgba[2] = pSrc[0] / 255.0f;
+			rgba[3] = pSrc[3] / 255.0f;
+		}
+		else
+		{
+			for (int i = 0; i < srcChannels; ++i)
+			{
+				if (isHalfFormat(srcFormat))
+					rgba[i] = ((const half*)pSrc)[i];
+				else if (isFloat32Format(srcFormat))
+					rgba[i] = ((const float*)pSrc)[i];
+				else if (isUnorm16Format(srcFormat))
+					rgba[i] = ((const uint16_t*)pSrc)[i] * (1.0f / 65535.0f);
+				else
+					rgba[i] = pSrc[i] * (1.0f / 255.0f);
+			}
+			if (srcChannels < 4)
+				rgba[3] = 1.0f;
+			if (srcChannels == 1)
+				rgba[2] = rgba[1] = rgba[0];
+		}
+
+		if (dstChannels == 1)
+			rgba[0] = 0.30f * rgba[0] + 0.59f * rgba[1] + 0.11f * rgba[2];
+
+		if (dstFormat == BGRA8)
+		{
+			pDst[0] = (uint8_t)(255 * saturate(rgba[2]) + 0.5f);
+			pDst[1] = (uint8_t)(255 * saturate(rgba[1]) + 0.5f);
+			pDst[2] = (uint8_t)(255 * saturate(rgba[0]) + 0.5f);
+			pDst[3] = (uint8_t)(255 * saturate(rgba[3]) + 0.5f);
+		}
+		else if (dstFormat == RGBE8)
+			*(uint32_t*)pDst = rgbToRGBE8(vec3(rgba[0], rgba[1], rgba[2]));
+		else if (dstFormat == RGB9E5)
+			*(uint32_t*)pDst = rgbToRGB9E5(vec3(rgba[0], rgba[1], rgba[2]));
+		else if (dstFormat == RGB10A2)
+			*(uint32_t*)pDst = ((uint32_t)(1023.0f * saturate(rgba[0]) + 0.5f) << 22) | ((uint32_t)(1023.0f * saturate(rgba[1]) + 0.5f) << 12) |
+				((uint32_t)(1023.0f * saturate(rgba[2]) + 0.5f) << 2) | (uint32_t)(3.0f * saturate(rgba[3]) + 0.5f);
+		else
+		{
+			for (int i = 0; i < dstChannels; ++i)
+			{
+				if (isHalfFormat(dstFormat))
+					((half*)pDst)[i] = rgba[i];
+				else if (isFloat32Format(dstFormat))
+					((float*)pDst)[i] = rgba[i];
+				else if (isUnorm16Format(dstFormat))
+					((uint16_t*)pDst)[i] = (uint16_t)(65535 * saturate(rgba[i]) + 0.5f);
+				else
+					pDst[i] = (uint8_t)(255 * saturate(rgba[i]) + 0.5f);
+			}
+		}
+	}
+}
+
+// Random bytes for the integer formats, a sane value range for the float formats including HDR values
+static void fillRandom(Image* pImage, uint32_t seed)
+{
+	const ImageFormat::Enum format = pImage->getFormat();
+	const uint32_t size = pImage->GetMipMappedSize(0, 1);
+	uint8_t* pPixels = pImage->GetPixels();
+	srand(seed);
+
+	if (isHalfFormat(format))
+	{
+		for (uint32_t i = 0; i < size / 2; ++i)
+			((half*)pPixels)[i] = half((rand() % 20000) / 100.0f);
+	}
+	else if (isFloat32Format(format))
+	{
+		for (uint32_t i = 0; i < size / 4; ++i)
+			((float*)pPixels)[i] = (i % 7 == 0) ? (float)(rand() % 200000) : (rand() % 20000) / 10000.0f;
+	}
+	else
+	{
+		for (uint32_t i = 0; i < size; ++i)
+			pPixels[i] = (uint8_t)rand();
+	}
+}
+
+// Returns the largest difference of an element, half and 16 bit values are compared as integers.
+// Float and packed destinations have to match exactly, anything else may be off by one.
+static bool compareToReference(const uint8_t* pResult, const uint8_t* pReference, uint32_t pixelCount, ImageFormat::Enum dstFormat, uint32_t* pMismatches)
+{
+	const uint32_t size = pixelCount * GetBytesPerPixel(dstFormat);
+	uint32_t mismatches = 0;
+	int maxDifference = 0;
+
+	if (isFloat32Format(dstFormat))
+	{
+		for (uint32_t i = 0; i < size / 4; ++i)
+		{
+			const float result = ((const float*)pResult)[i];
+			const float reference = ((const float*)pReference)[i];
+			if (fabsf(result - reference) > 1e-6f * (fabsf(reference) > 1.0f ? fabsf(reference) : 1.0f))
+			{
+				++mismatches;
+				maxDifference = 2;
+			}
+		}
+	}
+	else if (isPackedFormat(dstFormat))
+	{
+		for (uint32_t i = 0; i < size / 4; ++i)
+		{
+			if (((const uint32_t*)pResult)[i] != ((const uint32_t*)pReference)[i])
+			{
+				++mismatches;
+				maxDifference = 2;
+			}
+		}
+	}
+	else if (isHalfFormat(dstFormat) || isUnorm16Format(dstFormat))
+	{
+		for (uint32_t i = 0; i < size / 2; ++i)
+		{
+			const int difference = abs((int)((const uint16_t*)pResult)[i] - (int)((const uint16_t*)pReference)[i]);
+			mismatches += difference ? 1 : 0;
+			maxDifference = difference > maxDifference ? difference : maxDifference;
+		}
+	}
+	else
+	{
+		for (uint32_t i = 0; i < size; ++i)
+		{
+			const int difference = abs((int)pResult[i] - (int)pReference[i]);
+			mismatches += difference ? 1 : 0;
+			maxDifference = difference > maxDifference ? difference : maxDifference;
+		}
+	}
+
+	*pMismatches = mismatches;
+	return maxDifference <= 1;
+}
+
+// Odd dimensions and more pixels than one batch so the pool splits the work
+static const uint32_t gWidth = 509;
+static const uint32_t gHeight = 131;
+
+static void testAllPairs(ThreadPool* pPool)
+{
+	const uint32_t pixelCount = gWidth * gHeight;
+	uint32_t pairCount = 0;
+
+	for (uint32_t s = 0; s < sizeof(gSourceFormats) / sizeof(gSourceFormats[0]); ++s)
+	{
+		for (uint32_t d = 0; d < sizeof(gDestinationFormats) / sizeof(gDestinationFormats[0]); ++d)
+		{
+			const ImageFormat::Enum srcFormat = gSourceFormats[s];
+			const ImageFormat::Enum dstFormat = gDestinationFormats[d];
+			if (srcFormat == dstFormat)
+				continue;
+
+			Image image;
+			image.Create(srcFormat, gWidth, gHeight, 1, 1);
+			fillRandom(&image, s * 100 + d);
+			Image serialImage(image);
+
+			uint8_t* pReference = (uint8_t*)conf_malloc(pixelCount * GetBytesPerPixel(dstFormat));
+			referenceConvert(pReference, image.GetPixels(), pixelCount, srcFormat, dstFormat);
+
+			TEST_CHECK(image.Convert(dstFormat, pPool) && image.getFormat() == dstFormat);
+			TEST_CHECK(serialImage.Convert(dstFormat));
+
+			uint32_t mismatches = 0;
+			TEST_CHECK_MSG(compareToReference(image.GetPixels(), pReference, pixelCount, dstFormat, &mismatches),
+				"%s -> %s: %u elements differ from the reference", GetFormatString(srcFormat), GetFormatString(dstFormat), mismatches);
+
+			// The result does not depend on how the pixels were split over the pool
+			TEST_CHECK_MSG(memcmp(image.GetPixels(), serialImage.GetPixels(), pixelCount * GetBytesPerPixel(dstFormat)) == 0,
+				"%s -> %s: threaded and serial conversion differ", GetFormatString(srcFormat), GetFormatString(dstFormat));
+
+			conf_free(pReference);
+			image.Destroy();
+			serialImage.Destroy();
+			++pairCount;
+		}
+	}
+	printf("%u format pairs compared to the reference\n", pairCount);
+}
+
+// Widening an integer format and converting back has to restore every bit
+static void testRoundTrips(ThreadPool* pPool)
+{
+	struct RoundTrip { ImageFormat::Enum mFormat; ImageFormat::Enum mIntermediate; };
+	const RoundTrip roundTrips[] = {
+		{ R8, R16 }, { RG8, RG16 }, { RGB8, RGB16 }, { RGBA8, RGBA16 },
+		{ R8, R16F }, { RG8, RG16F }, { RGB8, RGB16F }, { RGBA8, RGBA16F },
+		{ R8, R32F }, { RG8, RG32F }, { RGB8, RGB32F }, { RGBA8, RGBA32F },
+		{ R16, R32F }, { RG16, RG32F }, { RGB16, RGB32F }, { RGBA16, RGBA32F },
+		{ RGBA8, BGRA8 }, { BGRA8, RGBA8 }, { R16F, R32F }, { RGBA16F, RGBA32F },
+	};
+
+	for (uint32_t i = 0; i < sizeof(roundTrips) / sizeof(roundTrips[0]); ++i)
+	{
+		const RoundTrip& roundTrip = roundTrips[i];
+		Image image;
+		image.Create(roundTrip.mFormat, gWidth, gHeight, 1, 1);
+		fillRandom(&image, 1000 + i);
+		Image original(image);
+
+		TEST_CHECK(image.Convert(roundTrip.mIntermediate, pPool));
+		TEST_CHECK(image.Convert(roundTrip.mFormat, pPool));
+		TEST_CHECK_MSG(memcmp(image.GetPixels(), original.GetPixels(), original.GetMipMappedSize(0, 1)) == 0,
+			"%s -> %s -> %s does not restore the pixels", GetFormatString(roundTrip.mFormat), GetFormatString(roundTrip.mIntermediate),
+			GetFormatString(roundTrip.mFormat));
+
+		image.Destroy();
+		original.Destroy();
+	}
+}
+
+static void timeCommonPairs(ThreadPool* pPool)
+{
+	const ImageFormat::Enum pairs[][2] = {
+		{ RGBA8, RGBA32F }, { RGBA32F, RGBA8 }, { RGBA8, RGBA16F }, { RGBA16F, RGBA8 }, { RGB8, RGBA8 }, { RGBA32F, RGBE8 }, { RGBA8, BGRA8 },
+	};
+	const uint32_t width = 2048;
+	const uint32_t height = 1024;
+
+	for (uint32_t i = 0; i < sizeof(pairs) / sizeof(pairs[0]); ++i)
+	{
+		Image image;
+		image.Create(pairs[i][0], width, height, 1, 1);
+		fillRandom(&image, i);
+		uint8_t* pReference = (uint8_t*)conf_malloc(width * height * GetBytesPerPixel(pairs[i][1]));
+
+		HiresTimer timer;
+		referenceConvert(pReference, image.GetPixels(), width * height, pairs[i][0], pairs[i][1]);
+		const int64_t referenceTime = timer.GetUSec(true);
+		Image serialImage(image);
+		timer.Reset();
+		serialImage.Convert(pairs[i][1]);
+		const int64_t serialTime = timer.GetUSec(true);
+		image.Convert(pairs[i][1], pPool);
+		const int64_t pooledTime = timer.GetUSec(true);
+
+		const double megaPixels = width * height / 1e6;
+		printf("%-8s -> %-8s: reference %7.1f, Convert %7.1f, Convert on the pool %7.1f megapixels per second\n", GetFormatString(pairs[i][0]),
+			GetFormatString(pairs[i][1]), megaPixels / (referenceTime / 1e6 + 1e-9), megaPixels / (serialTime / 1e6 + 1e-9),
+			megaPixels / (pooledTime / 1e6 + 1e-9));
+
+		conf_free(pReference);
+		image.Destroy();
+		serialImage.Destroy();
+	}
+}
+
+int main(int argc, char** argv)
+{
+	LogManager logManager;
+	ThreadPool pool;
+	pool.CreateThreads(Thread::GetNumCPUCores() > 1 ? Thread::GetNumCPUCores() - 1 : 1);
+
+	testAllPairs(&pool);
+	testRoundTrips(&pool);
+	timeCommonPairs(&pool);
+
+	return finishTest("ImageConvertTest");
+}
@@ -0,0 +1,341 @@
+/*
+ * Copyright (c) 2018 Confetti Interactive Inc.
+ *
+ * This file is part of The-Forge
+ * (see https://github.com/ConfettiFX/The-Forge).
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+*/
+
+// Jobs with dependencies and parallelFor on a ThreadPool. Checks that every job runs once and only after its
+// dependencies, that job memory can be reused once its counter was waited on, and that parallelFor covers its range
+// exactly once.
+
+#include <stdlib.h>
+
+#include "../../../../Common_3/ThirdParty/OpenSource/TinySTL/vector.h"
+#include "../../../../Common_3/OS/Interfaces/IThread.h"
+#include "../../../../Common_3/OS/Interfaces/ITimeManager.h"
+#include "../../../../Common_3/OS/Interfaces/ILogManager.h"
+#include "../../../../Common_3/OS/Interfaces/IMemoryManager.h"
+
+#include "TestFramework.h"
+
+#define WORKER_COUNT 4
+
+typedef struct GraphNode
+{
+	tinystl::vector<uint32_t> mDependencies;
+	/// Times the job ran
+	tfrg_atomic32_t mRunCount;
+	struct JobGraph* pGraph;
+} GraphNode;
+
+typedef struct JobGraph
+{
+	tinystl::vector<GraphNode> mNodes;
+	tinystl::vector<Job> mJobs;
+	tfrg_atomic32_t mOrderViolationCount;
+	uint32_t mWorkSize;
+} JobGraph;
+
+static void executeNode(void* pData)
+{
+	GraphNode* pNode = (GraphNode*)pData;
+	JobGraph* pGraph = pNode->pGraph;
+	for (uint32_t i = 0; i < (uint32_t)pNode->mDependencies.size(); ++i)
+	{
+		if (!tfrg_atomic32_load_acquire(&pGraph->mNodes[pNode->mDependencies[i]].mRunCount))
+			tfrg_atomic32_add(&pGraph->mOrderViolationCount, 1);
+	}
+
+	volatile float work = 0.0f;
+	for (uint32_t i = 0; i < pGraph->mWorkSize; ++i)
+		work += i * 0.5f;
+	tfrg_atomic32_add(&pNode->mRunCount, 1);
+}
+
+// Random graph where each job depends on up to maxDependencies earlier ones
+static void initJobGraph(JobGraph* pGraph, uint32_t jobCount, uint32_t maxDependencies, uint32_t workSize, JobCounter* pCounter)
+{
+	pGraph->mNodes.resize(jobCount);
+	pGraph->mJobs.resize(jobCount);
+	pGraph->mOrderViolationCount = 0;
+	pGraph->mWorkSize = workSize;
+	for (uint32_t i = 0; i < jobCount; ++i)
+	{
+		GraphNode* pNode = &pGraph->mNodes[i];
+		pNode->mDependencies.clear();
+		pNode->mRunCount = 0;
+		pNode->pGraph = pGraph;
+		initJob(&pGraph->mJobs[i], executeNode, pNode, pCounter);
+	}
+
+	for (uint32_t i = 1; i < jobCount; ++i)
+	{
+		const uint32_t dependencyCount = rand() % (maxDependencies + 1);
+		for (uint32_t j = 0; j < dependencyCount; ++j)
+		{
+			const uint32_t dependency = rand() % i;
+			if (pGraph->mJobs[dependency].mContinuationCount == MAX_JOB_CONTINUATIONS)
+				continue;
+			pGraph->mNodes[i].mDependencies.push_back(dependency);
+			addJobDependency(&pGraph->mJobs[i], &pGraph->mJobs[dependency]);
+		}
+	}
+}
+
+static void checkJobGraph(JobGraph* pGraph, const JobCounter* pCounter)
+{
+	TEST_CHECK(isJobCounterDone(pCounter));
+	TEST_CHECK_MSG(pGraph->mOrderViolationCount == 0, "%u jobs ran before a dependency", pGraph->mOrderViolationCount);
+	for (uint32_t i = 0; i < (uint32_t)pGraph->mNodes.size(); ++i)
+		TEST_CHECK_MSG(pGraph->mNodes[i].mRunCount == 1, "job %u ran %u times", i, pGraph->mNodes[i].mRunCount);
+}
+
+// Nodes on the longest dependency chain of the graph, dependencies always come before their jobs
+static uint32_t getCriticalPathLength(const JobGraph* pGraph)
+{
+	const uint32_t jobCount = (uint32_t)pGraph->mNodes.size();
+	tinystl::vector<uint32_t> depths(jobCount);
+	uint32_t length = 0;
+	for (uint32_t i = 0; i < jobCount; ++i)
+	{
+		uint32_t depth = 0;
+		const GraphNode* pNode = &pGraph->mNodes[i];
+		for (uint32_t j = 0; j < (uint32_t)pNode->mDependencies.size(); ++j)
+			depth = depths[pNode->mDependencies[j]] > depth ? depths[pNode->mDependencies[j]] : depth;
+		depths[i] = depth + 1;
+		length = depths[i] > length ? depths[i] : length;
+	}
+	return length;
+}
+
+// Microseconds the work of one node takes on the calling thread
+static float timeNodeWork(uint32_t workSize)
+{
+	const uint32_t runCount = 200;
+	HiresTimer timer;
+	for (uint32_t run = 0; run < runCount; ++run)
+	{
+		volatile float work = 0.0f;
+		for (uint32_t i = 0; i < workSize; ++i)
+			work += i * 0.5f;
+	}
+	return timer.GetUSec(false) / (float)runCount;
+}
+
+// Jobs are submitted in random order, so many of them wait for dependencies submitted after them
+static void testRandomGraph(ThreadPool* pPool)
+{
+	const uint32_t jobCount = 2000;
+	JobGraph graph;
+	JobCounter counter = {};
+	srand(1);
+	initJobGraph(&graph, jobCount, 3, 2000, &counter);
+
+	tinystl::vector<uint32_t> order(jobCount);
+	for (uint32_t i = 0; i < jobCount; ++i)
+		order[i] = i;
+	for (uint32_t i = jobCount - 1; i > 0; --i)
+	{
+		const uint32_t j = rand() % (i + 1);
+		const uint32_t index = order[i];
+		order[i] = order[j];
+		order[j] = index;
+	}
+
+	HiresTimer timer;
+	for (uint32_t i = 0; i < jobCount; ++i)
+		submitJob(pPool, &graph.mJobs[order[i]]);
+	waitForJobCounter(pPool, &counter);
+	const float wallTime = timer.GetUSec(false) / 1000.0f;
+
+	// No schedule finishes before the longest chain, nor before the pool and the caller got through all the work
+	const float nodeTime = timeNodeWork(graph.mWorkSize) / 1000.0f;
+	const uint32_t criticalPathLength = getCriticalPathLength(&graph);
+	const float criticalTime = criticalPathLength * nodeTime;
+	const uint32_t threadCount = min((uint32_t)WORKER_COUNT + 1, Thread::GetNumCPUCores());
+	const float boundTime = max(criticalTime, jobCount * nodeTime / threadCount);
+	printf("%u jobs in a random graph: %.2f ms, critical path of %u jobs %.2f ms, wall / critical %.2f, wall / bound on %u cores %.2f\n",
+		jobCount, wallTime, criticalPathLength, criticalTime, wallTime / criticalTime, threadCount, wallTime / boundTime);
+
+	checkJobGraph(&graph, &counter);
+}
+
+typedef struct LateSubmitDesc
+{
+	ThreadPool* pPool;
+	Job* pJobs;
+	uint32_t mBegin;
+	uint32_t mEnd;
+} LateSubmitDesc;
+
+static void submitLate(void* pData)
+{
+	LateSubmitDesc* pDesc = (LateSubmitDesc*)pData;
+	Thread::Sleep(20);
+	for (uint32_t i = pDesc->mBegin; i < pDesc->mEnd; ++i)
+		submitJob(pDesc->pPool, &pDesc->pJobs[i]);
+}
+
+// The caller waits while another thread has not submitted its part of the graph yet, the wait covers those jobs as well
+static void testWaitOnPartlySubmittedGraph(ThreadPool* pPool)
+{
+	const uint32_t jobCount = 256;
+	JobGraph graph;
+	JobCounter counter = {};
+	srand(3);
+	initJobGraph(&graph, jobCount, 2, 100, &counter);
+
+	LateSubmitDesc desc = { pPool, graph.mJobs.data(), jobCount / 2, jobCount };
+	Thread* pThread = conf_placement_new<Thread>(conf_calloc(1, sizeof(Thread)), submitLate, &desc);
+	submitJobs(pPool, jobCount / 2, graph.mJobs.data());
+	waitForJobCounter(pPool, &counter);
+	checkJobGraph(&graph, &counter);
+
+	pThread->~Thread();
+	conf_free(pThread);
+}
+
+// A graph rebuilt every frame in the same memory, with jobs so short that waiting and reuse race with the workers
+static void testReuseAfterWait(ThreadPool* pPool)
+{
+	JobGraph graph;
+	JobCounter counter = {};
+	srand(2);
+	for (uint32_t frame = 0; frame < 500; ++frame)
+	{
+		initJobGraph(&graph, 64, 2, 0, &counter);
+		submitJobs(pPool, (uint32_t)graph.mJobs.size(), graph.mJobs.data());
+		waitForJobCounter(pPool, &counter);
+		checkJobGraph(&graph, &counter);
+	}
+}
+
+// Simulate, then cull in parallel, then record, chained by continuations without waiting in between
+static void testPipeline(ThreadPool* pPool)
+{
+	const uint32_t cullJobCount = MAX_JOB_CONTINUATIONS;
+	JobGraph graph;
+	JobCounter counter = {};
+	graph.mNodes.resize(cullJobCount + 2);
+	graph.mJobs.resize(cullJobCount + 2);
+	graph.mOrderViolationCount = 0;
+	graph.mWorkSize = 1000;
+
+	for (uint32_t frame = 0; frame < 100; ++frame)
+	{
+		for (uint32_t i = 0; i < cullJobCount + 2; ++i)
+		{
+			graph.mNodes[i].mDependencies.clear();
+			graph.mNodes[i].mRunCount = 0;
+			graph.mNodes[i].pGraph = &graph;
+			initJob(&graph.mJobs[i], executeNode, &graph.mNodes[i], &counter);
+		}
+
+		Job* pSimulate = &graph.mJobs[0];
+		Job* pRecord = &graph.mJobs[cullJobCount + 1];
+		for (uint32_t i = 1; i <= cullJobCount; ++i)
+		{
+			addJobContinuation(pSimulate, &graph.mJobs[i]);
+			graph.mNodes[i].mDependencies.push_back(0);
+			addJobDependency(pRecord, &graph.mJobs[i]);
+			graph.mNodes[cullJobCount + 1].mDependencies.push_back(i);
+		}
+
+		// The record job is submitted first and only runs once every cull job finished
+		for (uint32_t i = cullJobCount + 2; i > 0; --i)
+			submitJob(pPool, &graph.mJobs[i - 1]);
+		waitForJobCounter(pPool, &counter);
+		checkJobGraph(&graph, &counter);
+	}
+}
+
+typedef struct ParallelForData
+{
+	tfrg_atomic32_t* pVisitCounts;
+	tfrg_atomic64_t mSum;
+} ParallelForData;
+
+static void visitRange(void* pData, uint32_t begin, uint32_t end)
+{
+	ParallelForData* pFor = (ParallelForData*)pData;
+	uint64_t sum = 0;
+	for (uint32_t i = begin; i < end; ++i)
+	{
+		tfrg_atomic32_add(&pFor->pVisitCounts[i], 1);
+		sum += i;
+	}
+	tfrg_atomic64_add(&pFor->mSum, (int64_t)sum);
+}
+
+static void testParallelFor(ThreadPool* pPool)
+{
+	const uint32_t counts[] = { 0, 1, 7, 64, 1000, 100000 };
+	const uint32_t minBatchSizes[] = { 0, 1, 64, 1000000 };
+	for (uint32_t i = 0; i < sizeof(counts) / sizeof(counts[0]); ++i)
+	{
+		for (uint32_t j = 0; j < sizeof(minBatchSizes) / sizeof(minBatchSizes[0]); ++j)
+		{
+			const uint32_t count = counts[i];
+			ParallelForData data;
+			data.pVisitCounts = (tfrg_atomic32_t*)conf_calloc(count + 1, sizeof(tfrg_atomic32_t));
+			data.mSum = 0;
+
+			parallelFor(pPool, count, minBatchSizes[j], visitRange, &data);
+
+			uint32_t wrongCount = 0;
+			for (uint32_t k = 0; k < count; ++k)
+				wrongCount += data.pVisitCounts[k] != 1;
+			TEST_CHECK_MSG(wrongCount == 0, "%u of %u indices not visited exactly once, min batch size %u", wrongCount, count,
+				minBatchSizes[j]);
+			TEST_CHECK(data.mSum == (uint64_t)count * (count ? count - 1 : 0) / 2);
+			conf_free((void*)data.pVisitCounts);
+		}
+	}
+
+	// Many small calls in a row, each waits for its own batches only
+	ParallelForData data;
+	data.pVisitCounts = (tfrg_atomic32_t*)conf_calloc(10000, sizeof(tfrg_atomic32_t));
+	data.mSum = 0;
+	HiresTimer timer;
+	for (uint32_t i = 0; i < 1000; ++i)
+		parallelFor(pPool, 10000, 64, visitRange, &data);
+	printf("1000 parallelFor calls over 10000 indices: %.2f ms\n", timer.GetUSec(false) / 1000.0f);
+	TEST_CHECK(data.mSum == 1000ULL * 10000 * 9999 / 2);
+	conf_free((void*)data.pVisitCounts);
+}
+
+int main(int argc, char** argv)
+{
+	LogManager logManager;
+
+	ThreadPool* pPool = conf_placement_new<ThreadPool>(conf_calloc(1, sizeof(ThreadPool)));
+	pPool->CreateThreads(WORKER_COUNT);
+
+	testRandomGraph(pPool);
+	testWaitOnPartlySubmittedGraph(pPool);
+	testReuseAfterWait(pPool);
+	testPipeline(pPool);
+	testParallelFor(pPool);
+
+	pPool->~ThreadPool();
+	conf_free(pPool);
+	return finishTest("JobGraphTest");
+}
@@ -0,0 +1,263 @@
+/*
+ * Copyright (c) 2018 Confetti Interactive Inc.
+ *
+ * This file is part of The-Forge
+ * (see https://github.com/ConfettiFX/The-Forge).
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+*/
+
+// Callsite counters of the memory tracking. Checks the live bytes and counts per callsite after allocations,
+// reallocations and frees, also when another thread frees the memory, and reports how much slower the tracked
+// allocations are than confetti::allocate / deallocate. The tracked functions are called directly, so the test runs
+// the same in release builds, which do not track conf_malloc by default.
+
+#include <string.h>
+
+#include "../../../../Common_3/OS/Interfaces/IThread.h"
+#include "../../../../Common_3/OS/Interfaces/ITimeManager.h"
+#include "../../../../Common_3/OS/Interfaces/ILogManager.h"
+#include "../../../../Common_3/OS/Interfaces/IMemoryManager.h"
+
+#include "TestFramework.h"
+
+static confetti::AllocationCallsite gSmallCallsite = { __FILE__, __LINE__, 0 };
+static confetti::AllocationCallsite gLargeCallsite = { __FILE__, __LINE__, 0 };
+static confetti::AllocationCallsite gReallocCallsite = { __FILE__, __LINE__, 0 };
+static confetti::AllocationCallsite gThreadCallsite = { __FILE__, __LINE__, 0 };
+static confetti::AllocationCallsite gBenchmarkCallsite = { __FILE__, __LINE__, 0 };
+
+static uint32_t nextRandom(uint32_t* pSeed)
+{
+	uint32_t x = *pSeed;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	*pSeed = x;
+	return x;
+}
+
+// Counters of a callsite in this file, zero if the diff does not have it
+static confetti::MemoryCallsiteStats findCallsite(const confetti::MemorySnapshot* pDiff, uint32_t line)
+{
+	confetti::MemoryCallsiteStats stats = {};
+	for (uint32_t i = 0; i < pDiff->mCallsiteCount; ++i)
+	{
+		const confetti::MemoryCallsiteStats* pCallsite = &pDiff->pCallsites[i];
+		if (pCallsite->pFile && pCallsite->mLine == line && strstr(pCallsite->pFile, "MemoryTrackingTest.cpp"))
+		{
+			stats.mLiveBytes += pCallsite->mLiveBytes;
+			stats.mLiveCount += pCallsite->mLiveCount;
+		}
+	}
+	return stats;
+}
+
+static confetti::MemoryCallsiteStats diffCallsite(const confetti::MemorySnapshot* pBefore, uint32_t line)
+{
+	confetti::MemorySnapshot* pAfter = NULL;
+	confetti::MemorySnapshot* pDiff = NULL;
+	confetti::takeMemorySnapshot(&pAfter);
+	confetti::diffMemorySnapshots(pBefore, pAfter, &pDiff);
+	const confetti::MemoryCallsiteStats stats = findCallsite(pDiff, line);
+	confetti::removeMemorySnapshot(pDiff);
+	confetti::removeMemorySnapshot(pAfter);
+	return stats;
+}
+
+static void testCallsiteCounts()
+{
+	const uint32_t blockCount = 100;
+	confetti::MemorySnapshot* pBefore = NULL;
+	confetti::takeMemorySnapshot(&pBefore);
+
+	void* pSmall[blockCount];
+	void* pLarge[blockCount];
+	for (uint32_t i = 0; i < blockCount; ++i)
+	{
+		pSmall[i] = confetti::trackedAllocate(&gSmallCallsite, 48);
+		pLarge[i] = confetti::trackedCallocate(&gLargeCallsite, 10, 100);
+	}
+
+	confetti::MemoryCallsiteStats stats = diffCallsite(pBefore, gSmallCallsite.mLine);
+	TEST_CHECK_MSG(stats.mLiveBytes == 48 * blockCount && stats.mLiveCount == blockCount, "%lld bytes in %lld blocks",
+		(long long)stats.mLiveBytes, (long long)stats.mLiveCount);
+	stats = diffCallsite(pBefore, gLargeCallsite.mLine);
+	TEST_CHECK(stats.mLiveBytes == 1000 * blockCount && stats.mLiveCount == blockCount);
+
+	// A reallocation moves the block over to the reallocating callsite
+	for (uint32_t i = 0; i < blockCount / 2; ++i)
+		pLarge[i] = confetti::trackedReallocate(&gReallocCallsite, pLarge[i], 3000);
+	stats = diffCallsite(pBefore, gLargeCallsite.mLine);
+	TEST_CHECK(stats.mLiveBytes == 1000 * blockCount / 2 && stats.mLiveCount == blockCount / 2);
+	stats = diffCallsite(pBefore, gReallocCallsite.mLine);
+	TEST_CHECK(stats.mLiveBytes == 3000 * blockCount / 2 && stats.mLiveCount == blockCount / 2);
+
+	for (uint32_t i = 0; i < blockCount; ++i)
+	{
+		confetti::trackedDeallocate(pSmall[i]);
+		confetti::trackedDeallocate(pLarge[i]);
+	}
+	stats = diffCallsite(pBefore, gSmallCallsite.mLine);
+	TEST_CHECK(stats.mLiveBytes == 0 && stats.mLiveCount == 0);
+	stats = diffCallsite(pBefore, gLargeCallsite.mLine);
+	TEST_CHECK(stats.mLiveBytes == 0 && stats.mLiveCount == 0);
+	stats = diffCallsite(pBefore, gReallocCallsite.mLine);
+	TEST_CHECK(stats.mLiveBytes == 0 && stats.mLiveCount == 0);
+
+#if defined(USE_MEMORY_TRACKING)
+	// conf_malloc counts for the line it is written on
+	void* p = conf_malloc(100);
+	const uint32_t line = __LINE__ - 1;
+	stats = diffCallsite(pBefore, line);
+	TEST_CHECK(stats.mLiveBytes == 100 && stats.mLiveCount == 1);
+	conf_free(p);
+#endif
+
+	confetti::removeMemorySnapshot(pBefore);
+}
+
+typedef struct CrossThreadDesc
+{
+	void* pBlocks[1000];
+} CrossThreadDesc;
+
+static void allocateBlocks(void* pData)
+{
+	CrossThreadDesc* pDesc = (CrossThreadDesc*)pData;
+	for (uint32_t i = 0; i < 1000; ++i)
+		pDesc->pBlocks[i] = confetti::trackedAllocate(&gThreadCallsite, 64 + i);
+}
+
+// Blocks allocated by one thread and freed by another, the counters of both threads' tables add up
+static void testCrossThreadCounts()
+{
+	confetti::MemorySnapshot* pBefore = NULL;
+	confetti::takeMemorySnapshot(&pBefore);
+
+	CrossThreadDesc desc = {};
+	Thread* pThread = conf_placement_new<Thread>(conf_calloc(1, sizeof(Thread)), allocateBlocks, &desc);
+	pThread->~Thread();
+	conf_free(pThread);
+
+	int64_t bytes = 0;
+	for (uint32_t i = 0; i < 1000; ++i)
+		bytes += 64 + i;
+	confetti::MemoryCallsiteStats stats = diffCallsite(pBefore, gThreadCallsite.mLine);
+	TEST_CHECK_MSG(stats.mLiveBytes == bytes && stats.mLiveCount == 1000, "%lld bytes in %lld blocks",
+		(long long)stats.mLiveBytes, (long long)stats.mLiveCount);
+
+	for (uint32_t i = 0; i < 1000; ++i)
+		confetti::trackedDeallocate(desc.pBlocks[i]);
+	stats = diffCallsite(pBefore, gThreadCallsite.mLine);
+	TEST_CHECK(stats.mLiveBytes == 0 && stats.mLiveCount == 0);
+
+	confetti::removeMemorySnapshot(pBefore);
+}
+
+typedef struct BenchmarkDesc
+{
+	uint32_t mOpCount;
+	/// Largest block size, the sizes are mostly small either way
+	uint32_t mMaxSize;
+	bool mTracked;
+	tfrg_atomic32_t mNextSeed;
+} BenchmarkDesc;
+
+// Random alloc / free mix, the same sequence with and without tracking
+static void allocateAndFree(void* pData)
+{
+	BenchmarkDesc* pDesc = (BenchmarkDesc*)pData;
+	uint32_t seed = 12345 + tfrg_atomic32_add(&pDesc->mNextSeed, 1);
+	void* pSlots[1024] = {};
+	for (uint32_t i = 0; i < pDesc->mOpCount; ++i)
+	{
+		const uint32_t slot = nextRandom(&seed) & 1023;
+		if (pSlots[slot])
+		{
+			if (pDesc->mTracked)
+				confetti::trackedDeallocate(pSlots[slot]);
+			else
+				confetti::deallocate(pSlots[slot]);
+			pSlots[slot] = NULL;
+			continue;
+		}
+
+		const uint32_t r = nextRandom(&seed) % 1000;
+		size_t size = r < 800 ? 16 + nextRandom(&seed) % 240 : (r < 990 ? 256 + nextRandom(&seed) % 768 : 1024 + nextRandom(&seed) % 63000);
+		size = size < pDesc->mMaxSize ? size : pDesc->mMaxSize;
+		pSlots[slot] = pDesc->mTracked ? confetti::trackedAllocate(&gBenchmarkCallsite, size) : confetti::allocate(size);
+		*(volatile char*)pSlots[slot] = 1;
+	}
+
+	for (uint32_t i = 0; i < 1024; ++i)
+	{
+		if (pDesc->mTracked)
+			confetti::trackedDeallocate(pSlots[i]);
+		else
+			confetti::deallocate(pSlots[i]);
+	}
+}
+
+static float timeAllocations(uint32_t threadCount, uint32_t maxSize, bool tracked)
+{
+	BenchmarkDesc desc = { 2000000 / threadCount, maxSize, tracked, 0 };
+	Thread* pThreads[4];
+	HiresTimer timer;
+	for (uint32_t i = 0; i < threadCount; ++i)
+		pThreads[i] = conf_placement_new<Thread>(conf_calloc(1, sizeof(Thread)), allocateAndFree, &desc);
+	for (uint32_t i = 0; i < threadCount; ++i)
+	{
+		pThreads[i]->~Thread();
+		conf_free(pThreads[i]);
+	}
+	return timer.GetUSec(false) * 1000.0f / (desc.mOpCount * threadCount);
+}
+
+static void timeTracking()
+{
+	const uint32_t maxSizes[] = { 256, 64 * 1024 };
+	for (uint32_t threadCount = 1; threadCount <= 4; threadCount *= 4)
+	{
+		for (uint32_t s = 0; s < sizeof(maxSizes) / sizeof(maxSizes[0]); ++s)
+		{
+			float bestTimes[2] = { 1e9f, 1e9f };
+			for (uint32_t run = 0; run < 5; ++run)
+			{
+				for (uint32_t tracked = 0; tracked < 2; ++tracked)
+				{
+					const float time = timeAllocations(threadCount, maxSizes[s], tracked == 1);
+					bestTimes[tracked] = time < bestTimes[tracked] ? time : bestTimes[tracked];
+				}
+			}
+			printf("%u threads, blocks up to %u bytes: %.1f ns per op tracked, %.1f ns untracked, %+.1f%% overhead\n", threadCount,
+				maxSizes[s], bestTimes[1], bestTimes[0], (bestTimes[1] / bestTimes[0] - 1.0f) * 100.0f);
+		}
+	}
+}
+
+int main(int argc, char** argv)
+{
+	LogManager logManager;
+
+	testCallsiteCounts();
+	testCrossThreadCounts();
+	timeTracking();
+
+	return finishTest("MemoryTrackingTest");
+}
@@ -0,0 +1,403 @@
+/*
+ * Copyright (c) 2018 Confetti Interactive Inc.
+ *
+ * This file is part of The-Forge
+ * (see https://github.com/ConfettiFX/The-Forge).
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+*/
+
+// Image::GenerateMipMaps against a scalar reference filter for even, odd and non power of two sizes with and without sRGB,
+// and the throughput of the mip chain against the box filter it replaced.
+
+#include <stdlib.h>
+#include <math.h>
+
+#include "../../../../Common_3/OS/Image/Image.h"
+#include "../../../../Common_3/OS/Interfaces/IThread.h"
+#include "../../../../Common_3/OS/Interfaces/ITimeManager.h"
+#include "../../../../Common_3/OS/Interfaces/ILogManager.h"
+#include "../../../../Common_3/OS/Math/half.h"
+#include "../../../../Common_3/OS/Interfaces/IMemoryManager.h"
+
+#include "TestFramework.h"
+
+using namespace ImageFormat;
+
+static bool isHalfFormat(ImageFormat::Enum format) { return format >= R16F && format <= RGBA16F; }
+static bool isFloat32Format(ImageFormat::Enum format) { return format >= R32F && format <= RGBA32F; }
+static bool isUnorm16Format(ImageFormat::Enum format) { return format >= R16 && format <= RGBA16; }
+
+static double srgbToLinear(double c) { return (c <= 0.04045) ? c / 12.92 : pow((c + 0.055) / 1.055, 2.4); }
+static double linearToSrgb(double l) { return (l <= 0.0031308) ? l * 12.92 : 1.055 * pow(l, 1.0 / 2.4) - 0.055; }
+static double saturateDouble(double x) { return x < 0.0 ? 0.0 : (x > 1.0 ? 1.0 : x); }
+
+static double loadElement(const uint8_t* pPixels, uint32_t index, ImageFormat::Enum format, bool srgbChannel)
+{
+	if (isHalfFormat(format))
+		return (float)((const half*)pPixels)[index];
+	if (isFloat32Format(format))
+		return ((const float*)pPixels)[index];
+	if (isUnorm16Format(format))
+		return ((const uint16_t*)pPixels)[index] / 65535.0;
+	return srgbChannel ? srgbToLinear(pPixels[index] / 255.0) : pPixels[index] / 255.0;
+}
+
+// Coverage of every source texel by the footprint of destination texel i, clamped to the edge and normalized
+static void referenceBoxWeights(uint32_t srcSize, uint32_t dstSize, uint32_t i, int* pFirst, int* pLast, double* pWeights)
+{
+	const double scale = (double)srcSize / (double)dstSize;
+	const double begin = i * scale;
+	const double end = (i + 1) * scale;
+	*pFirst = (int)floor(begin);
+	*pLast = (int)ceil(end) - 1;
+	double total = 0.0;
+	for (int s = *pFirst; s <= *pLast; ++s)
+	{
+		const double lo = s > begin ? s : begin;
+		const double hi = s + 1 < end ? s + 1 : end;
+		pWeights[s - *pFirst] = hi - lo;
+		total += hi - lo;
+	}
+	for (int s = *pFirst; s <= *pLast; ++s)
+		pWeights[s - *pFirst] /= total;
+}
+
+// Scalar reference of one level: the rounded 2x2 average in the source format for even dimensions,
+// an area weighted box in double precision through linear space everywhere else
+static void referenceMipLevel(uint8_t* pDst, const uint8_t* pSrc, uint32_t srcWidth, uint32_t srcHeight, uint32_t dstWidth, uint32_t dstHeight,
+	ImageFormat::Enum format, bool sRGB)
+{
+	const uint32_t c = GetChannelCount(format);
+	const bool evenWidth = srcWidth == 1 || !(srcWidth & 1);
+	const bool evenHeight = srcHeight == 1 || !(srcHeight & 1);
+	sRGB = sRGB && !isHalfFormat(format) && !isFloat32Format(format) && !isUnorm16Format(format) && c >= 3;
+
+	if (evenWidth && evenHeight && !sRGB)
+	{
+		const uint32_t xOff = srcWidth < 2 ? 0 : 1;
+		const uint32_t yOff = srcHeight < 2 ? 0 : 1;
+		for (uint32_t y = 0; y < dstHeight; ++y)
+		{
+			for (uint32_t x = 0; x < dstWidth; ++x)
+			{
+				for (uint32_t i = 0; i < c; ++i)
+				{
+					const uint32_t x0 = srcWidth < 2 ? x : x * 2;
+					const uint32_t y0 = srcHeight < 2 ? y : y * 2;
+					const uint32_t a = (y0 * srcWidth + x0) * c + i;
+					const uint32_t b = (y0 * srcWidth + x0 + xOff) * c + i;
+					const uint32_t d = ((y0 + yOff) * srcWidth + x0) * c + i;
+					const uint32_t e = ((y0 + yOff) * srcWidth + x0 + xOff) * c + i;
+					const uint32_t out = (y * dstWidth + x) * c + i;
+					if (isHalfFormat(format))
+					{
+						const half* s = (const half*)pSrc;
+						((half*)pDst)[out] = half(((float)s[a] + (float)s[b] + (float)s[d] + (float)s[e]) * 0.25f);
+					}
+					else if (isFloat32Format(format))
+					{
+						const float* s = (const float*)pSrc;
+						((float*)pDst)[out] = (s[a] + s[b] + s[d] + s[e]) * 0.25f;
+					}
+					else if (isUnorm16Format(format))
+					{
+						const uint16_t* s = (const uint16_t*)pSrc;
+						((uint16_t*)pDst)[out] = (uint16_t)(((uint32_t)s[a] + s[b] + s[d] + s[e] + 2) >> 2);
+					}
+					else
+					{
+						pDst[out] = (uint8_t)((pSrc[a] + pSrc[b] + pSrc[d] + pSrc[e] + 2) >> 2);
+					}
+				}
+			}
+		}
+		return;
+	}
+
+	double weightsX[64];
+	double weightsY[64];
+	for (uint32_t y = 0; y < dstHeight; ++y)
+	{
+		int firstY, lastY;
+		referenceBoxWeights(srcHeight, dstHeight, y, &firstY, &lastY, weightsY);
+		for (uint32_t x = 0; x < dstWidth; ++x)
+		{
+			int firstX, lastX;
+			referenceBoxWeights(srcWidth, dstWidth, x, &firstX, &lastX, weightsX);
+			for (uint32_t i = 0; i < c; ++i)
+			{
+				const bool srgbChannel = sRGB && !(c == 4 && i == 3);
+				double sum = 0.0;
+				for (int sy = firstY; sy <= lastY; ++sy)
+				{
+					const uint32_t row = (uint32_t)(sy < (int)srcHeight ? sy : srcHeight - 1);
+					for (int sx = firstX; sx <= lastX; ++sx)
+					{
+						const uint32_t column = (uint32_t)(sx < (int)srcWidth ? sx : srcWidth - 1);
+						sum += weightsY[sy - firstY] * weightsX[sx - firstX] * loadElement(pSrc, (row * srcWidth + column) * c + i, format, srgbChannel);
+					}
+				}
+
+				const uint32_t out = (y * dstWidth + x) * c + i;
+				if (isHalfFormat(format))
+					((half*)pDst)[out] = half((float)sum);
+				else if (isFloat32Format(format))
+					((float*)pDst)[out] = (float)sum;
+				else if (isUnorm16Format(format))
+					((uint16_t*)pDst)[out] = (uint16_t)(65535.0 * saturateDouble(sum) + 0.5);
+				else
+					pDst[out] = (uint8_t)(255.0 * (srgbChannel ? linearToSrgb(saturateDouble(sum)) : saturateDouble(sum)) + 0.5);
+			}
+		}
+	}
+}
+
+// The 2x2 box has to match integer elements exactly, half may be off by one from a different summation order.
+// Resampled integer elements may be off by one, floats by the rounding of single precision weights.
+static uint32_t countMismatches(const uint8_t* pResult, const uint8_t* pReference, uint32_t elementCount, ImageFormat::Enum format, bool exact)
+{
+	const int tolerance = (exact && !isHalfFormat(format)) ? 0 : 1;
+	const float floatTolerance = exact ? 1e-6f : 1e-4f;
+	uint32_t mismatches = 0;
+	for (uint32_t i = 0; i < elementCount; ++i)
+	{
+		if (isFloat32Format(format))
+		{
+			const float result = ((const float*)pResult)[i];
+			const float reference = ((const float*)pReference)[i];
+			mismatches += fabsf(result - reference) > floatTolerance * (fabsf(reference) > 1.0f ? fabsf(reference) : 1.0f) ? 1 : 0;
+		}
+		else if (isHalfFormat(format) || isUnorm16Format(format))
+			mismatches += abs((int)((const uint16_t*)pResult)[i] - (int)((const uint16_t*)pReference)[i]) > tolerance ? 1 : 0;
+		else
+			mismatches += abs((int)pResult[i] - (int)pReference[i]) > tolerance ? 1 : 0;
+	}
+	return mismatches;
+}
+
+static void fillRandom(Image* pImage, uint32_t seed)
+{
+	const ImageFormat::Enum format = pImage->getFormat();
+	const uint32_t size = pImage->GetMipMappedSize(0, 1);
+	uint8_t* pPixels = pImage->GetPixels();
+	srand(seed);
+
+	if (isHalfFormat(format))
+	{
+		for (uint32_t i = 0; i < size / 2; ++i)
+			((half*)pPixels)[i] = half((rand() % 20000) / 1000.0f);
+	}
+	else if (isFloat32Format(format))
+	{
+		for (uint32_t i = 0; i < size / 4; ++i)
+			((float*)pPixels)[i] = (rand() % 20000) / 1000.0f;
+	}
+	else
+	{
+		for (uint32_t i = 0; i < size; ++i)
+			pPixels[i] = (uint8_t)rand();
+	}
+}
+
+struct MipTestCase
+{
+	ImageFormat::Enum mFormat;
+	uint32_t mWidth;
+	uint32_t mHeight;
+	bool mSRGB;
+};
+
+// Every level is compared to the reference computed from the level above it, so errors do not add up over the chain
+static void testAgainstReference(ThreadPool* pPool)
+{
+	const MipTestCase testCases[] = {
+		{ RGBA8, 256, 128, false }, { RGBA8, 257, 129, false }, { RGBA8, 100, 37, false }, { RGBA8, 256, 128, true }, { RGBA8, 100, 37, true },
+		{ RGB8, 64, 64, true }, { RGB8, 45, 81, true }, { R8, 512, 64, false }, { R8, 129, 257, false }, { R8, 1, 64, false },
+		{ RGBA16, 128, 128, false }, { RGBA16, 99, 33, false }, { RGBA16F, 128, 64, false }, { RGBA16F, 67, 129, false },
+		{ R32F, 256, 256, false }, { R32F, 96, 1, false }, { RGBA32F, 128, 32, false }, { RGBA32F, 77, 300, false },
+	};
+
+	for (uint32_t t = 0; t < sizeof(testCases) / sizeof(testCases[0]); ++t)
+	{
+		const MipTestCase& testCase = testCases[t];
+		Image image;
+		image.Create(testCase.mFormat, testCase.mWidth, testCase.mHeight, 1, 1);
+		fillRandom(&image, t);
+		Image serialImage(image);
+
+		TEST_CHECK(image.GenerateMipMaps(ALL_MIPLEVELS, MIPMAP_FILTER_BOX, testCase.mSRGB, pPool));
+		TEST_CHECK(serialImage.GenerateMipMaps(ALL_MIPLEVELS, MIPMAP_FILTER_BOX, testCase.mSRGB));
+		TEST_CHECK(image.GetMipMapCount() == image.GetMipMapCountFromDimensions());
+
+		const uint32_t c = GetChannelCount(testCase.mFormat);
+		uint8_t* pReference = (uint8_t*)conf_malloc(image.GetMipMappedSize(1, 1));
+		for (uint32_t level = 1; level < image.GetMipMapCount(); ++level)
+		{
+			const uint32_t srcWidth = image.GetWidth(level - 1);
+			const uint32_t srcHeight = image.GetHeight(level - 1);
+			const uint32_t dstWidth = image.GetWidth(level);
+			const uint32_t dstHeight = image.GetHeight(level);
+			referenceMipLevel(pReference, image.GetPixels(level - 1), srcWidth, srcHeight, dstWidth, dstHeight,
+				testCase.mFormat, testCase.mSRGB);
+			const bool boxPath = !testCase.mSRGB && (srcWidth == 1 || !(srcWidth & 1)) && (srcHeight == 1 || !(srcHeight & 1));
+			const uint32_t mismatches = countMismatches(image.GetPixels(level), pReference, dstWidth * dstHeight * c, testCase.mFormat, boxPath);
+			TEST_CHECK_MSG(mismatches == 0, "%s %ux%u%s level %u: %u elements differ from the reference", GetFormatString(testCase.mFormat),
+				testCase.mWidth, testCase.mHeight, testCase.mSRGB ? " sRGB" : "", level, mismatches);
+		}
+
+		// The result does not depend on how the rows were split over the pool
+		TEST_CHECK_MSG(memcmp(image.GetPixels(), serialImage.GetPixels(), image.GetMipMappedSize(0, image.GetMipMapCount())) == 0,
+			"%s %ux%u: threaded and serial mip chains differ", GetFormatString(testCase.mFormat), testCase.mWidth, testCase.mHeight);
+
+		conf_free(pReference);
+		image.Destroy();
+		serialImage.Destroy();
+	}
+}
+
+// The windowed sinc kernels are normalized, so a constant image has to stay constant on every level
+static void testConstantImage(ThreadPool* pPool)
+{
+	const MipMapFilter filters[] = { MIPMAP_FILTER_BOX, MIPMAP_FILTER_KAISER, MIPMAP_FILTER_LANCZOS };
+	for (uint32_t f = 0; f < sizeof(filters) / sizeof(filters[0]); ++f)
+	{
+		Image image;
+		image.Create(RGBA8, 157, 93, 1, 1);
+		memset(image.GetPixels(), 200, image.GetMipMappedSize(0, 1));
+		TEST_CHECK(image.GenerateMipMaps(ALL_MIPLEVELS, filters[f], true, pPool));
+
+		uint32_t mismatches = 0;
+		const uint8_t* pPixels = image.GetPixels(1);
+		const uint32_t size = image.GetMipMappedSize(1, image.GetMipMapCount() - 1);
+		for (uint32_t i = 0; i < size; ++i)
+			mismatches += abs((int)pPixels[i] - 200) > 1 ? 1 : 0;
+		TEST_CHECK_MSG(mismatches == 0, "filter %u: %u elements of a constant image changed", filters[f], mismatches);
+		image.Destroy();
+	}
+}
+
+// The truncating box filter GenerateMipMaps used before the row kernels, kept to compare the throughput
+template <typename T>
+static void legacyBuildMipMap(T* dst, const T* src, const uint32_t w, const uint32_t h, const uint32_t d, const uint32_t c)
+{
+	uint32_t xOff = (w < 2) ? 0 : c;
+	uint32_t yOff = (h < 2) ? 0 : c * w;
+	uint32_t zOff = (d < 2) ? 0 : c * w * h;
+
+	for (uint32_t z = 0; z < d; z += 2)
+	{
+		for (uint32_t y = 0; y < h; y += 2)
+		{
+			for (uint32_t x = 0; x < w; x += 2)
+			{
+				for (uint32_t i = 0; i < c; i++)
+				{
+					*dst++ = (src[0] + src[xOff] + src[yOff] + src[yOff + xOff] + src[zOff] + src[zOff + xOff] + src[zOff + yOff] + src[zOff + yOff + xOff]) / 8;
+					src++;
+				}
+				src += xOff;
+			}
+			src += yOff;
+		}
+		src += zOff;
+	}
+}
+
+static void legacyGenerateMipMaps(Image* pImage)
+{
+	const ImageFormat::Enum format = pImage->getFormat();
+	const uint32_t c = GetChannelCount(format);
+	for (uint32_t level = 1; level < pImage->GetMipMapCount(); ++level)
+	{
+		const uint32_t w = pImage->GetWidth(level - 1);
+		const uint32_t h = pImage->GetHeight(level - 1);
+		uint8_t* src = pImage->GetPixels(level - 1);
+		uint8_t* dst = pImage->GetPixels(level);
+		if (isFloat32Format(format))
+			legacyBuildMipMap((float*)dst, (const float*)src, w, h, 1, c);
+		else if (isUnorm16Format(format))
+			legacyBuildMipMap((uint16_t*)dst, (const uint16_t*)src, w, h, 1, c);
+		else
+			legacyBuildMipMap(dst, src, w, h, 1, c);
+	}
+}
+
+// Megapixels of the top level per second for the whole chain, best of a few runs
+static void timeMipChains(ThreadPool* pPool)
+{
+	const MipTestCase testCases[] = {
+		{ RGBA8, 2048, 2048, false }, { R8, 2048, 2048, false }, { RGBA16, 1024, 1024, false }, { RGBA32F, 1024, 1024, false },
+		{ RGBA8, 2048, 2048, true }, { RGBA8, 1920, 1080, false },
+	};
+	const uint32_t runCount = 3;
+
+	for (uint32_t t = 0; t < sizeof(testCases) / sizeof(testCases[0]); ++t)
+	{
+		const MipTestCase& testCase = testCases[t];
+		Image image;
+		image.Create(testCase.mFormat, testCase.mWidth, testCase.mHeight, 1, 1);
+		fillRandom(&image, t);
+		TEST_CHECK(image.GenerateMipMaps(ALL_MIPLEVELS, MIPMAP_FILTER_BOX, testCase.mSRGB));
+
+		// The old filter only handled power of two sizes and knew nothing about sRGB
+		const bool hasLegacy = !testCase.mSRGB && !(testCase.mWidth & (testCase.mWidth - 1)) && !(testCase.mHeight & (testCase.mHeight - 1));
+		int64_t legacyTime = INT64_MAX;
+		int64_t serialTime = INT64_MAX;
+		int64_t pooledTime = INT64_MAX;
+		HiresTimer timer;
+		for (uint32_t run = 0; run < runCount; ++run)
+		{
+			if (hasLegacy)
+			{
+				timer.Reset();
+				legacyGenerateMipMaps(&image);
+				legacyTime = min(legacyTime, timer.GetUSec(false));
+			}
+			timer.Reset();
+			image.GenerateMipMaps(ALL_MIPLEVELS, MIPMAP_FILTER_BOX, testCase.mSRGB);
+			serialTime = min(serialTime, timer.GetUSec(false));
+			timer.Reset();
+			image.GenerateMipMaps(ALL_MIPLEVELS, MIPMAP_FILTER_BOX, testCase.mSRGB, pPool);
+			pooledTime = min(pooledTime, timer.GetUSec(false));
+		}
+
+		const double megaPixels = testCase.mWidth * testCase.mHeight / 1e6;
+		char legacy[32] = "      -";
+		if (hasLegacy)
+			sprintf(legacy, "%7.1f", megaPixels / (legacyTime / 1e6 + 1e-9));
+		printf("%-8s %4ux%-4u%s: old box filter %s, GenerateMipMaps %7.1f, GenerateMipMaps on the pool %7.1f megapixels per second\n",
+			GetFormatString(testCase.mFormat), testCase.mWidth, testCase.mHeight, testCase.mSRGB ? " sRGB" : "     ", legacy,
+			megaPixels / (serialTime / 1e6 + 1e-9), megaPixels / (pooledTime / 1e6 + 1e-9));
+
+		image.Destroy();
+	}
+}
+
+int main(int argc, char** argv)
+{
+	LogManager logManager;
+	ThreadPool pool;
+	pool.CreateThreads(Thread::GetNumCPUCores() > 1 ? Thread::GetNumCPUCores() - 1 : 1);
+
+	testAgainstReference(&pool);
+	testConstantImage(&pool);
+	timeMipChains(&pool);
+
+	return finishTest("MipMapTest");
+}
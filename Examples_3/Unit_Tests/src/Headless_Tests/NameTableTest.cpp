@@ -0,0 +1,188 @@
+/*
+ * Copyright (c) 2018 Confetti Interactive Inc.
+ *
+ * This file is part of The-Forge
+ * (see https://github.com/ConfettiFX/The-Forge).
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+*/
+
+// Interned names: every name gets exactly one copy, string views that are not null terminated intern like the
+// full string, names whose ids collide keep their own copy, and threads interning the same names agree on it.
+
+#include <stdio.h>
+
+#include "../../../../Common_3/OS/Interfaces/IFileSystem.h"
+#include "../../../../Common_3/OS/Interfaces/IThread.h"
+#include "../../../../Common_3/OS/Interfaces/ILogManager.h"
+#include "../../../../Common_3/ThirdParty/OpenSource/TinySTL/flat_hash_map.h"
+#include "../../../../Common_3/OS/Interfaces/IMemoryManager.h"
+
+#include "TestFramework.h"
+
+static void testIntern()
+{
+	const char* pFirst = NULL;
+	const char* pSecond = NULL;
+	const NameId id = internName("Textures/Sponza/lion.dds", &pFirst);
+	TEST_CHECK(id == getNameId("Textures/Sponza/lion.dds"));
+	TEST_CHECK(internName("Textures/Sponza/lion.dds", &pSecond) == id);
+	TEST_CHECK(pFirst == pSecond && strcmp(pFirst, "Textures/Sponza/lion.dds") == 0);
+	TEST_CHECK(getInternedName(id) == pFirst);
+
+	// A view into a longer string is interned without the rest of it
+	const char* pPath = "Textures/Sponza/lion.dds.backup";
+	const char* pView = NULL;
+	TEST_CHECK(internName(StringView(pPath, 24), &pView) == id && pView == pFirst);
+
+	const char* pOther = NULL;
+	const NameId otherId = internName("Textures/Sponza/lion_normal.dds", &pOther);
+	TEST_CHECK(otherId != id && pOther != pFirst && strcmp(pOther, "Textures/Sponza/lion_normal.dds") == 0);
+	TEST_CHECK(getInternedName(getNameId("Textures/never_interned.dds")) == NULL);
+}
+
+static uint64_t gRandomState = 88172645463325252ULL;
+
+static uint64_t nextRandom()
+{
+	gRandomState ^= gRandomState << 13;
+	gRandomState ^= gRandomState >> 7;
+	gRandomState ^= gRandomState << 17;
+	return gRandomState;
+}
+
+static void randomName(char* pName, uint64_t seed)
+{
+	memcpy(pName, "Textures/", 9);
+	for (uint32_t i = 0; i < 12; ++i, seed /= 26)
+		pName[9 + i] = (char)('a' + seed % 26);
+	memcpy(pName + 21, ".dds", 5);
+}
+
+// Generates random names until two of them share an id, so the test does not depend on which hash the platform uses
+static bool findCollision(char* pNameA, char* pNameB)
+{
+	tinystl::flat_hash_map<NameId, uint64_t> ids;
+	for (uint32_t i = 0; i < 4 * 1024 * 1024; ++i)
+	{
+		const uint64_t seed = nextRandom();
+		char name[32];
+		randomName(name, seed);
+		const NameId id = getNameId(name);
+		tinystl::flat_hash_map<NameId, uint64_t>::iterator it = ids.find(id);
+		if (it != ids.end())
+		{
+			randomName(pNameA, it->second);
+			memcpy(pNameB, name, sizeof(name));
+			if (strcmp(pNameA, pNameB) != 0)
+				return true;
+		}
+		ids.insert({ id, seed });
+	}
+	return false;
+}
+
+static void testCollision()
+{
+	char nameA[32] = {};
+	char nameB[32] = {};
+	if (!findCollision(nameA, nameB))
+	{
+		TEST_CHECK_MSG(false, "no two names with the same id found");
+		return;
+	}
+	TEST_CHECK(getNameId(nameA) == getNameId(nameB) && strcmp(nameA, nameB) != 0);
+	printf("%s and %s share the id 0x%08x\n", nameA, nameB, getNameId(nameA));
+
+	const char* pA = NULL;
+	const char* pB = NULL;
+	TEST_CHECK(internName(nameA, &pA) == internName(nameB, &pB));
+	// Each caller gets the file it asked for
+	TEST_CHECK_MSG(pA && strcmp(pA, nameA) == 0, "interned %s as %s", nameA, pA);
+	TEST_CHECK_MSG(pB && strcmp(pB, nameB) == 0, "interned %s as %s", nameB, pB);
+	TEST_CHECK(pA != pB);
+
+	// Interning either name again finds its own entry in the chain
+	const char* pAgainA = NULL;
+	const char* pAgainB = NULL;
+	internName(nameB, &pAgainB);
+	internName(nameA, &pAgainA);
+	TEST_CHECK(pAgainA == pA && pAgainB == pB);
+	TEST_CHECK(getInternedName(getNameId(nameA)) == pA);
+}
+
+#define INTERN_THREAD_COUNT 4
+#define INTERN_NAME_COUNT 2000
+
+struct InternThreadData
+{
+	uint32_t mThreadIndex;
+	const char* pNames[INTERN_NAME_COUNT];
+};
+
+static void internNames(void* pData)
+{
+	InternThreadData* pThreadData = (InternThreadData*)pData;
+	for (uint32_t n = 0; n < INTERN_NAME_COUNT; ++n)
+	{
+		// Every thread starts at a different name
+		const uint32_t i = (n + pThreadData->mThreadIndex * (INTERN_NAME_COUNT / INTERN_THREAD_COUNT)) % INTERN_NAME_COUNT;
+		char name[64];
+		snprintf(name, sizeof(name), "Meshes/part_%u.bin", i);
+		internName(name, &pThreadData->pNames[i]);
+	}
+}
+
+static void testConcurrentIntern()
+{
+	InternThreadData* pData = (InternThreadData*)conf_calloc(INTERN_THREAD_COUNT, sizeof(InternThreadData));
+	Thread* pThreads[INTERN_THREAD_COUNT];
+	for (uint32_t t = 0; t < INTERN_THREAD_COUNT; ++t)
+	{
+		pData[t].mThreadIndex = t;
+		pThreads[t] = conf_placement_new<Thread>(conf_calloc(1, sizeof(Thread)), internNames, &pData[t]);
+	}
+	for (uint32_t t = 0; t < INTERN_THREAD_COUNT; ++t)
+	{
+		pThreads[t]->~Thread();
+		conf_free(pThreads[t]);
+	}
+
+	uint32_t mismatches = 0;
+	for (uint32_t i = 0; i < INTERN_NAME_COUNT; ++i)
+	{
+		char name[64];
+		snprintf(name, sizeof(name), "Meshes/part_%u.bin", i);
+		for (uint32_t t = 0; t < INTERN_THREAD_COUNT; ++t)
+			mismatches += (pData[t].pNames[i] != pData[0].pNames[i] || strcmp(pData[t].pNames[i], name) != 0) ? 1 : 0;
+	}
+	TEST_CHECK_MSG(mismatches == 0, "%u names were interned differently by the threads", mismatches);
+	conf_free(pData);
+}
+
+int main(int argc, char** argv)
+{
+	LogManager logManager;
+
+	testIntern();
+	testCollision();
+	testConcurrentIntern();
+	exitNameTable();
+
+	return finishTest("NameTableTest");
+}
@@ -0,0 +1,412 @@
+/*
+ * Copyright (c) 2018 Confetti Interactive Inc.
+ *
+ * This file is part of The-Forge
+ * (see https://github.com/ConfettiFX/The-Forge).
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+*/
+
+// Uploads of the resource loader through a CPU stand-in for the copy queue. Checks that resources arrive uncorrupted
+// while the staging ring is reused, that sync tokens only complete after their copies executed, and the staging stats.
+// Texture files have to be decoded straight into staging memory. Times blocking uploads against uploads with tokens
+// and reports how long they stalled on a full staging ring.
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "../../../../Common_3/ThirdParty/OpenSource/TinySTL/vector.h"
+#include "../../../../Common_3/Renderer/IRenderer.h"
+#include "../../../../Common_3/Renderer/ResourceLoader.h"
+#include "../../../../Common_3/OS/Image/Image.h"
+#include "../../../../Common_3/OS/Interfaces/IFileSystem.h"
+#include "../../../../Common_3/OS/Interfaces/ITimeManager.h"
+#include "../../../../Common_3/OS/Interfaces/ILogManager.h"
+#include "../../../../Common_3/OS/Interfaces/IMemoryManager.h"
+
+#include "CpuQueueRenderer.h"
+
+/// Content of byte i of upload index, differs between neighbouring uploads and within a staging page
+static inline uint8_t getPattern(uint32_t index, uint64_t i)
+{
+	return (uint8_t)(index * 131 + i + (i >> 12));
+}
+
+static void fillPattern(uint8_t* pData, uint64_t size, uint32_t index)
+{
+	for (uint64_t i = 0; i < size; ++i)
+		pData[i] = getPattern(index, i);
+}
+
+static bool checkPattern(const void* pData, uint64_t size, uint32_t index)
+{
+	const uint8_t* pBytes = (const uint8_t*)pData;
+	for (uint64_t i = 0; i < size; ++i)
+	{
+		if (pBytes[i] != getPattern(index, i))
+			return false;
+	}
+	return true;
+}
+
+static void addPatternBuffer(uint32_t index, uint64_t size, uint8_t* pScratch, Buffer** ppBuffer, SyncToken* pToken)
+{
+	fillPattern(pScratch, size, index);
+	BufferLoadDesc desc = {};
+	desc.mDesc.mUsage = BUFFER_USAGE_VERTEX;
+	desc.mDesc.mMemoryUsage = RESOURCE_MEMORY_USAGE_GPU_ONLY;
+	desc.mDesc.mSize = size;
+	desc.pData = pScratch;
+	desc.ppBuffer = ppBuffer;
+	if (pToken)
+		addResource(&desc, pToken);
+	else
+		addResource(&desc);
+
+	// The loader is done with the data once addResource returned, even if the copy did not execute yet
+	memset(pScratch, 0xcd, (size_t)size);
+}
+
+// Blocking uploads are complete when addResource returns
+static void testSyncBuffers(Renderer* pRenderer)
+{
+	initResourceLoaderInterface(pRenderer, 2 << 20);
+	const uint64_t maxSize = 256 * 1024;
+	uint8_t* pScratch = (uint8_t*)conf_malloc((size_t)maxSize);
+	srand(1);
+
+	for (uint32_t i = 0; i < 200; ++i)
+	{
+		const uint64_t size = 1024 + rand() % (maxSize - 1024);
+		Buffer* pBuffer = NULL;
+		addPatternBuffer(i, size, pScratch, &pBuffer, NULL);
+		TEST_CHECK_MSG(checkPattern(pBuffer->pCpuMappedAddress, size, i), "buffer %u", i);
+		removeResource(pBuffer);
+	}
+
+	conf_free(pScratch);
+	removeResourceLoaderInterface(pRenderer);
+}
+
+// Many uploads in flight through a small staging ring. Whenever a token reports completion the copies of its buffer
+// have to be done, and every buffer has its data once the last token completed.
+static void testAsyncBuffers(Renderer* pRenderer)
+{
+	const uint64_t budget = 2 << 20;
+	initResourceLoaderInterface(pRenderer, budget);
+	const uint32_t count = 600;
+	const uint64_t maxSize = 256 * 1024;
+	uint8_t* pScratch = (uint8_t*)conf_malloc((size_t)maxSize);
+	tinystl::vector<Buffer*> buffers(count);
+	tinystl::vector<uint64_t> sizes(count);
+	tinystl::vector<SyncToken> tokens(count);
+	const uint32_t submitCount = tfrg_atomic32_load_relaxed(&gCpuQueueSubmitCount);
+	srand(2);
+
+	uint32_t checkedEarly = 0;
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		sizes[i] = 1024 + rand() % (maxSize - 1024);
+		addPatternBuffer(i, sizes[i], pScratch, &buffers[i], &tokens[i]);
+		TEST_CHECK(i == 0 || tokens[i] >= tokens[i - 1]);
+
+		// Poll an earlier upload, which also hands the current batch to the queue
+		const uint32_t j = rand() % (i + 1);
+		if (rand() % 8 == 0 && isTokenCompleted(tokens[j]))
+		{
+			TEST_CHECK_MSG(checkPattern(buffers[j]->pCpuMappedAddress, sizes[j], j), "buffer %u completed before its copy executed", j);
+			++checkedEarly;
+		}
+	}
+
+	waitForToken(tokens[count - 1]);
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		TEST_CHECK(isTokenCompleted(tokens[i]));
+		TEST_CHECK_MSG(checkPattern(buffers[i]->pCpuMappedAddress, sizes[i], i), "buffer %u", i);
+	}
+
+	ResourceLoaderStats stats;
+	getResourceLoaderStats(&stats);
+	TEST_CHECK(stats.mStagingBudget == budget);
+	TEST_CHECK(stats.mStagingHighWaterMark <= stats.mStagingBudget);
+	TEST_CHECK(stats.mTempStagingBytes == 0);
+	TEST_CHECK(stats.mCopySubmitCount == tfrg_atomic32_load_relaxed(&gCpuQueueSubmitCount) - submitCount);
+	// 600 uploads of up to 256KB don't fit 2MB of staging memory at once
+	TEST_CHECK(stats.mStagingStallCount > 0);
+	printf("%u async buffers: %llu submits, %u tokens completed early, staging high water %llu of %llu bytes, wasted %llu bytes, "
+		"%llu stalls\n", count, (unsigned long long)stats.mCopySubmitCount, checkedEarly, (unsigned long long)stats.mStagingHighWaterMark,
+		(unsigned long long)stats.mStagingBudget, (unsigned long long)stats.mStagingWastedBytes, (unsigned long long)stats.mStagingStallCount);
+
+	for (uint32_t i = 0; i < count; ++i)
+		removeResource(buffers[i]);
+	conf_free(pScratch);
+	removeResourceLoaderInterface(pRenderer);
+}
+
+// Buffers larger than the whole ring are staged in chunks instead of temporary buffers.
+// Updates of the same buffer execute in order, the last one wins.
+static void testLargeBuffersAndUpdates(Renderer* pRenderer)
+{
+	initResourceLoaderInterface(pRenderer, 1 << 20);
+	const uint64_t size = 5 << 20;
+	uint8_t* pScratch = (uint8_t*)conf_malloc((size_t)size);
+	Buffer* pBuffers[3] = {};
+	SyncToken token = 0;
+	for (uint32_t i = 0; i < 3; ++i)
+		addPatternBuffer(i, size - i * 4096, pScratch, &pBuffers[i], &token);
+	waitForToken(token);
+	for (uint32_t i = 0; i < 3; ++i)
+		TEST_CHECK_MSG(checkPattern(pBuffers[i]->pCpuMappedAddress, size - i * 4096, i), "large buffer %u", i);
+
+	for (uint32_t i = 0; i < 20; ++i)
+	{
+		fillPattern(pScratch, size, 100 + i);
+		BufferUpdateDesc update(pBuffers[0], pScratch);
+		updateResource(&update, &token);
+	}
+	waitForToken(token);
+	TEST_CHECK(checkPattern(pBuffers[0]->pCpuMappedAddress, size, 119));
+
+	ResourceLoaderStats stats;
+	getResourceLoaderStats(&stats);
+	TEST_CHECK(stats.mTempStagingBytes == 0);
+
+	for (uint32_t i = 0; i < 3; ++i)
+		removeResource(pBuffers[i]);
+	conf_free(pScratch);
+	removeResourceLoaderInterface(pRenderer);
+}
+
+// Textures with full mip chains. Mip 0 of the largest ones does not fit a staging page and goes through a temporary buffer.
+static void testTextures(Renderer* pRenderer)
+{
+	initResourceLoaderInterface(pRenderer, 1 << 20);
+	const uint32_t count = 60;
+	tinystl::vector<Texture*> textures(count);
+	tinystl::vector<Image> images(count);
+	srand(3);
+
+	SyncToken token = 0;
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		const uint32_t size = 16u << (rand() % 6);
+		uint32_t mipCount = 1;
+		while ((size >> mipCount) > 0)
+			++mipCount;
+		images[i].Create(ImageFormat::RGBA8, size, size, 1, mipCount);
+		fillPattern(images[i].GetPixels(), images[i].GetMipMappedSize(), i);
+
+		TextureLoadDesc desc;
+		desc.pImage = &images[i];
+		desc.ppTexture = &textures[i];
+		addResource(&desc, &token);
+	}
+	waitForToken(token);
+
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		TEST_CHECK(textures[i]->mDesc.mMipLevels == images[i].GetMipMapCount());
+		TEST_CHECK(textures[i]->mTextureSize == images[i].GetMipMappedSize());
+		TEST_CHECK_MSG(checkPattern(textures[i]->pCpuMappedAddress, images[i].GetMipMappedSize(), i), "texture %u", i);
+	}
+
+	ResourceLoaderStats stats;
+	getResourceLoaderStats(&stats);
+	TEST_CHECK(stats.mTempStagingBytes > 0);
+	TEST_CHECK(stats.mStagingHighWaterMark <= stats.mStagingBudget);
+
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		removeResource(textures[i]);
+		images[i].Destroy();
+	}
+	removeResourceLoaderInterface(pRenderer);
+}
+
+static String gTextureDir;
+static confetti::MemorySnapshot* gLoadStartSnapshot = NULL;
+static int64_t gLoadHeapBytes = 0;
+
+/// Most heap memory the loader held while recording the copies of a texture. Buffers and textures of the renderer
+/// stand-in are the staging and GPU memory of a real renderer, they don't count.
+static void measureLoadHeapBytes(Texture*)
+{
+	confetti::MemorySnapshot* pSnapshot = NULL;
+	confetti::MemorySnapshot* pDiff = NULL;
+	confetti::takeMemorySnapshot(&pSnapshot);
+	confetti::diffMemorySnapshots(gLoadStartSnapshot, pSnapshot, &pDiff);
+
+	int64_t bytes = 0;
+	for (uint32_t i = 0; i < pDiff->mCallsiteCount; ++i)
+	{
+		const confetti::MemoryCallsiteStats* pCallsite = &pDiff->pCallsites[i];
+		if (pCallsite->mLiveBytes > 0 && (!pCallsite->pFile || !strstr(pCallsite->pFile, "CpuQueueRenderer.h")))
+			bytes += pCallsite->mLiveBytes;
+	}
+	gLoadHeapBytes = max(gLoadHeapBytes, bytes);
+
+	confetti::removeMemorySnapshot(pDiff);
+	confetti::removeMemorySnapshot(pSnapshot);
+}
+
+/// Uncompressed RGBA16F DDS file with a full mip chain filled with the pattern of index, pImage receives the mips
+static void writePatternDDS(const String& fileName, uint32_t size, uint32_t index, Image* pImage)
+{
+	uint32_t mipCount = 1;
+	while ((size >> mipCount) > 0)
+		++mipCount;
+	pImage->Create(ImageFormat::RGBA16F, size, size, 1, mipCount);
+	fillPattern(pImage->GetPixels(), pImage->GetMipMappedSize(), index);
+
+	// Magic and header, the pixel format is the D3DFMT_A16B16G16R16F four character code
+	uint32_t header[32] = {};
+	header[0] = 0x20534444;
+	header[1] = 124;
+	header[2] = 0x0002100F;
+	header[3] = size;
+	header[4] = size;
+	header[7] = mipCount;
+	header[19] = 32;
+	header[20] = 0x4;
+	header[21] = 113;
+	header[27] = 0x00401008;
+
+	File file = {};
+	file.Open(fileName, FM_WriteBinary, FSR_Absolute);
+	TEST_CHECK(file.IsOpen());
+	file.Write(header, sizeof(header));
+	file.Write(pImage->GetPixels(), pImage->GetMipMappedSize());
+	file.Close();
+}
+
+// Texture files are decoded straight into staging memory, with and without the loading threads. Files which fit a
+// staging page go to the staging ring, larger ones to a temporary staging buffer. Either way the loader must not
+// hold a copy of the pixels in heap memory of its own.
+static void testTextureFiles(Renderer* pRenderer)
+{
+	const uint32_t sizes[] = { 128, 1024 };
+	const char* names[] = { "Small.dds", "Large.dds" };
+	Image images[2];
+	String fileNames[2];
+	for (uint32_t i = 0; i < 2; ++i)
+	{
+		fileNames[i] = gTextureDir + names[i];
+		writePatternDDS(fileNames[i], sizes[i], i, &images[i]);
+	}
+
+	// The loader only starts its threads with more than one core
+	gCpuUpdateSubresourcesCallback = measureLoadHeapBytes;
+	for (uint32_t threaded = 0; threaded < (Thread::GetNumCPUCores() > 1 ? 2U : 1U); ++threaded)
+	{
+		initResourceLoaderInterface(pRenderer, 4 << 20, threaded != 0);
+		for (uint32_t i = 0; i < 2; ++i)
+		{
+			const uint64_t imageSize = images[i].GetMipMappedSize();
+			Texture* pTexture = NULL;
+			TextureLoadDesc desc;
+			desc.pFilename = fileNames[i].c_str();
+			desc.mRoot = FSR_Absolute;
+			desc.mUseMipmaps = true;
+			desc.ppTexture = &pTexture;
+
+			confetti::takeMemorySnapshot(&gLoadStartSnapshot);
+			gLoadHeapBytes = -1;
+			addResource(&desc, threaded != 0);
+			if (threaded)
+				finishResourceLoading();
+			confetti::removeMemorySnapshot(gLoadStartSnapshot);
+
+			TEST_CHECK_MSG(pTexture && pTexture->mTextureSize == imageSize && !memcmp(pTexture->pCpuMappedAddress, images[i].GetPixels(), (size_t)imageSize),
+				"%s %s", threaded ? "threaded" : "blocking", names[i]);
+#if USE_MEMORY_TRACKING
+			TEST_CHECK_MSG(gLoadHeapBytes >= 0 && gLoadHeapBytes < (int64_t)imageSize, "%s load of %s held %lld heap bytes for %llu bytes of pixels",
+				threaded ? "threaded" : "blocking", names[i], (long long)gLoadHeapBytes, (unsigned long long)imageSize);
+#endif
+			printf("%s load of %s: %llu bytes of pixels, %lld bytes of heap memory held while recording the copies\n", threaded ? "Threaded" : "Blocking",
+				names[i], (unsigned long long)imageSize, (long long)gLoadHeapBytes);
+			if (pTexture)
+				removeResource(pTexture);
+		}
+		removeResourceLoaderInterface(pRenderer);
+	}
+	gCpuUpdateSubresourcesCallback = NULL;
+
+	for (uint32_t i = 0; i < 2; ++i)
+	{
+		FileSystem::Delete(fileNames[i]);
+		images[i].Destroy();
+	}
+}
+
+// Same uploads blocking and with tokens, with a queue latency of 1 ms per submission
+static void timeSyncAgainstAsync(Renderer* pRenderer)
+{
+	const uint32_t count = 1000;
+	const uint64_t size = 64 * 1024;
+	uint8_t* pScratch = (uint8_t*)conf_malloc((size_t)size);
+	tinystl::vector<Buffer*> buffers(count);
+
+	for (uint32_t async = 0; async < 2; ++async)
+	{
+		initResourceLoaderInterface(pRenderer, 8 << 20);
+		const uint32_t submitCount = tfrg_atomic32_load_relaxed(&gCpuQueueSubmitCount);
+		HiresTimer timer;
+		SyncToken token = 0;
+		for (uint32_t i = 0; i < count; ++i)
+			addPatternBuffer(i, size, pScratch, &buffers[i], async ? &token : NULL);
+		if (async)
+			waitForToken(token);
+		const float time = timer.GetUSec(false) / 1000.0f;
+
+		ResourceLoaderStats stats;
+		getResourceLoaderStats(&stats);
+		printf("%u buffers of %llu KB %s: %.1f ms, %.0f req/s, %u submits, %llu stalls on the staging ring for %.1f ms\n", count,
+			(unsigned long long)(size / 1024), async ? "with tokens" : "blocking", time, count * 1000.0f / time,
+			tfrg_atomic32_load_relaxed(&gCpuQueueSubmitCount) - submitCount, (unsigned long long)stats.mStagingStallCount,
+			stats.mStagingStallTime / 1000.0f);
+
+		for (uint32_t i = 0; i < count; ++i)
+			removeResource(buffers[i]);
+		removeResourceLoaderInterface(pRenderer);
+	}
+	conf_free(pScratch);
+}
+
+int main(int argc, char** argv)
+{
+	LogManager logManager;
+
+	gTextureDir = FileSystem::GetProgramDir() + "/ResourceLoaderQueueTest/";
+	FileSystem::CreateDir(gTextureDir);
+
+	GPUSettings settings = {};
+	settings.mUniformBufferAlignment = 256;
+	Renderer* pRenderer = (Renderer*)conf_calloc(1, sizeof(Renderer));
+	pRenderer->pActiveGpuSettings = &settings;
+
+	testSyncBuffers(pRenderer);
+	testAsyncBuffers(pRenderer);
+	testLargeBuffersAndUpdates(pRenderer);
+	testTextures(pRenderer);
+	testTextureFiles(pRenderer);
+	timeSyncAgainstAsync(pRenderer);
+
+	conf_free(pRenderer);
+	return finishTest("ResourceLoaderQueueTest");
+}
@@ -0,0 +1,263 @@
+/*
+ * Copyright (c) 2018 Confetti Interactive Inc.
+ *
+ * This file is part of The-Forge
+ * (see https://github.com/ConfettiFX/The-Forge).
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+*/
+
+// addShaders with the stub compiler of StubShaderCompiler.cpp in place of glslangValidator. Checks that permutations
+// compiled in parallel get their own byte code, that duplicates are compiled once, that warm loads only hit the
+// shader cache without reflecting and that changed includes invalidate the stages using them.
+// VULKAN_SDK has to point to the directory with bin/glslangValidator of the stub, ctest sets it.
+
+#include <stdlib.h>
+
+#include "../../../../Common_3/ThirdParty/OpenSource/TinySTL/vector.h"
+#include "../../../../Common_3/Renderer/IRenderer.h"
+#include "../../../../Common_3/Renderer/ResourceLoader.h"
+#include "../../../../Common_3/OS/Interfaces/IFileSystem.h"
+#include "../../../../Common_3/OS/Interfaces/ITimeManager.h"
+#include "../../../../Common_3/OS/Interfaces/ILogManager.h"
+#include "../../../../Common_3/OS/Interfaces/IMemoryManager.h"
+
+#include "CpuQueueRenderer.h"
+
+#define PERMUTATION_COUNT 16
+
+static String gShaderDir;
+
+static void writeTextFile(const String& fileName, const char* pText)
+{
+	File file = {};
+	file.Open(fileName, FM_WriteBinary, FSR_Absolute);
+	TEST_CHECK(file.IsOpen());
+	file.Write(pText, (unsigned)strlen(pText));
+	file.Close();
+}
+
+/// Shaders of a vertex and a fragment stage with the permutation macro PERM. Each permutation is requested twice.
+typedef struct ShaderSet
+{
+	tinystl::vector<ShaderMacro> mMacros;
+	tinystl::vector<ShaderLoadDesc> mDescs;
+	tinystl::vector<Shader*> mShaders;
+} ShaderSet;
+
+static void initShaderSet(ShaderSet* pSet, const char* pPrefix, uint32_t permutationCount, const char* pFragmentShader = "b.frag")
+{
+	const uint32_t count = permutationCount * 2;
+	pSet->mMacros.resize(count);
+	pSet->mDescs.resize(count);
+	pSet->mShaders.resize(count);
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		pSet->mMacros[i].definition = "PERM";
+		pSet->mMacros[i].value = String::format("%s%u", pPrefix, i % permutationCount);
+		pSet->mDescs[i] = {};
+		pSet->mDescs[i].mStages[0] = { gShaderDir + "a.vert", &pSet->mMacros[i], 1, FSR_Absolute };
+		pSet->mDescs[i].mStages[4] = { gShaderDir + pFragmentShader, &pSet->mMacros[i], 1, FSR_Absolute };
+		pSet->mShaders[i] = NULL;
+	}
+}
+
+static void removeShaderSet(Renderer* pRenderer, ShaderSet* pSet)
+{
+	for (uint32_t i = 0; i < (uint32_t)pSet->mShaders.size(); ++i)
+	{
+		if (pSet->mShaders[i])
+			removeShader(pRenderer, pSet->mShaders[i]);
+		pSet->mShaders[i] = NULL;
+	}
+}
+
+static void checkShaderSet(const ShaderSet* pSet)
+{
+	for (uint32_t i = 0; i < (uint32_t)pSet->mShaders.size(); ++i)
+	{
+		const Shader* pShader = pSet->mShaders[i];
+		TEST_CHECK_MSG(pShader != NULL, "shader %u", i);
+		if (!pShader)
+			continue;
+
+		String vertexCode = String::format("SPIRV(%sa.vert PERM=%s)", gShaderDir.c_str(), pSet->mMacros[i].value.c_str());
+		TEST_CHECK_MSG(getCpuShaderByteCode(pShader, SHADER_STAGE_VERT) == vertexCode, "shader %u: %s instead of %s", i,
+			getCpuShaderByteCode(pShader, SHADER_STAGE_VERT).c_str(), vertexCode.c_str());
+		TEST_CHECK(pShader->mStages == (SHADER_STAGE_VERT | SHADER_STAGE_FRAG));
+
+		// The made up reflection of each stage has the byte code size as register
+		const PipelineReflection* pReflection = &pShader->mReflection;
+		TEST_CHECK(pReflection->mStageReflectionCount == 2);
+		for (uint32_t j = 0; j < pReflection->mStageReflectionCount; ++j)
+		{
+			const ShaderReflection* pStage = &pReflection->mStageReflections[j];
+			TEST_CHECK(pStage->mShaderResourceCount == 1 && pStage->pShaderResources[0].reg == getCpuShaderByteCode(pShader, pStage->mShaderStage).size());
+		}
+	}
+}
+
+static ShaderCacheStats getStatsSince(const ShaderCacheStats& start)
+{
+	ShaderCacheStats stats;
+	getShaderCacheStats(&stats);
+	stats.mHitCount -= start.mHitCount;
+	stats.mMissCount -= start.mMissCount;
+	stats.mDuplicateCount -= start.mDuplicateCount;
+	return stats;
+}
+
+// The first load compiles every permutation once, the second one only reads the cache file
+static void testColdAndWarmLoad(Renderer* pRenderer)
+{
+	ShaderSet set;
+	initShaderSet(&set, "", PERMUTATION_COUNT);
+
+	ShaderCacheStats start;
+	getShaderCacheStats(&start);
+	uint32_t reflectionCount = tfrg_atomic32_load_relaxed(&gCpuReflectionCount);
+	HiresTimer timer;
+	addShaders(pRenderer, (uint32_t)set.mDescs.size(), set.mDescs.data(), set.mShaders.data());
+	const float coldTime = timer.GetUSec(true) / 1000.0f;
+
+	ShaderCacheStats stats = getStatsSince(start);
+	TEST_CHECK(stats.mMissCount == 2 * PERMUTATION_COUNT);
+	TEST_CHECK(stats.mDuplicateCount == 2 * PERMUTATION_COUNT);
+	TEST_CHECK(stats.mHitCount == 0);
+	TEST_CHECK(stats.mEntryCount >= 4 * PERMUTATION_COUNT);
+	checkShaderSet(&set);
+	removeShaderSet(pRenderer, &set);
+
+	// Reopens the cache from its file
+	removeResourceLoaderInterface(pRenderer);
+	initResourceLoaderInterface(pRenderer);
+
+	getShaderCacheStats(&start);
+	reflectionCount = tfrg_atomic32_load_relaxed(&gCpuReflectionCount);
+	timer.Reset();
+	addShaders(pRenderer, (uint32_t)set.mDescs.size(), set.mDescs.data(), set.mShaders.data());
+	const float warmTime = timer.GetUSec(true) / 1000.0f;
+
+	stats = getStatsSince(start);
+	TEST_CHECK(stats.mMissCount == 0);
+	TEST_CHECK(stats.mHitCount == 4 * PERMUTATION_COUNT);
+	TEST_CHECK(stats.mFileSize > 0);
+	TEST_CHECK_MSG(tfrg_atomic32_load_relaxed(&gCpuReflectionCount) == reflectionCount, "warm load reflected %u stages",
+		tfrg_atomic32_load_relaxed(&gCpuReflectionCount) - reflectionCount);
+	checkShaderSet(&set);
+	removeShaderSet(pRenderer, &set);
+
+	printf("%u shaders: cold %.1f ms, warm %.1f ms\n", (uint32_t)set.mDescs.size(), coldTime, warmTime);
+}
+
+// Stages including a changed file are compiled again, the others still hit
+static void testIncludeChange(Renderer* pRenderer)
+{
+	writeTextFile(gShaderDir + "common.h", "vec4 common() { return vec4(2.0); }\n");
+
+	ShaderSet set;
+	initShaderSet(&set, "", PERMUTATION_COUNT);
+	ShaderCacheStats start;
+	getShaderCacheStats(&start);
+	addShaders(pRenderer, (uint32_t)set.mDescs.size(), set.mDescs.data(), set.mShaders.data());
+
+	ShaderCacheStats stats = getStatsSince(start);
+	TEST_CHECK(stats.mMissCount == PERMUTATION_COUNT);
+	TEST_CHECK(stats.mHitCount == 2 * PERMUTATION_COUNT);
+	checkShaderSet(&set);
+	removeShaderSet(pRenderer, &set);
+}
+
+// New permutations one shader at a time and in a single addShaders call
+static void testParallelCompile(Renderer* pRenderer)
+{
+	ShaderSet serialSet;
+	ShaderSet batchSet;
+	initShaderSet(&serialSet, "serial", PERMUTATION_COUNT);
+	initShaderSet(&batchSet, "batch", PERMUTATION_COUNT);
+
+	HiresTimer timer;
+	for (uint32_t i = 0; i < (uint32_t)serialSet.mDescs.size(); ++i)
+		addShader(pRenderer, &serialSet.mDescs[i], &serialSet.mShaders[i]);
+	const float serialTime = timer.GetUSec(true) / 1000.0f;
+	addShaders(pRenderer, (uint32_t)batchSet.mDescs.size(), batchSet.mDescs.data(), batchSet.mShaders.data());
+	const float batchTime = timer.GetUSec(true) / 1000.0f;
+
+	checkShaderSet(&serialSet);
+	checkShaderSet(&batchSet);
+	removeShaderSet(pRenderer, &serialSet);
+	removeShaderSet(pRenderer, &batchSet);
+
+	// Every stage of the batch compiles at the same time with enough cores, the stub compiler mostly sleeps
+	printf("%u new permutations on %u cores: %.1f ms one shader at a time, %.1f ms in one call, %.1fx speedup\n", 2 * PERMUTATION_COUNT,
+		Thread::GetNumCPUCores(), serialTime, batchTime, serialTime / batchTime);
+}
+
+// A failed stage only fails its own shader and is not added to the cache
+static void testFailedStage(Renderer* pRenderer)
+{
+	writeTextFile(gShaderDir + "fail.frag", "#error broken\nvoid main() {}\n");
+
+	for (uint32_t attempt = 0; attempt < 2; ++attempt)
+	{
+		ShaderSet set;
+		initShaderSet(&set, "fail", 1, "fail.frag");
+		set.mDescs[1].mStages[4].mFileName = gShaderDir + "b.frag";
+
+		ShaderCacheStats start;
+		getShaderCacheStats(&start);
+		addShaders(pRenderer, (uint32_t)set.mDescs.size(), set.mDescs.data(), set.mShaders.data());
+		TEST_CHECK(set.mShaders[0] == NULL && set.mShaders[1] != NULL);
+		// The vertex and b.frag stages hit the second time, fail.frag compiles again
+		TEST_CHECK(getStatsSince(start).mHitCount == (attempt ? 3u : 0u));
+		removeShaderSet(pRenderer, &set);
+	}
+}
+
+int main(int argc, char** argv)
+{
+	LogManager logManager;
+
+	const char* pVulkanSdk = getenv("VULKAN_SDK");
+	TEST_CHECK_MSG(pVulkanSdk != NULL, "VULKAN_SDK has to point to the stub compiler");
+	if (!pVulkanSdk)
+		return finishTest("ShaderCompileTest");
+
+	Renderer* pRenderer = (Renderer*)conf_calloc(1, sizeof(Renderer));
+	GPUSettings settings = {};
+	pRenderer->pActiveGpuSettings = &settings;
+	pRenderer->pName = (char*)"ShaderCompileTest";
+
+	// Sources and the cache file of earlier runs
+	gShaderDir = FileSystem::GetProgramDir() + "/ShaderCompileTest/Shaders/";
+	FileSystem::CreateDir(gShaderDir);
+	writeTextFile(gShaderDir + "common.h", "vec4 common() { return vec4(1.0); }\n");
+	writeTextFile(gShaderDir + "a.vert", "#include \"common.h\"\nvoid main() { gl_Position = common(); }\n");
+	writeTextFile(gShaderDir + "b.frag", "void main() { discard; }\n");
+	FileSystem::Delete(FileSystem::GetProgramDir() + "/ShaderCompileTest/PCVulkan/CompiledShadersBinary/ShaderCache.bin");
+
+	initResourceLoaderInterface(pRenderer);
+	testColdAndWarmLoad(pRenderer);
+	testIncludeChange(pRenderer);
+	testParallelCompile(pRenderer);
+	testFailedStage(pRenderer);
+	removeResourceLoaderInterface(pRenderer);
+
+	conf_free(pRenderer);
+	return finishTest("ShaderCompileTest");
+}
@@ -0,0 +1,170 @@
+/*
+ * Copyright (c) 2018 Confetti Interactive Inc.
+ *
+ * This file is part of The-Forge
+ * (see https://github.com/ConfettiFX/The-Forge).
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+*/
+
+// Bookkeeping of the resource loader staging ring, no renderer involved.
+
+#include <stdlib.h>
+
+#include "../../../../Common_3/ThirdParty/OpenSource/TinySTL/vector.h"
+#include "../../../../Common_3/Renderer/StagingRing.h"
+#include "../../../../Common_3/OS/Interfaces/IMemoryManager.h"
+
+#include "TestFramework.h"
+
+struct LiveAllocation
+{
+	uint64_t mOffset;
+	uint64_t mSize;
+	uint64_t mToken;
+};
+
+static void testAllocateAndRelease()
+{
+	StagingRing ring;
+	uint64_t offset = 0;
+
+	// Alignment and skipping the end of a page
+	initStagingRing(&ring, 1024, 4);
+	TEST_CHECK(getStagingRingSize(&ring) == 4096);
+	TEST_CHECK(stagingRingAllocate(&ring, 100, 0, 1, &offset) && offset == 0);
+	TEST_CHECK(stagingRingAllocate(&ring, 100, 64, 1, &offset) && offset == 128);
+	TEST_CHECK(ring.mWastedBytes == 28);
+	TEST_CHECK(stagingRingAllocate(&ring, 900, 16, 1, &offset) && offset == 1024);
+	TEST_CHECK(ring.mWastedBytes == 28 + (1024 - 228));
+	TEST_CHECK(isStagingRingTokenPending(&ring, 1) && !isStagingRingTokenPending(&ring, 2));
+
+	// A full ring refuses without side effects
+	TEST_CHECK(stagingRingAllocate(&ring, 1024, 0, 2, &offset) && offset == 2048);
+	TEST_CHECK(stagingRingAllocate(&ring, 1024, 0, 3, &offset) && offset == 3072);
+	uint64_t head = ring.mHead;
+	uint64_t wasted = ring.mWastedBytes;
+	TEST_CHECK(!stagingRingAllocate(&ring, 16, 0, 4, &offset));
+	TEST_CHECK(ring.mHead == head && ring.mWastedBytes == wasted && !isStagingRingTokenPending(&ring, 4));
+	TEST_CHECK(ring.mHighWaterMark == 4096);
+
+	// Release frees in token order, the padding after token 1 is held until the next release
+	stagingRingRelease(&ring, 1);
+	TEST_CHECK(getStagingRingUsage(&ring) == 4096 - 1924);
+	TEST_CHECK(stagingRingAllocate(&ring, 1000, 0, 4, &offset) && offset == 0);
+	TEST_CHECK(!stagingRingAllocate(&ring, 1000, 0, 4, &offset));
+	stagingRingRelease(&ring, 3);
+	TEST_CHECK(getStagingRingUsage(&ring) == 1000);
+	TEST_CHECK(stagingRingAllocate(&ring, 1000, 0, 4, &offset) && offset == 1024);
+	stagingRingRelease(&ring, 4);
+	TEST_CHECK(getStagingRingUsage(&ring) == 0 && ring.mMarkerCount == 0);
+
+	// An empty ring always fits a page sized request, even with a single page
+	initStagingRing(&ring, 1024, 1);
+	TEST_CHECK(stagingRingAllocate(&ring, 10, 0, 1, &offset) && offset == 0);
+	stagingRingRelease(&ring, 1);
+	TEST_CHECK(stagingRingAllocate(&ring, 1024, 0, 2, &offset) && offset == 0);
+	TEST_CHECK(!stagingRingAllocate(&ring, 1, 0, 3, &offset));
+}
+
+static void testMarkerLimit()
+{
+	StagingRing ring;
+	uint64_t offset = 0;
+	initStagingRing(&ring, 1024, 4);
+
+	for (uint64_t token = 1; token <= STAGING_RING_MAX_PENDING_TOKENS; ++token)
+		TEST_CHECK(stagingRingAllocate(&ring, 8, 0, token, &offset));
+	TEST_CHECK(ring.mMarkerCount == STAGING_RING_MAX_PENDING_TOKENS);
+
+	// More tokens than markers have to wait even though there is memory left, the last token can keep allocating
+	TEST_CHECK(!stagingRingAllocate(&ring, 8, 0, STAGING_RING_MAX_PENDING_TOKENS + 1, &offset));
+	TEST_CHECK(stagingRingAllocate(&ring, 8, 0, STAGING_RING_MAX_PENDING_TOKENS, &offset));
+	stagingRingRelease(&ring, 1);
+	TEST_CHECK(stagingRingAllocate(&ring, 8, 0, STAGING_RING_MAX_PENDING_TOKENS + 1, &offset));
+}
+
+// Live allocations never overlap and never cross a page
+static void testRandomized()
+{
+	const uint64_t pageSize = 4096;
+	StagingRing ring;
+	initStagingRing(&ring, pageSize, 3);
+
+	tinystl::vector<LiveAllocation> live;
+	tinystl::vector<LiveAllocation> kept;
+	uint64_t token = 1;
+	uint64_t completed = 0;
+	uint32_t allocationCount = 0;
+	srand(7);
+
+	for (uint32_t i = 0; i < 200000 && !gTestFailures; ++i)
+	{
+		if (rand() % 5 == 0)
+			++token;
+
+		if (rand() % 4 == 0 && completed + 1 < token)
+		{
+			completed += 1 + rand() % (token - completed - 1);
+			stagingRingRelease(&ring, completed);
+
+			kept.clear();
+			for (uint32_t j = 0; j < (uint32_t)live.size(); ++j)
+			{
+				if (live[j].mToken > completed)
+					kept.push_back(live[j]);
+			}
+			live.swap(kept);
+		}
+
+		uint64_t size = 1 + rand() % pageSize;
+		uint64_t alignment = (uint64_t)1 << (rand() % 10);
+		uint64_t offset = 0;
+		if (stagingRingAllocate(&ring, size, alignment, token, &offset))
+		{
+			++allocationCount;
+			TEST_CHECK(offset % alignment == 0);
+			TEST_CHECK(offset / pageSize == (offset + size - 1) / pageSize);
+			for (uint32_t j = 0; j < (uint32_t)live.size(); ++j)
+				TEST_CHECK_MSG(offset >= live[j].mOffset + live[j].mSize || live[j].mOffset >= offset + size,
+					"[%llu, %llu) overlaps [%llu, %llu)", (unsigned long long)offset, (unsigned long long)(offset + size),
+					(unsigned long long)live[j].mOffset, (unsigned long long)(live[j].mOffset + live[j].mSize));
+
+			LiveAllocation allocation = { offset, size, token };
+			live.push_back(allocation);
+		}
+		else
+		{
+			// Only refuse while something is still held
+			TEST_CHECK(!live.empty());
+		}
+	}
+
+	TEST_CHECK(allocationCount > 50000);
+	TEST_CHECK(ring.mHighWaterMark <= getStagingRingSize(&ring));
+	printf("%u random allocations, high water %llu of %llu bytes, wasted %llu bytes\n", allocationCount,
+		(unsigned long long)ring.mHighWaterMark, (unsigned long long)getStagingRingSize(&ring), (unsigned long long)ring.mWastedBytes);
+}
+
+int main(int argc, char** argv)
+{
+	testAllocateAndRelease();
+	testMarkerLimit();
+	testRandomized();
+	return finishTest("StagingRingTest");
+}
@@ -0,0 +1,128 @@
+/*
+ * Copyright (c) 2018 Confetti Interactive Inc.
+ *
+ * This file is part of The-Forge
+ * (see https://github.com/ConfettiFX/The-Forge).
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+*/
+
+// Stand-in for glslangValidator, built as bin/glslangValidator of the directory ShaderCompileTest uses as VULKAN_SDK.
+// Takes the command line of compileShader, waits like a real compile and writes "SPIRV(<source> <defines>)" as the
+// byte code. Sources containing #error fail to compile.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+// Milliseconds a compile takes
+#define STUB_COMPILE_TIME 20
+
+// Copies the argument following the first pOption in pCommandLine, with or without quotes, and returns the rest of the
+// command line. The POSIX SystemRun passes the whole command line as a single argument with its quotes, on Windows
+// the quotes are removed by the argument parsing.
+static const char* getOptionValue(const char* pCommandLine, const char* pOption, char* pValue, size_t valueSize)
+{
+	const char* pStart = strstr(pCommandLine, pOption);
+	if (!pStart)
+		return NULL;
+
+	pStart += strlen(pOption);
+	while (*pStart == ' ')
+		++pStart;
+	// Unquoted values of a quoted argument like "-DNAME=VALUE" end at the closing quote
+	const bool quoted = *pStart == '"';
+	if (quoted)
+		++pStart;
+
+	size_t length = 0;
+	while (pStart[length] && pStart[length] != '"' && (quoted || pStart[length] != ' ') && length + 1 < valueSize)
+	{
+		pValue[length] = pStart[length];
+		++length;
+	}
+	pValue[length] = '\0';
+	return pStart + length;
+}
+
+int main(int argc, char** argv)
+{
+	char commandLine[8192] = "";
+	for (int i = 1; i < argc; ++i)
+	{
+		strncat(commandLine, argv[i], sizeof(commandLine) - strlen(commandLine) - 2);
+		strcat(commandLine, " ");
+	}
+
+	// Options are searched after the value of the previous one, so file names can't be mistaken for options
+	char sourceName[1024];
+	char outputName[1024];
+	const char* pRest = getOptionValue(commandLine, "-V", sourceName, sizeof(sourceName));
+	pRest = pRest ? getOptionValue(pRest, "-o", outputName, sizeof(outputName)) : NULL;
+	if (!pRest)
+	{
+		printf("usage: glslangValidator -V <source> -o <output> [-D<name>=<value>]...\n");
+		return 2;
+	}
+
+	// Defines in the order they were passed
+	char defines[4096] = "";
+	char define[256];
+	while ((pRest = getOptionValue(pRest, "-D", define, sizeof(define))) != NULL)
+	{
+		strncat(defines, " ", sizeof(defines) - strlen(defines) - 1);
+		strncat(defines, define, sizeof(defines) - strlen(defines) - 1);
+	}
+
+#ifdef _WIN32
+	Sleep(STUB_COMPILE_TIME);
+#else
+	usleep(STUB_COMPILE_TIME * 1000);
+#endif
+
+	FILE* pSource = fopen(sourceName, "rb");
+	if (!pSource)
+	{
+		printf("ERROR: cannot open %s\n", sourceName);
+		return 1;
+	}
+	char source[4096] = "";
+	size_t sourceSize = fread(source, 1, sizeof(source) - 1, pSource);
+	source[sourceSize] = '\0';
+	fclose(pSource);
+	if (strstr(source, "#error"))
+	{
+		printf("ERROR: %s: #error\n", sourceName);
+		return 1;
+	}
+
+	FILE* pOutput = fopen(outputName, "wb");
+	if (!pOutput)
+	{
+		printf("ERROR: cannot write %s\n", outputName);
+		return 1;
+	}
+	fprintf(pOutput, "SPIRV(%s%s)", sourceName, defines);
+	fclose(pOutput);
+	return 0;
+}
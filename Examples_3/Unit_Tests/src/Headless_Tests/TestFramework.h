@@ -0,0 +1,45 @@
+/*
+ * Copyright (c) 2018 Confetti Interactive Inc.
+ *
+ * This file is part of The-Forge
+ * (see https://github.com/ConfettiFX/The-Forge).
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+*/
+
+#pragma once
+
+// Minimal checks for the headless tests. Every test is its own executable which runs without a window or GPU
+// and returns a non zero exit code when a check failed, so ctest can run them.
+
+#include <stdio.h>
+#include <stdint.h>
+
+static int gTestFailures = 0;
+
+#define TEST_CHECK(x) \
+	do { if (!(x)) { printf("%s(%d): check failed: %s\n", __FILE__, __LINE__, #x); ++gTestFailures; } } while (0)
+
+#define TEST_CHECK_MSG(x, ...) \
+	do { if (!(x)) { printf("%s(%d): check failed: %s: ", __FILE__, __LINE__, #x); printf(__VA_ARGS__); printf("\n"); ++gTestFailures; } } while (0)
+
+static inline int finishTest(const char* pName)
+{
+	printf("%s: %s\n", pName, gTestFailures ? "FAILED" : "passed");
+	return gTestFailures != 0 ? 1 : 0;
+}
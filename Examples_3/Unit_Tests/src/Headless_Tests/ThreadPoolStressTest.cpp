@@ -0,0 +1,255 @@
+/*
+ * Copyright (c) 2018 Confetti Interactive Inc.
+ *
+ * This file is part of The-Forge
+ * (see https://github.com/ConfettiFX/The-Forge).
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+*/
+
+// Rounds of random work on a ThreadPool: items added by the main thread, by threads without a queue of their own
+// and by running items, with random priorities, more items than a queue holds, and cancellations racing the workers.
+// Checks that every item runs exactly once, that a cancelled item never runs and that Complete() waits for all of them.
+
+#include <stdlib.h>
+
+#include "../../../../Common_3/ThirdParty/OpenSource/TinySTL/vector.h"
+#include "../../../../Common_3/OS/Interfaces/IThread.h"
+#include "../../../../Common_3/OS/Interfaces/ITimeManager.h"
+#include "../../../../Common_3/OS/Interfaces/ILogManager.h"
+#include "../../../../Common_3/OS/Interfaces/IMemoryManager.h"
+
+#include "TestFramework.h"
+
+#define WORKER_COUNT 6
+#define PRODUCER_COUNT 3
+#define ROUND_COUNT 200
+
+typedef struct StressItem
+{
+	WorkItem mItem;
+	/// Item added by this one once it runs, NULL for none
+	struct StressItem* pChild;
+	struct StressRound* pRound;
+	tfrg_atomic32_t mRunCount;
+	bool mCancelled;
+} StressItem;
+
+typedef struct StressRound
+{
+	ThreadPool* pPool;
+	tinystl::vector<StressItem> mItems;
+	/// Ranges of mItems added by each producer thread
+	uint32_t mProducerBegin[PRODUCER_COUNT + 1];
+	/// Children which ran before their parent added them
+	tfrg_atomic32_t mEarlyChildCount;
+} StressRound;
+
+static uint32_t nextRandom(uint32_t* pSeed)
+{
+	uint32_t x = *pSeed;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	*pSeed = x;
+	return x;
+}
+
+static void runStressItem(void* pData)
+{
+	StressItem* pItem = (StressItem*)pData;
+	tfrg_atomic32_add(&pItem->mRunCount, 1);
+	// A little work so the workers overlap
+	volatile uint32_t sum = 0;
+	for (uint32_t i = 0; i < (uint32_t)(((uintptr_t)pItem >> 4) & 255); ++i)
+		sum = sum + i;
+
+	if (pItem->pChild)
+	{
+		if (tfrg_atomic32_load_relaxed(&pItem->pChild->mRunCount))
+			tfrg_atomic32_add(&pItem->pRound->mEarlyChildCount, 1);
+		pItem->pRound->pPool->AddWorkItem(&pItem->pChild->mItem);
+	}
+}
+
+typedef struct ProducerDesc
+{
+	StressRound* pRound;
+	uint32_t mIndex;
+} ProducerDesc;
+
+// Threads without a queue of their own go through the shared queue
+static void produceItems(void* pData)
+{
+	ProducerDesc* pDesc = (ProducerDesc*)pData;
+	StressRound* pRound = pDesc->pRound;
+	for (uint32_t i = pRound->mProducerBegin[pDesc->mIndex]; i < pRound->mProducerBegin[pDesc->mIndex + 1]; ++i)
+		pRound->pPool->AddWorkItem(&pRound->mItems[i].mItem);
+}
+
+static void initStressItem(StressRound* pRound, StressItem* pItem, uint32_t* pSeed)
+{
+	pItem->mItem.pFunc = runStressItem;
+	pItem->mItem.pData = pItem;
+	pItem->mItem.mPriority = nextRandom(pSeed) % 4;
+	pItem->pChild = NULL;
+	pItem->pRound = pRound;
+	pItem->mRunCount = 0;
+	pItem->mCancelled = false;
+}
+
+static void testStressRounds(ThreadPool* pPool)
+{
+	uint32_t seed = 1234;
+	uint64_t itemCount = 0;
+	uint32_t cancelledCount = 0;
+	uint32_t wrongRunCount = 0;
+	StressRound round;
+	round.pPool = pPool;
+
+	HiresTimer timer;
+	for (uint32_t r = 0; r < ROUND_COUNT; ++r)
+	{
+		// Every tenth round overflows the queue of the main thread into the shared queue
+		const uint32_t mainCount = r % 10 == 9 ? WORK_STEALING_QUEUE_SIZE + 512 : 64 + nextRandom(&seed) % 512;
+		const uint32_t producerCount = 64 + nextRandom(&seed) % 256;
+		const uint32_t childCount = 64 + nextRandom(&seed) % 256;
+		const uint32_t addedCount = mainCount + PRODUCER_COUNT * producerCount;
+		// Resizing moves the items, so it happens while none of them is queued
+		round.mItems.resize(addedCount + childCount);
+		round.mEarlyChildCount = 0;
+		for (uint32_t i = 0; i < (uint32_t)round.mItems.size(); ++i)
+			initStressItem(&round, &round.mItems[i], &seed);
+		// Children are added by the items they hang off, which may be children themselves
+		for (uint32_t i = 0; i < childCount; ++i)
+		{
+			const uint32_t parent = nextRandom(&seed) % (addedCount + i);
+			StressItem* pParent = &round.mItems[parent];
+			while (pParent->pChild)
+				pParent = pParent->pChild;
+			pParent->pChild = &round.mItems[addedCount + i];
+		}
+		for (uint32_t i = 0; i <= PRODUCER_COUNT; ++i)
+			round.mProducerBegin[i] = mainCount + i * producerCount;
+
+		ProducerDesc producers[PRODUCER_COUNT];
+		Thread* pThreads[PRODUCER_COUNT];
+		for (uint32_t i = 0; i < PRODUCER_COUNT; ++i)
+		{
+			producers[i].pRound = &round;
+			producers[i].mIndex = i;
+			pThreads[i] = conf_placement_new<Thread>(conf_calloc(1, sizeof(Thread)), produceItems, &producers[i]);
+		}
+
+		for (uint32_t i = 0; i < mainCount; ++i)
+		{
+			pPool->AddWorkItem(&round.mItems[i].mItem);
+			// Cancel an earlier item now and then, it may have run already
+			if (i && nextRandom(&seed) % 16 == 0)
+			{
+				StressItem* pItem = &round.mItems[nextRandom(&seed) % i];
+				// Items with a child are kept, their child would never be added
+				WorkItem* pWorkItem = &pItem->mItem;
+				if (!pItem->pChild && !pItem->mCancelled && pPool->RemoveWorkItem(pWorkItem))
+				{
+					pItem->mCancelled = true;
+					++cancelledCount;
+				}
+			}
+		}
+
+		for (uint32_t i = 0; i < PRODUCER_COUNT; ++i)
+		{
+			pThreads[i]->~Thread();
+			conf_free(pThreads[i]);
+		}
+		pPool->Complete(0);
+		TEST_CHECK(pPool->IsCompleted(0));
+
+		for (uint32_t i = 0; i < (uint32_t)round.mItems.size(); ++i)
+		{
+			const StressItem* pItem = &round.mItems[i];
+			const uint32_t expected = pItem->mCancelled ? 0 : 1;
+			if (tfrg_atomic32_load_relaxed(&pItem->mRunCount) != expected || (expected && !pItem->mItem.mCompleted))
+				++wrongRunCount;
+			if (tfrg_atomic32_load_relaxed(&pItem->mItem.mState) != WORK_ITEM_STATE_IDLE)
+				++wrongRunCount;
+		}
+		TEST_CHECK(tfrg_atomic32_load_relaxed(&round.mEarlyChildCount) == 0);
+		itemCount += round.mItems.size();
+	}
+
+	TEST_CHECK_MSG(wrongRunCount == 0, "%u items ran a wrong number of times or were left queued", wrongRunCount);
+	printf("%u rounds with %u workers and %u producer threads: %llu items, %u cancelled, %.2f ms\n", ROUND_COUNT, WORKER_COUNT,
+		PRODUCER_COUNT, (unsigned long long)itemCount, cancelledCount, timer.GetUSec(false) / 1000.0f);
+}
+
+typedef struct CounterDesc
+{
+	tfrg_atomic32_t mRunCount;
+} CounterDesc;
+
+static void countRun(void* pData)
+{
+	tfrg_atomic32_add(&((CounterDesc*)pData)->mRunCount, 1);
+}
+
+// Counters shared by items of different priorities, waited on while other items are still queued
+static void testCounters(ThreadPool* pPool)
+{
+	const uint32_t itemCount = 2000;
+	tinystl::vector<WorkItem> items(itemCount);
+	JobCounter counters[4] = {};
+	CounterDesc desc = {};
+	uint32_t seed = 99;
+	for (uint32_t round = 0; round < 50; ++round)
+	{
+		for (uint32_t i = 0; i < itemCount; ++i)
+		{
+			JobCounter* pCounter = &counters[nextRandom(&seed) % 4];
+			items[i].pFunc = countRun;
+			items[i].pData = &desc;
+			items[i].mPriority = i % 3;
+			items[i].pCounter = pCounter;
+			tfrg_atomic32_add(&pCounter->mValue, 1);
+			pPool->AddWorkItem(&items[i]);
+		}
+		for (uint32_t i = 0; i < 4; ++i)
+		{
+			pPool->WaitForCounter(&counters[i]);
+			TEST_CHECK(isJobCounterDone(&counters[i]));
+		}
+		pPool->Complete(0);
+	}
+	TEST_CHECK(tfrg_atomic32_load_relaxed(&desc.mRunCount) == 50 * itemCount);
+}
+
+int main(int argc, char** argv)
+{
+	LogManager logManager;
+
+	ThreadPool* pPool = conf_placement_new<ThreadPool>(conf_calloc(1, sizeof(ThreadPool)));
+	pPool->CreateThreads(WORKER_COUNT);
+
+	testStressRounds(pPool);
+	testCounters(pPool);
+
+	pPool->~ThreadPool();
+	conf_free(pPool);
+	return finishTest("ThreadPoolStressTest");
+}
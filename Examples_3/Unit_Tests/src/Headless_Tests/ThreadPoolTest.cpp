@@ -0,0 +1,320 @@
+/*
+ * Copyright (c) 2018 Confetti Interactive Inc.
+ *
+ * This file is part of The-Forge
+ * (see https://github.com/ConfettiFX/The-Forge).
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+*/
+
+// Compares the work stealing ThreadPool with the mutex queue it replaced: jobs per second for batches of small jobs
+// and the latency from adding an item to an idle pool until a worker starts it. Checks that both pools run every job.
+
+#include <stdlib.h>
+
+#include "../../../../Common_3/ThirdParty/OpenSource/TinySTL/vector.h"
+#include "../../../../Common_3/OS/Interfaces/IThread.h"
+#include "../../../../Common_3/OS/Interfaces/ITimeManager.h"
+#include "../../../../Common_3/OS/Interfaces/ILogManager.h"
+#include "../../../../Common_3/OS/Interfaces/IMemoryManager.h"
+
+#include "TestFramework.h"
+
+#define WORKER_COUNT 4
+
+// The ThreadPool before the work stealing queues, for one priority. One mutex guards a vector the items are inserted
+// at the front of, workers poll it with Sleep(0). Complete() takes items on the caller, spins until every item has
+// completed and then holds the mutex to pause the workers until the next item is added.
+class MutexQueuePool
+{
+public:
+	MutexQueuePool(uint32_t threadCount) : mShutDown(false), mPausing(false), mPaused(false)
+	{
+		Pause();
+		for (uint32_t i = 0; i < threadCount; ++i)
+			mThreads.push_back(conf_placement_new<Thread>(conf_calloc(1, sizeof(Thread)), ProcessItems, this));
+	}
+
+	~MutexQueuePool()
+	{
+		mShutDown = true;
+		Resume();
+		for (uint32_t i = 0; i < (uint32_t)mThreads.size(); ++i)
+		{
+			mThreads[i]->~Thread();
+			conf_free(mThreads[i]);
+		}
+	}
+
+	void AddWorkItem(WorkItem* pItem)
+	{
+		mWorkItems.push_back(pItem);
+		pItem->mCompleted = false;
+		if (!mPaused)
+			mQueueMutex.Acquire();
+		mWorkQueue.insert(mWorkQueue.begin(), pItem);
+		mQueueMutex.Release();
+		mPaused = false;
+	}
+
+	void Complete()
+	{
+		Resume();
+		while (!mWorkQueue.empty())
+		{
+			mQueueMutex.Acquire();
+			if (!mWorkQueue.empty())
+			{
+				WorkItem* pItem = mWorkQueue.front();
+				mWorkQueue.erase(mWorkQueue.begin());
+				mQueueMutex.Release();
+				pItem->pFunc(pItem->pData);
+				pItem->mCompleted = true;
+			}
+			else
+			{
+				mQueueMutex.Release();
+				break;
+			}
+		}
+
+		while (!IsCompleted())
+		{
+		}
+
+		if (mWorkQueue.empty())
+			Pause();
+		mWorkItems.clear();
+	}
+
+private:
+	bool IsCompleted() const
+	{
+		for (uint32_t i = 0; i < (uint32_t)mWorkItems.size(); ++i)
+		{
+			if (!mWorkItems[i]->mCompleted)
+				return false;
+		}
+		return true;
+	}
+
+	void Pause()
+	{
+		if (!mPaused)
+		{
+			mPausing = true;
+			mQueueMutex.Acquire();
+			mPaused = true;
+			mPausing = false;
+		}
+	}
+
+	void Resume()
+	{
+		if (mPaused)
+		{
+			mQueueMutex.Release();
+			mPaused = false;
+		}
+	}
+
+	static void ProcessItems(void* pData)
+	{
+		MutexQueuePool* pPool = (MutexQueuePool*)pData;
+		bool wasActive = false;
+		for (;;)
+		{
+			if (pPool->mShutDown)
+				return;
+
+			if (pPool->mPausing && !wasActive)
+			{
+				Thread::Sleep(0);
+				continue;
+			}
+
+			pPool->mQueueMutex.Acquire();
+			if (!pPool->mWorkQueue.empty())
+			{
+				wasActive = true;
+				WorkItem* pItem = pPool->mWorkQueue.front();
+				pPool->mWorkQueue.erase(pPool->mWorkQueue.begin());
+				pPool->mQueueMutex.Release();
+				pItem->pFunc(pItem->pData);
+				pItem->mCompleted = true;
+			}
+			else
+			{
+				wasActive = false;
+				pPool->mQueueMutex.Release();
+				Thread::Sleep(0);
+			}
+		}
+	}
+
+	tinystl::vector<Thread*> mThreads;
+	tinystl::vector<WorkItem*> mWorkItems;
+	tinystl::vector<WorkItem*> mWorkQueue;
+	Mutex mQueueMutex;
+	volatile bool mShutDown;
+	volatile bool mPausing;
+	volatile bool mPaused;
+};
+
+typedef struct JobDesc
+{
+	tfrg_atomic32_t mRunCount;
+	uint32_t mWorkSize;
+} JobDesc;
+
+static void runJob(void* pData)
+{
+	JobDesc* pDesc = (JobDesc*)pData;
+	volatile uint32_t sum = 0;
+	for (uint32_t i = 0; i < pDesc->mWorkSize; ++i)
+		sum = sum + i;
+	tfrg_atomic32_add(&pDesc->mRunCount, 1);
+}
+
+// Adds batchCount batches of jobCount jobs and completes each, returns jobs per second
+template <typename Pool>
+static float runBatches(Pool* pPool, uint32_t batchCount, uint32_t jobCount, uint32_t workSize)
+{
+	tinystl::vector<WorkItem> items(jobCount);
+	JobDesc desc = { 0, workSize };
+	HiresTimer timer;
+	for (uint32_t batch = 0; batch < batchCount; ++batch)
+	{
+		for (uint32_t i = 0; i < jobCount; ++i)
+		{
+			items[i].pFunc = runJob;
+			items[i].pData = &desc;
+			pPool->AddWorkItem(&items[i]);
+		}
+		pPool->Complete(0);
+	}
+	const float seconds = timer.GetUSec(false) / 1e6f;
+	TEST_CHECK(tfrg_atomic32_load_relaxed(&desc.mRunCount) == batchCount * jobCount);
+	return batchCount * jobCount / seconds;
+}
+
+// Lets MutexQueuePool take the same calls as ThreadPool
+class MutexQueuePoolAdapter
+{
+public:
+	MutexQueuePoolAdapter(MutexQueuePool* pPool) : pPool(pPool) {}
+	void AddWorkItem(WorkItem* pItem) { pPool->AddWorkItem(pItem); }
+	void Complete(unsigned) { pPool->Complete(); }
+	MutexQueuePool* pPool;
+};
+
+typedef struct WakeDesc
+{
+	HiresTimer* pTimer;
+	int64_t mStartTime;
+	tfrg_atomic32_t mStarted;
+} WakeDesc;
+
+static void recordStart(void* pData)
+{
+	WakeDesc* pDesc = (WakeDesc*)pData;
+	pDesc->mStartTime = pDesc->pTimer->GetUSec(false);
+	tfrg_atomic32_store_release(&pDesc->mStarted, 1);
+}
+
+static int compareFloats(const void* pA, const void* pB)
+{
+	const float a = *(const float*)pA;
+	const float b = *(const float*)pB;
+	return a < b ? -1 : (a > b ? 1 : 0);
+}
+
+// Microseconds from adding an item to a pool which was idle for a while until a worker starts it, the median of the rounds.
+// The caller only yields while it waits, so the item is not run by Complete() on the caller.
+template <typename Pool>
+static float measureWakeLatency(Pool* pPool, uint32_t roundCount, float* pMaxLatency)
+{
+	float latencies[64];
+	HiresTimer timer;
+	WorkItem item;
+	WakeDesc desc;
+	desc.pTimer = &timer;
+	for (uint32_t round = 0; round < roundCount; ++round)
+	{
+		// Long enough for the workers to park
+		Thread::Sleep(5);
+		desc.mStarted = 0;
+		item.pFunc = recordStart;
+		item.pData = &desc;
+		const int64_t addTime = timer.GetUSec(false);
+		pPool->AddWorkItem(&item);
+		while (!tfrg_atomic32_load_acquire(&desc.mStarted))
+			Thread::Sleep(0);
+		latencies[round] = (float)(desc.mStartTime - addTime);
+		pPool->Complete(0);
+	}
+
+	qsort(latencies, roundCount, sizeof(float), compareFloats);
+	*pMaxLatency = latencies[roundCount - 1];
+	return latencies[roundCount / 2];
+}
+
+static void timePools()
+{
+	ThreadPool* pPool = conf_placement_new<ThreadPool>(conf_calloc(1, sizeof(ThreadPool)));
+	pPool->CreateThreads(WORKER_COUNT);
+	MutexQueuePool* pMutexPool = conf_placement_new<MutexQueuePool>(conf_calloc(1, sizeof(MutexQueuePool)), WORKER_COUNT);
+	MutexQueuePoolAdapter mutexPool(pMutexPool);
+
+	// With fewer cores than workers, waking the workers costs context switches while the mutex queue runs most jobs on the caller
+	printf("%u cores\n", Thread::GetNumCPUCores());
+	const uint32_t workSizes[] = { 0, 1000 };
+	for (uint32_t w = 0; w < sizeof(workSizes) / sizeof(workSizes[0]); ++w)
+	{
+		float best[2] = {};
+		for (uint32_t run = 0; run < 3; ++run)
+		{
+			const float stealing = runBatches(pPool, 200, 1024, workSizes[w]);
+			const float mutex = runBatches(&mutexPool, 200, 1024, workSizes[w]);
+			best[0] = stealing > best[0] ? stealing : best[0];
+			best[1] = mutex > best[1] ? mutex : best[1];
+		}
+		printf("%u workers, jobs of %u iterations: %.0f jobs/s work stealing, %.0f jobs/s mutex queue (%.2fx)\n", WORKER_COUNT,
+			workSizes[w], best[0], best[1], best[0] / best[1]);
+	}
+
+	float maxLatencies[2];
+	const float stealingLatency = measureWakeLatency(pPool, 64, &maxLatencies[0]);
+	const float mutexLatency = measureWakeLatency(&mutexPool, 64, &maxLatencies[1]);
+	printf("Park to wake latency: %.0f us median, %.0f us max work stealing, %.0f us median, %.0f us max mutex queue\n",
+		stealingLatency, maxLatencies[0], mutexLatency, maxLatencies[1]);
+
+	pMutexPool->~MutexQueuePool();
+	conf_free(pMutexPool);
+	pPool->~ThreadPool();
+	conf_free(pPool);
+}
+
+int main(int argc, char** argv)
+{
+	LogManager logManager;
+
+	timePools();
+
+	return finishTest("ThreadPoolTest");
+}
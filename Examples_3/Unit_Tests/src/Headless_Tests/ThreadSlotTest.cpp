@@ -0,0 +1,335 @@
+/*
+ * Copyright (c) 2018 Confetti Interactive Inc.
+ *
+ * This file is part of The-Forge
+ * (see https://github.com/ConfettiFX/The-Forge).
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+*/
+
+// Thread slots with the per thread descriptor manager lookup of the renderers, where the managers only record who
+// uses them. Checks that no manager is used by two threads at once while short lived threads release and reuse slots,
+// that pool workers only take a slot once they bind, and that threads without a slot still bind when every slot is taken.
+
+#include "../../../../Common_3/OS/Interfaces/IThread.h"
+#include "../../../../Common_3/OS/Interfaces/ITimeManager.h"
+#include "../../../../Common_3/OS/Interfaces/ILogManager.h"
+#include "../../../../Common_3/OS/Interfaces/IMemoryManager.h"
+
+#include "TestFramework.h"
+
+#define ROOT_SIGNATURE_COUNT 8
+
+typedef struct DescriptorManager
+{
+	/// Thread binding with the manager, 0 if none
+	tfrg_atomic64_t mUser;
+	uint64_t mBindCount;
+} DescriptorManager;
+
+typedef struct RootSignature
+{
+	DescriptorManager* pDescriptorManagers[MAX_THREAD_SLOTS + 1];
+} RootSignature;
+
+static RootSignature gRootSignatures[ROOT_SIGNATURE_COUNT];
+static tfrg_atomic32_t gManagerCount = 0;
+static tfrg_atomic32_t gConcurrentUseCount = 0;
+
+// Same as in the renderers
+static Mutex gSharedDescriptorMutex;
+
+struct SharedDescriptorLock
+{
+	SharedDescriptorLock(uint32_t slot) : mShared(slot >= MAX_THREAD_SLOTS) { if (mShared) gSharedDescriptorMutex.Acquire(); }
+	~SharedDescriptorLock() { if (mShared) gSharedDescriptorMutex.Release(); }
+	bool mShared;
+};
+
+static DescriptorManager* get_descriptor_manager(RootSignature* pRootSignature, uint32_t slot)
+{
+	DescriptorManager* pManager = pRootSignature->pDescriptorManagers[slot];
+	if (!pManager)
+	{
+		pManager = (DescriptorManager*)conf_calloc(1, sizeof(DescriptorManager));
+		tfrg_atomic32_add(&gManagerCount, 1);
+		pRootSignature->pDescriptorManagers[slot] = pManager;
+	}
+	return pManager;
+}
+
+static void bindDescriptors(RootSignature* pRootSignature, uint64_t user)
+{
+	const uint32_t slot = Thread::GetCurrentThreadSlot();
+	SharedDescriptorLock lock(slot);
+	DescriptorManager* pManager = get_descriptor_manager(pRootSignature, slot);
+
+	if (tfrg_atomic64_cas(&pManager->mUser, 0, user) != 0)
+		tfrg_atomic32_add(&gConcurrentUseCount, 1);
+	++pManager->mBindCount;
+	tfrg_atomic64_store_release(&pManager->mUser, 0);
+}
+
+typedef struct RecordDesc
+{
+	uint32_t mBindCount;
+	tfrg_atomic32_t mNextUser;
+} RecordDesc;
+
+static void recordCommands(void* pData)
+{
+	RecordDesc* pDesc = (RecordDesc*)pData;
+	const uint64_t user = tfrg_atomic32_add(&pDesc->mNextUser, 1) + 1;
+	for (uint32_t i = 0; i < pDesc->mBindCount; ++i)
+		bindDescriptors(&gRootSignatures[i % ROOT_SIGNATURE_COUNT], user);
+}
+
+// Waves of short lived recording threads, each wave reuses the slots the previous one released
+static void testShortLivedThreads()
+{
+	const uint32_t waveCount = 10;
+	const uint32_t threadCount = 48;
+	RecordDesc desc = { 20000, 0 };
+	Thread* pThreads[threadCount];
+	for (uint32_t wave = 0; wave < waveCount; ++wave)
+	{
+		for (uint32_t i = 0; i < threadCount; ++i)
+			pThreads[i] = conf_placement_new<Thread>(conf_calloc(1, sizeof(Thread)), recordCommands, &desc);
+		for (uint32_t i = 0; i < threadCount; ++i)
+		{
+			pThreads[i]->~Thread();
+			conf_free(pThreads[i]);
+		}
+	}
+
+	uint64_t bindCount = 0;
+	uint32_t managerCount = 0;
+	for (uint32_t i = 0; i < ROOT_SIGNATURE_COUNT; ++i)
+	{
+		for (uint32_t slot = 0; slot <= MAX_THREAD_SLOTS; ++slot)
+		{
+			if (gRootSignatures[i].pDescriptorManagers[slot])
+			{
+				bindCount += gRootSignatures[i].pDescriptorManagers[slot]->mBindCount;
+				++managerCount;
+			}
+		}
+	}
+
+	TEST_CHECK_MSG(tfrg_atomic32_load_relaxed(&gConcurrentUseCount) == 0, "%u binds found their manager in use by another thread",
+		tfrg_atomic32_load_relaxed(&gConcurrentUseCount));
+	TEST_CHECK(bindCount == (uint64_t)waveCount * threadCount * desc.mBindCount);
+	TEST_CHECK(managerCount == tfrg_atomic32_load_relaxed(&gManagerCount));
+	// Released slots are reused, so the managers don't grow with the number of threads
+	TEST_CHECK(managerCount <= ROOT_SIGNATURE_COUNT * MAX_THREAD_SLOTS);
+	TEST_CHECK(!gRootSignatures[0].pDescriptorManagers[MAX_THREAD_SLOTS]);
+	printf("%u waves of %u threads: %llu binds, %u descriptor managers\n", waveCount, threadCount, (unsigned long long)bindCount, managerCount);
+}
+
+typedef struct HoldDesc
+{
+	tfrg_atomic64_t mSeenSlots;
+	tfrg_atomic32_t mDuplicateCount;
+	tfrg_atomic32_t mInvalidCount;
+	/// Binds of the threads without a slot, which go through the shared descriptor managers
+	uint32_t mSharedBindCount;
+	tfrg_atomic32_t mArrivedCount;
+	tfrg_atomic32_t mRelease;
+} HoldDesc;
+
+// Takes a slot and keeps it until released
+static void holdSlot(void* pData)
+{
+	HoldDesc* pDesc = (HoldDesc*)pData;
+	const uint32_t slot = Thread::GetCurrentThreadSlot();
+	if (slot >= MAX_THREAD_SLOTS)
+	{
+		tfrg_atomic32_add(&pDesc->mInvalidCount, 1);
+		// Wait until every thread holds or failed to get its slot, so the threads without one bind at the same time
+		while (tfrg_atomic32_load_acquire(&pDesc->mArrivedCount) < MAX_THREAD_SLOTS - 1)
+			Thread::Sleep(1);
+		const uint64_t user = (uint64_t)Thread::GetCurrentThreadID() | (1ULL << 63);
+		for (uint32_t i = 0; i < pDesc->mSharedBindCount; ++i)
+			bindDescriptors(&gRootSignatures[i % ROOT_SIGNATURE_COUNT], user);
+	}
+	else
+	{
+		const uint64_t mask = 1ULL << slot;
+		uint64_t seen = tfrg_atomic64_load_relaxed(&pDesc->mSeenSlots);
+		for (;;)
+		{
+			if (seen & mask)
+			{
+				tfrg_atomic32_add(&pDesc->mDuplicateCount, 1);
+				break;
+			}
+			const uint64_t prev = tfrg_atomic64_cas(&pDesc->mSeenSlots, seen, seen | mask);
+			if (prev == seen)
+				break;
+			seen = prev;
+		}
+	}
+
+	tfrg_atomic32_add(&pDesc->mArrivedCount, 1);
+	while (!tfrg_atomic32_load_acquire(&pDesc->mRelease))
+		Thread::Sleep(1);
+}
+
+// More threads than slots at the same time. The main thread holds one slot, the others go to the first threads.
+// The threads left without a slot take turns on the shared descriptor managers instead of dropping their binds.
+static void testAllSlotsTaken()
+{
+	const uint32_t mainSlot = Thread::GetCurrentThreadSlot();
+	TEST_CHECK(mainSlot < MAX_THREAD_SLOTS);
+
+	const uint32_t extraCount = 6;
+	const uint32_t threadCount = MAX_THREAD_SLOTS + extraCount;
+	HoldDesc desc = {};
+	desc.mSeenSlots = 1ULL << mainSlot;
+	desc.mSharedBindCount = 20000;
+	uint64_t sharedBindCount = 0;
+	for (uint32_t i = 0; i < ROOT_SIGNATURE_COUNT; ++i)
+	{
+		if (gRootSignatures[i].pDescriptorManagers[MAX_THREAD_SLOTS])
+			sharedBindCount -= gRootSignatures[i].pDescriptorManagers[MAX_THREAD_SLOTS]->mBindCount;
+	}
+	Thread* pThreads[threadCount];
+	for (uint32_t i = 0; i < threadCount; ++i)
+		pThreads[i] = conf_placement_new<Thread>(conf_calloc(1, sizeof(Thread)), holdSlot, &desc);
+	while (tfrg_atomic32_load_acquire(&desc.mArrivedCount) < threadCount)
+		Thread::Sleep(1);
+
+	TEST_CHECK(tfrg_atomic32_load_relaxed(&desc.mDuplicateCount) == 0);
+	TEST_CHECK(tfrg_atomic32_load_relaxed(&desc.mInvalidCount) == extraCount + 1);
+	TEST_CHECK(tfrg_atomic64_load_relaxed(&desc.mSeenSlots) == ~0ULL);
+
+	tfrg_atomic32_store_release(&desc.mRelease, 1);
+	for (uint32_t i = 0; i < threadCount; ++i)
+	{
+		pThreads[i]->~Thread();
+		conf_free(pThreads[i]);
+	}
+	TEST_CHECK(Thread::GetCurrentThreadSlot() == mainSlot);
+
+	// Every bind of the threads without a slot arrived, none of them while another thread used the manager
+	for (uint32_t i = 0; i < ROOT_SIGNATURE_COUNT; ++i)
+	{
+		if (gRootSignatures[i].pDescriptorManagers[MAX_THREAD_SLOTS])
+			sharedBindCount += gRootSignatures[i].pDescriptorManagers[MAX_THREAD_SLOTS]->mBindCount;
+	}
+	TEST_CHECK_MSG(sharedBindCount == (uint64_t)(extraCount + 1) * desc.mSharedBindCount, "%llu shared binds", (unsigned long long)sharedBindCount);
+	TEST_CHECK(tfrg_atomic32_load_relaxed(&gConcurrentUseCount) == 0);
+
+	// The slots of the exited threads are free again
+	desc = {};
+	desc.mSeenSlots = 1ULL << mainSlot;
+	for (uint32_t i = 0; i < MAX_THREAD_SLOTS - 1; ++i)
+		pThreads[i] = conf_placement_new<Thread>(conf_calloc(1, sizeof(Thread)), holdSlot, &desc);
+	while (tfrg_atomic32_load_acquire(&desc.mArrivedCount) < MAX_THREAD_SLOTS - 1)
+		Thread::Sleep(1);
+	TEST_CHECK(tfrg_atomic32_load_relaxed(&desc.mInvalidCount) == 0);
+	TEST_CHECK(tfrg_atomic64_load_relaxed(&desc.mSeenSlots) == ~0ULL);
+	tfrg_atomic32_store_release(&desc.mRelease, 1);
+	for (uint32_t i = 0; i < MAX_THREAD_SLOTS - 1; ++i)
+	{
+		pThreads[i]->~Thread();
+		conf_free(pThreads[i]);
+	}
+}
+
+typedef struct PoolBindDesc
+{
+	tfrg_atomic32_t mBindCount;
+	tfrg_atomic32_t mSlotlessCount;
+} PoolBindDesc;
+
+static void bindOnWorker(void* pData)
+{
+	PoolBindDesc* pDesc = (PoolBindDesc*)pData;
+	if (Thread::GetCurrentThreadSlot() >= MAX_THREAD_SLOTS)
+		tfrg_atomic32_add(&pDesc->mSlotlessCount, 1);
+	for (uint32_t i = 0; i < 100; ++i)
+		bindDescriptors(&gRootSignatures[i % ROOT_SIGNATURE_COUNT], (uint64_t)Thread::GetCurrentThreadID() | (1ULL << 62));
+	tfrg_atomic32_add(&pDesc->mBindCount, 100);
+	// Keep the worker busy so the other items go to other workers
+	Thread::Sleep(1);
+}
+
+// A pool with more workers than slots. Workers only take a slot on their first bind, so a thread started after the
+// pool still gets one, and the binds of the workers without a slot go through the shared managers.
+static void testPoolWithMoreWorkersThanSlots()
+{
+	const uint32_t workerCount = MAX_THREAD_SLOTS + 8;
+	ThreadPool* pPool = conf_placement_new<ThreadPool>(conf_calloc(1, sizeof(ThreadPool)));
+	pPool->CreateThreads(workerCount);
+	Thread::Sleep(50);
+
+	HoldDesc desc = {};
+	Thread* pThread = conf_placement_new<Thread>(conf_calloc(1, sizeof(Thread)), holdSlot, &desc);
+	while (tfrg_atomic32_load_acquire(&desc.mArrivedCount) < 1)
+		Thread::Sleep(1);
+	TEST_CHECK_MSG(tfrg_atomic32_load_relaxed(&desc.mInvalidCount) == 0, "idle pool workers took every thread slot");
+	tfrg_atomic32_store_release(&desc.mRelease, 1);
+	pThread->~Thread();
+	conf_free(pThread);
+
+	const uint32_t itemCount = workerCount * 4;
+	PoolBindDesc bindDesc = {};
+	tinystl::vector<WorkItem> items(itemCount);
+	for (uint32_t i = 0; i < itemCount; ++i)
+	{
+		items[i].pFunc = bindOnWorker;
+		items[i].pData = &bindDesc;
+		pPool->AddWorkItem(&items[i]);
+	}
+	pPool->Complete(0);
+
+	TEST_CHECK(tfrg_atomic32_load_relaxed(&bindDesc.mBindCount) == itemCount * 100);
+	TEST_CHECK(tfrg_atomic32_load_relaxed(&gConcurrentUseCount) == 0);
+	printf("Pool of %u workers: %u of %u items ran without a thread slot\n", workerCount, tfrg_atomic32_load_relaxed(&bindDesc.mSlotlessCount), itemCount);
+
+	pPool->~ThreadPool();
+	conf_free(pPool);
+}
+
+// Cost of a bind on a thread which already has its managers
+static void timeLookup()
+{
+	const uint32_t bindCount = 10000000;
+	HiresTimer timer;
+	for (uint32_t i = 0; i < bindCount; ++i)
+		bindDescriptors(&gRootSignatures[i % ROOT_SIGNATURE_COUNT], 1);
+	printf("%u binds over %u root signatures: %.2f ns per bind\n", bindCount, ROOT_SIGNATURE_COUNT, timer.GetUSec(false) * 1000.0f / bindCount);
+}
+
+int main(int argc, char** argv)
+{
+	LogManager logManager;
+
+	testShortLivedThreads();
+	testAllSlotsTaken();
+	testPoolWithMoreWorkersThanSlots();
+	timeLookup();
+
+	for (uint32_t i = 0; i < ROOT_SIGNATURE_COUNT; ++i)
+	{
+		for (uint32_t slot = 0; slot <= MAX_THREAD_SLOTS; ++slot)
+			conf_free(gRootSignatures[i].pDescriptorManagers[slot]);
+	}
+	return finishTest("ThreadSlotTest");
+}
@@ -0,0 +1,465 @@
+/*
+ * Copyright (c) 2018 Confetti Interactive Inc.
+ *
+ * This file is part of The-Forge
+ * (see https://github.com/ConfettiFX/The-Forge).
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+*/
+
+// UIRenderer against a recording renderer without a GPU. Checks the vertices and draw counts of label heavy frames,
+// the handling of frames larger than the vertex stream and that vertices of frames in flight are not overwritten.
+
+#include <stdlib.h>
+
+#include "../../../../Common_3/ThirdParty/OpenSource/TinySTL/vector.h"
+#include "../../../../Common_3/Renderer/IRenderer.h"
+#include "../../../../Common_3/Renderer/ResourceLoader.h"
+#include "../../../../Common_3/OS/UI/UIRenderer.h"
+#include "../../../../Common_3/OS/Interfaces/ITimeManager.h"
+#include "../../../../Common_3/OS/Interfaces/ILogManager.h"
+#include "../../../../Common_3/OS/Interfaces/IMemoryManager.h"
+
+#include "TestFramework.h"
+
+/************************************************************************/
+// Recording renderer
+/************************************************************************/
+typedef enum RecordedOp
+{
+	RECORDED_OP_BIND_PIPELINE = 0,
+	RECORDED_OP_BIND_DESCRIPTORS,
+	RECORDED_OP_BIND_VERTEX_BUFFER,
+	RECORDED_OP_SET_SCISSOR,
+	RECORDED_OP_DRAW,
+} RecordedOp;
+
+typedef struct RecordedCmd
+{
+	RecordedOp	mOp;
+	/// Vertex count and first vertex of draws
+	uint32_t	mVertexCount;
+	uint32_t	mFirstVertex;
+	Buffer*		pVertexBuffer;
+} RecordedCmd;
+
+static tinystl::vector<RecordedCmd> gRecordedCmds;
+static tinystl::vector<Fence*> gWaitedFences;
+
+template <typename T>
+static T* allocateMockObject()
+{
+	return (T*)conf_calloc(1, sizeof(T));
+}
+
+static void record(RecordedOp op, uint32_t vertexCount = 0, uint32_t firstVertex = 0, Buffer* pVertexBuffer = NULL)
+{
+	RecordedCmd cmd = { op, vertexCount, firstVertex, pVertexBuffer };
+	gRecordedCmds.push_back(cmd);
+}
+
+void addBlendState(BlendState** ppBlendState, BlendConstant, BlendConstant, BlendConstant, BlendConstant, BlendMode, BlendMode, int, int, bool)
+{
+	*ppBlendState = allocateMockObject<BlendState>();
+}
+void removeBlendState(BlendState* pBlendState) { conf_free(pBlendState); }
+
+void addDepthState(Renderer*, DepthState** ppDepthState, bool, bool, CompareMode, bool, uint8_t, uint8_t, CompareMode, StencilOp, StencilOp, StencilOp,
+	CompareMode, StencilOp, StencilOp, StencilOp)
+{
+	*ppDepthState = allocateMockObject<DepthState>();
+}
+void removeDepthState(DepthState* pDepthState) { conf_free(pDepthState); }
+
+void addRasterizerState(RasterizerState** ppRasterizerState, CullMode, int, float, FillMode, bool, bool)
+{
+	*ppRasterizerState = allocateMockObject<RasterizerState>();
+}
+void removeRasterizerState(RasterizerState* pRasterizerState) { conf_free(pRasterizerState); }
+
+void addPipeline(Renderer*, const GraphicsPipelineDesc* pDesc, Pipeline** ppPipeline)
+{
+	*ppPipeline = allocateMockObject<Pipeline>();
+	(*ppPipeline)->mGraphics = *pDesc;
+}
+void removePipeline(Renderer*, Pipeline* pPipeline) { conf_free(pPipeline); }
+
+void addRootSignature(Renderer*, uint32_t, Shader* const*, RootSignature** ppRootSignature, const RootSignatureDesc*)
+{
+	*ppRootSignature = allocateMockObject<RootSignature>();
+}
+void removeRootSignature(Renderer*, RootSignature* pRootSignature) { conf_free(pRootSignature); }
+
+void addSampler(Renderer*, Sampler** ppSampler, FilterType, FilterType, MipMapMode, AddressMode, AddressMode, AddressMode, float, float)
+{
+	*ppSampler = allocateMockObject<Sampler>();
+}
+void removeSampler(Renderer*, Sampler* pSampler) { conf_free(pSampler); }
+
+void addShader(Renderer*, const BinaryShaderDesc*, Shader** ppShader) { *ppShader = allocateMockObject<Shader>(); }
+void removeShader(Renderer*, Shader* pShader) { conf_free(pShader); }
+
+void addResource(BufferLoadDesc* pDesc, bool)
+{
+	Buffer* pBuffer = allocateMockObject<Buffer>();
+	pBuffer->mDesc = pDesc->mDesc;
+	pBuffer->pCpuMappedAddress = conf_calloc(1, (size_t)pDesc->mDesc.mSize);
+	*pDesc->ppBuffer = pBuffer;
+}
+void addResource(TextureLoadDesc* pDesc, bool) { *pDesc->ppTexture = allocateMockObject<Texture>(); }
+void updateResource(BufferUpdateDesc*, bool) {}
+void removeResource(Buffer* pBuffer)
+{
+	conf_free(pBuffer->pCpuMappedAddress);
+	conf_free(pBuffer);
+}
+void removeResource(Texture* pTexture) { conf_free(pTexture); }
+
+uint32_t getDescriptorIndexFromName(const RootSignature*, const char* pName) { return (uint32_t)strlen(pName); }
+
+void cmdBindPipeline(Cmd*, Pipeline*) { record(RECORDED_OP_BIND_PIPELINE); }
+void cmdBindDescriptors(Cmd*, RootSignature*, uint32_t, DescriptorData*) { record(RECORDED_OP_BIND_DESCRIPTORS); }
+void cmdBindVertexBuffer(Cmd*, uint32_t, Buffer** ppBuffers) { record(RECORDED_OP_BIND_VERTEX_BUFFER, 0, 0, ppBuffers[0]); }
+void cmdSetScissor(Cmd*, uint32_t, uint32_t, uint32_t, uint32_t) { record(RECORDED_OP_SET_SCISSOR); }
+void cmdDraw(Cmd*, uint32_t vertexCount, uint32_t firstVertex) { record(RECORDED_OP_DRAW, vertexCount, firstVertex); }
+
+// The mock GPU never finishes on its own, submitted fences only complete through waitForFences
+void getFenceStatus(Fence* pFence, FenceStatus* pFenceStatus)
+{
+	*pFenceStatus = pFence->mSubmitted ? FENCE_STATUS_INCOMPLETE : FENCE_STATUS_COMPLETE;
+}
+void waitForFences(Queue* pQueue, uint32_t fenceCount, Fence** ppFences)
+{
+	TEST_CHECK(pQueue != NULL);
+	for (uint32_t i = 0; i < fenceCount; ++i)
+	{
+		ppFences[i]->mSubmitted = false;
+		gWaitedFences.push_back(ppFences[i]);
+	}
+}
+
+/************************************************************************/
+// Helpers
+/************************************************************************/
+static void appendVertices(tinystl::vector<float>& out, PrimitiveTopology topology, const float* pVertices, uint32_t vertexCount, uint32_t floatsPerVertex)
+{
+	// Strips are expanded to lists by the renderer so consecutive draws can be merged
+	if (topology == PRIMITIVE_TOPO_TRI_STRIP)
+	{
+		for (uint32_t i = 0; i + 2 < vertexCount; ++i)
+			out.insert(out.end(), pVertices + i * floatsPerVertex, pVertices + (i + 3) * floatsPerVertex);
+	}
+	else
+	{
+		out.insert(out.end(), pVertices, pVertices + vertexCount * floatsPerVertex);
+	}
+}
+
+static bool equalVertices(const tinystl::vector<float>& a, const tinystl::vector<float>& b)
+{
+	return a.size() == b.size() && (a.empty() || memcmp(a.data(), b.data(), a.size() * sizeof(float)) == 0);
+}
+
+// Replays the recorded commands and returns the vertices drawn from the plain and the textured stream
+static uint32_t replayDraws(tinystl::vector<float>& plainVertices, tinystl::vector<float>& texturedVertices)
+{
+	Buffer* pVertexBuffer = NULL;
+	uint32_t drawCount = 0;
+	for (uint32_t i = 0; i < (uint32_t)gRecordedCmds.size(); ++i)
+	{
+		const RecordedCmd& cmd = gRecordedCmds[i];
+		if (cmd.mOp == RECORDED_OP_BIND_VERTEX_BUFFER)
+			pVertexBuffer = cmd.pVertexBuffer;
+		if (cmd.mOp != RECORDED_OP_DRAW)
+			continue;
+
+		++drawCount;
+		const uint32_t stride = (uint32_t)pVertexBuffer->mDesc.mVertexStride;
+		const float* pVertices = (const float*)((const uint8_t*)pVertexBuffer->pCpuMappedAddress + (size_t)cmd.mFirstVertex * stride);
+		tinystl::vector<float>& out = stride == sizeof(float2) ? plainVertices : texturedVertices;
+		out.insert(out.end(), pVertices, pVertices + cmd.mVertexCount * stride / sizeof(float));
+	}
+	return drawCount;
+}
+
+struct TestContext
+{
+	UIRenderer*		pUIRenderer;
+	Cmd*			pCmd;
+	RenderTarget*	pRenderTarget;
+	Texture*		pFontTexture;
+	Texture*		pImageTexture;
+	float4			mColors[4];
+};
+
+/************************************************************************/
+// Tests
+/************************************************************************/
+// Label heavy frames record the expected vertices with few draws. The second scenario interleaves scissors,
+// plain quads and images which break the batches.
+static void testLabelFrames(TestContext* pContext)
+{
+	UIRenderer* pUI = pContext->pUIRenderer;
+	tinystl::vector<float> expectedPlain;
+	tinystl::vector<float> expectedTextured;
+	tinystl::vector<TexVertex> vertices;
+	srand(1);
+
+	for (uint32_t scenario = 0; scenario < 2; ++scenario)
+	{
+		for (uint32_t frame = 0; frame < 200; ++frame)
+		{
+			gRecordedCmds.clear();
+			expectedPlain.clear();
+			expectedTextured.clear();
+
+			pUI->beginRender(pContext->pCmd, 1, &pContext->pRenderTarget, NULL);
+			for (uint32_t label = 0; label < 400; ++label)
+			{
+				if (scenario == 1 && label % 20 == 0)
+				{
+					RectDesc scissor = { 0, (int)label, 100, (int)label + 50 };
+					pUI->setScissor(&scissor);
+					float2 quad[4] = { float2(0.0f, (float)label), float2(100.0f, (float)label), float2(0.0f, label + 10.0f), float2(100.0f, label + 10.0f) };
+					pUI->drawPlain(PRIMITIVE_TOPO_TRI_STRIP, quad, 4, &pContext->mColors[3]);
+					appendVertices(expectedPlain, PRIMITIVE_TOPO_TRI_STRIP, &quad[0].x, 4, 2);
+				}
+
+				const uint32_t characterCount = 4 + rand() % 20;
+				vertices.resize(characterCount * 6);
+				for (uint32_t v = 0; v < (uint32_t)vertices.size(); ++v)
+					vertices[v] = TexVertex(float2((float)rand(), (float)label), float2((float)frame, (float)rand()));
+				pUI->drawTexturedR8AsAlpha(PRIMITIVE_TOPO_TRI_LIST, vertices.data(), (uint32_t)vertices.size(), pContext->pFontTexture, &pContext->mColors[(label / 8) % 3]);
+				appendVertices(expectedTextured, PRIMITIVE_TOPO_TRI_LIST, &vertices[0].position.x, (uint32_t)vertices.size(), 4);
+
+				if (scenario == 1 && label % 50 == 0)
+				{
+					TexVertex image[4] = {
+						TexVertex(float2(0.0f, 0.0f), float2(0.0f, 0.0f)), TexVertex(float2(1.0f, 0.0f), float2(1.0f, 0.0f)),
+						TexVertex(float2(0.0f, 1.0f), float2(0.0f, 1.0f)), TexVertex(float2(1.0f, 1.0f), float2(1.0f, 1.0f))
+					};
+					pUI->drawTextured(PRIMITIVE_TOPO_TRI_STRIP, image, 4, pContext->pImageTexture, &pContext->mColors[0]);
+					appendVertices(expectedTextured, PRIMITIVE_TOPO_TRI_STRIP, &image[0].position.x, 4, 4);
+				}
+			}
+			pUI->reset();
+
+			tinystl::vector<float> plainVertices;
+			tinystl::vector<float> texturedVertices;
+			const uint32_t drawCount = replayDraws(plainVertices, texturedVertices);
+			UIRenderStats stats;
+			pUI->getStats(&stats);
+
+			TEST_CHECK(equalVertices(plainVertices, expectedPlain));
+			TEST_CHECK(equalVertices(texturedVertices, expectedTextured));
+			TEST_CHECK(stats.mDrawCount == drawCount);
+			TEST_CHECK(stats.mDroppedDrawCount == 0);
+			TEST_CHECK(stats.mVertexBytes == (expectedPlain.size() + expectedTextured.size()) * sizeof(float));
+			// Labels of the same color share a draw
+			if (scenario == 0)
+				TEST_CHECK(stats.mDrawCount <= 400 / 8 + 1);
+
+			if (frame == 0)
+				printf("scenario %u: %u requested draws, %u recorded draws, %llu vertex bytes\n", scenario, stats.mRequestedDrawCount,
+					stats.mDrawCount, (unsigned long long)stats.mVertexBytes);
+		}
+	}
+}
+
+// A frame larger than the vertex stream drops its tail instead of overwriting itself
+static void testOversizedFrame(TestContext* pContext)
+{
+	UIRenderer* pUI = pContext->pUIRenderer;
+	tinystl::vector<TexVertex> vertices(60000);
+
+	gRecordedCmds.clear();
+	pUI->beginRender(pContext->pCmd, 1, &pContext->pRenderTarget, NULL);
+	for (uint32_t i = 0; i < 10; ++i)
+		pUI->drawTexturedR8AsAlpha(PRIMITIVE_TOPO_TRI_LIST, vertices.data(), (uint32_t)vertices.size(), pContext->pFontTexture, &pContext->mColors[0]);
+	pUI->reset();
+
+	UIRenderStats stats;
+	pUI->getStats(&stats);
+	TEST_CHECK(stats.mDroppedDrawCount > 0 && stats.mDroppedDrawCount < 10);
+
+	uint64_t drawnVertexCount = 0;
+	for (uint32_t i = 0; i < (uint32_t)gRecordedCmds.size(); ++i)
+		drawnVertexCount += gRecordedCmds[i].mOp == RECORDED_OP_DRAW ? gRecordedCmds[i].mVertexCount : 0;
+	TEST_CHECK(drawnVertexCount * sizeof(TexVertex) == stats.mVertexBytes);
+}
+
+// With a fence per frame, vertices of frames in flight are only overwritten after their fence was waited on
+static void testFramesInFlight(TestContext* pContext)
+{
+	struct LiveRange
+	{
+		Buffer*		pVertexBuffer;
+		uint32_t	mFirstVertex;
+		uint32_t	mEndVertex;
+		uint32_t	mFrame;
+	};
+
+	UIRenderer* pUI = pContext->pUIRenderer;
+	Queue queue = {};
+	CmdPool cmdPool = {};
+	cmdPool.pQueue = &queue;
+	Cmd cmd = {};
+	cmd.pCmdPool = &cmdPool;
+
+	tinystl::vector<LiveRange> liveRanges;
+	tinystl::vector<LiveRange> keptRanges;
+	tinystl::vector<Fence*> frameFences;
+	tinystl::vector<TexVertex> vertices(6000);
+	tinystl::vector<float2> plainVertices(3000);
+	uint32_t waitCount = 0;
+	uint32_t statsWaitCount = 0;
+
+	for (uint32_t frame = 0; frame < 400; ++frame)
+	{
+		gRecordedCmds.clear();
+		gWaitedFences.clear();
+
+		pUI->beginRender(&cmd, 1, &pContext->pRenderTarget, NULL);
+		const uint32_t labelCount = 1 + rand() % 12;
+		for (uint32_t label = 0; label < labelCount; ++label)
+		{
+			pUI->drawTexturedR8AsAlpha(PRIMITIVE_TOPO_TRI_LIST, vertices.data(), 6000 - rand() % 100 * 6, pContext->pFontTexture, &pContext->mColors[label % 3]);
+			if (label % 3 == 0)
+				pUI->drawPlain(PRIMITIVE_TOPO_TRI_LIST, plainVertices.data(), (uint32_t)plainVertices.size(), &pContext->mColors[0]);
+		}
+
+		Fence* pFence = allocateMockObject<Fence>();
+		frameFences.push_back(pFence);
+		pUI->reset(pFence);
+
+		UIRenderStats stats;
+		pUI->getStats(&stats);
+		TEST_CHECK(stats.mDroppedDrawCount == 0);
+		statsWaitCount += stats.mStreamWaitCount;
+		waitCount += (uint32_t)gWaitedFences.size();
+
+		// A completed frame implies that all older frames completed
+		int completedFrame = -1;
+		for (uint32_t w = 0; w < (uint32_t)gWaitedFences.size(); ++w)
+		{
+			for (uint32_t f = 0; f < frame; ++f)
+			{
+				if (frameFences[f] == gWaitedFences[w] && (int)f > completedFrame)
+					completedFrame = (int)f;
+			}
+		}
+		keptRanges.clear();
+		for (uint32_t r = 0; r < (uint32_t)liveRanges.size(); ++r)
+		{
+			if ((int)liveRanges[r].mFrame > completedFrame)
+				keptRanges.push_back(liveRanges[r]);
+		}
+		liveRanges.swap(keptRanges);
+
+		Buffer* pVertexBuffer = NULL;
+		for (uint32_t i = 0; i < (uint32_t)gRecordedCmds.size(); ++i)
+		{
+			const RecordedCmd& recorded = gRecordedCmds[i];
+			if (recorded.mOp == RECORDED_OP_BIND_VERTEX_BUFFER)
+				pVertexBuffer = recorded.pVertexBuffer;
+			if (recorded.mOp != RECORDED_OP_DRAW)
+				continue;
+
+			const uint32_t first = recorded.mFirstVertex;
+			const uint32_t end = recorded.mFirstVertex + recorded.mVertexCount;
+			for (uint32_t r = 0; r < (uint32_t)liveRanges.size(); ++r)
+			{
+				const LiveRange& live = liveRanges[r];
+				TEST_CHECK_MSG(live.pVertexBuffer != pVertexBuffer || end <= live.mFirstVertex || live.mEndVertex <= first,
+					"frame %u overwrites vertices [%u, %u) of frame %u", frame, live.mFirstVertex, live.mEndVertex, live.mFrame);
+			}
+			LiveRange range = { pVertexBuffer, first, end, frame };
+			liveRanges.push_back(range);
+		}
+
+		// Submitted, the GPU holds on to the frame until something waits for it
+		pFence->mSubmitted = true;
+	}
+
+	printf("400 fenced frames: %u fence waits\n", waitCount);
+	TEST_CHECK(waitCount > 0 && waitCount == statsWaitCount);
+
+	for (uint32_t i = 0; i < (uint32_t)frameFences.size(); ++i)
+		conf_free(frameFences[i]);
+}
+
+static void timeLabelFrames(TestContext* pContext)
+{
+	UIRenderer* pUI = pContext->pUIRenderer;
+	tinystl::vector<TexVertex> vertices(60);
+	HiresTimer timer;
+
+	for (uint32_t frame = 0; frame < 2000; ++frame)
+	{
+		gRecordedCmds.clear();
+		pUI->beginRender(pContext->pCmd, 1, &pContext->pRenderTarget, NULL);
+		for (uint32_t label = 0; label < 400; ++label)
+			pUI->drawTexturedR8AsAlpha(PRIMITIVE_TOPO_TRI_LIST, vertices.data(), (uint32_t)vertices.size(), pContext->pFontTexture, &pContext->mColors[(label / 8) % 3]);
+		pUI->reset();
+	}
+	printf("400 labels: %.1f us per frame\n", timer.GetUSec(false) / 2000.0);
+}
+
+int main(int argc, char** argv)
+{
+	LogManager logManager;
+
+	GPUSettings settings = {};
+	settings.mUniformBufferAlignment = 256;
+	Renderer* pRenderer = allocateMockObject<Renderer>();
+	pRenderer->pActiveGpuSettings = &settings;
+
+	Texture renderTargetTexture = {};
+	RenderTarget renderTarget = {};
+	renderTarget.pTexture = &renderTargetTexture;
+	renderTarget.mDesc.mWidth = 1920;
+	renderTarget.mDesc.mHeight = 1080;
+	Texture fontTexture = {};
+	fontTexture.mDesc.mWidth = 512;
+	fontTexture.mDesc.mHeight = 512;
+	Texture imageTexture = {};
+	imageTexture.mDesc.mWidth = 64;
+	imageTexture.mDesc.mHeight = 64;
+	Cmd cmd = {};
+
+	TestContext context;
+	context.pUIRenderer = conf_new(UIRenderer, pRenderer);
+	context.pCmd = &cmd;
+	context.pRenderTarget = &renderTarget;
+	context.pFontTexture = &fontTexture;
+	context.pImageTexture = &imageTexture;
+	context.mColors[0] = float4(1.0f, 1.0f, 1.0f, 1.0f);
+	context.mColors[1] = float4(1.0f, 0.0f, 0.0f, 1.0f);
+	context.mColors[2] = float4(0.0f, 1.0f, 0.0f, 1.0f);
+	context.mColors[3] = float4(0.0f, 0.0f, 0.0f, 0.5f);
+
+	testLabelFrames(&context);
+	testOversizedFrame(&context);
+	testFramesInFlight(&context);
+	timeLabelFrames(&context);
+
+	context.pUIRenderer->~UIRenderer();
+	conf_free(context.pUIRenderer);
+	conf_free(pRenderer);
+	return finishTest("UIRendererTest");
+}
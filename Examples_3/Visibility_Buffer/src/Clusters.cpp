@@ -0,0 +1,473 @@
+/*
+ * Copyright (c) 2018 Confetti Interactive Inc.
+ * 
+ * This file is part of The-Forge
+ * (see https://github.com/ConfettiFX/The-Forge).
+ * 
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ * 
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+*/
+
+// Cluster generation and CPU cluster culling, apart from the scene loading so they build without assimp.
+
+#include "Geometry.h"
+
+#include "../../../Common_3/OS/Interfaces/ILogManager.h"
+#include "../../../Common_3/OS/Interfaces/IMemoryManager.h"
+
+vec3 makeVec3(const SceneVertexPos& v)
+{
+	return vec3(v.x, v.y, v.z);
+}
+
+// Triangle of a cluster with its normal, the normal is computed once and shared by both passes of createCluster
+struct ClusterTriangle
+{
+	vec3 vtx[3];
+	vec3 normal;
+#if defined(METAL)
+	// The Metal path only normalizes normals longer than 0.1 for the cone axis
+	vec3 coneNormal;
+#endif
+};
+
+static uint32_t getMeshTriangleCount(const Mesh* mesh)
+{
+#if defined(METAL)
+	return mesh->triangleCount;
+#else
+	return mesh->indexCount / 3;
+#endif
+}
+
+static void loadClusterTriangles(const Scene* pScene, const Mesh* mesh, uint32_t clusterStart, uint32_t clusterEnd, ClusterTriangle* triangleCache)
+{
+	for (uint32_t triangleIndex = clusterStart; triangleIndex < clusterEnd; ++triangleIndex)
+	{
+		ClusterTriangle& triangle = triangleCache[triangleIndex - clusterStart];
+#if defined(METAL)
+		// Assumes that we have no indices and every 3 vertices are a triangle (due to Metal limitation).
+		const uint32_t triangleStart = mesh->startVertex / 3;
+		for (uint32_t j = 0; j < 3; ++j)
+			triangle.vtx[j] = makeVec3(pScene->positions[triangleStart + triangleIndex * 3 + j]);
+#else
+		const uint32_t firstIndex = mesh->startIndex + triangleIndex * 3;
+		for (uint32_t j = 0; j < 3; ++j)
+			triangle.vtx[j] = makeVec3(pScene->positions[pScene->indices[firstIndex + j]]);
+#endif
+
+		triangle.normal = cross(
+			triangle.vtx[1] - triangle.vtx[0],
+			triangle.vtx[2] - triangle.vtx[0]);
+
+#if defined(METAL)
+		triangle.coneNormal = (lengthSqr(triangle.normal) > 0.01f) ? normalize(triangle.normal) : triangle.normal;
+#endif
+		if (!(triangle.normal == vec3(0, 0, 0)))
+			triangle.normal = normalize(triangle.normal);
+	}
+}
+
+// Computes cluster i of the mesh. Clusters only read the scene and write their own slot so they can be built in parallel.
+static void createCluster(bool twoSided, const Scene* pScene, Mesh* mesh, uint32_t i)
+{
+	// 16 KiB stack space
+	ClusterTriangle triangleCache[CLUSTER_SIZE];
+
+	const uint32_t triangleCount = getMeshTriangleCount(mesh);
+	const uint32_t clusterStart = i * CLUSTER_SIZE;
+	const uint32_t clusterEnd = min<uint32_t>(clusterStart + CLUSTER_SIZE, triangleCount);
+
+	const int clusterTriangleCount = clusterEnd - clusterStart;
+
+	// Load all triangles into our local cache
+	loadClusterTriangles(pScene, mesh, clusterStart, clusterEnd, triangleCache);
+
+	vec3 aabbMin = vec3(INFINITY, INFINITY, INFINITY);
+	vec3 aabbMax = -aabbMin;
+
+	vec3 coneAxis = vec3(0, 0, 0);
+
+	for (int triangleIndex = 0; triangleIndex < clusterTriangleCount; ++triangleIndex)
+	{
+		const ClusterTriangle& triangle = triangleCache[triangleIndex];
+		for (int j = 0; j < 3; ++j)
+		{
+			aabbMin = minPerElem(aabbMin, triangle.vtx[j]);
+			aabbMax = maxPerElem(aabbMax, triangle.vtx[j]);
+		}
+
+#if defined(METAL)
+		coneAxis = coneAxis - triangle.coneNormal;
+#else
+		coneAxis = coneAxis - triangle.normal;
+#endif
+	}
+
+	// This is the cosine of the cone opening angle - 1 means it's 0?,
+	// we're minimizing this value (at 0, it would mean the cone is 90?
+	// open)
+	float coneOpening = 1;
+	// dont cull two sided meshes
+	bool validCluster = !twoSided;
+
+	const vec3 center = (aabbMin + aabbMax) / 2;
+	// if the axis is 0 then we have a invalid cluster
+	if (coneAxis == vec3(0, 0, 0))
+		validCluster = false;
+
+	coneAxis = normalize(coneAxis);
+
+	float t = -INFINITY;
+
+	// cant find a cluster for 2 sided objects
+	if (validCluster)
+	{
+		// We nee a second pass to find the intersection of the line center + t * coneAxis with the plane defined by each triangle
+		for (int triangleIndex = 0; triangleIndex < clusterTriangleCount; ++triangleIndex)
+		{
+			const ClusterTriangle& triangle = triangleCache[triangleIndex];
+			const float directionalPart = dot(coneAxis, -triangle.normal);
+
+			if (directionalPart <= 0)   //AMD BUG?: changed to <= 0 because directionalPart is used to divide a quantity
+			{
+				// No solution for this cluster - at least two triangles are facing each other
+				validCluster = false;
+				break;
+			}
+
+			// We need to intersect the plane with our cone ray which is center + t * coneAxis, and find the max
+			// t along the cone ray (which points into the empty space) See: https://en.wikipedia.org/wiki/Line%E2%80%93plane_intersection
+			const float td = dot(center - triangle.vtx[0], triangle.normal) / -directionalPart;
+
+			t = max(t, td);
+
+			coneOpening = min(coneOpening, directionalPart);
+		}
+	}
+
+	Cluster& cluster = mesh->clusters[i];
+	cluster.aabbMax = v3ToF3(aabbMax);
+	cluster.aabbMin = v3ToF3(aabbMin);
+
+	cluster.coneAngleCosine = sqrtf(1 - coneOpening * coneOpening);
+	cluster.coneCenter = v3ToF3(center + coneAxis * t);
+	cluster.coneAxis = v3ToF3(coneAxis);
+
+	mesh->clusterCompacts[i].triangleCount = clusterTriangleCount;
+	mesh->clusterCompacts[i].clusterStart = clusterStart;
+
+	//#if AMD_GEOMETRY_FX_ENABLE_CLUSTER_CENTER_SAFETY_CHECK
+	// If distance of coneCenter to the bounding box center is more than 16x the bounding box extent, the cluster is also invalid
+	// This is mostly a safety measure - if triangles are nearly parallel to coneAxis, t may become very large and unstable
+	if (validCluster)
+	{
+		const float aabbSize = length(aabbMax - aabbMin);
+		const float coneCenterToCenterDistance = length(f3Tov3(cluster.coneCenter) - center);
+
+		if (coneCenterToCenterDistance > (16 * aabbSize))
+			validCluster = false;
+	}
+	//#endif
+
+	cluster.valid = validCluster;
+}
+
+static void allocateClusters(Mesh* mesh)
+{
+	mesh->clusterCount = (getMeshTriangleCount(mesh) + CLUSTER_SIZE - 1) / CLUSTER_SIZE;
+	mesh->clusterCompacts = (ClusterCompact*)conf_calloc(mesh->clusterCount, sizeof(ClusterCompact));
+	mesh->clusters = (Cluster*)conf_calloc(mesh->clusterCount, sizeof(Cluster));
+}
+
+// Compute an array of clusters from the mesh vertices. Clusters are sub batches of the original mesh limited in number
+// for more efficient CPU / GPU culling. CPU culling operates per cluster, while GPU culling operates per triangle for
+// all the clusters that passed the CPU test.
+void CreateClusters(bool twoSided, const Scene* pScene, Mesh* mesh)
+{
+	allocateClusters(mesh);
+
+	for (uint32_t i = 0; i < mesh->clusterCount; ++i)
+		createCluster(twoSided, pScene, mesh, i);
+}
+
+struct CreateClustersData
+{
+	const Scene* pScene;
+	uint32_t* pMeshClusterOffsets;
+};
+
+static void createClusterRange(void* pData, uint32_t begin, uint32_t end)
+{
+	const CreateClustersData* pCreateData = (const CreateClustersData*)pData;
+	const Scene* pScene = pCreateData->pScene;
+	const uint32_t* pOffsets = pCreateData->pMeshClusterOffsets;
+
+	// Binary search for the mesh owning the first cluster of the range, the rest is walked linearly
+	uint32_t meshIdx = 0;
+	uint32_t last = pScene->numMeshes;
+	while (meshIdx + 1 < last)
+	{
+		const uint32_t mid = (meshIdx + last) / 2;
+		if (pOffsets[mid] <= begin)
+			meshIdx = mid;
+		else
+			last = mid;
+	}
+
+	for (uint32_t i = begin; i < end; ++i)
+	{
+		while (i >= pOffsets[meshIdx + 1])
+			++meshIdx;
+
+		Mesh* mesh = pScene->meshes + meshIdx;
+		createCluster(pScene->materials[mesh->materialId].twoSided, pScene, mesh, i - pOffsets[meshIdx]);
+	}
+}
+
+// Computes the clusters of all meshes in the scene. Work is split by cluster so a few big meshes still spread over all threads.
+void CreateClusters(ThreadPool* pThreadPool, const Scene* pScene)
+{
+	uint32_t* pMeshClusterOffsets = (uint32_t*)conf_malloc((pScene->numMeshes + 1) * sizeof(uint32_t));
+	uint32_t clusterCount = 0;
+	for (uint32_t i = 0; i < pScene->numMeshes; ++i)
+	{
+		allocateClusters(pScene->meshes + i);
+		pMeshClusterOffsets[i] = clusterCount;
+		clusterCount += pScene->meshes[i].clusterCount;
+	}
+	pMeshClusterOffsets[pScene->numMeshes] = clusterCount;
+
+	CreateClustersData data = { pScene, pMeshClusterOffsets };
+	parallelFor(pThreadPool, clusterCount, 64, createClusterRange, &data);
+
+	conf_free(pMeshClusterOffsets);
+}
+
+// Gathers the culling relevant part of the clusters of all meshes into SoA arrays for cullClusters
+void addClusterCullData(const Scene* pScene, ClusterCullData** ppCullData)
+{
+	ClusterCullData* pCullData = (ClusterCullData*)conf_calloc(1, sizeof(ClusterCullData));
+	pCullData->meshClusterOffsets = (uint32_t*)conf_calloc(pScene->numMeshes, sizeof(uint32_t));
+
+	for (uint32_t i = 0; i < pScene->numMeshes; ++i)
+	{
+		pCullData->meshClusterOffsets[i] = pCullData->clusterCount;
+		pCullData->clusterCount += pScene->meshes[i].clusterCount;
+	}
+
+	const uint32_t paddedCount = (pCullData->clusterCount + CLUSTER_CULL_LANES - 1) & ~(CLUSTER_CULL_LANES - 1);
+	pCullData->paddedClusterCount = paddedCount;
+
+	for (uint32_t c = 0; c < 3; ++c)
+	{
+		pCullData->aabbCenter[c] = (float*)conf_calloc(paddedCount, sizeof(float));
+		pCullData->aabbExtent[c] = (float*)conf_calloc(paddedCount, sizeof(float));
+		pCullData->coneApex[c] = (float*)conf_calloc(paddedCount, sizeof(float));
+		pCullData->coneAxis[c] = (float*)conf_calloc(paddedCount, sizeof(float));
+	}
+	pCullData->coneAngleCosine = (float*)conf_calloc(paddedCount, sizeof(float));
+	pCullData->coneInvalidMask = (uint32_t*)conf_calloc(paddedCount, sizeof(uint32_t));
+
+	for (uint32_t i = 0; i < pScene->numMeshes; ++i)
+	{
+		const Mesh* mesh = &pScene->meshes[i];
+		for (uint32_t j = 0; j < mesh->clusterCount; ++j)
+		{
+			const Cluster& cluster = mesh->clusters[j];
+			const uint32_t index = pCullData->meshClusterOffsets[i] + j;
+
+			const float3 center = (cluster.aabbMax + cluster.aabbMin) * 0.5f;
+			const float3 extent = (cluster.aabbMax - cluster.aabbMin) * 0.5f;
+			const float* pCenter = &center.x;
+			const float* pExtent = &extent.x;
+			const float* pApex = &cluster.coneCenter.x;
+			const float* pAxis = &cluster.coneAxis.x;
+			for (uint32_t c = 0; c < 3; ++c)
+			{
+				pCullData->aabbCenter[c][index] = pCenter[c];
+				pCullData->aabbExtent[c][index] = pExtent[c];
+				pCullData->coneApex[c][index] = pApex[c];
+				pCullData->coneAxis[c][index] = pAxis[c];
+			}
+			pCullData->coneAngleCosine[index] = cluster.coneAngleCosine;
+			pCullData->coneInvalidMask[index] = cluster.valid ? 0 : ~0u;
+		}
+	}
+
+	*ppCullData = pCullData;
+}
+
+void removeClusterCullData(ClusterCullData* pCullData)
+{
+	for (uint32_t c = 0; c < 3; ++c)
+	{
+		conf_free(pCullData->aabbCenter[c]);
+		conf_free(pCullData->aabbExtent[c]);
+		conf_free(pCullData->coneApex[c]);
+		conf_free(pCullData->coneAxis[c]);
+	}
+	conf_free(pCullData->coneAngleCosine);
+	conf_free(pCullData->coneInvalidMask);
+	conf_free(pCullData->meshClusterOffsets);
+	conf_free(pCullData);
+}
+
+// Extracts the side planes of the view frustum from the model view projection matrix (Gribb / Hartmann).
+// Near and far planes are left out, so the test works for any depth range convention.
+void getClusterCullView(const mat4& mvp, const vec3& eye, ClusterCullView* pView)
+{
+	const vec4 row0 = mvp.getRow(0);
+	const vec4 row1 = mvp.getRow(1);
+	const vec4 row3 = mvp.getRow(3);
+	const vec4 planes[4] = { row3 + row0, row3 - row0, row3 + row1, row3 - row1 };
+
+	for (uint32_t i = 0; i < 4; ++i)
+	{
+		pView->planes[i][0] = planes[i].getX();
+		pView->planes[i][1] = planes[i].getY();
+		pView->planes[i][2] = planes[i].getZ();
+		pView->planes[i][3] = planes[i].getW();
+	}
+
+	pView->eye[0] = eye.getX();
+	pView->eye[1] = eye.getY();
+	pView->eye[2] = eye.getZ();
+}
+
+// A cluster is visible from a view if the view is outside the cluster cone (or the cone is invalid)
+// and its bounding box intersects the side planes of the frustum.
+// The cone test matches dot(normalize(eye - apex), axis) < cosine without the division by the length.
+#if VECTORMATH_MODE_SCALAR
+void cullClusters(const ClusterCullData* pCullData, uint32_t begin, uint32_t end, uint32_t viewCount, const ClusterCullView* pViews, uint8_t* pVisibility)
+{
+	for (uint32_t i = begin; i < end; ++i)
+	{
+		uint8_t visible = 0;
+		for (uint32_t v = 0; v < viewCount && !visible; ++v)
+		{
+			const ClusterCullView& view = pViews[v];
+			const float dx = view.eye[0] - pCullData->coneApex[0][i];
+			const float dy = view.eye[1] - pCullData->coneApex[1][i];
+			const float dz = view.eye[2] - pCullData->coneApex[2][i];
+			const float length = sqrtf(dx * dx + dy * dy + dz * dz);
+			const float coneDot = dx * pCullData->coneAxis[0][i] + dy * pCullData->coneAxis[1][i] + dz * pCullData->coneAxis[2][i];
+			bool inside = pCullData->coneInvalidMask[i] || coneDot < pCullData->coneAngleCosine[i] * length;
+
+			for (uint32_t p = 0; p < 4 && inside; ++p)
+			{
+				const float* plane = view.planes[p];
+				const float distance =
+					plane[0] * pCullData->aabbCenter[0][i] + plane[1] * pCullData->aabbCenter[1][i] + plane[2] * pCullData->aabbCenter[2][i] + plane[3];
+				const float radius =
+					fabsf(plane[0]) * pCullData->aabbExtent[0][i] + fabsf(plane[1]) * pCullData->aabbExtent[1][i] + fabsf(plane[2]) * pCullData->aabbExtent[2][i];
+				inside = distance + radius >= 0.0f;
+			}
+
+			visible = inside ? 1 : 0;
+		}
+		pVisibility[i] = visible;
+	}
+}
+#else
+#if defined(__AVX__)
+typedef __m256 CullVec;
+#define cullLoad(p)              _mm256_loadu_ps(p)
+#define cullSet1(f)              _mm256_set1_ps(f)
+#define cullAdd(a, b)            _mm256_add_ps(a, b)
+#define cullSub(a, b)            _mm256_sub_ps(a, b)
+#define cullMul(a, b)            _mm256_mul_ps(a, b)
+#define cullSqrt(a)              _mm256_sqrt_ps(a)
+#define cullAnd(a, b)            _mm256_and_ps(a, b)
+#define cullOr(a, b)             _mm256_or_ps(a, b)
+#define cullCmpLt(a, b)          _mm256_cmp_ps(a, b, _CMP_LT_OQ)
+#define cullCmpGe(a, b)          _mm256_cmp_ps(a, b, _CMP_GE_OQ)
+#define cullZero()               _mm256_setzero_ps()
+#define cullMoveMask(a)          _mm256_movemask_ps(a)
+#else
+typedef __m128 CullVec;
+#define cullLoad(p)              _mm_loadu_ps(p)
+#define cullSet1(f)              _mm_set1_ps(f)
+#define cullAdd(a, b)            _mm_add_ps(a, b)
+#define cullSub(a, b)            _mm_sub_ps(a, b)
+#define cullMul(a, b)            _mm_mul_ps(a, b)
+#define cullSqrt(a)              _mm_sqrt_ps(a)
+#define cullAnd(a, b)            _mm_and_ps(a, b)
+#define cullOr(a, b)             _mm_or_ps(a, b)
+#define cullCmpLt(a, b)          _mm_cmplt_ps(a, b)
+#define cullCmpGe(a, b)          _mm_cmpge_ps(a, b)
+#define cullZero()               _mm_setzero_ps()
+#define cullMoveMask(a)          _mm_movemask_ps(a)
+#endif
+
+void cullClusters(const ClusterCullData* pCullData, uint32_t begin, uint32_t end, uint32_t viewCount, const ClusterCullView* pViews, uint8_t* pVisibility)
+{
+	ASSERT((begin % CLUSTER_CULL_LANES) == 0 && (end % CLUSTER_CULL_LANES) == 0);
+	ASSERT(end <= pCullData->paddedClusterCount);
+
+	for (uint32_t i = begin; i < end; i += CLUSTER_CULL_LANES)
+	{
+		const CullVec centerX = cullLoad(pCullData->aabbCenter[0] + i);
+		const CullVec centerY = cullLoad(pCullData->aabbCenter[1] + i);
+		const CullVec centerZ = cullLoad(pCullData->aabbCenter[2] + i);
+		const CullVec extentX = cullLoad(pCullData->aabbExtent[0] + i);
+		const CullVec extentY = cullLoad(pCullData->aabbExtent[1] + i);
+		const CullVec extentZ = cullLoad(pCullData->aabbExtent[2] + i);
+		const CullVec apexX = cullLoad(pCullData->coneApex[0] + i);
+		const CullVec apexY = cullLoad(pCullData->coneApex[1] + i);
+		const CullVec apexZ = cullLoad(pCullData->coneApex[2] + i);
+		const CullVec axisX = cullLoad(pCullData->coneAxis[0] + i);
+		const CullVec axisY = cullLoad(pCullData->coneAxis[1] + i);
+		const CullVec axisZ = cullLoad(pCullData->coneAxis[2] + i);
+		const CullVec cosine = cullLoad(pCullData->coneAngleCosine + i);
+		const CullVec invalid = cullLoad((const float*)(pCullData->coneInvalidMask + i));
+
+		CullVec visible = cullZero();
+		for (uint32_t v = 0; v < viewCount; ++v)
+		{
+			const ClusterCullView& view = pViews[v];
+
+			// Cone test
+			const CullVec dx = cullSub(cullSet1(view.eye[0]), apexX);
+			const CullVec dy = cullSub(cullSet1(view.eye[1]), apexY);
+			const CullVec dz = cullSub(cullSet1(view.eye[2]), apexZ);
+			const CullVec length = cullSqrt(cullAdd(cullAdd(cullMul(dx, dx), cullMul(dy, dy)), cullMul(dz, dz)));
+			const CullVec coneDot = cullAdd(cullAdd(cullMul(dx, axisX), cullMul(dy, axisY)), cullMul(dz, axisZ));
+			CullVec inside = cullOr(invalid, cullCmpLt(coneDot, cullMul(cosine, length)));
+
+			// Frustum side planes
+			for (uint32_t p = 0; p < 4; ++p)
+			{
+				const float* plane = view.planes[p];
+				const CullVec distance = cullAdd(
+					cullAdd(cullMul(cullSet1(plane[0]), centerX), cullMul(cullSet1(plane[1]), centerY)),
+					cullAdd(cullMul(cullSet1(plane[2]), centerZ), cullSet1(plane[3])));
+				const CullVec radius = cullAdd(
+					cullAdd(cullMul(cullSet1(fabsf(plane[0])), extentX), cullMul(cullSet1(fabsf(plane[1])), extentY)),
+					cullMul(cullSet1(fabsf(plane[2])), extentZ));
+				inside = cullAnd(inside, cullCmpGe(cullAdd(distance, radius), cullZero()));
+			}
+
+			visible = cullOr(visible, inside);
+		}
+
+		const int mask = cullMoveMask(visible);
+		for (uint32_t l = 0; l < CLUSTER_CULL_LANES; ++l)
+			pVisibility[i + l] = (uint8_t)((mask >> l) & 1);
+	}
+}
+#endif
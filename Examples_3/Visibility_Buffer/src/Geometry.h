@@ -27,6 +27,8 @@
 
 #include "../../../Common_3/Renderer/IRenderer.h"
 #include "../../../Common_3/Renderer/ResourceLoader.h"
+#include "../../../Common_3/OS/Interfaces/IThread.h"
+#include "../../../Common_3/OS/Interfaces/IFileSystem.h"
 
 #if defined(METAL)
 #include "OSXMetal/shader_defs.h"
@@ -40,6 +42,13 @@
 
 #define MAX_PATH 260
 
+// Clusters tested per iteration of cullClusters
+#if defined(__AVX__)
+#define CLUSTER_CULL_LANES 8
+#else
+#define CLUSTER_CULL_LANES 4
+#endif
+
 // Type definitions
 
 typedef struct SceneVertexPos
@@ -120,17 +129,43 @@ typedef struct Scene
     uint32_t totalVertices;
     Mesh* meshes;
     Material* materials;
-    tinystl::vector<SceneVertexPos> positions;
-    tinystl::vector<SceneVertexTexCoord> texCoords;
-	tinystl::vector<SceneVertexNormal> normals;
-	tinystl::vector<SceneVertexTangent> tangents;
-    char** textures;
-    char** normalMaps;
-    char** specularMaps;
-    
-	tinystl::vector<uint32_t>			indices;
+    SceneVertexPos* positions;
+    SceneVertexTexCoord* texCoords;
+    SceneVertexNormal* normals;
+    SceneVertexTangent* tangents;
+    const char** textures;
+    const char** normalMaps;
+    const char** specularMaps;
+
+    uint32_t* indices;
+
+    // Set when the scene was loaded from a cooked file. Vertex streams, indices, clusters and texture names
+    // then point into the mapping instead of being owned by the scene.
+    MappedFile* pCookedFile;
 } Scene;
 
+// Structure of arrays copy of the culling data of every cluster in the scene.
+// Clusters of all meshes are stored back to back, the arrays are padded to a multiple of CLUSTER_CULL_LANES.
+typedef struct ClusterCullData
+{
+	uint32_t clusterCount;
+	uint32_t paddedClusterCount;
+	uint32_t* meshClusterOffsets;     // First entry of each mesh
+	float* aabbCenter[3];
+	float* aabbExtent[3];
+	float* coneApex[3];
+	float* coneAxis[3];
+	float* coneAngleCosine;
+	uint32_t* coneInvalidMask;        // ~0u if the cone test can't cull the cluster
+} ClusterCullData;
+
+// Culling inputs of one view, in the object space of the scene
+typedef struct ClusterCullView
+{
+	float eye[3];
+	float planes[4][4];               // Left, right, bottom and top frustum planes, inside is positive
+} ClusterCullView;
+
 typedef struct FilterBatchData
 {
 #if defined(METAL)
@@ -165,8 +200,22 @@ typedef struct FilterBatchChunk
 // Exposed functions
 
 Scene* loadScene(const char* fileName);
+// Maps a scene written by cookScene. Returns NULL if the file is missing, was cooked for another platform
+// or does not match the contents of the source scene it was cooked from. sourceFileName may be NULL to skip
+// that check, otherwise a missing source invalidates the cooked scene as well.
+Scene* loadCookedScene(const char* fileName, const char* sourceFileName);
+// Writes the scene including its clusters in the cooked format, so the next run can map it instead of converting the source
+bool cookScene(const Scene* pScene, const char* sourceFileName, const char* fileName);
+// Frees the scene and the clusters of its meshes
 void removeScene(Scene* scene);
 void CreateClusters(bool twoSided, const Scene* pScene, Mesh* mesh);
+void CreateClusters(ThreadPool* pThreadPool, const Scene* pScene);
+void addClusterCullData(const Scene* pScene, ClusterCullData** ppCullData);
+void removeClusterCullData(ClusterCullData* pCullData);
+void getClusterCullView(const mat4& mvp, const vec3& eye, ClusterCullView* pView);
+// Writes 1 to pVisibility for every cluster in [begin, end) that is visible from at least one view, 0 otherwise.
+// begin and end have to be multiples of CLUSTER_CULL_LANES.
+void cullClusters(const ClusterCullData* pCullData, uint32_t begin, uint32_t end, uint32_t viewCount, const ClusterCullView* pViews, uint8_t* pVisibility);
 #if defined(METAL)
 void addClusterToBatchChunk(const ClusterCompact* cluster, const Mesh* mesh, uint32_t meshIdx, bool isTwoSided, FilterBatchChunk* batchChunk);
 #else
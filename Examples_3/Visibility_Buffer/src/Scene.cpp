@@ -0,0 +1,922 @@
+/*
+ * Copyright (c) 2018 Confetti Interactive Inc.
+ * 
+ * This file is part of The-Forge
+ * (see https://github.com/ConfettiFX/The-Forge).
+ * 
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ * 
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+*/
+
+// Scene loading, cooking and cooked scene mapping, apart from the GPU resources so they build without assimp.
+
+#include "Geometry.h"
+
+#include "../../../Common_3/ThirdParty/OpenSource/TinySTL/unordered_set.h"
+
+#include "../../../Common_3/OS/Interfaces/IFileSystem.h"
+#include "../../../Common_3/OS/Interfaces/ILogManager.h"
+#include "../../../Common_3/OS/Interfaces/IMemoryManager.h"
+#include "../../../Common_3/OS/Core/Compiler.h"
+
+static void SetAlphaTestMaterials(tinystl::unordered_set<String>& mats)
+{
+	// San Miguel
+	mats.insert("aglaonema_Leaf");
+	mats.insert("brevipedunculata_Leaf1");
+	mats.insert("Azalea_1_blattg1");
+	mats.insert("Azalea_1_Blutenb");
+	mats.insert("Azalea_1_leafcal");
+	mats.insert("Azalea_2_blattg1");
+	mats.insert("Azalea_2_Blutenb");
+	mats.insert("Chusan_Palm_1_Leaf");
+	mats.insert("Fern_1_Fan");
+	mats.insert("Fern_3_Leaf");
+	mats.insert("Ficus_1_Leaf1");
+	mats.insert("Geranium_1_Leaf");
+	mats.insert("Geranium_1_blbl1");
+	mats.insert("Geranium_1_blbl2");
+	mats.insert("Geranium_1_Kelchbl");
+	mats.insert("Hoja_Seca_2A");
+	mats.insert("Hoja_Seca_2B");
+	mats.insert("Hoja_Seca_2C");
+	mats.insert("Hoja_Verde_A");
+	mats.insert("Hoja_Verde_B");
+	mats.insert("Hojas_Rojas_top");
+	mats.insert("hybrids_blossom");
+	mats.insert("hybrids_Leaf");
+	mats.insert("Ivy_1_Leaf");
+	mats.insert("Leave_A_a");
+	mats.insert("Leave_A_b");
+	mats.insert("Leave_A_c");
+	mats.insert("Mona_Lisa_1_Leaf1");
+	mats.insert("Mona_Lisa_1_Leaf2");
+	mats.insert("Mona_Lisa_2_Leaf1");
+	mats.insert("Mona_Lisa_1_petal11");
+	mats.insert("Mona_Lisa_1_petal12");
+	mats.insert("paniceum_Leaf");
+	mats.insert("Pansy_1_blblbac");
+	mats.insert("Pansy_1_Leaf");
+	mats.insert("Pansy_1_Leafcop");
+	mats.insert("Pansy_1_Leafsma");
+	mats.insert("Poinsettia_1_Leaf");
+	mats.insert("Poinsettia_1_redleaf");
+	mats.insert("Poinsettia_1_smallre");
+	mats.insert("Rose_1_Blatt2");
+	mats.insert("Rose_1_Blutenb");
+	mats.insert("Rose_1_Blatt1_");
+	mats.insert("Rose_1_Kelchbl");
+	mats.insert("Rose_2__Blutenb");
+	mats.insert("Rose_2__Kelchbl");
+	mats.insert("Rose_2_Blatt1_");
+	mats.insert("Rose_3_Blutenb");
+	mats.insert("Rose_3_Blatt2");
+	mats.insert("zebrina_Leaf");
+}
+
+static void SetTwoSidedMaterials(tinystl::unordered_set<String>& mats)
+{
+	// San Miguel
+	mats.insert("aglaonema_Leaf");
+	mats.insert("brevipedunculata_Leaf1");
+	mats.insert("Azalea_1_blattg1");
+	mats.insert("Azalea_1_Blutenb");
+	mats.insert("Azalea_1_leafcal");
+	mats.insert("Azalea_2_blattg1");
+	mats.insert("Azalea_2_Blutenb");
+	mats.insert("Chusan_Palm_1_Leaf");
+	mats.insert("Fern_1_Fan");
+	mats.insert("Fern_3_Leaf");
+	mats.insert("Ficus_1_Leaf1");
+	mats.insert("Geranium_1_Leaf");
+	mats.insert("Geranium_1_blbl1");
+	mats.insert("Geranium_1_blbl2");
+	mats.insert("Geranium_1_Kelchbl");
+	mats.insert("Hoja_Seca_2A");
+	mats.insert("Hoja_Seca_2B");
+	mats.insert("Hoja_Seca_2C");
+	mats.insert("Hoja_Verde_A");
+	mats.insert("Hoja_Verde_B");
+	mats.insert("Hojas_Rojas_top");
+	mats.insert("hybrids_blossom");
+	mats.insert("hybrids_Leaf");
+	mats.insert("Ivy_1_Leaf");
+	mats.insert("Leave_A_a");
+	mats.insert("Leave_A_b");
+	mats.insert("Leave_A_c");
+	mats.insert("Mona_Lisa_1_Leaf1");
+	mats.insert("Mona_Lisa_1_Leaf2");
+	mats.insert("Mona_Lisa_2_Leaf1");
+	mats.insert("Mona_Lisa_1_petal11");
+	mats.insert("Mona_Lisa_1_petal12");
+	mats.insert("paniceum_Leaf");
+	mats.insert("Pansy_1_blblbac");
+	mats.insert("Pansy_1_Leaf");
+	mats.insert("Pansy_1_Leafcop");
+	mats.insert("Pansy_1_Leafsma");
+	mats.insert("Poinsettia_1_Leaf");
+	mats.insert("Poinsettia_1_redleaf");
+	mats.insert("Poinsettia_1_smallre");
+	mats.insert("Rose_1_Blatt2");
+	mats.insert("Rose_1_Blutenb");
+	mats.insert("Rose_1_Blatt1_");
+	mats.insert("Rose_1_Kelchbl");
+	mats.insert("Rose_2__Blutenb");
+	mats.insert("Rose_2__Kelchbl");
+	mats.insert("Rose_2_Blatt1_");
+	mats.insert("Rose_3_Blutenb");
+	mats.insert("Rose_3_Blatt2");
+	mats.insert("zebrina_Leaf");
+	mats.insert("Tronco");
+	mats.insert("Muros");
+	mats.insert("techos");
+	mats.insert("Azotea");
+	mats.insert("Pared_SanMiguel_N");
+	mats.insert("Pared_SanMiguel_H");
+	mats.insert("Pared_SanMiguel_B");
+	mats.insert("Pared_SanMiguel_G");
+	mats.insert("Barandal_Detalle_Extremos");
+	mats.insert("Madera_Silla");
+	mats.insert("Forja_Macetas");
+	mats.insert("Muro_Naranja_Escalera");
+	mats.insert("Tela_Mesa_D_2");
+	mats.insert("Tela_Mesa_D");
+}
+
+#if !defined(METAL)
+static inline float2 abs(const float2& v)
+{
+	return float2(fabsf(v.getX()), fabsf(v.getY()));
+}
+static inline float2 subtract(const float2& v, const float2& w)
+{
+	return float2(v.getX() - w.getX(), v.getY() - w.getY());
+}
+static inline float2 step(const float2& y, const float2& x)
+{
+	return float2(x.getX() >= y.getX() ? 1.f : 0.f,
+		x.getY() >= y.getY() ? 1.f : 0.f);
+}
+static inline float2 mulPerElem(const float2 &v, float f)
+{
+	return float2(v.getX()*f, v.getY()*f);
+}
+static inline float2 mulPerElem(const float2 &v, const float2& w)
+{
+	return float2(v.getX()*w.getX(), v.getY()*w.getY());
+}
+static inline float2 sumPerElem(const float2 &v, const float2& w)
+{
+	return float2(v.getX() + w.getX(), v.getY() + w.getY());
+}
+static inline float2 sign_not_zero(const float2& v)
+{
+	return subtract(mulPerElem(step(float2(0, 0), v), 2.0), float2(1, 1));
+}
+static inline uint packSnorm2x16(const float2& v)
+{
+	uint x = (uint)round(clamp(v.getX(), -1, 1) * 32767.0f);
+	uint y = (uint)round(clamp(v.getY(), -1, 1) * 32767.0f);
+	return ((uint)0x0000FFFF & x) | ((y << 16) & (uint)0xFFFF0000);
+}
+static inline uint packUnorm2x16(const float2& v)
+{
+	uint x = (uint)round(clamp(v.getX(), 0, 1) * 65535.0f);
+	uint y = (uint)round(clamp(v.getY(), 0, 1) * 65535.0f);
+	return ((uint)0x0000FFFF & x) | ((y << 16) & (uint)0xFFFF0000);
+}
+
+#define F16_EXPONENT_BITS 0x1F
+#define F16_EXPONENT_SHIFT 10
+#define F16_EXPONENT_BIAS 15
+#define F16_MANTISSA_BITS 0x3ff
+#define F16_MANTISSA_SHIFT (23 - F16_EXPONENT_SHIFT)
+#define F16_MAX_EXPONENT (F16_EXPONENT_BITS << F16_EXPONENT_SHIFT)
+
+static inline unsigned short F32toF16(float val)
+{
+	uint f32 = (*(uint *)&val);
+	unsigned short f16 = 0;
+	/* Decode IEEE 754 little-endian 32-bit floating-point value */
+	int sign = (f32 >> 16) & 0x8000;
+	/* Map exponent to the range [-127,128] */
+	int exponent = ((f32 >> 23) & 0xff) - 127;
+	int mantissa = f32 & 0x007fffff;
+	if (exponent == 128)
+	{ /* Infinity or NaN */
+		f16 = (unsigned short)(sign | F16_MAX_EXPONENT);
+		if (mantissa) f16 |= (mantissa & F16_MANTISSA_BITS);
+
+	}
+	else if (exponent > 15)
+	{ /* Overflow - flush to Infinity */
+		f16 = (unsigned short)(sign | F16_MAX_EXPONENT);
+	}
+	else if (exponent > -15)
+	{ /* Representable value */
+		exponent += F16_EXPONENT_BIAS;
+		mantissa >>= F16_MANTISSA_SHIFT;
+		f16 = (unsigned short)(sign | exponent << F16_EXPONENT_SHIFT | mantissa);
+	}
+	else
+	{
+		f16 = (unsigned short)sign;
+	}
+	return f16;
+}
+static inline uint pack2Floats(float2 f)
+{
+	return (F32toF16(f.getX()) & 0x0000FFFF) | ((F32toF16(f.getY()) << 16) & 0xFFFF0000);
+}
+
+static inline float2 normalize(const float2 & vec)
+{
+	float lenSqr = vec.getX()*vec.getX() + vec.getY()*vec.getY();
+	float lenInv = (1.0f / sqrtf(lenSqr));
+	return float2(vec.getX() * lenInv, vec.getY() * lenInv);
+}
+
+static inline float OctWrap(float v, float w)
+{
+	return (1.0f - abs(w)) * (v >= 0.0f ? 1.0f : -1.0f);
+}
+
+static inline uint encodeDir(const float3& n)
+{
+	float absLength = (abs(n.getX()) + abs(n.getY()) + abs(n.getZ()));
+	float3 enc;
+	enc.setX(n.getX() / absLength);
+	enc.setY(n.getY() / absLength);
+	enc.setZ(n.getZ() / absLength);
+
+	if (enc.getZ() < 0)
+	{
+		float oldX = enc.getX();
+		enc.setX(OctWrap(enc.getX(), enc.getY()));
+		enc.setY(OctWrap(enc.getY(), oldX));
+	}
+	enc.setX(enc.getX() * 0.5f + 0.5f);
+	enc.setY(enc.getY() * 0.5f + 0.5f);
+
+	return packUnorm2x16(float2(enc.getX(), enc.getY()));
+}
+#endif
+
+// Loads a scene using ASSIMP and returns a Scene object with scene information
+Scene* loadScene(const char* fileName)
+{
+#if TARGET_IOS
+	NSString *fileUrl = [[NSBundle mainBundle] pathForResource:[NSString stringWithUTF8String : fileName] ofType : @""];
+	fileName = [fileUrl fileSystemRepresentation];
+#endif
+
+	Scene* scene = (Scene*)conf_calloc(1, sizeof(Scene));
+	File assimpScene = {};
+	assimpScene.Open(fileName, FileMode::FM_ReadBinary, FSRoot::FSR_Absolute);
+	if (!assimpScene.IsOpen())
+	{
+		ErrorMsg("Could not open scene %s.\nPlease make sure you have downloaded the art assets by using the PRE_BUILD command in the root directory", fileName);
+		return NULL;
+	}
+	ASSERT(assimpScene.IsOpen());
+
+	assimpScene.Read(&scene->numMeshes, sizeof(uint32_t));
+	assimpScene.Read(&scene->totalVertices, sizeof(uint32_t));
+	assimpScene.Read(&scene->totalTriangles, sizeof(uint32_t));
+
+	scene->meshes = (Mesh*)conf_calloc(scene->numMeshes, sizeof(Mesh));
+	scene->indices = (uint32_t*)conf_calloc(scene->totalTriangles, sizeof(uint32_t));
+	scene->positions = (SceneVertexPos*)conf_calloc(scene->totalVertices, sizeof(SceneVertexPos));
+	scene->texCoords = (SceneVertexTexCoord*)conf_calloc(scene->totalVertices, sizeof(SceneVertexTexCoord));
+	scene->normals = (SceneVertexNormal*)conf_calloc(scene->totalVertices, sizeof(SceneVertexNormal));
+	scene->tangents = (SceneVertexTangent*)conf_calloc(scene->totalVertices, sizeof(SceneVertexTangent));
+
+    tinystl::vector<float2> texcoords(scene->totalVertices);
+    tinystl::vector<float3> normals(scene->totalVertices);
+    tinystl::vector<float3> tangents(scene->totalVertices);
+
+    assimpScene.Read(scene->indices, sizeof(uint32_t) * scene->totalTriangles);
+    assimpScene.Read(scene->positions, sizeof(float3) * scene->totalVertices);
+    assimpScene.Read(texcoords.data(), sizeof(float2) * scene->totalVertices);
+    assimpScene.Read(normals.data(), sizeof(float3) * scene->totalVertices);
+    assimpScene.Read(tangents.data(), sizeof(float3) * scene->totalVertices);
+
+    for (uint32_t v = 0; v < scene->totalVertices; v++)
+    {
+        const float3& normal = normals[v];
+        const float3& tangent = tangents[v];
+        const float2& tc = texcoords[v];
+        
+#ifndef METAL
+        scene->normals[v].normal = encodeDir(normal);
+        scene->tangents[v].tangent = encodeDir(tangent);
+        scene->texCoords[v].texCoord = pack2Floats(float2(tc.x, 1.0f - tc.y));
+#else
+        scene->normals[v].nx = normal.x;
+        scene->normals[v].ny = normal.y;
+        scene->normals[v].nz = normal.z;
+        
+        scene->tangents[v].tx = tangent.x;
+        scene->tangents[v].ty = tangent.y;
+        scene->tangents[v].tz = tangent.z;
+        
+        scene->texCoords[v].u = tc.x;
+        scene->texCoords[v].v = 1.0f - tc.y;
+#endif
+    }
+
+	for (uint32_t i = 0; i < scene->numMeshes; ++i)
+	{
+		Mesh& batch = scene->meshes[i];
+
+		assimpScene.Read(&batch.materialId, sizeof(uint32_t));
+        assimpScene.Read(&batch.vertexCount, sizeof(uint32_t));
+#ifndef METAL
+		assimpScene.Read(&batch.startIndex, sizeof(uint32_t));
+        assimpScene.Read(&batch.indexCount, sizeof(uint32_t));
+#else
+        assimpScene.Read(&batch.startVertex, sizeof(uint32_t));
+        assimpScene.Read(&batch.vertexCount, sizeof(uint32_t));
+#endif
+	}
+
+	tinystl::unordered_set<String> twoSidedMaterials;
+	SetTwoSidedMaterials(twoSidedMaterials);
+
+	tinystl::unordered_set<String> alphaTestMaterials;
+	SetAlphaTestMaterials(alphaTestMaterials);
+
+	assimpScene.Read(&scene->numMaterials, sizeof(uint32_t));
+	scene->materials = (Material*)conf_calloc(scene->numMaterials, sizeof(Material));
+	scene->textures = (const char**)conf_calloc(scene->numMaterials, sizeof(char*));
+	scene->normalMaps = (const char**)conf_calloc(scene->numMaterials, sizeof(char*));
+	scene->specularMaps = (const char**)conf_calloc(scene->numMaterials, sizeof(char*));
+
+#ifdef ORBIS
+#define DEFAULT_ALBEDO "default.gnf"
+#define DEFAULT_NORMAL "default_nrm.gnf"
+#define DEFAULT_SPEC   "default_spec.gnf"
+#else
+#define DEFAULT_ALBEDO "default.dds"
+#define DEFAULT_NORMAL "default_nrm.dds"
+#define DEFAULT_SPEC "default.dds"
+#endif
+
+	// Texture names are interned, materials sharing a texture share its name and nothing is freed per material
+	tinystl::vector<char> matName;
+	tinystl::vector<char> albedoName;
+	for (uint32_t i = 0; i < scene->numMaterials; i++)
+	{
+		Material& m = scene->materials[i];
+		m.twoSided = false;
+
+		uint32_t matNameLength = 0;
+		assimpScene.Read(&matNameLength, sizeof(uint32_t));
+
+		matName.resize(matNameLength);
+		assimpScene.Read(matName.data(), sizeof(char) * matNameLength);
+
+		uint32_t albedoNameLength = 0;
+		assimpScene.Read(&albedoNameLength, sizeof(uint32_t));
+
+		albedoName.resize(albedoNameLength);
+		assimpScene.Read(albedoName.data(), sizeof(char)*albedoNameLength);
+
+		if (albedoName[0] != '\0')
+		{
+			String path(albedoName.data());
+			uint dotPos = 0;
+#ifdef ORBIS
+			// try to load the GNF version instead: change extension to GNF
+			path.rfind('.', -1, &dotPos);
+			path.resize(dotPos);
+			path[dotPos] = '\0';
+			path.append(".gnf", 4);
+#endif
+			String base_filename = FileSystem::GetFileNameAndExtension(path);
+			internName(base_filename, &scene->textures[i]);
+
+			// try load the associated normal map 
+			String normalMap(base_filename);
+			normalMap.rfind('.', -1, &dotPos);
+			normalMap.insert(dotPos, "_NRM", 4);
+
+			if (FileSystem::FileExists(normalMap, FSR_Textures))
+				internName(normalMap, &scene->normalMaps[i]);
+			else
+				internName(DEFAULT_NORMAL, &scene->normalMaps[i]);
+
+			// try load the associated spec map 
+			String specMap(base_filename);
+			dotPos = 0;
+			specMap.rfind('.', -1, &dotPos);
+			specMap.insert(dotPos, "_SPEC", 5);
+
+			if (FileSystem::FileExists(specMap, FSR_Textures))
+				internName(specMap, &scene->specularMaps[i]);
+			else
+				internName(DEFAULT_SPEC, &scene->specularMaps[i]);
+		}
+		else
+		{
+			// default textures
+			internName(DEFAULT_ALBEDO, &scene->textures[i]);
+			internName(DEFAULT_NORMAL, &scene->normalMaps[i]);
+			internName(DEFAULT_SPEC, &scene->specularMaps[i]);
+		}
+
+		float ns = 0.0f;
+		assimpScene.Read(&ns, sizeof(float));  // load shininess
+
+		int twoSided = 0;
+		assimpScene.Read(&twoSided, sizeof(float));  // load two sided
+		m.twoSided = (twoSided != 0);
+
+		String tinyMatName(matName.data());
+		if (twoSidedMaterials.find(tinyMatName) != twoSidedMaterials.end())
+			m.twoSided = true;
+
+		m.alphaTested = (alphaTestMaterials.find(tinyMatName) != alphaTestMaterials.end());
+	}
+
+	assimpScene.Close();
+    
+#ifdef METAL
+    // Once we have read all the geometry from the original asset, expand indices into vertices so the models are compatible with Metal implementation.
+    uint32_t expandedVertexCount = 0;
+    for (uint32_t i = 0; i < scene->numMeshes; i++)
+        expandedVertexCount += scene->meshes[i].vertexCount; // Index count is stored in the vertex count member when reading the mesh on Metal.
+
+    SceneVertexPos* positions = (SceneVertexPos*)conf_malloc(expandedVertexCount * sizeof(SceneVertexPos));
+    SceneVertexTexCoord* texCoords = (SceneVertexTexCoord*)conf_malloc(expandedVertexCount * sizeof(SceneVertexTexCoord));
+    SceneVertexNormal* normals = (SceneVertexNormal*)conf_malloc(expandedVertexCount * sizeof(SceneVertexNormal));
+    SceneVertexTangent* tangents = (SceneVertexTangent*)conf_malloc(expandedVertexCount * sizeof(SceneVertexTangent));
+
+    scene->totalTriangles = 0;
+    scene->totalVertices = 0;
+
+    uint32_t originalIdx = 0;
+    uint32_t vertex = 0;
+    for (uint32_t i = 0; i < scene->numMeshes; i++)
+    {
+        scene->meshes[i].startVertex = vertex;
+
+        uint32_t idxCount = scene->meshes[i].vertexCount;
+        for (uint32_t j = 0; j < idxCount; j++, vertex++)
+        {
+            uint32_t idx = scene->indices[originalIdx++];
+            positions[vertex] = scene->positions[idx];
+            texCoords[vertex] = scene->texCoords[idx];
+            normals[vertex] = scene->normals[idx];
+            tangents[vertex] = scene->tangents[idx];
+        }
+        scene->meshes[i].vertexCount = vertex - scene->meshes[i].startVertex;
+        scene->meshes[i].triangleCount = scene->meshes[i].vertexCount / 3;
+        scene->totalTriangles += scene->meshes[i].triangleCount;
+        scene->totalVertices += scene->meshes[i].vertexCount;
+    }
+
+    conf_free(scene->indices);
+    conf_free(scene->positions);
+    conf_free(scene->texCoords);
+    conf_free(scene->normals);
+    conf_free(scene->tangents);
+
+    scene->indices = NULL;
+    scene->positions = positions;
+    scene->texCoords = texCoords;
+    scene->normals = normals;
+    scene->tangents = tangents;
+#endif
+
+	return scene;
+}
+
+void removeScene(Scene* scene)
+{
+	for (uint32_t i = 0; i < scene->numMeshes; ++i)
+	{
+		// Cooked clusters live in the mapping
+		if (!scene->pCookedFile)
+		{
+			conf_free(scene->meshes[i].clusters);
+			conf_free(scene->meshes[i].clusterCompacts);
+		}
+	}
+
+	if (scene->pCookedFile)
+	{
+		scene->pCookedFile->~MappedFile();
+		conf_free(scene->pCookedFile);
+	}
+	else
+	{
+		conf_free(scene->positions);
+		conf_free(scene->texCoords);
+		conf_free(scene->normals);
+		conf_free(scene->tangents);
+		conf_free(scene->indices);
+	}
+
+	conf_free(scene->textures);
+	conf_free(scene->normalMaps);
+	conf_free(scene->specularMaps);
+	conf_free(scene->meshes);
+	conf_free(scene->materials);
+	conf_free(scene);
+}
+
+/************************************************************************/
+// Cooked scene
+/************************************************************************/
+// Bump when the cooked layout, the vertex encoding or the cluster generation changes
+#define COOKED_SCENE_VERSION 2
+#define COOKED_SCENE_MAGIC 0x4E435342 // 'BSCN'
+// Sections start on a cache line, the mapping itself is page aligned
+#define COOKED_SCENE_ALIGNMENT 64
+
+#if defined(METAL)
+#define COOKED_SCENE_PLATFORM 1 // Expanded vertices, float normals and texture coordinates
+#else
+#define COOKED_SCENE_PLATFORM 0 // Indexed vertices, packed normals and texture coordinates
+#endif
+
+enum CookedSceneSectionType
+{
+	COOKED_SECTION_POSITIONS = 0,
+	COOKED_SECTION_TEXCOORDS,
+	COOKED_SECTION_NORMALS,
+	COOKED_SECTION_TANGENTS,
+	COOKED_SECTION_INDICES,
+	COOKED_SECTION_MESHES,
+	COOKED_SECTION_MATERIALS,
+	COOKED_SECTION_CLUSTER_COMPACTS,
+	COOKED_SECTION_CLUSTERS,
+	COOKED_SECTION_STRINGS,
+	COOKED_SECTION_COUNT
+};
+
+typedef struct CookedSceneSection
+{
+	uint64_t offset;
+	uint64_t size;
+} CookedSceneSection;
+
+typedef struct CookedSceneHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t platform;
+	uint32_t clusterSize;
+	uint32_t clusterStride;
+	uint32_t numMeshes;
+	uint32_t numMaterials;
+	uint32_t totalTriangles;
+	uint32_t totalVertices;
+	uint32_t totalClusters;
+	// The modification time only lets a load skip hashing an unchanged source, otherwise size and hash decide
+	uint32_t sourceModifiedTime;
+	uint32_t padding;
+	uint64_t sourceSize;
+	uint64_t sourceHash;
+	CookedSceneSection sections[COOKED_SECTION_COUNT];
+} CookedSceneHeader;
+
+typedef struct CookedMesh
+{
+	uint32_t start;        // startIndex, or startVertex on Metal
+	uint32_t count;        // indexCount, or triangleCount on Metal
+	uint32_t vertexCount;
+	uint32_t materialId;
+	uint32_t firstCluster; // Clusters of all meshes are stored back to back
+	uint32_t clusterCount;
+} CookedMesh;
+
+typedef struct CookedMaterial
+{
+	uint32_t twoSided;
+	uint32_t alphaTested;
+	// Offsets of the NUL terminated texture names in the string section
+	uint32_t texture;
+	uint32_t normalMap;
+	uint32_t specularMap;
+} CookedMaterial;
+
+static void addCookedSection(CookedSceneHeader* pHeader, uint32_t section, uint64_t size, uint64_t* pOffset)
+{
+	*pOffset = (*pOffset + COOKED_SCENE_ALIGNMENT - 1) & ~(uint64_t)(COOKED_SCENE_ALIGNMENT - 1);
+	pHeader->sections[section].offset = *pOffset;
+	pHeader->sections[section].size = size;
+	*pOffset += size;
+}
+
+static void padCookedSection(File* pFile, const CookedSceneSection& section)
+{
+	static const uint8_t zeros[COOKED_SCENE_ALIGNMENT] = {};
+	ASSERT(section.offset >= pFile->GetPosition() && section.offset - pFile->GetPosition() < COOKED_SCENE_ALIGNMENT);
+	pFile->Write(zeros, (unsigned)(section.offset - pFile->GetPosition()));
+}
+
+// Hashes the bytes of the source scene so a cooked scene can be matched to it independently of file times
+static bool hashSceneSource(const char* sourceFileName, uint64_t* pSize, uint64_t* pHash)
+{
+	MappedFile source;
+	if (!source.Open(sourceFileName, FSRoot::FSR_Absolute))
+		return false;
+
+	// The mapping is page aligned
+	const uint8_t* pBytes = (const uint8_t*)source.GetData();
+	const size_t wordCount = source.GetSize() / sizeof(uint32_t);
+	uint64_t hash = tinystl::hash_range((const uint32_t*)pBytes, (const uint32_t*)pBytes + wordCount, 2166136261U);
+	for (size_t i = wordCount * sizeof(uint32_t); i < source.GetSize(); ++i)
+		hash = 16777619U * hash ^ pBytes[i];
+
+	*pSize = source.GetSize();
+	*pHash = hash;
+	return true;
+}
+
+static uint32_t addCookedString(tinystl::vector<char>& strings, const char* str)
+{
+	const uint32_t offset = (uint32_t)strings.size();
+	strings.insert(strings.end(), str, str + strlen(str) + 1);
+	return offset;
+}
+
+bool cookScene(const Scene* pScene, const char* sourceFileName, const char* fileName)
+{
+	uint32_t totalClusters = 0;
+	tinystl::vector<CookedMesh> meshes(pScene->numMeshes);
+	for (uint32_t i = 0; i < pScene->numMeshes; ++i)
+	{
+		const Mesh& mesh = pScene->meshes[i];
+		CookedMesh& cookedMesh = meshes[i];
+#if defined(METAL)
+		cookedMesh.start = mesh.startVertex;
+		cookedMesh.count = mesh.triangleCount;
+#else
+		cookedMesh.start = mesh.startIndex;
+		cookedMesh.count = mesh.indexCount;
+#endif
+		cookedMesh.vertexCount = mesh.vertexCount;
+		cookedMesh.materialId = mesh.materialId;
+		cookedMesh.firstCluster = totalClusters;
+		cookedMesh.clusterCount = mesh.clusterCount;
+		totalClusters += mesh.clusterCount;
+	}
+
+	tinystl::vector<char> strings;
+	tinystl::vector<CookedMaterial> materials(pScene->numMaterials);
+	for (uint32_t i = 0; i < pScene->numMaterials; ++i)
+	{
+		materials[i].twoSided = pScene->materials[i].twoSided;
+		materials[i].alphaTested = pScene->materials[i].alphaTested;
+		materials[i].texture = addCookedString(strings, pScene->textures[i]);
+		materials[i].normalMap = addCookedString(strings, pScene->normalMaps[i]);
+		materials[i].specularMap = addCookedString(strings, pScene->specularMaps[i]);
+	}
+
+	CookedSceneHeader header = {};
+	header.magic = COOKED_SCENE_MAGIC;
+	header.version = COOKED_SCENE_VERSION;
+	header.platform = COOKED_SCENE_PLATFORM;
+	header.clusterSize = CLUSTER_SIZE;
+	header.clusterStride = sizeof(Cluster);
+	header.numMeshes = pScene->numMeshes;
+	header.numMaterials = pScene->numMaterials;
+	header.totalTriangles = pScene->totalTriangles;
+	header.totalVertices = pScene->totalVertices;
+	header.totalClusters = totalClusters;
+	header.sourceModifiedTime = FileSystem::GetLastModifiedTime(sourceFileName);
+	if (!hashSceneSource(sourceFileName, &header.sourceSize, &header.sourceHash))
+	{
+		LOGWARNINGF("Could not read scene %s to cook it", sourceFileName);
+		return false;
+	}
+
+	uint64_t offset = sizeof(header);
+	addCookedSection(&header, COOKED_SECTION_POSITIONS, pScene->totalVertices * sizeof(SceneVertexPos), &offset);
+	addCookedSection(&header, COOKED_SECTION_TEXCOORDS, pScene->totalVertices * sizeof(SceneVertexTexCoord), &offset);
+	addCookedSection(&header, COOKED_SECTION_NORMALS, pScene->totalVertices * sizeof(SceneVertexNormal), &offset);
+	addCookedSection(&header, COOKED_SECTION_TANGENTS, pScene->totalVertices * sizeof(SceneVertexTangent), &offset);
+	addCookedSection(&header, COOKED_SECTION_INDICES, pScene->indices ? pScene->totalTriangles * sizeof(uint32_t) : 0, &offset);
+	addCookedSection(&header, COOKED_SECTION_MESHES, meshes.size() * sizeof(CookedMesh), &offset);
+	addCookedSection(&header, COOKED_SECTION_MATERIALS, materials.size() * sizeof(CookedMaterial), &offset);
+	addCookedSection(&header, COOKED_SECTION_CLUSTER_COMPACTS, totalClusters * sizeof(ClusterCompact), &offset);
+	addCookedSection(&header, COOKED_SECTION_CLUSTERS, totalClusters * sizeof(Cluster), &offset);
+	addCookedSection(&header, COOKED_SECTION_STRINGS, strings.size(), &offset);
+
+	// File offsets are 32 bit
+	if (offset >= (1ULL << 32))
+	{
+		LOGWARNINGF("Scene %s is too large to be cooked", sourceFileName);
+		return false;
+	}
+
+	File cookedFile = {};
+	if (!cookedFile.Open(fileName, FileMode::FM_WriteBinary, FSRoot::FSR_Absolute))
+	{
+		LOGWARNINGF("Could not write cooked scene %s", fileName);
+		return false;
+	}
+
+	const void* pSectionData[COOKED_SECTION_COUNT] = {};
+	pSectionData[COOKED_SECTION_POSITIONS] = pScene->positions;
+	pSectionData[COOKED_SECTION_TEXCOORDS] = pScene->texCoords;
+	pSectionData[COOKED_SECTION_NORMALS] = pScene->normals;
+	pSectionData[COOKED_SECTION_TANGENTS] = pScene->tangents;
+	pSectionData[COOKED_SECTION_INDICES] = pScene->indices;
+	pSectionData[COOKED_SECTION_MESHES] = meshes.data();
+	pSectionData[COOKED_SECTION_MATERIALS] = materials.data();
+	pSectionData[COOKED_SECTION_STRINGS] = strings.data();
+
+	cookedFile.Write(&header, sizeof(header));
+	for (uint32_t i = 0; i < COOKED_SECTION_COUNT; ++i)
+	{
+		padCookedSection(&cookedFile, header.sections[i]);
+
+		// Clusters are owned per mesh and get concatenated
+		if (i == COOKED_SECTION_CLUSTER_COMPACTS)
+		{
+			for (uint32_t j = 0; j < pScene->numMeshes; ++j)
+				cookedFile.Write(pScene->meshes[j].clusterCompacts, pScene->meshes[j].clusterCount * sizeof(ClusterCompact));
+		}
+		else if (i == COOKED_SECTION_CLUSTERS)
+		{
+			for (uint32_t j = 0; j < pScene->numMeshes; ++j)
+				cookedFile.Write(pScene->meshes[j].clusters, pScene->meshes[j].clusterCount * sizeof(Cluster));
+		}
+		else
+		{
+			cookedFile.Write(pSectionData[i], (unsigned)header.sections[i].size);
+		}
+	}
+
+	const bool complete = cookedFile.GetSize() == offset;
+	cookedFile.Close();
+
+	if (!complete)
+		LOGWARNINGF("Could not write cooked scene %s", fileName);
+
+	return complete;
+}
+
+static bool isCookedSceneValid(const MappedFile* pFile, const char* sourceFileName)
+{
+	if (pFile->GetSize() < sizeof(CookedSceneHeader))
+		return false;
+
+	const CookedSceneHeader* pHeader = (const CookedSceneHeader*)pFile->GetData();
+	if (pHeader->magic != COOKED_SCENE_MAGIC || pHeader->version != COOKED_SCENE_VERSION || pHeader->platform != COOKED_SCENE_PLATFORM ||
+		pHeader->clusterSize != CLUSTER_SIZE || pHeader->clusterStride != sizeof(Cluster))
+		return false;
+
+	// The source is optional so cooked scenes can be shipped on their own, but if it is given it has to exist
+	if (sourceFileName)
+	{
+		if (!FileSystem::FileExists(sourceFileName, FSRoot::FSR_Absolute))
+			return false;
+
+		// An unchanged time skips hashing, a touched but identical source still matches by content
+		const unsigned sourceModifiedTime = FileSystem::GetLastModifiedTime(sourceFileName);
+		if (sourceModifiedTime == (unsigned)~0 || sourceModifiedTime != pHeader->sourceModifiedTime)
+		{
+			uint64_t sourceSize = 0;
+			uint64_t sourceHash = 0;
+			if (!hashSceneSource(sourceFileName, &sourceSize, &sourceHash) || sourceSize != pHeader->sourceSize || sourceHash != pHeader->sourceHash)
+				return false;
+		}
+	}
+
+	const uint64_t expectedSizes[COOKED_SECTION_COUNT] =
+	{
+		pHeader->totalVertices * (uint64_t)sizeof(SceneVertexPos),
+		pHeader->totalVertices * (uint64_t)sizeof(SceneVertexTexCoord),
+		pHeader->totalVertices * (uint64_t)sizeof(SceneVertexNormal),
+		pHeader->totalVertices * (uint64_t)sizeof(SceneVertexTangent),
+		COOKED_SCENE_PLATFORM ? 0 : pHeader->totalTriangles * (uint64_t)sizeof(uint32_t),
+		pHeader->numMeshes * (uint64_t)sizeof(CookedMesh),
+		pHeader->numMaterials * (uint64_t)sizeof(CookedMaterial),
+		pHeader->totalClusters * (uint64_t)sizeof(ClusterCompact),
+		pHeader->totalClusters * (uint64_t)sizeof(Cluster),
+		pHeader->sections[COOKED_SECTION_STRINGS].size,
+	};
+
+	for (uint32_t i = 0; i < COOKED_SECTION_COUNT; ++i)
+	{
+		const CookedSceneSection& section = pHeader->sections[i];
+		if (section.size != expectedSizes[i] || (section.offset & (COOKED_SCENE_ALIGNMENT - 1)) ||
+			section.offset > pFile->GetSize() || section.size > pFile->GetSize() - section.offset)
+			return false;
+	}
+
+	// Every texture name has to be terminated inside the string section
+	const CookedSceneSection& strings = pHeader->sections[COOKED_SECTION_STRINGS];
+	const char* pStrings = (const char*)pFile->GetData() + strings.offset;
+	if (pHeader->numMaterials && (!strings.size || pStrings[strings.size - 1] != '\0'))
+		return false;
+
+	const CookedMaterial* pMaterials = (const CookedMaterial*)((const uint8_t*)pFile->GetData() + pHeader->sections[COOKED_SECTION_MATERIALS].offset);
+	for (uint32_t i = 0; i < pHeader->numMaterials; ++i)
+	{
+		if (pMaterials[i].texture >= strings.size || pMaterials[i].normalMap >= strings.size || pMaterials[i].specularMap >= strings.size)
+			return false;
+	}
+
+	const CookedMesh* pMeshes = (const CookedMesh*)((const uint8_t*)pFile->GetData() + pHeader->sections[COOKED_SECTION_MESHES].offset);
+	for (uint32_t i = 0; i < pHeader->numMeshes; ++i)
+	{
+		if (pMeshes[i].materialId >= pHeader->numMaterials || pMeshes[i].firstCluster > pHeader->totalClusters ||
+			pMeshes[i].clusterCount > pHeader->totalClusters - pMeshes[i].firstCluster)
+			return false;
+	}
+
+	return true;
+}
+
+Scene* loadCookedScene(const char* fileName, const char* sourceFileName)
+{
+	if (!FileSystem::FileExists(fileName, FSRoot::FSR_Absolute))
+		return NULL;
+
+	MappedFile* pCookedFile = conf_placement_new<MappedFile>(conf_calloc(1, sizeof(MappedFile)));
+	if (!pCookedFile->Open(fileName, FSRoot::FSR_Absolute) || !isCookedSceneValid(pCookedFile, sourceFileName))
+	{
+		LOGINFOF("Cooked scene %s is missing or out of date", fileName);
+		pCookedFile->~MappedFile();
+		conf_free(pCookedFile);
+		return NULL;
+	}
+
+	// The mapping is read only, the casts below only drop const for the Scene interface
+	uint8_t* pData = (uint8_t*)pCookedFile->GetData();
+	const CookedSceneHeader* pHeader = (const CookedSceneHeader*)pData;
+	const CookedSceneSection* pSections = pHeader->sections;
+
+	Scene* scene = (Scene*)conf_calloc(1, sizeof(Scene));
+	scene->pCookedFile = pCookedFile;
+	scene->numMeshes = pHeader->numMeshes;
+	scene->numMaterials = pHeader->numMaterials;
+	scene->totalTriangles = pHeader->totalTriangles;
+	scene->totalVertices = pHeader->totalVertices;
+
+	scene->positions = (SceneVertexPos*)(pData + pSections[COOKED_SECTION_POSITIONS].offset);
+	scene->texCoords = (SceneVertexTexCoord*)(pData + pSections[COOKED_SECTION_TEXCOORDS].offset);
+	scene->normals = (SceneVertexNormal*)(pData + pSections[COOKED_SECTION_NORMALS].offset);
+	scene->tangents = (SceneVertexTangent*)(pData + pSections[COOKED_SECTION_TANGENTS].offset);
+	scene->indices = pSections[COOKED_SECTION_INDICES].size ? (uint32_t*)(pData + pSections[COOKED_SECTION_INDICES].offset) : NULL;
+
+	ClusterCompact* pClusterCompacts = (ClusterCompact*)(pData + pSections[COOKED_SECTION_CLUSTER_COMPACTS].offset);
+	Cluster* pClusters = (Cluster*)(pData + pSections[COOKED_SECTION_CLUSTERS].offset);
+	const CookedMesh* pMeshes = (const CookedMesh*)(pData + pSections[COOKED_SECTION_MESHES].offset);
+
+	scene->meshes = (Mesh*)conf_calloc(scene->numMeshes, sizeof(Mesh));
+	for (uint32_t i = 0; i < scene->numMeshes; ++i)
+	{
+		Mesh& mesh = scene->meshes[i];
+#if defined(METAL)
+		mesh.startVertex = pMeshes[i].start;
+		mesh.triangleCount = pMeshes[i].count;
+#else
+		mesh.startIndex = pMeshes[i].start;
+		mesh.indexCount = pMeshes[i].count;
+#endif
+		mesh.vertexCount = pMeshes[i].vertexCount;
+		mesh.materialId = pMeshes[i].materialId;
+		mesh.clusterCount = pMeshes[i].clusterCount;
+		mesh.clusterCompacts = pClusterCompacts + pMeshes[i].firstCluster;
+		mesh.clusters = pClusters + pMeshes[i].firstCluster;
+	}
+
+	char* pStrings = (char*)(pData + pSections[COOKED_SECTION_STRINGS].offset);
+	const CookedMaterial* pMaterials = (const CookedMaterial*)(pData + pSections[COOKED_SECTION_MATERIALS].offset);
+
+	scene->materials = (Material*)conf_calloc(scene->numMaterials, sizeof(Material));
+	scene->textures = (const char**)conf_calloc(scene->numMaterials, sizeof(char*));
+	scene->normalMaps = (const char**)conf_calloc(scene->numMaterials, sizeof(char*));
+	scene->specularMaps = (const char**)conf_calloc(scene->numMaterials, sizeof(char*));
+	for (uint32_t i = 0; i < scene->numMaterials; ++i)
+	{
+		scene->materials[i].twoSided = pMaterials[i].twoSided != 0;
+		scene->materials[i].alphaTested = pMaterials[i].alphaTested != 0;
+		scene->textures[i] = pStrings + pMaterials[i].texture;
+		scene->normalMaps[i] = pStrings + pMaterials[i].normalMap;
+		scene->specularMaps[i] = pStrings + pMaterials[i].specularMap;
+	}
+
+	return scene;
+}
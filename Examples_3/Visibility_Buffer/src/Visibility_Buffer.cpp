@@ -448,6 +448,10 @@ Gui*							pGuiWindow = nullptr;
 /************************************************************************/
 // Triangle filtering data
 /************************************************************************/
+ClusterCullData*				pClusterCullData = nullptr;
+uint8_t*						pClusterVisibility = nullptr;
+// Clusters are culled on the main thread and these workers
+ThreadPool						gThreadSystem;
 #if defined(METAL)
 FilterBatchChunk*				pFilterBatchChunk[gImageCount] = { nullptr };
 #else
@@ -562,14 +566,33 @@ public:
 		addSampler(pRenderer, &pSamplerBilinear, FILTER_BILINEAR, FILTER_BILINEAR, MIPMAP_MODE_LINEAR, ADDRESS_MODE_REPEAT, ADDRESS_MODE_REPEAT, ADDRESS_MODE_REPEAT, 0.0f, 8.0f);
 		addSampler(pRenderer, &pSamplerPointClamp, FILTER_NEAREST, FILTER_NEAREST, MIPMAP_MODE_NEAREST, ADDRESS_MODE_CLAMP_TO_EDGE, ADDRESS_MODE_CLAMP_TO_EDGE, ADDRESS_MODE_CLAMP_TO_EDGE);
 		/************************************************************************/
-		// Load the scene using the SceneLoader class, which uses Assimp
+		// Load the scene. The cooked scene next to the source is mapped directly, if it is missing
+		// or out of date the source scene is converted, its clusters are created and the result is cooked.
 		/************************************************************************/
+		gThreadSystem.CreateThreads(Thread::GetNumCPUCores() - 1);
+
 		HiresTimer sceneLoadTimer;
 		String sceneFullPath = FileSystem::FixPath(gSceneName, FSRoot::FSR_Meshes);
-		pScene = loadScene(sceneFullPath.c_str());
-		if (!pScene)
-			return false;
-		LOGINFOF("Load assimp scene : %f ms", sceneLoadTimer.GetUSec(true) / 1000.0f);
+		String cookedScenePath = sceneFullPath + ".cooked";
+		pScene = loadCookedScene(cookedScenePath.c_str(), sceneFullPath.c_str());
+		const bool sceneCooked = pScene != NULL;
+		if (!sceneCooked)
+		{
+			pScene = loadScene(sceneFullPath.c_str());
+			if (!pScene)
+				return false;
+			LOGINFOF("Load source scene : %f ms", sceneLoadTimer.GetUSec(true) / 1000.0f);
+
+			HiresTimer clusterTimer;
+			CreateClusters(&gThreadSystem, pScene);
+			LOGINFOF("Create clusters : %f ms", clusterTimer.GetUSec(true) / 1000.0f);
+
+#if !defined(TARGET_IOS)
+			// The app bundle is read only on iOS, cooked scenes can only be shipped with it there
+			cookScene(pScene, sceneFullPath.c_str(), cookedScenePath.c_str());
+#endif
+		}
+		LOGINFOF("Load scene (%s) : %f ms", sceneCooked ? "warm, cooked" : "cold, converted", sceneLoadTimer.GetUSec(true) / 1000.0f);
 		/************************************************************************/
 		// IA buffers
 		/************************************************************************/
@@ -584,7 +607,7 @@ public:
 		ibDesc.mDesc.mElementCount = pScene->totalTriangles;
 		ibDesc.mDesc.mStructStride = sizeof(uint32_t);
 		ibDesc.mDesc.mSize = ibDesc.mDesc.mElementCount * ibDesc.mDesc.mStructStride;
-		ibDesc.pData = pScene->indices.data();
+		ibDesc.pData = pScene->indices;
 		ibDesc.ppBuffer = &pIndexBufferAll;
 		ibDesc.mDesc.pDebugName = L"Non-filtered Index Buffer Desc";
 		addResource(&ibDesc);
@@ -619,7 +642,7 @@ public:
 		vbPosDesc.mDesc.mElementCount = pScene->totalVertices;
 		vbPosDesc.mDesc.mStructStride = sizeof(SceneVertexPos);
 		vbPosDesc.mDesc.mSize = vbPosDesc.mDesc.mElementCount * vbPosDesc.mDesc.mStructStride;
-		vbPosDesc.pData = pScene->positions.data();
+		vbPosDesc.pData = pScene->positions;
 		vbPosDesc.ppBuffer = &pVertexBufferPosition;
 		vbPosDesc.mDesc.pDebugName = L"Vertex Position Buffer Desc";
 		addResource(&vbPosDesc);
@@ -632,7 +655,7 @@ public:
 		vbTexCoordDesc.mDesc.mElementCount = pScene->totalVertices * (sizeof(SceneVertexTexCoord) / sizeof(uint32_t));
 		vbTexCoordDesc.mDesc.mStructStride = sizeof(uint32_t);
 		vbTexCoordDesc.mDesc.mSize = vbTexCoordDesc.mDesc.mElementCount * vbTexCoordDesc.mDesc.mStructStride;
-		vbTexCoordDesc.pData = pScene->texCoords.data();
+		vbTexCoordDesc.pData = pScene->texCoords;
 		vbTexCoordDesc.ppBuffer = &pVertexBufferTexCoord;
 		vbTexCoordDesc.mDesc.pDebugName = L"Vertex TexCoord Buffer Desc";
 		addResource(&vbTexCoordDesc);
@@ -645,7 +668,7 @@ public:
 		vbNormalDesc.mDesc.mElementCount = pScene->totalVertices * (sizeof(SceneVertexNormal) / sizeof(uint32_t));
 		vbNormalDesc.mDesc.mStructStride = sizeof(uint32_t);
 		vbNormalDesc.mDesc.mSize = vbNormalDesc.mDesc.mElementCount * vbNormalDesc.mDesc.mStructStride;
-		vbNormalDesc.pData = pScene->normals.data();
+		vbNormalDesc.pData = pScene->normals;
 		vbNormalDesc.ppBuffer = &pVertexBufferNormal;
 		vbNormalDesc.mDesc.pDebugName = L"Vertex Normal Buffer Desc";
 		addResource(&vbNormalDesc);
@@ -658,24 +681,17 @@ public:
 		vbTangentDesc.mDesc.mElementCount = pScene->totalVertices * (sizeof(SceneVertexTangent) / sizeof(uint32_t));
 		vbTangentDesc.mDesc.mStructStride = sizeof(uint32_t);
 		vbTangentDesc.mDesc.mSize = vbTangentDesc.mDesc.mElementCount * vbTangentDesc.mDesc.mStructStride;
-		vbTangentDesc.pData = pScene->tangents.data();
+		vbTangentDesc.pData = pScene->tangents;
 		vbTangentDesc.ppBuffer = &pVertexBufferTangent;
 		vbTangentDesc.mDesc.pDebugName = L"Vertex Tangent Buffer Desc";
 		addResource(&vbTangentDesc);
 
 		LOGINFOF("Load scene buffers : %f ms", bufferLoadTimer.GetUSec(true) / 1000.0f);
 		/************************************************************************/
-		// Cluster creation
+		// Cluster culling data
 		/************************************************************************/
-		HiresTimer clusterTimer;
-		// Calculate clusters
-		for (uint32_t i = 0; i < pScene->numMeshes; ++i)
-		{
-			Mesh* mesh = pScene->meshes + i;
-			Material* material = pScene->materials + mesh->materialId;
-			CreateClusters(material->twoSided, pScene, mesh);
-		}
-		LOGINFOF("Load clusters : %f ms", clusterTimer.GetUSec(true) / 1000.0f);
+		addClusterCullData(pScene, &pClusterCullData);
+		pClusterVisibility = (uint8_t*)conf_calloc(pClusterCullData->paddedClusterCount, sizeof(uint8_t));
 		/************************************************************************/
 		// Texture loading
 		/************************************************************************/
@@ -684,6 +700,8 @@ public:
 		gNormalMaps = tinystl::vector<Texture*>(pScene->numMaterials);
 		gSpecularMaps = tinystl::vector<Texture*>(pScene->numMaterials);
 
+		// Textures are uploaded in a few large copy batches, the token of the last one covers all of them
+		SyncToken textureToken = 0;
 		for (uint32_t i = 0; i < pScene->numMaterials; ++i)
 		{
 			TextureLoadDesc diffuse = {};
@@ -692,22 +710,23 @@ public:
 			diffuse.mUseMipmaps = true;
 			diffuse.ppTexture = &gDiffuseMaps[i];
 			diffuse.mSrgb = true;
-			addResource(&diffuse);
+			addResource(&diffuse, &textureToken);
 
 			TextureLoadDesc normal = {};
 			normal.pFilename = pScene->normalMaps[i];
 			normal.mRoot = FSR_Textures;
 			normal.mUseMipmaps = true;
 			normal.ppTexture = &gNormalMaps[i];
-			addResource(&normal);
+			addResource(&normal, &textureToken);
 
 			TextureLoadDesc specular = {};
 			specular.pFilename = pScene->specularMaps[i];
 			specular.mRoot = FSR_Textures;
 			specular.mUseMipmaps = true;
 			specular.ppTexture = &gSpecularMaps[i];
-			addResource(&specular);
+			addResource(&specular, &textureToken);
 		}
+		waitForToken(textureToken);
 
 		LOGINFOF("Load textures : %f ms", textureLoadTimer.GetUSec(true) / 1000.0f);
 		/************************************************************************/
@@ -1289,7 +1308,7 @@ public:
 			setResourcesToComputeCompliantState(0, true);
 #endif
 
-		LOGINFOF("Total Load Time : %f ms", timer.GetUSec(true) / 1000.0f);
+		LOGINFOF("Total Load Time (%s) : %f ms", sceneCooked ? "warm" : "cold", timer.GetUSec(true) / 1000.0f);
 
 #ifndef _DURANGO
 		registerRawMouseMoveEvent(onMouseMoveHandler);
@@ -1380,12 +1399,9 @@ public:
 		removeResource(pVertexBufferNormal);
 		removeResource(pVertexBufferTangent);
 
-		// Destroy clusters
-		for (uint32_t i = 0; i < pScene->numMeshes; ++i)
-		{
-			conf_free(pScene->meshes[i].clusters);
-			conf_free(pScene->meshes[i].clusterCompacts);
-		}
+		// Destroy cluster culling data, the clusters are owned by the scene
+		removeClusterCullData(pClusterCullData);
+		conf_free(pClusterVisibility);
 		// Remove Textures
 		for (uint32_t i = 0; i < pScene->numMaterials; ++i)
 		{
@@ -3318,28 +3334,29 @@ public:
 	}
 #endif
 
-	// Determines if the cluster can be safely culled performing quick cone-based test on the CPU.
-	// Since the triangle filtering kernel operates with 2 views in the same pass, this method must
-	// only cull those clusters that are not visible from ANY of the views (camera and shadow views).
-	bool cullCluster(const Cluster* cluster, vec3 eyes[gNumViews])
+	struct ClusterCullJobData
 	{
-		// Invalid clusters can't be safely culled using the cone based test
-		if (cluster->valid)
-		{
-			uint visibility = 0;
-			for (uint32_t i = 0; i < gNumViews; i++)
-			{
-				// We move camera position into object space
-				vec3 testVec = normalize(eyes[i] - f3Tov3(cluster->coneCenter));
+		ClusterCullView mViews[gNumViews];
+	};
 
-				// Check if we are inside the cone
-				if (dot(testVec, f3Tov3(cluster->coneAxis)) < cluster->coneAngleCosine)
-					visibility |= (1 << i);
-			}
-			return (visibility == 0);
+	static void cullClusterRange(void* pData, uint32_t begin, uint32_t end)
+	{
+		const ClusterCullJobData* pJobData = (const ClusterCullJobData*)pData;
+		cullClusters(pClusterCullData, begin * CLUSTER_CULL_LANES, end * CLUSTER_CULL_LANES, gNumViews, pJobData->mViews, pClusterVisibility);
+	}
 
-		}
-		return false;
+	// Determines which clusters can be safely culled performing quick cone and frustum tests on the CPU.
+	// Since the triangle filtering kernel operates with 2 views in the same pass, only those clusters
+	// that are not visible from ANY of the views (camera and shadow views) get culled.
+	// The clusters are tested CLUSTER_CULL_LANES at a time on the main thread and the worker threads,
+	// the results are stored in pClusterVisibility.
+	void runClusterCulling(uint32_t frameIdx)
+	{
+		ClusterCullJobData jobData;
+		for (uint32_t i = 0; i < gNumViews; ++i)
+			getClusterCullView(gPerFrame[frameIdx].gPerFrameUniformData.transform[i].mvp, gPerFrame[frameIdx].gEyeObjectSpace[i], &jobData.mViews[i]);
+
+		parallelFor(&gThreadSystem, pClusterCullData->paddedClusterCount / CLUSTER_CULL_LANES, 256, cullClusterRange, &jobData);
 	}
 
 	static inline int genClipMask(__m128 v)
@@ -3486,20 +3503,22 @@ public:
 		filterParams[5].ppBuffers = &pFilteredIndexBuffer[frameIdx][VIEW_SHADOW];
 		cmdBindDescriptors(cmd, pRootSignatureTriangleFiltering, 6, filterParams);
 
-		// Iterate mesh clusters and perform cluster culling
+		// Perform CPU-based cluster culling before adding the clusters for GPU filtering
+		runClusterCulling(frameIdx);
+
+		// Iterate mesh clusters and batch the ones which passed cluster culling
 		uint32_t batchBufferOffset = 0;
 		for (uint32_t i = 0; i < pScene->numMeshes; i++)
 		{
 			const Mesh* mesh = pScene->meshes + i;
 			const Material* material = pScene->materials + mesh->materialId;
+			const uint8_t* pMeshVisibility = pClusterVisibility + pClusterCullData->meshClusterOffsets[i];
 			gPerFrame[frameIdx].gTotalClusters += mesh->clusterCount;
 			for (uint32_t j = 0; j < mesh->clusterCount; j++)
 			{
-				const Cluster* cluster = mesh->clusters + j;
 				const ClusterCompact* pClusterCompact = &mesh->clusterCompacts[j];
 
-				// Perform CPU-based cluster culling before adding the cluster for GPU filtering
-				if (cullCluster(cluster, gPerFrame[frameIdx].gEyeObjectSpace))
+				if (!pMeshVisibility[j])
 				{
 					gPerFrame[frameIdx].gCulledClusters++;
 					continue;
@@ -3731,16 +3750,20 @@ public:
 #endif
 
 #else
+		// Run cluster culling
+		if (gAppSettings.mClusterCulling)
+			runClusterCulling(frameIdx);
+
 		for (uint32_t i = 0; i < pScene->numMeshes; ++i)
 		{
 			Mesh* drawBatch = &pScene->meshes[i];
 			FilterBatchChunk* batchChunk = pFilterBatchChunk[frameIdx][currentSmallBatchChunk];
+			const uint8_t* pMeshVisibility = pClusterVisibility + pClusterCullData->meshClusterOffsets[i];
 			for (uint32_t j = 0; j < drawBatch->clusterCount; ++j)
 			{
 				++gPerFrame[frameIdx].gTotalClusters;
 				const ClusterCompact* clusterCompactInfo = &drawBatch->clusterCompacts[j];
-				// Run cluster culling
-				if (!gAppSettings.mClusterCulling || !cullCluster(&drawBatch->clusters[j], gPerFrame[frameIdx].gEyeObjectSpace))
+				if (!gAppSettings.mClusterCulling || pMeshVisibility[j])
 				{
 					// cluster culling passed or is turned off
 					// We will now add the cluster to the batch to be triangle filtered
@@ -4017,7 +4040,7 @@ public:
 		cmdUIDrawGUI(cmd, pUIManager, pGuiWindow);
 #endif
 
-		cmdUIEndRender(cmd, pUIManager);
+		cmdUIEndRender(cmd, pUIManager, pRenderCompleteFences[frameIdx]);
 
 		cmdEndRender(cmd, 1, &pScreenRenderTarget, NULL);
 #endif